@@ -0,0 +1,399 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <Windows.h>
+#include <compressapi.h>
+#include "BarCapture.h"
+
+typedef struct {
+    PUINT8 Data;
+    PUINT8 Compressed;
+    SIZE_T CompressedSize;
+    OVERLAPPED Overlapped;
+    bool Pending;
+}CAPTURE_BUFFER;
+
+static bool WaitForCaptureWrite(HANDLE File, CAPTURE_BUFFER& Buffer)
+{
+    DWORD bytesWritten = 0;
+
+    if (!Buffer.Pending) {
+        return true;
+    }
+
+    Buffer.Pending = false;
+    if (!GetOverlappedResult(File, &Buffer.Overlapped, &bytesWritten, TRUE)) {
+        std::cout << "Capture write failed, error: " << GetLastError() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+static bool StartCaptureWrite(HANDLE File, CAPTURE_BUFFER& Buffer, LPCVOID Data, DWORD Length, UINT64 FileOffset)
+{
+    ResetEvent(Buffer.Overlapped.hEvent);
+    Buffer.Overlapped.Offset = (DWORD)FileOffset;
+    Buffer.Overlapped.OffsetHigh = (DWORD)(FileOffset >> 32);
+
+    if (!WriteFile(File, Data, Length, NULL, &Buffer.Overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        std::cout << "Capture write failed, error: " << GetLastError() << std::endl;
+        return false;
+    }
+
+    Buffer.Pending = true;
+    return true;
+}
+
+static double ElapsedSeconds(const LARGE_INTEGER& Start, const LARGE_INTEGER& Frequency)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+}
+
+//
+// Reads a BAR into a ring of aligned buffers and writes every buffer to the
+// file asynchronously, so the next MMIO read overlaps the previous disk write.
+// Uncompressed captures bypass the file cache; compressed captures are
+// written as a BAR_CAPTURE_HEADER and BAR_CAPTURE_FRAME records and go
+// through the cache since their lengths are not sector multiples.
+//
+UserStatus CaptureBarToFile(CHardwareInterfaceLib& CHWLib, const BAR_CAPTURE_CONFIG& Config)
+{
+    UserStatus userStatus = Success;
+    CAPTURE_BUFFER Buffers[BAR_CAPTURE_MAX_BUFFERS];
+    UINT32 BufferCount = Config.BufferCount;
+    COMPRESSOR_HANDLE Compressor = NULL;
+    HANDLE File = INVALID_HANDLE_VALUE;
+    UINT64 Done = 0;
+    UINT64 FileOffset = 0;
+    UINT32 Index = 0;
+    int LastPercent = -1;
+    LARGE_INTEGER Frequency, Start;
+
+    if (BufferCount < BAR_CAPTURE_MIN_BUFFERS) {
+        BufferCount = BAR_CAPTURE_MIN_BUFFERS;
+    }
+    if (BufferCount > BAR_CAPTURE_MAX_BUFFERS) {
+        BufferCount = BAR_CAPTURE_MAX_BUFFERS;
+    }
+
+    memset(Buffers, 0, sizeof(Buffers));
+    for (UINT32 i = 0; i < BufferCount; i++)
+    {
+        //
+        // VirtualAlloc returns page aligned memory, which satisfies the
+        // sector alignment required by unbuffered writes.
+        //
+        Buffers[i].Data = (PUINT8)VirtualAlloc(NULL, BAR_CAPTURE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        Buffers[i].Overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (Buffers[i].Data == NULL || Buffers[i].Overlapped.hEvent == NULL) {
+            std::cout << "Capture buffer allocation failed" << std::endl;
+            userStatus = NullPointer;
+            goto Exit;
+        }
+
+        if (Config.Compress) {
+            Buffers[i].Compressed = (PUINT8)VirtualAlloc(NULL, sizeof(BAR_CAPTURE_FRAME) + 2 * BAR_CAPTURE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (Buffers[i].Compressed == NULL) {
+                std::cout << "Capture buffer allocation failed" << std::endl;
+                userStatus = NullPointer;
+                goto Exit;
+            }
+        }
+    }
+
+    if (Config.Compress && !CreateCompressor(COMPRESS_ALGORITHM_XPRESS, NULL, &Compressor)) {
+        std::cout << "CreateCompressor failed, error: " << GetLastError() << std::endl;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    File = CreateFileA(Config.FileName.c_str(),
+                       GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_FLAG_OVERLAPPED | (Config.Compress ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_NO_BUFFERING),
+                       NULL);
+    if (File == INVALID_HANDLE_VALUE) {
+        std::cout << "Unable to create " << Config.FileName << ", error: " << GetLastError() << std::endl;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if (Config.Compress) {
+        BAR_CAPTURE_HEADER Header;
+
+        Header.m_Magic = BAR_CAPTURE_MAGIC;
+        Header.m_Version = BAR_CAPTURE_VERSION;
+        Header.m_Algorithm = COMPRESS_ALGORITHM_XPRESS;
+        Header.m_ChunkSize = BAR_CAPTURE_BUFFER_SIZE;
+        Header.m_BarBase = Config.BarBase;
+        Header.m_Offset = Config.Offset;
+        Header.m_Length = Config.Length;
+        if (!StartCaptureWrite(File, Buffers[0], &Header, sizeof(Header), 0) || !WaitForCaptureWrite(File, Buffers[0])) {
+            userStatus = Failure;
+            goto Exit;
+        }
+        FileOffset = sizeof(Header);
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    while (Done < Config.Length)
+    {
+        CAPTURE_BUFFER& Buffer = Buffers[Index];
+        UINT32 Chunk = (Config.Length - Done > BAR_CAPTURE_BUFFER_SIZE) ? BAR_CAPTURE_BUFFER_SIZE : (UINT32)(Config.Length - Done);
+
+        //
+        // The buffer is reused once its previous write has completed.
+        //
+        if (!WaitForCaptureWrite(File, Buffer)) {
+            userStatus = Failure;
+            goto Exit;
+        }
+
+        userStatus = CHWLib.PCIeBarRead(Config.BarBase, Config.Offset + Done, Buffer.Data, Chunk);
+        if (userStatus != Success) {
+            std::cout << std::endl << "PCIeBarRead failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+            goto Exit;
+        }
+
+        if (Config.Compress) {
+            BAR_CAPTURE_FRAME Frame;
+
+            if (!Compress(Compressor, Buffer.Data, Chunk, Buffer.Compressed + sizeof(Frame), 2 * BAR_CAPTURE_BUFFER_SIZE, &Buffer.CompressedSize)) {
+                std::cout << std::endl << "Compress failed, error: " << GetLastError() << std::endl;
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            Frame.m_RawSize = Chunk;
+            Frame.m_CompressedSize = (UINT32)Buffer.CompressedSize;
+            Frame.m_Hash = CHash128::Compute(Buffer.Data, Chunk).m_Low;
+            memcpy(Buffer.Compressed, &Frame, sizeof(Frame));
+
+            if (!StartCaptureWrite(File, Buffer, Buffer.Compressed, (DWORD)(sizeof(Frame) + Buffer.CompressedSize), FileOffset)) {
+                userStatus = Failure;
+                goto Exit;
+            }
+            FileOffset += sizeof(Frame) + Buffer.CompressedSize;
+        }
+        else {
+            //
+            // Pad the last chunk to the write alignment, the file is cut
+            // back to the BAR length once all writes have completed.
+            //
+            DWORD WriteLength = (Chunk + BAR_CAPTURE_WRITE_ALIGNMENT - 1) & ~(BAR_CAPTURE_WRITE_ALIGNMENT - 1);
+            memset(Buffer.Data + Chunk, 0, WriteLength - Chunk);
+
+            if (!StartCaptureWrite(File, Buffer, Buffer.Data, WriteLength, FileOffset)) {
+                userStatus = Failure;
+                goto Exit;
+            }
+            FileOffset += WriteLength;
+        }
+
+        Done += Chunk;
+        Index = (Index + 1) % BufferCount;
+
+        int Percent = (int)((Done * 100) / Config.Length);
+        if (Percent != LastPercent) {
+            double Seconds = ElapsedSeconds(Start, Frequency);
+            LastPercent = Percent;
+            std::cout << "\rCaptured " << std::dec << (Done >> 20) << " MB of " << (Config.Length >> 20) << " MB (" << Percent << "%), "
+                << std::fixed << std::setprecision(1) << (Seconds > 0 ? (Done / 1048576.0) / Seconds : 0.0) << " MB/s" << std::flush;
+        }
+    }
+
+    for (UINT32 i = 0; i < BufferCount; i++)
+    {
+        if (!WaitForCaptureWrite(File, Buffers[i])) {
+            userStatus = Failure;
+            goto Exit;
+        }
+    }
+
+    {
+        double Seconds = ElapsedSeconds(Start, Frequency);
+        std::cout << std::endl << "Captured 0x" << std::hex << Config.Length << " bytes from BAR 0x" << Config.BarBase << " to " << Config.FileName
+            << std::dec << " in " << std::fixed << std::setprecision(3) << Seconds << " s, "
+            << std::setprecision(1) << (Seconds > 0 ? (Config.Length / 1048576.0) / Seconds : 0.0) << " MB/s";
+        if (Config.Compress) {
+            std::cout << ", " << FileOffset << " bytes written (" << std::setprecision(1)
+                << (FileOffset ? (double)Config.Length / (double)FileOffset : 0.0) << ":1)";
+        }
+        std::cout << std::endl;
+    }
+
+    if (!Config.Compress && FileOffset != Config.Length) {
+        //
+        // SetEndOfFile is not restricted to sector multiples on a handle
+        // opened with caching, so reopen it to drop the padding.
+        //
+        LARGE_INTEGER EndOfFile;
+
+        CloseHandle(File);
+        File = CreateFileA(Config.FileName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        EndOfFile.QuadPart = (LONGLONG)Config.Length;
+        if (File == INVALID_HANDLE_VALUE || !SetFilePointerEx(File, EndOfFile, NULL, FILE_BEGIN) || !SetEndOfFile(File)) {
+            std::cout << "Unable to truncate " << Config.FileName << ", error: " << GetLastError() << std::endl;
+            userStatus = Failure;
+        }
+    }
+
+Exit:
+    for (UINT32 i = 0; i < BufferCount; i++)
+    {
+        if (File != INVALID_HANDLE_VALUE) {
+            WaitForCaptureWrite(File, Buffers[i]);
+        }
+        if (Buffers[i].Overlapped.hEvent) {
+            CloseHandle(Buffers[i].Overlapped.hEvent);
+        }
+        if (Buffers[i].Data) {
+            VirtualFree(Buffers[i].Data, 0, MEM_RELEASE);
+        }
+        if (Buffers[i].Compressed) {
+            VirtualFree(Buffers[i].Compressed, 0, MEM_RELEASE);
+        }
+    }
+
+    if (File != INVALID_HANDLE_VALUE) {
+        CloseHandle(File);
+    }
+
+    if (Compressor) {
+        CloseCompressor(Compressor);
+    }
+
+    if (userStatus == Success && Config.Compress && Config.Verify) {
+        userStatus = ExpandBarCapture(Config.FileName, "");
+    }
+
+    return userStatus;
+}
+
+//
+// Expands a compressed capture to OutputFileName, or only checks it when
+// OutputFileName is empty. Every frame must decompress to its raw size and
+// hash, and the frames must add up to the length in the header.
+//
+UserStatus ExpandBarCapture(const std::string& FileName, const std::string& OutputFileName)
+{
+    UserStatus userStatus = Success;
+    BAR_CAPTURE_HEADER Header;
+    DECOMPRESSOR_HANDLE Decompressor = NULL;
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Output = INVALID_HANDLE_VALUE;
+    std::vector<UINT8> Compressed;
+    std::vector<UINT8> Raw;
+    UINT64 Done = 0;
+    UINT64 FileOffset = sizeof(Header);
+    UINT32 Frames = 0;
+    DWORD bytesRead = 0;
+    DWORD bytesWritten = 0;
+    UINT8 Trailing = 0;
+
+    File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (File == INVALID_HANDLE_VALUE) {
+        std::cout << "Unable to open " << FileName << ", error: " << GetLastError() << std::endl;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if (!ReadFile(File, &Header, sizeof(Header), &bytesRead, NULL) || bytesRead != sizeof(Header) ||
+        Header.m_Magic != BAR_CAPTURE_MAGIC || Header.m_Version != BAR_CAPTURE_VERSION) {
+        std::cout << FileName << " is not a compressed BAR capture" << std::endl;
+        userStatus = Failure;
+        goto Exit;
+    }
+    if (Header.m_Algorithm != COMPRESS_ALGORITHM_XPRESS || Header.m_ChunkSize == 0 || Header.m_ChunkSize > BAR_CAPTURE_MAX_CHUNK_SIZE) {
+        std::cout << FileName << " uses algorithm " << Header.m_Algorithm << " with chunks of 0x" << std::hex << Header.m_ChunkSize
+            << std::dec << " bytes, which is not supported" << std::endl;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (!CreateDecompressor(Header.m_Algorithm, NULL, &Decompressor)) {
+        std::cout << "CreateDecompressor failed, error: " << GetLastError() << std::endl;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (!OutputFileName.empty()) {
+        Output = CreateFileA(OutputFileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (Output == INVALID_HANDLE_VALUE) {
+            std::cout << "Unable to create " << OutputFileName << ", error: " << GetLastError() << std::endl;
+            userStatus = InvalidHandle;
+            goto Exit;
+        }
+    }
+
+    Raw.resize(Header.m_ChunkSize);
+    Compressed.resize(2 * (size_t)Header.m_ChunkSize);
+
+    while (Done < Header.m_Length)
+    {
+        BAR_CAPTURE_FRAME Frame;
+        UINT32 Chunk = (Header.m_Length - Done > Header.m_ChunkSize) ? Header.m_ChunkSize : (UINT32)(Header.m_Length - Done);
+        SIZE_T RawSize = 0;
+
+        if (!ReadFile(File, &Frame, sizeof(Frame), &bytesRead, NULL) || bytesRead != sizeof(Frame) ||
+            Frame.m_RawSize != Chunk || Frame.m_CompressedSize == 0 || Frame.m_CompressedSize > Compressed.size() ||
+            !ReadFile(File, Compressed.data(), Frame.m_CompressedSize, &bytesRead, NULL) || bytesRead != Frame.m_CompressedSize) {
+            std::cout << "Frame " << Frames << " at file offset 0x" << std::hex << FileOffset << std::dec << " is truncated or corrupt" << std::endl;
+            userStatus = Failure;
+            goto Exit;
+        }
+
+        if (!Decompress(Decompressor, Compressed.data(), Frame.m_CompressedSize, Raw.data(), Frame.m_RawSize, &RawSize) ||
+            RawSize != Frame.m_RawSize || CHash128::Compute(Raw.data(), RawSize).m_Low != Frame.m_Hash) {
+            std::cout << "Frame " << Frames << " holding BAR offset 0x" << std::hex << Header.m_Offset + Done << std::dec
+                << " does not expand to the captured data" << std::endl;
+            userStatus = Failure;
+            goto Exit;
+        }
+
+        if (Output != INVALID_HANDLE_VALUE && (!WriteFile(Output, Raw.data(), (DWORD)RawSize, &bytesWritten, NULL) || bytesWritten != RawSize)) {
+            std::cout << "Unable to write " << OutputFileName << ", error: " << GetLastError() << std::endl;
+            userStatus = Failure;
+            goto Exit;
+        }
+
+        Done += RawSize;
+        FileOffset += sizeof(Frame) + Frame.m_CompressedSize;
+        Frames++;
+    }
+
+    if (ReadFile(File, &Trailing, sizeof(Trailing), &bytesRead, NULL) && bytesRead != 0) {
+        std::cout << FileName << " has data after the last frame at file offset 0x" << std::hex << FileOffset << std::dec << std::endl;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    std::cout << FileName << ": 0x" << std::hex << Header.m_Length << " bytes of BAR 0x" << Header.m_BarBase << " at offset 0x" << Header.m_Offset
+        << std::dec << " in " << Frames << " frames, every frame matches its hash";
+    if (Output != INVALID_HANDLE_VALUE) {
+        std::cout << ", expanded to " << OutputFileName;
+    }
+    std::cout << std::endl;
+
+Exit:
+    if (Output != INVALID_HANDLE_VALUE) {
+        CloseHandle(Output);
+    }
+
+    if (File != INVALID_HANDLE_VALUE) {
+        CloseHandle(File);
+    }
+
+    if (Decompressor) {
+        CloseDecompressor(Decompressor);
+    }
+
+    return userStatus;
+}
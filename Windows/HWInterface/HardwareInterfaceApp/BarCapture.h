@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include "..\HardwareInterfaceLib\HardwareInterfaceLib.h"
+#include "..\HardwareInterfaceLib\Hash128.h"
+
+//
+// Size of each capture buffer, one BAR window per read.
+//
+#define BAR_CAPTURE_BUFFER_SIZE     PCIe_BAR_WINDOW_SIZE
+#define BAR_CAPTURE_MIN_BUFFERS     2
+#define BAR_CAPTURE_MAX_BUFFERS     8
+
+//
+// Unbuffered writes must be a multiple of the volume sector size, 4 KB
+// covers both 512 byte and 4K native disks.
+//
+#define BAR_CAPTURE_WRITE_ALIGNMENT 0x1000
+
+#define BAR_CAPTURE_MAGIC           0x43425748      // 'HWBC'
+#define BAR_CAPTURE_VERSION         1
+#define BAR_CAPTURE_MAX_CHUNK_SIZE  0x10000000
+
+typedef struct {
+    UINT64 BarBase;
+    UINT64 Offset;
+    UINT64 Length;
+    std::string FileName;
+    bool Compress;
+    bool Verify;
+    UINT32 BufferCount;
+}BAR_CAPTURE_CONFIG;
+
+//
+// A compressed capture is a BAR_CAPTURE_HEADER followed by one frame per
+// m_ChunkSize bytes of the BAR, the last one shorter. Every frame is a
+// BAR_CAPTURE_FRAME followed by m_CompressedSize bytes of m_Algorithm data
+// that expand to m_RawSize bytes whose CHash128 low half is m_Hash.
+// Uncompressed captures are the plain BAR image.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct {
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT32 m_Algorithm;
+    UINT32 m_ChunkSize;
+    UINT64 m_BarBase;
+    UINT64 m_Offset;
+    UINT64 m_Length;
+}BAR_CAPTURE_HEADER;
+
+typedef struct {
+    UINT32 m_RawSize;
+    UINT32 m_CompressedSize;
+    UINT64 m_Hash;
+}BAR_CAPTURE_FRAME;
+#pragma pack(pop)
+
+UserStatus CaptureBarToFile(CHardwareInterfaceLib& CHWLib, const BAR_CAPTURE_CONFIG& Config);
+UserStatus ExpandBarCapture(const std::string& FileName, const std::string& OutputFileName);
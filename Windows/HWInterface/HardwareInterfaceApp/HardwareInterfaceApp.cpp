@@ -5,32 +5,1206 @@
 #include <Cfgmgr32.h>
 #include <regstr.h>
 #include "..\HardwareInterfaceLib\HardwareInterfaceLib.h"
+#include "..\HardwareInterfaceLib\ConfigSnapshot.h"
+#include "..\HardwareInterfaceLib\ConfigArchive.h"
+#include "..\HardwareInterfaceLib\RegisterIndex.h"
+#include "..\HardwareInterfaceLib\CapabilityWalker.h"
+#include "..\HardwareInterfaceLib\RegisterMap.h"
+#include "..\HardwareInterfaceLib\PciIds.h"
+#include "..\HardwareInterfaceLib\DeviceRegistry.h"
+#include "..\HardwareInterfaceLib\CaptureArena.h"
+#include "..\HardwareInterfaceLib\SriovEnumerator.h"
+#include "..\HardwareInterfaceLib\HealthScanner.h"
+#include "..\HardwareInterfaceLib\ConfigCache.h"
+#include "..\HardwareInterfaceLib\BarIndex.h"
+#include "..\HardwareInterfaceLib\PowerScheduler.h"
+#include "..\HardwareInterfaceLib\HardwareBroker.h"
+#include "..\HardwareInterfaceLib\AccessTrace.h"
+#include "BarCapture.h"
 
 #define PCI_STD_CFG_SIZE 256
+#define PCI_IDS_IMAGE_FILE "pciids.bin"
+#define PCI_CLASS_BRIDGE 0x06
 
-#pragma pack(1)
+//
+// Serves capability walks of an adaptive capture from the standard header
+// already read, only reads past it go to the driver.
+//
+typedef struct
+{
+    CHardwareInterfaceLib* m_CHWLib;
+    const UINT8* m_Header;
+    UINT64 m_BytesRead;
+}CapturedHeader;
+
+void Dump256BytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, const CDeviceRegistry& PCIDevices, CCaptureArena& Arena, CRegisterIndexBuilder* Index = NULL);
+void Dump4KBytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, const CDeviceRegistry& PCIeDevices, CCaptureArena& Arena, CRegisterIndexBuilder* Index = NULL, bool Adaptive = false, CPowerScheduler* Scheduler = NULL, PowerPolicy Policy = PowerCaptureAll);
+UserStatus ReadCapturedHeader(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+UserStatus GetPCIPCIeDevices(CDeviceRegistry& PCIPCIeDevices, CPciIds* PciIds = NULL, CBarIndex* Bars = NULL);
+UserStatus AddBarResources(CHardwareInterfaceLib& CHWLib, CBarIndex& Bars, DEVINST DevInst, UINT8 Bus, UINT8 Device, UINT8 Function);
+int RunCommand(int argc, char* argv[]);
+int DumpCommand(int argc, char* argv[]);
+int CaptureCommand(int argc, char* argv[]);
+int ExpandCommand(int argc, char* argv[]);
+int SnapshotCommand(int argc, char* argv[]);
+int DecodeCommand(int argc, char* argv[]);
+int ArchiveCommand(int argc, char* argv[]);
+int ManifestCommand(int argc, char* argv[]);
+int IndexCommand(int argc, char* argv[]);
+int QueryCommand(int argc, char* argv[]);
+int CapsCommand(int argc, char* argv[]);
+int RegMapCommand(int argc, char* argv[]);
+int RegDecodeCommand(int argc, char* argv[]);
+int PciIdsCommand(int argc, char* argv[]);
+int SriovCommand(int argc, char* argv[]);
+int HealthCommand(int argc, char* argv[]);
+int BarsCommand(int argc, char* argv[]);
+int BrokerCommand(int argc, char* argv[]);
+int ReplayCommand(int argc, char* argv[]);
+bool StartTrace(CHardwareInterfaceLib& CHWLib, CAccessTraceRecorder& Recorder, const std::string& TraceFile);
+void StopTrace(CHardwareInterfaceLib& CHWLib, CAccessTraceRecorder& Recorder, const std::string& TraceFile);
+void OpenPciIds(CPciIds& PciIds);
+void PrintConfigSpace(const UINT8* Data, UINT32 Size);
+void PrintUsage();
+
+int main(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CDeviceRegistry PCIPCIeDevices;
+    CCaptureArena Arena;
+    CPciIds PciIds;
+
+    //
+    // Without arguments dump the configuration space of all devices.
+    //
+    if (argc > 1) {
+        return RunCommand(argc, argv);
+    }
+
+    OpenPciIds(PciIds);
+    userStatus = GetPCIPCIeDevices(PCIPCIeDevices, &PciIds);
+    if (userStatus != Success) {
+        std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    //
+    // Dump all  256 bytes config space of all PCI devices
+    //
+    Dump256BytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena);
+
+    //
+    // Dump all 4 KB config space of all PCIe devices
+    //
+    Dump4KBytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena);
+
+
+    userStatus = CHWLib.CHardwareInterfaceLibUninitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibUninitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+}
+
+int RunCommand(int argc, char* argv[])
+{
+    std::string Command = argv[1];
+
+    if (Command == "dump") {
+        return DumpCommand(argc, argv);
+    }
+    if (Command == "capture") {
+        return CaptureCommand(argc, argv);
+    }
+    if (Command == "expand") {
+        return ExpandCommand(argc, argv);
+    }
+    if (Command == "snapshot") {
+        return SnapshotCommand(argc, argv);
+    }
+    if (Command == "decode") {
+        return DecodeCommand(argc, argv);
+    }
+    if (Command == "archive") {
+        return ArchiveCommand(argc, argv);
+    }
+    if (Command == "manifest") {
+        return ManifestCommand(argc, argv);
+    }
+    if (Command == "index") {
+        return IndexCommand(argc, argv);
+    }
+    if (Command == "query") {
+        return QueryCommand(argc, argv);
+    }
+    if (Command == "caps") {
+        return CapsCommand(argc, argv);
+    }
+    if (Command == "regmap") {
+        return RegMapCommand(argc, argv);
+    }
+    if (Command == "regdecode") {
+        return RegDecodeCommand(argc, argv);
+    }
+    if (Command == "pciids") {
+        return PciIdsCommand(argc, argv);
+    }
+    if (Command == "sriov") {
+        return SriovCommand(argc, argv);
+    }
+    if (Command == "health") {
+        return HealthCommand(argc, argv);
+    }
+    if (Command == "bars") {
+        return BarsCommand(argc, argv);
+    }
+    if (Command == "broker") {
+        return BrokerCommand(argc, argv);
+    }
+    if (Command == "replay") {
+        return ReplayCommand(argc, argv);
+    }
+
+    PrintUsage();
+    return 1;
+}
+
+void PrintUsage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe" << std::endl;
+    std::cout << "      Dump 256 bytes/4 KB configuration space of all PCI/PCIe devices." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe dump [-adaptive] [-power <skip|defer>] [-trace <File>]" << std::endl;
+    std::cout << "      Dump 4 KB configuration space of all PCI/PCIe devices, reading only the populated part with -adaptive." << std::endl;
+    std::cout << "      With -power, devices in D3 are skipped or dumped last. With -trace, the accesses are recorded to File." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe capture <BarBase> <Length> <File> [-offset <Offset>] [-buffers <Count>] [-compress [-verify]]" << std::endl;
+    std::cout << "      Capture Length bytes of the BAR at physical address BarBase to File." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe expand <File> [<Output>]" << std::endl;
+    std::cout << "      Check every frame of a compressed capture File and expand it to the plain BAR image Output." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe snapshot <File>" << std::endl;
+    std::cout << "      Save the 4 KB configuration space of all PCI/PCIe devices to an encoded snapshot File." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe decode <File>" << std::endl;
+    std::cout << "      Dump the configuration space saved in snapshot File." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe archive <Archive> <Snapshot>... [-threads <Count>]" << std::endl;
+    std::cout << "      Ingest snapshot files into Archive, storing identical configuration spaces once." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe manifest <Archive>" << std::endl;
+    std::cout << "      List the functions of every host in Archive with their blob ids." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe index <Index> [-archive <Archive>]" << std::endl;
+    std::cout << "      Dump all devices, or read Archive, and build a register Index." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe query <Index> <Predicate>..." << std::endl;
+    std::cout << "      List functions matching all predicates, e.g. class=0x060400 0x10&0xF=0x1." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe caps <Bus> <Device> <Function>" << std::endl;
+    std::cout << "      List the capabilities and extended capabilities of a function." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe regmap <Database> <Description>..." << std::endl;
+    std::cout << "      Compile register description files into a register map Database." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe regdecode <Database> <VendorId> <DeviceId> <BarBase> <Length> [-offset <Offset>]" << std::endl;
+    std::cout << "      Read Length bytes of the BAR at physical address BarBase and decode its registers." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe pciids <Image> <pci.ids>" << std::endl;
+    std::cout << "      Compile pci.ids into a PCI id Image, name it " PCI_IDS_IMAGE_FILE " next to the executable to name devices from it." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe sriov <Bus> <Device> <Function> [-size <Bytes>]" << std::endl;
+    std::cout << "      Enumerate the virtual functions of an SR-IOV physical function and capture their configuration space." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe health [-interval <Milliseconds>] [-passes <Count>]" << std::endl;
+    std::cout << "      Watch link speed/width and AER status of all PCIe devices and print changes." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe bars [-size-live] [-lookup <Address>]..." << std::endl;
+    std::cout << "      Print the memory BARs Windows assigned to all PCI/PCIe devices and the owner of each Address, -size-live sizes" << std::endl;
+    std::cout << "      the BARs of quiesced non-bridge functions by writing them instead." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe broker [-pipe <Name>] [-ttl <Milliseconds>] [-trace <File>]" << std::endl;
+    std::cout << "      Hold the driver handle and serve register reads of local tools over a named pipe until Enter is pressed." << std::endl;
+    std::cout << "  HardwareInterfaceApp.exe replay <File> [-original] [-scripts] [-passes <Count>]" << std::endl;
+    std::cout << "      Replay the accesses of trace File back to back or at their recorded times and compare latencies." << std::endl;
+}
+
+int DumpCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CDeviceRegistry PCIPCIeDevices;
+    CCaptureArena Arena;
+    CPciIds PciIds;
+    bool Adaptive = false;
+    PowerPolicy Policy = PowerCaptureAll;
+    std::string TraceFile;
+    CAccessTraceRecorder Recorder;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-adaptive") {
+            Adaptive = true;
+        }
+        else if (Option == "-power" && i + 1 < argc && std::string(argv[i + 1]) == "skip") {
+            Policy = PowerSkipLowPower;
+            i++;
+        }
+        else if (Option == "-power" && i + 1 < argc && std::string(argv[i + 1]) == "defer") {
+            Policy = PowerDeferLowPower;
+            i++;
+        }
+        else if (Option == "-trace" && i + 1 < argc) {
+            TraceFile = argv[++i];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    OpenPciIds(PciIds);
+    userStatus = GetPCIPCIeDevices(PCIPCIeDevices, &PciIds);
+    if (userStatus != Success) {
+        std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    if (!StartTrace(CHWLib, Recorder, TraceFile)) {
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    if (Policy == PowerCaptureAll) {
+        Dump4KBytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena, NULL, Adaptive);
+        StopTrace(CHWLib, Recorder, TraceFile);
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 0;
+    }
+
+    //
+    // The power state is read through the HAL, which does not stall on a
+    // function in D3 the way a memory mapped read does.
+    //
+    CPowerScheduler Scheduler(CHWLib);
+    LARGE_INTEGER Frequency, Start, End;
+    for (UINT32 Device = 0; Device < PCIPCIeDevices.GetCount(); Device++)
+    {
+        Scheduler.AddDevice(PCIPCIeDevices.GetBus(Device), PCIPCIeDevices.GetDevice(Device), PCIPCIeDevices.GetFunction(Device));
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    userStatus = Scheduler.Classify();
+    QueryPerformanceCounter(&End);
+    if (userStatus != Success) {
+        std::cout << "Power state read failed, Error: " << Scheduler.GetStatusMessage() << std::endl;
+    }
+    std::cout << "Power states of " << std::dec << Scheduler.GetCount() << " functions read in " << std::fixed << std::setprecision(3)
+        << (double)(End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart << " ms, " << Scheduler.GetBytesRead() << " bytes" << std::endl;
+
+    Dump4KBytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena, NULL, Adaptive, &Scheduler, Policy);
+
+    StopTrace(CHWLib, Recorder, TraceFile);
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return 0;
+}
+
+int CaptureCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    BAR_CAPTURE_CONFIG Config;
+
+    if (argc < 5) {
+        PrintUsage();
+        return 1;
+    }
+
+    Config.BarBase = std::stoull(argv[2], nullptr, 0);
+    Config.Length = std::stoull(argv[3], nullptr, 0);
+    Config.FileName = argv[4];
+    Config.Offset = 0;
+    Config.Compress = false;
+    Config.Verify = false;
+    Config.BufferCount = BAR_CAPTURE_MIN_BUFFERS;
+
+    for (int i = 5; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-compress") {
+            Config.Compress = true;
+        }
+        else if (Option == "-verify") {
+            Config.Verify = true;
+        }
+        else if (Option == "-offset" && i + 1 < argc) {
+            Config.Offset = std::stoull(argv[++i], nullptr, 0);
+        }
+        else if (Option == "-buffers" && i + 1 < argc) {
+            Config.BufferCount = std::stoul(argv[++i], nullptr, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    userStatus = CaptureBarToFile(CHWLib, Config);
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return (userStatus == Success) ? 0 : 1;
+}
+
+int ExpandCommand(int argc, char* argv[])
+{
+    if (argc < 3 || argc > 4) {
+        PrintUsage();
+        return 1;
+    }
+
+    return (ExpandBarCapture(argv[2], (argc == 4) ? argv[3] : "") == Success) ? 0 : 1;
+}
+
+void PrintConfigSpace(const UINT8* Data, UINT32 Size)
+{
+    //
+    // 256 byte dumps use two digit row offsets, 4 KB dumps three.
+    //
+    int Width = (Size > PCI_STD_CFG_SIZE) ? 3 : 2;
+
+    std::cout << std::string(Width, ' ') << " 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F" << std::endl;
+    std::cout << std::string(Width - 2, ' ') << "-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --" << std::endl;
+    for (UINT32 RowIndex = 0; RowIndex < Size; RowIndex += 0x10)
+    {
+        std::cout << std::setw(Width) << std::setfill('0') << std::uppercase << std::hex << RowIndex << "|";
+        for (UINT32 ByteIndex = RowIndex; ByteIndex < RowIndex + 0x10 && ByteIndex < Size; ByteIndex++)
+        {
+            std::cout << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << +(Data[ByteIndex]) << " ";
+        }
+        std::cout << std::endl;
+    }
+}
+
+int SnapshotCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CDeviceRegistry PCIPCIeDevices;
+    CCaptureArena Arena;
+    CConfigSnapshotWriter Writer;
+    CHAR HostName[MAX_COMPUTERNAME_LENGTH + 1] = { 0 };
+    DWORD HostNameLength = sizeof(HostName);
+    UINT32 Captured = 0;
+
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    userStatus = GetPCIPCIeDevices(PCIPCIeDevices);
+    if (userStatus != Success) {
+        std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    GetComputerNameA(HostName, &HostNameLength);
+    userStatus = Writer.Create(argv[2], HostName);
+    if (userStatus != Success) {
+        std::cout << "Snapshot create failed, Error: " << Writer.GetStatusMessage() << std::endl;
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    if (Arena.Reserve(PCIPCIeDevices.GetCount(), PCIe_CFG_SIZE) != Success) {
+        std::cout << "Memory allocation failed, Error: " << Arena.GetStatusMessage() << std::endl;
+        Writer.Close();
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    for (UINT32 Device = 0; Device < PCIPCIeDevices.GetCount(); Device++)
+    {
+        PCI_PCIeCfgData pciExCfgData;
+        pciExCfgData.m_Bus = PCIPCIeDevices.GetBus(Device);
+        pciExCfgData.m_Device = PCIPCIeDevices.GetDevice(Device);
+        pciExCfgData.m_Function = PCIPCIeDevices.GetFunction(Device);
+        pciExCfgData.m_Offset = 0;
+        pciExCfgData.OutputData.m_Size = PCIe_CFG_SIZE;
+        pciExCfgData.OutputData.DataPointer = Arena.GetSlot(Device);
+
+        userStatus = CHWLib.PCIeExCfgRead(&pciExCfgData);
+        if (userStatus != Success) {
+            std::cout << "PCIeExCfgRead failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+            continue;
+        }
+
+        userStatus = Writer.Append(pciExCfgData.m_Bus, pciExCfgData.m_Device, pciExCfgData.m_Function, pciExCfgData.OutputData.DataPointer, PCIe_CFG_SIZE);
+        if (userStatus != Success) {
+            std::cout << "Snapshot append failed, Error: " << Writer.GetStatusMessage() << std::endl;
+            break;
+        }
+        Captured++;
+    }
+
+    if (Writer.Close() != Success) {
+        std::cout << "Snapshot close failed, Error: " << Writer.GetStatusMessage() << std::endl;
+        userStatus = Failure;
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    std::cout << std::dec << Captured << " devices, " << Writer.GetRawBytes() << " bytes captured, "
+        << Writer.GetEncodedBytes() << " bytes written" << std::endl;
+
+    return (userStatus == Success) ? 0 : 1;
+}
+
+int DecodeCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CConfigSnapshotReader Reader;
+    ConfigSnapshotRecord Record;
+    std::vector<UINT8> Data;
+
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    userStatus = Reader.Open(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Snapshot open failed, Error: " << Reader.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Host: " << Reader.GetHeader().m_HostName << ", Devices: " << std::dec << Reader.GetHeader().m_RecordCount << std::endl << std::endl;
+
+    for (UINT32 Index = 0; Index < Reader.GetHeader().m_RecordCount; Index++)
+    {
+        userStatus = Reader.ReadRecord(Record, Data);
+        if (userStatus != Success) {
+            std::cout << "Snapshot read failed, Error: " << Reader.GetStatusMessage() << std::endl;
+            return 1;
+        }
+
+        std::cout << "Bus: 0x" << std::hex << +(Record.m_Bus) << ", " << "Device: 0x" << std::hex << +(Record.m_Device) << ", "
+            << "Function: 0x" << std::hex << +(Record.m_Function) << std::endl;
+        PrintConfigSpace(Data.data(), Record.m_RawSize);
+        std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
+    }
+
+    return 0;
+}
+
+int ArchiveCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CConfigArchiveBuilder Builder;
+    std::vector<std::string> SnapshotFiles;
+    UINT32 ThreadCount = 0;
+    LARGE_INTEGER Frequency, Start, End;
+
+    for (int i = 3; i < argc; i++)
+    {
+        std::string Argument = argv[i];
+        if (Argument == "-threads" && i + 1 < argc) {
+            ThreadCount = std::stoul(argv[++i], nullptr, 0);
+        }
+        else {
+            SnapshotFiles.push_back(Argument);
+        }
+    }
+
+    if (argc < 4 || SnapshotFiles.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    userStatus = Builder.Ingest(SnapshotFiles, ThreadCount);
+    if (userStatus != Success) {
+        std::cout << "Archive ingest failed, Error: " << Builder.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    QueryPerformanceCounter(&End);
+
+    userStatus = Builder.Write(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Archive write failed, Error: " << Builder.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    double Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    std::cout << std::dec << SnapshotFiles.size() << " hosts, " << Builder.GetFunctionCount() << " functions, "
+        << Builder.GetBlobCount() << " unique, ingested in " << std::fixed << std::setprecision(3) << Seconds << " s" << std::endl;
+
+    return 0;
+}
+
+int ManifestCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CConfigArchiveReader Reader;
+
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    userStatus = Reader.Open(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Archive open failed, Error: " << Reader.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Hosts: " << std::dec << Reader.GetHeader().m_HostCount << ", Functions: " << Reader.GetHeader().m_EntryCount
+        << ", Unique: " << Reader.GetHeader().m_BlobCount << std::endl << std::endl;
+
+    for (UINT32 HostIndex = 0; HostIndex < Reader.GetHeader().m_HostCount; HostIndex++)
+    {
+        const ConfigArchiveHost* Host = NULL;
+        const ConfigArchiveEntry* Entries = NULL;
+        UINT32 EntryCount = 0;
+
+        userStatus = Reader.GetHost(HostIndex, &Host);
+        if (userStatus == Success) {
+            userStatus = Reader.GetEntries(HostIndex, &Entries, &EntryCount);
+        }
+        if (userStatus != Success) {
+            std::cout << "Archive read failed, Error: " << Reader.GetStatusMessage() << std::endl;
+            return 1;
+        }
+
+        std::cout << "Host: " << std::string(Host->m_HostName, strnlen(Host->m_HostName, sizeof(Host->m_HostName))) << std::endl;
+        for (UINT32 Index = 0; Index < EntryCount; Index++)
+        {
+            std::cout << "  " << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << +(Entries[Index].m_Bus) << ":"
+                << std::setw(2) << +(Entries[Index].m_Device) << "." << +(Entries[Index].m_Function)
+                << " -> " << std::dec << Entries[Index].m_BlobId << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+int IndexCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CRegisterIndexBuilder Builder;
+
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "-archive")) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (argc == 5) {
+        CConfigArchiveReader Archive;
+        userStatus = Archive.Open(argv[4]);
+        if (userStatus == Success) {
+            userStatus = Builder.AddArchive(Archive);
+        }
+        if (userStatus != Success) {
+            std::cout << "Archive read failed, Error: " << Archive.GetStatusMessage() << Builder.GetStatusMessage() << std::endl;
+            return 1;
+        }
+    }
+    else {
+        CDeviceRegistry PCIPCIeDevices;
+        CPciIds PciIds;
+
+        OpenPciIds(PciIds);
+        userStatus = GetPCIPCIeDevices(PCIPCIeDevices, &PciIds);
+        if (userStatus != Success) {
+            std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
+            return 1;
+        }
+
+        CHardwareInterfaceLib CHWLib;
+        userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+        if (userStatus != Success)
+        {
+            std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+            return 1;
+        }
+
+        CCaptureArena Arena;
+        Dump256BytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena, &Builder);
+        Dump4KBytesPCIConfigSpace(CHWLib, PCIPCIeDevices, Arena, &Builder);
+
+        CHWLib.CHardwareInterfaceLibUninitialise();
+    }
+
+    userStatus = Builder.Write(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Index write failed, Error: " << Builder.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int QueryCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CRegisterIndex Index;
+    std::vector<RegisterPredicate> Predicates;
+    std::vector<UINT32> Rows;
+    LARGE_INTEGER Frequency, Start, End;
+
+    if (argc < 4) {
+        PrintUsage();
+        return 1;
+    }
+
+    for (int i = 3; i < argc; i++)
+    {
+        RegisterPredicate Predicate;
+        if (CRegisterIndex::ParsePredicate(argv[i], Predicate) != Success) {
+            std::cout << "Invalid predicate: " << argv[i] << std::endl;
+            return 1;
+        }
+        Predicates.push_back(Predicate);
+    }
+
+    userStatus = Index.Open(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Index open failed, Error: " << Index.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    userStatus = Index.Query(Predicates, Rows);
+    QueryPerformanceCounter(&End);
+    if (userStatus != Success) {
+        std::cout << "Query failed, Error: " << Index.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    for (auto Row : Rows)
+    {
+        std::string HostName;
+        UINT8 Bus = 0, Device = 0, Function = 0;
+        UINT32 Id = 0;
+
+        Index.GetRow(Row, HostName, &Bus, &Device, &Function);
+        Index.GetValue(Row, 0, &Id);
+        std::cout << HostName << " " << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << +Bus << ":"
+            << std::setw(2) << +Device << "." << +Function << " " << std::setw(4) << (Id & 0xFFFF) << ":" << std::setw(4) << (Id >> 16);
+        for (auto& Predicate : Predicates)
+        {
+            UINT32 Value = 0;
+            Index.GetValue(Row, Predicate.m_Offset, &Value);
+            std::cout << " [" << std::setw(3) << Predicate.m_Offset << "]=" << std::setw(8) << Value;
+        }
+        std::cout << std::endl;
+    }
+
+    double Milliseconds = (double)(End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart;
+    std::cout << std::dec << Rows.size() << " of " << Index.GetHeader().m_RowCount << " functions match, query took "
+        << std::fixed << std::setprecision(3) << Milliseconds << " ms" << std::endl;
+
+    return 0;
+}
+
+int CapsCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    std::vector<CapabilityEntry> Capabilities;
+    UINT8 Bus, Device, Function;
+
+    if (argc < 5) {
+        PrintUsage();
+        return 1;
+    }
+
+    Bus = (UINT8)std::stoul(argv[2], nullptr, 0);
+    Device = (UINT8)std::stoul(argv[3], nullptr, 0);
+    Function = (UINT8)std::stoul(argv[4], nullptr, 0);
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    //
+    // Headers are read through the cache, neighbouring headers of a line
+    // then cost no further transfer.
+    //
+    CConfigCache Cache(CHWLib);
+    CCapabilityWalker Walker(CConfigCache::CacheRead, &Cache);
+    for (int Extended = 0; Extended < 2; Extended++)
+    {
+        userStatus = Walker.GetCapabilities(Bus, Device, Function, Extended != 0, Capabilities);
+        if (userStatus != Success) {
+            std::cout << "Capability walk failed, Error: " << Walker.GetStatusMessage() << std::endl;
+            break;
+        }
+
+        std::cout << (Extended ? "Extended capabilities:" : "Capabilities:") << std::endl;
+        for (auto& Capability : Capabilities)
+        {
+            std::cout << "  " << std::setw(3) << std::setfill('0') << std::uppercase << std::hex << Capability.m_Offset
+                << ": ID 0x" << std::setw(Extended ? 4 : 2) << Capability.m_Id << std::endl;
+        }
+    }
+
+    const ConfigCacheStatistics& Statistics = Cache.GetStatistics();
+    std::cout << std::dec << Walker.GetBytesRead() << " bytes requested, " << Statistics.m_Hits << " of " << Statistics.m_Requests
+        << " reads from the cache, " << Statistics.m_Transfers << " transfers of " << Statistics.m_BytesTransferred << " bytes" << std::endl;
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return (userStatus == Success) ? 0 : 1;
+}
+
+int RegMapCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CRegisterMapCompiler Compiler;
+
+    if (argc < 4) {
+        PrintUsage();
+        return 1;
+    }
+
+    for (int i = 3; i < argc; i++)
+    {
+        userStatus = Compiler.AddFile(argv[i]);
+        if (userStatus != Success) {
+            std::cout << "Description failed, Error: " << Compiler.GetStatusMessage() << std::endl;
+            return 1;
+        }
+    }
+
+    userStatus = Compiler.Write(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Register map write failed, Error: " << Compiler.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    std::cout << std::dec << Compiler.GetDeviceCount() << " devices, " << Compiler.GetRegisterCount() << " registers compiled" << std::endl;
+
+    return 0;
+}
+
+int RegDecodeCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CRegisterMap RegisterMap;
+    const RegisterMapDevice* Device;
+    std::vector<DecodedRegister> Registers;
+    std::vector<UINT8> Buffer;
+    UINT16 VendorId, DeviceId;
+    UINT64 BarBase, Length, Offset = 0;
+    LARGE_INTEGER Frequency, OpenStart, OpenEnd, DecodeStart, DecodeEnd;
+
+    if (argc < 7) {
+        PrintUsage();
+        return 1;
+    }
+
+    VendorId = (UINT16)std::stoul(argv[3], nullptr, 0);
+    DeviceId = (UINT16)std::stoul(argv[4], nullptr, 0);
+    BarBase = std::stoull(argv[5], nullptr, 0);
+    Length = std::stoull(argv[6], nullptr, 0);
+
+    for (int i = 7; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-offset" && i + 1 < argc) {
+            Offset = std::stoull(argv[++i], nullptr, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (Length == 0 || Offset + Length > MAXDWORD) {
+        std::cout << "Offset and Length must lie in the first 4 GB of the BAR" << std::endl;
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&OpenStart);
+    userStatus = RegisterMap.Open(argv[2]);
+    QueryPerformanceCounter(&OpenEnd);
+    if (userStatus != Success) {
+        std::cout << "Register map open failed, Error: " << RegisterMap.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    Device = RegisterMap.FindDevice(VendorId, DeviceId);
+    if (Device == NULL) {
+        std::cout << "Device " << std::setw(4) << std::setfill('0') << std::uppercase << std::hex << VendorId << ":"
+            << std::setw(4) << DeviceId << " is not described in " << argv[2] << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    Buffer.resize((size_t)Length);
+    userStatus = CHWLib.PCIeBarRead(BarBase, Offset, Buffer.data(), Length);
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    if (userStatus != Success) {
+        std::cout << "PCIeBarRead failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    QueryPerformanceCounter(&DecodeStart);
+    RegisterMap.Decode(Device, (UINT32)Offset, Buffer.data(), (UINT32)Length, Registers);
+    QueryPerformanceCounter(&DecodeEnd);
+
+    std::cout << RegisterMap.GetString(Device->m_Name) << std::endl;
+    for (auto& Register : Registers)
+    {
+        const RegisterMapField* Fields = RegisterMap.GetFields(Register.m_Register);
+
+        std::cout << "  " << std::setw(8) << std::setfill('0') << std::uppercase << std::hex << Register.m_Register->m_Offset << " "
+            << RegisterMap.GetString(Register.m_Register->m_Name) << " = 0x" << std::setw(Register.m_Register->m_Width * 2)
+            << Register.m_Value << "  " << RegisterMap.GetString(Register.m_Register->m_Description) << std::endl;
+        for (UINT32 f = 0; Fields != NULL && f < Register.m_Register->m_FieldCount; f++)
+        {
+            std::cout << "      [" << std::dec << (Fields[f].m_Bits > 1 ? std::to_string(Fields[f].m_Lsb + Fields[f].m_Bits - 1) + ":" : "")
+                << +Fields[f].m_Lsb << "] " << RegisterMap.GetString(Fields[f].m_Name) << " = 0x" << std::hex
+                << CRegisterMap::GetFieldValue(&Fields[f], Register.m_Value) << std::endl;
+        }
+    }
+
+    std::cout << std::dec << Registers.size() << " registers decoded, open took " << std::fixed << std::setprecision(3)
+        << (double)(OpenEnd.QuadPart - OpenStart.QuadPart) * 1000 / Frequency.QuadPart << " ms, decode took "
+        << (double)(DecodeEnd.QuadPart - DecodeStart.QuadPart) * 1000 / Frequency.QuadPart << " ms" << std::endl;
+
+    return 0;
+}
+
+int PciIdsCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CPciIdsCompiler Compiler;
+    CPciIds PciIds;
+    LARGE_INTEGER Frequency, Start, Compiled, Opened, Looked;
+    UINT32 Lookups = 1000000, Found = 0, Random = 1;
+
+    if (argc < 4) {
+        PrintUsage();
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    userStatus = Compiler.AddFile(argv[3]);
+    if (userStatus == Success) {
+        userStatus = Compiler.Write(argv[2]);
+    }
+    QueryPerformanceCounter(&Compiled);
+    if (userStatus != Success) {
+        std::cout << "PCI id compile failed, Error: " << Compiler.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    userStatus = PciIds.Open(argv[2]);
+    QueryPerformanceCounter(&Opened);
+    if (userStatus != Success) {
+        std::cout << "PCI id image open failed, Error: " << PciIds.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    //
+    // Look up pseudo random vendor and device ids, misses cost as much as
+    // hits, the key of the slot is compared either way.
+    //
+    for (UINT32 i = 0; i < Lookups; i++)
+    {
+        Random = Random * 1103515245 + 12345;
+        if (PciIds.FindDevice((UINT16)(0x1000 + (Random >> 24)), (UINT16)(Random >> 8)) != NULL) {
+            Found++;
+        }
+    }
+    QueryPerformanceCounter(&Looked);
+
+    std::cout << std::dec << Compiler.GetCount(PciIdsVendor) << " vendors, " << Compiler.GetCount(PciIdsDevice) << " devices, "
+        << Compiler.GetCount(PciIdsSubsystem) << " subsystems, image " << PciIds.GetHeader().m_Size << " bytes" << std::endl;
+    std::cout << "Compile took " << std::fixed << std::setprecision(3) << (double)(Compiled.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart
+        << " ms, open took " << (double)(Opened.QuadPart - Compiled.QuadPart) * 1000 / Frequency.QuadPart << " ms, "
+        << std::setprecision(0) << Lookups / ((double)(Looked.QuadPart - Opened.QuadPart) / Frequency.QuadPart) << " lookups/s ("
+        << Found << " of " << Lookups << " found)" << std::endl;
+
+    return 0;
+}
+
+int SriovCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    SriovInfo Info;
+    std::vector<UINT32> Users;
+    LARGE_INTEGER Frequency, Start, Enumerated, Captured;
+    UINT8 Bus, Device, Function;
+    UINT32 Size = PCI_STD_CFG_SIZE;
+
+    if (argc < 5) {
+        PrintUsage();
+        return 1;
+    }
+
+    Bus = (UINT8)std::stoul(argv[2], nullptr, 0);
+    Device = (UINT8)std::stoul(argv[3], nullptr, 0);
+    Function = (UINT8)std::stoul(argv[4], nullptr, 0);
+    for (int i = 5; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-size" && i + 1 < argc) {
+            Size = (UINT32)std::stoul(argv[++i], nullptr, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    CSriovEnumerator Enumerator(CHWLib);
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    userStatus = Enumerator.GetSriovInfo(Bus, Device, Function, Info);
+    QueryPerformanceCounter(&Enumerated);
+    if (userStatus != Success) {
+        std::cout << "SR-IOV capability read failed, Error: " << Enumerator.GetStatusMessage() << std::endl;
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    std::cout << "TotalVFs: " << std::dec << Info.m_TotalVFs << ", NumVFs: " << Info.m_NumVFs << ", VF Enable: " << Info.m_VfEnable
+        << ", First VF Offset: 0x" << std::hex << Info.m_FirstVfOffset << ", VF Stride: 0x" << Info.m_VfStride
+        << ", VF Device ID: 0x" << Info.m_VfDeviceId << std::endl;
+
+    userStatus = Enumerator.Capture(Bus, Device, Function, Size);
+    QueryPerformanceCounter(&Captured);
+    if (userStatus != Success) {
+        std::cout << "VF capture failed, Error: " << Enumerator.GetStatusMessage() << std::endl;
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    //
+    // Print each distinct capture once, after the VFs sharing it.
+    //
+    Users.assign(Enumerator.GetCaptureCount(), 0);
+    for (UINT32 Vf = 0; Vf < Enumerator.GetVfCount(); Vf++)
+    {
+        Users[Enumerator.GetCaptureIndex(Vf)]++;
+    }
+
+    for (UINT32 Capture = 0; Capture < Enumerator.GetCaptureCount(); Capture++)
+    {
+        std::cout << "Capture " << std::dec << Capture << ", " << Users[Capture] << " VFs:";
+        for (UINT32 Vf = 0, Listed = 0; Vf < Enumerator.GetVfCount() && Listed < 8; Vf++)
+        {
+            UINT16 RoutingId = Enumerator.GetRoutingId(Vf);
+            if (Enumerator.GetCaptureIndex(Vf) == Capture) {
+                std::cout << " " << std::hex << std::setw(2) << std::setfill('0') << +SRIOV_ROUTING_ID_BUS(RoutingId) << ":"
+                    << std::setw(2) << +SRIOV_ROUTING_ID_DEVICE(RoutingId) << "." << +SRIOV_ROUTING_ID_FUNCTION(RoutingId);
+                Listed++;
+            }
+        }
+        std::cout << ((Users[Capture] > 8) ? " ..." : "") << std::endl;
+
+        PrintConfigSpace(Enumerator.GetCapture(Capture), Enumerator.GetCaptureSize());
+        std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
+    }
+
+    std::cout << std::dec << Enumerator.GetVfCount() << " VFs, " << Enumerator.GetCaptureCount() << " distinct captures of " << Size
+        << " bytes" << std::endl;
+    std::cout << "Enumeration took " << std::fixed << std::setprecision(3) << (double)(Enumerated.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart
+        << " ms, capture took " << (double)(Captured.QuadPart - Enumerated.QuadPart) * 1000 / Frequency.QuadPart << " ms" << std::endl;
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return 0;
+}
+
+int HealthCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CDeviceRegistry PCIPCIeDevices;
+    CPciIds PciIds;
+    std::vector<UINT32> Watched;
+    std::vector<HealthChange> Changes;
+    LARGE_INTEGER Frequency, Start, End;
+    UINT32 Interval = 1000, Passes = 0;
+    static const char* ChangeNames[] = { "Link speed", "Link width", "Uncorrectable errors", "Correctable errors", "Link status" };
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-interval" && i + 1 < argc) {
+            Interval = (UINT32)std::stoul(argv[++i], nullptr, 0);
+        }
+        else if (Option == "-passes" && i + 1 < argc) {
+            Passes = (UINT32)std::stoul(argv[++i], nullptr, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    OpenPciIds(PciIds);
+    userStatus = GetPCIPCIeDevices(PCIPCIeDevices, &PciIds);
+    if (userStatus != Success) {
+        std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    //
+    // Conventional PCI functions have no link to watch and are skipped.
+    //
+    CHealthScanner Scanner(CHWLib);
+    for (UINT32 Device = 0; Device < PCIPCIeDevices.GetCount(); Device++)
+    {
+        userStatus = Scanner.AddDevice(PCIPCIeDevices.GetBus(Device), PCIPCIeDevices.GetDevice(Device), PCIPCIeDevices.GetFunction(Device));
+        if (userStatus == Success) {
+            Watched.push_back(Device);
+        }
+        else if (userStatus != IndexOutOfRange) {
+            std::cout << "Health scanner setup failed, Error: " << Scanner.GetStatusMessage() << std::endl;
+        }
+    }
+    std::cout << "Watching " << std::dec << Scanner.GetDeviceCount() << " of " << PCIPCIeDevices.GetCount() << " functions" << std::endl;
+
+    QueryPerformanceFrequency(&Frequency);
+    for (UINT32 Pass = 0; Passes == 0 || Pass < Passes; Pass++)
+    {
+        if (Pass != 0) {
+            Sleep(Interval);
+        }
+
+        UINT64 BytesRead = Scanner.GetBytesRead();
+        QueryPerformanceCounter(&Start);
+        userStatus = Scanner.Scan(Changes);
+        QueryPerformanceCounter(&End);
+        if (userStatus != Success) {
+            std::cout << "Health scan failed, Error: " << Scanner.GetStatusMessage() << std::endl;
+        }
+
+        for (auto& Change : Changes)
+        {
+            UINT32 Device = Watched[Change.m_Device];
+
+            std::cout << PCIPCIeDevices.GetName(Device) << ", Bus: 0x" << std::hex << +PCIPCIeDevices.GetBus(Device) << ", Device: 0x"
+                << +PCIPCIeDevices.GetDevice(Device) << ", Function: 0x" << +PCIPCIeDevices.GetFunction(Device) << ": "
+                << ChangeNames[Change.m_Kind] << " 0x" << Change.m_Previous << " -> 0x" << Change.m_Current;
+            if (Change.m_Kind == HealthLinkSpeed || Change.m_Kind == HealthLinkWidth) {
+                std::cout << " (maximum 0x" << Change.m_Maximum << ")";
+            }
+            std::cout << std::endl;
+        }
 
-typedef struct {
-    std::string DeviceName;
-    UINT8 Bus;
-    UINT8 Device;
-    UINT8 Function;
-}PCI_PCIeDevice;
+        std::cout << "Pass " << std::dec << Pass + 1 << ": " << Changes.size() << " changes, " << Scanner.GetBytesRead() - BytesRead
+            << " bytes read in " << std::fixed << std::setprecision(3) << (double)(End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart
+            << " ms" << std::endl;
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return (userStatus == Success) ? 0 : 1;
+}
 
-void Dump256BytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, std::vector<PCI_PCIeDevice> PCIDevices);
-void Dump4KBytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, std::vector<PCI_PCIeDevice> PCIeDevices);
-UserStatus GetPCIPCIeDevices(std::vector<PCI_PCIeDevice>& PCIPCIeDevices);
+//
+// Lookups are repeated so that the rate is measured over a few
+// milliseconds, a single binary search is below the counter resolution.
+//
+#define BAR_LOOKUP_REPEAT 100000
 
-int main()
+int BarsCommand(int argc, char* argv[])
 {
     UserStatus userStatus = Success;
-    std::vector<PCI_PCIeDevice> PCIPCIeDevices;
+    CDeviceRegistry PCIPCIeDevices;
+    CPciIds PciIds;
+    CBarIndex Bars;
+    std::vector<UINT64> Lookups;
+    bool SizeLive = false;
+    UINT32 Bridges = 0;
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 Found = 0;
 
-    userStatus = GetPCIPCIeDevices(PCIPCIeDevices);
+    for (int i = 2; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-lookup" && i + 1 < argc) {
+            Lookups.push_back(std::stoull(argv[++i], nullptr, 0));
+        }
+        else if (Option == "-size-live") {
+            SizeLive = true;
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    //
+    // The BAR map comes from the resources Windows assigned unless live
+    // sizing is asked for, sizing turns decode off under the driver of
+    // each function.
+    //
+    OpenPciIds(PciIds);
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    userStatus = GetPCIPCIeDevices(PCIPCIeDevices, &PciIds, SizeLive ? NULL : &Bars);
     if (userStatus != Success) {
         std::cout << "GetPCIDevices failed, status: 0x" << std::hex << userStatus << std::endl;
         return 1;
     }
+    QueryPerformanceCounter(&End);
 
     CHardwareInterfaceLib CHWLib;
     userStatus = CHWLib.CHardwareInterfaceLibInitialise();
@@ -40,132 +1214,461 @@ int main()
         return 1;
     }
 
-    //
-    // Dump all  256 bytes config space of all PCI devices
-    //
-    Dump256BytesPCIConfigSpace(CHWLib, PCIPCIeDevices);
+    if (SizeLive) {
+        QueryPerformanceCounter(&Start);
+        for (UINT32 Device = 0; Device < PCIPCIeDevices.GetCount(); Device++)
+        {
+            //
+            // A bridge with decode off stops forwarding to every device
+            // below it.
+            //
+            if ((PCIPCIeDevices.GetClassCode(Device) >> 16) == PCI_CLASS_BRIDGE) {
+                Bridges++;
+                continue;
+            }
+            userStatus = Bars.SizeBars(CHWLib, PCIPCIeDevices.GetBus(Device), PCIPCIeDevices.GetDevice(Device), PCIPCIeDevices.GetFunction(Device));
+            if (userStatus != Success) {
+                std::cout << "BAR sizing failed, Error: " << Bars.GetStatusMessage() << std::endl;
+            }
+        }
+        QueryPerformanceCounter(&End);
+    }
 
-    //
-    // Dump all 4 KB config space of all PCIe devices
-    //
-    Dump4KBytesPCIConfigSpace(CHWLib, PCIPCIeDevices);
+    for (UINT32 Bar = 0; Bar < Bars.GetCount(); Bar++)
+    {
+        std::cout << "Bus: 0x" << std::hex << +Bars.GetBus(Bar) << ", Device: 0x" << +Bars.GetDevice(Bar) << ", Function: 0x" << +Bars.GetFunction(Bar)
+            << ", BAR" << std::dec << +Bars.GetBar(Bar) << ": 0x" << std::hex << std::setw(16) << std::setfill('0') << Bars.GetBase(Bar)
+            << " size 0x" << Bars.GetSize(Bar) << std::setfill(' ')
+            << ((Bars.GetFlags(Bar) & BAR_INDEX_64BIT) ? " 64-bit" : " 32-bit")
+            << ((Bars.GetFlags(Bar) & BAR_INDEX_PREFETCHABLE) ? " prefetchable" : "") << std::endl;
+    }
+    std::cout << std::dec << Bars.GetCount() << " BARs of " << PCIPCIeDevices.GetCount() << " functions " << (SizeLive ? "sized" : "read")
+        << " in " << std::fixed << std::setprecision(3) << (double)(End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart << " ms";
+    if (SizeLive) {
+        std::cout << ", " << Bridges << " bridges not sized";
+    }
+    std::cout << std::endl;
+
+    for (auto Address : Lookups)
+    {
+        UINT32 Bar = Bars.Find(Address, 1);
+        if (Bar == BAR_INDEX_INVALID) {
+            std::cout << "0x" << std::hex << Address << ": not inside a known BAR" << std::endl;
+            continue;
+        }
+        std::cout << "0x" << std::hex << Address << ": Bus: 0x" << +Bars.GetBus(Bar) << ", Device: 0x" << +Bars.GetDevice(Bar)
+            << ", Function: 0x" << +Bars.GetFunction(Bar) << ", BAR" << std::dec << +Bars.GetBar(Bar) << " offset 0x" << std::hex
+            << Address - Bars.GetBase(Bar) << std::endl;
+    }
 
+    if (!Lookups.empty()) {
+        QueryPerformanceCounter(&Start);
+        for (UINT32 Repeat = 0; Repeat < BAR_LOOKUP_REPEAT; Repeat++)
+        {
+            for (auto Address : Lookups)
+            {
+                Found += (Bars.Find(Address + Repeat % 4, 1) != BAR_INDEX_INVALID);
+            }
+        }
+        QueryPerformanceCounter(&End);
+        std::cout << std::dec << BAR_LOOKUP_REPEAT * Lookups.size() << " lookups (" << Found << " found) at " << std::fixed << std::setprecision(1)
+            << (double)BAR_LOOKUP_REPEAT * Lookups.size() * Frequency.QuadPart / (End.QuadPart - Start.QuadPart + 1) / 1000000 << " M/s" << std::endl;
+    }
 
-    userStatus = CHWLib.CHardwareInterfaceLibUninitialise();
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return 0;
+}
+
+int BrokerCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    std::string PipeName = HW_BROKER_PIPE_NAME;
+    UINT32 Ttl = CONFIG_CACHE_DEFAULT_TTL;
+    std::string TraceFile;
+    CAccessTraceRecorder Recorder;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-pipe" && i + 1 < argc) {
+            PipeName = argv[++i];
+        }
+        else if (Option == "-ttl" && i + 1 < argc) {
+            Ttl = (UINT32)std::stoul(argv[++i], nullptr, 0);
+        }
+        else if (Option == "-trace" && i + 1 < argc) {
+            TraceFile = argv[++i];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
     if (userStatus != Success)
     {
-        std::cout << "CHardwareInterfaceLibUninitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    if (!StartTrace(CHWLib, Recorder, TraceFile)) {
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    CHardwareBroker Broker(CHWLib);
+    userStatus = Broker.Start(PipeName.c_str(), Ttl);
+    if (userStatus != Success) {
+        std::cout << "Broker start failed, Error: " << Broker.GetStatusMessage() << std::endl;
+        StopTrace(CHWLib, Recorder, TraceFile);
+        CHWLib.CHardwareInterfaceLibUninitialise();
+        return 1;
+    }
+
+    std::cout << "Serving " << PipeName << " with a " << std::dec << Ttl << " ms cache, press Enter to stop" << std::endl;
+    std::cin.get();
+    Broker.Stop();
+
+    HardwareBrokerStatistics Statistics = Broker.GetStatistics();
+    std::cout << std::dec << Statistics.m_Connections << " connections, " << Statistics.m_Messages << " messages, " << Statistics.m_Requests
+        << " reads in " << Statistics.m_Batches << " rounds, " << Statistics.m_Merged << " merged, " << Statistics.m_CacheHits
+        << " cache hits, " << Statistics.m_Transfers << " transfers" << std::endl;
+
+    StopTrace(CHWLib, Recorder, TraceFile);
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return 0;
+}
+
+int ReplayCommand(int argc, char* argv[])
+{
+    UserStatus userStatus = Success;
+    CAccessTraceReplayer Replayer;
+    AccessTraceReplayStatistics Statistics;
+    bool OriginalSpeed = false;
+    bool Scripts = false;
+    UINT32 Passes = 1;
+    static const char* OperationNames[AccessTraceOperationCount] = { "", "StdCfgRead", "ExCfgRead", "MMIORead", "BarRead", "RegScript" };
+
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+
+    for (int i = 3; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-original") {
+            OriginalSpeed = true;
+        }
+        else if (Option == "-scripts") {
+            Scripts = true;
+        }
+        else if (Option == "-passes" && i + 1 < argc) {
+            Passes = (UINT32)std::stoul(argv[++i], nullptr, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    userStatus = Replayer.Open(argv[2]);
+    if (userStatus != Success) {
+        std::cout << "Trace open failed, Error: " << Replayer.GetStatusMessage() << std::endl;
+        return 1;
+    }
+
+    CHardwareInterfaceLib CHWLib;
+    userStatus = CHWLib.CHardwareInterfaceLibInitialise();
+    if (userStatus != Success)
+    {
+        std::cout << "CHardwareInterfaceLibInitialise failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
         return 1;
     }
+
+    for (UINT32 Pass = 0; Pass < Passes; Pass++)
+    {
+        userStatus = Replayer.Replay(CHWLib, OriginalSpeed, Scripts, Statistics);
+        if (userStatus != Success) {
+            std::cout << "Replay failed, Error: " << Replayer.GetStatusMessage() << std::endl;
+            break;
+        }
+
+        std::cout << "Pass " << std::dec << Pass << ": " << Statistics.m_Replayed << " accesses in " << std::fixed << std::setprecision(3)
+            << (double)Statistics.m_ElapsedNs / 1000000 << " ms, recorded " << (double)Statistics.m_RecordedNs / 1000000 << " ms, "
+            << Statistics.m_Skipped << " skipped, " << Statistics.m_Mismatches << " status mismatches" << std::endl;
+        for (UINT32 Operation = 1; Operation < AccessTraceOperationCount; Operation++)
+        {
+            const AccessTraceOperationStatistics& Counters = Statistics.m_Operations[Operation];
+            if (Counters.m_Count == 0) {
+                continue;
+            }
+            std::cout << "  " << std::left << std::setw(12) << OperationNames[Operation] << std::right << std::setw(10) << Counters.m_Count
+                << " accesses, " << std::setw(10) << Counters.m_Bytes << " bytes, " << std::setprecision(2)
+                << (double)Counters.m_ReplayedNs / Counters.m_Count / 1000 << " us/access, recorded "
+                << (double)Counters.m_RecordedNs / Counters.m_Count / 1000 << " us, max " << (double)Counters.m_MaxReplayedNs / 1000 << " us" << std::endl;
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+
+    return (userStatus == Success) ? 0 : 1;
+}
+
+//
+// Records the accesses of CHWLib to TraceFile, does nothing without a file.
+//
+bool StartTrace(CHardwareInterfaceLib& CHWLib, CAccessTraceRecorder& Recorder, const std::string& TraceFile)
+{
+    if (TraceFile.empty()) {
+        return true;
+    }
+
+    if (Recorder.Start(TraceFile.c_str()) != Success) {
+        std::cout << "Trace start failed, Error: " << Recorder.GetStatusMessage() << std::endl;
+        return false;
+    }
+    CHWLib.SetTraceRecorder(&Recorder);
+    return true;
+}
+
+void StopTrace(CHardwareInterfaceLib& CHWLib, CAccessTraceRecorder& Recorder, const std::string& TraceFile)
+{
+    if (TraceFile.empty()) {
+        return;
+    }
+
+    CHWLib.SetTraceRecorder(NULL);
+    if (Recorder.Stop() != Success) {
+        std::cout << "Trace stop failed, Error: " << Recorder.GetStatusMessage() << std::endl;
+        return;
+    }
+    std::cout << std::dec << Recorder.GetRecordCount() << " accesses recorded to " << TraceFile << std::endl;
 }
 
-void Dump256BytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, std::vector<PCI_PCIeDevice> PCIDevices)
+//
+// Opens PCI_IDS_IMAGE_FILE next to the executable if it exists, device
+// names then come from it instead of the device registry properties.
+//
+void OpenPciIds(CPciIds& PciIds)
+{
+    CHAR ModulePath[MAX_PATH];
+    DWORD Length = GetModuleFileNameA(NULL, ModulePath, sizeof(ModulePath));
+    std::string ImagePath;
+
+    if (Length == 0 || Length >= sizeof(ModulePath)) {
+        return;
+    }
+
+    ImagePath.assign(ModulePath, Length);
+    ImagePath = ImagePath.substr(0, ImagePath.find_last_of("\\/") + 1) + PCI_IDS_IMAGE_FILE;
+    PciIds.Open(ImagePath);
+}
+
+void Dump256BytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, const CDeviceRegistry& PCIDevices, CCaptureArena& Arena, CRegisterIndexBuilder* Index)
 {
     UserStatus userStatus = Success;
 
+    if (Arena.Reserve(PCIDevices.GetCount(), PCI_STD_CFG_SIZE) != Success) {
+        std::cout << "Memory allocation failed, Error: " << Arena.GetStatusMessage() << std::endl;
+        return;
+    }
+
     //
     // Dump all  256 bytes config space of all PCI devices
     //
-    for (auto Device = PCIDevices.begin(); Device != PCIDevices.end(); ++Device)
+    for (UINT32 Device = 0; Device < PCIDevices.GetCount(); Device++)
     {
-        std::cout << "Device: " << Device->DeviceName << ", " << "Bus: 0x" << std::hex << +(Device->Bus) << ", " << "Device: 0x" << std::hex << +(Device->Device) << ", "
-            << "Function: 0x" << std::hex << +(Device->Function) << std::endl;
+        UINT8 Bus = PCIDevices.GetBus(Device);
+        UINT8 DeviceNumber = PCIDevices.GetDevice(Device);
+        UINT8 Function = PCIDevices.GetFunction(Device);
+
+        std::cout << "Device: " << PCIDevices.GetName(Device) << ", " << "Bus: 0x" << std::hex << +Bus << ", " << "Device: 0x" << std::hex << +DeviceNumber << ", "
+            << "Function: 0x" << std::hex << +Function << std::endl;
 
         PCI_PCIeCfgData pciStdData;
-        pciStdData.m_Bus = Device->Bus;
-        pciStdData.m_Device = Device->Device;
-        pciStdData.m_Function = Device->Function;
+        pciStdData.m_Bus = Bus;
+        pciStdData.m_Device = DeviceNumber;
+        pciStdData.m_Function = Function;
         pciStdData.m_Offset = 0;
         pciStdData.OutputData.m_Size = PCI_STD_CFG_SIZE;
-        pciStdData.OutputData.DataPointer = (PUINT8)calloc(1, pciStdData.OutputData.m_Size);
-        if (pciStdData.OutputData.DataPointer == NULL) {
-            std::cout << "Memory allocation failed" << std::endl;
-            return;
-        }
+        pciStdData.OutputData.DataPointer = Arena.GetSlot(Device);
 
         userStatus = CHWLib.PCIStdCfgRead(&pciStdData);
         if (userStatus != Success) {
-            if (pciStdData.OutputData.DataPointer) {
-                free(pciStdData.OutputData.DataPointer);
-            }
             std::cout << "PCIStdCfgRead failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
             std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
             continue;
         }
 
-        std::cout << "   00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F" << std::endl;
-        std::cout << "-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --" << std::endl;
-        for (UINT32 RowIndex = 0; RowIndex < pciStdData.OutputData.m_Size; RowIndex += 0x10)
-        {
-            std::cout << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << RowIndex << "|";
-            for (UINT32 ByteIndex = RowIndex; ByteIndex < RowIndex + 0x10; ByteIndex++)
-            {
-                std::cout << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << +(pciStdData.OutputData.DataPointer[ByteIndex]) << " ";
-            }
-            std::cout << std::endl;
+        PrintConfigSpace(pciStdData.OutputData.DataPointer, pciStdData.OutputData.m_Size);
+        if (Index != NULL) {
+            Index->Add(Bus, DeviceNumber, Function, pciStdData.OutputData.DataPointer, pciStdData.OutputData.m_Size);
         }
 
-        if (pciStdData.OutputData.DataPointer) {
-            free(pciStdData.OutputData.DataPointer);
-        }
         std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
     }
 }
 
-void Dump4KBytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, std::vector<PCI_PCIeDevice> PCIeDevices)
+UserStatus ReadCapturedHeader(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    CapturedHeader* Header = (CapturedHeader*)Context;
+    UserStatus userStatus = Success;
+
+    if (Offset + Size <= PCI_STD_CFG_SIZE) {
+        memcpy(Data, Header->m_Header + Offset, Size);
+        return Success;
+    }
+
+    PCI_PCIeCfgData cfgData;
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = Function;
+    cfgData.m_Offset = Offset;
+    cfgData.OutputData.m_Size = Size;
+    cfgData.OutputData.DataPointer = Data;
+
+    userStatus = Header->m_CHWLib->PCIeExCfgRead(&cfgData);
+    Header->m_BytesRead += Size;
+    return userStatus;
+}
+
+//
+// In adaptive mode the standard header is read first, the extent of the
+// populated space is found from the PCI Express capability and the extended
+// capability chain, and only the range up to it is read. The rest of the
+// slot is zeroed, as if the function had no more extended capabilities.
+// With a scheduler, functions in D3 are skipped or, with PowerDeferLowPower,
+// read last if they have left D3 by then.
+//
+void Dump4KBytesPCIConfigSpace(CHardwareInterfaceLib& CHWLib, const CDeviceRegistry& PCIeDevices, CCaptureArena& Arena, CRegisterIndexBuilder* Index, bool Adaptive, CPowerScheduler* Scheduler, PowerPolicy Policy)
 {
     UserStatus userStatus = Success;
+    CapturedHeader Header = { &CHWLib, NULL, 0 };
+    CCapabilityWalker Walker(ReadCapturedHeader, &Header);
+    LARGE_INTEGER Frequency, Start, End;
+    UINT64 ReadTicks = 0;
+    std::vector<UINT32> Order, Deferred;
+    UINT32 FirstDeferred = 0;
+    static const char* PowerStateNames[] = { "D0", "D1", "D2", "D3hot", "D3cold", "unknown" };
+
+    if (Arena.Reserve(PCIeDevices.GetCount(), PCIe_CFG_SIZE) != Success) {
+        std::cout << "Memory allocation failed, Error: " << Arena.GetStatusMessage() << std::endl;
+        return;
+    }
+
+    if (Scheduler != NULL) {
+        Scheduler->Schedule(Policy, Order, Deferred);
+    }
+    else {
+        for (UINT32 Device = 0; Device < PCIeDevices.GetCount(); Device++)
+        {
+            Order.push_back(Device);
+        }
+    }
+    FirstDeferred = (UINT32)Order.size();
+    Order.insert(Order.end(), Deferred.begin(), Deferred.end());
+
+    QueryPerformanceFrequency(&Frequency);
 
     //
-    // Dump all  256 bytes config space of all PCI devices
+    // Dump all 4 KB config space of all PCIe devices
     //
-    for (auto Device = PCIeDevices.begin(); Device != PCIeDevices.end(); ++Device)
+    for (UINT32 Position = 0; Position < Order.size(); Position++)
     {
-        std::cout << "Device: " << Device->DeviceName << ", " << "Bus: 0x" << std::hex << +(Device->Bus) << ", " << "Device: 0x" << std::hex << +(Device->Device) << ", "
-            << "Function: 0x" << std::hex << +(Device->Function) << std::endl;
+        UINT32 Device = Order[Position];
+        UINT8 Bus = PCIeDevices.GetBus(Device);
+        UINT8 DeviceNumber = PCIeDevices.GetDevice(Device);
+        UINT8 Function = PCIeDevices.GetFunction(Device);
+        UINT32 Extent = PCIe_CFG_SIZE;
+
+        std::cout << "Device: " << PCIeDevices.GetName(Device) << ", " << "Bus: 0x" << std::hex << +Bus << ", " << "Device: 0x" << std::hex << +DeviceNumber << ", "
+            << "Function: 0x" << std::hex << +Function;
+        if (Scheduler != NULL) {
+            if (Position >= FirstDeferred && Scheduler->Reclassify(Device) == Success && Scheduler->IsLowPower(Device)) {
+                std::cout << ", still in " << PowerStateNames[Scheduler->GetPowerState(Device)] << ", skipped" << std::endl;
+                std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
+                Scheduler->SetOutcome(Device, CaptureSkipped);
+                continue;
+            }
+            std::cout << ", " << PowerStateNames[Scheduler->GetPowerState(Device)];
+        }
+        std::cout << std::endl;
 
         PCI_PCIeCfgData pciExCfgData;
-        pciExCfgData.m_Bus = Device->Bus;
-        pciExCfgData.m_Device = Device->Device;
-        pciExCfgData.m_Function = Device->Function;
+        pciExCfgData.m_Bus = Bus;
+        pciExCfgData.m_Device = DeviceNumber;
+        pciExCfgData.m_Function = Function;
         pciExCfgData.m_Offset = 0;
         pciExCfgData.OutputData.m_Size = PCIe_CFG_SIZE;
-        pciExCfgData.OutputData.DataPointer = (PUINT8)calloc(1, pciExCfgData.OutputData.m_Size);
-        if (pciExCfgData.OutputData.DataPointer == NULL) {
-            std::cout << "Memory allocation failed" << std::endl;
-            return;
+        pciExCfgData.OutputData.DataPointer = Arena.GetSlot(Device);
+
+        QueryPerformanceCounter(&Start);
+        if (!Adaptive) {
+            userStatus = CHWLib.PCIeExCfgRead(&pciExCfgData);
+            Header.m_BytesRead += PCIe_CFG_SIZE;
+        }
+        else {
+            pciExCfgData.OutputData.m_Size = PCI_STD_CFG_SIZE;
+            userStatus = CHWLib.PCIStdCfgRead(&pciExCfgData);
+            Header.m_BytesRead += PCI_STD_CFG_SIZE;
+            if (userStatus == Success) {
+                Header.m_Header = pciExCfgData.OutputData.DataPointer;
+                userStatus = Walker.GetExtent(Bus, DeviceNumber, Function, &Extent);
+                if (userStatus != Success) {
+                    std::cout << "Capability walk failed, Error: " << Walker.GetStatusMessage() << std::endl;
+                    std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
+                    continue;
+                }
+            }
+            if (userStatus == Success && Extent > PCI_STD_CFG_SIZE) {
+                pciExCfgData.m_Offset = PCI_STD_CFG_SIZE;
+                pciExCfgData.OutputData.m_Size = Extent - PCI_STD_CFG_SIZE;
+                pciExCfgData.OutputData.DataPointer = Arena.GetSlot(Device) + PCI_STD_CFG_SIZE;
+                userStatus = CHWLib.PCIeExCfgRead(&pciExCfgData);
+                Header.m_BytesRead += pciExCfgData.OutputData.m_Size;
+            }
+            memset(Arena.GetSlot(Device) + Extent, 0, PCIe_CFG_SIZE - Extent);
         }
+        QueryPerformanceCounter(&End);
+        ReadTicks += End.QuadPart - Start.QuadPart;
 
-        userStatus = CHWLib.PCIeExCfgRead(&pciExCfgData);
+        if (Scheduler != NULL) {
+            Scheduler->SetOutcome(Device, (userStatus == Success) ? CaptureDone : CaptureFailed);
+        }
         if (userStatus != Success) {
-            if (pciExCfgData.OutputData.DataPointer) {
-                free(pciExCfgData.OutputData.DataPointer);
-            }
             std::cout << "PCIeExCfgRead failed, Error: " << CHWLib.GetStatusMessage() << std::endl;
             std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
             continue;
         }
 
-        std::cout << "    00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F" << std::endl;
-        std::cout << " -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --" << std::endl;
-        for (UINT32 RowIndex = 0; RowIndex < pciExCfgData.OutputData.m_Size; RowIndex += 0x10)
-        {
-            std::cout << std::setw(3) << std::setfill('0') << std::uppercase << std::hex << RowIndex << "|";
-            for (UINT32 ByteIndex = RowIndex; ByteIndex < RowIndex + 0x10; ByteIndex++)
-            {
-                std::cout << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << +(pciExCfgData.OutputData.DataPointer[ByteIndex]) << " ";
-            }
-            std::cout << std::endl;
+        PrintConfigSpace(Arena.GetSlot(Device), Extent);
+        if (Index != NULL) {
+            Index->Add(Bus, DeviceNumber, Function, Arena.GetSlot(Device), PCIe_CFG_SIZE);
         }
 
-        if (pciExCfgData.OutputData.DataPointer) {
-            free(pciExCfgData.OutputData.DataPointer);
-        }
         std::cout << std::endl << std::string(100, '*') << std::endl << std::endl;
     }
+
+    std::cout << std::dec << PCIeDevices.GetCount() << " functions, " << Header.m_BytesRead << " bytes read in "
+        << (double)ReadTicks * 1000.0 / Frequency.QuadPart << " ms" << std::endl;
+
+    if (Scheduler != NULL) {
+        UINT32 Outcomes[CaptureDeferred + 1] = { 0 };
+        for (UINT32 Device = 0; Device < Scheduler->GetCount(); Device++)
+        {
+            Outcomes[Scheduler->GetOutcome(Device)]++;
+        }
+        std::cout << Outcomes[CaptureDone] << " captured, " << Outcomes[CaptureFailed] << " failed, " << Outcomes[CaptureSkipped]
+            << " skipped in low power, " << Deferred.size() << " deferred" << std::endl;
+    }
 }
 
-UserStatus GetPCIPCIeDevices(std::vector<PCI_PCIeDevice>& PCIPCIeDevices)
+UserStatus GetPCIPCIeDevices(CDeviceRegistry& PCIPCIeDevices, CPciIds* PciIds, CBarIndex* Bars)
 {
     UserStatus userStatus = Success;
     CONFIGRET cr = CR_SUCCESS;
@@ -265,55 +1768,78 @@ UserStatus GetPCIPCIeDevices(std::vector<PCI_PCIeDevice>& PCIPCIeDevices)
         DeviceNumber = (Address & 0xFFFF0000) >> 16;
         FunctionNumber = (Address & 0x0000FFFF);
 
+        UINT32 RegValue = 0;
+        PCI_PCIeCfgData pciStdData;
+        pciStdData.m_Bus = BusNumber;
+        pciStdData.m_Device = DeviceNumber;
+        pciStdData.m_Function = FunctionNumber;
+        pciStdData.m_Offset = 0;
+        pciStdData.OutputData.m_Size = sizeof(RegValue);
+        pciStdData.OutputData.DataPointer = (PUINT8)&RegValue;
+
+        userStatus = CHWLib.PCIStdCfgRead(&pciStdData);
+        if (userStatus != Success) {
+            continue;
+        }
+
         //
-        // Get device friendly name / device description
+        // Name the device from the PCI id image when one is open, the
+        // subsystem ids only exist in type 0 headers.
         //
         std::string DeviceName;
-        CHAR Buffer[1024];
-        RequiredLength = sizeof(Buffer);
-        cr = CM_Get_DevNode_Registry_PropertyA(DevInst,
-            CM_DRP_FRIENDLYNAME,
-            NULL,
-            Buffer,
-            &RequiredLength,
-            0);
-        if (cr != CR_SUCCESS) {
+        bool Named = false;
+        if (PciIds != NULL && PciIds->IsOpen()) {
+            PciHeaderType::ValueType HeaderType = 0;
+            PciSubsystem::ValueType Subsystem = 0;
+
+            if (CHWLib.ReadRegister<PciHeaderType>(BusNumber, DeviceNumber, FunctionNumber, HeaderType) == Success &&
+                PciHeaderLayout::Get(HeaderType) == 0) {
+                CHWLib.ReadRegister<PciSubsystem>(BusNumber, DeviceNumber, FunctionNumber, Subsystem);
+            }
+            Named = PciIds->GetDeviceName((UINT16)(RegValue & 0xFFFF), (UINT16)(RegValue >> 16),
+                (UINT16)PciSubsystemVendorId::Get(Subsystem), (UINT16)PciSubsystemId::Get(Subsystem), DeviceName);
+        }
+
+        //
+        // Otherwise get device friendly name / device description
+        //
+        if (!Named) {
+            CHAR Buffer[1024];
+            RequiredLength = sizeof(Buffer);
             cr = CM_Get_DevNode_Registry_PropertyA(DevInst,
-                CM_DRP_DEVICEDESC,
+                CM_DRP_FRIENDLYNAME,
                 NULL,
                 Buffer,
                 &RequiredLength,
                 0);
             if (cr != CR_SUCCESS) {
-                DeviceName = "Unknown Device";
+                cr = CM_Get_DevNode_Registry_PropertyA(DevInst,
+                    CM_DRP_DEVICEDESC,
+                    NULL,
+                    Buffer,
+                    &RequiredLength,
+                    0);
+                if (cr != CR_SUCCESS) {
+                    DeviceName = "Unknown Device";
+                }
+                else {
+                    Buffer[sizeof(Buffer) - 1] = '\0';
+                    DeviceName = Buffer;
+                }
             }
             else {
                 Buffer[sizeof(Buffer) - 1] = '\0';
                 DeviceName = Buffer;
             }
         }
-        else {
-            Buffer[sizeof(Buffer) - 1] = '\0';
-            DeviceName = Buffer;
-        }
 
-        UINT32 RegValue = 0;
-        PCI_PCIeCfgData pciStdData;
-        pciStdData.m_Bus = BusNumber;
-        pciStdData.m_Device = DeviceNumber;
-        pciStdData.m_Function = FunctionNumber;
-        pciStdData.m_Offset = 0;
-        pciStdData.OutputData.m_Size = sizeof(RegValue);
-        pciStdData.OutputData.DataPointer = (PUINT8)&RegValue;
+        PciClassCode::ValueType ClassCode = 0;
+        CHWLib.ReadField<PciClassCode>(BusNumber, DeviceNumber, FunctionNumber, ClassCode);
+        PCIPCIeDevices.Add(BusNumber, DeviceNumber, FunctionNumber, (UINT16)(RegValue & 0xFFFF), (UINT16)(RegValue >> 16), ClassCode, DeviceName);
 
-        userStatus = CHWLib.PCIStdCfgRead(&pciStdData);
-        if (userStatus == Success) {
-            PCI_PCIeDevice Device;
-            Device.DeviceName = DeviceName;
-            Device.Bus = BusNumber;
-            Device.Device = DeviceNumber;
-            Device.Function = FunctionNumber;
-            PCIPCIeDevices.push_back(Device);
+        if (Bars != NULL && AddBarResources(CHWLib, *Bars, DevInst, BusNumber, DeviceNumber, FunctionNumber) != Success) {
+            std::cout << "BAR resources of Bus: 0x" << std::hex << BusNumber << ", Device: 0x" << +DeviceNumber << ", Function: 0x" << +FunctionNumber
+                << " not added, Error: " << Bars->GetStatusMessage() << std::dec << std::endl;
         }
     }
 
@@ -332,4 +1858,67 @@ Exit:
     }
 
     return userStatus;
-}
\ No newline at end of file
+}
+//
+// Adds the memory windows in the allocated configuration of a function,
+// the resources the PnP manager programmed into its BARs and, for a
+// bridge, its windows, which AddResource skips.
+//
+UserStatus AddBarResources(CHardwareInterfaceLib& CHWLib, CBarIndex& Bars, DEVINST DevInst, UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    UserStatus userStatus = Success;
+    LOG_CONF LogConf = 0;
+    RES_DES ResDes = 0;
+    RES_DES NextResDes = 0;
+    RESOURCEID ResourceId = 0;
+    std::vector<UINT8> Data;
+
+    if (CM_Get_First_Log_Conf(&LogConf, DevInst, ALLOC_LOG_CONF) != CR_SUCCESS) {
+        return Success;
+    }
+
+    ResDes = (RES_DES)LogConf;
+    while (userStatus == Success && CM_Get_Next_Res_Des(&NextResDes, ResDes, ResType_All, &ResourceId, 0) == CR_SUCCESS)
+    {
+        ULONG DataSize = 0;
+        UINT64 Base = 0;
+        UINT64 End = 0;
+
+        if (ResDes != (RES_DES)LogConf) {
+            CM_Free_Res_Des_Handle(ResDes);
+        }
+        ResDes = NextResDes;
+
+        if ((ResourceId != ResType_Mem && ResourceId != ResType_MemLarge) ||
+            CM_Get_Res_Des_Data_Size(&DataSize, ResDes, 0) != CR_SUCCESS || DataSize == 0) {
+            continue;
+        }
+        Data.resize(DataSize);
+        if (CM_Get_Res_Des_Data(ResDes, Data.data(), DataSize, 0) != CR_SUCCESS) {
+            continue;
+        }
+
+        if (ResourceId == ResType_Mem && DataSize >= sizeof(MEM_DES)) {
+            const MEM_DES* Memory = (const MEM_DES*)Data.data();
+            Base = Memory->MD_Alloc_Base;
+            End = Memory->MD_Alloc_End;
+        }
+        else if (ResourceId == ResType_MemLarge && DataSize >= sizeof(MEM_LARGE_DES)) {
+            const MEM_LARGE_DES* Memory = (const MEM_LARGE_DES*)Data.data();
+            Base = Memory->MLD_Alloc_Base;
+            End = Memory->MLD_Alloc_End;
+        }
+        if (End <= Base) {
+            continue;
+        }
+
+        userStatus = Bars.AddResource(CHWLib, Bus, Device, Function, Base, End - Base + 1);
+    }
+
+    if (ResDes != (RES_DES)LogConf) {
+        CM_Free_Res_Des_Handle(ResDes);
+    }
+    CM_Free_Log_Conf_Handle(LogConf);
+
+    return userStatus;
+}
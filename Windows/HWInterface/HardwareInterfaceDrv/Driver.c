@@ -98,8 +98,10 @@ Return Value:
     //
     // In order to create a control device, we first need to allocate a
     // WDFDEVICE_INIT structure and set all properties.
+    // Everyone may open the device for reading, only system and
+    // administrators for writing, which IOCTL_PLATFORM_REG_SCRIPT_WRITE needs.
     //
-    deviceInit = WdfControlDeviceInitAllocate(driver, &SDDL_DEVOBJ_SYS_ALL_ADM_RWX_WORLD_RW_RES_R
+    deviceInit = WdfControlDeviceInitAllocate(driver, &SDDL_DEVOBJ_SYS_ALL_ADM_RWX_WORLD_R_RES_R
     );
     if (deviceInit == NULL) {
         status = STATUS_INSUFFICIENT_RESOURCES;
@@ -130,6 +132,7 @@ Return Value:
     // Specify the size of device context
     //
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, CONTROL_DEVICE_EXTENSION);
+    attributes.EvtCleanupCallback = HardwareInterfaceDrvEvtDeviceCleanup;
 
     status = WdfDeviceCreate(&deviceInit, &attributes, &controlDevice);
     if (!NT_SUCCESS(status))
@@ -184,6 +187,29 @@ Return Value:
         return status;
     }
 
+    //
+    // Manual queue that holds the IOCTL_PLATFORM_RING_SETUP request while
+    // its ring is served, so the default queue keeps dispatching.
+    //
+    KeInitializeEvent(&ControlGetData(controlDevice)->RingWakeup, SynchronizationEvent, FALSE);
+
+    WDF_IO_QUEUE_CONFIG_INIT(&IOQueueConfig, WdfIoQueueDispatchManual);
+    IOQueueConfig.EvtIoCanceledOnQueue = HardwareInterfaceDrvEvtRingCanceledOnQueue;
+
+    status = WdfIoQueueCreate(controlDevice,
+        &IOQueueConfig,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &ControlGetData(controlDevice)->RingQueue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "%!FUNC!: WdfIoQueueCreate for the ring queue failed %!STATUS!\n", status);
+        WPP_CLEANUP(DriverObject);
+        if (deviceInit != NULL) {
+            WdfDeviceInitFree(deviceInit);
+        }
+        return status;
+    }
+
     //
     // Control devices must notify WDF when they are done initializing.
     // I/O is rejected until this call is made.
@@ -213,11 +239,12 @@ void HardwareInterfaceDrvEvtIoDeviceControl(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC!: Entry\n");
 
-    UNREFERENCED_PARAMETER(Queue);
-
     PAGED_CODE();
 
-    if (!OutputBufferLength || !InputBufferLength)
+    //
+    // Every request carries buffers except the ring doorbell.
+    //
+    if ((!OutputBufferLength || !InputBufferLength) && IoControlCode != IOCTL_PLATFORM_RING_DOORBELL)
     {
         status = STATUS_INVALID_PARAMETER;
         WdfRequestComplete(Request, status);
@@ -396,6 +423,304 @@ void HardwareInterfaceDrvEvtIoDeviceControl(
             break;
         }
 
+        case IOCTL_PLATFORM_REG_SCRIPT_EXECUTE:
+        case IOCTL_PLATFORM_REG_SCRIPT_WRITE:
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Called  IOCTL_PLATFORM_REG_SCRIPT_EXECUTE 0x%x\n", IoControlCode);
+
+            if (InputBufferLength < sizeof(RegScriptHeader))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Input buffer too small\n");
+                break;
+            }
+
+            if (OutputBufferLength < sizeof(RegScriptResult))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Output buffer too small\n");
+                break;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(Request, 0, &InBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(Request, 0, &OutBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            //
+            // Input and output share the system buffer, copy the script so
+            // results can be written while it executes.
+            //
+            PRegScriptHeader script = (PRegScriptHeader)ExAllocatePoolWithTag(NonPagedPoolNx, InputBufferLength, DRIVER_POOL_TAG);
+            if (script == NULL) {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Unable to allocate script copy\n");
+                break;
+            }
+            RtlCopyMemory(script, InBuf, InputBufferLength);
+
+            UINT32 resultCount = 0;
+            UINT32 scriptStatus = RegScriptValidate(script, InputBufferLength, &resultCount);
+            if (scriptStatus != REG_SCRIPT_STATUS_SUCCESS) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Register script rejected, script status 0x%x\n", scriptStatus);
+                ExFreePoolWithTag(script, DRIVER_POOL_TAG);
+                break;
+            }
+
+            //
+            // The I/O manager only lets IOCTL_PLATFORM_REG_SCRIPT_WRITE
+            // through on handles opened for writing.
+            //
+            if (IoControlCode == IOCTL_PLATFORM_REG_SCRIPT_EXECUTE && RegScriptWrites(script)) {
+                status = STATUS_ACCESS_DENIED;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Register script writes, IOCTL_PLATFORM_REG_SCRIPT_WRITE required\n");
+                ExFreePoolWithTag(script, DRIVER_POOL_TAG);
+                break;
+            }
+
+            SIZE_T resultLength = sizeof(RegScriptResult) + (SIZE_T)resultCount * sizeof(UINT32);
+            if (OutputBufferLength < resultLength) {
+                status = STATUS_BUFFER_TOO_SMALL;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Output buffer too small for %d results\n", resultCount);
+                ExFreePoolWithTag(script, DRIVER_POOL_TAG);
+                break;
+            }
+
+            REG_SCRIPT_CONTEXT scriptContext;
+            RtlSecureZeroMemory(&scriptContext, sizeof(scriptContext));
+            scriptContext.Bus = script->m_Bus;
+            scriptContext.Slot.u.bits.DeviceNumber = script->m_Device;
+            scriptContext.Slot.u.bits.FunctionNumber = script->m_Function;
+            scriptContext.MmioBase.QuadPart = script->m_MmioBase;
+
+            RegScriptAccessor accessor;
+            accessor.m_Context = &scriptContext;
+            accessor.m_Read = HardwareInterfaceDrvScriptRead;
+            accessor.m_Write = HardwareInterfaceDrvScriptWrite;
+            accessor.m_Stall = HardwareInterfaceDrvScriptStall;
+
+            scriptStatus = RegScriptExecute(script, &accessor, (PRegScriptResult)OutBuf, OutputBufferLength);
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Register script completed, script status 0x%x, ops executed %d\n",
+                scriptStatus, ((PRegScriptResult)OutBuf)->m_OpsExecuted);
+
+            if (scriptContext.Mmio != NULL) {
+                MmUnmapIoSpace(scriptContext.Mmio, PCIe_CFG_SIZE);
+            }
+            ExFreePoolWithTag(script, DRIVER_POOL_TAG);
+
+            //
+            // A script that stopped on a failed access or poll timeout still
+            // completes the request, the caller finds the reason in m_Status.
+            //
+            WdfRequestSetInformation(Request, resultLength);
+
+            break;
+        }
+
+        case IOCTL_PLATFORM_PCIe_BAR_READ:
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Called  IOCTL_PLATFORM_PCIe_BAR_READ 0x%x\n", IoControlCode);
+
+            if (InputBufferLength < sizeof(PCIeBarReadRequest))
+            {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Input buffer too small\n");
+                break;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(Request, sizeof(PCIeBarReadRequest), &InBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            PCIeBarReadRequest barRequest = *(PPCIeBarReadRequest)InBuf;
+
+            if (barRequest.m_Length == 0 || barRequest.m_Length > PCIe_BAR_WINDOW_SIZE) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Requested length %d exceeds BAR window %d bytes.", barRequest.m_Length, PCIe_BAR_WINDOW_SIZE);
+                break;
+            }
+
+            //
+            // The window must not wrap around the physical address space.
+            //
+            UINT64 windowAddress = barRequest.m_BaseAddressRegister + barRequest.m_Offset;
+            if (windowAddress < barRequest.m_BaseAddressRegister || windowAddress + barRequest.m_Length < windowAddress) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "BAR window at 0x%llx offset 0x%llx length %d wraps.",
+                    barRequest.m_BaseAddressRegister, barRequest.m_Offset, barRequest.m_Length);
+                break;
+            }
+
+            //
+            // For METHOD_OUT_DIRECT the output buffer is the caller's buffer
+            // locked by the I/O manager and mapped to system space.
+            //
+            status = WdfRequestRetrieveOutputBuffer(Request, barRequest.m_Length, &OutBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            PHYSICAL_ADDRESS phyAddr;
+            phyAddr.QuadPart = windowAddress;
+
+            PUINT8 pMMIO = (PUINT8)MmMapIoSpace(phyAddr, barRequest.m_Length, MmNonCached);
+            if (pMMIO == NULL) {
+                status = STATUS_NO_MEMORY;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Unable to map BAR window\n");
+                break;
+            }
+
+            HardwareInterfaceDrvCopyFromMmio((PUINT8)OutBuf, pMMIO, barRequest.m_Length);
+
+            MmUnmapIoSpace(pMMIO, barRequest.m_Length);
+
+            WdfRequestSetInformation(Request, barRequest.m_Length);
+
+            break;
+        }
+
+        case IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT:
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Called  IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT 0x%x\n", IoControlCode);
+
+            status = WdfRequestRetrieveInputBuffer(Request, sizeof(PCIeCfgReadRequest), &InBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            PCIeCfgReadRequest cfgRequest = *(PPCIeCfgReadRequest)InBuf;
+
+            if (cfgRequest.m_Length == 0 || cfgRequest.m_Offset >= PCI_CFG_SIZE || cfgRequest.m_Length > PCI_CFG_SIZE - cfgRequest.m_Offset) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Requested offset 0x%x, data length %d exceeds PCI/PCIe standard configuration size %d bytes.",
+                    cfgRequest.m_Offset, cfgRequest.m_Length, PCI_CFG_SIZE);
+                break;
+            }
+
+            //
+            // The minimum length checks the request against the locked
+            // output buffer, a shorter MDL fails with STATUS_BUFFER_TOO_SMALL.
+            //
+            status = WdfRequestRetrieveOutputBuffer(Request, cfgRequest.m_Length, &OutBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            status = HardwareInterfaceDrvReadConfig(cfgRequest.m_Bus, cfgRequest.m_Device, cfgRequest.m_Function,
+                                                    cfgRequest.m_Offset, cfgRequest.m_Length, (PUINT8)OutBuf);
+            if (!NT_SUCCESS(status)) {
+                break;
+            }
+
+            WdfRequestSetInformation(Request, cfgRequest.m_Length);
+
+            break;
+        }
+
+        case IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT:
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Called  IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT 0x%x\n", IoControlCode);
+
+            status = WdfRequestRetrieveInputBuffer(Request, sizeof(PCIeMMIOReadRequest), &InBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            PCIeMMIOReadRequest mmioRequest = *(PPCIeMMIOReadRequest)InBuf;
+
+            if (mmioRequest.m_Length == 0 || mmioRequest.m_Offset >= PCIe_CFG_SIZE || mmioRequest.m_Length > PCIe_CFG_SIZE - mmioRequest.m_Offset) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Requested offset 0x%x, data length %d exceeds PCIe range %d bytes.",
+                    mmioRequest.m_Offset, mmioRequest.m_Length, PCIe_CFG_SIZE);
+                break;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(Request, mmioRequest.m_Length, &OutBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            PHYSICAL_ADDRESS phyAddr;
+            phyAddr.QuadPart = mmioRequest.m_BaseAddressRegister;
+
+            PUINT8 pMMIO = (PUINT8)MmMapIoSpace(phyAddr, PCIe_CFG_SIZE, MmNonCached);
+            if (pMMIO == NULL) {
+                status = STATUS_NO_MEMORY;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Unable to map BAR\n");
+                break;
+            }
+
+            status = HardwareInterfaceDrvReadMmio(pMMIO, mmioRequest.m_Offset, mmioRequest.m_Length, (PUINT8)OutBuf);
+            if (NT_SUCCESS(status)) {
+                WdfRequestSetInformation(Request, mmioRequest.m_Length);
+            }
+
+            MmUnmapIoSpace(pMMIO, PCIe_CFG_SIZE);
+
+            break;
+        }
+
+        case IOCTL_PLATFORM_RING_SETUP:
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Called  IOCTL_PLATFORM_RING_SETUP 0x%x\n", IoControlCode);
+
+            status = WdfRequestRetrieveInputBuffer(Request, sizeof(HwRingSetup), &InBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            HwRingSetup ringSetup = *(PHwRingSetup)InBuf;
+            SIZE_T ringLength = HwRingLayoutSize(ringSetup.m_Entries, ringSetup.m_DataLength);
+
+            if (ringLength == 0 || ringSetup.m_IdleUs > HW_RING_MAX_IDLE_US) {
+                status = STATUS_INVALID_PARAMETER;
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Invalid ring of %d entries, %d data bytes, %d us idle\n",
+                    ringSetup.m_Entries, ringSetup.m_DataLength, ringSetup.m_IdleUs);
+                break;
+            }
+
+            status = WdfRequestRetrieveOutputBuffer(Request, ringLength, &OutBuf, &BufSize);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", status);
+                break;
+            }
+
+            status = HardwareInterfaceDrvRingStart(ControlGetData(WdfIoQueueGetDevice(Queue)), Request, &ringSetup, OutBuf, BufSize);
+            if (NT_SUCCESS(status)) {
+                //
+                // The request waits in the ring queue and keeps the ring
+                // locked until it is canceled.
+                //
+                TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC!: Exit, ring started\n");
+                return;
+            }
+
+            break;
+        }
+
+        case IOCTL_PLATFORM_RING_DOORBELL:
+        {
+            KeSetEvent(&ControlGetData(WdfIoQueueGetDevice(Queue))->RingWakeup, IO_NO_INCREMENT, FALSE);
+
+            break;
+        }
+
         default:
         {
             //
@@ -412,6 +737,652 @@ void HardwareInterfaceDrvEvtIoDeviceControl(
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC!: Exit, status %!STATUS!\n", status);
 }
 
+VOID HardwareInterfaceDrvCopyFromMmio(
+    PUINT8 Destination,
+    PUINT8 Mmio,
+    SIZE_T Length
+)
+/*++
+Routine Description:
+
+    Copies an MMIO range to memory with the widest naturally aligned
+    accesses, byte accesses are only used for an unaligned head and tail.
+
+Arguments:
+
+    Destination - buffer that receives the data.
+
+    Mmio - mapped MMIO range.
+
+    Length - number of bytes to copy.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+#if defined(_WIN64)
+    const SIZE_T accessWidth = sizeof(ULONG64);
+#else
+    const SIZE_T accessWidth = sizeof(ULONG);
+#endif
+    SIZE_T head = (accessWidth - ((ULONG_PTR)Mmio & (accessWidth - 1))) & (accessWidth - 1);
+    SIZE_T bulk;
+
+    if (head > Length) {
+        head = Length;
+    }
+
+    if (head) {
+        READ_REGISTER_BUFFER_UCHAR(Mmio, Destination, (ULONG)head);
+        Mmio += head;
+        Destination += head;
+        Length -= head;
+    }
+
+    bulk = Length / accessWidth;
+    if (bulk) {
+#if defined(_WIN64)
+        READ_REGISTER_BUFFER_ULONG64((PULONG64)Mmio, (PULONG64)Destination, (ULONG)bulk);
+#else
+        READ_REGISTER_BUFFER_ULONG((PULONG)Mmio, (PULONG)Destination, (ULONG)bulk);
+#endif
+        Mmio += bulk * accessWidth;
+        Destination += bulk * accessWidth;
+        Length -= bulk * accessWidth;
+    }
+
+    if (Length) {
+        READ_REGISTER_BUFFER_UCHAR(Mmio, Destination, (ULONG)Length);
+    }
+}
+
+NTSTATUS HardwareInterfaceDrvReadConfig(
+    UINT8 Bus,
+    UINT8 Device,
+    UINT8 Function,
+    UINT32 Offset,
+    UINT32 Length,
+    PUINT8 Buffer
+)
+/*++
+Routine Description:
+
+    Reads a range of standard configuration space with one HAL call.
+
+Arguments:
+
+    Bus, Device, Function - function to read.
+
+    Offset - offset of the range, checked by the caller.
+
+    Length - length of the range, checked by the caller.
+
+    Buffer - buffer that receives the data.
+
+Return Value:
+
+    STATUS_SUCCESS if the whole range was read.
+
+--*/
+{
+    PCI_SLOT_NUMBER slot;
+    RtlSecureZeroMemory(&slot, sizeof(slot));
+    slot.u.bits.DeviceNumber = Device;
+    slot.u.bits.FunctionNumber = Function;
+
+    ULONG bytesReturned = HalGetBusDataByOffset(PCIConfiguration, Bus, slot.u.AsULONG, Buffer, Offset, Length);
+    if (bytesReturned != Length) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Failed to read standard PCI config space for Bus: 0x%x, Device: 0x%x, Function: 0x%x, Offset: 0x%x",
+            Bus, Device, Function, Offset);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS HardwareInterfaceDrvReadMmio(
+    PUINT8 Mmio,
+    UINT32 Offset,
+    UINT32 Length,
+    PUINT8 Buffer
+)
+/*++
+Routine Description:
+
+    Reads a range of a mapped 4 KB MMIO region unless the device is in D3.
+
+Arguments:
+
+    Mmio - mapped MMIO region.
+
+    Offset - offset of the range, checked by the caller.
+
+    Length - length of the range, checked by the caller.
+
+    Buffer - buffer that receives the data.
+
+Return Value:
+
+    STATUS_POWER_STATE_INVALID if the first DWORD of the region reads as
+    all F's, STATUS_SUCCESS otherwise.
+
+--*/
+{
+    if (READ_REGISTER_ULONG((PULONG)Mmio) == 0xFFFFFFFF) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "MMIO access requested in D3 state.\n");
+        return STATUS_POWER_STATE_INVALID;
+    }
+
+    HardwareInterfaceDrvCopyFromMmio(Buffer, Mmio + Offset, Length);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS HardwareInterfaceDrvRingStart(
+    PCONTROL_DEVICE_EXTENSION DeviceExtension,
+    WDFREQUEST Request,
+    const HwRingSetup* Setup,
+    PVOID Buffer,
+    SIZE_T Length
+)
+/*++
+Routine Description:
+
+    Lays out a ring in the locked output buffer of the setup request,
+    starts the ring thread and parks the request in the ring queue.
+
+Arguments:
+
+    DeviceExtension - control device extension.
+
+    Request - IOCTL_PLATFORM_RING_SETUP request.
+
+    Setup - validated copy of the request input.
+
+    Buffer - system address of the ring.
+
+    Length - length of the ring in bytes.
+
+Return Value:
+
+    STATUS_SUCCESS if the ring is served, the request then stays pending.
+    STATUS_DEVICE_BUSY if another ring is served.
+
+--*/
+{
+    NTSTATUS          status;
+    HANDLE            threadHandle;
+    OBJECT_ATTRIBUTES objectAttributes;
+
+    //
+    // A ring whose request was canceled leaves its exited thread behind.
+    //
+    if (DeviceExtension->RingThread != NULL) {
+        LARGE_INTEGER timeout;
+        timeout.QuadPart = 0;
+        if (KeWaitForSingleObject(DeviceExtension->RingThread, Executive, KernelMode, FALSE, &timeout) == STATUS_TIMEOUT) {
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "A ring is already registered\n");
+            return STATUS_DEVICE_BUSY;
+        }
+        ObDereferenceObject(DeviceExtension->RingThread);
+        DeviceExtension->RingThread = NULL;
+    }
+
+    if (HwRingInitialize(Buffer, Length, Setup->m_Entries, Setup->m_DataLength, &DeviceExtension->Ring) != HW_RING_STATUS_SUCCESS) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Ring buffer is not aligned to %d bytes\n", HW_RING_CACHE_LINE);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    DeviceExtension->RingIdleUs = Setup->m_IdleUs;
+    DeviceExtension->RingStop = FALSE;
+    DeviceExtension->RingCanceledRequest = NULL;
+    DeviceExtension->RingMmio = NULL;
+    KeClearEvent(&DeviceExtension->RingWakeup);
+
+    InitializeObjectAttributes(&objectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    status = PsCreateSystemThread(&threadHandle, THREAD_ALL_ACCESS, &objectAttributes, NULL, NULL,
+                                  HardwareInterfaceDrvRingThread, DeviceExtension);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "PsCreateSystemThread failed %!STATUS!\n", status);
+        return status;
+    }
+
+    status = ObReferenceObjectByHandle(threadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, &DeviceExtension->RingThread, NULL);
+    ZwClose(threadHandle);
+    if (!NT_SUCCESS(status)) {
+        //
+        // Without a reference the thread cannot be waited for, it is
+        // still told to stop.
+        //
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "ObReferenceObjectByHandle failed %!STATUS!\n", status);
+        DeviceExtension->RingThread = NULL;
+        InterlockedExchange(&DeviceExtension->RingStop, TRUE);
+        KeSetEvent(&DeviceExtension->RingWakeup, IO_NO_INCREMENT, FALSE);
+        return status;
+    }
+
+    status = WdfRequestForwardToIoQueue(Request, DeviceExtension->RingQueue);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestForwardToIoQueue failed %!STATUS!\n", status);
+        HardwareInterfaceDrvRingStop(DeviceExtension);
+        return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID HardwareInterfaceDrvRingStop(
+    PCONTROL_DEVICE_EXTENSION DeviceExtension
+)
+/*++
+Routine Description:
+
+    Stops the ring thread and waits until it has exited.
+
+Arguments:
+
+    DeviceExtension - control device extension.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    if (DeviceExtension->RingThread == NULL) {
+        return;
+    }
+
+    InterlockedExchange(&DeviceExtension->RingStop, TRUE);
+    KeSetEvent(&DeviceExtension->RingWakeup, IO_NO_INCREMENT, FALSE);
+    KeWaitForSingleObject(DeviceExtension->RingThread, Executive, KernelMode, FALSE, NULL);
+    ObDereferenceObject(DeviceExtension->RingThread);
+    DeviceExtension->RingThread = NULL;
+}
+
+VOID HardwareInterfaceDrvRingThread(
+    PVOID StartContext
+)
+/*++
+Routine Description:
+
+    Serves the ring until it is stopped. The thread drains the submission
+    queue, polls for RingIdleUs after the last descriptor and then sleeps
+    with HW_RING_FLAG_NEED_WAKEUP set until a doorbell arrives. It also
+    sleeps while the completion queue is full. On exit it completes the
+    canceled setup request, which unlocks the ring.
+
+Arguments:
+
+    StartContext - control device extension.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    PCONTROL_DEVICE_EXTENSION deviceExtension = (PCONTROL_DEVICE_EXTENSION)StartContext;
+    LARGE_INTEGER frequency, now, idleStart;
+    LONGLONG      idleTicks;
+    HwRingSqe     sqe;
+    HwRingCqe     cqe;
+    UINT32        executed;
+
+    KeQueryPerformanceCounter(&frequency);
+    idleTicks = frequency.QuadPart * deviceExtension->RingIdleUs / 1000000;
+    idleStart = KeQueryPerformanceCounter(NULL);
+
+    while (!deviceExtension->RingStop) {
+        executed = 0;
+        while (HwRingFetch(&deviceExtension->Ring, &sqe)) {
+            HardwareInterfaceDrvRingExecute(deviceExtension, &sqe, &cqe);
+            HwRingPost(&deviceExtension->Ring, &cqe);
+            executed++;
+        }
+
+        now = KeQueryPerformanceCounter(NULL);
+        if (executed != 0) {
+            idleStart = now;
+            continue;
+        }
+        if (now.QuadPart - idleStart.QuadPart < idleTicks) {
+            YieldProcessor();
+            continue;
+        }
+
+        //
+        // Announce the sleep before looking once more. A submission
+        // published before the flag was visible is found here, one
+        // published after it sees the flag and rings the doorbell.
+        //
+        HwRingSetNeedWakeup(&deviceExtension->Ring, TRUE);
+        if (!HwRingHasWork(&deviceExtension->Ring) && !deviceExtension->RingStop) {
+            KeWaitForSingleObject(&deviceExtension->RingWakeup, Executive, KernelMode, FALSE, NULL);
+        }
+        HwRingSetNeedWakeup(&deviceExtension->Ring, FALSE);
+        idleStart = KeQueryPerformanceCounter(NULL);
+    }
+
+    if (deviceExtension->RingMmio != NULL) {
+        MmUnmapIoSpace(deviceExtension->RingMmio, PCIe_CFG_SIZE);
+        deviceExtension->RingMmio = NULL;
+    }
+
+    WDFREQUEST request = (WDFREQUEST)InterlockedExchangePointer((PVOID*)&deviceExtension->RingCanceledRequest, NULL);
+    if (request != NULL) {
+        WdfRequestComplete(request, STATUS_CANCELLED);
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+VOID HardwareInterfaceDrvRingExecute(
+    PCONTROL_DEVICE_EXTENSION DeviceExtension,
+    const HwRingSqe* Sqe,
+    PHwRingCqe Cqe
+)
+/*++
+Routine Description:
+
+    Validates and executes one descriptor into the data area of the ring.
+    The MMIO region of the last MMIO read stays mapped for the next one.
+
+Arguments:
+
+    DeviceExtension - control device extension.
+
+    Sqe - driver copy of the descriptor.
+
+    Cqe - receives the completion.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    NTSTATUS status;
+    PUINT8   data;
+
+    Cqe->m_UserData = Sqe->m_UserData;
+    Cqe->m_Length = 0;
+    Cqe->m_Status = HwRingValidateSqe(&DeviceExtension->Ring, Sqe);
+    if (Cqe->m_Status != HW_RING_STATUS_SUCCESS) {
+        return;
+    }
+
+    data = DeviceExtension->Ring.m_Data + Sqe->m_DataOffset;
+
+    if (Sqe->m_OpCode == HW_RING_OP_CFG_READ) {
+        status = HardwareInterfaceDrvReadConfig(Sqe->m_Bus, Sqe->m_Device, Sqe->m_Function, Sqe->m_Offset, Sqe->m_Length, data);
+    }
+    else {
+        if (DeviceExtension->RingMmio != NULL && DeviceExtension->RingMmioBase.QuadPart != (LONGLONG)Sqe->m_Address) {
+            MmUnmapIoSpace(DeviceExtension->RingMmio, PCIe_CFG_SIZE);
+            DeviceExtension->RingMmio = NULL;
+        }
+        if (DeviceExtension->RingMmio == NULL) {
+            DeviceExtension->RingMmioBase.QuadPart = Sqe->m_Address;
+            DeviceExtension->RingMmio = (PUINT8)MmMapIoSpace(DeviceExtension->RingMmioBase, PCIe_CFG_SIZE, MmNonCached);
+        }
+        status = (DeviceExtension->RingMmio != NULL) ?
+            HardwareInterfaceDrvReadMmio(DeviceExtension->RingMmio, Sqe->m_Offset, Sqe->m_Length, data) : STATUS_NO_MEMORY;
+    }
+
+    if (NT_SUCCESS(status)) {
+        Cqe->m_Length = Sqe->m_Length;
+    }
+    else {
+        Cqe->m_Status = (status == STATUS_POWER_STATE_INVALID) ? HW_RING_STATUS_POWER_STATE : HW_RING_STATUS_ACCESS_FAILED;
+    }
+}
+
+VOID HardwareInterfaceDrvEvtRingCanceledOnQueue(
+    WDFQUEUE Queue,
+    WDFREQUEST Request
+)
+/*++
+Routine Description:
+
+    Called when the setup request is canceled, also when the handle is
+    closed. The ring thread may still write the ring, so the request is
+    handed to it and completed once it has stopped.
+
+Arguments:
+
+    Queue - ring queue.
+
+    Request - IOCTL_PLATFORM_RING_SETUP request.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    PCONTROL_DEVICE_EXTENSION deviceExtension = ControlGetData(WdfIoQueueGetDevice(Queue));
+
+    InterlockedExchangePointer((PVOID*)&deviceExtension->RingCanceledRequest, Request);
+    InterlockedExchange(&deviceExtension->RingStop, TRUE);
+    KeSetEvent(&deviceExtension->RingWakeup, IO_NO_INCREMENT, FALSE);
+}
+
+VOID HardwareInterfaceDrvEvtDeviceCleanup(
+    WDFOBJECT Device
+)
+/*++
+Routine Description:
+
+    Waits for the ring thread before the control device goes away.
+
+Arguments:
+
+    Device - control device.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    HardwareInterfaceDrvRingStop(ControlGetData(Device));
+}
+
+BOOLEAN HardwareInterfaceDrvScriptRead(
+    PVOID Context,
+    UINT8 Space,
+    UINT32 Offset,
+    UINT8 Width,
+    PUINT32 Value
+)
+/*++
+Routine Description:
+
+    Register script read accessor, reads Width bytes at Offset of the
+    configuration space or the MMIO region of the script target.
+
+Arguments:
+
+    Context - REG_SCRIPT_CONTEXT of the script.
+
+    Space - REG_SCRIPT_SPACE_PCI_CFG or REG_SCRIPT_SPACE_MMIO.
+
+    Offset - register offset, validated against the space size.
+
+    Width - access width in bytes, 1, 2 or 4.
+
+    Value - receives the register value.
+
+Return Value:
+
+    TRUE if the register was read.
+
+--*/
+{
+    PREG_SCRIPT_CONTEXT scriptContext = (PREG_SCRIPT_CONTEXT)Context;
+
+    *Value = 0;
+
+    if (Space == REG_SCRIPT_SPACE_PCI_CFG) {
+        ULONG bytesReturned = HalGetBusDataByOffset(PCIConfiguration,
+                                                    scriptContext->Bus,
+                                                    scriptContext->Slot.u.AsULONG,
+                                                    Value,
+                                                    Offset,
+                                                    Width);
+        return (bytesReturned == Width);
+    }
+
+    if (!HardwareInterfaceDrvScriptMapMmio(scriptContext)) {
+        return FALSE;
+    }
+
+    switch (Width)
+    {
+        case 1:
+            *Value = READ_REGISTER_UCHAR(scriptContext->Mmio + Offset);
+            break;
+        case 2:
+            *Value = READ_REGISTER_USHORT((PUSHORT)(scriptContext->Mmio + Offset));
+            break;
+        default:
+            *Value = READ_REGISTER_ULONG((PULONG)(scriptContext->Mmio + Offset));
+            break;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN HardwareInterfaceDrvScriptWrite(
+    PVOID Context,
+    UINT8 Space,
+    UINT32 Offset,
+    UINT8 Width,
+    UINT32 Value
+)
+/*++
+Routine Description:
+
+    Register script write accessor, writes Width bytes at Offset of the
+    configuration space or the MMIO region of the script target.
+
+Arguments:
+
+    Context - REG_SCRIPT_CONTEXT of the script.
+
+    Space - REG_SCRIPT_SPACE_PCI_CFG or REG_SCRIPT_SPACE_MMIO.
+
+    Offset - register offset, validated against the space size.
+
+    Width - access width in bytes, 1, 2 or 4.
+
+    Value - value to write.
+
+Return Value:
+
+    TRUE if the register was written.
+
+--*/
+{
+    PREG_SCRIPT_CONTEXT scriptContext = (PREG_SCRIPT_CONTEXT)Context;
+
+    if (Space == REG_SCRIPT_SPACE_PCI_CFG) {
+        ULONG bytesWritten = HalSetBusDataByOffset(PCIConfiguration,
+                                                   scriptContext->Bus,
+                                                   scriptContext->Slot.u.AsULONG,
+                                                   &Value,
+                                                   Offset,
+                                                   Width);
+        return (bytesWritten == Width);
+    }
+
+    if (!HardwareInterfaceDrvScriptMapMmio(scriptContext)) {
+        return FALSE;
+    }
+
+    switch (Width)
+    {
+        case 1:
+            WRITE_REGISTER_UCHAR(scriptContext->Mmio + Offset, (UCHAR)Value);
+            break;
+        case 2:
+            WRITE_REGISTER_USHORT((PUSHORT)(scriptContext->Mmio + Offset), (USHORT)Value);
+            break;
+        default:
+            WRITE_REGISTER_ULONG((PULONG)(scriptContext->Mmio + Offset), Value);
+            break;
+    }
+
+    return TRUE;
+}
+
+VOID HardwareInterfaceDrvScriptStall(
+    PVOID Context,
+    UINT32 Microseconds
+)
+/*++
+Routine Description:
+
+    Register script delay accessor. Short delays spin, longer ones give up
+    the processor since requests are dispatched at PASSIVE_LEVEL.
+
+Arguments:
+
+    Context - REG_SCRIPT_CONTEXT of the script.
+
+    Microseconds - time to wait.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    LARGE_INTEGER interval;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Microseconds <= 50) {
+        KeStallExecutionProcessor(Microseconds);
+        return;
+    }
+
+    interval.QuadPart = -((LONGLONG)Microseconds * 10);
+    KeDelayExecutionThread(KernelMode, FALSE, &interval);
+}
+
+BOOLEAN HardwareInterfaceDrvScriptMapMmio(
+    PREG_SCRIPT_CONTEXT ScriptContext
+)
+/*++
+Routine Description:
+
+    Maps the 4 KB MMIO region of the script target on first use.
+
+Arguments:
+
+    ScriptContext - REG_SCRIPT_CONTEXT of the script.
+
+Return Value:
+
+    TRUE if the region is mapped.
+
+--*/
+{
+    if (ScriptContext->Mmio == NULL) {
+        ScriptContext->Mmio = (PUINT8)MmMapIoSpace(ScriptContext->MmioBase, PCIe_CFG_SIZE, MmNonCached);
+        if (ScriptContext->Mmio == NULL) {
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Unable to map register script MMIO region\n");
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 void HardwareInterfaceDrvEvtDriverUnload(
     WDFDRIVER Driver
 )
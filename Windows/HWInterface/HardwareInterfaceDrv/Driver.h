@@ -18,6 +18,8 @@ Environment:
 #include <wdf.h>
 #include <initguid.h>
 #include "Public.h"
+#include "RegScript.h"
+#include "HwRing.h"
 #include "Trace.h"
 
 EXTERN_C_START
@@ -31,10 +33,37 @@ typedef struct _CONTROL_DEVICE_EXTENSION {
 
     HANDLE   FileHandle; // Store your control data here
 
+    //
+    // Ring registered by IOCTL_PLATFORM_RING_SETUP. The setup request waits
+    // in RingQueue while RingThread serves the ring, RingMmio caches the
+    // MMIO region of the last MMIO read.
+    //
+    WDFQUEUE         RingQueue;
+    PVOID            RingThread;
+    KEVENT           RingWakeup;
+    volatile LONG    RingStop;
+    WDFREQUEST       RingCanceledRequest;
+    HwRing           Ring;
+    UINT32           RingIdleUs;
+    PHYSICAL_ADDRESS RingMmioBase;
+    PUINT8           RingMmio;
+
 } CONTROL_DEVICE_EXTENSION, * PCONTROL_DEVICE_EXTENSION;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(CONTROL_DEVICE_EXTENSION, ControlGetData)
 
+//
+// Target of a register script, the MMIO region is mapped on first use.
+//
+typedef struct _REG_SCRIPT_CONTEXT {
+
+    ULONG            Bus;
+    PCI_SLOT_NUMBER  Slot;
+    PHYSICAL_ADDRESS MmioBase;
+    PUINT8           Mmio;
+
+} REG_SCRIPT_CONTEXT, * PREG_SCRIPT_CONTEXT;
+
 //
 // WDFDRIVER Events
 //
@@ -42,5 +71,30 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(CONTROL_DEVICE_EXTENSION, ControlGetData)
 DRIVER_INITIALIZE DriverEntry;
 EVT_WDF_DRIVER_UNLOAD HardwareInterfaceDrvEvtDriverUnload;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL HardwareInterfaceDrvEvtIoDeviceControl;
+EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE HardwareInterfaceDrvEvtRingCanceledOnQueue;
+EVT_WDF_OBJECT_CONTEXT_CLEANUP HardwareInterfaceDrvEvtDeviceCleanup;
+
+VOID HardwareInterfaceDrvCopyFromMmio(PUINT8 Destination, PUINT8 Mmio, SIZE_T Length);
+NTSTATUS HardwareInterfaceDrvReadConfig(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Length, PUINT8 Buffer);
+NTSTATUS HardwareInterfaceDrvReadMmio(PUINT8 Mmio, UINT32 Offset, UINT32 Length, PUINT8 Buffer);
+
+//
+// Register access ring
+//
+
+KSTART_ROUTINE HardwareInterfaceDrvRingThread;
+
+NTSTATUS HardwareInterfaceDrvRingStart(PCONTROL_DEVICE_EXTENSION DeviceExtension, WDFREQUEST Request, const HwRingSetup* Setup, PVOID Buffer, SIZE_T Length);
+VOID HardwareInterfaceDrvRingStop(PCONTROL_DEVICE_EXTENSION DeviceExtension);
+VOID HardwareInterfaceDrvRingExecute(PCONTROL_DEVICE_EXTENSION DeviceExtension, const HwRingSqe* Sqe, PHwRingCqe Cqe);
+
+//
+// Register script accessors
+//
+
+BOOLEAN HardwareInterfaceDrvScriptRead(PVOID Context, UINT8 Space, UINT32 Offset, UINT8 Width, PUINT32 Value);
+BOOLEAN HardwareInterfaceDrvScriptWrite(PVOID Context, UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value);
+VOID HardwareInterfaceDrvScriptStall(PVOID Context, UINT32 Microseconds);
+BOOLEAN HardwareInterfaceDrvScriptMapMmio(PREG_SCRIPT_CONTEXT ScriptContext);
 
 EXTERN_C_END
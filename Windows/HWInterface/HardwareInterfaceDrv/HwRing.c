@@ -0,0 +1,529 @@
+/*++
+
+Module Name:
+
+    HwRing.c
+
+Abstract:
+
+    This file contains the register access ring layout and queue routines.
+
+    The submission queue is produced by the application and consumed by the
+    driver, the completion queue the other way round. An index only ever
+    increases and wraps at 2^32, the entry of index i is i & (m_Entries - 1),
+    so a queue holds m_Entries entries when tail - head == m_Entries.
+
+    A ring thread that found no work sets HW_RING_FLAG_NEED_WAKEUP, issues a
+    full barrier and checks the submission queue once more before it
+    sleeps. The application issues a full barrier between publishing its
+    tail and reading the flag, so at least one side sees the other's write
+    and a submission is never left behind a sleeping thread.
+
+Environment:
+
+    user and kernel
+
+--*/
+
+#include "HwRing.h"
+
+#if defined(_MSC_VER)
+#define HW_RING_READ_ACQUIRE(Index)             ReadULongAcquire((ULONG const volatile*)&(Index)->m_Value)
+#define HW_RING_WRITE_RELEASE(Index, Value)     WriteULongRelease((ULONG volatile*)&(Index)->m_Value, (Value))
+#define HW_RING_FULL_BARRIER()                  MemoryBarrier()
+#else
+#define HW_RING_READ_ACQUIRE(Index)             __atomic_load_n(&(Index)->m_Value, __ATOMIC_ACQUIRE)
+#define HW_RING_WRITE_RELEASE(Index, Value)     __atomic_store_n(&(Index)->m_Value, (Value), __ATOMIC_RELEASE)
+#define HW_RING_FULL_BARRIER()                  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define HW_RING_ALIGN(Length) (((Length) + HW_RING_CACHE_LINE - 1) & ~((SIZE_T)HW_RING_CACHE_LINE - 1))
+
+static SIZE_T
+HwRingSqOffset(
+    VOID
+    )
+{
+    return HW_RING_ALIGN(sizeof(HwRingHeader));
+}
+
+static SIZE_T
+HwRingCqOffset(
+    UINT32 Entries
+    )
+{
+    return HwRingSqOffset() + HW_RING_ALIGN((SIZE_T)Entries * sizeof(HwRingSqe));
+}
+
+static SIZE_T
+HwRingDataOffset(
+    UINT32 Entries
+    )
+{
+    return HwRingCqOffset(Entries) + HW_RING_ALIGN((SIZE_T)Entries * sizeof(HwRingCqe));
+}
+
+static VOID
+HwRingSetView(
+    PVOID Memory,
+    UINT32 Entries,
+    UINT32 DataLength,
+    PHwRing Ring
+    )
+{
+    PUINT8 base = (PUINT8)Memory;
+
+    Ring->m_Header = (PHwRingHeader)base;
+    Ring->m_Sq = (PHwRingSqe)(base + HwRingSqOffset());
+    Ring->m_Cq = (PHwRingCqe)(base + HwRingCqOffset(Entries));
+    Ring->m_Data = base + HwRingDataOffset(Entries);
+    Ring->m_Entries = Entries;
+    Ring->m_DataLength = DataLength;
+    Ring->m_SqIndex = 0;
+    Ring->m_CqIndex = 0;
+    Ring->m_Flags = 0;
+}
+
+SIZE_T
+HwRingLayoutSize(
+    _In_ UINT32 Entries,
+    _In_ UINT32 DataLength
+    )
+/*++
+
+Routine Description:
+
+    Returns the size of the registered buffer of a ring.
+
+Arguments:
+
+    Entries - number of entries of each queue.
+
+    DataLength - length of the data area in bytes.
+
+Return Value:
+
+    Size in bytes, 0 if Entries is not a power of two up to
+    HW_RING_MAX_ENTRIES or DataLength exceeds HW_RING_MAX_DATA_LENGTH.
+
+--*/
+{
+    if (Entries == 0 || Entries > HW_RING_MAX_ENTRIES || (Entries & (Entries - 1)) != 0 ||
+        DataLength > HW_RING_MAX_DATA_LENGTH) {
+        return 0;
+    }
+
+    return HwRingDataOffset(Entries) + HW_RING_ALIGN(DataLength);
+}
+
+UINT32
+HwRingInitialize(
+    _Out_writes_bytes_(Length) PVOID Memory,
+    _In_ SIZE_T Length,
+    _In_ UINT32 Entries,
+    _In_ UINT32 DataLength,
+    _Out_ PHwRing Ring
+    )
+/*++
+
+Routine Description:
+
+    Lays out a ring in the registered buffer and fills the view of the
+    driver. The signature is written last, the application attaches once
+    it sees it.
+
+Arguments:
+
+    Memory - registered buffer, aligned to HW_RING_CACHE_LINE.
+
+    Length - length of the registered buffer in bytes.
+
+    Entries - number of entries of each queue.
+
+    DataLength - length of the data area in bytes.
+
+    Ring - receives the view of the driver.
+
+Return Value:
+
+    HW_RING_STATUS_SUCCESS if the ring is laid out,
+    HW_RING_STATUS_INVALID_LAYOUT otherwise.
+
+--*/
+{
+    SIZE_T layoutSize = HwRingLayoutSize(Entries, DataLength);
+    PHwRingHeader header = (PHwRingHeader)Memory;
+
+    if (layoutSize == 0 || Length < layoutSize || ((ULONG_PTR)Memory & (HW_RING_CACHE_LINE - 1)) != 0) {
+        return HW_RING_STATUS_INVALID_LAYOUT;
+    }
+
+    RtlZeroMemory(Memory, HwRingDataOffset(Entries));
+    header->m_Entries = Entries;
+    header->m_DataLength = DataLength;
+    header->m_SqOffset = (UINT32)HwRingSqOffset();
+    header->m_CqOffset = (UINT32)HwRingCqOffset(Entries);
+    header->m_DataOffset = (UINT32)HwRingDataOffset(Entries);
+    HwRingSetView(Memory, Entries, DataLength, Ring);
+
+    HW_RING_FULL_BARRIER();
+    header->m_Signature = HW_RING_SIGNATURE;
+
+    return HW_RING_STATUS_SUCCESS;
+}
+
+UINT32
+HwRingAttach(
+    _In_reads_bytes_(Length) PVOID Memory,
+    _In_ SIZE_T Length,
+    _Out_ PHwRing Ring
+    )
+/*++
+
+Routine Description:
+
+    Fills the view of the application from a ring laid out by the driver.
+
+Arguments:
+
+    Memory - registered buffer.
+
+    Length - length of the registered buffer in bytes.
+
+    Ring - receives the view of the application.
+
+Return Value:
+
+    HW_RING_STATUS_SUCCESS if the ring is attached,
+    HW_RING_STATUS_NOT_READY until the driver has written the signature,
+    HW_RING_STATUS_INVALID_LAYOUT if the header does not fit the buffer.
+
+--*/
+{
+    PHwRingHeader header = (PHwRingHeader)Memory;
+    SIZE_T layoutSize;
+
+    if (Length < sizeof(HwRingHeader)) {
+        return HW_RING_STATUS_INVALID_LAYOUT;
+    }
+
+    if (*(volatile UINT32*)&header->m_Signature != HW_RING_SIGNATURE) {
+        return HW_RING_STATUS_NOT_READY;
+    }
+    HW_RING_FULL_BARRIER();
+
+    layoutSize = HwRingLayoutSize(header->m_Entries, header->m_DataLength);
+    if (layoutSize == 0 || layoutSize > Length ||
+        header->m_DataOffset != HwRingDataOffset(header->m_Entries)) {
+        return HW_RING_STATUS_INVALID_LAYOUT;
+    }
+
+    HwRingSetView(Memory, header->m_Entries, header->m_DataLength, Ring);
+
+    return HW_RING_STATUS_SUCCESS;
+}
+
+UINT32
+HwRingValidateSqe(
+    _In_ const HwRing* Ring,
+    _In_ const HwRingSqe* Sqe
+    )
+/*++
+
+Routine Description:
+
+    Checks a descriptor against the address space of its op and the data
+    area of the ring. The driver calls it on its own copy of the entry, the
+    application may call it before submitting.
+
+Arguments:
+
+    Ring - view of the ring.
+
+    Sqe - descriptor to check.
+
+Return Value:
+
+    HW_RING_STATUS_SUCCESS if the descriptor can be executed,
+    HW_RING_STATUS_* error code otherwise.
+
+--*/
+{
+    UINT32 spaceSize;
+
+    switch (Sqe->m_OpCode)
+    {
+        case HW_RING_OP_CFG_READ:
+            spaceSize = PCI_CFG_SIZE;
+            break;
+        case HW_RING_OP_MMIO_READ:
+            spaceSize = PCIe_CFG_SIZE;
+            break;
+        default:
+            return HW_RING_STATUS_INVALID_OP;
+    }
+
+    if (Sqe->m_Length == 0 || Sqe->m_Offset >= spaceSize || Sqe->m_Length > spaceSize - Sqe->m_Offset) {
+        return HW_RING_STATUS_OUT_OF_RANGE;
+    }
+
+    if (Sqe->m_Length > Ring->m_DataLength || Sqe->m_DataOffset > Ring->m_DataLength - Sqe->m_Length) {
+        return HW_RING_STATUS_INVALID_BUFFER;
+    }
+
+    return HW_RING_STATUS_SUCCESS;
+}
+
+BOOLEAN
+HwRingSubmit(
+    _Inout_ PHwRing Ring,
+    _In_ const HwRingSqe* Sqe
+    )
+/*++
+
+Routine Description:
+
+    Posts a descriptor to the submission queue.
+
+Arguments:
+
+    Ring - view of the application.
+
+    Sqe - descriptor to post.
+
+Return Value:
+
+    TRUE if the descriptor was posted, FALSE if the queue is full.
+
+--*/
+{
+    UINT32 head = HW_RING_READ_ACQUIRE(&Ring->m_Header->m_SqHead);
+
+    if (Ring->m_SqIndex - head >= Ring->m_Entries) {
+        return FALSE;
+    }
+
+    Ring->m_Sq[Ring->m_SqIndex & (Ring->m_Entries - 1)] = *Sqe;
+    Ring->m_SqIndex++;
+    HW_RING_WRITE_RELEASE(&Ring->m_Header->m_SqTail, Ring->m_SqIndex);
+
+    return TRUE;
+}
+
+BOOLEAN
+HwRingNeedsWakeup(
+    _In_ const HwRing* Ring
+    )
+/*++
+
+Routine Description:
+
+    Checks whether the ring thread sleeps. Called after submitting.
+
+Arguments:
+
+    Ring - view of the application.
+
+Return Value:
+
+    TRUE if the submissions posted so far need IOCTL_PLATFORM_RING_DOORBELL.
+
+--*/
+{
+    HW_RING_FULL_BARRIER();
+
+    return (Ring->m_Header->m_Flags.m_Value & HW_RING_FLAG_NEED_WAKEUP) != 0;
+}
+
+BOOLEAN
+HwRingReap(
+    _Inout_ PHwRing Ring,
+    _Out_ PHwRingCqe Cqe
+    )
+/*++
+
+Routine Description:
+
+    Takes the next completion.
+
+Arguments:
+
+    Ring - view of the application.
+
+    Cqe - receives the completion.
+
+Return Value:
+
+    TRUE if a completion was taken, FALSE if there is none.
+
+--*/
+{
+    UINT32 tail = HW_RING_READ_ACQUIRE(&Ring->m_Header->m_CqTail);
+
+    if (tail == Ring->m_CqIndex) {
+        return FALSE;
+    }
+
+    *Cqe = Ring->m_Cq[Ring->m_CqIndex & (Ring->m_Entries - 1)];
+    Ring->m_CqIndex++;
+    HW_RING_WRITE_RELEASE(&Ring->m_Header->m_CqHead, Ring->m_CqIndex);
+
+    return TRUE;
+}
+
+//
+// Number of descriptors the driver can take now: submitted and with a
+// free completion slot. Returns FALSE in Valid if an index of the
+// application is out of range.
+//
+static UINT32
+HwRingAvailable(
+    const HwRing* Ring,
+    PBOOLEAN Valid
+    )
+{
+    UINT32 submitted = HW_RING_READ_ACQUIRE(&Ring->m_Header->m_SqTail) - Ring->m_SqIndex;
+    UINT32 completed = Ring->m_CqIndex - HW_RING_READ_ACQUIRE(&Ring->m_Header->m_CqHead);
+
+    *Valid = (submitted <= Ring->m_Entries && completed <= Ring->m_Entries);
+    if (!*Valid) {
+        return 0;
+    }
+
+    return (submitted < Ring->m_Entries - completed) ? submitted : Ring->m_Entries - completed;
+}
+
+BOOLEAN
+HwRingHasWork(
+    _In_ const HwRing* Ring
+    )
+/*++
+
+Routine Description:
+
+    Checks whether HwRingFetch would return a descriptor.
+
+Arguments:
+
+    Ring - view of the driver.
+
+Return Value:
+
+    TRUE if a descriptor is waiting and its completion has a slot.
+
+--*/
+{
+    BOOLEAN valid;
+
+    return HwRingAvailable(Ring, &valid) != 0;
+}
+
+BOOLEAN
+HwRingFetch(
+    _Inout_ PHwRing Ring,
+    _Out_ PHwRingSqe Sqe
+    )
+/*++
+
+Routine Description:
+
+    Copies the next descriptor out of the submission queue and frees its
+    slot. The caller validates and executes the copy, the application may
+    rewrite the slot as soon as the head moves. A descriptor is only taken
+    when its completion has a slot. If the application indices are out of
+    range HW_RING_FLAG_CORRUPT is set and the ring is not consumed again.
+
+Arguments:
+
+    Ring - view of the driver.
+
+    Sqe - receives the copy of the descriptor.
+
+Return Value:
+
+    TRUE if a descriptor was taken.
+
+--*/
+{
+    BOOLEAN valid;
+
+    if (Ring->m_Flags & HW_RING_FLAG_CORRUPT) {
+        return FALSE;
+    }
+
+    if (HwRingAvailable(Ring, &valid) == 0) {
+        if (!valid) {
+            Ring->m_Flags |= HW_RING_FLAG_CORRUPT;
+            HW_RING_WRITE_RELEASE(&Ring->m_Header->m_Flags, Ring->m_Flags);
+        }
+        return FALSE;
+    }
+
+    *Sqe = Ring->m_Sq[Ring->m_SqIndex & (Ring->m_Entries - 1)];
+    Ring->m_SqIndex++;
+    HW_RING_WRITE_RELEASE(&Ring->m_Header->m_SqHead, Ring->m_SqIndex);
+
+    return TRUE;
+}
+
+VOID
+HwRingPost(
+    _Inout_ PHwRing Ring,
+    _In_ const HwRingCqe* Cqe
+    )
+/*++
+
+Routine Description:
+
+    Posts a completion to the slot HwRingFetch reserved.
+
+Arguments:
+
+    Ring - view of the driver.
+
+    Cqe - completion to post.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    Ring->m_Cq[Ring->m_CqIndex & (Ring->m_Entries - 1)] = *Cqe;
+    Ring->m_CqIndex++;
+    HW_RING_WRITE_RELEASE(&Ring->m_Header->m_CqTail, Ring->m_CqIndex);
+}
+
+VOID
+HwRingSetNeedWakeup(
+    _Inout_ PHwRing Ring,
+    _In_ BOOLEAN NeedWakeup
+    )
+/*++
+
+Routine Description:
+
+    Sets or clears HW_RING_FLAG_NEED_WAKEUP. The full barrier orders the
+    flag before the submission tail the ring thread reads next.
+
+Arguments:
+
+    Ring - view of the driver.
+
+    NeedWakeup - TRUE before the ring thread sleeps, FALSE once it runs.
+
+Return Value:
+
+    VOID.
+
+--*/
+{
+    if (NeedWakeup) {
+        Ring->m_Flags |= HW_RING_FLAG_NEED_WAKEUP;
+    }
+    else {
+        Ring->m_Flags &= ~HW_RING_FLAG_NEED_WAKEUP;
+    }
+    HW_RING_WRITE_RELEASE(&Ring->m_Header->m_Flags, Ring->m_Flags);
+    HW_RING_FULL_BARRIER();
+}
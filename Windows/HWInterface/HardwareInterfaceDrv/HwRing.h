@@ -0,0 +1,228 @@
+/*++
+
+Module Name:
+
+    HwRing.h
+
+Abstract:
+
+    This module contains the layout of the register access rings and the
+    routines both sides use on them. An application registers one buffer
+    with IOCTL_PLATFORM_RING_SETUP that holds a header, a submission queue,
+    a completion queue and a data area. It posts read descriptors to the
+    submission queue without a system call, the driver's ring thread
+    executes them into the data area and posts one completion each.
+
+    Every index is written by one side only. The producer of a queue
+    publishes its tail with release semantics after filling the entry and
+    the consumer reads it with acquire semantics before reading the entry.
+    Each side keeps its own index in HwRing and never reads it back from
+    the shared header, so a corrupted header cannot make the driver read
+    outside the queues.
+
+Environment:
+
+    user and kernel
+
+--*/
+
+#pragma once
+
+#ifdef _KERNEL_MODE
+#include <ntddk.h>
+#else
+#include <Windows.h>
+#endif
+#include "Public.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HW_RING_SIGNATURE           0x474E4952  // 'RING'
+#define HW_RING_CACHE_LINE          64
+#define HW_RING_MAX_ENTRIES         4096
+#define HW_RING_MAX_DATA_LENGTH     0x1000000
+#define HW_RING_MAX_IDLE_US         100000
+
+//
+// Ring op codes.
+//
+#define HW_RING_OP_CFG_READ         0x01    // m_Length bytes of standard configuration space of m_Bus/m_Device/m_Function at m_Offset.
+#define HW_RING_OP_MMIO_READ        0x02    // m_Length bytes at m_Offset of the 4 KB MMIO region at m_Address.
+
+//
+// Header flags written by the driver.
+//
+#define HW_RING_FLAG_NEED_WAKEUP    0x01    // The ring thread sleeps, post IOCTL_PLATFORM_RING_DOORBELL after submitting.
+#define HW_RING_FLAG_CORRUPT        0x02    // The submission tail or completion head was out of range, the ring thread stopped consuming.
+
+//
+// Completion status, also returned by the layout routines.
+//
+#define HW_RING_STATUS_SUCCESS          0x00
+#define HW_RING_STATUS_INVALID_OP       0x01
+#define HW_RING_STATUS_OUT_OF_RANGE     0x02
+#define HW_RING_STATUS_INVALID_BUFFER   0x03
+#define HW_RING_STATUS_ACCESS_FAILED    0x04
+#define HW_RING_STATUS_POWER_STATE      0x05
+#define HW_RING_STATUS_INVALID_LAYOUT   0x06
+#define HW_RING_STATUS_NOT_READY        0x07
+
+//
+// Input of IOCTL_PLATFORM_RING_SETUP, the output buffer is the ring of
+// HwRingLayoutSize(m_Entries, m_DataLength) bytes. m_Entries is a power of
+// two, the ring thread polls for m_IdleUs microseconds before it sleeps.
+//
+typedef struct
+{
+    UINT32 m_Entries;
+    UINT32 m_DataLength;
+    UINT32 m_IdleUs;
+}HwRingSetup, *PHwRingSetup;
+
+typedef struct
+{
+    UINT8 m_OpCode;
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT32 m_Offset;
+    UINT64 m_Address;
+    UINT32 m_Length;
+    UINT32 m_DataOffset;
+    UINT64 m_UserData;
+}HwRingSqe, *PHwRingSqe;
+
+typedef struct
+{
+    UINT64 m_UserData;
+    UINT32 m_Status;
+    UINT32 m_Length;
+}HwRingCqe, *PHwRingCqe;
+
+//
+// One index per cache line so the two sides do not share lines they write.
+//
+typedef struct
+{
+    volatile UINT32 m_Value;
+    UINT8 m_Reserved[HW_RING_CACHE_LINE - sizeof(UINT32)];
+}HwRingIndex;
+
+//
+// Start of the registered buffer. The queues and the data area follow at
+// the offsets given, each aligned to HW_RING_CACHE_LINE.
+//
+typedef struct
+{
+    UINT32 m_Signature;
+    UINT32 m_Entries;
+    UINT32 m_DataLength;
+    UINT32 m_SqOffset;
+    UINT32 m_CqOffset;
+    UINT32 m_DataOffset;
+    UINT8 m_Reserved[HW_RING_CACHE_LINE - 6 * sizeof(UINT32)];
+    HwRingIndex m_Flags;
+    HwRingIndex m_SqHead;
+    HwRingIndex m_SqTail;
+    HwRingIndex m_CqHead;
+    HwRingIndex m_CqTail;
+}HwRingHeader, *PHwRingHeader;
+
+//
+// Private view of a ring. m_SqIndex and m_CqIndex are the indices this
+// side owns: the submission tail and completion head in the application,
+// the submission head and completion tail in the driver. m_Flags is the
+// driver's copy of the header flags.
+//
+typedef struct
+{
+    PHwRingHeader m_Header;
+    PHwRingSqe m_Sq;
+    PHwRingCqe m_Cq;
+    PUINT8 m_Data;
+    UINT32 m_Entries;
+    UINT32 m_DataLength;
+    UINT32 m_SqIndex;
+    UINT32 m_CqIndex;
+    UINT32 m_Flags;
+}HwRing, *PHwRing;
+
+SIZE_T
+HwRingLayoutSize(
+    _In_ UINT32 Entries,
+    _In_ UINT32 DataLength
+    );
+
+UINT32
+HwRingInitialize(
+    _Out_writes_bytes_(Length) PVOID Memory,
+    _In_ SIZE_T Length,
+    _In_ UINT32 Entries,
+    _In_ UINT32 DataLength,
+    _Out_ PHwRing Ring
+    );
+
+UINT32
+HwRingAttach(
+    _In_reads_bytes_(Length) PVOID Memory,
+    _In_ SIZE_T Length,
+    _Out_ PHwRing Ring
+    );
+
+UINT32
+HwRingValidateSqe(
+    _In_ const HwRing* Ring,
+    _In_ const HwRingSqe* Sqe
+    );
+
+//
+// Application side.
+//
+BOOLEAN
+HwRingSubmit(
+    _Inout_ PHwRing Ring,
+    _In_ const HwRingSqe* Sqe
+    );
+
+BOOLEAN
+HwRingNeedsWakeup(
+    _In_ const HwRing* Ring
+    );
+
+BOOLEAN
+HwRingReap(
+    _Inout_ PHwRing Ring,
+    _Out_ PHwRingCqe Cqe
+    );
+
+//
+// Driver side.
+//
+BOOLEAN
+HwRingHasWork(
+    _In_ const HwRing* Ring
+    );
+
+BOOLEAN
+HwRingFetch(
+    _Inout_ PHwRing Ring,
+    _Out_ PHwRingSqe Sqe
+    );
+
+VOID
+HwRingPost(
+    _Inout_ PHwRing Ring,
+    _In_ const HwRingCqe* Cqe
+    );
+
+VOID
+HwRingSetNeedWakeup(
+    _Inout_ PHwRing Ring,
+    _In_ BOOLEAN NeedWakeup
+    );
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,8 @@ Environment:
 
 --*/
 
+#pragma once
+
 //
 // Define an symbolic link so that apps can find the device and talk to it.
 //
@@ -23,6 +25,11 @@ Environment:
 #define PCI_CFG_SIZE  0x100
 #define PCIe_CFG_SIZE 0x1000
 
+//
+// Largest BAR window mapped by a single IOCTL_PLATFORM_PCIe_BAR_READ request.
+//
+#define PCIe_BAR_WINDOW_SIZE 0x100000
+
 #define IOCTL_PLATFORM_PCI_PCIe 0x8081
 
 #define IOCTL_PLATFORM_PCI_STD_CFG_READ\
@@ -31,6 +38,93 @@ Environment:
 #define IOCTL_PLATFORM_PCIe_MMIO_READ\
         CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x802, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+//
+// Executes a register script. IOCTL_PLATFORM_REG_SCRIPT_EXECUTE only takes
+// scripts without WRITE and RMW ops, scripts that write need
+// IOCTL_PLATFORM_REG_SCRIPT_WRITE and so a handle opened for writing, which
+// the device only grants to administrators.
+//
+#define IOCTL_PLATFORM_REG_SCRIPT_EXECUTE\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x803, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Reads up to PCIe_BAR_WINDOW_SIZE bytes of a BAR straight into the locked
+// output buffer, the input buffer holds a PCIeBarReadRequest.
+//
+#define IOCTL_PLATFORM_PCIe_BAR_READ\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x804, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+//
+// Direct I/O forms of IOCTL_PLATFORM_PCI_STD_CFG_READ and IOCTL_PLATFORM_PCIe_MMIO_READ.
+// The input buffer holds a PCIeCfgReadRequest or PCIeMMIOReadRequest and the
+// data goes to the locked output buffer, which must hold m_Length bytes.
+// Drivers without them fail the request with STATUS_INVALID_DEVICE_REQUEST.
+//
+#define IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x805, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+#define IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x806, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+//
+// Registers a ring (see HwRing.h). The input buffer holds a HwRingSetup,
+// the output buffer is the ring and stays locked while the request is
+// pending. The request completes with STATUS_CANCELLED when it is canceled
+// or the handle is closed, which stops the ring thread.
+//
+#define IOCTL_PLATFORM_RING_SETUP\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x807, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+//
+// Wakes the ring thread after it set HW_RING_FLAG_NEED_WAKEUP, takes no buffers.
+//
+#define IOCTL_PLATFORM_RING_DOORBELL\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x808, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_PLATFORM_REG_SCRIPT_WRITE\
+        CTL_CODE(IOCTL_PLATFORM_PCI_PCIe, 0x809, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Register script limits. A script is validated against these before it is
+// executed, so the worst case run time of a request is bounded.
+//
+#define REG_SCRIPT_MAX_OPS          256
+#define REG_SCRIPT_MAX_DELAY_US     100000
+#define REG_SCRIPT_MAX_POLL_US      1000000
+#define REG_SCRIPT_MAX_TOTAL_US     2000000
+#define REG_SCRIPT_POLL_INTERVAL_US 10
+
+//
+// Register script op codes.
+//
+#define REG_SCRIPT_OP_READ          0x01    // Read register, store value in result slot.
+#define REG_SCRIPT_OP_WRITE         0x02    // Write m_Value to register.
+#define REG_SCRIPT_OP_RMW           0x03    // Register = (Register & ~m_Mask) | (m_Value & m_Mask).
+#define REG_SCRIPT_OP_POLL          0x04    // Read until (Register & m_Mask) == m_Value or m_Param microseconds elapse.
+#define REG_SCRIPT_OP_DELAY         0x05    // Wait m_Param microseconds.
+#define REG_SCRIPT_OP_BRANCH_EQ     0x06    // Jump to op m_Param if (last value & m_Mask) == m_Value.
+#define REG_SCRIPT_OP_BRANCH_NE     0x07    // Jump to op m_Param if (last value & m_Mask) != m_Value.
+
+//
+// Register script address spaces.
+//
+#define REG_SCRIPT_SPACE_PCI_CFG    0x01    // Standard configuration space of m_Bus/m_Device/m_Function.
+#define REG_SCRIPT_SPACE_MMIO       0x02    // 4 KB MMIO region at m_MmioBase.
+
+//
+// Register script completion status.
+//
+#define REG_SCRIPT_STATUS_SUCCESS           0x00
+#define REG_SCRIPT_STATUS_INVALID_LENGTH    0x01
+#define REG_SCRIPT_STATUS_INVALID_OP        0x02
+#define REG_SCRIPT_STATUS_INVALID_SPACE     0x03
+#define REG_SCRIPT_STATUS_INVALID_WIDTH     0x04
+#define REG_SCRIPT_STATUS_OUT_OF_RANGE      0x05
+#define REG_SCRIPT_STATUS_INVALID_BRANCH    0x06
+#define REG_SCRIPT_STATUS_TIME_LIMIT        0x07
+#define REG_SCRIPT_STATUS_ACCESS_FAILED     0x08
+#define REG_SCRIPT_STATUS_POLL_TIMEOUT      0x09
+
 #pragma pack(push)
 #pragma pack(1)
 typedef struct
@@ -54,4 +148,66 @@ typedef struct
     UINT32 m_Offset;
     DataElement OutputData;
 }PCIeMMIOData, *PPCIeMMIOData;
+
+typedef struct
+{
+    UINT64 m_BaseAddressRegister;
+    UINT64 m_Offset;
+    UINT32 m_Length;
+}PCIeBarReadRequest, *PPCIeBarReadRequest;
+
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT8 m_Reserved;
+    UINT32 m_Offset;
+    UINT32 m_Length;
+}PCIeCfgReadRequest, *PPCIeCfgReadRequest;
+
+typedef struct
+{
+    UINT64 m_BaseAddressRegister;
+    UINT32 m_Offset;
+    UINT32 m_Length;
+}PCIeMMIOReadRequest, *PPCIeMMIOReadRequest;
+
+typedef struct
+{
+    UINT8 m_OpCode;
+    UINT8 m_Space;
+    UINT8 m_Width;
+    UINT8 m_Reserved;
+    UINT32 m_Offset;
+    UINT32 m_Value;
+    UINT32 m_Mask;
+    UINT32 m_Param;
+}RegScriptOp, *PRegScriptOp;
+
+//
+// Input of IOCTL_PLATFORM_REG_SCRIPT_EXECUTE and IOCTL_PLATFORM_REG_SCRIPT_WRITE, m_OpCount RegScriptOp entries follow the header.
+//
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT8 m_Reserved;
+    UINT64 m_MmioBase;
+    UINT32 m_OpCount;
+}RegScriptHeader, *PRegScriptHeader;
+
+//
+// Output of both script IOCTLs, m_ResultCount UINT32 values follow the header.
+// Every READ and POLL op owns one result slot in script order, slots of ops
+// that were skipped by a branch or not reached read as 0xFFFFFFFF.
+//
+typedef struct
+{
+    UINT32 m_Status;
+    UINT32 m_OpsExecuted;
+    UINT32 m_LastOp;
+    UINT32 m_ResultCount;
+}RegScriptResult, *PRegScriptResult;
 #pragma pack(pop)
@@ -0,0 +1,371 @@
+/*++
+
+Module Name:
+
+    RegScript.c
+
+Abstract:
+
+    This file contains the register script validator and interpreter.
+
+    A script is a list of fixed size ops (read, write, read-modify-write,
+    poll, delay and conditional forward branch) against either the standard
+    configuration space or a 4 KB MMIO region of one device. Branches may
+    only jump forward, so every script terminates and its run time is bounded
+    by the sum of its delay and poll timeouts.
+
+Environment:
+
+    user and kernel
+
+--*/
+
+#include "RegScript.h"
+
+static UINT32
+RegScriptSpaceSize(
+    UINT8 Space
+    )
+{
+    switch (Space)
+    {
+        case REG_SCRIPT_SPACE_PCI_CFG:
+            return PCI_CFG_SIZE;
+        case REG_SCRIPT_SPACE_MMIO:
+            return PCIe_CFG_SIZE;
+        default:
+            return 0;
+    }
+}
+
+static BOOLEAN
+RegScriptHasResult(
+    const RegScriptOp* Op
+    )
+{
+    return (Op->m_OpCode == REG_SCRIPT_OP_READ || Op->m_OpCode == REG_SCRIPT_OP_POLL);
+}
+
+static UINT32
+RegScriptValidateAccess(
+    const RegScriptOp* Op
+    )
+{
+    UINT32 spaceSize = RegScriptSpaceSize(Op->m_Space);
+
+    if (spaceSize == 0) {
+        return REG_SCRIPT_STATUS_INVALID_SPACE;
+    }
+
+    if (Op->m_Width != 1 && Op->m_Width != 2 && Op->m_Width != 4) {
+        return REG_SCRIPT_STATUS_INVALID_WIDTH;
+    }
+
+    if ((Op->m_Offset & (Op->m_Width - 1)) != 0 ||
+        Op->m_Offset >= spaceSize ||
+        Op->m_Offset + Op->m_Width > spaceSize) {
+        return REG_SCRIPT_STATUS_OUT_OF_RANGE;
+    }
+
+    return REG_SCRIPT_STATUS_SUCCESS;
+}
+
+UINT32
+RegScriptValidate(
+    _In_reads_bytes_(ScriptLength) const RegScriptHeader* Script,
+    _In_ SIZE_T ScriptLength,
+    _Out_ PUINT32 ResultCount
+    )
+/*++
+
+Routine Description:
+
+    Checks that a script is well formed before it is executed.
+
+Arguments:
+
+    Script - script header followed by its ops.
+
+    ScriptLength - length of the script buffer in bytes.
+
+    ResultCount - receives the number of result slots the script produces.
+
+Return Value:
+
+    REG_SCRIPT_STATUS_SUCCESS if the script can be executed,
+    REG_SCRIPT_STATUS_* error code otherwise.
+
+--*/
+{
+    const RegScriptOp* ops;
+    UINT32 totalMicroseconds = 0;
+    UINT32 status;
+
+    *ResultCount = 0;
+
+    if (ScriptLength < sizeof(RegScriptHeader) ||
+        Script->m_OpCount == 0 ||
+        Script->m_OpCount > REG_SCRIPT_MAX_OPS ||
+        ScriptLength < sizeof(RegScriptHeader) + (SIZE_T)Script->m_OpCount * sizeof(RegScriptOp)) {
+        return REG_SCRIPT_STATUS_INVALID_LENGTH;
+    }
+
+    ops = (const RegScriptOp*)(Script + 1);
+    for (UINT32 i = 0; i < Script->m_OpCount; i++)
+    {
+        const RegScriptOp* op = &ops[i];
+
+        switch (op->m_OpCode)
+        {
+            case REG_SCRIPT_OP_READ:
+            case REG_SCRIPT_OP_POLL:
+                status = RegScriptValidateAccess(op);
+                if (status != REG_SCRIPT_STATUS_SUCCESS) {
+                    return status;
+                }
+                if (op->m_OpCode == REG_SCRIPT_OP_POLL) {
+                    if (op->m_Param > REG_SCRIPT_MAX_POLL_US) {
+                        return REG_SCRIPT_STATUS_TIME_LIMIT;
+                    }
+                    totalMicroseconds += op->m_Param;
+                }
+                break;
+
+            case REG_SCRIPT_OP_WRITE:
+            case REG_SCRIPT_OP_RMW:
+                status = RegScriptValidateAccess(op);
+                if (status != REG_SCRIPT_STATUS_SUCCESS) {
+                    return status;
+                }
+                break;
+
+            case REG_SCRIPT_OP_DELAY:
+                if (op->m_Param > REG_SCRIPT_MAX_DELAY_US) {
+                    return REG_SCRIPT_STATUS_TIME_LIMIT;
+                }
+                totalMicroseconds += op->m_Param;
+                break;
+
+            case REG_SCRIPT_OP_BRANCH_EQ:
+            case REG_SCRIPT_OP_BRANCH_NE:
+                //
+                // Only forward branches are allowed, a target equal to
+                // m_OpCount ends the script.
+                //
+                if (op->m_Param <= i || op->m_Param > Script->m_OpCount) {
+                    return REG_SCRIPT_STATUS_INVALID_BRANCH;
+                }
+                break;
+
+            default:
+                return REG_SCRIPT_STATUS_INVALID_OP;
+        }
+
+        if (RegScriptHasResult(op)) {
+            (*ResultCount)++;
+        }
+
+        if (totalMicroseconds > REG_SCRIPT_MAX_TOTAL_US) {
+            return REG_SCRIPT_STATUS_TIME_LIMIT;
+        }
+    }
+
+    return REG_SCRIPT_STATUS_SUCCESS;
+}
+
+BOOLEAN
+RegScriptWrites(
+    _In_ const RegScriptHeader* Script
+    )
+/*++
+
+Routine Description:
+
+    Tells whether a validated script writes to a register and must be sent
+    with IOCTL_PLATFORM_REG_SCRIPT_WRITE.
+
+Arguments:
+
+    Script - script header followed by its ops, checked by RegScriptValidate.
+
+Return Value:
+
+    TRUE if the script has a WRITE or RMW op, FALSE otherwise.
+
+--*/
+{
+    const RegScriptOp* ops = (const RegScriptOp*)(Script + 1);
+
+    for (UINT32 i = 0; i < Script->m_OpCount; i++)
+    {
+        if (ops[i].m_OpCode == REG_SCRIPT_OP_WRITE || ops[i].m_OpCode == REG_SCRIPT_OP_RMW) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+UINT32
+RegScriptExecute(
+    _In_ const RegScriptHeader* Script,
+    _In_ const RegScriptAccessor* Accessor,
+    _Out_writes_bytes_(ResultLength) PRegScriptResult Result,
+    _In_ SIZE_T ResultLength
+    )
+/*++
+
+Routine Description:
+
+    Executes a script that was accepted by RegScriptValidate.
+
+Arguments:
+
+    Script - validated script header followed by its ops.
+
+    Accessor - register access callbacks.
+
+    Result - receives the completion status followed by the result slots.
+
+    ResultLength - length of the result buffer in bytes.
+
+Return Value:
+
+    REG_SCRIPT_STATUS_SUCCESS if all ops completed,
+    REG_SCRIPT_STATUS_* error code otherwise. Result->m_LastOp holds the
+    index of the op that failed.
+
+--*/
+{
+    const RegScriptOp* ops = (const RegScriptOp*)(Script + 1);
+    PUINT32 results = (PUINT32)(Result + 1);
+    UINT32 resultCount = 0;
+    UINT32 slot = 0;
+    UINT32 next = 0;
+    UINT32 lastValue = 0;
+    UINT32 status = REG_SCRIPT_STATUS_SUCCESS;
+    UINT32 i = 0;
+
+    //
+    // Result slots are assigned to READ and POLL ops in script order, so a
+    // caller can find the value of an op even when branches skip some ops.
+    //
+    for (i = 0; i < Script->m_OpCount; i++)
+    {
+        if (RegScriptHasResult(&ops[i])) {
+            resultCount++;
+        }
+    }
+
+    if (ResultLength < sizeof(RegScriptResult) + (SIZE_T)resultCount * sizeof(UINT32)) {
+        return REG_SCRIPT_STATUS_INVALID_LENGTH;
+    }
+
+    Result->m_OpsExecuted = 0;
+    Result->m_LastOp = 0;
+    Result->m_ResultCount = resultCount;
+    for (i = 0; i < resultCount; i++)
+    {
+        results[i] = 0xFFFFFFFF;
+    }
+
+    for (i = 0; i < Script->m_OpCount && status == REG_SCRIPT_STATUS_SUCCESS; i = next)
+    {
+        const RegScriptOp* op = &ops[i];
+        UINT32 value = 0;
+
+        next = i + 1;
+        Result->m_LastOp = i;
+
+        switch (op->m_OpCode)
+        {
+            case REG_SCRIPT_OP_READ:
+                if (!Accessor->m_Read(Accessor->m_Context, op->m_Space, op->m_Offset, op->m_Width, &value)) {
+                    status = REG_SCRIPT_STATUS_ACCESS_FAILED;
+                    break;
+                }
+                results[slot] = value;
+                lastValue = value;
+                break;
+
+            case REG_SCRIPT_OP_WRITE:
+                if (!Accessor->m_Write(Accessor->m_Context, op->m_Space, op->m_Offset, op->m_Width, op->m_Value)) {
+                    status = REG_SCRIPT_STATUS_ACCESS_FAILED;
+                }
+                break;
+
+            case REG_SCRIPT_OP_RMW:
+                if (!Accessor->m_Read(Accessor->m_Context, op->m_Space, op->m_Offset, op->m_Width, &value)) {
+                    status = REG_SCRIPT_STATUS_ACCESS_FAILED;
+                    break;
+                }
+                value = (value & ~op->m_Mask) | (op->m_Value & op->m_Mask);
+                if (!Accessor->m_Write(Accessor->m_Context, op->m_Space, op->m_Offset, op->m_Width, value)) {
+                    status = REG_SCRIPT_STATUS_ACCESS_FAILED;
+                    break;
+                }
+                lastValue = value;
+                break;
+
+            case REG_SCRIPT_OP_POLL:
+            {
+                UINT32 waited = 0;
+                for (;;)
+                {
+                    if (!Accessor->m_Read(Accessor->m_Context, op->m_Space, op->m_Offset, op->m_Width, &value)) {
+                        status = REG_SCRIPT_STATUS_ACCESS_FAILED;
+                        break;
+                    }
+                    if ((value & op->m_Mask) == op->m_Value) {
+                        break;
+                    }
+                    if (waited >= op->m_Param) {
+                        status = REG_SCRIPT_STATUS_POLL_TIMEOUT;
+                        break;
+                    }
+                    Accessor->m_Stall(Accessor->m_Context, REG_SCRIPT_POLL_INTERVAL_US);
+                    waited += REG_SCRIPT_POLL_INTERVAL_US;
+                }
+                results[slot] = value;
+                lastValue = value;
+                break;
+            }
+
+            case REG_SCRIPT_OP_DELAY:
+                Accessor->m_Stall(Accessor->m_Context, op->m_Param);
+                break;
+
+            case REG_SCRIPT_OP_BRANCH_EQ:
+                if ((lastValue & op->m_Mask) == op->m_Value) {
+                    next = op->m_Param;
+                }
+                break;
+
+            case REG_SCRIPT_OP_BRANCH_NE:
+                if ((lastValue & op->m_Mask) != op->m_Value) {
+                    next = op->m_Param;
+                }
+                break;
+
+            default:
+                status = REG_SCRIPT_STATUS_INVALID_OP;
+                break;
+        }
+
+        Result->m_OpsExecuted++;
+
+        //
+        // Result slots of skipped ops are left untouched, keep the slot index
+        // in step with the op index.
+        //
+        for (UINT32 j = i; j < next; j++)
+        {
+            if (RegScriptHasResult(&ops[j])) {
+                slot++;
+            }
+        }
+    }
+
+    Result->m_Status = status;
+    return status;
+}
@@ -0,0 +1,70 @@
+/*++
+
+Module Name:
+
+    RegScript.h
+
+Abstract:
+
+    This module contains the register script validator and interpreter
+    declarations. The same code is used by the driver to execute a script
+    and by user applications to check a script before sending it.
+
+Environment:
+
+    user and kernel
+
+--*/
+
+#pragma once
+
+#ifdef _KERNEL_MODE
+#include <ntddk.h>
+#else
+#include <Windows.h>
+#endif
+#include "Public.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Register accessors supplied by the caller of RegScriptExecute. Read and
+// Write return FALSE if the access could not be performed.
+//
+typedef BOOLEAN (*PFN_REG_SCRIPT_READ)(PVOID Context, UINT8 Space, UINT32 Offset, UINT8 Width, PUINT32 Value);
+typedef BOOLEAN (*PFN_REG_SCRIPT_WRITE)(PVOID Context, UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value);
+typedef VOID (*PFN_REG_SCRIPT_STALL)(PVOID Context, UINT32 Microseconds);
+
+typedef struct
+{
+    PVOID m_Context;
+    PFN_REG_SCRIPT_READ m_Read;
+    PFN_REG_SCRIPT_WRITE m_Write;
+    PFN_REG_SCRIPT_STALL m_Stall;
+}RegScriptAccessor, *PRegScriptAccessor;
+
+UINT32
+RegScriptValidate(
+    _In_reads_bytes_(ScriptLength) const RegScriptHeader* Script,
+    _In_ SIZE_T ScriptLength,
+    _Out_ PUINT32 ResultCount
+    );
+
+BOOLEAN
+RegScriptWrites(
+    _In_ const RegScriptHeader* Script
+    );
+
+UINT32
+RegScriptExecute(
+    _In_ const RegScriptHeader* Script,
+    _In_ const RegScriptAccessor* Accessor,
+    _Out_writes_bytes_(ResultLength) PRegScriptResult Result,
+    _In_ SIZE_T ResultLength
+    );
+
+#ifdef __cplusplus
+}
+#endif
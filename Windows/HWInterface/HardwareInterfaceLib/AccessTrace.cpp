@@ -0,0 +1,466 @@
+#include "AccessTrace.h"
+
+static UINT64 TicksToNs(UINT64 Ticks, UINT64 Frequency)
+{
+    return (UINT64)((double)Ticks * 1000000000.0 / Frequency);
+}
+
+CAccessTraceRecorder::CAccessTraceRecorder()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_StartTicks = 0;
+    m_Used = 0;
+    m_PendingUsed = 0;
+    m_StopWriter = false;
+    m_WriteFailed = false;
+}
+
+CAccessTraceRecorder::~CAccessTraceRecorder()
+{
+    Stop();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CAccessTraceRecorder::Start
+
+  Summary:  Creates the trace file, writes a header without records and
+            starts the writer thread. Timestamps count from here.
+
+  Args:     const char* FileName
+              Trace file to create.
+
+  Modifies: [m_File, m_Header, m_Writer].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CAccessTraceRecorder::Start(const char* FileName)
+{
+    UserStatus userStatus = Success;
+    DWORD BytesWritten = 0;
+    LARGE_INTEGER frequency;
+    m_StatusMessage.str("");
+
+    if (m_File != INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "A trace is already being recorded";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    m_File = CreateFileA(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create trace " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Header.m_Magic = ACCESS_TRACE_MAGIC;
+    m_Header.m_Version = ACCESS_TRACE_VERSION;
+    m_Header.m_Frequency = (UINT64)frequency.QuadPart;
+
+    if (!WriteFile(m_File, &m_Header, sizeof(m_Header), &BytesWritten, NULL)) {
+        m_StatusMessage << "Unable to write trace header to " << FileName;
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    m_Buffer.resize(ACCESS_TRACE_BUFFER_SIZE);
+    m_Pending.resize(ACCESS_TRACE_BUFFER_SIZE);
+    m_Used = 0;
+    m_PendingUsed = 0;
+    m_StopWriter = false;
+    m_WriteFailed = false;
+    m_StartTicks = Now();
+    m_Writer = std::thread(&CAccessTraceRecorder::WriterThread, this);
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CAccessTraceRecorder::Stop
+
+  Summary:  Hands the last buffer to the writer thread, waits for it and
+            rewrites the header with the record count and duration.
+
+  Args:     None
+
+  Modifies: [m_File, m_Writer].
+
+  Returns:  UserStatus
+              Returns Failure if a record could not be written.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CAccessTraceRecorder::Stop()
+{
+    UserStatus userStatus = Success;
+    DWORD BytesWritten = 0;
+    LARGE_INTEGER start;
+    m_StatusMessage.str("");
+
+    if (m_File == INVALID_HANDLE_VALUE) {
+        goto Exit;
+    }
+
+    m_Header.m_Duration = Now() - m_StartTicks;
+    if (m_Used != 0) {
+        Submit();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_StopWriter = true;
+    }
+    m_Ready.notify_one();
+    m_Writer.join();
+
+    start.QuadPart = 0;
+    if (m_WriteFailed) {
+        m_StatusMessage << "Unable to write trace records";
+        userStatus = Failure;
+    }
+    else if (!SetFilePointerEx(m_File, start, NULL, FILE_BEGIN) ||
+             !WriteFile(m_File, &m_Header, sizeof(m_Header), &BytesWritten, NULL)) {
+        m_StatusMessage << "Unable to update trace header";
+        userStatus = Failure;
+    }
+
+    CloseHandle(m_File);
+    m_File = INVALID_HANDLE_VALUE;
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CAccessTraceRecorder::Record
+
+  Summary:  Appends the record of a call to the buffer, Payload follows it.
+            Nothing is recorded while the recorder is stopped.
+
+  Args:     AccessTraceOperation Operation
+              Library call that was made.
+            UINT64 Address, UINT32 Offset, UINT32 Size
+              Target of the call as laid out in AccessTrace.h.
+            UserStatus Status
+              Status the call returned.
+            UINT64 Start
+              Now() at the start of the call.
+            const void* Payload, UINT16 PayloadSize
+              Data needed to replay the call, the register script.
+
+  Modifies: [m_Buffer].
+
+  Returns:  None
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CAccessTraceRecorder::Record(AccessTraceOperation Operation, UINT64 Address, UINT32 Offset, UINT32 Size, UserStatus Status, UINT64 Start,
+                                  const void* Payload, UINT16 PayloadSize)
+{
+    UINT64 end = Now();
+    AccessTraceRecord record;
+
+    if (m_File == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (m_Used + sizeof(record) + PayloadSize > m_Buffer.size()) {
+        Submit();
+    }
+
+    record.m_Timestamp = Start - m_StartTicks;
+    record.m_Address = Address;
+    record.m_Offset = Offset;
+    record.m_Size = Size;
+    record.m_Latency = (end - Start > 0xFFFFFFFF) ? 0xFFFFFFFF : (UINT32)(end - Start);
+    record.m_Operation = (UINT8)Operation;
+    record.m_Status = (UINT8)Status;
+    record.m_PayloadSize = PayloadSize;
+
+    memcpy(m_Buffer.data() + m_Used, &record, sizeof(record));
+    m_Used += sizeof(record);
+    if (PayloadSize != 0) {
+        memcpy(m_Buffer.data() + m_Used, Payload, PayloadSize);
+        m_Used += PayloadSize;
+    }
+    m_Header.m_RecordCount++;
+}
+
+//
+// Swaps the filled buffer with the one the writer thread has written,
+// waiting only if that write is still running.
+//
+void CAccessTraceRecorder::Submit()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Written.wait(lock, [this] { return m_PendingUsed == 0; });
+    m_Buffer.swap(m_Pending);
+    m_PendingUsed = m_Used;
+    m_Used = 0;
+    m_Ready.notify_one();
+}
+
+void CAccessTraceRecorder::WriterThread()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for (;;)
+    {
+        m_Ready.wait(lock, [this] { return m_PendingUsed != 0 || m_StopWriter; });
+        if (m_PendingUsed == 0) {
+            break;
+        }
+
+        size_t used = m_PendingUsed;
+        DWORD bytesWritten = 0;
+        lock.unlock();
+        bool written = WriteFile(m_File, m_Pending.data(), (DWORD)used, &bytesWritten, NULL) && bytesWritten == used;
+        lock.lock();
+
+        if (!written) {
+            m_WriteFailed = true;
+        }
+        m_PendingUsed = 0;
+        m_Written.notify_one();
+    }
+}
+
+UINT64 CAccessTraceRecorder::GetRecordCount()
+{
+    return m_Header.m_RecordCount;
+}
+
+std::string CAccessTraceRecorder::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CAccessTraceReplayer::CAccessTraceReplayer()
+{
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Data.resize(PCIe_CFG_SIZE);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CAccessTraceReplayer::Open
+
+  Summary:  Reads a whole trace file into memory and checks its header, so
+            a replay does not wait for the disk.
+
+  Args:     const char* FileName
+              Trace file to read.
+
+  Modifies: [m_Trace, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CAccessTraceReplayer::Open(const char* FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER FileSize;
+    UINT64 done = 0;
+    m_StatusMessage.str("");
+
+    m_Trace.clear();
+    memset(&m_Header, 0, sizeof(m_Header));
+
+    file = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &FileSize)) {
+        m_StatusMessage << "Unable to open trace " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if ((UINT64)FileSize.QuadPart < sizeof(m_Header)) {
+        m_StatusMessage << "Trace " << FileName << " is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Trace.resize((size_t)FileSize.QuadPart);
+    while (done < m_Trace.size())
+    {
+        DWORD chunk = (m_Trace.size() - done > ACCESS_TRACE_BUFFER_SIZE) ? ACCESS_TRACE_BUFFER_SIZE : (DWORD)(m_Trace.size() - done);
+        DWORD bytesRead = 0;
+        if (!ReadFile(file, m_Trace.data() + done, chunk, &bytesRead, NULL) || bytesRead == 0) {
+            m_StatusMessage << "Unable to read trace " << FileName;
+            userStatus = Failure;
+            goto Exit;
+        }
+        done += bytesRead;
+    }
+
+    memcpy(&m_Header, m_Trace.data(), sizeof(m_Header));
+    if (m_Header.m_Magic != ACCESS_TRACE_MAGIC || m_Header.m_Version != ACCESS_TRACE_VERSION || m_Header.m_Frequency == 0) {
+        m_StatusMessage << "Not an access trace, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    if (userStatus != Success) {
+        m_Trace.clear();
+    }
+    return userStatus;
+}
+
+const AccessTraceHeader& CAccessTraceReplayer::GetHeader()
+{
+    return m_Header;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CAccessTraceReplayer::Replay
+
+  Summary:  Issues every record of the trace through CHWLib in order. At
+            original speed each call waits until its recorded start time,
+            scaled to the counter of this host, has passed, short gaps are
+            spun so the pacing holds below the scheduler tick. A record
+            whose status differs from the recording counts as a mismatch.
+
+  Args:     CHardwareInterfaceLib& CHWLib
+              Initialised library to replay through.
+            bool OriginalSpeed
+              Keeps the recorded gaps between calls, otherwise calls are
+              issued back to back.
+            bool Scripts
+              Replays register scripts, which can write registers.
+            AccessTraceReplayStatistics& Statistics
+              Receives counts and latencies per operation.
+
+  Modifies: [Statistics].
+
+  Returns:  UserStatus
+              Returns error code, a status the replayed calls return is
+              only counted.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CAccessTraceReplayer::Replay(CHardwareInterfaceLib& CHWLib, bool OriginalSpeed, bool Scripts, AccessTraceReplayStatistics& Statistics)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER frequency;
+    size_t position = sizeof(AccessTraceHeader);
+    UINT64 replayStart;
+    m_StatusMessage.str("");
+
+    memset(&Statistics, 0, sizeof(Statistics));
+    if (m_Trace.empty()) {
+        m_StatusMessage << "No trace is open";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    Statistics.m_RecordedNs = TicksToNs(m_Header.m_Duration, m_Header.m_Frequency);
+    replayStart = CAccessTraceRecorder::Now();
+
+    for (UINT64 r = 0; r < m_Header.m_RecordCount; r++)
+    {
+        AccessTraceRecord record;
+        UserStatus replayStatus = Success;
+        UINT64 start, end;
+        const UINT8* payload;
+
+        if (m_Trace.size() - position < sizeof(record)) {
+            m_StatusMessage << "Trace ends at record 0x" << std::hex << r << " of 0x" << m_Header.m_RecordCount;
+            userStatus = IndexOutOfRange;
+            goto Exit;
+        }
+        memcpy(&record, m_Trace.data() + position, sizeof(record));
+        position += sizeof(record);
+        payload = m_Trace.data() + position;
+
+        if (m_Trace.size() - position < record.m_PayloadSize || record.m_Operation == 0 || record.m_Operation >= AccessTraceOperationCount ||
+            record.m_Size > PCIe_BAR_WINDOW_SIZE) {
+            m_StatusMessage << "Record 0x" << std::hex << r << " is corrupt";
+            userStatus = Failure;
+            goto Exit;
+        }
+        position += record.m_PayloadSize;
+
+        if (record.m_Operation == AccessTraceRegScript && (!Scripts || record.m_PayloadSize == 0)) {
+            Statistics.m_Skipped++;
+            continue;
+        }
+
+        if (OriginalSpeed) {
+            UINT64 due = replayStart + (UINT64)((double)record.m_Timestamp * frequency.QuadPart / m_Header.m_Frequency);
+            for (UINT64 now = CAccessTraceRecorder::Now(); now < due; now = CAccessTraceRecorder::Now())
+            {
+                if ((due - now) * 1000 > ACCESS_TRACE_SPIN_MS * (UINT64)frequency.QuadPart) {
+                    Sleep(1);
+                }
+            }
+        }
+
+        if (m_Data.size() < record.m_Size) {
+            m_Data.resize(record.m_Size);
+        }
+
+        start = CAccessTraceRecorder::Now();
+        switch (record.m_Operation)
+        {
+        case AccessTraceStdCfgRead:
+        case AccessTraceExCfgRead:
+        {
+            PCI_PCIeCfgData cfgData;
+            cfgData.m_Bus = ACCESS_TRACE_BUS(record.m_Address);
+            cfgData.m_Device = ACCESS_TRACE_DEVICE(record.m_Address);
+            cfgData.m_Function = ACCESS_TRACE_FUNCTION(record.m_Address);
+            cfgData.m_Offset = record.m_Offset;
+            cfgData.OutputData.m_Size = record.m_Size;
+            cfgData.OutputData.DataPointer = m_Data.data();
+            replayStatus = (record.m_Operation == AccessTraceStdCfgRead) ? CHWLib.PCIStdCfgRead(&cfgData) : CHWLib.PCIeExCfgRead(&cfgData);
+            break;
+        }
+        case AccessTraceMMIORead:
+        {
+            PCIeMMIOData mmioData;
+            mmioData.m_BaseAddressRegister = record.m_Address;
+            mmioData.m_Offset = record.m_Offset;
+            mmioData.OutputData.m_Size = record.m_Size;
+            mmioData.OutputData.DataPointer = m_Data.data();
+            replayStatus = CHWLib.PCIeMMIORead(&mmioData);
+            break;
+        }
+        case AccessTraceBarRead:
+            replayStatus = CHWLib.PCIeBarRead(record.m_Address, record.m_Offset, m_Data.data(), record.m_Size);
+            break;
+        default:
+            m_Script.assign(payload, payload + record.m_PayloadSize);
+            replayStatus = CHWLib.RegScriptExecute((PRegScriptHeader)m_Script.data(), record.m_PayloadSize, (PRegScriptResult)m_Data.data(), record.m_Size);
+            break;
+        }
+        end = CAccessTraceRecorder::Now();
+
+        AccessTraceOperationStatistics& operation = Statistics.m_Operations[record.m_Operation];
+        UINT64 latencyNs = TicksToNs(end - start, (UINT64)frequency.QuadPart);
+        operation.m_Count++;
+        operation.m_Bytes += record.m_Size;
+        operation.m_RecordedNs += TicksToNs(record.m_Latency, m_Header.m_Frequency);
+        operation.m_ReplayedNs += latencyNs;
+        if (latencyNs > operation.m_MaxReplayedNs) {
+            operation.m_MaxReplayedNs = latencyNs;
+        }
+        if (replayStatus != (UserStatus)record.m_Status) {
+            Statistics.m_Mismatches++;
+        }
+        Statistics.m_Replayed++;
+    }
+
+    Statistics.m_ElapsedNs = TicksToNs(CAccessTraceRecorder::Now() - replayStart, (UINT64)frequency.QuadPart);
+
+Exit:
+    return userStatus;
+}
+
+std::string CAccessTraceReplayer::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
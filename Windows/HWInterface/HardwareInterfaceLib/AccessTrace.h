@@ -0,0 +1,208 @@
+#pragma once
+/*+===================================================================
+  File:      AccessTrace.h
+
+  Summary:   Records the register accesses of CHardwareInterfaceLib into
+             a binary trace and replays a trace against any driver or
+             simulated fabric the library runs on.
+
+  Classes:   CAccessTraceRecorder, CAccessTraceReplayer.
+
+  Functions: Start, Stop, Now, Record, GetRecordCount, Open, GetHeader,
+             Replay.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+#define ACCESS_TRACE_MAGIC          0x52545748      // 'HWTR'
+#define ACCESS_TRACE_VERSION        1
+#define ACCESS_TRACE_BUFFER_SIZE    0x100000
+#define ACCESS_TRACE_MAX_PAYLOAD    (sizeof(RegScriptHeader) + REG_SCRIPT_MAX_OPS * sizeof(RegScriptOp))
+#define ACCESS_TRACE_SPIN_MS        2
+
+#define ACCESS_TRACE_BDF(b, d, f)   (UINT64)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+#define ACCESS_TRACE_BUS(a)         (UINT8)((a) >> 8)
+#define ACCESS_TRACE_DEVICE(a)      (UINT8)(((a) >> 3) & 0x1F)
+#define ACCESS_TRACE_FUNCTION(a)    (UINT8)((a) & 0x07)
+
+typedef enum
+{
+    AccessTraceStdCfgRead = 1,
+    AccessTraceExCfgRead,
+    AccessTraceMMIORead,
+    AccessTraceBarRead,
+    AccessTraceRegScript,
+    AccessTraceOperationCount
+}AccessTraceOperation;
+
+//
+// A trace is an AccessTraceHeader followed by m_RecordCount records in call
+// order, each an AccessTraceRecord followed by m_PayloadSize bytes. Times
+// are performance counter ticks of the recording host at m_Frequency,
+// m_Timestamp counts from the start of the trace to the start of the call.
+//
+//   StdCfgRead, ExCfgRead  m_Address is an ACCESS_TRACE_BDF.
+//   MMIORead               m_Address is the BAR address.
+//   BarRead                One driver window, m_Address is the BAR address
+//                          plus the window offset, m_Offset is 0.
+//   RegScript              m_Address is the ACCESS_TRACE_BDF of the script,
+//                          m_Size the result length, the payload is the
+//                          script unless it is longer than
+//                          ACCESS_TRACE_MAX_PAYLOAD.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT64 m_Frequency;
+    UINT64 m_RecordCount;
+    UINT64 m_Duration;
+}AccessTraceHeader;
+
+typedef struct
+{
+    UINT64 m_Timestamp;
+    UINT64 m_Address;
+    UINT32 m_Offset;
+    UINT32 m_Size;
+    UINT32 m_Latency;
+    UINT8 m_Operation;
+    UINT8 m_Status;
+    UINT16 m_PayloadSize;
+}AccessTraceRecord;
+#pragma pack(pop)
+
+typedef struct
+{
+    UINT64 m_Count;
+    UINT64 m_Bytes;
+    UINT64 m_RecordedNs;
+    UINT64 m_ReplayedNs;
+    UINT64 m_MaxReplayedNs;
+}AccessTraceOperationStatistics;
+
+typedef struct
+{
+    UINT64 m_Replayed;
+    UINT64 m_Skipped;
+    UINT64 m_Mismatches;
+    UINT64 m_RecordedNs;
+    UINT64 m_ElapsedNs;
+    AccessTraceOperationStatistics m_Operations[AccessTraceOperationCount];
+}AccessTraceReplayStatistics;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CAccessTraceRecorder
+
+  Summary:  Writes the accesses CHardwareInterfaceLib reports through
+            Record to a trace file. Records are appended to a 1 MB buffer,
+            a full buffer is swapped with the one a writer thread has
+            finished writing, so the caller only pays for two counter
+            reads and a copy unless the disk falls behind. Like the
+            library it is used by one thread. Ring accesses are performed
+            by the ring thread of the driver and are not recorded.
+
+  Methods:  CAccessTraceRecorder()
+              Constructor.
+            ~CAccessTraceRecorder()
+              Stops the recorder.
+            UserStatus Start(const char* FileName)
+              Creates the trace file and starts the writer thread.
+            UserStatus Stop()
+              Writes the buffered records and the final header and closes the file.
+            static UINT64 Now()
+              Returns the performance counter, the start time of a call.
+            void Record(AccessTraceOperation Operation, UINT64 Address, UINT32 Offset, UINT32 Size, UserStatus Status, UINT64 Start, const void* Payload, UINT16 PayloadSize)
+              Appends the record of a call that started at Start.
+            UINT64 GetRecordCount()
+              Returns the records written since Start.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CAccessTraceRecorder
+{
+public:
+    CAccessTraceRecorder();
+    ~CAccessTraceRecorder();
+    UserStatus Start(const char* FileName);
+    UserStatus Stop();
+
+    static UINT64 Now()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return (UINT64)counter.QuadPart;
+    }
+
+    void Record(AccessTraceOperation Operation, UINT64 Address, UINT32 Offset, UINT32 Size, UserStatus Status, UINT64 Start,
+                const void* Payload = NULL, UINT16 PayloadSize = 0);
+    UINT64 GetRecordCount();
+    std::string GetStatusMessage();
+
+private:
+    void Submit();
+    void WriterThread();
+
+    HANDLE m_File;
+    AccessTraceHeader m_Header;
+    UINT64 m_StartTicks;
+    std::vector<UINT8> m_Buffer;
+    size_t m_Used;
+    std::vector<UINT8> m_Pending;
+    size_t m_PendingUsed;
+    std::thread m_Writer;
+    std::mutex m_Lock;
+    std::condition_variable m_Ready;
+    std::condition_variable m_Written;
+    bool m_StopWriter;
+    bool m_WriteFailed;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CAccessTraceReplayer
+
+  Summary:  Re-issues the accesses of a trace through a
+            CHardwareInterfaceLib, back to back or at the times they were
+            recorded, and compares status and latency with the recording.
+            Register scripts can write and are only replayed on request.
+
+  Methods:  CAccessTraceReplayer()
+              Constructor.
+            UserStatus Open(const char* FileName)
+              Reads a trace file and checks its header.
+            const AccessTraceHeader& GetHeader()
+              Returns the trace header.
+            UserStatus Replay(CHardwareInterfaceLib& CHWLib, bool OriginalSpeed, bool Scripts, AccessTraceReplayStatistics& Statistics)
+              Replays the trace through CHWLib.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CAccessTraceReplayer
+{
+public:
+    CAccessTraceReplayer();
+    UserStatus Open(const char* FileName);
+    const AccessTraceHeader& GetHeader();
+    UserStatus Replay(CHardwareInterfaceLib& CHWLib, bool OriginalSpeed, bool Scripts, AccessTraceReplayStatistics& Statistics);
+    std::string GetStatusMessage();
+
+private:
+    std::vector<UINT8> m_Trace;
+    std::vector<UINT8> m_Data;
+    std::vector<UINT8> m_Script;
+    AccessTraceHeader m_Header;
+    std::stringstream m_StatusMessage;
+};
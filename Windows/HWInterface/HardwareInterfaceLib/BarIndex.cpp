@@ -0,0 +1,318 @@
+#include <algorithm>
+#include "BarIndex.h"
+#include "RegScriptBuilder.h"
+
+#define BAR_COUNT_TYPE0                 6
+#define BAR_COUNT_TYPE1                 2
+#define BAR_IO_SPACE                    0x01
+#define BAR_TYPE_64BIT                  0x04
+#define BAR_TYPE_MASK                   0x06
+#define BAR_PREFETCHABLE                0x08
+#define BAR_MEMORY_ADDRESS_MASK         (~(UINT64)0x0F)
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CBarIndex::Add
+
+  Summary:  Inserts a window at its sorted position.
+
+  Args:     UINT64 Base, UINT64 Size
+              Window in physical address space.
+            UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar
+              Owner of the window, Bar is the index of its first BAR
+              register.
+            UINT8 Flags
+              BAR_INDEX_64BIT, BAR_INDEX_PREFETCHABLE.
+
+  Modifies: [columns].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the window is empty, wraps or
+              overlaps a window already added.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CBarIndex::Add(UINT64 Base, UINT64 Size, UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar, UINT8 Flags)
+{
+    UINT64 last = Base + Size - 1;
+    size_t position = 0;
+    m_StatusMessage.str("");
+
+    if (Size == 0 || last < Base) {
+        m_StatusMessage << "BAR window at 0x" << std::hex << Base << " of size 0x" << Size << " is invalid";
+        return IndexOutOfRange;
+    }
+
+    position = std::upper_bound(m_Base.begin(), m_Base.end(), Base) - m_Base.begin();
+    if ((position > 0 && m_Last[position - 1] >= Base) || (position < m_Base.size() && m_Base[position] <= last)) {
+        size_t other = (position > 0 && m_Last[position - 1] >= Base) ? position - 1 : position;
+        m_StatusMessage << "BAR window at 0x" << std::hex << Base << " of size 0x" << Size << " overlaps BAR " << std::dec << +m_Bar[other]
+            << " of Bus: 0x" << std::hex << (m_Bdf[other] >> 8) << ", Device: 0x" << ((m_Bdf[other] >> 3) & 0x1F) << ", Function: 0x" << (m_Bdf[other] & 0x07);
+        return IndexOutOfRange;
+    }
+
+    m_Base.insert(m_Base.begin() + position, Base);
+    m_Last.insert(m_Last.begin() + position, last);
+    m_Bdf.insert(m_Bdf.begin() + position, (UINT16)(((UINT32)Bus << 8) | ((Device & 0x1F) << 3) | (Function & 0x07)));
+    m_Bar.insert(m_Bar.begin() + position, Bar);
+    m_Flags.insert(m_Flags.begin() + position, Flags);
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CBarIndex::AddResource
+
+  Summary:  Adds a memory window the OS assigned to a function. Reads the
+            BARs without writing them and adds the window under the BAR
+            that decodes Base, with its type and prefetchable bit.
+            Resources no BAR decodes, bridge windows and expansion ROMs,
+            are skipped.
+
+  Args:     CHardwareInterfaceLib& CHWLib
+              Initialised library.
+            UINT8 Bus, UINT8 Device, UINT8 Function
+              Owner of the resource.
+            UINT64 Base, UINT64 Size
+              Assigned window.
+
+  Modifies: [columns].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CBarIndex::AddResource(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 Base, UINT64 Size)
+{
+    UserStatus userStatus = Success;
+    CRegScriptBuilder probe(Bus, Device, Function);
+    UINT32 barSlots[BAR_COUNT_TYPE0] = { 0 };
+    UINT32 headerSlot;
+    UINT32 barCount = 0;
+    m_StatusMessage.str("");
+
+    headerSlot = probe.Read(REG_SCRIPT_SPACE_PCI_CFG, PciHeaderType::Offset, PciHeaderType::Width);
+    for (UINT32 bar = 0; bar < BAR_COUNT_TYPE0; bar++)
+    {
+        barSlots[bar] = probe.Read(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32));
+    }
+
+    userStatus = probe.Execute(CHWLib);
+    if (userStatus != Success) {
+        m_StatusMessage << CHWLib.GetStatusMessage();
+        return userStatus;
+    }
+
+    switch (PciHeaderLayout::Get((PciHeaderType::ValueType)probe.GetResult(headerSlot)))
+    {
+    case 0:
+        barCount = BAR_COUNT_TYPE0;
+        break;
+    case 1:
+        barCount = BAR_COUNT_TYPE1;
+        break;
+    default:
+        return Success;
+    }
+
+    for (UINT32 bar = 0; bar < barCount; bar++)
+    {
+        UINT32 value = probe.GetResult(barSlots[bar]);
+        UINT64 base = value & BAR_MEMORY_ADDRESS_MASK;
+        UINT8 flags = (value & BAR_PREFETCHABLE) ? BAR_INDEX_PREFETCHABLE : 0;
+        UINT32 first = bar;
+
+        if (value & BAR_IO_SPACE) {
+            continue;
+        }
+
+        if ((value & BAR_TYPE_MASK) == BAR_TYPE_64BIT) {
+            if (++bar >= barCount) {
+                break;
+            }
+            base |= (UINT64)probe.GetResult(barSlots[bar]) << 32;
+            flags |= BAR_INDEX_64BIT;
+        }
+
+        if (base == Base) {
+            return Add(Base, Size, Bus, Device, Function, (UINT8)first, flags);
+        }
+    }
+
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CBarIndex::SizeBars
+
+  Summary:  Sizes the memory BARs of a type 0 function with the standard
+            protocol. A first script reads the header type, the command
+            register and the BARs. A second script turns memory and I/O
+            decode off, writes all ones to every BAR and reads it back,
+            restores the BARs and then the command register, so the
+            function stops decoding only for the span of one request. The
+            driver stops a script at the first access that fails, so when
+            the second script fails the BARs and the command register are
+            restored by a third. Bridges are refused, with decode off they
+            stop forwarding to everything below them. The function must be
+            quiesced, a driver touching it while decode is off gets all
+            ones. Unimplemented and unassigned BARs are skipped.
+
+  Args:     CHardwareInterfaceLib& CHWLib
+              Initialised library.
+            UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to size.
+
+  Modifies: [columns].
+
+  Returns:  UserStatus
+              Returns Failure for a function that is not type 0, error
+              code otherwise, BARs added before a failure are kept.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CBarIndex::SizeBars(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    UserStatus userStatus = Success;
+    CRegScriptBuilder probe(Bus, Device, Function);
+    CRegScriptBuilder sizing(Bus, Device, Function);
+    UINT32 original[BAR_COUNT_TYPE0] = { 0 };
+    UINT32 mask[BAR_COUNT_TYPE0] = { 0 };
+    UINT32 originalSlots[BAR_COUNT_TYPE0] = { 0 };
+    UINT32 maskSlots[BAR_COUNT_TYPE0] = { 0 };
+    UINT32 headerSlot, commandSlot;
+    UINT32 barCount = 0;
+    UINT32 command = 0;
+    m_StatusMessage.str("");
+
+    headerSlot = probe.Read(REG_SCRIPT_SPACE_PCI_CFG, PciHeaderType::Offset, PciHeaderType::Width);
+    commandSlot = probe.Read(REG_SCRIPT_SPACE_PCI_CFG, PciCommand::Offset, PciCommand::Width);
+    for (UINT32 bar = 0; bar < BAR_COUNT_TYPE0; bar++)
+    {
+        originalSlots[bar] = probe.Read(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32));
+    }
+
+    userStatus = probe.Execute(CHWLib);
+    if (userStatus != Success) {
+        m_StatusMessage << CHWLib.GetStatusMessage();
+        return userStatus;
+    }
+
+    if (PciHeaderLayout::Get((PciHeaderType::ValueType)probe.GetResult(headerSlot)) != 0) {
+        m_StatusMessage << "Bus: 0x" << std::hex << +Bus << ", Device: 0x" << +Device << ", Function: 0x" << +Function
+            << " is not a type 0 function, its BARs are not sized";
+        return Failure;
+    }
+    barCount = BAR_COUNT_TYPE0;
+
+    command = probe.GetResult(commandSlot);
+    for (UINT32 bar = 0; bar < barCount; bar++)
+    {
+        original[bar] = probe.GetResult(originalSlots[bar]);
+    }
+
+    sizing.ReadModifyWrite(REG_SCRIPT_SPACE_PCI_CFG, PciCommand::Offset, PciCommand::Width,
+                           PciCommandIoSpace::Mask | PciCommandMemorySpace::Mask, 0);
+    for (UINT32 bar = 0; bar < barCount; bar++)
+    {
+        sizing.Write(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32), 0xFFFFFFFF);
+        maskSlots[bar] = sizing.Read(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32));
+        sizing.Write(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32), original[bar]);
+    }
+    sizing.Write(REG_SCRIPT_SPACE_PCI_CFG, PciCommand::Offset, PciCommand::Width, command);
+
+    userStatus = sizing.Execute(CHWLib);
+    if (userStatus != Success) {
+        CRegScriptBuilder restore(Bus, Device, Function);
+
+        m_StatusMessage << CHWLib.GetStatusMessage();
+        for (UINT32 bar = 0; bar < barCount; bar++)
+        {
+            restore.Write(REG_SCRIPT_SPACE_PCI_CFG, PciBar0::Offset + bar * sizeof(UINT32), sizeof(UINT32), original[bar]);
+        }
+        restore.Write(REG_SCRIPT_SPACE_PCI_CFG, PciCommand::Offset, PciCommand::Width, command);
+        if (restore.Execute(CHWLib) != Success) {
+            m_StatusMessage << ", restoring the BARs and the command register failed: " << CHWLib.GetStatusMessage();
+        }
+        return userStatus;
+    }
+
+    for (UINT32 bar = 0; bar < barCount; bar++)
+    {
+        mask[bar] = sizing.GetResult(maskSlots[bar]);
+    }
+
+    for (UINT32 bar = 0; bar < barCount; bar++)
+    {
+        UINT64 base = original[bar] & BAR_MEMORY_ADDRESS_MASK;
+        UINT64 sizeMask = 0xFFFFFFFF00000000 | (mask[bar] & BAR_MEMORY_ADDRESS_MASK);
+        UINT8 flags = (original[bar] & BAR_PREFETCHABLE) ? BAR_INDEX_PREFETCHABLE : 0;
+        UINT32 first = bar;
+
+        if (original[bar] & BAR_IO_SPACE) {
+            continue;
+        }
+
+        if ((original[bar] & BAR_TYPE_MASK) == BAR_TYPE_64BIT) {
+            if (++bar >= barCount) {
+                break;
+            }
+            base |= (UINT64)original[bar] << 32;
+            sizeMask = ((UINT64)mask[bar] << 32) | (mask[first] & BAR_MEMORY_ADDRESS_MASK);
+            flags |= BAR_INDEX_64BIT;
+        }
+
+        //
+        // An unimplemented BAR reads back 0, an unassigned one has base 0.
+        //
+        if (((UINT32)sizeMask & BAR_MEMORY_ADDRESS_MASK) == 0 && ((flags & BAR_INDEX_64BIT) == 0 || (UINT32)(sizeMask >> 32) == 0)) {
+            continue;
+        }
+        if (base == 0) {
+            continue;
+        }
+
+        userStatus = Add(base, ~sizeMask + 1, Bus, Device, Function, (UINT8)first, flags);
+        if (userStatus != Success) {
+            return userStatus;
+        }
+    }
+
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CBarIndex::Find
+
+  Summary:  Returns the window holding Address to Address + Length - 1.
+
+  Args:     UINT64 Address
+              Physical address of the access.
+            UINT64 Length
+              Access length in bytes, at least 1.
+
+  Modifies: None.
+
+  Returns:  UINT32
+              Returns the window index or BAR_INDEX_INVALID.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CBarIndex::Find(UINT64 Address, UINT64 Length) const
+{
+    size_t position = std::upper_bound(m_Base.begin(), m_Base.end(), Address) - m_Base.begin();
+
+    if (position == 0 || Length == 0) {
+        return BAR_INDEX_INVALID;
+    }
+    position--;
+    if (Length - 1 > m_Last[position] - Address || Address > m_Last[position]) {
+        return BAR_INDEX_INVALID;
+    }
+    return (UINT32)position;
+}
+
+void CBarIndex::Clear()
+{
+    m_Base.clear();
+    m_Last.clear();
+    m_Bdf.clear();
+    m_Bar.clear();
+    m_Flags.clear();
+}
+
+std::string CBarIndex::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
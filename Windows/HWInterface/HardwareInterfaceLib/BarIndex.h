@@ -0,0 +1,116 @@
+#pragma once
+/*+===================================================================
+  File:      BarIndex.h
+
+  Summary:   Sorted interval index of the memory BARs of all functions,
+             used to check MMIO reads and find the function they hit.
+
+  Classes:   CBarIndex.
+
+  Functions: Add, AddResource, SizeBars, Find.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+#define BAR_INDEX_INVALID               0xFFFFFFFF
+#define BAR_INDEX_64BIT                 0x01
+#define BAR_INDEX_PREFETCHABLE          0x02
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CBarIndex
+
+  Summary:  Keeps the memory BAR windows sorted by base address in
+            columns, one entry per BAR. Windows of different BARs never
+            overlap, so a lookup is a binary search over the bases for
+            the last window starting at or below the address and one
+            compare with its end. I/O BARs are not indexed, MMIO reads
+            never target them.
+
+  Methods:  UserStatus Add(UINT64 Base, UINT64 Size, UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar, UINT8 Flags)
+              Adds a window, e.g. one sized by SizeBars or reported by the OS.
+            UserStatus AddResource(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 Base, UINT64 Size)
+              Adds a window the OS assigned under the BAR that decodes it, BARs are only read.
+            UserStatus SizeBars(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function)
+              Sizes the memory BARs of a quiesced type 0 function by writing them and adds them.
+            UINT32 Find(UINT64 Address, UINT64 Length) const
+              Returns the window holding the whole range or BAR_INDEX_INVALID.
+            UINT32 GetCount() const
+              Returns the number of windows.
+            UINT64 GetBase/GetSize(UINT32 Index) const
+              Return a window.
+            UINT8 GetBus/GetDevice/GetFunction/GetBar/GetFlags(UINT32 Index) const
+              Return the owner of a window.
+            void Clear()
+              Removes all windows.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CBarIndex
+{
+public:
+    UserStatus Add(UINT64 Base, UINT64 Size, UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar, UINT8 Flags);
+    UserStatus AddResource(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 Base, UINT64 Size);
+    UserStatus SizeBars(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, UINT8 Function);
+    UINT32 Find(UINT64 Address, UINT64 Length) const;
+    void Clear();
+    std::string GetStatusMessage();
+
+    UINT32 GetCount() const
+    {
+        return (UINT32)m_Base.size();
+    }
+
+    UINT64 GetBase(UINT32 Index) const
+    {
+        return m_Base[Index];
+    }
+
+    UINT64 GetSize(UINT32 Index) const
+    {
+        return m_Last[Index] - m_Base[Index] + 1;
+    }
+
+    UINT8 GetBus(UINT32 Index) const
+    {
+        return (UINT8)(m_Bdf[Index] >> 8);
+    }
+
+    UINT8 GetDevice(UINT32 Index) const
+    {
+        return (UINT8)((m_Bdf[Index] >> 3) & 0x1F);
+    }
+
+    UINT8 GetFunction(UINT32 Index) const
+    {
+        return (UINT8)(m_Bdf[Index] & 0x07);
+    }
+
+    UINT8 GetBar(UINT32 Index) const
+    {
+        return m_Bar[Index];
+    }
+
+    UINT8 GetFlags(UINT32 Index) const
+    {
+        return m_Flags[Index];
+    }
+
+private:
+    //
+    // m_Last is the last byte of a window, so a window may end at the top
+    // of the address space.
+    //
+    std::vector<UINT64> m_Base;
+    std::vector<UINT64> m_Last;
+    std::vector<UINT16> m_Bdf;
+    std::vector<UINT8> m_Bar;
+    std::vector<UINT8> m_Flags;
+    std::stringstream m_StatusMessage;
+};
@@ -0,0 +1,437 @@
+#include "CapabilityWalker.h"
+
+//
+// A standard list holds at most 48 capabilities of 4 bytes above 0x40, an
+// extended chain at most 960 headers, longer chains are loops.
+//
+#define PCI_MAX_CAPABILITIES            48
+#define PCIe_MAX_EXT_CAPABILITIES       ((PCIe_CFG_SIZE - PCIe_EXTENDED_CAPABILITIES) / sizeof(UINT32))
+#define PCI_CAPABILITIES_START          0x40
+
+//
+// Sizes of the extended capabilities whose layout is fixed. Capabilities
+// not listed extend up to the next capability of the chain.
+//
+static const struct
+{
+    UINT16 m_Id;
+    UINT16 m_Size;
+}ExtendedCapabilitySizes[] =
+{
+    { PCIe_EXT_CAP_ID_AER, 0x48 },
+    { PCIe_EXT_CAP_ID_DSN, 0x0C },
+    { PCIe_EXT_CAP_ID_POWER_BUDGET, 0x10 },
+    { PCIe_EXT_CAP_ID_ARI, 0x08 },
+    { PCIe_EXT_CAP_ID_ATS, 0x08 },
+    { PCIe_EXT_CAP_ID_SRIOV, 0x40 },
+    { PCIe_EXT_CAP_ID_PRI, 0x10 },
+    { PCIe_EXT_CAP_ID_LTR, 0x08 },
+    { PCIe_EXT_CAP_ID_L1SS, 0x10 },
+    { PCIe_EXT_CAP_ID_PTM, 0x0C },
+};
+
+CCapabilityWalker::CCapabilityWalker(CHardwareInterfaceLib& CHWLib)
+{
+    m_Read = LibRead;
+    m_Context = &CHWLib;
+    m_BytesRead = 0;
+}
+
+CCapabilityWalker::CCapabilityWalker(PFN_CFG_READ Read, PVOID Context)
+{
+    m_Read = Read;
+    m_Context = Context;
+    m_BytesRead = 0;
+}
+
+//
+// Reads inside the first 256 bytes go through the HAL, the rest through
+// the memory mapped extended configuration space.
+//
+UserStatus CCapabilityWalker::LibRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    CHardwareInterfaceLib* CHWLib = (CHardwareInterfaceLib*)Context;
+    PCI_PCIeCfgData cfgData;
+
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = Function;
+    cfgData.m_Offset = Offset;
+    cfgData.OutputData.m_Size = Size;
+    cfgData.OutputData.DataPointer = Data;
+
+    if (Offset + Size <= PCI_CFG_SIZE) {
+        return CHWLib->PCIStdCfgRead(&cfgData);
+    }
+    return CHWLib->PCIeExCfgRead(&cfgData);
+}
+
+UserStatus CCapabilityWalker::Read(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UserStatus userStatus = m_Read(m_Context, Bus, Device, Function, Offset, Data, Size);
+
+    if (userStatus != Success) {
+        m_StatusMessage << "Configuration read failed for Bus: 0x" << std::hex << +Bus << ", Device: 0x" << +Device
+            << ", Function: 0x" << +Function << ", Offset: 0x" << Offset << ", Size: 0x" << Size;
+    }
+    m_BytesRead += Size;
+    return userStatus;
+}
+
+CCapabilityWalker::DeviceCapabilities& CCapabilityWalker::GetDevice(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    UINT32 key = ((UINT32)Bus << 8) | ((Device & 0x1F) << 3) | (Function & 0x07);
+
+    auto found = m_Devices.find(key);
+    if (found == m_Devices.end()) {
+        DeviceCapabilities capabilities;
+        capabilities.m_Standard.m_Started = false;
+        capabilities.m_Standard.m_Next = 0;
+        capabilities.m_Standard.m_Steps = 0;
+        capabilities.m_Extended = capabilities.m_Standard;
+        found = m_Devices.emplace(key, capabilities).first;
+    }
+    return found->second;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCapabilityWalker::Step
+
+  Summary:  Advances a chain by one read. The first step of the standard
+            list reads the status register and the capabilities pointer,
+            every other step reads a single capability header.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to walk.
+            bool Extended
+              Walk the extended chain instead of the standard list.
+            CapabilityChain& Chain
+              Walk state of the chain.
+
+  Modifies: [Chain].
+
+  Returns:  UserStatus
+              Returns error code, Chain is unchanged on failure.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCapabilityWalker::Step(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, CapabilityChain& Chain)
+{
+    UserStatus userStatus = Success;
+    CapabilityEntry entry;
+
+    if (!Chain.m_Started && !Extended) {
+        PciStatus::ValueType status = 0;
+        PciCapabilitiesPointer::ValueType pointer = 0;
+
+        userStatus = Read(Bus, Device, Function, PciStatus::Offset, (PUINT8)&status, PciStatus::Width);
+        if (userStatus == Success && PciStatusCapabilitiesList::Get(status) && status != 0xFFFF) {
+            userStatus = Read(Bus, Device, Function, PciCapabilitiesPointer::Offset, &pointer, PciCapabilitiesPointer::Width);
+        }
+        if (userStatus != Success) {
+            goto Exit;
+        }
+
+        Chain.m_Started = true;
+        Chain.m_Next = ((pointer & 0xFC) >= PCI_CAPABILITIES_START) ? (pointer & 0xFC) : 0;
+        goto Exit;
+    }
+
+    if (!Chain.m_Started) {
+        Chain.m_Started = true;
+        Chain.m_Next = PCIe_EXTENDED_CAPABILITIES;
+    }
+
+    if (Chain.m_Next == 0) {
+        goto Exit;
+    }
+
+    if (!Extended) {
+        UINT8 header[2] = { 0 };
+
+        userStatus = Read(Bus, Device, Function, Chain.m_Next, header, sizeof(header));
+        if (userStatus != Success) {
+            goto Exit;
+        }
+
+        entry.m_Id = header[0];
+        entry.m_Offset = (UINT16)Chain.m_Next;
+        Chain.m_Found.push_back(entry);
+        Chain.m_Next = ((header[1] & 0xFC) >= PCI_CAPABILITIES_START) ? (header[1] & 0xFC) : 0;
+        if (++Chain.m_Steps >= PCI_MAX_CAPABILITIES) {
+            Chain.m_Next = 0;
+        }
+    }
+    else {
+        UINT32 header = 0;
+
+        userStatus = Read(Bus, Device, Function, Chain.m_Next, (PUINT8)&header, sizeof(header));
+        if (userStatus != Success) {
+            goto Exit;
+        }
+
+        //
+        // An empty header at 0x100 means no extended capabilities, all ones
+        // means the function has no extended configuration space.
+        //
+        if (header == 0 || header == 0xFFFFFFFF) {
+            Chain.m_Next = 0;
+            goto Exit;
+        }
+
+        entry.m_Id = (UINT16)(header & 0xFFFF);
+        entry.m_Offset = (UINT16)Chain.m_Next;
+        Chain.m_Found.push_back(entry);
+        Chain.m_Next = (((header >> 20) & 0xFFC) >= PCIe_EXTENDED_CAPABILITIES) ? ((header >> 20) & 0xFFC) : 0;
+        if (++Chain.m_Steps >= PCIe_MAX_EXT_CAPABILITIES) {
+            Chain.m_Next = 0;
+        }
+    }
+
+Exit:
+    return userStatus;
+}
+
+UserStatus CCapabilityWalker::Find(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, UINT16 Id, PUINT32 pOffset)
+{
+    UserStatus userStatus = Success;
+    DeviceCapabilities& device = GetDevice(Bus, Device, Function);
+    CapabilityChain& chain = Extended ? device.m_Extended : device.m_Standard;
+    size_t searched = 0;
+    m_StatusMessage.str("");
+
+    for (;;)
+    {
+        for (; searched < chain.m_Found.size(); searched++)
+        {
+            if (chain.m_Found[searched].m_Id == Id) {
+                *pOffset = chain.m_Found[searched].m_Offset;
+                return Success;
+            }
+        }
+
+        if (chain.m_Started && chain.m_Next == 0) {
+            break;
+        }
+
+        userStatus = Step(Bus, Device, Function, Extended, chain);
+        if (userStatus != Success) {
+            return userStatus;
+        }
+    }
+
+    m_StatusMessage << (Extended ? "Extended capability 0x" : "Capability 0x") << std::hex << Id << " not present for Bus: 0x" << +Bus
+        << ", Device: 0x" << +Device << ", Function: 0x" << +Function;
+    return IndexOutOfRange;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCapabilityWalker::FindCapability
+
+  Summary:  Returns the offset of the first standard capability with the
+            given id, walking the list only up to it.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to search.
+            UINT8 Id
+              Capability id, e.g. PCI_CAP_ID_PCIe.
+            PUINT32 pOffset
+              Receives the offset of the capability header.
+
+  Modifies: [pOffset].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the capability is not present.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCapabilityWalker::FindCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, PUINT32 pOffset)
+{
+    return Find(Bus, Device, Function, false, Id, pOffset);
+}
+
+UserStatus CCapabilityWalker::FindExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, PUINT32 pOffset)
+{
+    return Find(Bus, Device, Function, true, Id, pOffset);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCapabilityWalker::ReadCapability
+
+  Summary:  Reads Size bytes at FieldOffset inside a standard capability,
+            e.g. the Link Status register of the PCIe capability.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to read.
+            UINT8 Id
+              Capability id.
+            UINT32 FieldOffset
+              Offset of the field from the capability header.
+            PUINT8 Data
+              Receives the field.
+            UINT32 Size
+              Field size in bytes.
+
+  Modifies: [Data].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCapabilityWalker::ReadCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size)
+{
+    UINT32 offset = 0;
+    UserStatus userStatus = FindCapability(Bus, Device, Function, Id, &offset);
+
+    if (userStatus == Success) {
+        if (offset + FieldOffset + Size > PCI_CFG_SIZE) {
+            m_StatusMessage << "Field 0x" << std::hex << FieldOffset << " of capability 0x" << +Id << " is past the standard configuration space";
+            return IndexOutOfRange;
+        }
+        userStatus = Read(Bus, Device, Function, offset + FieldOffset, Data, Size);
+    }
+    return userStatus;
+}
+
+UserStatus CCapabilityWalker::ReadExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size)
+{
+    UINT32 offset = 0;
+    UserStatus userStatus = FindExtendedCapability(Bus, Device, Function, Id, &offset);
+
+    if (userStatus == Success) {
+        if (offset + FieldOffset + Size > PCIe_CFG_SIZE) {
+            m_StatusMessage << "Field 0x" << std::hex << FieldOffset << " of extended capability 0x" << Id << " is past the configuration space";
+            return IndexOutOfRange;
+        }
+        userStatus = Read(Bus, Device, Function, offset + FieldOffset, Data, Size);
+    }
+    return userStatus;
+}
+
+UserStatus CCapabilityWalker::GetCapabilities(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, std::vector<CapabilityEntry>& Capabilities)
+{
+    UserStatus userStatus = Success;
+    DeviceCapabilities& device = GetDevice(Bus, Device, Function);
+    CapabilityChain& chain = Extended ? device.m_Extended : device.m_Standard;
+    m_StatusMessage.str("");
+
+    while (!chain.m_Started || chain.m_Next != 0)
+    {
+        userStatus = Step(Bus, Device, Function, Extended, chain);
+        if (userStatus != Success) {
+            return userStatus;
+        }
+    }
+
+    Capabilities = chain.m_Found;
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCapabilityWalker::GetExtent
+
+  Summary:  Returns the end of the populated configuration space of a
+            function. Functions without a PCI Express capability, or with
+            an empty or all ones header at 0x100, end at 256 bytes. Else
+            the extended chain is walked and every capability ends after
+            its fixed size, after the length of a vendor specific header,
+            or at the next capability of the chain.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to size.
+            PUINT32 pExtent
+              Receives the populated size, a multiple of 4 between
+              PCI_CFG_SIZE and PCIe_CFG_SIZE.
+
+  Modifies: [pExtent].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCapabilityWalker::GetExtent(UINT8 Bus, UINT8 Device, UINT8 Function, PUINT32 pExtent)
+{
+    UserStatus userStatus = Success;
+    std::vector<CapabilityEntry> capabilities;
+    UINT32 offset = 0;
+    UINT32 extent = PCI_CFG_SIZE;
+
+    userStatus = FindCapability(Bus, Device, Function, PCI_CAP_ID_PCIe, &offset);
+    if (userStatus == IndexOutOfRange) {
+        userStatus = Success;
+        goto Exit;
+    }
+    if (userStatus != Success) {
+        goto Exit;
+    }
+
+    userStatus = GetCapabilities(Bus, Device, Function, true, capabilities);
+    if (userStatus != Success) {
+        goto Exit;
+    }
+
+    for (size_t i = 0; i < capabilities.size(); i++)
+    {
+        UINT32 start = capabilities[i].m_Offset;
+        UINT32 end = 0;
+
+        for (size_t j = 0; j < sizeof(ExtendedCapabilitySizes) / sizeof(ExtendedCapabilitySizes[0]); j++)
+        {
+            if (ExtendedCapabilitySizes[j].m_Id == capabilities[i].m_Id) {
+                end = start + ExtendedCapabilitySizes[j].m_Size;
+                break;
+            }
+        }
+
+        if (end == 0 && (capabilities[i].m_Id == PCIe_EXT_CAP_ID_VENDOR || capabilities[i].m_Id == PCIe_EXT_CAP_ID_DVSEC)) {
+            VendorSpecificHeader::ValueType header = 0;
+
+            userStatus = Read(Bus, Device, Function, start + VendorSpecificHeader::Offset, (PUINT8)&header, VendorSpecificHeader::Width);
+            if (userStatus != Success) {
+                goto Exit;
+            }
+            if (VendorSpecificLength::Get(header) > VendorSpecificHeader::Offset) {
+                end = start + VendorSpecificLength::Get(header);
+            }
+        }
+
+        if (end == 0) {
+            end = PCIe_CFG_SIZE;
+            for (size_t j = 0; j < capabilities.size(); j++)
+            {
+                if (capabilities[j].m_Offset > start && capabilities[j].m_Offset < end) {
+                    end = capabilities[j].m_Offset;
+                }
+            }
+        }
+
+        if (end > extent) {
+            extent = end;
+        }
+    }
+
+    extent = (extent + sizeof(UINT32) - 1) & ~(UINT32)(sizeof(UINT32) - 1);
+    if (extent > PCIe_CFG_SIZE) {
+        extent = PCIe_CFG_SIZE;
+    }
+
+Exit:
+    if (userStatus == Success) {
+        *pExtent = extent;
+    }
+    return userStatus;
+}
+
+void CCapabilityWalker::Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    m_Devices.erase(((UINT32)Bus << 8) | ((Device & 0x1F) << 3) | (Function & 0x07));
+}
+
+void CCapabilityWalker::InvalidateAll()
+{
+    m_Devices.clear();
+}
+
+UINT64 CCapabilityWalker::GetBytesRead()
+{
+    return m_BytesRead;
+}
+
+std::string CCapabilityWalker::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,141 @@
+#pragma once
+/*+===================================================================
+  File:      CapabilityWalker.h
+
+  Summary:   Finds PCI capabilities and PCIe extended capabilities one
+             header at a time and reads single fields of them.
+
+  Classes:   CCapabilityWalker.
+
+  Functions: FindCapability, FindExtendedCapability, ReadCapability,
+             ReadExtendedCapability, ReadRegister, ReadField,
+             GetCapabilities, GetExtent, Invalidate.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+#define PCIe_EXTENDED_CAPABILITIES      0x100
+
+//
+// Reads Size bytes at Offset of the configuration space of a function.
+//
+typedef UserStatus (*PFN_CFG_READ)(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+
+typedef struct
+{
+    UINT16 m_Id;
+    UINT16 m_Offset;
+}CapabilityEntry;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CCapabilityWalker
+
+  Summary:  Follows the capability list at 0x34 and the extended capability
+            chain at 0x100 only as far as a lookup needs, reading one
+            header per step, and caches the offsets found per function.
+            Field reads then fetch only the requested bytes.
+
+  Methods:  CCapabilityWalker(CHardwareInterfaceLib& CHWLib)
+              Reads through the driver.
+            CCapabilityWalker(PFN_CFG_READ Read, PVOID Context)
+              Reads through any other backend.
+            UserStatus FindCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, PUINT32 pOffset)
+              Returns the offset of a standard capability.
+            UserStatus FindExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, PUINT32 pOffset)
+              Returns the offset of an extended capability.
+            UserStatus ReadCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size)
+              Reads a field of a standard capability.
+            UserStatus ReadExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size)
+              Reads a field of an extended capability.
+            UserStatus ReadRegister<Reg>(UINT8 Bus, UINT8 Device, UINT8 Function, Reg::ValueType& Value)
+              Reads a capability register defined in RegisterDefs.h.
+            UserStatus ReadField<Field>(UINT8 Bus, UINT8 Device, UINT8 Function, Field::ValueType& Value)
+              Reads a capability field defined in RegisterDefs.h.
+            UserStatus GetCapabilities(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, std::vector<CapabilityEntry>& Capabilities)
+              Walks a whole chain and returns it.
+            UserStatus GetExtent(UINT8 Bus, UINT8 Device, UINT8 Function, PUINT32 pExtent)
+              Returns the end of the populated configuration space.
+            void Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function), InvalidateAll()
+              Forgets cached offsets, e.g. after a reset.
+            UINT64 GetBytesRead()
+              Returns the configuration space bytes read so far.
+            std::string GetStatusMessage()
+              Returns the error status message.
+            static UserStatus LibRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              PFN_CFG_READ reading through the CHardwareInterfaceLib in Context.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CCapabilityWalker
+{
+public:
+    CCapabilityWalker(CHardwareInterfaceLib& CHWLib);
+    CCapabilityWalker(PFN_CFG_READ Read, PVOID Context);
+    UserStatus FindCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, PUINT32 pOffset);
+    UserStatus FindExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, PUINT32 pOffset);
+    UserStatus ReadCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size);
+    UserStatus ReadExtendedCapability(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 Id, UINT32 FieldOffset, PUINT8 Data, UINT32 Size);
+
+    template <typename Reg>
+    UserStatus ReadRegister(UINT8 Bus, UINT8 Device, UINT8 Function, typename Reg::ValueType& Value)
+    {
+        static_assert(Reg::Space::IsCapability, "Configuration header registers are read through CHardwareInterfaceLib");
+        if (Reg::Space::IsExtended) {
+            return ReadExtendedCapability(Bus, Device, Function, Reg::Space::Id, Reg::Offset, (PUINT8)&Value, Reg::Width);
+        }
+        return ReadCapability(Bus, Device, Function, (UINT8)Reg::Space::Id, Reg::Offset, (PUINT8)&Value, Reg::Width);
+    }
+
+    template <typename Field>
+    UserStatus ReadField(UINT8 Bus, UINT8 Device, UINT8 Function, typename Field::ValueType& Value)
+    {
+        typename Field::ValueType registerValue = 0;
+        UserStatus userStatus = ReadRegister<typename Field::Register>(Bus, Device, Function, registerValue);
+        Value = Field::Get(registerValue);
+        return userStatus;
+    }
+
+    UserStatus GetCapabilities(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, std::vector<CapabilityEntry>& Capabilities);
+    UserStatus GetExtent(UINT8 Bus, UINT8 Device, UINT8 Function, PUINT32 pExtent);
+    void Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function);
+    void InvalidateAll();
+    UINT64 GetBytesRead();
+    std::string GetStatusMessage();
+    static UserStatus LibRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+
+private:
+    //
+    // Walk state of one chain, m_Next is the next header to read and 0 once
+    // the end of the chain has been reached.
+    //
+    struct CapabilityChain
+    {
+        bool m_Started;
+        UINT32 m_Next;
+        UINT32 m_Steps;
+        std::vector<CapabilityEntry> m_Found;
+    };
+
+    struct DeviceCapabilities
+    {
+        CapabilityChain m_Standard;
+        CapabilityChain m_Extended;
+    };
+
+    UserStatus Read(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus Step(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, CapabilityChain& Chain);
+    UserStatus Find(UINT8 Bus, UINT8 Device, UINT8 Function, bool Extended, UINT16 Id, PUINT32 pOffset);
+    DeviceCapabilities& GetDevice(UINT8 Bus, UINT8 Device, UINT8 Function);
+
+    PFN_CFG_READ m_Read;
+    PVOID m_Context;
+    std::unordered_map<UINT32, DeviceCapabilities> m_Devices;
+    UINT64 m_BytesRead;
+    std::stringstream m_StatusMessage;
+};
@@ -0,0 +1,79 @@
+#include "CaptureArena.h"
+
+CCaptureArena::CCaptureArena()
+{
+    m_Slab = NULL;
+    m_Capacity = 0;
+    m_SlotCount = 0;
+    m_SlotSize = 0;
+    m_AllocationCount = 0;
+}
+
+CCaptureArena::~CCaptureArena()
+{
+    Release();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCaptureArena::Reserve
+
+  Summary:  Lays out the slots for a capture. The slab is reused when it
+            is large enough, otherwise it is replaced by one rounded up to
+            the allocation granularity. Slots are not cleared, a capture
+            overwrites every slot it uses.
+
+  Args:     UINT32 SlotCount
+              Number of functions to capture.
+            UINT32 SlotSize
+              Bytes per function, PCI_CFG_SIZE or PCIe_CFG_SIZE.
+
+  Modifies: [m_Slab, m_Capacity, m_SlotCount, m_SlotSize].
+
+  Returns:  UserStatus
+              Returns error code, the previous slab is kept on failure.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCaptureArena::Reserve(UINT32 SlotCount, UINT32 SlotSize)
+{
+    SIZE_T size = (SIZE_T)SlotCount * SlotSize;
+    PUINT8 slab = NULL;
+    m_StatusMessage.str("");
+
+    if (SlotSize == 0 || (SlotSize % sizeof(UINT32)) != 0) {
+        m_StatusMessage << "Slot size 0x" << std::hex << SlotSize << " is not a multiple of 4 bytes";
+        return IndexOutOfRange;
+    }
+
+    if (size > m_Capacity) {
+        size = (size + CAPTURE_ARENA_GRANULARITY - 1) & ~(SIZE_T)(CAPTURE_ARENA_GRANULARITY - 1);
+        slab = (PUINT8)VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (slab == NULL) {
+            m_StatusMessage << "Unable to allocate a capture arena of 0x" << std::hex << size << " bytes";
+            return NullPointer;
+        }
+
+        Release();
+        m_Slab = slab;
+        m_Capacity = size;
+        m_AllocationCount++;
+    }
+
+    m_SlotCount = SlotCount;
+    m_SlotSize = SlotSize;
+    return Success;
+}
+
+void CCaptureArena::Release()
+{
+    if (m_Slab != NULL) {
+        VirtualFree(m_Slab, 0, MEM_RELEASE);
+        m_Slab = NULL;
+    }
+    m_Capacity = 0;
+    m_SlotCount = 0;
+    m_SlotSize = 0;
+}
+
+std::string CCaptureArena::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
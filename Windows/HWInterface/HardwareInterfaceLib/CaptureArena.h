@@ -0,0 +1,98 @@
+#pragma once
+/*+===================================================================
+  File:      CaptureArena.h
+
+  Summary:   One page aligned slab holding the configuration space
+             captures of all functions.
+
+  Classes:   CCaptureArena.
+
+  Functions: Reserve, GetSlot, GetData.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include "HardwareInterfaceLib.h"
+
+#define CAPTURE_ARENA_GRANULARITY   0x10000
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CCaptureArena
+
+  Summary:  Replaces one heap buffer per function with fixed size slots
+            in a single VirtualAlloc slab, slot i belongs to the function
+            at index i of the device registry. The slab is kept across
+            captures and only reallocated when a capture needs more room,
+            so repeated captures allocate nothing. The slots are
+            contiguous and can be handed to a writer in one piece.
+
+  Methods:  UserStatus Reserve(UINT32 SlotCount, UINT32 SlotSize)
+              Lays out SlotCount slots of SlotSize bytes, growing the slab
+              if needed.
+            PUINT8 GetSlot(UINT32 Slot)
+              Returns the buffer of a slot.
+            PUINT8 GetData(), SIZE_T GetSize()
+              Return the slots as one buffer.
+            UINT32 GetSlotCount(), UINT32 GetSlotSize()
+              Return the current layout.
+            UINT32 GetAllocationCount()
+              Returns how often the slab was allocated.
+            void Release()
+              Frees the slab.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CCaptureArena
+{
+public:
+    CCaptureArena();
+    ~CCaptureArena();
+    CCaptureArena(const CCaptureArena&) = delete;
+    CCaptureArena& operator=(const CCaptureArena&) = delete;
+
+    UserStatus Reserve(UINT32 SlotCount, UINT32 SlotSize);
+    void Release();
+    std::string GetStatusMessage();
+
+    PUINT8 GetSlot(UINT32 Slot)
+    {
+        return m_Slab + (SIZE_T)Slot * m_SlotSize;
+    }
+
+    PUINT8 GetData()
+    {
+        return m_Slab;
+    }
+
+    SIZE_T GetSize()
+    {
+        return (SIZE_T)m_SlotCount * m_SlotSize;
+    }
+
+    UINT32 GetSlotCount()
+    {
+        return m_SlotCount;
+    }
+
+    UINT32 GetSlotSize()
+    {
+        return m_SlotSize;
+    }
+
+    UINT32 GetAllocationCount()
+    {
+        return m_AllocationCount;
+    }
+
+private:
+    PUINT8 m_Slab;
+    SIZE_T m_Capacity;
+    UINT32 m_SlotCount;
+    UINT32 m_SlotSize;
+    UINT32 m_AllocationCount;
+    std::stringstream m_StatusMessage;
+};
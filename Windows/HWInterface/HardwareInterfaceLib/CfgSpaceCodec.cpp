@@ -0,0 +1,246 @@
+#include "CfgSpaceCodec.h"
+
+static inline UINT32 LoadDword(const UINT8* Data)
+{
+    UINT32 value;
+    memcpy(&value, Data, sizeof(value));
+    return value;
+}
+
+static inline void StoreDword(PUINT8 Data, UINT32 Value)
+{
+    memcpy(Data, &Value, sizeof(Value));
+}
+
+static inline UINT32 ReferenceDword(const UINT8* Reference, UINT32 Index)
+{
+    return Reference ? LoadDword(Reference + Index * sizeof(UINT32)) : 0;
+}
+
+static inline UINT8 ClassifyDword(const UINT8* Data, const UINT8* Reference, UINT32 Index)
+{
+    UINT32 value = LoadDword(Data + Index * sizeof(UINT32));
+
+    if (value == ReferenceDword(Reference, Index)) {
+        return CFG_CODEC_SAME;
+    }
+    if (value == 0xFFFFFFFF) {
+        return CFG_CODEC_ONES;
+    }
+    if (Index > 0 && value == LoadDword(Data + (Index - 1) * sizeof(UINT32))) {
+        return CFG_CODEC_REPEAT;
+    }
+    return CFG_CODEC_LITERAL;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCfgSpaceCodec::MaxEncodedSize
+
+  Summary:  Returns the worst case encoded size, all dwords literal with
+            every byte non-zero.
+
+  Args:     UINT32 Size
+              Raw size in bytes.
+
+  Modifies: None
+
+  Returns:  Size of the output buffer Encode needs.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CCfgSpaceCodec::MaxEncodedSize(UINT32 Size)
+{
+    UINT32 dwords = Size / sizeof(UINT32);
+    UINT32 tokens = (dwords + CFG_CODEC_MAX_RUN - 1) / CFG_CODEC_MAX_RUN;
+
+    return Size + (dwords + 1) / 2 + 2 * tokens;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCfgSpaceCodec::Encode
+
+  Summary:  Encodes a configuration space capture.
+
+  Args:     const UINT8* Data
+              Capture to encode.
+            UINT32 Size
+              Capture size in bytes, a multiple of 4.
+            const UINT8* Reference
+              Capture of the same size to encode against, or NULL.
+            PUINT8 Output
+              Receives at most MaxEncodedSize(Size) bytes.
+
+  Modifies: [Output].
+
+  Returns:  Encoded size in bytes, 0 if Size is not a multiple of 4.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CCfgSpaceCodec::Encode(const UINT8* Data, UINT32 Size, const UINT8* Reference, PUINT8 Output)
+{
+    UINT32 dwords = Size / sizeof(UINT32);
+    PUINT8 out = Output;
+    UINT32 i = 0;
+
+    if (Size % sizeof(UINT32)) {
+        return 0;
+    }
+
+    while (i < dwords)
+    {
+        UINT8 kind = ClassifyDword(Data, Reference, i);
+        UINT32 run = 1;
+
+        if (kind != CFG_CODEC_LITERAL) {
+            while (i + run < dwords && run < CFG_CODEC_MAX_RUN && ClassifyDword(Data, Reference, i + run) == kind) {
+                run++;
+            }
+            *out++ = (UINT8)(kind | (run - 1));
+            i += run;
+            continue;
+        }
+
+        //
+        // A single unchanged dword costs only a zero nibble inside a
+        // literal run, cheaper than closing the run with a token.
+        //
+        while (i + run < dwords && run < CFG_CODEC_MAX_RUN)
+        {
+            UINT8 next = ClassifyDword(Data, Reference, i + run);
+            if (next == CFG_CODEC_LITERAL) {
+                run++;
+            }
+            else if (next == CFG_CODEC_SAME && run + 1 < CFG_CODEC_MAX_RUN && i + run + 1 < dwords &&
+                     ClassifyDword(Data, Reference, i + run + 1) == CFG_CODEC_LITERAL) {
+                run += 2;
+            }
+            else {
+                break;
+            }
+        }
+
+        *out++ = (UINT8)(CFG_CODEC_LITERAL | (run - 1));
+
+        PUINT8 masks = out;
+        out += (run + 1) / 2;
+        memset(masks, 0, (run + 1) / 2);
+
+        for (UINT32 j = 0; j < run; j++)
+        {
+            UINT32 delta = LoadDword(Data + (i + j) * sizeof(UINT32)) ^ ReferenceDword(Reference, i + j);
+            UINT8 mask = 0;
+
+            for (UINT32 b = 0; b < sizeof(UINT32); b++)
+            {
+                UINT8 byte = (UINT8)(delta >> (b * 8));
+                if (byte) {
+                    mask |= (UINT8)(1 << b);
+                    *out++ = byte;
+                }
+            }
+            masks[j / 2] |= (UINT8)(mask << ((j & 1) * 4));
+        }
+
+        i += run;
+    }
+
+    return (UINT32)(out - Output);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CCfgSpaceCodec::Decode
+
+  Summary:  Decodes a configuration space capture.
+
+  Args:     const UINT8* Input
+              Encoded data.
+            UINT32 InputSize
+              Encoded size in bytes.
+            const UINT8* Reference
+              Capture the data was encoded against, or NULL.
+            PUINT8 Output
+              Receives Size bytes.
+            UINT32 Size
+              Raw size in bytes, a multiple of 4.
+
+  Modifies: [Output].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the encoded data is truncated or
+              does not decode to exactly Size bytes.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CCfgSpaceCodec::Decode(const UINT8* Input, UINT32 InputSize, const UINT8* Reference, PUINT8 Output, UINT32 Size)
+{
+    const UINT8* in = Input;
+    const UINT8* end = Input + InputSize;
+    UINT32 dwords = Size / sizeof(UINT32);
+    UINT32 i = 0;
+
+    if (Size % sizeof(UINT32)) {
+        return IndexOutOfRange;
+    }
+
+    while (i < dwords)
+    {
+        if (in >= end) {
+            return IndexOutOfRange;
+        }
+
+        UINT8 token = *in++;
+        UINT32 run = (token & ~CFG_CODEC_KIND_MASK) + 1;
+
+        if (i + run > dwords) {
+            return IndexOutOfRange;
+        }
+
+        switch (token & CFG_CODEC_KIND_MASK)
+        {
+            case CFG_CODEC_SAME:
+                for (UINT32 j = 0; j < run; j++, i++)
+                {
+                    StoreDword(Output + i * sizeof(UINT32), ReferenceDword(Reference, i));
+                }
+                break;
+
+            case CFG_CODEC_ONES:
+                memset(Output + i * sizeof(UINT32), 0xFF, run * sizeof(UINT32));
+                i += run;
+                break;
+
+            case CFG_CODEC_REPEAT:
+                if (i == 0) {
+                    return IndexOutOfRange;
+                }
+                for (UINT32 j = 0; j < run; j++, i++)
+                {
+                    StoreDword(Output + i * sizeof(UINT32), LoadDword(Output + (i - 1) * sizeof(UINT32)));
+                }
+                break;
+
+            default:
+            {
+                const UINT8* masks = in;
+                in += (run + 1) / 2;
+                if (in > end) {
+                    return IndexOutOfRange;
+                }
+
+                for (UINT32 j = 0; j < run; j++, i++)
+                {
+                    UINT8 mask = (UINT8)((masks[j / 2] >> ((j & 1) * 4)) & 0x0F);
+                    UINT32 delta = 0;
+
+                    for (UINT32 b = 0; b < sizeof(UINT32); b++)
+                    {
+                        if (mask & (1 << b)) {
+                            if (in >= end) {
+                                return IndexOutOfRange;
+                            }
+                            delta |= (UINT32)(*in++) << (b * 8);
+                        }
+                    }
+                    StoreDword(Output + i * sizeof(UINT32), delta ^ ReferenceDword(Reference, i));
+                }
+                break;
+            }
+        }
+    }
+
+    return (in == end) ? Success : IndexOutOfRange;
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*+===================================================================
+  File:      CfgSpaceCodec.h
+
+  Summary:   Compresses PCI/PCIe configuration space captures.
+
+  Classes:   CCfgSpaceCodec.
+
+  Functions: MaxEncodedSize, Encode, Decode.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include "HardwareInterfaceLib.h"
+
+//
+// The encoded stream is a list of tokens, each covering 1 to 64 dwords. The
+// top two bits of a token select its kind, the low six bits hold the dword
+// count minus one.
+//
+//   CFG_CODEC_SAME     dwords equal to the reference (zero without one).
+//   CFG_CODEC_ONES     dwords equal to 0xFFFFFFFF.
+//   CFG_CODEC_REPEAT   dwords equal to the previous dword.
+//   CFG_CODEC_LITERAL  dwords XORed with the reference, followed by one
+//                      nibble per dword flagging its non-zero bytes (two
+//                      nibbles per byte, low nibble first), then the
+//                      non-zero bytes themselves.
+//
+#define CFG_CODEC_SAME          0x00
+#define CFG_CODEC_ONES          0x40
+#define CFG_CODEC_REPEAT        0x80
+#define CFG_CODEC_LITERAL       0xC0
+#define CFG_CODEC_KIND_MASK     0xC0
+#define CFG_CODEC_MAX_RUN       64
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CCfgSpaceCodec
+
+  Summary:  Run elision, dword delta against a reference capture and byte
+            packing for configuration space captures, which are mostly
+            zeros and 0xFF.
+
+  Methods:  static UINT32 MaxEncodedSize(UINT32 Size)
+              Returns the worst case encoded size of Size bytes.
+            static UINT32 Encode(const UINT8* Data, UINT32 Size, const UINT8* Reference, PUINT8 Output)
+              Encodes Size bytes, returns the encoded size.
+            static UserStatus Decode(const UINT8* Input, UINT32 InputSize, const UINT8* Reference, PUINT8 Output, UINT32 Size)
+              Decodes Input into Size bytes.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CCfgSpaceCodec
+{
+public:
+    static UINT32 MaxEncodedSize(UINT32 Size);
+    static UINT32 Encode(const UINT8* Data, UINT32 Size, const UINT8* Reference, PUINT8 Output);
+    static UserStatus Decode(const UINT8* Input, UINT32 InputSize, const UINT8* Reference, PUINT8 Output, UINT32 Size);
+};
@@ -0,0 +1,536 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "ConfigArchive.h"
+
+#define CONFIG_ARCHIVE_WRITE_CHUNK  0x100000
+
+//
+// Buffers archive writes into 1 MB WriteFile calls.
+//
+class CArchiveFileWriter
+{
+public:
+    CArchiveFileWriter(HANDLE File) : m_File(File), m_Failed(false)
+    {
+        m_Buffer.reserve(CONFIG_ARCHIVE_WRITE_CHUNK);
+    }
+
+    void Append(const void* Data, SIZE_T Size)
+    {
+        const UINT8* data = (const UINT8*)Data;
+        m_Buffer.insert(m_Buffer.end(), data, data + Size);
+        if (m_Buffer.size() >= CONFIG_ARCHIVE_WRITE_CHUNK) {
+            Flush();
+        }
+    }
+
+    bool Flush()
+    {
+        DWORD bytesWritten = 0;
+        if (!m_Buffer.empty() && !WriteFile(m_File, m_Buffer.data(), (DWORD)m_Buffer.size(), &bytesWritten, NULL)) {
+            m_Failed = true;
+        }
+        m_Buffer.clear();
+        return !m_Failed;
+    }
+
+private:
+    HANDLE m_File;
+    bool m_Failed;
+    std::vector<UINT8> m_Buffer;
+};
+
+CConfigArchiveBuilder::CConfigArchiveBuilder()
+{
+    m_FunctionCount = 0;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigArchiveBuilder::InsertBlob
+
+  Summary:  Adds a capture to its shard unless a capture with the same
+            hash is already there.
+
+  Args:     const UINT8* Data
+              Capture to add.
+            UINT32 Size
+              Capture size in bytes.
+
+  Modifies: [m_Shards].
+
+  Returns:  Ingest blob id of the capture.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CConfigArchiveBuilder::InsertBlob(const UINT8* Data, UINT32 Size)
+{
+    Hash128 hash = CHash128::Compute(Data, Size, Size);
+    UINT32 shardIndex = (UINT32)(hash.m_High % CONFIG_ARCHIVE_SHARDS);
+    ArchiveShard& shard = m_Shards[shardIndex];
+    UINT32 local = 0;
+
+    std::lock_guard<std::mutex> lock(shard.m_Lock);
+
+    auto found = shard.m_Index.find(hash);
+    if (found != shard.m_Index.end()) {
+        local = found->second;
+        shard.m_RefCounts[local]++;
+    }
+    else {
+        local = (UINT32)shard.m_Blobs.size();
+        shard.m_Index.emplace(hash, local);
+        shard.m_Hashes.push_back(hash);
+        shard.m_Blobs.emplace_back(Data, Data + Size);
+        shard.m_RefCounts.push_back(1);
+    }
+
+    return local * CONFIG_ARCHIVE_SHARDS + shardIndex;
+}
+
+void CConfigArchiveBuilder::IngestFile(const std::string& FileName, ArchiveHostData& Host)
+{
+    CConfigSnapshotReader reader;
+    ConfigSnapshotRecord record;
+    std::vector<UINT8> data;
+    ConfigArchiveEntry entry;
+
+    Host.m_Status = reader.Open(FileName);
+    if (Host.m_Status != Success) {
+        Host.m_StatusMessage = reader.GetStatusMessage();
+        return;
+    }
+
+    Host.m_HostName = reader.GetHeader().m_HostName;
+    Host.m_Entries.reserve(reader.GetHeader().m_RecordCount);
+
+    for (UINT32 i = 0; i < reader.GetHeader().m_RecordCount; i++)
+    {
+        Host.m_Status = reader.ReadRecord(record, data);
+        if (Host.m_Status != Success) {
+            Host.m_StatusMessage = FileName + ": " + reader.GetStatusMessage();
+            return;
+        }
+
+        entry.m_Bus = record.m_Bus;
+        entry.m_Device = record.m_Device;
+        entry.m_Function = record.m_Function;
+        entry.m_Reserved = 0;
+        entry.m_BlobId = InsertBlob(data.data(), record.m_RawSize);
+        Host.m_Entries.push_back(entry);
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigArchiveBuilder::Ingest
+
+  Summary:  Ingests snapshot files, each file becomes the manifest of one
+            host. Threads take the next file until none are left, so files
+            are decoded in parallel and only meet on shard locks.
+
+  Args:     const std::vector<std::string>& SnapshotFiles
+              Snapshot files written by CConfigSnapshotWriter.
+            UINT32 ThreadCount
+              Worker threads, 0 uses one per logical processor.
+
+  Modifies: [m_Hosts, m_Shards, m_FunctionCount].
+
+  Returns:  UserStatus
+              Returns the status of the first file that failed.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigArchiveBuilder::Ingest(const std::vector<std::string>& SnapshotFiles, UINT32 ThreadCount)
+{
+    UserStatus userStatus = Success;
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    size_t first = m_Hosts.size();
+    m_StatusMessage.str("");
+
+    if (ThreadCount == 0) {
+        ThreadCount = std::thread::hardware_concurrency();
+    }
+    if (ThreadCount == 0 || ThreadCount > SnapshotFiles.size()) {
+        ThreadCount = (UINT32)SnapshotFiles.size();
+    }
+
+    m_Hosts.resize(first + SnapshotFiles.size());
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < SnapshotFiles.size(); i = next++)
+        {
+            IngestFile(SnapshotFiles[i], m_Hosts[first + i]);
+        }
+    };
+
+    for (UINT32 i = 1; i < ThreadCount; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    if (ThreadCount > 0) {
+        worker();
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t i = first; i < m_Hosts.size(); i++)
+    {
+        if (m_Hosts[i].m_Status != Success && userStatus == Success) {
+            userStatus = m_Hosts[i].m_Status;
+            m_StatusMessage << m_Hosts[i].m_StatusMessage;
+        }
+        m_FunctionCount += m_Hosts[i].m_Entries.size();
+    }
+
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigArchiveBuilder::Write
+
+  Summary:  Writes the archive. Blob ids are renumbered in hash order so the
+            same snapshots always give the same archive and readers can
+            binary search by hash.
+
+  Args:     const std::string& FileName
+              Archive file to create.
+
+  Modifies: None
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigArchiveBuilder::Write(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    ConfigArchiveHeader header;
+    std::vector<std::pair<Hash128, UINT32>> order;
+    std::vector<UINT32> remap[CONFIG_ARCHIVE_SHARDS];
+    UINT64 dataOffset = 0;
+    m_StatusMessage.str("");
+
+    for (UINT32 s = 0; s < CONFIG_ARCHIVE_SHARDS; s++)
+    {
+        remap[s].resize(m_Shards[s].m_Blobs.size());
+        for (UINT32 i = 0; i < m_Shards[s].m_Blobs.size(); i++)
+        {
+            order.push_back(std::make_pair(m_Shards[s].m_Hashes[i], i * CONFIG_ARCHIVE_SHARDS + s));
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    memset(&header, 0, sizeof(header));
+    header.m_Magic = CONFIG_ARCHIVE_MAGIC;
+    header.m_Version = CONFIG_ARCHIVE_VERSION;
+    header.m_BlobCount = (UINT32)order.size();
+    header.m_HostCount = (UINT32)m_Hosts.size();
+    header.m_EntryCount = m_FunctionCount;
+    header.m_BlobTableOffset = sizeof(header);
+    header.m_HostTableOffset = header.m_BlobTableOffset + order.size() * sizeof(ConfigArchiveBlob);
+    header.m_EntryTableOffset = header.m_HostTableOffset + m_Hosts.size() * sizeof(ConfigArchiveHost);
+    header.m_DataOffset = header.m_EntryTableOffset + m_FunctionCount * sizeof(ConfigArchiveEntry);
+
+    file = CreateFileA(FileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create archive " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    {
+        CArchiveFileWriter writer(file);
+
+        for (UINT32 id = 0; id < order.size(); id++)
+        {
+            UINT32 shard = order[id].second % CONFIG_ARCHIVE_SHARDS;
+            UINT32 local = order[id].second / CONFIG_ARCHIVE_SHARDS;
+            remap[shard][local] = id;
+            header.m_DataSize += m_Shards[shard].m_Blobs[local].size();
+        }
+
+        writer.Append(&header, sizeof(header));
+
+        for (UINT32 id = 0; id < order.size(); id++)
+        {
+            UINT32 shard = order[id].second % CONFIG_ARCHIVE_SHARDS;
+            UINT32 local = order[id].second / CONFIG_ARCHIVE_SHARDS;
+            ConfigArchiveBlob blob;
+            blob.m_HashLow = order[id].first.m_Low;
+            blob.m_HashHigh = order[id].first.m_High;
+            blob.m_Offset = dataOffset;
+            blob.m_Size = (UINT32)m_Shards[shard].m_Blobs[local].size();
+            blob.m_RefCount = m_Shards[shard].m_RefCounts[local];
+            writer.Append(&blob, sizeof(blob));
+            dataOffset += blob.m_Size;
+        }
+
+        UINT64 firstEntry = 0;
+        for (auto& host : m_Hosts)
+        {
+            ConfigArchiveHost entry;
+            memset(&entry, 0, sizeof(entry));
+            host.m_HostName.copy(entry.m_HostName, sizeof(entry.m_HostName) - 1);
+            entry.m_FirstEntry = firstEntry;
+            entry.m_EntryCount = (UINT32)host.m_Entries.size();
+            writer.Append(&entry, sizeof(entry));
+            firstEntry += entry.m_EntryCount;
+        }
+
+        for (auto& host : m_Hosts)
+        {
+            for (auto entry : host.m_Entries)
+            {
+                entry.m_BlobId = remap[entry.m_BlobId % CONFIG_ARCHIVE_SHARDS][entry.m_BlobId / CONFIG_ARCHIVE_SHARDS];
+                writer.Append(&entry, sizeof(entry));
+            }
+        }
+
+        for (UINT32 id = 0; id < order.size(); id++)
+        {
+            const std::vector<UINT8>& data = m_Shards[order[id].second % CONFIG_ARCHIVE_SHARDS].m_Blobs[order[id].second / CONFIG_ARCHIVE_SHARDS];
+            writer.Append(data.data(), data.size());
+        }
+
+        if (!writer.Flush()) {
+            m_StatusMessage << "Unable to write archive " << FileName;
+            userStatus = Failure;
+        }
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    return userStatus;
+}
+
+UINT64 CConfigArchiveBuilder::GetFunctionCount()
+{
+    return m_FunctionCount;
+}
+
+UINT64 CConfigArchiveBuilder::GetBlobCount()
+{
+    UINT64 count = 0;
+    for (UINT32 s = 0; s < CONFIG_ARCHIVE_SHARDS; s++)
+    {
+        count += m_Shards[s].m_Blobs.size();
+    }
+    return count;
+}
+
+std::string CConfigArchiveBuilder::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CConfigArchiveReader::CConfigArchiveReader()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    m_Size = 0;
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Blobs = NULL;
+    m_HostTable = NULL;
+    m_Entries = NULL;
+}
+
+CConfigArchiveReader::~CConfigArchiveReader()
+{
+    Close();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigArchiveReader::Open
+
+  Summary:  Maps an archive read-only and checks that its tables lie inside
+            the file.
+
+  Args:     const std::string& FileName
+              Archive file to read.
+
+  Modifies: [m_File, m_Mapping, m_View, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigArchiveReader::Open(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER FileSize;
+    m_StatusMessage.str("");
+
+    Close();
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &FileSize)) {
+        m_StatusMessage << "Unable to open archive " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    m_Size = (UINT64)FileSize.QuadPart;
+    if (m_Size < sizeof(m_Header)) {
+        m_StatusMessage << "Archive " << FileName << " is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_View = (const UINT8*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_View == NULL) {
+        m_StatusMessage << "Unable to map archive " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    memcpy(&m_Header, m_View, sizeof(m_Header));
+    if (m_Header.m_Magic != CONFIG_ARCHIVE_MAGIC || m_Header.m_Version != CONFIG_ARCHIVE_VERSION) {
+        m_StatusMessage << "Not a configuration space archive, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (m_Header.m_BlobTableOffset + (UINT64)m_Header.m_BlobCount * sizeof(ConfigArchiveBlob) > m_Header.m_HostTableOffset ||
+        m_Header.m_HostTableOffset + (UINT64)m_Header.m_HostCount * sizeof(ConfigArchiveHost) > m_Header.m_EntryTableOffset ||
+        m_Header.m_EntryTableOffset + m_Header.m_EntryCount * sizeof(ConfigArchiveEntry) > m_Header.m_DataOffset ||
+        m_Header.m_DataOffset + m_Header.m_DataSize > m_Size) {
+        m_StatusMessage << "Archive " << FileName << " is truncated";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Blobs = (const ConfigArchiveBlob*)(m_View + m_Header.m_BlobTableOffset);
+    m_HostTable = (const ConfigArchiveHost*)(m_View + m_Header.m_HostTableOffset);
+    m_Entries = (const ConfigArchiveEntry*)(m_View + m_Header.m_EntryTableOffset);
+
+Exit:
+    if (userStatus != Success) {
+        Close();
+    }
+    return userStatus;
+}
+
+const ConfigArchiveHeader& CConfigArchiveReader::GetHeader()
+{
+    return m_Header;
+}
+
+UserStatus CConfigArchiveReader::GetHost(UINT32 HostIndex, const ConfigArchiveHost** ppHost)
+{
+    m_StatusMessage.str("");
+
+    if (m_View == NULL || HostIndex >= m_Header.m_HostCount) {
+        m_StatusMessage << "Host index 0x" << std::hex << HostIndex << " is out of range";
+        return IndexOutOfRange;
+    }
+
+    *ppHost = &m_HostTable[HostIndex];
+    return Success;
+}
+
+UserStatus CConfigArchiveReader::GetEntries(UINT32 HostIndex, const ConfigArchiveEntry** ppEntries, PUINT32 pCount)
+{
+    const ConfigArchiveHost* host = NULL;
+    UserStatus userStatus = GetHost(HostIndex, &host);
+
+    if (userStatus != Success) {
+        return userStatus;
+    }
+
+    if (host->m_FirstEntry + host->m_EntryCount > m_Header.m_EntryCount) {
+        m_StatusMessage << "Manifest of host 0x" << std::hex << HostIndex << " is out of range";
+        return IndexOutOfRange;
+    }
+
+    *ppEntries = &m_Entries[host->m_FirstEntry];
+    *pCount = host->m_EntryCount;
+    return Success;
+}
+
+UserStatus CConfigArchiveReader::GetBlob(UINT32 BlobId, const UINT8** ppData, PUINT32 pSize)
+{
+    m_StatusMessage.str("");
+
+    if (m_View == NULL || BlobId >= m_Header.m_BlobCount ||
+        m_Blobs[BlobId].m_Offset + m_Blobs[BlobId].m_Size > m_Header.m_DataSize) {
+        m_StatusMessage << "Blob id 0x" << std::hex << BlobId << " is out of range";
+        return IndexOutOfRange;
+    }
+
+    *ppData = m_View + m_Header.m_DataOffset + m_Blobs[BlobId].m_Offset;
+    *pSize = m_Blobs[BlobId].m_Size;
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigArchiveReader::FindBlob
+
+  Summary:  Binary searches the blob table, which is sorted by hash. Hash a
+            capture with CHash128::Compute(Data, Size, Size) to look it up.
+
+  Args:     const Hash128& Hash
+              Hash of the capture.
+            PUINT32 pBlobId
+              Receives the blob id.
+
+  Modifies: None
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the capture is not archived.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigArchiveReader::FindBlob(const Hash128& Hash, PUINT32 pBlobId)
+{
+    UINT32 low = 0;
+    UINT32 high = m_Header.m_BlobCount;
+    m_StatusMessage.str("");
+
+    while (m_View != NULL && low < high)
+    {
+        UINT32 middle = low + (high - low) / 2;
+        Hash128 current;
+        current.m_Low = m_Blobs[middle].m_HashLow;
+        current.m_High = m_Blobs[middle].m_HashHigh;
+
+        if (current == Hash) {
+            *pBlobId = middle;
+            return Success;
+        }
+        if (current < Hash) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    m_StatusMessage << "Capture is not in the archive";
+    return IndexOutOfRange;
+}
+
+void CConfigArchiveReader::Close()
+{
+    if (m_View != NULL) {
+        UnmapViewOfFile(m_View);
+        m_View = NULL;
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+        m_Mapping = NULL;
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+    }
+    m_Blobs = NULL;
+    m_HostTable = NULL;
+    m_Entries = NULL;
+}
+
+std::string CConfigArchiveReader::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
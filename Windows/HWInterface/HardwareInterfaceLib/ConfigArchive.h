@@ -0,0 +1,184 @@
+#pragma once
+/*+===================================================================
+  File:      ConfigArchive.h
+
+  Summary:   Content-addressed archive of configuration space snapshots
+             from many hosts.
+
+  Classes:   CConfigArchiveBuilder, CConfigArchiveReader.
+
+  Functions: Ingest, Write, Open, GetHost, GetEntries, GetBlob, FindBlob.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "ConfigSnapshot.h"
+#include "Hash128.h"
+
+#define CONFIG_ARCHIVE_MAGIC        0x52415748      // 'HWAR'
+#define CONFIG_ARCHIVE_VERSION      1
+#define CONFIG_ARCHIVE_SHARDS       64
+
+//
+// An archive is a ConfigArchiveHeader followed by the blob table sorted by
+// hash, the host table, the entry table and the blob data. Every unique
+// capture is stored once, each host has a manifest of ConfigArchiveEntry
+// mapping its functions to blob ids, a blob id indexes the blob table.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT32 m_BlobCount;
+    UINT32 m_HostCount;
+    UINT64 m_EntryCount;
+    UINT64 m_BlobTableOffset;
+    UINT64 m_HostTableOffset;
+    UINT64 m_EntryTableOffset;
+    UINT64 m_DataOffset;
+    UINT64 m_DataSize;
+}ConfigArchiveHeader;
+
+typedef struct
+{
+    UINT64 m_HashLow;
+    UINT64 m_HashHigh;
+    UINT64 m_Offset;
+    UINT32 m_Size;
+    UINT32 m_RefCount;
+}ConfigArchiveBlob;
+
+typedef struct
+{
+    CHAR m_HostName[CONFIG_SNAPSHOT_HOST_LENGTH];
+    UINT64 m_FirstEntry;
+    UINT32 m_EntryCount;
+    UINT32 m_Reserved;
+}ConfigArchiveHost;
+
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT8 m_Reserved;
+    UINT32 m_BlobId;
+}ConfigArchiveEntry;
+#pragma pack(pop)
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CConfigArchiveBuilder
+
+  Summary:  Ingests snapshot files in parallel, deduplicates captures by
+            128-bit hash and writes the archive.
+
+  Methods:  UserStatus Ingest(const std::vector<std::string>& SnapshotFiles, UINT32 ThreadCount)
+              Maps and decodes the snapshots, one file per thread at a time.
+            UserStatus Write(const std::string& FileName)
+              Writes the archive with blob ids ordered by hash.
+            UINT64 GetFunctionCount(), GetBlobCount()
+              Returns the captures ingested and the unique captures.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CConfigArchiveBuilder
+{
+public:
+    CConfigArchiveBuilder();
+    UserStatus Ingest(const std::vector<std::string>& SnapshotFiles, UINT32 ThreadCount);
+    UserStatus Write(const std::string& FileName);
+    UINT64 GetFunctionCount();
+    UINT64 GetBlobCount();
+    std::string GetStatusMessage();
+
+private:
+    //
+    // Blobs are spread over shards by hash so ingest threads rarely share a
+    // lock. While ingesting a blob id is the shard in the low bits and the
+    // index within the shard above them, Write renumbers them.
+    //
+    struct ArchiveShard
+    {
+        std::mutex m_Lock;
+        std::unordered_map<Hash128, UINT32, Hash128Hasher> m_Index;
+        std::vector<Hash128> m_Hashes;
+        std::vector<std::vector<UINT8>> m_Blobs;
+        std::vector<UINT32> m_RefCounts;
+    };
+
+    struct ArchiveHostData
+    {
+        std::string m_HostName;
+        std::vector<ConfigArchiveEntry> m_Entries;
+        UserStatus m_Status;
+        std::string m_StatusMessage;
+    };
+
+    void IngestFile(const std::string& FileName, ArchiveHostData& Host);
+    UINT32 InsertBlob(const UINT8* Data, UINT32 Size);
+
+    ArchiveShard m_Shards[CONFIG_ARCHIVE_SHARDS];
+    std::vector<ArchiveHostData> m_Hosts;
+    UINT64 m_FunctionCount;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CConfigArchiveReader
+
+  Summary:  Reads an archive through a read-only file mapping, blobs and
+            manifests are returned in place.
+
+  Methods:  UserStatus Open(const std::string& FileName)
+              Maps the archive and checks its tables.
+            const ConfigArchiveHeader& GetHeader()
+              Returns the archive header.
+            UserStatus GetHost(UINT32 HostIndex, const ConfigArchiveHost** ppHost)
+              Returns a host of the archive.
+            UserStatus GetEntries(UINT32 HostIndex, const ConfigArchiveEntry** ppEntries, PUINT32 pCount)
+              Returns the manifest of a host.
+            UserStatus GetBlob(UINT32 BlobId, const UINT8** ppData, PUINT32 pSize)
+              Returns a unique capture.
+            UserStatus FindBlob(const Hash128& Hash, PUINT32 pBlobId)
+              Looks a capture up by hash.
+            void Close()
+              Unmaps the archive.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CConfigArchiveReader
+{
+public:
+    CConfigArchiveReader();
+    ~CConfigArchiveReader();
+    UserStatus Open(const std::string& FileName);
+    const ConfigArchiveHeader& GetHeader();
+    UserStatus GetHost(UINT32 HostIndex, const ConfigArchiveHost** ppHost);
+    UserStatus GetEntries(UINT32 HostIndex, const ConfigArchiveEntry** ppEntries, PUINT32 pCount);
+    UserStatus GetBlob(UINT32 BlobId, const UINT8** ppData, PUINT32 pSize);
+    UserStatus FindBlob(const Hash128& Hash, PUINT32 pBlobId);
+    void Close();
+    std::string GetStatusMessage();
+
+private:
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const UINT8* m_View;
+    UINT64 m_Size;
+    ConfigArchiveHeader m_Header;
+    const ConfigArchiveBlob* m_Blobs;
+    const ConfigArchiveHost* m_HostTable;
+    const ConfigArchiveEntry* m_Entries;
+    std::stringstream m_StatusMessage;
+};
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include "ConfigCache.h"
+
+#define CONFIG_CACHE_BDF(b, d, f)       (UINT16)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+
+CConfigCache::CConfigCache(CHardwareInterfaceLib& CHWLib)
+{
+    m_Read = CCapabilityWalker::LibRead;
+    m_Context = &CHWLib;
+    Initialise();
+}
+
+CConfigCache::CConfigCache(PFN_CFG_READ Read, PVOID Context)
+{
+    m_Read = Read;
+    m_Context = Context;
+    Initialise();
+}
+
+void CConfigCache::Initialise()
+{
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    m_Frequency = (UINT64)frequency.QuadPart;
+    SetTtl(CONFIG_CACHE_DEFAULT_TTL);
+    ResetStatistics();
+
+    //
+    // Vendor and device id, revision and class code, header type and the
+    // capabilities pointer are fixed by the hardware.
+    //
+    memset(m_Immutable, 0, sizeof(m_Immutable));
+    SetImmutable(PciVendorId::Offset, PciVendorId::Width + PciDeviceId::Width, true);
+    SetImmutable(PciClassRevision::Offset, PciClassRevision::Width, true);
+    SetImmutable(PciHeaderType::Offset, PciHeaderType::Width, true);
+    SetImmutable(PciCapabilitiesPointer::Offset, PciCapabilitiesPointer::Width, true);
+}
+
+CConfigCache::DeviceCache& CConfigCache::GetDevice(UINT16 Bdf)
+{
+    auto found = m_Devices.find(Bdf);
+    if (found == m_Devices.end()) {
+        found = m_Devices.emplace(Bdf, DeviceCache()).first;
+        found->second.m_Data.resize(PCIe_CFG_SIZE);
+        found->second.m_Fetched.assign(PCIe_CFG_SIZE / sizeof(UINT32), 0);
+    }
+    return found->second;
+}
+
+bool CConfigCache::IsValid(const DeviceCache& Device, UINT32 Offset, UINT32 Size, UINT64 Now)
+{
+    for (UINT32 dword = Offset / sizeof(UINT32); dword <= (Offset + Size - 1) / sizeof(UINT32); dword++)
+    {
+        UINT64 fetched = Device.m_Fetched[dword];
+        UINT32 first = (Offset > dword * sizeof(UINT32)) ? Offset : dword * sizeof(UINT32);
+        UINT32 last = (Offset + Size < (dword + 1) * sizeof(UINT32)) ? Offset + Size : (dword + 1) * sizeof(UINT32);
+
+        if (fetched == 0) {
+            return false;
+        }
+        if (Now - fetched < m_TtlTicks) {
+            continue;
+        }
+        for (UINT32 byte = first; byte < last; byte++)
+        {
+            if ((m_Immutable[byte / 8] & (1 << (byte % 8))) == 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+UserStatus CConfigCache::Read(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UserStatus userStatus = Queue(Bus, Device, Function, Offset, Data, Size);
+
+    if (userStatus == Success) {
+        userStatus = Flush();
+    }
+    return userStatus;
+}
+
+UserStatus CConfigCache::CacheRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    return ((CConfigCache*)Context)->Read(Bus, Device, Function, Offset, Data, Size);
+}
+
+UserStatus CConfigCache::Queue(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    PendingRead pending;
+
+    if (Data == NULL) {
+        m_StatusMessage.str("");
+        m_StatusMessage << "Data is NULL";
+        return NullPointer;
+    }
+    if (Size == 0 || Offset >= PCIe_CFG_SIZE || Size > PCIe_CFG_SIZE - Offset) {
+        m_StatusMessage.str("");
+        m_StatusMessage << "Read of 0x" << std::hex << Size << " bytes at 0x" << Offset << " is outside the configuration space";
+        return IndexOutOfRange;
+    }
+
+    pending.m_Bdf = CONFIG_CACHE_BDF(Bus, Device, Function);
+    pending.m_Offset = (UINT16)Offset;
+    pending.m_Size = (UINT16)Size;
+    pending.m_Data = Data;
+    m_Pending.push_back(pending);
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigCache::Flush
+
+  Summary:  Serves the queued reads. Reads whose bytes are all valid are
+            hits, the others add their range widened to CONFIG_CACHE_LINE
+            to a fetch list, split at the 256 byte boundary if it crosses
+            it. The list is sorted per function and ranges at most
+            CONFIG_CACHE_MERGE_GAP apart are merged, except across the
+            boundary so that standard reads never depend on the extended
+            configuration space. Each merged range is one transfer, then
+            every queued read is copied from the cache.
+
+  Args:     None.
+
+  Modifies: [m_Devices, m_Pending, m_Statistics].
+
+  Returns:  UserStatus
+              Returns the first failure, reads of a failed range are left
+              untouched and the rest are served.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigCache::Flush()
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER counter;
+    UINT64 now = 0;
+    size_t merged = 0;
+    m_StatusMessage.str("");
+
+    QueryPerformanceCounter(&counter);
+    now = (UINT64)counter.QuadPart;
+
+    m_Fetches.clear();
+    for (auto& pending : m_Pending)
+    {
+        DeviceCache& device = GetDevice(pending.m_Bdf);
+
+        m_Statistics.m_Requests++;
+        if (IsValid(device, pending.m_Offset, pending.m_Size, now)) {
+            m_Statistics.m_Hits++;
+            continue;
+        }
+
+        FetchRange range;
+        range.m_Bdf = pending.m_Bdf;
+        range.m_Start = (UINT16)(pending.m_Offset & ~(CONFIG_CACHE_LINE - 1));
+        range.m_End = (UINT16)((pending.m_Offset + pending.m_Size + CONFIG_CACHE_LINE - 1) & ~(CONFIG_CACHE_LINE - 1));
+
+        //
+        // A read across 0x100 is fetched as a standard and an extended
+        // range, the standard bytes never go through the extended path.
+        //
+        if (range.m_Start < PCI_CFG_SIZE && range.m_End > PCI_CFG_SIZE) {
+            FetchRange extended = range;
+            extended.m_Start = PCI_CFG_SIZE;
+            m_Fetches.push_back(extended);
+            range.m_End = PCI_CFG_SIZE;
+        }
+        m_Fetches.push_back(range);
+        m_Statistics.m_Misses++;
+    }
+
+    std::sort(m_Fetches.begin(), m_Fetches.end(), [](const FetchRange& Left, const FetchRange& Right) {
+        return (Left.m_Bdf != Right.m_Bdf) ? (Left.m_Bdf < Right.m_Bdf) : (Left.m_Start < Right.m_Start);
+    });
+
+    for (size_t i = 1; i < m_Fetches.size(); i++)
+    {
+        FetchRange& last = m_Fetches[merged];
+        const FetchRange& next = m_Fetches[i];
+
+        if (next.m_Bdf == last.m_Bdf && next.m_Start <= last.m_End + CONFIG_CACHE_MERGE_GAP &&
+            !(last.m_End <= PCI_CFG_SIZE && next.m_End > PCI_CFG_SIZE)) {
+            if (next.m_End > last.m_End) {
+                last.m_End = next.m_End;
+            }
+        }
+        else {
+            m_Fetches[++merged] = next;
+        }
+    }
+    if (!m_Fetches.empty()) {
+        m_Fetches.resize(merged + 1);
+    }
+
+    for (auto& range : m_Fetches)
+    {
+        DeviceCache& device = GetDevice(range.m_Bdf);
+        UINT64 fetched = now;
+        UserStatus readStatus = m_Read(m_Context, (UINT8)(range.m_Bdf >> 8), (UINT8)((range.m_Bdf >> 3) & 0x1F), (UINT8)(range.m_Bdf & 0x07),
+            range.m_Start, device.m_Data.data() + range.m_Start, range.m_End - range.m_Start);
+
+        m_Statistics.m_Transfers++;
+        m_Statistics.m_BytesTransferred += range.m_End - range.m_Start;
+        if (readStatus != Success) {
+            if (userStatus == Success) {
+                userStatus = readStatus;
+                m_StatusMessage << "Configuration read failed for Bus: 0x" << std::hex << (range.m_Bdf >> 8) << ", Device: 0x"
+                    << ((range.m_Bdf >> 3) & 0x1F) << ", Function: 0x" << (range.m_Bdf & 0x07) << ", Offset: 0x" << range.m_Start
+                    << ", Size: 0x" << range.m_End - range.m_Start;
+            }
+            fetched = 0;
+        }
+        for (UINT32 dword = range.m_Start / sizeof(UINT32); dword < range.m_End / sizeof(UINT32); dword++)
+        {
+            device.m_Fetched[dword] = fetched;
+        }
+    }
+
+    //
+    // Every byte of a served read was valid or has just been fetched, even
+    // with a TTL of 0.
+    //
+    for (auto& pending : m_Pending)
+    {
+        DeviceCache& device = GetDevice(pending.m_Bdf);
+        bool fetched = true;
+
+        for (UINT32 dword = pending.m_Offset / sizeof(UINT32); dword <= (pending.m_Offset + pending.m_Size - 1u) / sizeof(UINT32); dword++)
+        {
+            fetched = fetched && (device.m_Fetched[dword] != 0);
+        }
+        if (fetched) {
+            memcpy(pending.m_Data, device.m_Data.data() + pending.m_Offset, pending.m_Size);
+        }
+    }
+
+    m_Pending.clear();
+    return userStatus;
+}
+
+void CConfigCache::SetTtl(UINT32 Milliseconds)
+{
+    m_TtlTicks = m_Frequency * Milliseconds / 1000;
+}
+
+void CConfigCache::SetImmutable(UINT32 Offset, UINT32 Size, bool Immutable)
+{
+    for (UINT32 byte = Offset; byte < Offset + Size && byte < PCIe_CFG_SIZE; byte++)
+    {
+        if (Immutable) {
+            m_Immutable[byte / 8] |= (UINT8)(1 << (byte % 8));
+        }
+        else {
+            m_Immutable[byte / 8] &= (UINT8)~(1 << (byte % 8));
+        }
+    }
+}
+
+void CConfigCache::Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    m_Devices.erase(CONFIG_CACHE_BDF(Bus, Device, Function));
+}
+
+void CConfigCache::InvalidateRange(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Size)
+{
+    auto found = m_Devices.find(CONFIG_CACHE_BDF(Bus, Device, Function));
+
+    if (found == m_Devices.end() || Size == 0 || Offset >= PCIe_CFG_SIZE) {
+        return;
+    }
+    if (Size > PCIe_CFG_SIZE - Offset) {
+        Size = PCIe_CFG_SIZE - Offset;
+    }
+    for (UINT32 dword = Offset / sizeof(UINT32); dword <= (Offset + Size - 1) / sizeof(UINT32); dword++)
+    {
+        found->second.m_Fetched[dword] = 0;
+    }
+}
+
+void CConfigCache::InvalidateAll()
+{
+    m_Devices.clear();
+}
+
+const ConfigCacheStatistics& CConfigCache::GetStatistics()
+{
+    return m_Statistics;
+}
+
+void CConfigCache::ResetStatistics()
+{
+    memset(&m_Statistics, 0, sizeof(m_Statistics));
+}
+
+std::string CConfigCache::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
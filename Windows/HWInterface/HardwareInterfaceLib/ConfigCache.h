@@ -0,0 +1,139 @@
+#pragma once
+/*+===================================================================
+  File:      ConfigCache.h
+
+  Summary:   Caching layer over configuration space reads that keeps
+             immutable fields for good, expires the others after a TTL
+             and merges queued small reads into fewer transfers.
+
+  Classes:   CConfigCache.
+
+  Functions: Read, Queue, Flush, CacheRead, SetTtl, SetImmutable,
+             Invalidate, InvalidateRange, InvalidateAll, GetStatistics.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "CapabilityWalker.h"
+
+//
+// Misses are widened to whole lines, and merged ranges of one function at
+// most CONFIG_CACHE_MERGE_GAP bytes apart are fetched in one transfer.
+//
+#define CONFIG_CACHE_LINE               64
+#define CONFIG_CACHE_MERGE_GAP          64
+#define CONFIG_CACHE_DEFAULT_TTL        100
+
+typedef struct
+{
+    UINT64 m_Requests;
+    UINT64 m_Hits;
+    UINT64 m_Misses;
+    UINT64 m_Transfers;
+    UINT64 m_BytesTransferred;
+}ConfigCacheStatistics;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CConfigCache
+
+  Summary:  Keeps a lazily allocated 4 KB image per function with the time
+            every dword was fetched. Bytes marked immutable, by default
+            the ids, revision, class code, header type and capabilities
+            pointer, stay valid once fetched, all other bytes for the TTL.
+            Reads are queued and served by Flush: requests hitting the
+            cache are copied, misses are widened to lines, sorted, merged
+            with neighbouring misses of the same function and fetched
+            with one read per merged range. Read is Queue plus Flush, and
+            CacheRead lets CCapabilityWalker and the scanners read through
+            the cache. Writes do not go through the cache, callers
+            invalidate what they write.
+
+  Methods:  CConfigCache(CHardwareInterfaceLib& CHWLib)
+              Reads through the driver.
+            CConfigCache(PFN_CFG_READ Read, PVOID Context)
+              Reads through any other backend.
+            UserStatus Read(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Reads through the cache now.
+            UserStatus Queue(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Queues a read, Data is filled by the next Flush.
+            UserStatus Flush()
+              Serves all queued reads.
+            static UserStatus CacheRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              PFN_CFG_READ reading through the CConfigCache in Context.
+            void SetTtl(UINT32 Milliseconds)
+              Sets how long mutable bytes stay valid, 0 disables caching them.
+            void SetImmutable(UINT32 Offset, UINT32 Size, bool Immutable)
+              Marks bytes of every function as immutable or mutable.
+            void Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function), InvalidateRange(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Size), InvalidateAll()
+              Drop cached bytes, e.g. after a write or a reset.
+            const ConfigCacheStatistics& GetStatistics(), void ResetStatistics()
+              Return or clear the hit and transfer counters.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CConfigCache
+{
+public:
+    CConfigCache(CHardwareInterfaceLib& CHWLib);
+    CConfigCache(PFN_CFG_READ Read, PVOID Context);
+    UserStatus Read(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus Queue(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus Flush();
+    static UserStatus CacheRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    void SetTtl(UINT32 Milliseconds);
+    void SetImmutable(UINT32 Offset, UINT32 Size, bool Immutable);
+    void Invalidate(UINT8 Bus, UINT8 Device, UINT8 Function);
+    void InvalidateRange(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Size);
+    void InvalidateAll();
+    const ConfigCacheStatistics& GetStatistics();
+    void ResetStatistics();
+    std::string GetStatusMessage();
+
+private:
+    //
+    // m_Fetched holds the counter value at which each dword was fetched, 0
+    // for a dword never fetched or invalidated.
+    //
+    struct DeviceCache
+    {
+        std::vector<UINT8> m_Data;
+        std::vector<UINT64> m_Fetched;
+    };
+
+    struct PendingRead
+    {
+        UINT16 m_Bdf;
+        UINT16 m_Offset;
+        UINT16 m_Size;
+        PUINT8 m_Data;
+    };
+
+    struct FetchRange
+    {
+        UINT16 m_Bdf;
+        UINT16 m_Start;
+        UINT16 m_End;
+    };
+
+    void Initialise();
+    DeviceCache& GetDevice(UINT16 Bdf);
+    bool IsValid(const DeviceCache& Device, UINT32 Offset, UINT32 Size, UINT64 Now);
+
+    PFN_CFG_READ m_Read;
+    PVOID m_Context;
+    std::unordered_map<UINT16, DeviceCache> m_Devices;
+    std::vector<PendingRead> m_Pending;
+    std::vector<FetchRange> m_Fetches;
+    UINT8 m_Immutable[PCIe_CFG_SIZE / 8];
+    UINT64 m_TtlTicks;
+    UINT64 m_Frequency;
+    ConfigCacheStatistics m_Statistics;
+    std::stringstream m_StatusMessage;
+};
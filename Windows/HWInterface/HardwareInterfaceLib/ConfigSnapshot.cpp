@@ -0,0 +1,399 @@
+#include "ConfigSnapshot.h"
+#include "CfgSpaceCodec.h"
+
+CConfigSnapshotWriter::CConfigSnapshotWriter()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_RawBytes = 0;
+    m_EncodedBytes = 0;
+}
+
+CConfigSnapshotWriter::~CConfigSnapshotWriter()
+{
+    if (m_File != INVALID_HANDLE_VALUE) {
+        Close();
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotWriter::Create
+
+  Summary:  Creates the snapshot file and writes a placeholder header.
+
+  Args:     const std::string& FileName
+              Snapshot file to create.
+            const std::string& HostName
+              Host the captures are taken on.
+
+  Modifies: [m_File, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotWriter::Create(const std::string& FileName, const std::string& HostName)
+{
+    UserStatus userStatus = Success;
+    DWORD BytesWritten = 0;
+    m_StatusMessage.str("");
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create snapshot " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Header.m_Magic = CONFIG_SNAPSHOT_MAGIC;
+    m_Header.m_Version = CONFIG_SNAPSHOT_VERSION;
+    HostName.copy(m_Header.m_HostName, sizeof(m_Header.m_HostName) - 1);
+    m_References.clear();
+    m_RawBytes = 0;
+    m_EncodedBytes = sizeof(m_Header);
+
+    if (!WriteFile(m_File, &m_Header, sizeof(m_Header), &BytesWritten, NULL)) {
+        m_StatusMessage << "Unable to write snapshot header to " << FileName;
+        userStatus = Failure;
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotWriter::Append
+
+  Summary:  Encodes one capture against the previous capture of the same
+            vendor and device and appends it to the snapshot.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Location of the captured function.
+            const UINT8* Data
+              Configuration space capture starting at offset 0.
+            UINT32 Size
+              Capture size in bytes, a multiple of 4 up to PCIe_CFG_SIZE.
+
+  Modifies: [m_References, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotWriter::Append(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size)
+{
+    UserStatus userStatus = Success;
+    DWORD BytesWritten = 0;
+    ConfigSnapshotRecord record;
+    UINT32 id = 0;
+    const UINT8* reference = NULL;
+    m_StatusMessage.str("");
+
+    if (m_File == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Snapshot file is not open";
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    //
+    // Readers refuse records larger than the extended configuration space.
+    //
+    if (Data == NULL || Size < sizeof(UINT32) || Size % sizeof(UINT32) || Size > PCIe_CFG_SIZE) {
+        m_StatusMessage << "Capture size 0x" << std::hex << Size << " is not a multiple of 4 bytes up to 0x" << std::hex << PCIe_CFG_SIZE;
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    memcpy(&id, Data, sizeof(id));
+
+    record.m_Bus = Bus;
+    record.m_Device = Device;
+    record.m_Function = Function;
+    record.m_Reserved = 0;
+    record.m_VendorId = (UINT16)(id & 0xFFFF);
+    record.m_DeviceId = (UINT16)(id >> 16);
+    record.m_RawSize = Size;
+    record.m_ReferenceIndex = CONFIG_SNAPSHOT_NO_REFERENCE;
+
+    {
+        auto found = m_References.find(id);
+        if (found != m_References.end() && found->second.second.size() == Size) {
+            record.m_ReferenceIndex = found->second.first;
+            reference = found->second.second.data();
+        }
+    }
+
+    m_Encoded.resize(CCfgSpaceCodec::MaxEncodedSize(Size));
+    record.m_EncodedSize = CCfgSpaceCodec::Encode(Data, Size, reference, m_Encoded.data());
+
+    if (!WriteFile(m_File, &record, sizeof(record), &BytesWritten, NULL) ||
+        !WriteFile(m_File, m_Encoded.data(), record.m_EncodedSize, &BytesWritten, NULL)) {
+        m_StatusMessage << "Unable to write snapshot record for Bus: 0x" << std::hex << +Bus << ", Device: 0x" << std::hex << +Device
+            << ", Function: 0x" << std::hex << +Function;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    m_References[id] = std::make_pair(m_Header.m_RecordCount, std::vector<UINT8>(Data, Data + Size));
+    m_Header.m_RecordCount++;
+    m_RawBytes += Size;
+    m_EncodedBytes += sizeof(record) + record.m_EncodedSize;
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotWriter::Close
+
+  Summary:  Writes the final record count to the header and closes the file.
+
+  Args:     None
+
+  Modifies: [m_File].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotWriter::Close()
+{
+    UserStatus userStatus = Success;
+    DWORD BytesWritten = 0;
+    LARGE_INTEGER start;
+    m_StatusMessage.str("");
+
+    if (m_File == INVALID_HANDLE_VALUE) {
+        goto Exit;
+    }
+
+    start.QuadPart = 0;
+    if (!SetFilePointerEx(m_File, start, NULL, FILE_BEGIN) ||
+        !WriteFile(m_File, &m_Header, sizeof(m_Header), &BytesWritten, NULL)) {
+        m_StatusMessage << "Unable to update snapshot header";
+        userStatus = Failure;
+    }
+
+    CloseHandle(m_File);
+    m_File = INVALID_HANDLE_VALUE;
+    m_References.clear();
+
+Exit:
+    return userStatus;
+}
+
+UINT64 CConfigSnapshotWriter::GetRawBytes()
+{
+    return m_RawBytes;
+}
+
+UINT64 CConfigSnapshotWriter::GetEncodedBytes()
+{
+    return m_EncodedBytes;
+}
+
+std::string CConfigSnapshotWriter::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CConfigSnapshotReader::CConfigSnapshotReader()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    m_Data = NULL;
+    m_Size = 0;
+    m_Position = 0;
+    m_RecordIndex = 0;
+    memset(&m_Header, 0, sizeof(m_Header));
+}
+
+CConfigSnapshotReader::~CConfigSnapshotReader()
+{
+    Close();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotReader::Open
+
+  Summary:  Maps a snapshot file read-only and checks its header.
+
+  Args:     const std::string& FileName
+              Snapshot file to read.
+
+  Modifies: [m_File, m_Mapping, m_View].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotReader::Open(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER FileSize;
+    m_StatusMessage.str("");
+
+    Close();
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &FileSize)) {
+        m_StatusMessage << "Unable to open snapshot " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_View = (const UINT8*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_View == NULL) {
+        m_StatusMessage << "Unable to map snapshot " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    userStatus = Attach(m_View, (UINT64)FileSize.QuadPart);
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotReader::Attach
+
+  Summary:  Reads a snapshot that is already in memory, the memory must
+            stay valid while records are read.
+
+  Args:     const UINT8* Data
+              Snapshot contents.
+            UINT64 Size
+              Snapshot size in bytes.
+
+  Modifies: [m_Data, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotReader::Attach(const UINT8* Data, UINT64 Size)
+{
+    UserStatus userStatus = Success;
+    m_StatusMessage.str("");
+
+    m_Data = Data;
+    m_Size = Size;
+    m_Position = sizeof(m_Header);
+    m_RecordIndex = 0;
+    m_References.clear();
+
+    if (Data == NULL || Size < sizeof(m_Header)) {
+        m_StatusMessage << "Snapshot is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    memcpy(&m_Header, Data, sizeof(m_Header));
+    m_Header.m_HostName[sizeof(m_Header.m_HostName) - 1] = '\0';
+    if (m_Header.m_Magic != CONFIG_SNAPSHOT_MAGIC || m_Header.m_Version != CONFIG_SNAPSHOT_VERSION) {
+        m_StatusMessage << "Not a configuration space snapshot, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+    }
+
+Exit:
+    return userStatus;
+}
+
+const ConfigSnapshotHeader& CConfigSnapshotReader::GetHeader()
+{
+    return m_Header;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CConfigSnapshotReader::ReadRecord
+
+  Summary:  Decodes the next record of the snapshot.
+
+  Args:     ConfigSnapshotRecord& Record
+              Receives the record header.
+            std::vector<UINT8>& Data
+              Receives the decoded capture.
+
+  Modifies: [m_Position, m_References].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange after the last record or if the
+              record is truncated.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CConfigSnapshotReader::ReadRecord(ConfigSnapshotRecord& Record, std::vector<UINT8>& Data)
+{
+    UserStatus userStatus = Success;
+    const UINT8* reference = NULL;
+    UINT32 id = 0;
+    m_StatusMessage.str("");
+
+    if (m_RecordIndex >= m_Header.m_RecordCount || m_Position + sizeof(Record) > m_Size) {
+        m_StatusMessage << "No more records in snapshot";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    memcpy(&Record, m_Data + m_Position, sizeof(Record));
+    m_Position += sizeof(Record);
+
+    if (m_Position + Record.m_EncodedSize > m_Size || Record.m_RawSize > PCIe_CFG_SIZE) {
+        m_StatusMessage << "Snapshot record 0x" << std::hex << m_RecordIndex << " is truncated";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    //
+    // The writer only ever references the latest record of the same vendor
+    // and device, so only that record has to be kept.
+    //
+    id = ((UINT32)Record.m_DeviceId << 16) | Record.m_VendorId;
+    if (Record.m_ReferenceIndex != CONFIG_SNAPSHOT_NO_REFERENCE) {
+        auto found = m_References.find(id);
+        if (found == m_References.end() || found->second.first != Record.m_ReferenceIndex ||
+            found->second.second.size() != Record.m_RawSize) {
+            m_StatusMessage << "Snapshot record 0x" << std::hex << m_RecordIndex << " has an invalid reference";
+            userStatus = Failure;
+            goto Exit;
+        }
+        reference = found->second.second.data();
+    }
+
+    Data.resize(Record.m_RawSize);
+    userStatus = CCfgSpaceCodec::Decode(m_Data + m_Position, Record.m_EncodedSize, reference, Data.data(), Record.m_RawSize);
+    if (userStatus != Success) {
+        m_StatusMessage << "Snapshot record 0x" << std::hex << m_RecordIndex << " does not decode";
+        goto Exit;
+    }
+
+    m_Position += Record.m_EncodedSize;
+    m_References[id] = std::make_pair(m_RecordIndex, Data);
+    m_RecordIndex++;
+
+Exit:
+    return userStatus;
+}
+
+void CConfigSnapshotReader::Close()
+{
+    if (m_View != NULL) {
+        UnmapViewOfFile(m_View);
+        m_View = NULL;
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+        m_Mapping = NULL;
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+    }
+    m_Data = NULL;
+    m_Size = 0;
+    m_References.clear();
+}
+
+std::string CConfigSnapshotReader::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,139 @@
+#pragma once
+/*+===================================================================
+  File:      ConfigSnapshot.h
+
+  Summary:   Writes and reads configuration space snapshot files.
+
+  Classes:   CConfigSnapshotWriter, CConfigSnapshotReader.
+
+  Functions: Create, Append, Close, Open, ReadRecord.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <map>
+#include <string>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+#define CONFIG_SNAPSHOT_MAGIC       0x53535748      // 'HWSS'
+#define CONFIG_SNAPSHOT_VERSION     1
+#define CONFIG_SNAPSHOT_NO_REFERENCE 0xFFFFFFFF
+#define CONFIG_SNAPSHOT_HOST_LENGTH 64
+
+//
+// A snapshot file is a ConfigSnapshotHeader followed by m_RecordCount
+// records. Each record is a ConfigSnapshotRecord followed by m_EncodedSize
+// bytes of CCfgSpaceCodec data. A record is encoded against the previous
+// record of the same vendor and device, m_ReferenceIndex names it.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT32 m_RecordCount;
+    UINT32 m_Reserved;
+    CHAR m_HostName[CONFIG_SNAPSHOT_HOST_LENGTH];
+}ConfigSnapshotHeader;
+
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT8 m_Reserved;
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT32 m_RawSize;
+    UINT32 m_ReferenceIndex;
+    UINT32 m_EncodedSize;
+}ConfigSnapshotRecord;
+#pragma pack(pop)
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CConfigSnapshotWriter
+
+  Summary:  Encodes captures with CCfgSpaceCodec and writes them to a
+            snapshot file.
+
+  Methods:  UserStatus Create(const std::string& FileName, const std::string& HostName)
+              Creates the snapshot file.
+            UserStatus Append(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size)
+              Encodes one capture and appends it.
+            UserStatus Close()
+              Writes the record count and closes the file.
+            UINT64 GetRawBytes(), GetEncodedBytes()
+              Returns the bytes appended and the bytes written so far.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CConfigSnapshotWriter
+{
+public:
+    CConfigSnapshotWriter();
+    ~CConfigSnapshotWriter();
+    UserStatus Create(const std::string& FileName, const std::string& HostName);
+    UserStatus Append(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size);
+    UserStatus Close();
+    UINT64 GetRawBytes();
+    UINT64 GetEncodedBytes();
+    std::string GetStatusMessage();
+
+private:
+    HANDLE m_File;
+    ConfigSnapshotHeader m_Header;
+    std::vector<UINT8> m_Encoded;
+    std::map<UINT32, std::pair<UINT32, std::vector<UINT8>>> m_References;
+    UINT64 m_RawBytes;
+    UINT64 m_EncodedBytes;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CConfigSnapshotReader
+
+  Summary:  Reads a snapshot file through a read-only file mapping.
+
+  Methods:  UserStatus Open(const std::string& FileName)
+              Maps the snapshot file and checks its header.
+            UserStatus Attach(const UINT8* Data, UINT64 Size)
+              Reads a snapshot that is already in memory.
+            const ConfigSnapshotHeader& GetHeader()
+              Returns the snapshot header.
+            UserStatus ReadRecord(ConfigSnapshotRecord& Record, std::vector<UINT8>& Data)
+              Decodes the next record, records are read in file order.
+            void Close()
+              Unmaps the snapshot file.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CConfigSnapshotReader
+{
+public:
+    CConfigSnapshotReader();
+    ~CConfigSnapshotReader();
+    UserStatus Open(const std::string& FileName);
+    UserStatus Attach(const UINT8* Data, UINT64 Size);
+    const ConfigSnapshotHeader& GetHeader();
+    UserStatus ReadRecord(ConfigSnapshotRecord& Record, std::vector<UINT8>& Data);
+    void Close();
+    std::string GetStatusMessage();
+
+private:
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const UINT8* m_View;
+    const UINT8* m_Data;
+    UINT64 m_Size;
+    UINT64 m_Position;
+    UINT32 m_RecordIndex;
+    ConfigSnapshotHeader m_Header;
+    std::map<UINT32, std::pair<UINT32, std::vector<UINT8>>> m_References;
+    std::stringstream m_StatusMessage;
+};
@@ -0,0 +1,100 @@
+#include "DeviceRegistry.h"
+
+UINT32 CDeviceRegistry::AddName(const std::string& Name)
+{
+    auto found = m_NameIndex.find(Name);
+    if (found != m_NameIndex.end()) {
+        return found->second;
+    }
+
+    UINT32 offset = (UINT32)m_Names.size();
+    m_Names.insert(m_Names.end(), Name.begin(), Name.end());
+    m_Names.push_back('\0');
+    m_NameIndex[Name] = offset;
+    return offset;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CDeviceRegistry::Add
+
+  Summary:  Appends a function to every column, or updates it in place if
+            its BDF is already registered.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Location of the function.
+            UINT16 VendorId, UINT16 DeviceId
+              Ids at offset 0x00 of the configuration space.
+            UINT32 ClassCode
+              24-bit class code at offset 0x09.
+            const std::string& Name
+              Display name.
+
+  Modifies: [columns, m_Names, m_BdfIndex].
+
+  Returns:  UINT32
+              Returns the index of the function.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CDeviceRegistry::Add(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 VendorId, UINT16 DeviceId, UINT32 ClassCode, const std::string& Name)
+{
+    UINT16 bdf = DEVICE_REGISTRY_BDF(Bus, Device, Function);
+    UINT32 index;
+
+    if (m_BdfIndex.empty()) {
+        m_BdfIndex.assign(DEVICE_REGISTRY_BDF_COUNT, DEVICE_REGISTRY_INVALID_INDEX);
+    }
+
+    index = m_BdfIndex[bdf];
+    if (index == DEVICE_REGISTRY_INVALID_INDEX) {
+        index = (UINT32)m_Bdf.size();
+        m_Bdf.push_back(bdf);
+        m_VendorId.push_back(0);
+        m_DeviceId.push_back(0);
+        m_ClassCode.push_back(0);
+        m_Name.push_back(0);
+        m_BdfIndex[bdf] = index;
+    }
+
+    m_VendorId[index] = VendorId;
+    m_DeviceId[index] = DeviceId;
+    m_ClassCode[index] = ClassCode & 0xFFFFFF;
+    m_Name[index] = AddName(Name);
+    return index;
+}
+
+UINT32 CDeviceRegistry::Find(UINT8 Bus, UINT8 Device, UINT8 Function) const
+{
+    if (m_BdfIndex.empty()) {
+        return DEVICE_REGISTRY_INVALID_INDEX;
+    }
+    return m_BdfIndex[DEVICE_REGISTRY_BDF(Bus, Device, Function)];
+}
+
+SIZE_T CDeviceRegistry::GetMemoryUsage() const
+{
+    SIZE_T usage = 0;
+
+    usage += m_Bdf.capacity() * sizeof(UINT16);
+    usage += m_VendorId.capacity() * sizeof(UINT16);
+    usage += m_DeviceId.capacity() * sizeof(UINT16);
+    usage += m_ClassCode.capacity() * sizeof(UINT32);
+    usage += m_Name.capacity() * sizeof(UINT32);
+    usage += m_Names.capacity();
+    usage += m_BdfIndex.capacity() * sizeof(UINT32);
+    for (auto& name : m_NameIndex)
+    {
+        usage += sizeof(name) + name.first.capacity();
+    }
+    return usage;
+}
+
+void CDeviceRegistry::Clear()
+{
+    m_Bdf.clear();
+    m_VendorId.clear();
+    m_DeviceId.clear();
+    m_ClassCode.clear();
+    m_Name.clear();
+    m_Names.clear();
+    m_NameIndex.clear();
+    m_BdfIndex.clear();
+}
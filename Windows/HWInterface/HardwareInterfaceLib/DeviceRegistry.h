@@ -0,0 +1,125 @@
+#pragma once
+/*+===================================================================
+  File:      DeviceRegistry.h
+
+  Summary:   Column store of the enumerated PCI/PCIe functions.
+
+  Classes:   CDeviceRegistry.
+
+  Functions: Add, Find, GetBus, GetDevice, GetFunction, GetVendorId,
+             GetDeviceId, GetClassCode, GetName.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+#define DEVICE_REGISTRY_INVALID_INDEX   0xFFFFFFFF
+#define DEVICE_REGISTRY_BDF(b, d, f)    (UINT16)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+#define DEVICE_REGISTRY_BDF_COUNT       0x10000
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CDeviceRegistry
+
+  Summary:  Keeps one array per attribute instead of one record per
+            function, so a loop over BDFs or ids touches only that column.
+            Names are interned, functions of the same model share one
+            copy. Indices are stable, a function added twice keeps its
+            index, and a BDF maps to its index through a direct table.
+            The registry owns its storage and can be moved but not copied.
+
+  Methods:  UINT32 Add(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 VendorId, UINT16 DeviceId, UINT32 ClassCode, const std::string& Name)
+              Adds or updates a function and returns its index.
+            UINT32 Find(UINT8 Bus, UINT8 Device, UINT8 Function) const
+              Returns the index of a function or DEVICE_REGISTRY_INVALID_INDEX.
+            UINT32 GetCount() const
+              Returns the number of functions.
+            UINT16 GetBdf(UINT32 Index) const, UINT8 GetBus/GetDevice/GetFunction(UINT32 Index) const
+              Return the location of a function.
+            UINT16 GetVendorId/GetDeviceId(UINT32 Index) const, UINT32 GetClassCode(UINT32 Index) const
+              Return the ids of a function.
+            const char* GetName(UINT32 Index) const
+              Returns the name of a function.
+            SIZE_T GetMemoryUsage() const
+              Returns the bytes held by the columns, names and lookup table.
+            void Clear()
+              Removes all functions.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CDeviceRegistry
+{
+public:
+    CDeviceRegistry() = default;
+    CDeviceRegistry(CDeviceRegistry&& Other) = default;
+    CDeviceRegistry& operator=(CDeviceRegistry&& Other) = default;
+    CDeviceRegistry(const CDeviceRegistry&) = delete;
+    CDeviceRegistry& operator=(const CDeviceRegistry&) = delete;
+
+    UINT32 Add(UINT8 Bus, UINT8 Device, UINT8 Function, UINT16 VendorId, UINT16 DeviceId, UINT32 ClassCode, const std::string& Name);
+    UINT32 Find(UINT8 Bus, UINT8 Device, UINT8 Function) const;
+    SIZE_T GetMemoryUsage() const;
+    void Clear();
+
+    UINT32 GetCount() const
+    {
+        return (UINT32)m_Bdf.size();
+    }
+
+    UINT16 GetBdf(UINT32 Index) const
+    {
+        return m_Bdf[Index];
+    }
+
+    UINT8 GetBus(UINT32 Index) const
+    {
+        return (UINT8)(m_Bdf[Index] >> 8);
+    }
+
+    UINT8 GetDevice(UINT32 Index) const
+    {
+        return (UINT8)((m_Bdf[Index] >> 3) & 0x1F);
+    }
+
+    UINT8 GetFunction(UINT32 Index) const
+    {
+        return (UINT8)(m_Bdf[Index] & 0x07);
+    }
+
+    UINT16 GetVendorId(UINT32 Index) const
+    {
+        return m_VendorId[Index];
+    }
+
+    UINT16 GetDeviceId(UINT32 Index) const
+    {
+        return m_DeviceId[Index];
+    }
+
+    UINT32 GetClassCode(UINT32 Index) const
+    {
+        return m_ClassCode[Index];
+    }
+
+    const char* GetName(UINT32 Index) const
+    {
+        return m_Names.data() + m_Name[Index];
+    }
+
+private:
+    UINT32 AddName(const std::string& Name);
+
+    std::vector<UINT16> m_Bdf;
+    std::vector<UINT16> m_VendorId;
+    std::vector<UINT16> m_DeviceId;
+    std::vector<UINT32> m_ClassCode;
+    std::vector<UINT32> m_Name;
+    std::vector<CHAR> m_Names;
+    std::unordered_map<std::string, UINT32> m_NameIndex;
+    std::vector<UINT32> m_BdfIndex;
+};
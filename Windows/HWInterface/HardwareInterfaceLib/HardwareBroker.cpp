@@ -0,0 +1,637 @@
+#include "HardwareBroker.h"
+
+CHardwareBroker::CHardwareBroker(CHardwareInterfaceLib& CHWLib)
+    : m_CHWLib(CHWLib), m_Cache(CHWLib)
+{
+    m_StopEvent = NULL;
+    m_ActiveConnections = 0;
+    m_Running = false;
+    m_StopBackend = false;
+    memset(&m_Statistics, 0, sizeof(m_Statistics));
+}
+
+CHardwareBroker::~CHardwareBroker()
+{
+    Stop();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareBroker::Start
+
+  Summary:  Creates the first instance of the pipe, which fails if another
+            broker already serves the name, and starts the backend and
+            listener threads. Local clients only, the pipe rejects remote
+            ones.
+
+  Args:     const char* PipeName
+              Name of the pipe, HW_BROKER_PIPE_NAME by default.
+            UINT32 TtlMs
+              How long configuration reads are served from the cache, 0
+              serves every read from the device except immutable fields.
+
+  Modifies: [m_Cache, m_StopEvent, m_Listener, m_Backend, m_Running].
+
+  Returns:  UserStatus
+              InvalidHandle if the pipe cannot be created.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareBroker::Start(const char* PipeName, UINT32 TtlMs)
+{
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    m_StatusMessage.str("");
+
+    if (m_Running) {
+        m_StatusMessage << "Broker is already running on " << m_PipeName;
+        return Failure;
+    }
+
+    m_PipeName = PipeName;
+    m_Cache.SetTtl(TtlMs);
+    m_Cache.InvalidateAll();
+    m_Cache.ResetStatistics();
+
+    pipe = CreateInstance(true);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+
+        m_StatusMessage << "Unable to create pipe " << m_PipeName << ", error: " << error;
+        if (error == ERROR_ACCESS_DENIED) {
+            m_StatusMessage << ", another broker may be running";
+        }
+        return InvalidHandle;
+    }
+
+    m_StopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (m_StopEvent == NULL) {
+        m_StatusMessage << "Unable to create stop event, error: " << GetLastError();
+        CloseHandle(pipe);
+        return Failure;
+    }
+
+    m_StopBackend = false;
+    m_Running = true;
+    m_Backend = std::thread(&CHardwareBroker::BackendThread, this);
+    m_Listener = std::thread(&CHardwareBroker::ListenerThread, this, pipe);
+    return Success;
+}
+
+void CHardwareBroker::Stop()
+{
+    if (!m_Running) {
+        return;
+    }
+
+    SetEvent(m_StopEvent);
+    m_Listener.join();
+
+    //
+    // Connections finish the message they are serving, so the backend runs
+    // until the last one is gone.
+    //
+    {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_WorkDone.wait(lock, [this] { return m_ActiveConnections == 0; });
+        m_StopBackend = true;
+    }
+    m_WorkReady.notify_all();
+    m_Backend.join();
+
+    CloseHandle(m_StopEvent);
+    m_StopEvent = NULL;
+    m_Running = false;
+}
+
+HardwareBrokerStatistics CHardwareBroker::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    return m_Statistics;
+}
+
+std::string CHardwareBroker::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+HANDLE CHardwareBroker::CreateInstance(bool First)
+{
+    return CreateNamedPipeA(m_PipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (First ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+                            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            PIPE_UNLIMITED_INSTANCES, HW_BROKER_MAX_MESSAGE, HW_BROKER_MAX_MESSAGE, 0, NULL);
+}
+
+//
+// Waits for an overlapped pipe operation or the stop event, a stopped
+// operation is canceled.
+//
+bool CHardwareBroker::WaitIo(HANDLE Pipe, OVERLAPPED& Overlapped, DWORD& Transferred)
+{
+    HANDLE events[2] = { Overlapped.hEvent, m_StopEvent };
+
+    if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0) {
+        CancelIoEx(Pipe, &Overlapped);
+        GetOverlappedResult(Pipe, &Overlapped, &Transferred, TRUE);
+        return false;
+    }
+    return GetOverlappedResult(Pipe, &Overlapped, &Transferred, TRUE) != FALSE;
+}
+
+//
+// Every connected instance is handed to its own thread and a new instance
+// waits for the next client.
+//
+void CHardwareBroker::ListenerThread(HANDLE Pipe)
+{
+    OVERLAPPED overlapped;
+    DWORD transferred = 0;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    while (overlapped.hEvent != NULL && WaitForSingleObject(m_StopEvent, 0) != WAIT_OBJECT_0) {
+        DWORD error = ERROR_PIPE_CONNECTED;
+
+        if (Pipe == INVALID_HANDLE_VALUE) {
+            Pipe = CreateInstance(false);
+            if (Pipe == INVALID_HANDLE_VALUE) {
+                WaitForSingleObject(m_StopEvent, 100);
+                continue;
+            }
+        }
+
+        ResetEvent(overlapped.hEvent);
+        if (ConnectNamedPipe(Pipe, &overlapped) == FALSE) {
+            error = GetLastError();
+        }
+        if (error == ERROR_IO_PENDING) {
+            error = WaitIo(Pipe, overlapped, transferred) ? ERROR_PIPE_CONNECTED : GetLastError();
+        }
+
+        if (error != ERROR_PIPE_CONNECTED) {
+            DisconnectNamedPipe(Pipe);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_ActiveConnections++;
+            m_Statistics.m_Connections++;
+        }
+        std::thread(&CHardwareBroker::ConnectionThread, this, Pipe).detach();
+        Pipe = INVALID_HANDLE_VALUE;
+    }
+
+    if (Pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(Pipe);
+    }
+    if (overlapped.hEvent != NULL) {
+        CloseHandle(overlapped.hEvent);
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareBroker::ConnectionThread
+
+  Summary:  Serves one client: reads a request message, queues it for the
+            backend, waits until the backend built the response and writes
+            it back. A malformed message, or one whose response would not
+            fit in HW_BROKER_MAX_MESSAGE, drops the client.
+
+  Args:     HANDLE Pipe
+              Connected pipe instance, closed on return.
+
+  Modifies: [m_Queue, m_ActiveConnections, m_Statistics].
+
+  Returns:  void.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CHardwareBroker::ConnectionThread(HANDLE Pipe)
+{
+    std::vector<UINT8> message(HW_BROKER_MAX_MESSAGE);
+    std::vector<UINT8> response;
+    OVERLAPPED overlapped;
+    DWORD transferred = 0;
+    Batch batch;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    while (overlapped.hEvent != NULL) {
+        const BrokerRequest* requests = (const BrokerRequest*)message.data();
+        size_t responseLength = 0;
+
+        ResetEvent(overlapped.hEvent);
+        if ((ReadFile(Pipe, message.data(), HW_BROKER_MAX_MESSAGE, NULL, &overlapped) == FALSE && GetLastError() != ERROR_IO_PENDING) ||
+            !WaitIo(Pipe, overlapped, transferred)) {
+            break;
+        }
+        if (transferred == 0 || transferred % sizeof(BrokerRequest) != 0) {
+            break;
+        }
+
+        batch.m_Requests = requests;
+        batch.m_Count = transferred / sizeof(BrokerRequest);
+        batch.m_Response = &response;
+        batch.m_Done = false;
+        for (UINT32 i = 0; i < batch.m_Count; i++)
+        {
+            responseLength += sizeof(BrokerResponse) + requests[i].m_Length;
+        }
+        if (responseLength > HW_BROKER_MAX_MESSAGE) {
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Queue.push_back(&batch);
+            m_Statistics.m_Messages++;
+            m_WorkReady.notify_one();
+            m_WorkDone.wait(lock, [&batch] { return batch.m_Done; });
+        }
+
+        ResetEvent(overlapped.hEvent);
+        if ((WriteFile(Pipe, response.data(), (DWORD)response.size(), NULL, &overlapped) == FALSE && GetLastError() != ERROR_IO_PENDING) ||
+            !WaitIo(Pipe, overlapped, transferred)) {
+            break;
+        }
+    }
+
+    if (overlapped.hEvent != NULL) {
+        CloseHandle(overlapped.hEvent);
+    }
+    DisconnectNamedPipe(Pipe);
+    CloseHandle(Pipe);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_ActiveConnections--;
+    m_WorkDone.notify_all();
+}
+
+//
+// Takes every message queued while the previous round was served, so the
+// more clients wait the larger the rounds get.
+//
+void CHardwareBroker::BackendThread()
+{
+    std::vector<Batch*> round;
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for (;;)
+    {
+        HardwareBrokerStatistics counters;
+
+        m_WorkReady.wait(lock, [this] { return !m_Queue.empty() || m_StopBackend; });
+        if (m_Queue.empty()) {
+            break;
+        }
+        round.swap(m_Queue);
+        lock.unlock();
+
+        memset(&counters, 0, sizeof(counters));
+        ServeRound(round, counters);
+
+        lock.lock();
+        m_Statistics.m_Requests += counters.m_Requests;
+        m_Statistics.m_Merged += counters.m_Merged;
+        m_Statistics.m_Batches++;
+        m_Statistics.m_CacheHits += counters.m_CacheHits;
+        m_Statistics.m_Transfers += counters.m_Transfers;
+        for (auto batch : round)
+        {
+            batch->m_Done = true;
+        }
+        round.clear();
+        m_WorkDone.notify_all();
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareBroker::ServeRound
+
+  Summary:  Serves all messages of a backend round. Identical reads of any
+            clients share one slot. Configuration reads are queued to the
+            cache and served by one Flush, which merges their misses into
+            line transfers, if the Flush fails every read is retried alone
+            so that each gets its own status. Every distinct MMIO range is
+            read once. The response of each message is built from the
+            slots in request order.
+
+  Args:     std::vector<Batch*>& Round
+              Messages to serve.
+            HardwareBrokerStatistics& Counters
+              Receives the request, merge, cache hit and transfer counts.
+
+  Modifies: [m_Cache, m_Reads, m_Slots, m_Index, m_ReadData, Round].
+
+  Returns:  void.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CHardwareBroker::ServeRound(std::vector<Batch*>& Round, HardwareBrokerStatistics& Counters)
+{
+    ConfigCacheStatistics before = m_Cache.GetStatistics();
+    size_t dataLength = 0;
+    size_t slot = 0;
+    bool configQueued = false;
+
+    m_Reads.clear();
+    m_Slots.clear();
+    m_Index.clear();
+
+    for (auto batch : Round)
+    {
+        for (UINT32 i = 0; i < batch->m_Count; i++)
+        {
+            const BrokerRequest& request = batch->m_Requests[i];
+            std::pair<UINT64, UINT64> key(request.m_Address, ((UINT64)request.m_Operation << 48) | ((UINT64)request.m_Length << 32) | request.m_Offset);
+            auto found = m_Index.find(key);
+            UniqueRead read;
+
+            Counters.m_Requests++;
+            if (found != m_Index.end()) {
+                Counters.m_Merged++;
+                m_Slots.push_back(found->second);
+                continue;
+            }
+
+            read.m_Request = request;
+            read.m_Data = dataLength;
+            read.m_Status = Success;
+            if (request.m_Operation != BrokerCfgRead && request.m_Operation != BrokerMMIORead) {
+                read.m_Status = Failure;
+            }
+            else if (request.m_Length == 0 || request.m_Length > HW_BROKER_MAX_READ || request.m_Offset >= PCIe_CFG_SIZE ||
+                     request.m_Length > PCIe_CFG_SIZE - request.m_Offset ||
+                     (request.m_Operation == BrokerCfgRead && request.m_Address > 0xFFFF)) {
+                read.m_Status = IndexOutOfRange;
+            }
+            else {
+                dataLength += request.m_Length;
+            }
+
+            m_Index.emplace(key, m_Reads.size());
+            m_Slots.push_back(m_Reads.size());
+            m_Reads.push_back(read);
+        }
+    }
+    m_ReadData.resize(dataLength);
+
+    for (auto& read : m_Reads)
+    {
+        const BrokerRequest& request = read.m_Request;
+
+        if (read.m_Status == Success && request.m_Operation == BrokerCfgRead) {
+            m_Cache.Queue((UINT8)(request.m_Address >> 8), (UINT8)((request.m_Address >> 3) & 0x1F), (UINT8)(request.m_Address & 0x07),
+                          request.m_Offset, m_ReadData.data() + read.m_Data, request.m_Length);
+            configQueued = true;
+        }
+    }
+    if (configQueued && m_Cache.Flush() != Success) {
+        for (auto& read : m_Reads)
+        {
+            const BrokerRequest& request = read.m_Request;
+
+            if (read.m_Status == Success && request.m_Operation == BrokerCfgRead) {
+                read.m_Status = m_Cache.Read((UINT8)(request.m_Address >> 8), (UINT8)((request.m_Address >> 3) & 0x1F),
+                                             (UINT8)(request.m_Address & 0x07), request.m_Offset, m_ReadData.data() + read.m_Data,
+                                             request.m_Length);
+            }
+        }
+    }
+
+    for (auto& read : m_Reads)
+    {
+        PCIeMMIOData mmioData;
+
+        if (read.m_Status != Success || read.m_Request.m_Operation != BrokerMMIORead) {
+            continue;
+        }
+        mmioData.m_BaseAddressRegister = read.m_Request.m_Address;
+        mmioData.m_Offset = read.m_Request.m_Offset;
+        mmioData.OutputData.DataPointer = m_ReadData.data() + read.m_Data;
+        mmioData.OutputData.m_Size = read.m_Request.m_Length;
+        read.m_Status = m_CHWLib.PCIeMMIORead(&mmioData);
+        Counters.m_Transfers++;
+    }
+
+    Counters.m_CacheHits += m_Cache.GetStatistics().m_Hits - before.m_Hits;
+    Counters.m_Transfers += m_Cache.GetStatistics().m_Transfers - before.m_Transfers;
+
+    for (auto batch : Round)
+    {
+        batch->m_Response->clear();
+        for (UINT32 i = 0; i < batch->m_Count; i++)
+        {
+            const UniqueRead& read = m_Reads[m_Slots[slot++]];
+            BrokerResponse response;
+
+            response.m_Status = (UINT16)read.m_Status;
+            response.m_Length = (read.m_Status == Success) ? read.m_Request.m_Length : 0;
+            batch->m_Response->insert(batch->m_Response->end(), (PUINT8)&response, (PUINT8)&response + sizeof(response));
+            batch->m_Response->insert(batch->m_Response->end(), m_ReadData.data() + read.m_Data,
+                                      m_ReadData.data() + read.m_Data + response.m_Length);
+        }
+    }
+}
+
+CHardwareBrokerClient::CHardwareBrokerClient()
+{
+    m_Pipe = INVALID_HANDLE_VALUE;
+}
+
+CHardwareBrokerClient::~CHardwareBrokerClient()
+{
+    Disconnect();
+}
+
+UserStatus CHardwareBrokerClient::Connect(const char* PipeName)
+{
+    ULONGLONG deadline = GetTickCount64() + HW_BROKER_CONNECT_TIMEOUT;
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    m_StatusMessage.str("");
+
+    Disconnect();
+    for (;;)
+    {
+        DWORD error = 0;
+
+        m_Pipe = CreateFileA(PipeName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (m_Pipe != INVALID_HANDLE_VALUE) {
+            break;
+        }
+        error = GetLastError();
+        if (error != ERROR_PIPE_BUSY || GetTickCount64() >= deadline) {
+            m_StatusMessage << "Unable to connect to broker " << PipeName << ", error: " << error;
+            return InvalidHandle;
+        }
+        WaitNamedPipeA(PipeName, (DWORD)(deadline - GetTickCount64()));
+    }
+
+    if (!SetNamedPipeHandleState(m_Pipe, &mode, NULL, NULL)) {
+        m_StatusMessage << "Unable to set message mode on " << PipeName << ", error: " << GetLastError();
+        Disconnect();
+        return Failure;
+    }
+    return Success;
+}
+
+UserStatus CHardwareBrokerClient::CfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UserStatus userStatus = QueueCfgRead(Bus, Device, Function, Offset, Data, Size);
+
+    if (userStatus == Success) {
+        userStatus = Flush();
+    }
+    return userStatus;
+}
+
+UserStatus CHardwareBrokerClient::MMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UserStatus userStatus = QueueMMIORead(BaseAddressRegister, Offset, Data, Size);
+
+    if (userStatus == Success) {
+        userStatus = Flush();
+    }
+    return userStatus;
+}
+
+UserStatus CHardwareBrokerClient::QueueCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    return Queue(BrokerCfgRead, HW_BROKER_BDF(Bus, Device, Function), Offset, Data, Size);
+}
+
+UserStatus CHardwareBrokerClient::QueueMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    return Queue(BrokerMMIORead, BaseAddressRegister, Offset, Data, Size);
+}
+
+UserStatus CHardwareBrokerClient::BrokerRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    return ((CHardwareBrokerClient*)Context)->CfgRead(Bus, Device, Function, Offset, Data, Size);
+}
+
+UserStatus CHardwareBrokerClient::Queue(UINT16 Operation, UINT64 Address, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    BrokerRequest request;
+
+    if (Data == NULL) {
+        m_StatusMessage.str("");
+        m_StatusMessage << "Data is NULL";
+        return NullPointer;
+    }
+    if (Size == 0 || Size > HW_BROKER_MAX_READ || Offset >= PCIe_CFG_SIZE || Size > PCIe_CFG_SIZE - Offset) {
+        m_StatusMessage.str("");
+        m_StatusMessage << "Read of 0x" << std::hex << Size << " bytes at 0x" << Offset << " is outside the 4 KB region";
+        return IndexOutOfRange;
+    }
+
+    request.m_Operation = Operation;
+    request.m_Length = (UINT16)Size;
+    request.m_Offset = Offset;
+    request.m_Address = Address;
+    m_Requests.push_back(request);
+    m_Data.push_back(Data);
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareBrokerClient::Flush
+
+  Summary:  Sends the queued reads in messages as large as the request
+            and the response both fit in HW_BROKER_MAX_MESSAGE, one
+            transaction per message.
+
+  Args:     None.
+
+  Modifies: [m_Requests, m_Data, m_Response].
+
+  Returns:  UserStatus
+              Returns the first failure, failed reads are left untouched
+              and the rest are served.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareBrokerClient::Flush()
+{
+    UserStatus userStatus = Success;
+    size_t first = 0;
+    size_t responseLength = 0;
+    m_StatusMessage.str("");
+
+    if (m_Pipe == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Not connected to a broker";
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    for (size_t i = 0; i < m_Requests.size(); i++)
+    {
+        size_t length = sizeof(BrokerResponse) + m_Requests[i].m_Length;
+
+        if (responseLength + length > HW_BROKER_MAX_MESSAGE || (i - first + 1) * sizeof(BrokerRequest) > HW_BROKER_MAX_MESSAGE) {
+            UserStatus transactStatus = Transact(first, i - first);
+
+            userStatus = (userStatus == Success) ? transactStatus : userStatus;
+            first = i;
+            responseLength = 0;
+        }
+        responseLength += length;
+    }
+    if (first < m_Requests.size()) {
+        UserStatus transactStatus = Transact(first, m_Requests.size() - first);
+
+        userStatus = (userStatus == Success) ? transactStatus : userStatus;
+    }
+
+Exit:
+    m_Requests.clear();
+    m_Data.clear();
+    return userStatus;
+}
+
+UserStatus CHardwareBrokerClient::Transact(size_t First, size_t Count)
+{
+    UserStatus userStatus = Success;
+    DWORD bytesRead = 0;
+    size_t position = 0;
+
+    m_Response.resize(HW_BROKER_MAX_MESSAGE);
+    if (!TransactNamedPipe(m_Pipe, &m_Requests[First], (DWORD)(Count * sizeof(BrokerRequest)), m_Response.data(),
+                           (DWORD)m_Response.size(), &bytesRead, NULL)) {
+        m_StatusMessage << "Broker transaction failed, error: " << GetLastError();
+        return Failure;
+    }
+
+    for (size_t i = First; i < First + Count; i++)
+    {
+        BrokerResponse response;
+
+        if (bytesRead - position < sizeof(response)) {
+            m_StatusMessage << "Broker response is truncated";
+            return Failure;
+        }
+        memcpy(&response, m_Response.data() + position, sizeof(response));
+        position += sizeof(response);
+        if (bytesRead - position < response.m_Length || (response.m_Length != 0 && response.m_Length != m_Requests[i].m_Length)) {
+            m_StatusMessage << "Broker response is malformed";
+            return Failure;
+        }
+
+        if (response.m_Status == Success) {
+            memcpy(m_Data[i], m_Response.data() + position, response.m_Length);
+        }
+        else if (userStatus == Success) {
+            userStatus = (UserStatus)response.m_Status;
+            m_StatusMessage << "Broker read failed for Address: 0x" << std::hex << m_Requests[i].m_Address << ", Offset: 0x"
+                << m_Requests[i].m_Offset << ", Size: 0x" << m_Requests[i].m_Length;
+        }
+        position += response.m_Length;
+    }
+    return userStatus;
+}
+
+void CHardwareBrokerClient::Disconnect()
+{
+    if (m_Pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_Pipe);
+        m_Pipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+std::string CHardwareBrokerClient::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
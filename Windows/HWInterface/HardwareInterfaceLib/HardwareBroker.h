@@ -0,0 +1,221 @@
+#pragma once
+/*+===================================================================
+  File:      HardwareBroker.h
+
+  Summary:   Local broker that owns the exclusive handle to the Hardware
+             Interface driver and serves register reads of many client
+             processes over a named pipe.
+
+  Classes:   CHardwareBroker, CHardwareBrokerClient.
+
+  Functions: Start, Stop, GetStatistics, Connect, CfgRead, MMIORead,
+             QueueCfgRead, QueueMMIORead, Flush, BrokerRead, Disconnect.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "ConfigCache.h"
+
+#define HW_BROKER_PIPE_NAME             "\\\\.\\pipe\\HWInterfaceBroker"
+#define HW_BROKER_MAX_MESSAGE           0x10000
+#define HW_BROKER_MAX_READ              PCIe_CFG_SIZE
+#define HW_BROKER_CONNECT_TIMEOUT       5000
+
+#define HW_BROKER_BDF(b, d, f)          (UINT64)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+
+typedef enum
+{
+    BrokerCfgRead = 1,
+    BrokerMMIORead
+}BrokerOperation;
+
+//
+// A request message is an array of BrokerRequest, the response message
+// holds one BrokerResponse per request in the same order, each followed by
+// m_Length bytes of data, m_Length is 0 for a failed read. m_Address is a
+// HW_BROKER_BDF for configuration reads and the BAR address for MMIO
+// reads, every read is at most HW_BROKER_MAX_READ bytes of a 4 KB region.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT16 m_Operation;
+    UINT16 m_Length;
+    UINT32 m_Offset;
+    UINT64 m_Address;
+}BrokerRequest;
+
+typedef struct
+{
+    UINT16 m_Status;
+    UINT16 m_Length;
+}BrokerResponse;
+#pragma pack(pop)
+
+typedef struct
+{
+    UINT64 m_Connections;
+    UINT64 m_Messages;
+    UINT64 m_Requests;
+    UINT64 m_Merged;
+    UINT64 m_Batches;
+    UINT64 m_CacheHits;
+    UINT64 m_Transfers;
+}HardwareBrokerStatistics;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CHardwareBroker
+
+  Summary:  Serves register reads of local clients with the one handle the
+            driver allows. A listener thread accepts pipe clients and
+            every connection has a thread that reads a request message,
+            hands it to the backend and writes the response. The backend
+            thread is the only one calling CHWLib once the broker runs: it
+            takes every message queued since its last round at once,
+            merges identical reads, reads configuration space through a
+            CConfigCache, so repeated reads are served from the cache for
+            the TTL and misses are merged into line transfers, and reads
+            each distinct MMIO range once. MMIO reads are never cached or
+            widened since reading a register can have side effects.
+
+  Methods:  CHardwareBroker(CHardwareInterfaceLib& CHWLib)
+              Serves reads through CHWLib, which is initialised by the caller.
+            ~CHardwareBroker()
+              Stops the broker.
+            UserStatus Start(const char* PipeName, UINT32 TtlMs)
+              Creates the pipe and starts the listener and backend threads.
+            void Stop()
+              Disconnects the clients and stops all threads.
+            HardwareBrokerStatistics GetStatistics()
+              Returns the connection, request and backend counters.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CHardwareBroker
+{
+public:
+    CHardwareBroker(CHardwareInterfaceLib& CHWLib);
+    ~CHardwareBroker();
+    UserStatus Start(const char* PipeName, UINT32 TtlMs);
+    void Stop();
+    HardwareBrokerStatistics GetStatistics();
+    std::string GetStatusMessage();
+
+private:
+    //
+    // One request message of a connection, done once m_Response is built.
+    //
+    struct Batch
+    {
+        const BrokerRequest* m_Requests;
+        UINT32 m_Count;
+        std::vector<UINT8>* m_Response;
+        bool m_Done;
+    };
+
+    //
+    // A distinct read of the backend round, m_Data indexes m_ReadData.
+    //
+    struct UniqueRead
+    {
+        BrokerRequest m_Request;
+        size_t m_Data;
+        UserStatus m_Status;
+    };
+
+    HANDLE CreateInstance(bool First);
+    void ListenerThread(HANDLE Pipe);
+    void ConnectionThread(HANDLE Pipe);
+    bool WaitIo(HANDLE Pipe, OVERLAPPED& Overlapped, DWORD& Transferred);
+    void BackendThread();
+    void ServeRound(std::vector<Batch*>& Round, HardwareBrokerStatistics& Counters);
+
+    CHardwareInterfaceLib& m_CHWLib;
+    CConfigCache m_Cache;
+    std::string m_PipeName;
+    HANDLE m_StopEvent;
+    std::thread m_Listener;
+    std::thread m_Backend;
+    std::mutex m_Lock;
+    std::condition_variable m_WorkReady;
+    std::condition_variable m_WorkDone;
+    std::vector<Batch*> m_Queue;
+    UINT32 m_ActiveConnections;
+    bool m_Running;
+    bool m_StopBackend;
+    std::vector<UniqueRead> m_Reads;
+    std::vector<size_t> m_Slots;
+    std::map<std::pair<UINT64, UINT64>, size_t> m_Index;
+    std::vector<UINT8> m_ReadData;
+    HardwareBrokerStatistics m_Statistics;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CHardwareBrokerClient
+
+  Summary:  Connection of a client process to CHardwareBroker. Reads are
+            queued and Flush sends them with as few messages as fit in
+            HW_BROKER_MAX_MESSAGE, CfgRead and MMIORead are Queue plus
+            Flush. BrokerRead lets CCapabilityWalker, CConfigCache and the
+            scanners read configuration space through the broker.
+
+  Methods:  CHardwareBrokerClient()
+              Constructor.
+            ~CHardwareBrokerClient()
+              Disconnects.
+            UserStatus Connect(const char* PipeName)
+              Opens the pipe of the broker, waiting while all instances are busy.
+            UserStatus CfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Reads configuration space now.
+            UserStatus MMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Reads an MMIO region now.
+            UserStatus QueueCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Queues a configuration read, Data is filled by the next Flush.
+            UserStatus QueueMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              Queues an MMIO read, Data is filled by the next Flush.
+            UserStatus Flush()
+              Sends the queued reads and waits for their data.
+            static UserStatus BrokerRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+              PFN_CFG_READ reading through the CHardwareBrokerClient in Context.
+            void Disconnect()
+              Closes the pipe.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CHardwareBrokerClient
+{
+public:
+    CHardwareBrokerClient();
+    ~CHardwareBrokerClient();
+    UserStatus Connect(const char* PipeName);
+    UserStatus CfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus MMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus QueueCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus QueueMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus Flush();
+    static UserStatus BrokerRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    void Disconnect();
+    std::string GetStatusMessage();
+
+private:
+    UserStatus Queue(UINT16 Operation, UINT64 Address, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus Transact(size_t First, size_t Count);
+
+    HANDLE m_Pipe;
+    std::vector<BrokerRequest> m_Requests;
+    std::vector<PUINT8> m_Data;
+    std::vector<UINT8> m_Response;
+    std::stringstream m_StatusMessage;
+};
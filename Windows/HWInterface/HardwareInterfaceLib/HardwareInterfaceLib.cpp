@@ -1,20 +1,31 @@
 #include "HardwareInterfaceLib.h"
+#include "BarIndex.h"
+#include "AccessTrace.h"
 
 CHardwareInterfaceLib::CHardwareInterfaceLib()
 {
     m_HardwareInterfaceDrv = NULL;
+    m_IoEvent = NULL;
+    m_RingMemory = NULL;
+    ZeroMemory(&m_Ring, sizeof(m_Ring));
+    ZeroMemory(&m_RingSetup, sizeof(m_RingSetup));
     m_PCIeExBar = 0;
+    m_BarIndex = NULL;
+    m_TraceRecorder = NULL;
+    m_DirectIo = true;
 }
 
 CHardwareInterfaceLib::~CHardwareInterfaceLib()
 {
-
+    CHardwareInterfaceLibUninitialise();
 }
 
 /*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
   Method:   CHardwareInterfaceLib::CHardwareInterfaceLibInitialise
 
-  Summary:  Opens handle to Hardware Interface driver.
+  Summary:  Opens handle to Hardware Interface driver. The handle is
+            overlapped so a ring setup request can stay pending while other
+            requests are sent, IoControl waits for the others.
 
   Args:     None
 
@@ -26,7 +37,6 @@ M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
 UserStatus CHardwareInterfaceLib::CHardwareInterfaceLibInitialise()
 {
     UserStatus userStatus = Success;
-    PCI_PCIeCfgData pciStdData;
     m_StatusMessage.str("");
 
     m_HardwareInterfaceDrv = CreateFileA(HW_INTERFACE_DRIVER,
@@ -34,9 +44,24 @@ UserStatus CHardwareInterfaceLib::CHardwareInterfaceLibInitialise()
                                          0,
                                          NULL,
                                          OPEN_EXISTING,
-                                         FILE_ATTRIBUTE_NORMAL,
+                                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
                                          NULL
                                          );
+
+    //
+    // Only administrators may open the driver for writing, other users
+    // get a handle that can run every request except writing scripts.
+    //
+    if (m_HardwareInterfaceDrv == INVALID_HANDLE_VALUE && GetLastError() == ERROR_ACCESS_DENIED) {
+        m_HardwareInterfaceDrv = CreateFileA(HW_INTERFACE_DRIVER,
+                                             GENERIC_READ,
+                                             0,
+                                             NULL,
+                                             OPEN_EXISTING,
+                                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+                                             NULL
+                                             );
+    }
     if (m_HardwareInterfaceDrv == INVALID_HANDLE_VALUE)
     {
         m_StatusMessage << "Unable to open handle to " << HW_INTERFACE_DRIVER;
@@ -44,21 +69,36 @@ UserStatus CHardwareInterfaceLib::CHardwareInterfaceLibInitialise()
         goto Exit;
     }
 
-    pciStdData.m_Bus = 0;
-    pciStdData.m_Device = 0;
-    pciStdData.m_Function = 0;
-    pciStdData.m_Offset = 0x60;
-    pciStdData.OutputData.m_Size = sizeof(m_PCIeExBar);
-    pciStdData.OutputData.DataPointer = (PUINT8)&m_PCIeExBar;
+    m_IoEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (m_IoEvent == NULL) {
+        m_StatusMessage << "Unable to create I/O event, error: " << GetLastError();
+        userStatus = Failure;
+        goto Exit;
+    }
+    m_DirectIo = true;
 
-    userStatus = PCIStdCfgRead(&pciStdData);
+    userStatus = ReadRegister<HostBridgePciExBar>(0, 0, 0, m_PCIeExBar);
     if (userStatus != Success) {
         m_StatusMessage << "PCIStdCfgRead failed, status: 0x" << std::hex << userStatus;
+        goto Exit;
     }
 
-    m_PCIeExBar &= 0x0000000ffc000000i64;
+    m_PCIeExBar = HostBridgePciExBarAddress::Isolate(m_PCIeExBar);
 
 Exit:
+    //
+    // A failed initialisation keeps no handles, so it can be retried.
+    //
+    if (userStatus != Success) {
+        if (m_IoEvent != NULL) {
+            CloseHandle(m_IoEvent);
+            m_IoEvent = NULL;
+        }
+        if (m_HardwareInterfaceDrv != NULL && m_HardwareInterfaceDrv != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_HardwareInterfaceDrv);
+        }
+        m_HardwareInterfaceDrv = NULL;
+    }
     return userStatus;
 }
 
@@ -80,6 +120,7 @@ UserStatus CHardwareInterfaceLib::PCIStdCfgRead(PPCI_PCIeCfgData pPCIStdCfgData)
     UserStatus userStatus = Success;
     DWORD BytesReturned = 0;
     bool successPCIRead;
+    UINT64 traceStart = (m_TraceRecorder != NULL) ? CAccessTraceRecorder::Now() : 0;
     m_StatusMessage.str("");
 
     if (pPCIStdCfgData->m_Offset + pPCIStdCfgData->OutputData.m_Size > PCI_CFG_SIZE) {
@@ -89,12 +130,28 @@ UserStatus CHardwareInterfaceLib::PCIStdCfgRead(PPCI_PCIeCfgData pPCIStdCfgData)
         goto Exit;
     }
 
-    successPCIRead = DeviceIoControl(m_HardwareInterfaceDrv,
-                                     IOCTL_PLATFORM_PCI_STD_CFG_READ,
-                                     (LPVOID)pPCIStdCfgData, sizeof(*pPCIStdCfgData),
-                                     (LPVOID)pPCIStdCfgData, sizeof(*pPCIStdCfgData),
-                                     &BytesReturned,
-                                     NULL);
+    successPCIRead = false;
+    if (m_DirectIo) {
+        PCIeCfgReadRequest cfgRequest;
+        cfgRequest.m_Bus = pPCIStdCfgData->m_Bus;
+        cfgRequest.m_Device = pPCIStdCfgData->m_Device;
+        cfgRequest.m_Function = pPCIStdCfgData->m_Function;
+        cfgRequest.m_Reserved = 0;
+        cfgRequest.m_Offset = pPCIStdCfgData->m_Offset;
+        cfgRequest.m_Length = pPCIStdCfgData->OutputData.m_Size;
+        successPCIRead = DirectRead(IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT, &cfgRequest, sizeof(cfgRequest),
+                                    pPCIStdCfgData->OutputData.DataPointer, pPCIStdCfgData->OutputData.m_Size, &BytesReturned);
+        if (successPCIRead) {
+            pPCIStdCfgData->OutputData.m_Size = BytesReturned;
+        }
+    }
+
+    if (!m_DirectIo) {
+        successPCIRead = IoControl(IOCTL_PLATFORM_PCI_STD_CFG_READ,
+                                   (LPVOID)pPCIStdCfgData, sizeof(*pPCIStdCfgData),
+                                   (LPVOID)pPCIStdCfgData, sizeof(*pPCIStdCfgData),
+                                   &BytesReturned);
+    }
     if (successPCIRead == false) {
         userStatus = Failure;
         m_StatusMessage << "Could not read PCI standard config space for Bus: 0x" << std::hex << +(pPCIStdCfgData->m_Bus) << ", Device: 0x" 
@@ -103,6 +160,10 @@ UserStatus CHardwareInterfaceLib::PCIStdCfgRead(PPCI_PCIeCfgData pPCIStdCfgData)
     }
 
 Exit:
+    if (m_TraceRecorder != NULL) {
+        m_TraceRecorder->Record(AccessTraceStdCfgRead, ACCESS_TRACE_BDF(pPCIStdCfgData->m_Bus, pPCIStdCfgData->m_Device, pPCIStdCfgData->m_Function),
+                                pPCIStdCfgData->m_Offset, pPCIStdCfgData->OutputData.m_Size, userStatus, traceStart);
+    }
     return userStatus;
 }
 
@@ -122,6 +183,7 @@ M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
 UserStatus CHardwareInterfaceLib::PCIeExCfgRead(PPCI_PCIeCfgData pPCIeExCfgData)
 {
     UserStatus userStatus = Success;
+    UINT64 traceStart = (m_TraceRecorder != NULL) ? CAccessTraceRecorder::Now() : 0;
     m_StatusMessage.str("");
 
     if (pPCIeExCfgData->m_Offset + pPCIeExCfgData->OutputData.m_Size > PCIe_CFG_SIZE) {
@@ -136,13 +198,17 @@ UserStatus CHardwareInterfaceLib::PCIeExCfgRead(PPCI_PCIeCfgData pPCIeExCfgData)
     pcieMMIOData.m_Offset = pPCIeExCfgData->m_Offset;
     pcieMMIOData.OutputData.m_Size = pPCIeExCfgData->OutputData.m_Size;
     pcieMMIOData.OutputData.DataPointer = pPCIeExCfgData->OutputData.DataPointer;
-    userStatus = PCIeMMIORead(&pcieMMIOData);
-    if (userStatus == Success) {
+    userStatus = MMIORead(&pcieMMIOData);
+    if (userStatus != Success) {
         m_StatusMessage << "Could not read PCIe extended config space for Bus: 0x" << std::hex << +(pPCIeExCfgData->m_Bus) << ", Device: 0x" << std::hex 
-            << +(pPCIeExCfgData->m_Device) + ", Function: 0x" << std::hex << +(pPCIeExCfgData->m_Function) << ", Offset: 0x" << std::hex << +(pPCIeExCfgData->m_Offset);
+            << +(pPCIeExCfgData->m_Device) << ", Function: 0x" << std::hex << +(pPCIeExCfgData->m_Function) << ", Offset: 0x" << std::hex << +(pPCIeExCfgData->m_Offset);
     }
 
 Exit:
+    if (m_TraceRecorder != NULL) {
+        m_TraceRecorder->Record(AccessTraceExCfgRead, ACCESS_TRACE_BDF(pPCIeExCfgData->m_Bus, pPCIeExCfgData->m_Device, pPCIeExCfgData->m_Function),
+                                pPCIeExCfgData->m_Offset, pPCIeExCfgData->OutputData.m_Size, userStatus, traceStart);
+    }
     return userStatus;
 }
 
@@ -160,11 +226,32 @@ Exit:
               Returns error code.
 M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
 UserStatus CHardwareInterfaceLib::PCIeMMIORead(PPCIeMMIOData pPCIeMMIOData)
+{
+    UserStatus userStatus = Success;
+    UINT64 traceStart = (m_TraceRecorder != NULL) ? CAccessTraceRecorder::Now() : 0;
+    m_StatusMessage.str("");
+
+    userStatus = CheckBarRange(pPCIeMMIOData->m_BaseAddressRegister + pPCIeMMIOData->m_Offset, pPCIeMMIOData->OutputData.m_Size);
+    if (userStatus == Success) {
+        userStatus = MMIORead(pPCIeMMIOData);
+    }
+
+    if (m_TraceRecorder != NULL) {
+        m_TraceRecorder->Record(AccessTraceMMIORead, pPCIeMMIOData->m_BaseAddressRegister, pPCIeMMIOData->m_Offset, pPCIeMMIOData->OutputData.m_Size,
+                                userStatus, traceStart);
+    }
+    return userStatus;
+}
+
+//
+// Maps and reads an MMIO region without the BAR check, the extended
+// configuration space is not a BAR.
+//
+UserStatus CHardwareInterfaceLib::MMIORead(PPCIeMMIOData pPCIeMMIOData)
 {
     UserStatus userStatus = Success;
     DWORD BytesReturned = 0;
     bool successPCIeMMIORead;
-    m_StatusMessage.str("");
 
     if (pPCIeMMIOData->m_Offset + pPCIeMMIOData->OutputData.m_Size > PCIe_CFG_SIZE) {
         m_StatusMessage << "Requested offset: 0x" << std::hex << pPCIeMMIOData->m_Offset << ", data length: 0x" << std::hex << pPCIeMMIOData->OutputData.m_Size 
@@ -173,12 +260,22 @@ UserStatus CHardwareInterfaceLib::PCIeMMIORead(PPCIeMMIOData pPCIeMMIOData)
         goto Exit;
     }
 
-    successPCIeMMIORead = DeviceIoControl(m_HardwareInterfaceDrv,
-                                          IOCTL_PLATFORM_PCIe_MMIO_READ,
-                                          (LPVOID)pPCIeMMIOData, sizeof(*pPCIeMMIOData),
-                                          (LPVOID)pPCIeMMIOData, sizeof(*pPCIeMMIOData),
-                                          &BytesReturned,
-                                          NULL);
+    successPCIeMMIORead = false;
+    if (m_DirectIo) {
+        PCIeMMIOReadRequest mmioRequest;
+        mmioRequest.m_BaseAddressRegister = pPCIeMMIOData->m_BaseAddressRegister;
+        mmioRequest.m_Offset = pPCIeMMIOData->m_Offset;
+        mmioRequest.m_Length = pPCIeMMIOData->OutputData.m_Size;
+        successPCIeMMIORead = DirectRead(IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT, &mmioRequest, sizeof(mmioRequest),
+                                         pPCIeMMIOData->OutputData.DataPointer, pPCIeMMIOData->OutputData.m_Size, &BytesReturned);
+    }
+
+    if (!m_DirectIo) {
+        successPCIeMMIORead = IoControl(IOCTL_PLATFORM_PCIe_MMIO_READ,
+                                        (LPVOID)pPCIeMMIOData, sizeof(*pPCIeMMIOData),
+                                        (LPVOID)pPCIeMMIOData, sizeof(*pPCIeMMIOData),
+                                        &BytesReturned);
+    }
     if (successPCIeMMIORead == false) {
         userStatus = Failure;
         m_StatusMessage << "Could not read PCIe MMIO region at base address: 0x" << std::hex << pPCIeMMIOData->m_BaseAddressRegister << ", offset: 0x" << std::hex << pPCIeMMIOData->m_Offset;
@@ -188,10 +285,762 @@ Exit:
     return userStatus;
 }
 
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::DirectRead
+
+  Summary:  Sends a METHOD_OUT_DIRECT read, the driver fills Buffer through
+            its locked pages instead of a pointer inside the request. A
+            driver without the direct IOCTLs fails them with
+            ERROR_INVALID_FUNCTION, then m_DirectIo is cleared and the
+            caller sends the buffered IOCTL instead.
+
+  Args:     DWORD IoControlCode
+              Direct I/O control code.
+            LPVOID Request
+              Request header passed in the input buffer.
+            DWORD RequestLength
+              Size of the request header.
+            PUINT8 Buffer
+              Receives the data.
+            UINT32 Length
+              Number of bytes to read.
+            LPDWORD BytesReturned
+              Receives the number of bytes read.
+
+  Modifies: [m_DirectIo].
+
+  Returns:  bool
+              Returns true if the read succeeded.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+bool CHardwareInterfaceLib::DirectRead(DWORD IoControlCode, LPVOID Request, DWORD RequestLength, PUINT8 Buffer, UINT32 Length, LPDWORD BytesReturned)
+{
+    bool successRead;
+
+    //
+    // The driver rejects an empty output buffer, there is nothing to read.
+    //
+    if (Length == 0) {
+        *BytesReturned = 0;
+        return true;
+    }
+
+    successRead = IoControl(IoControlCode,
+                            Request, RequestLength,
+                            (LPVOID)Buffer, Length,
+                            BytesReturned);
+    if (successRead == false && GetLastError() == ERROR_INVALID_FUNCTION) {
+        m_DirectIo = false;
+    }
+    return successRead;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::IoControl
+
+  Summary:  Sends an IOCTL on the overlapped handle and waits until the
+            driver completes it.
+
+  Args:     DWORD IoControlCode
+              I/O control code.
+            LPVOID InBuffer, DWORD InBufferLength
+              Input buffer.
+            LPVOID OutBuffer, DWORD OutBufferLength
+              Output buffer.
+            LPDWORD BytesReturned
+              Receives the number of bytes returned.
+
+  Modifies: None.
+
+  Returns:  bool
+              Returns true if the driver completed the request successfully,
+              GetLastError has the error otherwise.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+bool CHardwareInterfaceLib::IoControl(DWORD IoControlCode, LPVOID InBuffer, DWORD InBufferLength, LPVOID OutBuffer, DWORD OutBufferLength, LPDWORD BytesReturned)
+{
+    OVERLAPPED overlapped;
+    BOOL successIo;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = m_IoEvent;
+
+    successIo = DeviceIoControl(m_HardwareInterfaceDrv,
+                                IoControlCode,
+                                InBuffer, InBufferLength,
+                                OutBuffer, OutBufferLength,
+                                BytesReturned,
+                                &overlapped);
+    if (successIo == FALSE && GetLastError() == ERROR_IO_PENDING) {
+        successIo = GetOverlappedResult(m_HardwareInterfaceDrv, &overlapped, BytesReturned, TRUE);
+    }
+    return successIo != FALSE;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::CheckBarRange
+
+  Summary:  Refuses an access that is not inside one known BAR window when
+            a BAR index is set.
+
+  Args:     UINT64 Address
+              Physical address of the access.
+            UINT64 Length
+              Access length in bytes.
+
+  Modifies: None.
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the access is outside the BARs.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::CheckBarRange(UINT64 Address, UINT64 Length)
+{
+    if (m_BarIndex == NULL || Length == 0 || m_BarIndex->Find(Address, Length) != BAR_INDEX_INVALID) {
+        return Success;
+    }
+
+    m_StatusMessage << "Address: 0x" << std::hex << Address << ", length: 0x" << std::hex << Length << " is not inside a known BAR";
+    return IndexOutOfRange;
+}
+
+void CHardwareInterfaceLib::SetBarIndex(const CBarIndex* BarIndex)
+{
+    m_BarIndex = BarIndex;
+}
+
+void CHardwareInterfaceLib::SetTraceRecorder(CAccessTraceRecorder* Recorder)
+{
+    m_TraceRecorder = Recorder;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::PCIeBarWindowRead
+
+  Summary:  Reads one window of at most PCIe_BAR_WINDOW_SIZE bytes of a BAR.
+
+  Args:     UINT64 BaseAddressRegister
+              Physical base address of the BAR.
+            UINT64 Offset
+              Offset of the window from the BAR base.
+            PUINT8 Buffer
+              Receives the data, the driver writes it in place.
+            UINT32 Length
+              Window length in bytes.
+
+  Modifies: [Buffer].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::PCIeBarWindowRead(UINT64 BaseAddressRegister, UINT64 Offset, PUINT8 Buffer, UINT32 Length)
+{
+    UserStatus userStatus = Success;
+    DWORD BytesReturned = 0;
+    bool successBarRead;
+    PCIeBarReadRequest barRequest;
+    UINT64 traceStart = (m_TraceRecorder != NULL) ? CAccessTraceRecorder::Now() : 0;
+
+    barRequest.m_BaseAddressRegister = BaseAddressRegister;
+    barRequest.m_Offset = Offset;
+    barRequest.m_Length = Length;
+
+    successBarRead = IoControl(IOCTL_PLATFORM_PCIe_BAR_READ,
+                               (LPVOID)&barRequest, sizeof(barRequest),
+                               (LPVOID)Buffer, Length,
+                               &BytesReturned);
+    if (successBarRead == false || BytesReturned != Length) {
+        userStatus = Failure;
+        m_StatusMessage << "Could not read PCIe BAR at base address: 0x" << std::hex << BaseAddressRegister << ", offset: 0x" << std::hex << Offset
+            << ", length: 0x" << std::hex << Length;
+    }
+
+    if (m_TraceRecorder != NULL) {
+        m_TraceRecorder->Record(AccessTraceBarRead, BaseAddressRegister + Offset, 0, Length, userStatus, traceStart);
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::PCIeBarRead
+
+  Summary:  Reads any length of a BAR into Buffer. The driver maps at most
+            PCIe_BAR_WINDOW_SIZE bytes per request and writes every window
+            straight into Buffer, so nothing is staged in between.
+
+  Args:     UINT64 BaseAddressRegister
+              Physical base address of the BAR.
+            UINT64 Offset
+              Offset from the BAR base to start reading.
+            PUINT8 Buffer
+              Receives Length bytes.
+            UINT64 Length
+              Number of bytes to read.
+
+  Modifies: [Buffer].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::PCIeBarRead(UINT64 BaseAddressRegister, UINT64 Offset, PUINT8 Buffer, UINT64 Length)
+{
+    UserStatus userStatus = Success;
+    UINT64 done = 0;
+    m_StatusMessage.str("");
+
+    if (Buffer == NULL) {
+        m_StatusMessage << "BAR read buffer is NULL";
+        userStatus = NullPointer;
+        goto Exit;
+    }
+
+    userStatus = CheckBarRange(BaseAddressRegister + Offset, Length);
+    if (userStatus != Success) {
+        goto Exit;
+    }
+
+    while (done < Length) {
+        UINT32 window = (Length - done > PCIe_BAR_WINDOW_SIZE) ? PCIe_BAR_WINDOW_SIZE : (UINT32)(Length - done);
+
+        userStatus = PCIeBarWindowRead(BaseAddressRegister, Offset + done, Buffer + done, window);
+        if (userStatus != Success) {
+            goto Exit;
+        }
+        done += window;
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::PCIeBarStream
+
+  Summary:  Reads a BAR one chunk at a time into ChunkBuffer and hands every
+            chunk to Callback, so regions larger than memory can be dumped.
+
+  Args:     UINT64 BaseAddressRegister
+              Physical base address of the BAR.
+            UINT64 Offset
+              Offset from the BAR base to start reading.
+            UINT64 Length
+              Number of bytes to read.
+            PUINT8 ChunkBuffer
+              Caller buffer reused for every chunk.
+            UINT32 ChunkSize
+              Size of ChunkBuffer, windows are capped at PCIe_BAR_WINDOW_SIZE.
+            PFN_BAR_STREAM_CALLBACK Callback
+              Receives each chunk, returns false to stop.
+            PVOID Context
+              Passed to Callback.
+
+  Modifies: [ChunkBuffer].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::PCIeBarStream(UINT64 BaseAddressRegister, UINT64 Offset, UINT64 Length, PUINT8 ChunkBuffer, UINT32 ChunkSize,
+                                                PFN_BAR_STREAM_CALLBACK Callback, PVOID Context)
+{
+    UserStatus userStatus = Success;
+    UINT64 done = 0;
+    m_StatusMessage.str("");
+
+    if (ChunkBuffer == NULL || Callback == NULL || ChunkSize == 0) {
+        m_StatusMessage << "BAR stream chunk buffer or callback is NULL";
+        userStatus = NullPointer;
+        goto Exit;
+    }
+
+    userStatus = CheckBarRange(BaseAddressRegister + Offset, Length);
+    if (userStatus != Success) {
+        goto Exit;
+    }
+
+    if (ChunkSize > PCIe_BAR_WINDOW_SIZE) {
+        ChunkSize = PCIe_BAR_WINDOW_SIZE;
+    }
+
+    while (done < Length) {
+        UINT32 chunk = (Length - done > ChunkSize) ? ChunkSize : (UINT32)(Length - done);
+
+        userStatus = PCIeBarWindowRead(BaseAddressRegister, Offset + done, ChunkBuffer, chunk);
+        if (userStatus != Success) {
+            goto Exit;
+        }
+
+        if (!Callback(Context, Offset + done, ChunkBuffer, chunk)) {
+            break;
+        }
+        done += chunk;
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RegScriptExecute
+
+  Summary:  Executes a register script in the driver with a single request.
+
+  Args:     PRegScriptHeader pScript
+              Script header followed by its ops.
+            UINT32 ScriptLength
+              Length of the script in bytes.
+            PRegScriptResult pResult
+              Receives the script status followed by one UINT32 per READ/POLL op.
+            UINT32 ResultLength
+              Length of the result buffer in bytes.
+
+  Modifies: [pResult].
+
+  Returns:  UserStatus
+              Returns error code. A script that ran but stopped on a failed
+              access or poll timeout returns Failure, pResult->m_Status and
+              pResult->m_LastOp tell where it stopped.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RegScriptExecute(PRegScriptHeader pScript, UINT32 ScriptLength, PRegScriptResult pResult, UINT32 ResultLength)
+{
+    UserStatus userStatus = Success;
+    DWORD BytesReturned = 0;
+    bool successScriptExecute;
+    bool writes;
+    UINT32 resultCount = 0;
+    UINT32 scriptStatus;
+    UINT64 traceStart = (m_TraceRecorder != NULL) ? CAccessTraceRecorder::Now() : 0;
+    m_StatusMessage.str("");
+
+    if (pScript == NULL || pResult == NULL) {
+        m_StatusMessage << "Register script or result buffer is NULL";
+        userStatus = NullPointer;
+        goto Exit;
+    }
+
+    //
+    // Validate with the same code the driver runs, so a bad script is
+    // reported with its reason instead of a failed request.
+    //
+    scriptStatus = RegScriptValidate(pScript, ScriptLength, &resultCount);
+    if (scriptStatus != REG_SCRIPT_STATUS_SUCCESS) {
+        m_StatusMessage << "Register script rejected, script status: 0x" << std::hex << scriptStatus;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (ResultLength < sizeof(RegScriptResult) + resultCount * sizeof(UINT32)) {
+        m_StatusMessage << "Result buffer length 0x" << std::hex << ResultLength << " is too small for 0x" << std::hex << resultCount << " results";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    //
+    // Scripts that write need a handle opened for writing.
+    //
+    writes = (RegScriptWrites(pScript) != FALSE);
+    successScriptExecute = IoControl(writes ? IOCTL_PLATFORM_REG_SCRIPT_WRITE : IOCTL_PLATFORM_REG_SCRIPT_EXECUTE,
+                                     (LPVOID)pScript, ScriptLength,
+                                     (LPVOID)pResult, ResultLength,
+                                     &BytesReturned);
+    if (successScriptExecute == false) {
+        userStatus = Failure;
+        m_StatusMessage << "Could not execute register script for Bus: 0x" << std::hex << +(pScript->m_Bus) << ", Device: 0x"
+            << std::hex << +(pScript->m_Device) << ", Function: 0x" << std::hex << +(pScript->m_Function);
+        if (writes && GetLastError() == ERROR_ACCESS_DENIED) {
+            m_StatusMessage << ", scripts that write require administrator rights";
+        }
+        goto Exit;
+    }
+
+    if (pResult->m_Status != REG_SCRIPT_STATUS_SUCCESS) {
+        userStatus = Failure;
+        m_StatusMessage << "Register script stopped at op 0x" << std::hex << pResult->m_LastOp << ", script status: 0x" << std::hex << pResult->m_Status;
+    }
+
+Exit:
+    if (m_TraceRecorder != NULL && pScript != NULL) {
+        bool payload = (ScriptLength <= ACCESS_TRACE_MAX_PAYLOAD);
+        m_TraceRecorder->Record(AccessTraceRegScript, ACCESS_TRACE_BDF(pScript->m_Bus, pScript->m_Device, pScript->m_Function), 0, ResultLength,
+                                userStatus, traceStart, payload ? pScript : NULL, payload ? (UINT16)ScriptLength : 0);
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::PCIStdCfgWrite
+
+  Summary:  Writes a register of configuration space till 256 bytes with a
+            one op register script, a partial Mask is written with a read
+            modify write in the driver.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to write.
+            UINT32 Offset
+              Register offset, aligned to Width.
+            UINT8 Width
+              Register width in bytes, 1, 2 or 4.
+            UINT32 Value
+              Value to write.
+            UINT32 Mask
+              Bits of the register to write.
+
+  Modifies: None
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::PCIStdCfgWrite(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT8 Width, UINT32 Value, UINT32 Mask)
+{
+    struct
+    {
+        RegScriptHeader m_Header;
+        RegScriptOp m_Op;
+    } script;
+    RegScriptResult result;
+    UINT32 widthMask = (Width >= sizeof(UINT32)) ? 0xFFFFFFFF : ((1u << (Width * 8)) - 1);
+
+    script.m_Header.m_Bus = Bus;
+    script.m_Header.m_Device = Device;
+    script.m_Header.m_Function = Function;
+    script.m_Header.m_Reserved = 0;
+    script.m_Header.m_MmioBase = 0;
+    script.m_Header.m_OpCount = 1;
+    script.m_Op.m_OpCode = ((Mask & widthMask) == widthMask) ? REG_SCRIPT_OP_WRITE : REG_SCRIPT_OP_RMW;
+    script.m_Op.m_Space = REG_SCRIPT_SPACE_PCI_CFG;
+    script.m_Op.m_Width = Width;
+    script.m_Op.m_Reserved = 0;
+    script.m_Op.m_Offset = Offset;
+    script.m_Op.m_Value = Value;
+    script.m_Op.m_Mask = Mask;
+    script.m_Op.m_Param = 0;
+
+    return RegScriptExecute(&script.m_Header, sizeof(script), &result, sizeof(result));
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingSetup
+
+  Summary:  Registers a register access ring with the driver. The setup
+            request stays pending and keeps the ring locked until
+            RingTeardown cancels it, the driver's ring thread serves the
+            ring meanwhile. Returns once the driver has laid the ring out.
+
+  Args:     UINT32 Entries
+              Entries of each queue, a power of two up to HW_RING_MAX_ENTRIES.
+            UINT32 DataLength
+              Bytes of the data area the reads are written to.
+            UINT32 IdleUs
+              Microseconds the ring thread polls after the last descriptor
+              before it sleeps until RingFlush rings the doorbell.
+
+  Modifies: [m_Ring, m_RingMemory, m_RingSetup].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RingSetup(UINT32 Entries, UINT32 DataLength, UINT32 IdleUs)
+{
+    UserStatus userStatus = Success;
+    HwRingSetup setup;
+    SIZE_T ringLength = HwRingLayoutSize(Entries, DataLength);
+    UINT32 attachStatus = HW_RING_STATUS_NOT_READY;
+    m_StatusMessage.str("");
+
+    if (m_RingMemory != NULL) {
+        m_StatusMessage << "A ring is already set up";
+        return Failure;
+    }
+
+    if (ringLength == 0 || IdleUs > HW_RING_MAX_IDLE_US) {
+        m_StatusMessage << "Invalid ring of 0x" << std::hex << Entries << " entries, 0x" << std::hex << DataLength
+            << " data bytes, " << std::dec << IdleUs << " us idle";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    //
+    // Pages are aligned to the cache line the layout needs.
+    //
+    m_RingMemory = (PUINT8)VirtualAlloc(NULL, ringLength, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ZeroMemory(&m_RingSetup, sizeof(m_RingSetup));
+    m_RingSetup.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (m_RingMemory == NULL || m_RingSetup.hEvent == NULL) {
+        m_StatusMessage << "Unable to allocate a ring of 0x" << std::hex << ringLength << " bytes";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    setup.m_Entries = Entries;
+    setup.m_DataLength = DataLength;
+    setup.m_IdleUs = IdleUs;
+    if (DeviceIoControl(m_HardwareInterfaceDrv,
+                        IOCTL_PLATFORM_RING_SETUP,
+                        (LPVOID)&setup, sizeof(setup),
+                        (LPVOID)m_RingMemory, (DWORD)ringLength,
+                        NULL,
+                        &m_RingSetup) != FALSE || GetLastError() != ERROR_IO_PENDING) {
+        //
+        // Nothing is pending, so there is nothing for RingTeardown to wait for.
+        //
+        m_StatusMessage << "Could not register the ring, error: " << GetLastError();
+        CloseHandle(m_RingSetup.hEvent);
+        m_RingSetup.hEvent = NULL;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    //
+    // The setup request only completes when the ring is gone.
+    //
+    while (attachStatus == HW_RING_STATUS_NOT_READY && !HasOverlappedIoCompleted(&m_RingSetup)) {
+        attachStatus = HwRingAttach(m_RingMemory, ringLength, &m_Ring);
+        if (attachStatus == HW_RING_STATUS_NOT_READY) {
+            SwitchToThread();
+        }
+    }
+    if (attachStatus != HW_RING_STATUS_SUCCESS) {
+        m_StatusMessage << "Driver did not lay out the ring, ring status: 0x" << std::hex << attachStatus;
+        userStatus = Failure;
+    }
+
+Exit:
+    if (userStatus != Success) {
+        std::string message = m_StatusMessage.str();
+        RingTeardown();
+        m_StatusMessage.str(message);
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingSubmit
+
+  Summary:  Validates a descriptor the way the driver will and posts it.
+
+  Args:     const HwRingSqe& Descriptor
+              Descriptor to post.
+
+  Modifies: [m_Ring].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange for a descriptor the driver would
+              reject and Failure if the submission queue is full.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RingSubmit(const HwRingSqe& Descriptor)
+{
+    UserStatus userStatus = Success;
+    UINT32 ringStatus;
+
+    if (m_RingMemory == NULL) {
+        m_StatusMessage << "No ring is set up";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    ringStatus = HwRingValidateSqe(&m_Ring, &Descriptor);
+    if (ringStatus != HW_RING_STATUS_SUCCESS) {
+        m_StatusMessage << "Ring read at offset 0x" << std::hex << Descriptor.m_Offset << ", length 0x" << std::hex << Descriptor.m_Length
+            << " into data offset 0x" << std::hex << Descriptor.m_DataOffset << " is invalid, ring status: 0x" << std::hex << ringStatus;
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    if (!HwRingSubmit(&m_Ring, &Descriptor)) {
+        m_StatusMessage << "Ring submission queue is full";
+        userStatus = Failure;
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingSubmitCfgRead
+
+  Summary:  Posts a read of configuration space till 256 bytes to the ring.
+            The data lands at DataOffset of RingData.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to read.
+            UINT32 Offset, UINT32 Length
+              Range to read.
+            UINT32 DataOffset
+              Offset in the data area that receives the data.
+            UINT64 UserData
+              Returned in the completion.
+
+  Modifies: [m_Ring].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RingSubmitCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData)
+{
+    HwRingSqe descriptor;
+    m_StatusMessage.str("");
+
+    ZeroMemory(&descriptor, sizeof(descriptor));
+    descriptor.m_OpCode = HW_RING_OP_CFG_READ;
+    descriptor.m_Bus = Bus;
+    descriptor.m_Device = Device;
+    descriptor.m_Function = Function;
+    descriptor.m_Offset = Offset;
+    descriptor.m_Length = Length;
+    descriptor.m_DataOffset = DataOffset;
+    descriptor.m_UserData = UserData;
+    return RingSubmit(descriptor);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingSubmitMMIORead
+
+  Summary:  Posts a read of the 4 KB MMIO region at BaseAddressRegister to
+            the ring. The data lands at DataOffset of RingData.
+
+  Args:     UINT64 BaseAddressRegister
+              Physical address of the region.
+            UINT32 Offset, UINT32 Length
+              Range to read.
+            UINT32 DataOffset
+              Offset in the data area that receives the data.
+            UINT64 UserData
+              Returned in the completion.
+
+  Modifies: [m_Ring].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RingSubmitMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData)
+{
+    UserStatus userStatus = Success;
+    HwRingSqe descriptor;
+    m_StatusMessage.str("");
+
+    userStatus = CheckBarRange(BaseAddressRegister + Offset, Length);
+    if (userStatus != Success) {
+        return userStatus;
+    }
+
+    ZeroMemory(&descriptor, sizeof(descriptor));
+    descriptor.m_OpCode = HW_RING_OP_MMIO_READ;
+    descriptor.m_Address = BaseAddressRegister;
+    descriptor.m_Offset = Offset;
+    descriptor.m_Length = Length;
+    descriptor.m_DataOffset = DataOffset;
+    descriptor.m_UserData = UserData;
+    return RingSubmit(descriptor);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingFlush
+
+  Summary:  Rings the doorbell if the ring thread sleeps. Call it after
+            submitting and while waiting for completions, the ring thread
+            also sleeps while the completion queue is full.
+
+  Args:     None
+
+  Modifies: None.
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHardwareInterfaceLib::RingFlush()
+{
+    UserStatus userStatus = Success;
+    DWORD BytesReturned = 0;
+    m_StatusMessage.str("");
+
+    if (m_RingMemory == NULL) {
+        m_StatusMessage << "No ring is set up";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (m_Ring.m_Header->m_Flags.m_Value & HW_RING_FLAG_CORRUPT) {
+        m_StatusMessage << "Driver stopped serving the ring, its indices were corrupted";
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (HwRingNeedsWakeup(&m_Ring) &&
+        !IoControl(IOCTL_PLATFORM_RING_DOORBELL, NULL, 0, NULL, 0, &BytesReturned)) {
+        m_StatusMessage << "Could not ring the doorbell, error: " << GetLastError();
+        userStatus = Failure;
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingReap
+
+  Summary:  Takes the next completion of the ring. Completions come back in
+            submission order.
+
+  Args:     HwRingCqe& Completion
+              Receives the completion.
+
+  Modifies: [m_Ring].
+
+  Returns:  bool
+              Returns true if a completion was taken.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+bool CHardwareInterfaceLib::RingReap(HwRingCqe& Completion)
+{
+    return m_RingMemory != NULL && HwRingReap(&m_Ring, &Completion);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingData
+
+  Summary:  Returns the data area of the ring, NULL without a ring.
+
+  Args:     None
+
+  Modifies: None.
+
+  Returns:  PUINT8
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+PUINT8 CHardwareInterfaceLib::RingData()
+{
+    return (m_RingMemory != NULL) ? m_Ring.m_Data : NULL;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHardwareInterfaceLib::RingTeardown
+
+  Summary:  Cancels the setup request and waits until it completes, which
+            the driver does once its ring thread stopped, then frees the
+            ring. Outstanding descriptors are dropped.
+
+  Args:     None
+
+  Modifies: [m_Ring, m_RingMemory, m_RingSetup].
+
+  Returns:  None.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CHardwareInterfaceLib::RingTeardown()
+{
+    DWORD BytesReturned = 0;
+
+    if (m_RingSetup.hEvent != NULL) {
+        CancelIoEx(m_HardwareInterfaceDrv, &m_RingSetup);
+        GetOverlappedResult(m_HardwareInterfaceDrv, &m_RingSetup, &BytesReturned, TRUE);
+        CloseHandle(m_RingSetup.hEvent);
+    }
+    if (m_RingMemory != NULL) {
+        VirtualFree(m_RingMemory, 0, MEM_RELEASE);
+    }
+    m_RingMemory = NULL;
+    ZeroMemory(&m_Ring, sizeof(m_Ring));
+    ZeroMemory(&m_RingSetup, sizeof(m_RingSetup));
+}
+
 /*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
   Method:   CHardwareInterfaceLib::CHardwareInterfaceLibUninitialise
 
-  Summary:  Closes handle to Hardware Interface driver.
+  Summary:  Closes handle to Hardware Interface driver. Does nothing if
+            the handle is not open, the destructor calls it too.
 
   Args:     None
 
@@ -205,9 +1054,15 @@ UserStatus CHardwareInterfaceLib::CHardwareInterfaceLibUninitialise()
     UserStatus userStatus = Success;
     m_StatusMessage.str("");
 
-    if (m_HardwareInterfaceDrv) {
+    RingTeardown();
+    if (m_IoEvent) {
+        CloseHandle(m_IoEvent);
+        m_IoEvent = NULL;
+    }
+    if (m_HardwareInterfaceDrv != NULL && m_HardwareInterfaceDrv != INVALID_HANDLE_VALUE) {
         CloseHandle(m_HardwareInterfaceDrv);
     }
+    m_HardwareInterfaceDrv = NULL;
 
     return userStatus;
 }
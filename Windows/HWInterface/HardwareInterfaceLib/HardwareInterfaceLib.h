@@ -6,7 +6,12 @@
 
   Classes:   CHardwareInterfaceLib.
 
-  Functions: PCIStdCfgRead, PCIeExCfgRead, PCIeMMIORead.
+  Functions: PCIStdCfgRead, PCIeExCfgRead, PCIeMMIORead, PCIeBarRead,
+             PCIeBarStream, RegScriptExecute, PCIStdCfgWrite,
+             ReadRegister, ReadField, WriteField, SetBarIndex,
+             SetTraceRecorder, RingSetup,
+             RingSubmitCfgRead, RingSubmitMMIORead, RingFlush, RingReap,
+             RingData, RingTeardown.
 
   Origin:    
 
@@ -18,6 +23,9 @@
 #include <Windows.h>
 #include <sstream>
 #include "..\HardwareInterfaceDrv\Public.h"
+#include "..\HardwareInterfaceDrv\RegScript.h"
+#include "..\HardwareInterfaceDrv\HwRing.h"
+#include "RegisterDefs.h"
 
 typedef enum
 {
@@ -28,6 +36,15 @@ typedef enum
     NullPointer
 }UserStatus;
 
+//
+// Receives each chunk of a PCIeBarStream, Offset is relative to the start of
+// the BAR. Return false to stop the stream.
+//
+typedef bool (*PFN_BAR_STREAM_CALLBACK)(PVOID Context, UINT64 Offset, PUINT8 Data, UINT32 Length);
+
+class CBarIndex;
+class CAccessTraceRecorder;
+
 /*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
   Class:    CHardwareInterfaceLib
 
@@ -45,6 +62,38 @@ typedef enum
               Reads value of the specified register from extended configuration space of a PCIe device till 4 KB.
             UserStatus PCIeMMIORead(PPCIeMMIOData pPCIeMMIOData)
               Reads value from the MMIO region address of a PCIe device.
+            UserStatus PCIeBarRead(UINT64 BaseAddressRegister, UINT64 Offset, PUINT8 Buffer, UINT64 Length)
+              Reads any length of a BAR into Buffer through sliding mapped windows.
+            UserStatus PCIeBarStream(UINT64 BaseAddressRegister, UINT64 Offset, UINT64 Length, PUINT8 ChunkBuffer, UINT32 ChunkSize, PFN_BAR_STREAM_CALLBACK Callback, PVOID Context)
+              Reads a BAR one chunk at a time and hands every chunk to Callback.
+            UserStatus RegScriptExecute(PRegScriptHeader pScript, UINT32 ScriptLength, PRegScriptResult pResult, UINT32 ResultLength)
+              Executes a register script in the driver with a single request.
+            UserStatus PCIStdCfgWrite(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT8 Width, UINT32 Value, UINT32 Mask)
+              Writes the Mask bits of a register of configuration space till 256 bytes.
+            UserStatus ReadRegister<Reg>(UINT8 Bus, UINT8 Device, UINT8 Function, Reg::ValueType& Value)
+              Reads a register defined in RegisterDefs.h with one access of its width.
+            UserStatus ReadField<Field>(UINT8 Bus, UINT8 Device, UINT8 Function, Field::ValueType& Value)
+              Reads a field defined in RegisterDefs.h.
+            UserStatus WriteField<Field>(UINT8 Bus, UINT8 Device, UINT8 Function, Field::ValueType Value)
+              Writes a field defined in RegisterDefs.h.
+            void SetBarIndex(const CBarIndex* BarIndex)
+              Checks MMIO and BAR reads against BarIndex, NULL turns the check off.
+            void SetTraceRecorder(CAccessTraceRecorder* Recorder)
+              Records every configuration, MMIO, BAR and script access to Recorder, NULL stops recording.
+            UserStatus RingSetup(UINT32 Entries, UINT32 DataLength, UINT32 IdleUs)
+              Registers a register access ring with the driver.
+            UserStatus RingSubmitCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData)
+              Posts a configuration space read to the ring without a system call.
+            UserStatus RingSubmitMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData)
+              Posts an MMIO read to the ring without a system call.
+            UserStatus RingFlush()
+              Rings the doorbell if the ring thread sleeps.
+            bool RingReap(HwRingCqe& Completion)
+              Takes the next completion of the ring.
+            PUINT8 RingData()
+              Returns the data area of the ring.
+            void RingTeardown()
+              Cancels the ring registration and frees the ring.
             UserStatus CHardwareInterfaceLibUninitialise()
               Closes handle to Hardware Interface driver.
             std::string GetStatusMessage()
@@ -59,11 +108,77 @@ public:
     UserStatus PCIStdCfgRead(PPCI_PCIeCfgData pPCIStdCfgData);
     UserStatus PCIeExCfgRead(PPCI_PCIeCfgData pPCIeExCfgData);
     UserStatus PCIeMMIORead(PPCIeMMIOData pPCIeMMIOData);
+    UserStatus PCIeBarRead(UINT64 BaseAddressRegister, UINT64 Offset, PUINT8 Buffer, UINT64 Length);
+    UserStatus PCIeBarStream(UINT64 BaseAddressRegister, UINT64 Offset, UINT64 Length, PUINT8 ChunkBuffer, UINT32 ChunkSize,
+                             PFN_BAR_STREAM_CALLBACK Callback, PVOID Context);
+    UserStatus RegScriptExecute(PRegScriptHeader pScript, UINT32 ScriptLength, PRegScriptResult pResult, UINT32 ResultLength);
+    UserStatus PCIStdCfgWrite(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT8 Width, UINT32 Value, UINT32 Mask);
+
+    template <typename Reg>
+    UserStatus ReadRegister(UINT8 Bus, UINT8 Device, UINT8 Function, typename Reg::ValueType& Value)
+    {
+        static_assert(!Reg::Space::IsCapability, "Capability registers are read through CCapabilityWalker");
+        PCI_PCIeCfgData cfgData;
+        cfgData.m_Bus = Bus;
+        cfgData.m_Device = Device;
+        cfgData.m_Function = Function;
+        cfgData.m_Offset = Reg::Offset;
+        cfgData.OutputData.m_Size = Reg::Width;
+        cfgData.OutputData.DataPointer = (PUINT8)&Value;
+        return (Reg::Offset + Reg::Width <= PCI_CFG_SIZE) ? PCIStdCfgRead(&cfgData) : PCIeExCfgRead(&cfgData);
+    }
+
+    template <typename Field>
+    UserStatus ReadField(UINT8 Bus, UINT8 Device, UINT8 Function, typename Field::ValueType& Value)
+    {
+        typename Field::ValueType registerValue = 0;
+        UserStatus userStatus = ReadRegister<typename Field::Register>(Bus, Device, Function, registerValue);
+        Value = Field::Get(registerValue);
+        return userStatus;
+    }
+
+    //
+    // Fields of write-one-to-clear registers are written alone, so other
+    // status bits that happen to be set are not cleared by the write back.
+    //
+    template <typename Field>
+    UserStatus WriteField(UINT8 Bus, UINT8 Device, UINT8 Function, typename Field::ValueType Value)
+    {
+        typedef typename Field::Register Reg;
+        static_assert(Field::Access != RegisterReadOnly, "Field is read-only");
+        static_assert(!Reg::Space::IsCapability && Reg::Offset + Reg::Width <= PCI_CFG_SIZE && Reg::Width <= sizeof(UINT32),
+                      "Only standard configuration registers up to 4 bytes can be written");
+        UINT32 mask = (Reg::Access == RegisterWriteOneClear) ? (UINT32)((1ULL << (Reg::Width * 8)) - 1) : (UINT32)Field::Mask;
+        return PCIStdCfgWrite(Bus, Device, Function, Reg::Offset, (UINT8)Reg::Width, (UINT32)Field::Set(0, Value), mask);
+    }
+    void SetBarIndex(const CBarIndex* BarIndex);
+    void SetTraceRecorder(CAccessTraceRecorder* Recorder);
+    UserStatus RingSetup(UINT32 Entries, UINT32 DataLength, UINT32 IdleUs);
+    UserStatus RingSubmitCfgRead(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData);
+    UserStatus RingSubmitMMIORead(UINT64 BaseAddressRegister, UINT32 Offset, UINT32 Length, UINT32 DataOffset, UINT64 UserData);
+    UserStatus RingFlush();
+    bool RingReap(HwRingCqe& Completion);
+    PUINT8 RingData();
+    void RingTeardown();
     UserStatus CHardwareInterfaceLibUninitialise();
     std::string GetStatusMessage();
 
 private:
+    UserStatus PCIeBarWindowRead(UINT64 BaseAddressRegister, UINT64 Offset, PUINT8 Buffer, UINT32 Length);
+    UserStatus MMIORead(PPCIeMMIOData pPCIeMMIOData);
+    UserStatus CheckBarRange(UINT64 Address, UINT64 Length);
+    bool DirectRead(DWORD IoControlCode, LPVOID Request, DWORD RequestLength, PUINT8 Buffer, UINT32 Length, LPDWORD BytesReturned);
+    bool IoControl(DWORD IoControlCode, LPVOID InBuffer, DWORD InBufferLength, LPVOID OutBuffer, DWORD OutBufferLength, LPDWORD BytesReturned);
+    UserStatus RingSubmit(const HwRingSqe& Descriptor);
+
     HANDLE m_HardwareInterfaceDrv;
+    HANDLE m_IoEvent;
+    HwRing m_Ring;
+    PUINT8 m_RingMemory;
+    OVERLAPPED m_RingSetup;
+    bool m_DirectIo;
     UINT64 m_PCIeExBar;
+    const CBarIndex* m_BarIndex;
+    CAccessTraceRecorder* m_TraceRecorder;
     std::stringstream m_StatusMessage;
 };
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "Hash128.h"
+
+#define HASH128_C1 0x87c37b91114253d5ULL
+#define HASH128_C2 0x4cf5ad432745937fULL
+
+static inline UINT64 Rotl64(UINT64 Value, int Shift)
+{
+    return (Value << Shift) | (Value >> (64 - Shift));
+}
+
+static inline UINT64 Load64(const UINT8* Data)
+{
+    UINT64 value;
+    memcpy(&value, Data, sizeof(value));
+    return value;
+}
+
+static inline UINT64 Mix64(UINT64 Value)
+{
+    Value ^= Value >> 33;
+    Value *= 0xff51afd7ed558ccdULL;
+    Value ^= Value >> 33;
+    Value *= 0xc4ceb9fe1a85ec53ULL;
+    Value ^= Value >> 33;
+    return Value;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHash128::Compute
+
+  Summary:  Hashes a byte buffer.
+
+  Args:     const void* Data
+              Buffer to hash.
+            SIZE_T Length
+              Buffer size in bytes.
+            UINT64 Seed
+              Hash seed, captures hashed with different seeds never compare
+              equal.
+
+  Modifies: None
+
+  Returns:  Hash128
+              128-bit hash of the buffer.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+Hash128 CHash128::Compute(const void* Data, SIZE_T Length, UINT64 Seed)
+{
+    const UINT8* data = (const UINT8*)Data;
+    SIZE_T blocks = Length / 16;
+    UINT64 h1 = Seed;
+    UINT64 h2 = Seed;
+    UINT64 k1 = 0;
+    UINT64 k2 = 0;
+    Hash128 hash;
+
+    for (SIZE_T i = 0; i < blocks; i++)
+    {
+        k1 = Load64(data + i * 16);
+        k2 = Load64(data + i * 16 + 8);
+
+        k1 *= HASH128_C1; k1 = Rotl64(k1, 31); k1 *= HASH128_C2; h1 ^= k1;
+        h1 = Rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= HASH128_C2; k2 = Rotl64(k2, 33); k2 *= HASH128_C1; h2 ^= k2;
+        h2 = Rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    //
+    // Fold the last 1 to 15 bytes, high bytes first.
+    //
+    const UINT8* tail = data + blocks * 16;
+    k1 = 0;
+    k2 = 0;
+    for (SIZE_T i = Length & 15; i > 8; i--)
+    {
+        k2 ^= (UINT64)tail[i - 1] << ((i - 9) * 8);
+    }
+    if ((Length & 15) > 8) {
+        k2 *= HASH128_C2; k2 = Rotl64(k2, 33); k2 *= HASH128_C1; h2 ^= k2;
+    }
+    for (SIZE_T i = ((Length & 15) > 8) ? 8 : (Length & 15); i > 0; i--)
+    {
+        k1 ^= (UINT64)tail[i - 1] << ((i - 1) * 8);
+    }
+    if (Length & 15) {
+        k1 *= HASH128_C1; k1 = Rotl64(k1, 31); k1 *= HASH128_C2; h1 ^= k1;
+    }
+
+    h1 ^= (UINT64)Length;
+    h2 ^= (UINT64)Length;
+    h1 += h2;
+    h2 += h1;
+    h1 = Mix64(h1);
+    h2 = Mix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    hash.m_Low = h1;
+    hash.m_High = h2;
+    return hash;
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*+===================================================================
+  File:      Hash128.h
+
+  Summary:   128-bit non-cryptographic hash of a byte buffer.
+
+  Classes:   CHash128.
+
+  Functions: Compute.
+
+  Origin:    MurmurHash3_x64_128, placed in the public domain by
+             Austin Appleby.
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include "HardwareInterfaceLib.h"
+
+typedef struct
+{
+    UINT64 m_Low;
+    UINT64 m_High;
+}Hash128;
+
+inline bool operator==(const Hash128& Left, const Hash128& Right)
+{
+    return Left.m_Low == Right.m_Low && Left.m_High == Right.m_High;
+}
+
+inline bool operator<(const Hash128& Left, const Hash128& Right)
+{
+    return (Left.m_High != Right.m_High) ? (Left.m_High < Right.m_High) : (Left.m_Low < Right.m_Low);
+}
+
+//
+// Lets Hash128 key unordered containers, the low half is already uniform.
+//
+struct Hash128Hasher
+{
+    size_t operator()(const Hash128& Value) const
+    {
+        return (size_t)Value.m_Low;
+    }
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CHash128
+
+  Summary:  MurmurHash3 x64 128-bit, processes 16 bytes per round.
+
+  Methods:  static Hash128 Compute(const void* Data, SIZE_T Length, UINT64 Seed)
+              Returns the hash of Length bytes at Data.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CHash128
+{
+public:
+    static Hash128 Compute(const void* Data, SIZE_T Length, UINT64 Seed = 0);
+};
@@ -0,0 +1,198 @@
+#include "HealthScanner.h"
+
+CHealthScanner::CHealthScanner(CHardwareInterfaceLib& CHWLib)
+    : m_Walker(CHWLib)
+{
+    m_Read = CCapabilityWalker::LibRead;
+    m_Context = &CHWLib;
+    m_Scanned = false;
+    m_BytesRead = 0;
+}
+
+CHealthScanner::CHealthScanner(PFN_CFG_READ Read, PVOID Context)
+    : m_Walker(Read, Context)
+{
+    m_Read = Read;
+    m_Context = Context;
+    m_Scanned = false;
+    m_BytesRead = 0;
+}
+
+UserStatus CHealthScanner::Read(const HealthDevice& Device, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UserStatus userStatus = m_Read(m_Context, (UINT8)(Device.m_Bdf >> 8), (UINT8)((Device.m_Bdf >> 3) & 0x1F), (UINT8)(Device.m_Bdf & 0x07),
+        Offset, Data, Size);
+
+    if (userStatus != Success) {
+        m_StatusMessage << "Configuration read failed for Bus: 0x" << std::hex << (Device.m_Bdf >> 8) << ", Device: 0x"
+            << ((Device.m_Bdf >> 3) & 0x1F) << ", Function: 0x" << (Device.m_Bdf & 0x07) << ", Offset: 0x" << Offset;
+    }
+    m_BytesRead += Size;
+    return userStatus;
+}
+
+void CHealthScanner::AddChange(std::vector<HealthChange>& Changes, UINT32 Device, HealthChangeKind Kind, UINT32 Previous, UINT32 Current, UINT32 Maximum)
+{
+    HealthChange change;
+
+    change.m_Device = Device;
+    change.m_Kind = Kind;
+    change.m_Previous = Previous;
+    change.m_Current = Current;
+    change.m_Maximum = Maximum;
+    Changes.push_back(change);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHealthScanner::AddDevice
+
+  Summary:  Finds the PCI Express capability and the AER capability of a
+            function and reads Link Capabilities once, later passes only
+            read the status registers at the offsets kept.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Function to watch.
+
+  Modifies: [m_Devices].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the function has no PCI Express
+              capability.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHealthScanner::AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    UserStatus userStatus = Success;
+    PcieLinkCapabilities::ValueType linkCapabilities = 0;
+    HealthDevice device;
+    UINT32 pcieOffset = 0;
+    UINT32 aerOffset = 0;
+    m_StatusMessage.str("");
+
+    userStatus = m_Walker.FindCapability(Bus, Device, Function, PCI_CAP_ID_PCIe, &pcieOffset);
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<PcieLinkCapabilities>(Bus, Device, Function, linkCapabilities);
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.FindExtendedCapability(Bus, Device, Function, PCIe_EXT_CAP_ID_AER, &aerOffset);
+        if (userStatus == IndexOutOfRange) {
+            aerOffset = 0;
+            userStatus = Success;
+        }
+    }
+    if (userStatus != Success) {
+        m_StatusMessage << m_Walker.GetStatusMessage();
+        return userStatus;
+    }
+
+    device.m_Bdf = (UINT16)(((UINT32)Bus << 8) | ((Device & 0x1F) << 3) | (Function & 0x07));
+    device.m_LinkStatusOffset = (UINT16)(pcieOffset + PcieLinkStatus::Offset);
+    device.m_AerOffset = (UINT16)aerOffset;
+    device.m_MaxSpeed = (UINT8)PcieMaxLinkSpeed::Get(linkCapabilities);
+    device.m_MaxWidth = (UINT8)PcieMaxLinkWidth::Get(linkCapabilities);
+    device.m_LinkStatus = 0;
+    device.m_Uncorrectable = 0;
+    device.m_Correctable = 0;
+    m_Devices.push_back(device);
+
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CHealthScanner::Scan
+
+  Summary:  Reads Link Status of every function, and the uncorrectable
+            and correctable AER status of functions with AER, and reports
+            the values that changed. Functions reading all ones are
+            reported once as unreachable and their AER registers are not
+            read until they come back.
+
+  Args:     std::vector<HealthChange>& Changes
+              Receives the changes of this pass.
+
+  Modifies: [m_Devices, Changes].
+
+  Returns:  UserStatus
+              Returns error code, Changes holds what was found before the
+              failure.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CHealthScanner::Scan(std::vector<HealthChange>& Changes)
+{
+    UserStatus userStatus = Success;
+    bool first = !m_Scanned;
+    m_StatusMessage.str("");
+
+    Changes.clear();
+    m_Scanned = true;
+
+    for (UINT32 index = 0; index < m_Devices.size(); index++)
+    {
+        HealthDevice& device = m_Devices[index];
+        PcieLinkStatus::ValueType linkStatus = 0;
+        UINT32 uncorrectable = 0;
+        UINT32 correctable = 0;
+        UINT32 speed, width, previousSpeed, previousWidth;
+        bool baseline;
+
+        userStatus = Read(device, device.m_LinkStatusOffset, (PUINT8)&linkStatus, PcieLinkStatus::Width);
+        if (userStatus != Success) {
+            return userStatus;
+        }
+
+        //
+        // A function that comes back is compared with its maximum again, as
+        // on the first pass.
+        //
+        baseline = first;
+        if (linkStatus == 0xFFFF || device.m_LinkStatus == 0xFFFF) {
+            if (linkStatus != device.m_LinkStatus) {
+                AddChange(Changes, index, HealthUnreachable, device.m_LinkStatus, linkStatus, 0);
+            }
+            device.m_LinkStatus = linkStatus;
+            if (linkStatus == 0xFFFF) {
+                continue;
+            }
+            baseline = true;
+        }
+
+        speed = PcieCurrentLinkSpeed::Get(linkStatus);
+        width = PcieNegotiatedLinkWidth::Get(linkStatus);
+        previousSpeed = baseline ? device.m_MaxSpeed : PcieCurrentLinkSpeed::Get(device.m_LinkStatus);
+        previousWidth = baseline ? device.m_MaxWidth : PcieNegotiatedLinkWidth::Get(device.m_LinkStatus);
+
+        if (speed != previousSpeed) {
+            AddChange(Changes, index, HealthLinkSpeed, previousSpeed, speed, device.m_MaxSpeed);
+        }
+        if (width != previousWidth) {
+            AddChange(Changes, index, HealthLinkWidth, previousWidth, width, device.m_MaxWidth);
+        }
+        device.m_LinkStatus = linkStatus;
+
+        if (device.m_AerOffset == 0) {
+            continue;
+        }
+
+        userStatus = Read(device, device.m_AerOffset + AerUncorrectableStatus::Offset, (PUINT8)&uncorrectable, AerUncorrectableStatus::Width);
+        if (userStatus == Success) {
+            userStatus = Read(device, device.m_AerOffset + AerCorrectableStatus::Offset, (PUINT8)&correctable, AerCorrectableStatus::Width);
+        }
+        if (userStatus != Success) {
+            return userStatus;
+        }
+
+        if (uncorrectable != device.m_Uncorrectable) {
+            AddChange(Changes, index, HealthUncorrectableErrors, device.m_Uncorrectable, uncorrectable, 0);
+        }
+        if (correctable != device.m_Correctable) {
+            AddChange(Changes, index, HealthCorrectableErrors, device.m_Correctable, correctable, 0);
+        }
+        device.m_Uncorrectable = uncorrectable;
+        device.m_Correctable = correctable;
+    }
+
+    return Success;
+}
+
+std::string CHealthScanner::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,141 @@
+#pragma once
+/*+===================================================================
+  File:      HealthScanner.h
+
+  Summary:   Periodic link and AER health check of PCIe functions that
+             reads only the status registers.
+
+  Classes:   CHealthScanner.
+
+  Functions: AddDevice, Scan.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "CapabilityWalker.h"
+
+typedef enum
+{
+    HealthLinkSpeed,
+    HealthLinkWidth,
+    HealthUncorrectableErrors,
+    HealthCorrectableErrors,
+    HealthUnreachable
+}HealthChangeKind;
+
+//
+// One change found by a pass. Link values are the current speed or width
+// against the maximum from Link Capabilities in m_Maximum, AER values are
+// the status registers, and unreachable functions read all ones.
+//
+typedef struct
+{
+    UINT32 m_Device;
+    HealthChangeKind m_Kind;
+    UINT32 m_Previous;
+    UINT32 m_Current;
+    UINT32 m_Maximum;
+}HealthChange;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CHealthScanner
+
+  Summary:  Finds the PCI Express capability and the AER capability of
+            each function once, keeps their offsets and the link maximum,
+            and then reads only Link Status and the two AER status
+            registers per pass. A pass returns what changed since the
+            previous pass, the first pass returns every function that is
+            degraded, unreachable or has AER status bits set.
+
+  Methods:  CHealthScanner(CHardwareInterfaceLib& CHWLib)
+              Reads through the driver.
+            CHealthScanner(PFN_CFG_READ Read, PVOID Context)
+              Reads through any other backend.
+            UserStatus AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function)
+              Registers a function, IndexOutOfRange if it is not PCIe.
+            UserStatus Scan(std::vector<HealthChange>& Changes)
+              Runs one pass.
+            UINT32 GetDeviceCount()
+              Returns the number of registered functions.
+            UINT8 GetBus/GetDevice/GetFunction(UINT32 Device)
+              Return the location of a registered function.
+            bool HasAer(UINT32 Device)
+              Returns whether a function has the AER capability.
+            UINT64 GetBytesRead()
+              Returns the configuration space bytes read by passes.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CHealthScanner
+{
+public:
+    CHealthScanner(CHardwareInterfaceLib& CHWLib);
+    CHealthScanner(PFN_CFG_READ Read, PVOID Context);
+    UserStatus AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function);
+    UserStatus Scan(std::vector<HealthChange>& Changes);
+    std::string GetStatusMessage();
+
+    UINT32 GetDeviceCount()
+    {
+        return (UINT32)m_Devices.size();
+    }
+
+    UINT8 GetBus(UINT32 Device)
+    {
+        return (UINT8)(m_Devices[Device].m_Bdf >> 8);
+    }
+
+    UINT8 GetDevice(UINT32 Device)
+    {
+        return (UINT8)((m_Devices[Device].m_Bdf >> 3) & 0x1F);
+    }
+
+    UINT8 GetFunction(UINT32 Device)
+    {
+        return (UINT8)(m_Devices[Device].m_Bdf & 0x07);
+    }
+
+    bool HasAer(UINT32 Device)
+    {
+        return m_Devices[Device].m_AerOffset != 0;
+    }
+
+    UINT64 GetBytesRead()
+    {
+        return m_BytesRead;
+    }
+
+private:
+    //
+    // Offsets are absolute, m_AerOffset is 0 without AER. The last values
+    // read are kept to report changes only.
+    //
+    struct HealthDevice
+    {
+        UINT16 m_Bdf;
+        UINT16 m_LinkStatusOffset;
+        UINT16 m_AerOffset;
+        UINT8 m_MaxSpeed;
+        UINT8 m_MaxWidth;
+        UINT16 m_LinkStatus;
+        UINT32 m_Uncorrectable;
+        UINT32 m_Correctable;
+    };
+
+    UserStatus Read(const HealthDevice& Device, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    static void AddChange(std::vector<HealthChange>& Changes, UINT32 Device, HealthChangeKind Kind, UINT32 Previous, UINT32 Current, UINT32 Maximum);
+
+    CCapabilityWalker m_Walker;
+    PFN_CFG_READ m_Read;
+    PVOID m_Context;
+    std::vector<HealthDevice> m_Devices;
+    bool m_Scanned;
+    UINT64 m_BytesRead;
+    std::stringstream m_StatusMessage;
+};
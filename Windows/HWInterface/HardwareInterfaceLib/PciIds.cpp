@@ -0,0 +1,482 @@
+#include "PciIds.h"
+
+#define PCI_IDS_ALIGN(x)            (((x) + 7) & ~(UINT64)7)
+
+static bool ParseHexId(const std::string& Line, size_t Position, UINT16& Id)
+{
+    UINT32 value = 0;
+
+    if (Position + 4 > Line.size()) {
+        return false;
+    }
+    for (size_t i = Position; i < Position + 4; i++)
+    {
+        char c = Line[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        }
+        else {
+            return false;
+        }
+    }
+    Id = (UINT16)value;
+    return true;
+}
+
+//
+// Returns the text after Position without the blanks around it.
+//
+static std::string ParseName(const std::string& Line, size_t Position)
+{
+    size_t first = Line.find_first_not_of(" \t", Position);
+    size_t last = Line.find_last_not_of(" \t\r");
+
+    if (first == std::string::npos || last < first) {
+        return "";
+    }
+    return Line.substr(first, last - first + 1);
+}
+
+CPciIdsCompiler::CPciIdsCompiler()
+{
+    m_Strings.push_back('\0');
+    m_StringIndex[""] = 0;
+}
+
+UINT32 CPciIdsCompiler::AddString(const std::string& Text)
+{
+    auto found = m_StringIndex.find(Text);
+    if (found != m_StringIndex.end()) {
+        return found->second;
+    }
+
+    UINT32 offset = (UINT32)m_Strings.size();
+    m_Strings.insert(m_Strings.end(), Text.begin(), Text.end());
+    m_Strings.push_back('\0');
+    m_StringIndex[Text] = offset;
+    return offset;
+}
+
+void CPciIdsCompiler::AddEntry(PciIdsTableKind Table, UINT64 Key, const std::string& Name)
+{
+    PciIdsEntry entry;
+
+    if (m_EntryIndex[Table].count(Key) != 0) {
+        return;
+    }
+
+    entry.m_Key = Key;
+    entry.m_Name = AddString(Name);
+    m_EntryIndex[Table][Key] = (UINT32)m_Entries[Table].size();
+    m_Entries[Table].push_back(entry);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPciIdsCompiler::AddFile
+
+  Summary:  Parses the vendor, device and subsystem lines of a pci.ids
+            file. The class section and other sections that do not start
+            with a vendor id are skipped.
+
+  Args:     const std::string& FileName
+              pci.ids file.
+
+  Modifies: [m_Entries, m_Strings].
+
+  Returns:  UserStatus
+              Returns error code, the status message names the line.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPciIdsCompiler::AddFile(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER FileSize;
+    DWORD bytesRead = 0;
+    std::string text;
+    size_t lineStart = 0;
+    UINT32 lineNumber = 0;
+    bool inVendor = false;
+    bool inDevice = false;
+    UINT16 vendorId = 0, deviceId = 0;
+    m_StatusMessage.str("");
+
+    file = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &FileSize) || FileSize.QuadPart > MAXDWORD) {
+        m_StatusMessage << "Unable to open " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    text.resize((size_t)FileSize.QuadPart);
+    if (!text.empty() && (!ReadFile(file, &text[0], (DWORD)text.size(), &bytesRead, NULL) || bytesRead != text.size())) {
+        m_StatusMessage << "Unable to read " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    while (lineStart < text.size())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = text.size();
+        }
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        UINT16 subVendorId = 0, subDeviceId = 0;
+
+        lineStart = lineEnd + 1;
+        lineNumber++;
+
+        if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        if (line[0] != '\t') {
+            inVendor = ParseHexId(line, 0, vendorId) && line.size() > 4 && (line[4] == ' ' || line[4] == '\t');
+            inDevice = false;
+            if (inVendor) {
+                AddEntry(PciIdsVendor, vendorId, ParseName(line, 4));
+            }
+            continue;
+        }
+
+        if (!inVendor) {
+            continue;
+        }
+
+        if (line.size() > 1 && line[1] != '\t') {
+            if (!ParseHexId(line, 1, deviceId)) {
+                m_StatusMessage << FileName << "(" << lineNumber << "): expected a device id";
+                userStatus = Failure;
+                goto Exit;
+            }
+            inDevice = true;
+            AddEntry(PciIdsDevice, PCI_IDS_DEVICE_KEY(vendorId, deviceId), ParseName(line, 5));
+            continue;
+        }
+
+        if (!inDevice || !ParseHexId(line, 2, subVendorId) || line.size() < 12 || line[6] != ' ' || !ParseHexId(line, 7, subDeviceId)) {
+            m_StatusMessage << FileName << "(" << lineNumber << "): expected a subsystem id";
+            userStatus = Failure;
+            goto Exit;
+        }
+        AddEntry(PciIdsSubsystem, PCI_IDS_SUBSYSTEM_KEY(vendorId, deviceId, subVendorId, subDeviceId), ParseName(line, 11));
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPciIdsCompiler::Write
+
+  Summary:  Builds the perfect hash of every table, places each entry in
+            its slot and writes the image in one pass.
+
+  Args:     const std::string& FileName
+              Image file to create.
+
+  Modifies: None.
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPciIdsCompiler::Write(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    DWORD bytesWritten = 0;
+    PciIdsHeader header;
+    std::vector<UINT32> displacements[PciIdsTableCount];
+    std::vector<UINT32> slots[PciIdsTableCount];
+    std::vector<UINT8> image;
+    UINT64 offset = 0;
+    m_StatusMessage.str("");
+
+    memset(&header, 0, sizeof(header));
+    header.m_Magic = PCI_IDS_MAGIC;
+    header.m_Version = PCI_IDS_VERSION;
+    offset = PCI_IDS_ALIGN(sizeof(header));
+
+    for (UINT32 t = 0; t < PciIdsTableCount; t++)
+    {
+        std::vector<UINT64> keys;
+        PciIdsTable& table = header.m_Tables[t];
+
+        for (auto& entry : m_Entries[t])
+        {
+            keys.push_back(entry.m_Key);
+        }
+        userStatus = CPerfectHash::Build(keys, displacements[t], slots[t]);
+        if (userStatus != Success) {
+            m_StatusMessage << "Unable to build the hash of table " << t;
+            goto Exit;
+        }
+
+        table.m_Count = (UINT32)keys.size();
+        table.m_BucketCount = (UINT32)displacements[t].size();
+        table.m_BucketOffset = offset;
+        table.m_EntryOffset = PCI_IDS_ALIGN(table.m_BucketOffset + displacements[t].size() * sizeof(UINT32));
+        offset = PCI_IDS_ALIGN(table.m_EntryOffset + keys.size() * sizeof(PciIdsEntry));
+    }
+    header.m_StringOffset = offset;
+    header.m_StringSize = (UINT32)m_Strings.size();
+    header.m_Size = PCI_IDS_ALIGN(header.m_StringOffset + m_Strings.size());
+
+    image.assign((size_t)header.m_Size, 0);
+    memcpy(image.data(), &header, sizeof(header));
+    for (UINT32 t = 0; t < PciIdsTableCount; t++)
+    {
+        const PciIdsTable& table = header.m_Tables[t];
+
+        memcpy(image.data() + table.m_BucketOffset, displacements[t].data(), displacements[t].size() * sizeof(UINT32));
+        for (UINT32 s = 0; s < slots[t].size(); s++)
+        {
+            memcpy(image.data() + table.m_EntryOffset + (UINT64)s * sizeof(PciIdsEntry), &m_Entries[t][slots[t][s]], sizeof(PciIdsEntry));
+        }
+    }
+    memcpy(image.data() + header.m_StringOffset, m_Strings.data(), m_Strings.size());
+
+    file = CreateFileA(FileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create PCI id image " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if (!WriteFile(file, image.data(), (DWORD)image.size(), &bytesWritten, NULL) || bytesWritten != image.size()) {
+        m_StatusMessage << "Unable to write PCI id image " << FileName;
+        userStatus = Failure;
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    return userStatus;
+}
+
+UINT32 CPciIdsCompiler::GetCount(PciIdsTableKind Table)
+{
+    return (UINT32)m_Entries[Table].size();
+}
+
+std::string CPciIdsCompiler::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CPciIds::CPciIds()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    memset(&m_Header, 0, sizeof(m_Header));
+}
+
+CPciIds::~CPciIds()
+{
+    Close();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPciIds::Open
+
+  Summary:  Maps an image read-only and checks that its tables lie inside
+            the file, nothing is parsed.
+
+  Args:     const std::string& FileName
+              Image file to read.
+
+  Modifies: [m_File, m_Mapping, m_View, m_Header].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPciIds::Open(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER FileSize;
+    m_StatusMessage.str("");
+
+    Close();
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &FileSize)) {
+        m_StatusMessage << "Unable to open PCI id image " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if ((UINT64)FileSize.QuadPart < sizeof(m_Header)) {
+        m_StatusMessage << "PCI id image " << FileName << " is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_View = (const UINT8*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_View == NULL) {
+        m_StatusMessage << "Unable to map PCI id image " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    memcpy(&m_Header, m_View, sizeof(m_Header));
+    if (m_Header.m_Magic != PCI_IDS_MAGIC || m_Header.m_Version != PCI_IDS_VERSION) {
+        m_StatusMessage << "Not a PCI id image, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    for (UINT32 t = 0; t < PciIdsTableCount; t++)
+    {
+        const PciIdsTable& table = m_Header.m_Tables[t];
+        if (table.m_BucketCount != CPerfectHash::GetBucketCount(table.m_Count) ||
+            table.m_BucketOffset + (UINT64)table.m_BucketCount * sizeof(UINT32) > table.m_EntryOffset ||
+            table.m_EntryOffset + (UINT64)table.m_Count * sizeof(PciIdsEntry) > m_Header.m_Size) {
+            userStatus = IndexOutOfRange;
+        }
+    }
+
+    if (userStatus != Success || m_Header.m_Size > (UINT64)FileSize.QuadPart ||
+        m_Header.m_StringOffset + m_Header.m_StringSize > m_Header.m_Size ||
+        m_Header.m_StringSize == 0 || m_View[m_Header.m_StringOffset + m_Header.m_StringSize - 1] != '\0') {
+        m_StatusMessage << "PCI id image " << FileName << " is truncated";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+Exit:
+    if (userStatus != Success) {
+        Close();
+    }
+    return userStatus;
+}
+
+const char* CPciIds::Find(PciIdsTableKind Table, UINT64 Key)
+{
+    const PciIdsTable& table = m_Header.m_Tables[Table];
+    const PciIdsEntry* entry;
+    UINT32 name;
+
+    if (m_View == NULL || table.m_Count == 0) {
+        return NULL;
+    }
+
+    entry = (const PciIdsEntry*)(m_View + table.m_EntryOffset) +
+        CPerfectHash::Lookup(Key, (const UINT32*)(m_View + table.m_BucketOffset), table.m_BucketCount, table.m_Count);
+    if (entry->m_Key != Key) {
+        return NULL;
+    }
+
+    name = entry->m_Name;
+    return (name < m_Header.m_StringSize) ? (const char*)m_View + m_Header.m_StringOffset + name : NULL;
+}
+
+const char* CPciIds::FindVendor(UINT16 VendorId)
+{
+    return Find(PciIdsVendor, VendorId);
+}
+
+const char* CPciIds::FindDevice(UINT16 VendorId, UINT16 DeviceId)
+{
+    return Find(PciIdsDevice, PCI_IDS_DEVICE_KEY(VendorId, DeviceId));
+}
+
+const char* CPciIds::FindSubsystem(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId)
+{
+    return Find(PciIdsSubsystem, PCI_IDS_SUBSYSTEM_KEY(VendorId, DeviceId, SubVendorId, SubDeviceId));
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPciIds::GetDeviceName
+
+  Summary:  Builds a display name from the vendor, device and subsystem
+            names, e.g. "Intel Corporation I210 Gigabit Network
+            Connection (Ethernet Server Adapter I210-T1)".
+
+  Args:     UINT16 VendorId, UINT16 DeviceId
+              Ids at offset 0x00 of the configuration space.
+            UINT16 SubVendorId, UINT16 SubDeviceId
+              Ids at offset 0x2C of the configuration space.
+            std::string& Name
+              Receives the name.
+
+  Modifies: [Name].
+
+  Returns:  bool
+              Returns false, leaving Name unchanged, if the vendor is not
+              in the image.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+bool CPciIds::GetDeviceName(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId, std::string& Name)
+{
+    const char* vendor = FindVendor(VendorId);
+    const char* device;
+    const char* subsystem;
+
+    if (vendor == NULL) {
+        return false;
+    }
+
+    Name = vendor;
+    device = FindDevice(VendorId, DeviceId);
+    if (device == NULL) {
+        std::stringstream unknown;
+        unknown << " Device " << std::hex << DeviceId;
+        Name += unknown.str();
+        return true;
+    }
+
+    Name += " ";
+    Name += device;
+    subsystem = FindSubsystem(VendorId, DeviceId, SubVendorId, SubDeviceId);
+    if (subsystem != NULL) {
+        Name += " (";
+        Name += subsystem;
+        Name += ")";
+    }
+    return true;
+}
+
+bool CPciIds::IsOpen()
+{
+    return m_View != NULL;
+}
+
+const PciIdsHeader& CPciIds::GetHeader()
+{
+    return m_Header;
+}
+
+void CPciIds::Close()
+{
+    if (m_View != NULL) {
+        UnmapViewOfFile(m_View);
+        m_View = NULL;
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+        m_Mapping = NULL;
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+    }
+}
+
+std::string CPciIds::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,153 @@
+#pragma once
+/*+===================================================================
+  File:      PciIds.h
+
+  Summary:   Compiles the pci.ids database into a memory mapped image and
+             resolves vendor, device and subsystem names from it.
+
+  Classes:   CPciIdsCompiler, CPciIds.
+
+  Functions: AddFile, Write, Open, FindVendor, FindDevice, FindSubsystem,
+             GetDeviceName.
+
+  Origin:    pci.ids is maintained by the PCI ID Repository,
+             https://pci-ids.ucw.cz.
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "PerfectHash.h"
+
+#define PCI_IDS_MAGIC               0x44495748      // 'HWID'
+#define PCI_IDS_VERSION             1
+#define PCI_IDS_DEVICE_KEY(v, d)            (((UINT64)(v) << 16) | (d))
+#define PCI_IDS_SUBSYSTEM_KEY(v, d, sv, sd) (((UINT64)(v) << 48) | ((UINT64)(d) << 32) | ((UINT64)(sv) << 16) | (sd))
+
+typedef enum
+{
+    PciIdsVendor,
+    PciIdsDevice,
+    PciIdsSubsystem,
+    PciIdsTableCount
+}PciIdsTableKind;
+
+//
+// An image is a PciIdsHeader, then per table the perfect hash displacements
+// and one PciIdsEntry per slot, then a pool of NUL terminated names. Equal
+// names are stored once.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Count;
+    UINT32 m_BucketCount;
+    UINT64 m_BucketOffset;
+    UINT64 m_EntryOffset;
+}PciIdsTable;
+
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    PciIdsTable m_Tables[PciIdsTableCount];
+    UINT64 m_StringOffset;
+    UINT32 m_StringSize;
+    UINT32 m_Reserved;
+    UINT64 m_Size;
+}PciIdsHeader;
+
+typedef struct
+{
+    UINT64 m_Key;
+    UINT32 m_Name;
+}PciIdsEntry;
+#pragma pack(pop)
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CPciIdsCompiler
+
+  Summary:  Parses the vendor section of pci.ids and writes the image.
+
+  Methods:  UserStatus AddFile(const std::string& FileName)
+              Parses a pci.ids file, the first name of an id wins.
+            UserStatus Write(const std::string& FileName)
+              Builds one perfect hash per table and writes the image.
+            UINT32 GetCount(PciIdsTableKind Table)
+              Returns the ids parsed for a table.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CPciIdsCompiler
+{
+public:
+    CPciIdsCompiler();
+    UserStatus AddFile(const std::string& FileName);
+    UserStatus Write(const std::string& FileName);
+    UINT32 GetCount(PciIdsTableKind Table);
+    std::string GetStatusMessage();
+
+private:
+    UINT32 AddString(const std::string& Text);
+    void AddEntry(PciIdsTableKind Table, UINT64 Key, const std::string& Name);
+
+    std::vector<PciIdsEntry> m_Entries[PciIdsTableCount];
+    std::unordered_map<UINT64, UINT32> m_EntryIndex[PciIdsTableCount];
+    std::vector<CHAR> m_Strings;
+    std::unordered_map<std::string, UINT32> m_StringIndex;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CPciIds
+
+  Summary:  Resolves names from a memory mapped image. Opening checks the
+            header only, a lookup reads one displacement and one entry.
+
+  Methods:  UserStatus Open(const std::string& FileName)
+              Maps an image.
+            const char* FindVendor(UINT16 VendorId)
+            const char* FindDevice(UINT16 VendorId, UINT16 DeviceId)
+            const char* FindSubsystem(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId)
+              Return a name or NULL.
+            bool GetDeviceName(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId, std::string& Name)
+              Builds "Vendor Device (Subsystem)" from the names found.
+            bool IsOpen()
+              Returns whether an image is mapped.
+            const PciIdsHeader& GetHeader()
+              Returns the image header.
+            void Close()
+              Unmaps the image.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CPciIds
+{
+public:
+    CPciIds();
+    ~CPciIds();
+    UserStatus Open(const std::string& FileName);
+    const char* FindVendor(UINT16 VendorId);
+    const char* FindDevice(UINT16 VendorId, UINT16 DeviceId);
+    const char* FindSubsystem(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId);
+    bool GetDeviceName(UINT16 VendorId, UINT16 DeviceId, UINT16 SubVendorId, UINT16 SubDeviceId, std::string& Name);
+    bool IsOpen();
+    const PciIdsHeader& GetHeader();
+    void Close();
+    std::string GetStatusMessage();
+
+private:
+    const char* Find(PciIdsTableKind Table, UINT64 Key);
+
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const UINT8* m_View;
+    PciIdsHeader m_Header;
+    std::stringstream m_StatusMessage;
+};
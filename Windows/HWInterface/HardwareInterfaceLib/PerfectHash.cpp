@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "PerfectHash.h"
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPerfectHash::Build
+
+  Summary:  Places the largest buckets first, trying displacements until
+            every key of a bucket lands in a free slot. Late buckets hold
+            one key each and always fit, so the search ends quickly.
+
+  Args:     const std::vector<UINT64>& Keys
+              Distinct keys.
+            std::vector<UINT32>& Displacements
+              Receives GetBucketCount(Keys.size()) displacements.
+            std::vector<UINT32>& Slots
+              Receives the key index of every slot.
+
+  Modifies: [Displacements, Slots].
+
+  Returns:  UserStatus
+              Returns Failure if Keys holds duplicates.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPerfectHash::Build(const std::vector<UINT64>& Keys, std::vector<UINT32>& Displacements, std::vector<UINT32>& Slots)
+{
+    UINT32 keyCount = (UINT32)Keys.size();
+    UINT32 bucketCount = GetBucketCount(keyCount);
+    std::vector<std::vector<UINT32>> buckets(bucketCount);
+    std::vector<UINT32> order(bucketCount);
+    std::vector<bool> used(keyCount, false);
+    std::vector<UINT32> placed;
+    std::vector<UINT64> sorted(Keys);
+
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        return Failure;
+    }
+
+    Displacements.assign(bucketCount, 0);
+    Slots.assign(keyCount, 0);
+
+    for (UINT32 k = 0; k < keyCount; k++)
+    {
+        buckets[(UINT32)((Hash(Keys[k], 0) >> 32) % bucketCount)].push_back(k);
+    }
+
+    for (UINT32 b = 0; b < bucketCount; b++)
+    {
+        order[b] = b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](UINT32 Left, UINT32 Right) {
+        return buckets[Left].size() > buckets[Right].size();
+    });
+
+    for (UINT32 b : order)
+    {
+        const std::vector<UINT32>& bucket = buckets[b];
+        UINT32 displacement = 0;
+
+        if (bucket.empty()) {
+            break;
+        }
+
+        for (; displacement < PERFECT_HASH_MAX_DISPLACEMENT; displacement++)
+        {
+            placed.clear();
+            for (UINT32 k : bucket)
+            {
+                UINT32 slot = (UINT32)(Hash(Keys[k], (UINT64)displacement + 1) % keyCount);
+                if (used[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (placed.size() == bucket.size()) {
+                break;
+            }
+        }
+
+        if (displacement == PERFECT_HASH_MAX_DISPLACEMENT) {
+            return Failure;
+        }
+
+        Displacements[b] = displacement;
+        for (size_t i = 0; i < bucket.size(); i++)
+        {
+            used[placed[i]] = true;
+            Slots[placed[i]] = bucket[i];
+        }
+    }
+
+    return Success;
+}
@@ -0,0 +1,73 @@
+#pragma once
+/*+===================================================================
+  File:      PerfectHash.h
+
+  Summary:   Minimal perfect hash over a fixed set of 64-bit keys, for
+             lookup tables built once and memory mapped afterwards.
+
+  Classes:   CPerfectHash.
+
+  Functions: Build, Lookup.
+
+  Origin:    Hash, displace and compress, Belazzougui, Botelho and
+             Dietzfelbinger.
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+//
+// Keys are spread over one bucket per PERFECT_HASH_BUCKET_SIZE keys on
+// average, every bucket stores one displacement.
+//
+#define PERFECT_HASH_BUCKET_SIZE        4
+#define PERFECT_HASH_MAX_DISPLACEMENT   0x1000000
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CPerfectHash
+
+  Summary:  Maps n distinct keys onto the slots 0..n-1 without collisions.
+            A key is hashed to a bucket, the displacement of the bucket
+            selects the hash that places it in its slot. A lookup costs two
+            hashes and one displacement read, callers store the key with
+            the slot to reject keys outside the set.
+
+  Methods:  static UserStatus Build(const std::vector<UINT64>& Keys, std::vector<UINT32>& Displacements, std::vector<UINT32>& Slots)
+              Builds the displacement table, Slots[s] is the index in Keys
+              of the key placed in slot s.
+            static UINT32 Lookup(UINT64 Key, const UINT32* Displacements, UINT32 BucketCount, UINT32 SlotCount)
+              Returns the slot of a key of the set.
+            static UINT32 GetBucketCount(UINT32 KeyCount)
+              Returns the number of buckets used for KeyCount keys.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CPerfectHash
+{
+public:
+    static UserStatus Build(const std::vector<UINT64>& Keys, std::vector<UINT32>& Displacements, std::vector<UINT32>& Slots);
+
+    static inline UINT32 GetBucketCount(UINT32 KeyCount)
+    {
+        return (KeyCount + PERFECT_HASH_BUCKET_SIZE - 1) / PERFECT_HASH_BUCKET_SIZE;
+    }
+
+    static inline UINT64 Hash(UINT64 Key, UINT64 Seed)
+    {
+        Key ^= (Seed + 1) * 0x9E3779B97F4A7C15ULL;
+        Key = (Key ^ (Key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        Key = (Key ^ (Key >> 27)) * 0x94D049BB133111EBULL;
+        return Key ^ (Key >> 31);
+    }
+
+    static inline UINT32 Lookup(UINT64 Key, const UINT32* Displacements, UINT32 BucketCount, UINT32 SlotCount)
+    {
+        if (SlotCount == 0) {
+            return 0;
+        }
+        UINT32 bucket = (UINT32)((Hash(Key, 0) >> 32) % BucketCount);
+        return (UINT32)(Hash(Key, (UINT64)Displacements[bucket] + 1) % SlotCount);
+    }
+};
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include "PowerScheduler.h"
+
+CPowerScheduler::CPowerScheduler(CHardwareInterfaceLib& CHWLib)
+    : m_Walker(CHWLib)
+{
+    m_Read = CCapabilityWalker::LibRead;
+    m_Context = &CHWLib;
+    m_BytesRead = 0;
+}
+
+CPowerScheduler::CPowerScheduler(PFN_CFG_READ Read, PVOID Context)
+    : m_Walker(Read, Context)
+{
+    m_Read = Read;
+    m_Context = Context;
+    m_BytesRead = 0;
+}
+
+UINT32 CPowerScheduler::AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    m_Bdf.push_back((UINT16)(((UINT32)Bus << 8) | ((Device & 0x1F) << 3) | (Function & 0x07)));
+    m_State.push_back(PowerUnknown);
+    m_Outcome.push_back(CapturePending);
+    return (UINT32)m_Bdf.size() - 1;
+}
+
+UserStatus CPowerScheduler::Read(UINT32 Index, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    UINT16 bdf = m_Bdf[Index];
+    UserStatus userStatus = m_Read(m_Context, (UINT8)(bdf >> 8), (UINT8)((bdf >> 3) & 0x1F), (UINT8)(bdf & 0x07), Offset, Data, Size);
+
+    if (userStatus != Success) {
+        m_StatusMessage << "Configuration read failed for Bus: 0x" << std::hex << (bdf >> 8) << ", Device: 0x"
+            << ((bdf >> 3) & 0x1F) << ", Function: 0x" << (bdf & 0x07) << ", Offset: 0x" << Offset;
+    }
+    m_BytesRead += Size;
+    return userStatus;
+}
+
+bool CPowerScheduler::IsBehindDownLink(UINT8 Bus)
+{
+    for (auto& range : m_DownBuses)
+    {
+        if (Bus >= range.m_First && Bus <= range.m_Last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPowerScheduler::ReadState
+
+  Summary:  Reads the vendor id and PMCSR of a function. For a bridge
+            whose PCI Express capability reports Data Link Layer Link
+            Active, a link that is down adds the secondary to subordinate
+            buses to the down ranges.
+
+  Args:     UINT32 Index
+              Function to read.
+
+  Modifies: [m_State, m_DownBuses].
+
+  Returns:  UserStatus
+              Returns error code, the state is PowerUnknown on failure.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPowerScheduler::ReadState(UINT32 Index)
+{
+    UserStatus userStatus = Success;
+    UINT8 bus = (UINT8)(m_Bdf[Index] >> 8);
+    UINT8 device = (UINT8)((m_Bdf[Index] >> 3) & 0x1F);
+    UINT8 function = (UINT8)(m_Bdf[Index] & 0x07);
+    PciVendorId::ValueType vendorId = 0;
+    PciHeaderType::ValueType headerType = 0;
+    PmControlStatus::ValueType controlStatus = 0;
+    PcieLinkCapabilities::ValueType linkCapabilities = 0;
+    PcieLinkStatus::ValueType linkStatus = 0;
+    UINT8 buses[BridgeSubordinateBus::Offset - BridgeSecondaryBus::Offset + 1] = { 0 };
+    UINT32 offset = 0;
+
+    m_State[Index] = PowerUnknown;
+
+    userStatus = Read(Index, PciVendorId::Offset, (PUINT8)&vendorId, PciVendorId::Width);
+    if (userStatus != Success) {
+        return userStatus;
+    }
+    if (vendorId == 0xFFFF) {
+        m_State[Index] = PowerD3Cold;
+        return Success;
+    }
+
+    userStatus = m_Walker.FindCapability(bus, device, function, PCI_CAP_ID_PM, &offset);
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<PmControlStatus>(bus, device, function, controlStatus);
+        if (userStatus != Success) {
+            m_StatusMessage << m_Walker.GetStatusMessage();
+            return userStatus;
+        }
+        m_State[Index] = (controlStatus == 0xFFFF) ? PowerD3Cold : (UINT8)PmPowerState::Get(controlStatus);
+    }
+    else if (userStatus != IndexOutOfRange) {
+        m_StatusMessage << m_Walker.GetStatusMessage();
+        return userStatus;
+    }
+
+    //
+    // Only downstream ports can report Data Link Layer Link Active, a port
+    // that cannot leaves the functions below it to their own PMCSR.
+    //
+    userStatus = Read(Index, PciHeaderType::Offset, (PUINT8)&headerType, PciHeaderType::Width);
+    if (userStatus != Success || PciHeaderLayout::Get(headerType) != 1) {
+        return userStatus;
+    }
+
+    userStatus = m_Walker.FindCapability(bus, device, function, PCI_CAP_ID_PCIe, &offset);
+    if (userStatus == IndexOutOfRange) {
+        return Success;
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<PcieLinkCapabilities>(bus, device, function, linkCapabilities);
+    }
+    if (userStatus == Success && PcieLinkActiveReporting::Get(linkCapabilities)) {
+        userStatus = m_Walker.ReadRegister<PcieLinkStatus>(bus, device, function, linkStatus);
+    }
+    if (userStatus != Success) {
+        m_StatusMessage << m_Walker.GetStatusMessage();
+        return userStatus;
+    }
+    if (!PcieLinkActiveReporting::Get(linkCapabilities) || PcieDataLinkLayerActive::Get(linkStatus)) {
+        return Success;
+    }
+
+    userStatus = Read(Index, BridgeSecondaryBus::Offset, buses, sizeof(buses));
+    if (userStatus == Success && buses[0] != 0 && buses[0] <= buses[sizeof(buses) - 1]) {
+        BusRange range;
+        range.m_First = buses[0];
+        range.m_Last = buses[sizeof(buses) - 1];
+        m_DownBuses.push_back(range);
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPowerScheduler::Classify
+
+  Summary:  Reads the power state of every function in bus order, so that
+            a bridge is read before the buses below it. Functions on a bus
+            below a down link are D3Cold and are not read.
+
+  Args:     None.
+
+  Modifies: [m_State, m_DownBuses].
+
+  Returns:  UserStatus
+              Returns the first failure, the other functions are still
+              classified.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CPowerScheduler::Classify()
+{
+    UserStatus userStatus = Success;
+    std::vector<UINT32> order(m_Bdf.size());
+    m_StatusMessage.str("");
+
+    for (UINT32 index = 0; index < order.size(); index++)
+    {
+        order[index] = index;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](UINT32 Left, UINT32 Right) {
+        return m_Bdf[Left] < m_Bdf[Right];
+    });
+
+    m_DownBuses.clear();
+    for (auto index : order)
+    {
+        UserStatus readStatus = Success;
+
+        if (IsBehindDownLink((UINT8)(m_Bdf[index] >> 8))) {
+            m_State[index] = PowerD3Cold;
+            continue;
+        }
+
+        readStatus = ReadState(index);
+        if (readStatus != Success && userStatus == Success) {
+            userStatus = readStatus;
+        }
+    }
+
+    return userStatus;
+}
+
+//
+// A deferred function is read again even below a down link, the link may
+// have been trained since the first pass.
+//
+UserStatus CPowerScheduler::Reclassify(UINT32 Index)
+{
+    m_StatusMessage.str("");
+    return ReadState(Index);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CPowerScheduler::Schedule
+
+  Summary:  Splits the functions, in the order they were added, into those
+            to capture now and those to capture last. Skipped and
+            deferred functions get their outcome recorded.
+
+  Args:     PowerPolicy Policy
+              PowerCaptureAll puts every function in Now,
+              PowerSkipLowPower drops low power functions,
+              PowerDeferLowPower moves them to Later.
+            std::vector<UINT32>& Now, std::vector<UINT32>& Later
+              Receive the function indexes.
+
+  Modifies: [m_Outcome, Now, Later].
+
+  Returns:  None.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CPowerScheduler::Schedule(PowerPolicy Policy, std::vector<UINT32>& Now, std::vector<UINT32>& Later)
+{
+    Now.clear();
+    Later.clear();
+
+    for (UINT32 index = 0; index < m_Bdf.size(); index++)
+    {
+        if (Policy == PowerCaptureAll || !IsLowPower(index)) {
+            Now.push_back(index);
+        }
+        else if (Policy == PowerSkipLowPower) {
+            m_Outcome[index] = CaptureSkipped;
+        }
+        else {
+            m_Outcome[index] = CaptureDeferred;
+            Later.push_back(index);
+        }
+    }
+}
+
+void CPowerScheduler::SetOutcome(UINT32 Index, CaptureOutcome Outcome)
+{
+    m_Outcome[Index] = (UINT8)Outcome;
+}
+
+std::string CPowerScheduler::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
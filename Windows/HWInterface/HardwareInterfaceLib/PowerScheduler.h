@@ -0,0 +1,154 @@
+#pragma once
+/*+===================================================================
+  File:      PowerScheduler.h
+
+  Summary:   Power state of functions read from the PM capability and the
+             link state of their ports, used to order a capture so that
+             functions in D3 do not stall it.
+
+  Classes:   CPowerScheduler.
+
+  Functions: AddDevice, Classify, Reclassify, Schedule.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "CapabilityWalker.h"
+
+//
+// D0 to D3Hot come from PMCSR. D3Cold is a function reading all ones or
+// below a port whose link is down, PowerUnknown one without the PM
+// capability, which is captured like D0.
+//
+typedef enum
+{
+    PowerD0,
+    PowerD1,
+    PowerD2,
+    PowerD3Hot,
+    PowerD3Cold,
+    PowerUnknown
+}DevicePowerState;
+
+typedef enum
+{
+    PowerCaptureAll,
+    PowerSkipLowPower,
+    PowerDeferLowPower
+}PowerPolicy;
+
+typedef enum
+{
+    CapturePending,
+    CaptureDone,
+    CaptureFailed,
+    CaptureSkipped,
+    CaptureDeferred
+}CaptureOutcome;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CPowerScheduler
+
+  Summary:  Keeps the power state and capture outcome of every function in
+            columns. Classify reads the vendor id and, through the PM
+            capability, PMCSR of each function in bus order. Bridges that
+            report Data Link Layer Link Active and have their link down
+            mark their secondary to subordinate buses as down, functions
+            on them are D3Cold without any read. Schedule orders a capture
+            by the policy: low power (D3Hot, D3Cold) functions are kept,
+            skipped, or moved to a second list captured last, and
+            Reclassify checks a deferred function again just before it is
+            captured.
+
+  Methods:  CPowerScheduler(CHardwareInterfaceLib& CHWLib)
+              Reads through the driver.
+            CPowerScheduler(PFN_CFG_READ Read, PVOID Context)
+              Reads through any other backend.
+            UINT32 AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function)
+              Registers a function and returns its index.
+            UserStatus Classify()
+              Reads the power state of all functions.
+            UserStatus Reclassify(UINT32 Index)
+              Reads the power state of one function again.
+            void Schedule(PowerPolicy Policy, std::vector<UINT32>& Now, std::vector<UINT32>& Later)
+              Returns the functions to capture first and last.
+            bool IsLowPower(UINT32 Index)
+              Returns whether a function is in D3Hot or D3Cold.
+            DevicePowerState GetPowerState(UINT32 Index), CaptureOutcome GetOutcome(UINT32 Index)
+              Return the state and outcome of a function.
+            void SetOutcome(UINT32 Index, CaptureOutcome Outcome)
+              Records how the capture of a function ended.
+            UINT32 GetCount()
+              Returns the number of registered functions.
+            UINT64 GetBytesRead()
+              Returns the configuration space bytes read to classify.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CPowerScheduler
+{
+public:
+    CPowerScheduler(CHardwareInterfaceLib& CHWLib);
+    CPowerScheduler(PFN_CFG_READ Read, PVOID Context);
+    UINT32 AddDevice(UINT8 Bus, UINT8 Device, UINT8 Function);
+    UserStatus Classify();
+    UserStatus Reclassify(UINT32 Index);
+    void Schedule(PowerPolicy Policy, std::vector<UINT32>& Now, std::vector<UINT32>& Later);
+    void SetOutcome(UINT32 Index, CaptureOutcome Outcome);
+    std::string GetStatusMessage();
+
+    bool IsLowPower(UINT32 Index)
+    {
+        return m_State[Index] == PowerD3Hot || m_State[Index] == PowerD3Cold;
+    }
+
+    DevicePowerState GetPowerState(UINT32 Index)
+    {
+        return (DevicePowerState)m_State[Index];
+    }
+
+    CaptureOutcome GetOutcome(UINT32 Index)
+    {
+        return (CaptureOutcome)m_Outcome[Index];
+    }
+
+    UINT32 GetCount()
+    {
+        return (UINT32)m_Bdf.size();
+    }
+
+    UINT64 GetBytesRead()
+    {
+        return m_BytesRead + m_Walker.GetBytesRead();
+    }
+
+private:
+    //
+    // Secondary to subordinate bus range of a bridge whose link is down.
+    //
+    struct BusRange
+    {
+        UINT8 m_First;
+        UINT8 m_Last;
+    };
+
+    UserStatus Read(UINT32 Index, UINT32 Offset, PUINT8 Data, UINT32 Size);
+    UserStatus ReadState(UINT32 Index);
+    bool IsBehindDownLink(UINT8 Bus);
+
+    PFN_CFG_READ m_Read;
+    PVOID m_Context;
+    CCapabilityWalker m_Walker;
+    std::vector<UINT16> m_Bdf;
+    std::vector<UINT8> m_State;
+    std::vector<UINT8> m_Outcome;
+    std::vector<BusRange> m_DownBuses;
+    UINT64 m_BytesRead;
+    std::stringstream m_StatusMessage;
+};
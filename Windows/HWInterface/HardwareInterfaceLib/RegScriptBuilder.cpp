@@ -0,0 +1,152 @@
+#include "RegScriptBuilder.h"
+
+CRegScriptBuilder::CRegScriptBuilder(UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 MmioBase)
+{
+    m_Header.m_Bus = Bus;
+    m_Header.m_Device = Device;
+    m_Header.m_Function = Function;
+    m_Header.m_Reserved = 0;
+    m_Header.m_MmioBase = MmioBase;
+    m_Header.m_OpCount = 0;
+    m_ResultCount = 0;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegScriptBuilder::AppendOp
+
+  Summary:  Appends an op to the script.
+
+  Args:     UINT8 OpCode, UINT8 Space, UINT32 Offset, UINT8 Width,
+            UINT32 Value, UINT32 Mask, UINT32 Param
+              Op fields, see RegScriptOp.
+
+  Modifies: [m_Ops, m_ResultCount].
+
+  Returns:  Index of the op, or its result slot for READ/POLL ops.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CRegScriptBuilder::AppendOp(UINT8 OpCode, UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value, UINT32 Mask, UINT32 Param)
+{
+    RegScriptOp op;
+    op.m_OpCode = OpCode;
+    op.m_Space = Space;
+    op.m_Width = Width;
+    op.m_Reserved = 0;
+    op.m_Offset = Offset;
+    op.m_Value = Value;
+    op.m_Mask = Mask;
+    op.m_Param = Param;
+    m_Ops.push_back(op);
+
+    if (OpCode == REG_SCRIPT_OP_READ || OpCode == REG_SCRIPT_OP_POLL) {
+        return m_ResultCount++;
+    }
+
+    return (UINT32)(m_Ops.size() - 1);
+}
+
+UINT32 CRegScriptBuilder::Read(UINT8 Space, UINT32 Offset, UINT8 Width)
+{
+    return AppendOp(REG_SCRIPT_OP_READ, Space, Offset, Width, 0, 0, 0);
+}
+
+void CRegScriptBuilder::Write(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value)
+{
+    AppendOp(REG_SCRIPT_OP_WRITE, Space, Offset, Width, Value, 0, 0);
+}
+
+void CRegScriptBuilder::ReadModifyWrite(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value)
+{
+    AppendOp(REG_SCRIPT_OP_RMW, Space, Offset, Width, Value, Mask, 0);
+}
+
+UINT32 CRegScriptBuilder::Poll(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value, UINT32 TimeoutUs)
+{
+    return AppendOp(REG_SCRIPT_OP_POLL, Space, Offset, Width, Value, Mask, TimeoutUs);
+}
+
+void CRegScriptBuilder::Delay(UINT32 Microseconds)
+{
+    AppendOp(REG_SCRIPT_OP_DELAY, 0, 0, 0, 0, 0, Microseconds);
+}
+
+UINT32 CRegScriptBuilder::BranchIfEqual(UINT32 Mask, UINT32 Value)
+{
+    return AppendOp(REG_SCRIPT_OP_BRANCH_EQ, 0, 0, 0, Value, Mask, 0);
+}
+
+UINT32 CRegScriptBuilder::BranchIfNotEqual(UINT32 Mask, UINT32 Value)
+{
+    return AppendOp(REG_SCRIPT_OP_BRANCH_NE, 0, 0, 0, Value, Mask, 0);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegScriptBuilder::SetBranchTarget
+
+  Summary:  Makes a branch jump to the next op appended, or to the end of
+            the script if nothing else is appended.
+
+  Args:     UINT32 BranchOp
+              Op index returned by BranchIfEqual/BranchIfNotEqual.
+
+  Modifies: [m_Ops].
+
+  Returns:  None
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+void CRegScriptBuilder::SetBranchTarget(UINT32 BranchOp)
+{
+    if (BranchOp < m_Ops.size()) {
+        m_Ops[BranchOp].m_Param = (UINT32)m_Ops.size();
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegScriptBuilder::Execute
+
+  Summary:  Executes the script with a single driver request.
+
+  Args:     CHardwareInterfaceLib& CHWLib
+              Initialised hardware interface library.
+
+  Modifies: [m_Result].
+
+  Returns:  UserStatus
+              Returns error code, CHWLib.GetStatusMessage() has the reason.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegScriptBuilder::Execute(CHardwareInterfaceLib& CHWLib)
+{
+    std::vector<UINT8> script(sizeof(RegScriptHeader) + m_Ops.size() * sizeof(RegScriptOp));
+
+    m_Header.m_OpCount = (UINT32)m_Ops.size();
+    memcpy(script.data(), &m_Header, sizeof(m_Header));
+    if (!m_Ops.empty()) {
+        memcpy(script.data() + sizeof(m_Header), m_Ops.data(), m_Ops.size() * sizeof(RegScriptOp));
+    }
+
+    m_Result.assign(sizeof(RegScriptResult) + m_ResultCount * sizeof(UINT32), 0xFF);
+
+    return CHWLib.RegScriptExecute((PRegScriptHeader)script.data(), (UINT32)script.size(),
+                                   (PRegScriptResult)m_Result.data(), (UINT32)m_Result.size());
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegScriptBuilder::GetResult
+
+  Summary:  Returns the value of a result slot after Execute.
+
+  Args:     UINT32 Slot
+              Result slot returned by Read/Poll.
+
+  Modifies: None
+
+  Returns:  Register value, 0xFFFFFFFF if the op did not run.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CRegScriptBuilder::GetResult(UINT32 Slot)
+{
+    UINT32 value = 0xFFFFFFFF;
+
+    if (Slot < m_ResultCount && m_Result.size() >= sizeof(RegScriptResult) + (Slot + 1) * sizeof(UINT32)) {
+        memcpy(&value, m_Result.data() + sizeof(RegScriptResult) + Slot * sizeof(UINT32), sizeof(value));
+    }
+
+    return value;
+}
@@ -0,0 +1,72 @@
+#pragma once
+/*+===================================================================
+  File:      RegScriptBuilder.h
+
+  Summary:   Builds register scripts for CHardwareInterfaceLib::RegScriptExecute.
+
+  Classes:   CRegScriptBuilder.
+
+  Functions: Read, Write, ReadModifyWrite, Poll, Delay, BranchIfEqual,
+             BranchIfNotEqual, SetBranchTarget.
+
+  Origin:    
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <vector>
+#include "HardwareInterfaceLib.h"
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CRegScriptBuilder
+
+  Summary:  Builds a register script for one device and collects its results.
+
+  Methods:  CRegScriptBuilder(UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 MmioBase)
+              Constructor, sets the script target.
+            UINT32 Read(UINT8 Space, UINT32 Offset, UINT8 Width)
+              Appends a read, returns its result slot.
+            void Write(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value)
+              Appends a write.
+            void ReadModifyWrite(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value)
+              Appends a read-modify-write of the bits in Mask.
+            UINT32 Poll(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value, UINT32 TimeoutUs)
+              Appends a poll, returns its result slot.
+            void Delay(UINT32 Microseconds)
+              Appends a delay.
+            UINT32 BranchIfEqual(UINT32 Mask, UINT32 Value)
+              Appends a forward branch taken if (last value & Mask) == Value, returns the op index.
+            UINT32 BranchIfNotEqual(UINT32 Mask, UINT32 Value)
+              Appends a forward branch taken if (last value & Mask) != Value, returns the op index.
+            void SetBranchTarget(UINT32 BranchOp)
+              Makes the branch jump to the next op appended.
+            UserStatus Execute(CHardwareInterfaceLib& CHWLib)
+              Executes the script and keeps its results.
+            UINT32 GetResult(UINT32 Slot)
+              Returns the value of a result slot after Execute.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CRegScriptBuilder
+{
+public:
+    CRegScriptBuilder(UINT8 Bus, UINT8 Device, UINT8 Function, UINT64 MmioBase = 0);
+    UINT32 Read(UINT8 Space, UINT32 Offset, UINT8 Width);
+    void Write(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value);
+    void ReadModifyWrite(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value);
+    UINT32 Poll(UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Mask, UINT32 Value, UINT32 TimeoutUs);
+    void Delay(UINT32 Microseconds);
+    UINT32 BranchIfEqual(UINT32 Mask, UINT32 Value);
+    UINT32 BranchIfNotEqual(UINT32 Mask, UINT32 Value);
+    void SetBranchTarget(UINT32 BranchOp);
+    UserStatus Execute(CHardwareInterfaceLib& CHWLib);
+    UINT32 GetResult(UINT32 Slot);
+
+private:
+    UINT32 AppendOp(UINT8 OpCode, UINT8 Space, UINT32 Offset, UINT8 Width, UINT32 Value, UINT32 Mask, UINT32 Param);
+
+    RegScriptHeader m_Header;
+    std::vector<RegScriptOp> m_Ops;
+    std::vector<UINT8> m_Result;
+    UINT32 m_ResultCount;
+};
@@ -0,0 +1,378 @@
+#pragma once
+/*+===================================================================
+  File:      RegisterDefs.h
+
+  Summary:   Compile-time register and field definitions for configuration
+             space, the standard header and common capabilities.
+
+  Classes:   Register, RegisterField, ConfigSpace, CapabilitySpace,
+             ExtendedCapabilitySpace.
+
+  Functions: RegistersDisjoint, FieldsDisjoint.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <Windows.h>
+#include <type_traits>
+#include "..\HardwareInterfaceDrv\Public.h"
+
+//
+// Standard capability ids.
+//
+#define PCI_CAP_ID_PM                   0x01
+#define PCI_CAP_ID_MSI                  0x05
+#define PCI_CAP_ID_VENDOR               0x09
+#define PCI_CAP_ID_PCIe                 0x10
+#define PCI_CAP_ID_MSIX                 0x11
+
+//
+// Extended capability ids.
+//
+#define PCIe_EXT_CAP_ID_AER             0x0001
+#define PCIe_EXT_CAP_ID_VC              0x0002
+#define PCIe_EXT_CAP_ID_DSN             0x0003
+#define PCIe_EXT_CAP_ID_POWER_BUDGET    0x0004
+#define PCIe_EXT_CAP_ID_VENDOR          0x000B
+#define PCIe_EXT_CAP_ID_ACS             0x000D
+#define PCIe_EXT_CAP_ID_ARI             0x000E
+#define PCIe_EXT_CAP_ID_ATS             0x000F
+#define PCIe_EXT_CAP_ID_SRIOV           0x0010
+#define PCIe_EXT_CAP_ID_PRI             0x0013
+#define PCIe_EXT_CAP_ID_LTR             0x0018
+#define PCIe_EXT_CAP_ID_L1SS            0x001E
+#define PCIe_EXT_CAP_ID_PTM             0x001F
+#define PCIe_EXT_CAP_ID_DVSEC           0x0023
+
+typedef enum
+{
+    RegisterReadOnly,
+    RegisterReadWrite,
+    RegisterWriteOneClear
+}RegisterAccess;
+
+//
+// Address spaces of register definitions. ConfigSpace offsets are absolute,
+// capability offsets are relative to the capability header, which is found
+// at run time by CCapabilityWalker.
+//
+struct ConfigSpace
+{
+    static constexpr bool IsCapability = false;
+    static constexpr bool IsExtended = false;
+    static constexpr UINT16 Id = 0;
+};
+
+template <UINT8 TId>
+struct CapabilitySpace
+{
+    static constexpr bool IsCapability = true;
+    static constexpr bool IsExtended = false;
+    static constexpr UINT16 Id = TId;
+};
+
+template <UINT16 TId>
+struct ExtendedCapabilitySpace
+{
+    static constexpr bool IsCapability = true;
+    static constexpr bool IsExtended = true;
+    static constexpr UINT16 Id = TId;
+};
+
+template <UINT32 TWidth> struct RegisterValueType;
+template <> struct RegisterValueType<1> { typedef UINT8 Type; };
+template <> struct RegisterValueType<2> { typedef UINT16 Type; };
+template <> struct RegisterValueType<4> { typedef UINT32 Type; };
+template <> struct RegisterValueType<8> { typedef UINT64 Type; };
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    Register
+
+  Summary:  A register of TWidth bytes at TOffset of TSpace. The value type
+            and access width follow from TWidth, definitions that are not
+            naturally aligned or leave configuration space do not compile.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+template <typename TSpace, UINT32 TOffset, UINT32 TWidth, RegisterAccess TAccess>
+struct Register
+{
+    static_assert(TWidth == 1 || TWidth == 2 || TWidth == 4 || TWidth == 8, "Register width must be 1, 2, 4 or 8 bytes");
+    static_assert(TOffset % TWidth == 0, "Register is not naturally aligned");
+    static_assert(TOffset + TWidth <= (TSpace::IsCapability && !TSpace::IsExtended ? PCI_CFG_SIZE : PCIe_CFG_SIZE),
+                  "Register is outside its configuration space");
+
+    typedef TSpace Space;
+    typedef typename RegisterValueType<TWidth>::Type ValueType;
+    static constexpr UINT32 Offset = TOffset;
+    static constexpr UINT32 Width = TWidth;
+    static constexpr RegisterAccess Access = TAccess;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    RegisterField
+
+  Summary:  TBits bits of TRegister starting at bit TLsb. Get, Set and
+            Isolate are constant expressions, so a field read is the
+            register access plus one shift and mask.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+template <typename TRegister, UINT32 TLsb, UINT32 TBits, RegisterAccess TAccess = TRegister::Access>
+struct RegisterField
+{
+    static_assert(TBits > 0 && TLsb + TBits <= TRegister::Width * 8, "Field does not fit its register");
+    static_assert(TRegister::Access != RegisterReadOnly || TAccess == RegisterReadOnly, "Field of a read-only register must be read-only");
+
+    typedef TRegister Register;
+    typedef typename TRegister::ValueType ValueType;
+    static constexpr UINT32 Lsb = TLsb;
+    static constexpr UINT32 Bits = TBits;
+    static constexpr RegisterAccess Access = TAccess;
+    static constexpr ValueType Mask = (ValueType)(((TBits >= 64) ? ~0ULL : ((1ULL << TBits) - 1)) << TLsb);
+
+    static constexpr ValueType Get(ValueType RegisterValue)
+    {
+        return (ValueType)((RegisterValue & Mask) >> TLsb);
+    }
+
+    static constexpr ValueType Set(ValueType RegisterValue, ValueType FieldValue)
+    {
+        return (ValueType)((RegisterValue & ~Mask) | (((UINT64)FieldValue << TLsb) & Mask));
+    }
+
+    static constexpr ValueType Isolate(ValueType RegisterValue)
+    {
+        return (ValueType)(RegisterValue & Mask);
+    }
+};
+
+//
+// RegistersDisjoint<R...>() and FieldsDisjoint<F...>() are true when no two
+// registers of the same space share a byte and no two fields of the same
+// register share a bit, use them in a static_assert after each block of
+// definitions listing every register and every field of the block.
+//
+template <typename... T> struct DefinitionList {};
+
+template <typename A>
+constexpr bool RegisterOverlapsNone()
+{
+    return true;
+}
+
+template <typename A, typename B, typename... Rest>
+constexpr bool RegisterOverlapsNone()
+{
+    return !(std::is_same<typename A::Space, typename B::Space>::value &&
+             A::Offset < B::Offset + B::Width && B::Offset < A::Offset + A::Width) &&
+           RegisterOverlapsNone<A, Rest...>();
+}
+
+constexpr bool RegistersDisjoint(DefinitionList<>)
+{
+    return true;
+}
+
+template <typename First, typename... Rest>
+constexpr bool RegistersDisjoint(DefinitionList<First, Rest...>)
+{
+    return RegisterOverlapsNone<First, Rest...>() && RegistersDisjoint(DefinitionList<Rest...>());
+}
+
+template <typename... Registers>
+constexpr bool RegistersDisjoint()
+{
+    return RegistersDisjoint(DefinitionList<Registers...>());
+}
+
+template <typename A>
+constexpr bool FieldOverlapsNone()
+{
+    return true;
+}
+
+template <typename A, typename B, typename... Rest>
+constexpr bool FieldOverlapsNone()
+{
+    return !(std::is_same<typename A::Register, typename B::Register>::value && ((UINT64)A::Mask & (UINT64)B::Mask) != 0) &&
+           FieldOverlapsNone<A, Rest...>();
+}
+
+constexpr bool FieldsDisjoint(DefinitionList<>)
+{
+    return true;
+}
+
+template <typename First, typename... Rest>
+constexpr bool FieldsDisjoint(DefinitionList<First, Rest...>)
+{
+    return FieldOverlapsNone<First, Rest...>() && FieldsDisjoint(DefinitionList<Rest...>());
+}
+
+template <typename... Fields>
+constexpr bool FieldsDisjoint()
+{
+    return FieldsDisjoint(DefinitionList<Fields...>());
+}
+
+//
+// Standard configuration header.
+//
+typedef Register<ConfigSpace, 0x00, 2, RegisterReadOnly>        PciVendorId;
+typedef Register<ConfigSpace, 0x02, 2, RegisterReadOnly>        PciDeviceId;
+typedef Register<ConfigSpace, 0x04, 2, RegisterReadWrite>       PciCommand;
+typedef Register<ConfigSpace, 0x06, 2, RegisterWriteOneClear>   PciStatus;
+typedef Register<ConfigSpace, 0x08, 4, RegisterReadOnly>        PciClassRevision;
+typedef Register<ConfigSpace, 0x0E, 1, RegisterReadOnly>        PciHeaderType;
+typedef Register<ConfigSpace, 0x10, 4, RegisterReadWrite>       PciBar0;
+typedef Register<ConfigSpace, 0x14, 4, RegisterReadWrite>       PciBar1;
+typedef Register<ConfigSpace, 0x18, 4, RegisterReadWrite>       PciBar2;
+typedef Register<ConfigSpace, 0x1C, 4, RegisterReadWrite>       PciBar3;
+typedef Register<ConfigSpace, 0x20, 4, RegisterReadWrite>       PciBar4;
+typedef Register<ConfigSpace, 0x24, 4, RegisterReadWrite>       PciBar5;
+typedef Register<ConfigSpace, 0x2C, 4, RegisterReadOnly>        PciSubsystem;
+typedef Register<ConfigSpace, 0x34, 1, RegisterReadOnly>        PciCapabilitiesPointer;
+typedef Register<ConfigSpace, 0x3C, 1, RegisterReadWrite>       PciInterruptLine;
+typedef Register<ConfigSpace, 0x3D, 1, RegisterReadOnly>        PciInterruptPin;
+
+static_assert(RegistersDisjoint<PciVendorId, PciDeviceId, PciCommand, PciStatus, PciClassRevision, PciHeaderType,
+                                PciBar0, PciBar1, PciBar2, PciBar3, PciBar4, PciBar5, PciSubsystem,
+                                PciCapabilitiesPointer, PciInterruptLine, PciInterruptPin>(), "Standard header registers overlap");
+
+typedef RegisterField<PciCommand, 0, 1>     PciCommandIoSpace;
+typedef RegisterField<PciCommand, 1, 1>     PciCommandMemorySpace;
+typedef RegisterField<PciCommand, 2, 1>     PciCommandBusMaster;
+typedef RegisterField<PciCommand, 10, 1>    PciCommandInterruptDisable;
+typedef RegisterField<PciStatus, 4, 1, RegisterReadOnly> PciStatusCapabilitiesList;
+typedef RegisterField<PciStatus, 15, 1>     PciStatusParityError;
+typedef RegisterField<PciClassRevision, 0, 8> PciRevisionId;
+typedef RegisterField<PciClassRevision, 8, 24> PciClassCode;
+typedef RegisterField<PciHeaderType, 0, 7>  PciHeaderLayout;
+typedef RegisterField<PciHeaderType, 7, 1>  PciHeaderMultiFunction;
+typedef RegisterField<PciSubsystem, 0, 16>  PciSubsystemVendorId;
+typedef RegisterField<PciSubsystem, 16, 16> PciSubsystemId;
+
+static_assert(FieldsDisjoint<PciCommandIoSpace, PciCommandMemorySpace, PciCommandBusMaster, PciCommandInterruptDisable,
+                             PciStatusCapabilitiesList, PciStatusParityError, PciRevisionId, PciClassCode, PciHeaderLayout, PciHeaderMultiFunction,
+                             PciSubsystemVendorId, PciSubsystemId>(), "Standard header fields overlap");
+
+//
+// Type 1 (bridge) header bus numbers, they share offsets with BAR2 of the
+// type 0 header.
+//
+typedef Register<ConfigSpace, 0x18, 1, RegisterReadWrite>       BridgePrimaryBus;
+typedef Register<ConfigSpace, 0x19, 1, RegisterReadWrite>       BridgeSecondaryBus;
+typedef Register<ConfigSpace, 0x1A, 1, RegisterReadWrite>       BridgeSubordinateBus;
+
+static_assert(RegistersDisjoint<BridgePrimaryBus, BridgeSecondaryBus, BridgeSubordinateBus>(), "Bridge bus number registers overlap");
+
+//
+// Host bridge PCI Express extended configuration base (PCIEXBAR), the base
+// address bits are used in place.
+//
+typedef Register<ConfigSpace, 0x60, 8, RegisterReadWrite>       HostBridgePciExBar;
+typedef RegisterField<HostBridgePciExBar, 26, 10>               HostBridgePciExBarAddress;
+
+static_assert(RegistersDisjoint<PciVendorId, PciDeviceId, PciCommand, PciStatus, PciClassRevision, PciHeaderType,
+                                PciBar0, PciBar1, PciBar2, PciBar3, PciBar4, PciBar5, PciSubsystem,
+                                PciCapabilitiesPointer, PciInterruptLine, PciInterruptPin, HostBridgePciExBar>(),
+              "Host bridge registers overlap the standard header");
+static_assert(FieldsDisjoint<HostBridgePciExBarAddress>(), "Host bridge fields overlap");
+
+//
+// Power management capability.
+//
+typedef CapabilitySpace<PCI_CAP_ID_PM> PmCapability;
+typedef Register<PmCapability, 0x02, 2, RegisterReadOnly>       PmCapabilities;
+typedef Register<PmCapability, 0x04, 2, RegisterReadWrite>      PmControlStatus;
+
+typedef RegisterField<PmControlStatus, 0, 2>                    PmPowerState;
+typedef RegisterField<PmControlStatus, 3, 1, RegisterReadOnly>  PmNoSoftReset;
+typedef RegisterField<PmControlStatus, 8, 1>                    PmPmeEnable;
+typedef RegisterField<PmControlStatus, 15, 1>                   PmPmeStatus;
+
+static_assert(RegistersDisjoint<PmCapabilities, PmControlStatus>(), "Power management registers overlap");
+static_assert(FieldsDisjoint<PmPowerState, PmNoSoftReset, PmPmeEnable, PmPmeStatus>(), "Power management fields overlap");
+
+//
+// PCI Express capability.
+//
+typedef CapabilitySpace<PCI_CAP_ID_PCIe> PcieCapability;
+typedef Register<PcieCapability, 0x02, 2, RegisterReadOnly>     PcieCapabilities;
+typedef Register<PcieCapability, 0x04, 4, RegisterReadOnly>     PcieDeviceCapabilities;
+typedef Register<PcieCapability, 0x08, 2, RegisterReadWrite>    PcieDeviceControl;
+typedef Register<PcieCapability, 0x0A, 2, RegisterWriteOneClear> PcieDeviceStatus;
+typedef Register<PcieCapability, 0x0C, 4, RegisterReadOnly>     PcieLinkCapabilities;
+typedef Register<PcieCapability, 0x10, 2, RegisterReadWrite>    PcieLinkControl;
+typedef Register<PcieCapability, 0x12, 2, RegisterReadOnly>     PcieLinkStatus;
+
+static_assert(RegistersDisjoint<PcieCapabilities, PcieDeviceCapabilities, PcieDeviceControl, PcieDeviceStatus,
+                                PcieLinkCapabilities, PcieLinkControl, PcieLinkStatus>(), "PCI Express registers overlap");
+
+typedef RegisterField<PcieCapabilities, 4, 4>                   PcieDevicePortType;
+typedef RegisterField<PcieDeviceCapabilities, 0, 3>             PcieMaxPayloadSupported;
+typedef RegisterField<PcieDeviceControl, 5, 3>                  PcieMaxPayloadSize;
+typedef RegisterField<PcieDeviceControl, 12, 3>                 PcieMaxReadRequestSize;
+typedef RegisterField<PcieDeviceStatus, 0, 1>                   PcieCorrectableErrorDetected;
+typedef RegisterField<PcieDeviceStatus, 1, 1>                   PcieNonFatalErrorDetected;
+typedef RegisterField<PcieDeviceStatus, 2, 1>                   PcieFatalErrorDetected;
+typedef RegisterField<PcieLinkCapabilities, 0, 4>               PcieMaxLinkSpeed;
+typedef RegisterField<PcieLinkCapabilities, 4, 6>               PcieMaxLinkWidth;
+typedef RegisterField<PcieLinkCapabilities, 20, 1>              PcieLinkActiveReporting;
+typedef RegisterField<PcieLinkControl, 0, 2>                    PcieAspmControl;
+typedef RegisterField<PcieLinkStatus, 0, 4>                     PcieCurrentLinkSpeed;
+typedef RegisterField<PcieLinkStatus, 4, 6>                     PcieNegotiatedLinkWidth;
+typedef RegisterField<PcieLinkStatus, 11, 1>                    PcieLinkTraining;
+typedef RegisterField<PcieLinkStatus, 13, 1>                    PcieDataLinkLayerActive;
+
+static_assert(FieldsDisjoint<PcieDevicePortType, PcieMaxPayloadSupported, PcieMaxPayloadSize, PcieMaxReadRequestSize, PcieCorrectableErrorDetected, PcieNonFatalErrorDetected,
+                             PcieFatalErrorDetected, PcieMaxLinkSpeed, PcieMaxLinkWidth, PcieLinkActiveReporting, PcieCurrentLinkSpeed,
+                             PcieNegotiatedLinkWidth, PcieLinkTraining, PcieDataLinkLayerActive>(), "PCI Express fields overlap");
+
+//
+// Advanced error reporting extended capability.
+//
+typedef ExtendedCapabilitySpace<PCIe_EXT_CAP_ID_AER> AerCapability;
+typedef Register<AerCapability, 0x04, 4, RegisterWriteOneClear> AerUncorrectableStatus;
+typedef Register<AerCapability, 0x08, 4, RegisterReadWrite>     AerUncorrectableMask;
+typedef Register<AerCapability, 0x0C, 4, RegisterReadWrite>     AerUncorrectableSeverity;
+typedef Register<AerCapability, 0x10, 4, RegisterWriteOneClear> AerCorrectableStatus;
+typedef Register<AerCapability, 0x14, 4, RegisterReadWrite>     AerCorrectableMask;
+typedef Register<AerCapability, 0x18, 4, RegisterReadWrite>     AerCapabilitiesControl;
+
+static_assert(RegistersDisjoint<AerUncorrectableStatus, AerUncorrectableMask, AerUncorrectableSeverity,
+                                AerCorrectableStatus, AerCorrectableMask, AerCapabilitiesControl>(), "AER registers overlap");
+
+//
+// Single root I/O virtualization extended capability.
+//
+typedef ExtendedCapabilitySpace<PCIe_EXT_CAP_ID_SRIOV> SriovCapability;
+typedef Register<SriovCapability, 0x08, 2, RegisterReadWrite>   SriovControl;
+typedef Register<SriovCapability, 0x0A, 2, RegisterReadOnly>    SriovStatus;
+typedef Register<SriovCapability, 0x0C, 2, RegisterReadOnly>    SriovInitialVFs;
+typedef Register<SriovCapability, 0x0E, 2, RegisterReadOnly>    SriovTotalVFs;
+typedef Register<SriovCapability, 0x10, 2, RegisterReadWrite>   SriovNumVFs;
+typedef Register<SriovCapability, 0x14, 2, RegisterReadOnly>    SriovFirstVfOffset;
+typedef Register<SriovCapability, 0x16, 2, RegisterReadOnly>    SriovVfStride;
+typedef Register<SriovCapability, 0x1A, 2, RegisterReadOnly>    SriovVfDeviceId;
+
+static_assert(RegistersDisjoint<SriovControl, SriovStatus, SriovInitialVFs, SriovTotalVFs, SriovNumVFs,
+                                SriovFirstVfOffset, SriovVfStride, SriovVfDeviceId>(), "SR-IOV registers overlap");
+
+typedef RegisterField<SriovControl, 0, 1>                       SriovVfEnable;
+typedef RegisterField<SriovControl, 3, 1>                       SriovVfMemorySpaceEnable;
+
+static_assert(FieldsDisjoint<SriovVfEnable, SriovVfMemorySpaceEnable>(), "SR-IOV fields overlap");
+
+//
+// Vendor specific and designated vendor specific extended capabilities, both
+// carry their length in the dword after the header.
+//
+typedef ExtendedCapabilitySpace<PCIe_EXT_CAP_ID_VENDOR> VendorSpecificCapability;
+typedef Register<VendorSpecificCapability, 0x04, 4, RegisterReadOnly> VendorSpecificHeader;
+typedef RegisterField<VendorSpecificHeader, 0, 16>              VendorSpecificId;
+typedef RegisterField<VendorSpecificHeader, 20, 12>             VendorSpecificLength;
+
+static_assert(RegistersDisjoint<VendorSpecificHeader>(), "Vendor specific registers overlap");
+static_assert(FieldsDisjoint<VendorSpecificId, VendorSpecificLength>(), "Vendor specific fields overlap");
@@ -0,0 +1,700 @@
+#include <algorithm>
+#include "RegisterIndex.h"
+
+#define REGISTER_INDEX_ALIGN(x)     (((x) + 7) & ~(UINT64)7)
+#define REGISTER_INDEX_BDF(b, d, f) (UINT16)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+
+static inline UINT32 BlobDword(const std::vector<UINT8>& Blob, UINT32 Column)
+{
+    UINT32 value = 0xFFFFFFFF;
+    if ((Column + 1) * sizeof(UINT32) <= Blob.size()) {
+        memcpy(&value, Blob.data() + Column * sizeof(UINT32), sizeof(value));
+    }
+    return value;
+}
+
+static inline bool CompareValue(UINT32 Left, RegisterCompare Compare, UINT32 Right)
+{
+    switch (Compare)
+    {
+        case CompareEqual:          return Left == Right;
+        case CompareNotEqual:       return Left != Right;
+        case CompareGreater:        return Left > Right;
+        case CompareGreaterEqual:   return Left >= Right;
+        case CompareLess:           return Left < Right;
+        case CompareLessEqual:      return Left <= Right;
+    }
+    return false;
+}
+
+CRegisterIndexBuilder::CRegisterIndexBuilder()
+{
+    m_CurrentHost = 0;
+}
+
+UINT32 CRegisterIndexBuilder::AddHost(const std::string& HostName)
+{
+    m_HostNames.push_back(HostName);
+    m_CurrentHost = (UINT32)(m_HostNames.size() - 1);
+    return m_CurrentHost;
+}
+
+UINT32 CRegisterIndexBuilder::AddBlob(const UINT8* Data, UINT32 Size)
+{
+    Hash128 hash = CHash128::Compute(Data, Size, Size);
+
+    auto found = m_BlobIndex.find(hash);
+    if (found != m_BlobIndex.end()) {
+        return found->second;
+    }
+
+    m_Blobs.emplace_back(Data, Data + Size);
+    m_BlobIndex.emplace(hash, (UINT32)(m_Blobs.size() - 1));
+    return (UINT32)(m_Blobs.size() - 1);
+}
+
+//
+// A function captured twice, e.g. by both the 256 byte and the 4 KB dump,
+// keeps the larger capture.
+//
+void CRegisterIndexBuilder::AddRow(UINT32 Host, UINT16 Bdf, UINT32 Blob)
+{
+    UINT64 key = ((UINT64)Host << 16) | Bdf;
+
+    auto found = m_RowIndex.find(key);
+    if (found != m_RowIndex.end()) {
+        if (m_Blobs[Blob].size() >= m_Blobs[m_RowBlob[found->second]].size()) {
+            m_RowBlob[found->second] = Blob;
+        }
+        return;
+    }
+
+    m_RowIndex.emplace(key, (UINT32)m_RowBlob.size());
+    m_RowHost.push_back(Host);
+    m_RowBdf.push_back(Bdf);
+    m_RowBlob.push_back(Blob);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndexBuilder::Add
+
+  Summary:  Adds the capture of a function of the current host, a host is
+            created from the computer name if none was added.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Location of the captured function.
+            const UINT8* Data
+              Configuration space capture starting at offset 0.
+            UINT32 Size
+              Capture size in bytes, a multiple of 4 up to 4 KB.
+
+  Modifies: [m_Blobs, m_RowHost, m_RowBdf, m_RowBlob].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndexBuilder::Add(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size)
+{
+    m_StatusMessage.str("");
+
+    if (Data == NULL || Size == 0 || Size % sizeof(UINT32) || Size > PCIe_CFG_SIZE) {
+        m_StatusMessage << "Capture size 0x" << std::hex << Size << " is invalid";
+        return IndexOutOfRange;
+    }
+
+    if (m_HostNames.empty()) {
+        CHAR hostName[MAX_COMPUTERNAME_LENGTH + 1] = { 0 };
+        DWORD hostNameLength = sizeof(hostName);
+        GetComputerNameA(hostName, &hostNameLength);
+        AddHost(hostName);
+    }
+
+    AddRow(m_CurrentHost, REGISTER_INDEX_BDF(Bus, Device, Function), AddBlob(Data, Size));
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndexBuilder::AddArchive
+
+  Summary:  Adds every host of an archive, archive blobs are already unique
+            so each is hashed once however many functions share it.
+
+  Args:     CConfigArchiveReader& Archive
+              Open archive.
+
+  Modifies: [m_HostNames, m_Blobs, m_RowHost, m_RowBdf, m_RowBlob].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndexBuilder::AddArchive(CConfigArchiveReader& Archive)
+{
+    UserStatus userStatus = Success;
+    std::vector<UINT32> blobs(Archive.GetHeader().m_BlobCount);
+    m_StatusMessage.str("");
+
+    for (UINT32 id = 0; id < blobs.size(); id++)
+    {
+        const UINT8* data = NULL;
+        UINT32 size = 0;
+
+        userStatus = Archive.GetBlob(id, &data, &size);
+        if (userStatus != Success || size == 0 || size % sizeof(UINT32) || size > PCIe_CFG_SIZE) {
+            m_StatusMessage << "Archive blob 0x" << std::hex << id << " is invalid";
+            return (userStatus != Success) ? userStatus : IndexOutOfRange;
+        }
+        blobs[id] = AddBlob(data, size);
+    }
+
+    for (UINT32 hostIndex = 0; hostIndex < Archive.GetHeader().m_HostCount; hostIndex++)
+    {
+        const ConfigArchiveHost* host = NULL;
+        const ConfigArchiveEntry* entries = NULL;
+        UINT32 count = 0;
+
+        userStatus = Archive.GetHost(hostIndex, &host);
+        if (userStatus == Success) {
+            userStatus = Archive.GetEntries(hostIndex, &entries, &count);
+        }
+        if (userStatus != Success) {
+            m_StatusMessage << Archive.GetStatusMessage();
+            return userStatus;
+        }
+
+        AddHost(std::string(host->m_HostName, strnlen(host->m_HostName, sizeof(host->m_HostName))));
+        for (UINT32 i = 0; i < count; i++)
+        {
+            if (entries[i].m_BlobId >= blobs.size()) {
+                m_StatusMessage << "Archive entry references blob 0x" << std::hex << entries[i].m_BlobId;
+                return IndexOutOfRange;
+            }
+            AddRow(m_CurrentHost, REGISTER_INDEX_BDF(entries[i].m_Bus, entries[i].m_Device, entries[i].m_Function), blobs[entries[i].m_BlobId]);
+        }
+    }
+
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndexBuilder::Write
+
+  Summary:  Dictionary encodes every register column over the unique
+            captures and writes the index.
+
+  Args:     const std::string& FileName
+              Index file to create.
+
+  Modifies: None
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndexBuilder::Write(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    DWORD bytesWritten = 0;
+    RegisterIndexHeader header;
+    std::vector<RegisterIndexColumn> columns(REGISTER_INDEX_COLUMNS);
+    std::vector<std::vector<UINT32>> dictionaries(REGISTER_INDEX_COLUMNS);
+    std::vector<UINT8> section;
+    UINT32 blobCount = (UINT32)m_Blobs.size();
+    UINT64 bitmapWords = (blobCount + 63) / 64;
+    UINT64 offset = 0;
+    m_StatusMessage.str("");
+
+    memset(&header, 0, sizeof(header));
+    header.m_Magic = REGISTER_INDEX_MAGIC;
+    header.m_Version = REGISTER_INDEX_VERSION;
+    header.m_RowCount = (UINT32)m_RowBlob.size();
+    header.m_BlobCount = blobCount;
+    header.m_HostCount = (UINT32)m_HostNames.size();
+    header.m_RowHostOffset = REGISTER_INDEX_ALIGN(sizeof(header));
+    header.m_RowBdfOffset = REGISTER_INDEX_ALIGN(header.m_RowHostOffset + m_RowHost.size() * sizeof(UINT32));
+    header.m_RowBlobOffset = REGISTER_INDEX_ALIGN(header.m_RowBdfOffset + m_RowBdf.size() * sizeof(UINT16));
+    header.m_HostTableOffset = REGISTER_INDEX_ALIGN(header.m_RowBlobOffset + m_RowBlob.size() * sizeof(UINT32));
+    header.m_ColumnTableOffset = REGISTER_INDEX_ALIGN(header.m_HostTableOffset + m_HostNames.size() * sizeof(RegisterIndexHost));
+    offset = REGISTER_INDEX_ALIGN(header.m_ColumnTableOffset + columns.size() * sizeof(RegisterIndexColumn));
+
+    for (UINT32 c = 0; c < REGISTER_INDEX_COLUMNS; c++)
+    {
+        std::vector<UINT32>& dictionary = dictionaries[c];
+        RegisterIndexColumn& column = columns[c];
+
+        dictionary.reserve(blobCount);
+        for (UINT32 b = 0; b < blobCount; b++)
+        {
+            dictionary.push_back(BlobDword(m_Blobs[b], c));
+        }
+        std::sort(dictionary.begin(), dictionary.end());
+        dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+
+        memset(&column, 0, sizeof(column));
+        column.m_ValueCount = (UINT32)dictionary.size();
+        column.m_CodeWidth = (column.m_ValueCount <= 0x100) ? 1 : (column.m_ValueCount <= 0x10000) ? 2 : 4;
+        column.m_HasBitmaps = (column.m_ValueCount <= REGISTER_INDEX_BITMAP_MAX_VALUES) ? 1 : 0;
+        column.m_DictionaryOffset = offset;
+        column.m_CodeOffset = REGISTER_INDEX_ALIGN(column.m_DictionaryOffset + (UINT64)column.m_ValueCount * sizeof(UINT32));
+        column.m_BitmapOffset = REGISTER_INDEX_ALIGN(column.m_CodeOffset + (UINT64)blobCount * column.m_CodeWidth);
+        offset = column.m_BitmapOffset + (column.m_HasBitmaps ? column.m_ValueCount * bitmapWords * sizeof(UINT64) : 0);
+    }
+    header.m_Size = offset;
+
+    file = CreateFileA(FileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create index " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    //
+    // Everything up to the first column is small, write it as one section.
+    //
+    section.assign((size_t)columns[0].m_DictionaryOffset, 0);
+    memcpy(section.data(), &header, sizeof(header));
+    memcpy(section.data() + header.m_RowHostOffset, m_RowHost.data(), m_RowHost.size() * sizeof(UINT32));
+    memcpy(section.data() + header.m_RowBdfOffset, m_RowBdf.data(), m_RowBdf.size() * sizeof(UINT16));
+    memcpy(section.data() + header.m_RowBlobOffset, m_RowBlob.data(), m_RowBlob.size() * sizeof(UINT32));
+    for (UINT32 h = 0; h < m_HostNames.size(); h++)
+    {
+        m_HostNames[h].copy((PCHAR)section.data() + header.m_HostTableOffset + h * sizeof(RegisterIndexHost), CONFIG_SNAPSHOT_HOST_LENGTH - 1);
+    }
+    memcpy(section.data() + header.m_ColumnTableOffset, columns.data(), columns.size() * sizeof(RegisterIndexColumn));
+
+    if (!WriteFile(file, section.data(), (DWORD)section.size(), &bytesWritten, NULL)) {
+        userStatus = Failure;
+    }
+
+    for (UINT32 c = 0; c < REGISTER_INDEX_COLUMNS && userStatus == Success; c++)
+    {
+        const std::vector<UINT32>& dictionary = dictionaries[c];
+        const RegisterIndexColumn& column = columns[c];
+        UINT64 end = (c + 1 < REGISTER_INDEX_COLUMNS) ? columns[c + 1].m_DictionaryOffset : header.m_Size;
+        UINT64 bitmapBase = column.m_BitmapOffset - column.m_DictionaryOffset;
+
+        section.assign((size_t)(end - column.m_DictionaryOffset), 0);
+        memcpy(section.data(), dictionary.data(), dictionary.size() * sizeof(UINT32));
+
+        for (UINT32 b = 0; b < blobCount; b++)
+        {
+            UINT32 code = (UINT32)(std::lower_bound(dictionary.begin(), dictionary.end(), BlobDword(m_Blobs[b], c)) - dictionary.begin());
+            memcpy(section.data() + (column.m_CodeOffset - column.m_DictionaryOffset) + (UINT64)b * column.m_CodeWidth, &code, column.m_CodeWidth);
+
+            if (column.m_HasBitmaps) {
+                PUINT64 bitmap = (PUINT64)(section.data() + bitmapBase) + code * bitmapWords;
+                bitmap[b / 64] |= 1ULL << (b % 64);
+            }
+        }
+
+        if (!WriteFile(file, section.data(), (DWORD)section.size(), &bytesWritten, NULL)) {
+            userStatus = Failure;
+        }
+    }
+
+    if (userStatus != Success) {
+        m_StatusMessage << "Unable to write index " << FileName;
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    return userStatus;
+}
+
+std::string CRegisterIndexBuilder::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CRegisterIndex::CRegisterIndex()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    m_Size = 0;
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Columns = NULL;
+}
+
+CRegisterIndex::~CRegisterIndex()
+{
+    Close();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndex::Open
+
+  Summary:  Maps an index read-only and checks that its tables and columns
+            lie inside the file.
+
+  Args:     const std::string& FileName
+              Index file to read.
+
+  Modifies: [m_File, m_Mapping, m_View, m_Header, m_Columns].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndex::Open(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER FileSize;
+    UINT64 bitmapWords = 0;
+    m_StatusMessage.str("");
+
+    Close();
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &FileSize)) {
+        m_StatusMessage << "Unable to open index " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    m_Size = (UINT64)FileSize.QuadPart;
+    if (m_Size < sizeof(m_Header)) {
+        m_StatusMessage << "Index " << FileName << " is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_View = (const UINT8*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_View == NULL) {
+        m_StatusMessage << "Unable to map index " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    memcpy(&m_Header, m_View, sizeof(m_Header));
+    if (m_Header.m_Magic != REGISTER_INDEX_MAGIC || m_Header.m_Version != REGISTER_INDEX_VERSION) {
+        m_StatusMessage << "Not a register index, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (m_Header.m_Size > m_Size ||
+        m_Header.m_RowHostOffset + (UINT64)m_Header.m_RowCount * sizeof(UINT32) > m_Header.m_RowBdfOffset ||
+        m_Header.m_RowBdfOffset + (UINT64)m_Header.m_RowCount * sizeof(UINT16) > m_Header.m_RowBlobOffset ||
+        m_Header.m_RowBlobOffset + (UINT64)m_Header.m_RowCount * sizeof(UINT32) > m_Header.m_HostTableOffset ||
+        m_Header.m_HostTableOffset + (UINT64)m_Header.m_HostCount * sizeof(RegisterIndexHost) > m_Header.m_ColumnTableOffset ||
+        m_Header.m_ColumnTableOffset + REGISTER_INDEX_COLUMNS * sizeof(RegisterIndexColumn) > m_Header.m_Size) {
+        m_StatusMessage << "Index " << FileName << " is truncated";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Columns = (const RegisterIndexColumn*)(m_View + m_Header.m_ColumnTableOffset);
+    bitmapWords = (m_Header.m_BlobCount + 63) / 64;
+    for (UINT32 c = 0; c < REGISTER_INDEX_COLUMNS; c++)
+    {
+        const RegisterIndexColumn& column = m_Columns[c];
+        if ((column.m_CodeWidth != 1 && column.m_CodeWidth != 2 && column.m_CodeWidth != 4) ||
+            column.m_DictionaryOffset + (UINT64)column.m_ValueCount * sizeof(UINT32) > column.m_CodeOffset ||
+            column.m_CodeOffset + (UINT64)m_Header.m_BlobCount * column.m_CodeWidth > column.m_BitmapOffset ||
+            column.m_BitmapOffset + (column.m_HasBitmaps ? column.m_ValueCount * bitmapWords * sizeof(UINT64) : 0) > m_Header.m_Size) {
+            m_StatusMessage << "Index column 0x" << std::hex << c * sizeof(UINT32) << " is truncated";
+            userStatus = IndexOutOfRange;
+            goto Exit;
+        }
+    }
+
+Exit:
+    if (userStatus != Success) {
+        Close();
+    }
+    return userStatus;
+}
+
+UINT32 CRegisterIndex::GetCode(const RegisterIndexColumn& Column, UINT32 Blob)
+{
+    const UINT8* codes = m_View + Column.m_CodeOffset;
+
+    switch (Column.m_CodeWidth)
+    {
+        case 1:
+            return codes[Blob];
+        case 2:
+            return ((const UINT16*)codes)[Blob];
+        default:
+            return ((const UINT32*)codes)[Blob];
+    }
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndex::Query
+
+  Summary:  Finds the rows matching all predicates. Each predicate is first
+            evaluated on its column dictionary, the matching values then
+            select blobs through their bitmaps or by scanning the codes of
+            the blobs still selected, and the row blob column maps the
+            selected blobs to rows.
+
+  Args:     const std::vector<RegisterPredicate>& Predicates
+              Predicates, all must match.
+            std::vector<UINT32>& Rows
+              Receives the matching rows in index order.
+
+  Modifies: [Rows].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange for an offset that is not a dword
+              inside 4 KB or a code outside the dictionary of its column.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndex::Query(const std::vector<RegisterPredicate>& Predicates, std::vector<UINT32>& Rows)
+{
+    UINT64 bitmapWords = (m_Header.m_BlobCount + 63) / 64;
+    std::vector<UINT64> selected((size_t)bitmapWords, ~0ULL);
+    std::vector<UINT64> hits((size_t)bitmapWords);
+    std::vector<UINT8> matches;
+    const UINT32* rowBlob = NULL;
+    m_StatusMessage.str("");
+
+    Rows.clear();
+    if (m_View == NULL) {
+        m_StatusMessage << "Index is not open";
+        return InvalidHandle;
+    }
+
+    if (m_Header.m_BlobCount % 64) {
+        selected.back() = (1ULL << (m_Header.m_BlobCount % 64)) - 1;
+    }
+
+    for (auto& predicate : Predicates)
+    {
+        if (predicate.m_Offset % sizeof(UINT32) || predicate.m_Offset >= PCIe_CFG_SIZE) {
+            m_StatusMessage << "Offset 0x" << std::hex << predicate.m_Offset << " is not a dword of configuration space";
+            return IndexOutOfRange;
+        }
+
+        const RegisterIndexColumn& column = m_Columns[predicate.m_Offset / sizeof(UINT32)];
+        const UINT32* dictionary = (const UINT32*)(m_View + column.m_DictionaryOffset);
+        bool any = false;
+
+        matches.assign(column.m_ValueCount, 0);
+        for (UINT32 v = 0; v < column.m_ValueCount; v++)
+        {
+            matches[v] = CompareValue(dictionary[v] & predicate.m_Mask, predicate.m_Compare, predicate.m_Value) ? 1 : 0;
+            any = any || matches[v];
+        }
+
+        std::fill(hits.begin(), hits.end(), 0);
+        if (any && column.m_HasBitmaps) {
+            const UINT64* bitmaps = (const UINT64*)(m_View + column.m_BitmapOffset);
+            for (UINT32 v = 0; v < column.m_ValueCount; v++)
+            {
+                if (matches[v]) {
+                    for (UINT64 w = 0; w < bitmapWords; w++)
+                    {
+                        hits[(size_t)w] |= bitmaps[v * bitmapWords + w];
+                    }
+                }
+            }
+        }
+        else if (any) {
+            for (UINT64 w = 0; w < bitmapWords; w++)
+            {
+                UINT64 bits = selected[(size_t)w];
+                for (UINT32 i = 0; bits != 0; i++, bits >>= 1)
+                {
+                    if (!(bits & 1)) {
+                        continue;
+                    }
+
+                    //
+                    // Codes come from the file, Open only checked the
+                    // column layout.
+                    //
+                    UINT32 code = GetCode(column, (UINT32)(w * 64) + i);
+                    if (code >= column.m_ValueCount) {
+                        m_StatusMessage << "Blob 0x" << std::hex << (w * 64 + i) << " has no value at offset 0x" << predicate.m_Offset;
+                        return IndexOutOfRange;
+                    }
+                    if (matches[code]) {
+                        hits[(size_t)w] |= 1ULL << i;
+                    }
+                }
+            }
+        }
+
+        for (UINT64 w = 0; w < bitmapWords; w++)
+        {
+            selected[(size_t)w] &= hits[(size_t)w];
+        }
+    }
+
+    rowBlob = (const UINT32*)(m_View + m_Header.m_RowBlobOffset);
+    for (UINT32 r = 0; r < m_Header.m_RowCount; r++)
+    {
+        UINT32 b = rowBlob[r];
+        if (b < m_Header.m_BlobCount && (selected[b / 64] >> (b % 64)) & 1) {
+            Rows.push_back(r);
+        }
+    }
+
+    return Success;
+}
+
+UserStatus CRegisterIndex::GetRow(UINT32 Row, std::string& HostName, PUINT8 pBus, PUINT8 pDevice, PUINT8 pFunction)
+{
+    m_StatusMessage.str("");
+
+    if (m_View == NULL || Row >= m_Header.m_RowCount) {
+        m_StatusMessage << "Row 0x" << std::hex << Row << " is out of range";
+        return IndexOutOfRange;
+    }
+
+    UINT32 host = ((const UINT32*)(m_View + m_Header.m_RowHostOffset))[Row];
+    UINT16 bdf = ((const UINT16*)(m_View + m_Header.m_RowBdfOffset))[Row];
+    if (host >= m_Header.m_HostCount) {
+        m_StatusMessage << "Row 0x" << std::hex << Row << " references host 0x" << host;
+        return IndexOutOfRange;
+    }
+
+    const RegisterIndexHost* hosts = (const RegisterIndexHost*)(m_View + m_Header.m_HostTableOffset);
+    HostName.assign(hosts[host].m_HostName, strnlen(hosts[host].m_HostName, sizeof(hosts[host].m_HostName)));
+    *pBus = (UINT8)(bdf >> 8);
+    *pDevice = (UINT8)((bdf >> 3) & 0x1F);
+    *pFunction = (UINT8)(bdf & 0x07);
+    return Success;
+}
+
+UserStatus CRegisterIndex::GetValue(UINT32 Row, UINT32 Offset, PUINT32 pValue)
+{
+    m_StatusMessage.str("");
+
+    if (m_View == NULL || Row >= m_Header.m_RowCount || Offset % sizeof(UINT32) || Offset >= PCIe_CFG_SIZE) {
+        m_StatusMessage << "Row 0x" << std::hex << Row << ", offset 0x" << Offset << " is out of range";
+        return IndexOutOfRange;
+    }
+
+    const RegisterIndexColumn& column = m_Columns[Offset / sizeof(UINT32)];
+    UINT32 blob = ((const UINT32*)(m_View + m_Header.m_RowBlobOffset))[Row];
+    UINT32 code = (blob < m_Header.m_BlobCount) ? GetCode(column, blob) : column.m_ValueCount;
+    if (code >= column.m_ValueCount) {
+        m_StatusMessage << "Row 0x" << std::hex << Row << " has no value at offset 0x" << Offset;
+        return IndexOutOfRange;
+    }
+
+    *pValue = ((const UINT32*)(m_View + column.m_DictionaryOffset))[code];
+    return Success;
+}
+
+const RegisterIndexHeader& CRegisterIndex::GetHeader()
+{
+    return m_Header;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterIndex::ParsePredicate
+
+  Summary:  Parses a predicate. "vendor", "device" and "class" name the
+            vendor id, device id and 24-bit class code, anything else is a
+            dword offset with an optional mask, e.g. "0x8&0xFF000000=0x2000000".
+            Operators are =, ==, !=, >, >=, < and <=, numbers take C prefixes.
+
+  Args:     const std::string& Text
+              Predicate text.
+            RegisterPredicate& Predicate
+              Receives the predicate.
+
+  Modifies: [Predicate].
+
+  Returns:  UserStatus
+              Returns Failure if the text does not parse.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterIndex::ParsePredicate(const std::string& Text, RegisterPredicate& Predicate)
+{
+    size_t opStart = Text.find_first_of("=!<>");
+    size_t opEnd = Text.find_first_not_of("=!<>", opStart);
+    std::string field;
+    std::string op;
+    PCHAR end = NULL;
+    UINT32 shift = 0;
+
+    if (opStart == std::string::npos || opStart == 0 || opEnd == std::string::npos) {
+        return Failure;
+    }
+
+    field = Text.substr(0, opStart);
+    op = Text.substr(opStart, opEnd - opStart);
+
+    if (op == "=" || op == "==") {
+        Predicate.m_Compare = CompareEqual;
+    }
+    else if (op == "!=") {
+        Predicate.m_Compare = CompareNotEqual;
+    }
+    else if (op == ">") {
+        Predicate.m_Compare = CompareGreater;
+    }
+    else if (op == ">=") {
+        Predicate.m_Compare = CompareGreaterEqual;
+    }
+    else if (op == "<") {
+        Predicate.m_Compare = CompareLess;
+    }
+    else if (op == "<=") {
+        Predicate.m_Compare = CompareLessEqual;
+    }
+    else {
+        return Failure;
+    }
+
+    if (field == "vendor") {
+        Predicate.m_Offset = 0x00;
+        Predicate.m_Mask = 0x0000FFFF;
+    }
+    else if (field == "device") {
+        Predicate.m_Offset = 0x00;
+        Predicate.m_Mask = 0xFFFF0000;
+        shift = 16;
+    }
+    else if (field == "class") {
+        Predicate.m_Offset = 0x08;
+        Predicate.m_Mask = 0xFFFFFF00;
+        shift = 8;
+    }
+    else {
+        Predicate.m_Offset = strtoul(field.c_str(), &end, 0);
+        Predicate.m_Mask = 0xFFFFFFFF;
+        if (*end == '&') {
+            Predicate.m_Mask = strtoul(end + 1, &end, 0);
+        }
+        if (*end != '\0') {
+            return Failure;
+        }
+    }
+
+    Predicate.m_Value = strtoul(Text.c_str() + opEnd, &end, 0) << shift;
+    if (*end != '\0') {
+        return Failure;
+    }
+
+    return Success;
+}
+
+void CRegisterIndex::Close()
+{
+    if (m_View != NULL) {
+        UnmapViewOfFile(m_View);
+        m_View = NULL;
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+        m_Mapping = NULL;
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+    }
+    m_Columns = NULL;
+}
+
+std::string CRegisterIndex::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,191 @@
+#pragma once
+/*+===================================================================
+  File:      RegisterIndex.h
+
+  Summary:   Columnar index of configuration space registers for predicate
+             queries over many functions and hosts.
+
+  Classes:   CRegisterIndexBuilder, CRegisterIndex.
+
+  Functions: AddHost, Add, AddArchive, Write, Open, Query, ParsePredicate.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "ConfigArchive.h"
+#include "Hash128.h"
+
+#define REGISTER_INDEX_MAGIC        0x49525748      // 'HWRI'
+#define REGISTER_INDEX_VERSION      1
+#define REGISTER_INDEX_COLUMNS      (PCIe_CFG_SIZE / sizeof(UINT32))
+
+//
+// Columns with at most this many distinct values get one bitmap per value,
+// wider columns are answered by scanning their codes.
+//
+#define REGISTER_INDEX_BITMAP_MAX_VALUES 16
+
+//
+// Rows of the index are functions, but register columns are stored once per
+// unique capture (blob), so a query is evaluated on the blobs first and then
+// mapped to functions through the row blob column.
+//
+// An index file is a RegisterIndexHeader, then the row host, row BDF and row
+// blob columns, the host table, REGISTER_INDEX_COLUMNS column descriptors and
+// the column data. Column data is a sorted dictionary of the distinct dword
+// values at that offset, one code per blob of m_CodeWidth bytes indexing the
+// dictionary and, for narrow columns, one bitmap over the blobs per value.
+// Offsets past the end of a 256 byte capture read as 0xFFFFFFFF.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT32 m_RowCount;
+    UINT32 m_BlobCount;
+    UINT32 m_HostCount;
+    UINT32 m_Reserved;
+    UINT64 m_RowHostOffset;
+    UINT64 m_RowBdfOffset;
+    UINT64 m_RowBlobOffset;
+    UINT64 m_HostTableOffset;
+    UINT64 m_ColumnTableOffset;
+    UINT64 m_Size;
+}RegisterIndexHeader;
+
+typedef struct
+{
+    UINT32 m_ValueCount;
+    UINT8 m_CodeWidth;
+    UINT8 m_HasBitmaps;
+    UINT16 m_Reserved;
+    UINT64 m_DictionaryOffset;
+    UINT64 m_CodeOffset;
+    UINT64 m_BitmapOffset;
+}RegisterIndexColumn;
+
+typedef struct
+{
+    CHAR m_HostName[CONFIG_SNAPSHOT_HOST_LENGTH];
+}RegisterIndexHost;
+#pragma pack(pop)
+
+typedef enum
+{
+    CompareEqual,
+    CompareNotEqual,
+    CompareGreater,
+    CompareGreaterEqual,
+    CompareLess,
+    CompareLessEqual
+}RegisterCompare;
+
+//
+// Matches rows where (dword at m_Offset & m_Mask) compares to m_Value.
+//
+typedef struct
+{
+    UINT32 m_Offset;
+    UINT32 m_Mask;
+    UINT32 m_Value;
+    RegisterCompare m_Compare;
+}RegisterPredicate;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CRegisterIndexBuilder
+
+  Summary:  Collects captures, deduplicates them and writes the index.
+
+  Methods:  UINT32 AddHost(const std::string& HostName)
+              Adds a host, later captures belong to it.
+            UserStatus Add(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size)
+              Adds or replaces the capture of a function of the current host.
+            UserStatus AddArchive(CConfigArchiveReader& Archive)
+              Adds every host of an archive.
+            UserStatus Write(const std::string& FileName)
+              Builds the columns and writes the index.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CRegisterIndexBuilder
+{
+public:
+    CRegisterIndexBuilder();
+    UINT32 AddHost(const std::string& HostName);
+    UserStatus Add(UINT8 Bus, UINT8 Device, UINT8 Function, const UINT8* Data, UINT32 Size);
+    UserStatus AddArchive(CConfigArchiveReader& Archive);
+    UserStatus Write(const std::string& FileName);
+    std::string GetStatusMessage();
+
+private:
+    UINT32 AddBlob(const UINT8* Data, UINT32 Size);
+    void AddRow(UINT32 Host, UINT16 Bdf, UINT32 Blob);
+
+    std::vector<std::string> m_HostNames;
+    std::vector<std::vector<UINT8>> m_Blobs;
+    std::unordered_map<Hash128, UINT32, Hash128Hasher> m_BlobIndex;
+    std::vector<UINT32> m_RowHost;
+    std::vector<UINT16> m_RowBdf;
+    std::vector<UINT32> m_RowBlob;
+    std::unordered_map<UINT64, UINT32> m_RowIndex;
+    UINT32 m_CurrentHost;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CRegisterIndex
+
+  Summary:  Answers predicate queries from a memory mapped index file.
+
+  Methods:  UserStatus Open(const std::string& FileName)
+              Maps the index and checks its tables.
+            UserStatus Query(const std::vector<RegisterPredicate>& Predicates, std::vector<UINT32>& Rows)
+              Returns the rows matching all predicates.
+            UserStatus GetRow(UINT32 Row, std::string& HostName, PUINT8 pBus, PUINT8 pDevice, PUINT8 pFunction)
+              Returns the host and location of a row.
+            UserStatus GetValue(UINT32 Row, UINT32 Offset, PUINT32 pValue)
+              Returns the dword at Offset of a row.
+            const RegisterIndexHeader& GetHeader()
+              Returns the index header.
+            static UserStatus ParsePredicate(const std::string& Text, RegisterPredicate& Predicate)
+              Parses "vendor=0x8086", "class=0x060400" or "<Offset>[&<Mask>]<Op><Value>".
+            void Close()
+              Unmaps the index.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CRegisterIndex
+{
+public:
+    CRegisterIndex();
+    ~CRegisterIndex();
+    UserStatus Open(const std::string& FileName);
+    UserStatus Query(const std::vector<RegisterPredicate>& Predicates, std::vector<UINT32>& Rows);
+    UserStatus GetRow(UINT32 Row, std::string& HostName, PUINT8 pBus, PUINT8 pDevice, PUINT8 pFunction);
+    UserStatus GetValue(UINT32 Row, UINT32 Offset, PUINT32 pValue);
+    const RegisterIndexHeader& GetHeader();
+    static UserStatus ParsePredicate(const std::string& Text, RegisterPredicate& Predicate);
+    void Close();
+    std::string GetStatusMessage();
+
+private:
+    UINT32 GetCode(const RegisterIndexColumn& Column, UINT32 Blob);
+
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const UINT8* m_View;
+    UINT64 m_Size;
+    RegisterIndexHeader m_Header;
+    const RegisterIndexColumn* m_Columns;
+    std::stringstream m_StatusMessage;
+};
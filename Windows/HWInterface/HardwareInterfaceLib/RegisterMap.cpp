@@ -0,0 +1,739 @@
+#include <algorithm>
+#include "RegisterMap.h"
+
+#define REGISTER_MAP_ALIGN(x)       (((x) + 7) & ~(UINT64)7)
+
+//
+// Returns the next blank separated or quoted token of Line.
+//
+static bool NextToken(const std::string& Line, size_t& Position, std::string& Token)
+{
+    size_t end;
+
+    Position = Line.find_first_not_of(" \t\r", Position);
+    if (Position == std::string::npos || Line[Position] == '#') {
+        return false;
+    }
+
+    if (Line[Position] == '"') {
+        end = Line.find('"', Position + 1);
+        if (end == std::string::npos) {
+            end = Line.size();
+        }
+        Token = Line.substr(Position + 1, end - Position - 1);
+        Position = (end < Line.size()) ? end + 1 : end;
+        return true;
+    }
+
+    end = Line.find_first_of(" \t\r#", Position);
+    if (end == std::string::npos) {
+        end = Line.size();
+    }
+    Token = Line.substr(Position, end - Position);
+    Position = end;
+    return true;
+}
+
+static bool ParseNumber(const std::string& Token, UINT64 Maximum, UINT64& Value)
+{
+    char* end = NULL;
+
+    if (Token.empty()) {
+        return false;
+    }
+    Value = strtoull(Token.c_str(), &end, 0);
+    return *end == '\0' && Value <= Maximum;
+}
+
+static bool ParseAccess(const std::string& Token, UINT8& Access)
+{
+    if (Token == "ro") {
+        Access = RegisterReadOnly;
+    }
+    else if (Token == "rw") {
+        Access = RegisterReadWrite;
+    }
+    else if (Token == "rw1c") {
+        Access = RegisterWriteOneClear;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+CRegisterMapCompiler::CRegisterMapCompiler()
+{
+    m_RegisterCount = 0;
+    m_Strings.push_back('\0');
+    m_StringIndex[""] = 0;
+}
+
+UINT32 CRegisterMapCompiler::AddString(const std::string& Text)
+{
+    auto found = m_StringIndex.find(Text);
+    if (found != m_StringIndex.end()) {
+        return found->second;
+    }
+
+    UINT32 offset = (UINT32)m_Strings.size();
+    m_Strings.insert(m_Strings.end(), Text.begin(), Text.end());
+    m_Strings.push_back('\0');
+    m_StringIndex[Text] = offset;
+    return offset;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMapCompiler::AddFile
+
+  Summary:  Reads a description file and parses it.
+
+  Args:     const std::string& FileName
+              Description file.
+
+  Modifies: [m_Devices, m_Tables, m_Strings].
+
+  Returns:  UserStatus
+              Returns error code, the status message names the line.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterMapCompiler::AddFile(const std::string& FileName)
+{
+    HANDLE file = INVALID_HANDLE_VALUE;
+    LARGE_INTEGER FileSize;
+    DWORD bytesRead = 0;
+    std::string text;
+    m_StatusMessage.str("");
+
+    file = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &FileSize) || FileSize.QuadPart > MAXDWORD) {
+        m_StatusMessage << "Unable to open description " << FileName;
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        return InvalidHandle;
+    }
+
+    text.resize((size_t)FileSize.QuadPart);
+    if (!text.empty() && (!ReadFile(file, &text[0], (DWORD)text.size(), &bytesRead, NULL) || bytesRead != text.size())) {
+        m_StatusMessage << "Unable to read description " << FileName;
+        CloseHandle(file);
+        return Failure;
+    }
+    CloseHandle(file);
+
+    return AddText(text, FileName);
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMapCompiler::AddText
+
+  Summary:  Parses a description line by line. Offsets, widths and field
+            bounds are checked per line, overlaps when a register table
+            is complete.
+
+  Args:     const std::string& Text
+              Description text.
+            const std::string& Source
+              Name used in error messages.
+
+  Modifies: [m_Devices, m_Tables, m_Strings].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterMapCompiler::AddText(const std::string& Text, const std::string& Source)
+{
+    UserStatus userStatus = Success;
+    size_t lineStart = 0;
+    UINT32 lineNumber = 0;
+    bool tableOpen = false;
+    bool lastWasDevice = false;
+    std::vector<std::string> tokens;
+    std::string token;
+    m_StatusMessage.str("");
+
+    while (lineStart < Text.size())
+    {
+        size_t lineEnd = Text.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = Text.size();
+        }
+        std::string line = Text.substr(lineStart, lineEnd - lineStart);
+        size_t position = 0;
+        UINT64 first = 0, second = 0;
+        UINT8 access = 0;
+
+        lineStart = lineEnd + 1;
+        lineNumber++;
+
+        tokens.clear();
+        while (NextToken(line, position, token))
+        {
+            tokens.push_back(token);
+        }
+        if (tokens.empty()) {
+            continue;
+        }
+
+        if (tokens[0] == "device") {
+            if (tokens.size() < 3 || tokens.size() > 4 || !ParseNumber(tokens[1], 0xFFFF, first) || !ParseNumber(tokens[2], 0xFFFF, second)) {
+                m_StatusMessage << Source << "(" << lineNumber << "): expected device <VendorId> <DeviceId> [\"Name\"]";
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            if (!lastWasDevice) {
+                if (tableOpen && (userStatus = CloseTable(Source)) != Success) {
+                    goto Exit;
+                }
+                m_Tables.emplace_back();
+                tableOpen = true;
+            }
+
+            if (m_DeviceIndex.count(REGISTER_MAP_KEY(first, second)) != 0) {
+                m_StatusMessage << Source << "(" << lineNumber << "): device 0x" << std::hex << first << ":0x" << second << " is already described";
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            RegisterMapDevice device;
+            device.m_VendorId = (UINT16)first;
+            device.m_DeviceId = (UINT16)second;
+            device.m_Table = (UINT32)m_Tables.size() - 1;
+            device.m_Name = AddString(tokens.size() > 3 ? tokens[3] : "");
+            m_DeviceIndex[REGISTER_MAP_KEY(first, second)] = (UINT32)m_Devices.size();
+            m_Devices.push_back(device);
+            lastWasDevice = true;
+            continue;
+        }
+        lastWasDevice = false;
+
+        if (tokens[0] == "register") {
+            if (!tableOpen) {
+                m_StatusMessage << Source << "(" << lineNumber << "): register before the first device";
+                userStatus = Failure;
+                goto Exit;
+            }
+            if (tokens.size() < 5 || tokens.size() > 6 || !ParseNumber(tokens[1], MAXDWORD, first) || !ParseNumber(tokens[2], 64, second) ||
+                !ParseAccess(tokens[3], access)) {
+                m_StatusMessage << Source << "(" << lineNumber << "): expected register <Offset> <Bits> <ro|rw|rw1c> <Name> [\"Description\"]";
+                userStatus = Failure;
+                goto Exit;
+            }
+            if ((second != 8 && second != 16 && second != 32 && second != 64) || (first % (second / 8)) != 0 ||
+                first + second / 8 > (UINT64)MAXDWORD + 1) {
+                m_StatusMessage << Source << "(" << lineNumber << "): register " << tokens[4] << " is not 8, 16, 32 or 64 bits wide and naturally aligned";
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            CompiledRegister compiled;
+            memset(&compiled.m_Register, 0, sizeof(compiled.m_Register));
+            compiled.m_Register.m_Offset = (UINT32)first;
+            compiled.m_Register.m_Width = (UINT8)(second / 8);
+            compiled.m_Register.m_Access = access;
+            compiled.m_Register.m_Name = AddString(tokens[4]);
+            compiled.m_Register.m_Description = AddString(tokens.size() > 5 ? tokens[5] : "");
+            m_Tables.back().push_back(compiled);
+            m_RegisterCount++;
+            continue;
+        }
+
+        if (tokens[0] == "field") {
+            if (!tableOpen || m_Tables.back().empty()) {
+                m_StatusMessage << Source << "(" << lineNumber << "): field before the first register";
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            CompiledRegister& compiled = m_Tables.back().back();
+            if (tokens.size() < 5 || tokens.size() > 6 || !ParseNumber(tokens[1], 63, first) || !ParseNumber(tokens[2], 64, second) ||
+                !ParseAccess(tokens[3], access)) {
+                m_StatusMessage << Source << "(" << lineNumber << "): expected field <Lsb> <Bits> <ro|rw|rw1c> <Name> [\"Description\"]";
+                userStatus = Failure;
+                goto Exit;
+            }
+            if (second == 0 || first + second > compiled.m_Register.m_Width * 8U) {
+                m_StatusMessage << Source << "(" << lineNumber << "): field " << tokens[4] << " does not fit register "
+                    << &m_Strings[compiled.m_Register.m_Name];
+                userStatus = Failure;
+                goto Exit;
+            }
+
+            RegisterMapField field;
+            field.m_Lsb = (UINT8)first;
+            field.m_Bits = (UINT8)second;
+            field.m_Access = access;
+            field.m_Reserved = 0;
+            field.m_Name = AddString(tokens[4]);
+            field.m_Description = AddString(tokens.size() > 5 ? tokens[5] : "");
+            compiled.m_Fields.push_back(field);
+            continue;
+        }
+
+        m_StatusMessage << Source << "(" << lineNumber << "): unknown keyword " << tokens[0];
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (tableOpen) {
+        userStatus = CloseTable(Source);
+    }
+
+Exit:
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMapCompiler::CloseTable
+
+  Summary:  Sorts the last register table by offset and its fields by lsb
+            and rejects overlapping registers or fields.
+
+  Args:     const std::string& Source
+              Name used in error messages.
+
+  Modifies: [m_Tables].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterMapCompiler::CloseTable(const std::string& Source)
+{
+    std::vector<CompiledRegister>& table = m_Tables.back();
+
+    std::stable_sort(table.begin(), table.end(), [](const CompiledRegister& Left, const CompiledRegister& Right) {
+        return Left.m_Register.m_Offset < Right.m_Register.m_Offset;
+    });
+
+    for (size_t r = 0; r < table.size(); r++)
+    {
+        CompiledRegister& compiled = table[r];
+
+        if (r > 0 && (UINT64)table[r - 1].m_Register.m_Offset + table[r - 1].m_Register.m_Width > compiled.m_Register.m_Offset) {
+            m_StatusMessage << Source << ": register " << &m_Strings[table[r - 1].m_Register.m_Name] << " overlaps register "
+                << &m_Strings[compiled.m_Register.m_Name];
+            return Failure;
+        }
+
+        std::stable_sort(compiled.m_Fields.begin(), compiled.m_Fields.end(), [](const RegisterMapField& Left, const RegisterMapField& Right) {
+            return Left.m_Lsb < Right.m_Lsb;
+        });
+
+        for (size_t f = 1; f < compiled.m_Fields.size(); f++)
+        {
+            if (compiled.m_Fields[f - 1].m_Lsb + compiled.m_Fields[f - 1].m_Bits > compiled.m_Fields[f].m_Lsb) {
+                m_StatusMessage << Source << ": field " << &m_Strings[compiled.m_Fields[f - 1].m_Name] << " overlaps field "
+                    << &m_Strings[compiled.m_Fields[f].m_Name] << " of register " << &m_Strings[compiled.m_Register.m_Name];
+                return Failure;
+            }
+        }
+
+        if (compiled.m_Fields.size() > 0xFFFF) {
+            m_StatusMessage << Source << ": register " << &m_Strings[compiled.m_Register.m_Name] << " has too many fields";
+            return Failure;
+        }
+    }
+
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMapCompiler::Write
+
+  Summary:  Builds the perfect hash over the devices, flattens the tables
+            and writes the database in one pass.
+
+  Args:     const std::string& FileName
+              Database file to create.
+
+  Modifies: None.
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterMapCompiler::Write(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    DWORD bytesWritten = 0;
+    RegisterMapHeader header;
+    std::vector<UINT64> keys;
+    std::vector<UINT32> displacements;
+    std::vector<UINT32> slots;
+    std::vector<UINT8> image;
+    UINT32 fieldCount = 0;
+    UINT32 registerIndex = 0;
+    UINT32 fieldIndex = 0;
+    m_StatusMessage.str("");
+
+    for (auto& device : m_Devices)
+    {
+        keys.push_back(REGISTER_MAP_KEY(device.m_VendorId, device.m_DeviceId));
+    }
+
+    userStatus = CPerfectHash::Build(keys, displacements, slots);
+    if (userStatus != Success) {
+        m_StatusMessage << "Unable to build the device hash";
+        goto Exit;
+    }
+
+    for (auto& table : m_Tables)
+    {
+        for (auto& compiled : table)
+        {
+            fieldCount += (UINT32)compiled.m_Fields.size();
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.m_Magic = REGISTER_MAP_MAGIC;
+    header.m_Version = REGISTER_MAP_VERSION;
+    header.m_DeviceCount = (UINT32)m_Devices.size();
+    header.m_BucketCount = (UINT32)displacements.size();
+    header.m_TableCount = (UINT32)m_Tables.size();
+    header.m_RegisterCount = m_RegisterCount;
+    header.m_FieldCount = fieldCount;
+    header.m_StringSize = (UINT32)m_Strings.size();
+    header.m_BucketOffset = REGISTER_MAP_ALIGN(sizeof(header));
+    header.m_DeviceOffset = REGISTER_MAP_ALIGN(header.m_BucketOffset + displacements.size() * sizeof(UINT32));
+    header.m_TableOffset = REGISTER_MAP_ALIGN(header.m_DeviceOffset + m_Devices.size() * sizeof(RegisterMapDevice));
+    header.m_RegisterOffset = REGISTER_MAP_ALIGN(header.m_TableOffset + m_Tables.size() * sizeof(RegisterMapTable));
+    header.m_FieldOffset = REGISTER_MAP_ALIGN(header.m_RegisterOffset + (UINT64)m_RegisterCount * sizeof(RegisterMapRegister));
+    header.m_StringOffset = REGISTER_MAP_ALIGN(header.m_FieldOffset + (UINT64)fieldCount * sizeof(RegisterMapField));
+    header.m_Size = REGISTER_MAP_ALIGN(header.m_StringOffset + m_Strings.size());
+
+    image.assign((size_t)header.m_Size, 0);
+    memcpy(image.data(), &header, sizeof(header));
+    memcpy(image.data() + header.m_BucketOffset, displacements.data(), displacements.size() * sizeof(UINT32));
+    for (UINT32 s = 0; s < slots.size(); s++)
+    {
+        memcpy(image.data() + header.m_DeviceOffset + s * sizeof(RegisterMapDevice), &m_Devices[slots[s]], sizeof(RegisterMapDevice));
+    }
+
+    for (UINT32 t = 0; t < m_Tables.size(); t++)
+    {
+        RegisterMapTable table;
+        table.m_FirstRegister = registerIndex;
+        table.m_RegisterCount = (UINT32)m_Tables[t].size();
+        memcpy(image.data() + header.m_TableOffset + t * sizeof(RegisterMapTable), &table, sizeof(table));
+
+        for (auto& compiled : m_Tables[t])
+        {
+            RegisterMapRegister reg = compiled.m_Register;
+            reg.m_FirstField = fieldIndex;
+            reg.m_FieldCount = (UINT16)compiled.m_Fields.size();
+            memcpy(image.data() + header.m_RegisterOffset + (UINT64)registerIndex * sizeof(RegisterMapRegister), &reg, sizeof(reg));
+            if (!compiled.m_Fields.empty()) {
+                memcpy(image.data() + header.m_FieldOffset + (UINT64)fieldIndex * sizeof(RegisterMapField), compiled.m_Fields.data(),
+                    compiled.m_Fields.size() * sizeof(RegisterMapField));
+            }
+            registerIndex++;
+            fieldIndex += reg.m_FieldCount;
+        }
+    }
+    memcpy(image.data() + header.m_StringOffset, m_Strings.data(), m_Strings.size());
+
+    file = CreateFileA(FileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        m_StatusMessage << "Unable to create register map " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if (!WriteFile(file, image.data(), (DWORD)image.size(), &bytesWritten, NULL) || bytesWritten != image.size()) {
+        m_StatusMessage << "Unable to write register map " << FileName;
+        userStatus = Failure;
+    }
+
+Exit:
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    return userStatus;
+}
+
+UINT32 CRegisterMapCompiler::GetDeviceCount()
+{
+    return (UINT32)m_Devices.size();
+}
+
+UINT32 CRegisterMapCompiler::GetRegisterCount()
+{
+    return m_RegisterCount;
+}
+
+std::string CRegisterMapCompiler::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
+
+CRegisterMap::CRegisterMap()
+{
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    memset(&m_Header, 0, sizeof(m_Header));
+    m_Buckets = NULL;
+    m_Devices = NULL;
+    m_Tables = NULL;
+    m_Registers = NULL;
+    m_Fields = NULL;
+    m_Strings = NULL;
+}
+
+CRegisterMap::~CRegisterMap()
+{
+    Close();
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMap::Open
+
+  Summary:  Maps a database read-only. Only the header is checked, so the
+            cost does not grow with the database, lookups check the table
+            and field ranges they follow.
+
+  Args:     const std::string& FileName
+              Database file to read.
+
+  Modifies: [m_File, m_Mapping, m_View, m_Header and the table pointers].
+
+  Returns:  UserStatus
+              Returns error code.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CRegisterMap::Open(const std::string& FileName)
+{
+    UserStatus userStatus = Success;
+    LARGE_INTEGER FileSize;
+    m_StatusMessage.str("");
+
+    Close();
+
+    m_File = CreateFileA(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &FileSize)) {
+        m_StatusMessage << "Unable to open register map " << FileName;
+        userStatus = InvalidHandle;
+        goto Exit;
+    }
+
+    if ((UINT64)FileSize.QuadPart < sizeof(m_Header)) {
+        m_StatusMessage << "Register map " << FileName << " is too small";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping != NULL) {
+        m_View = (const UINT8*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (m_View == NULL) {
+        m_StatusMessage << "Unable to map register map " << FileName;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    memcpy(&m_Header, m_View, sizeof(m_Header));
+    if (m_Header.m_Magic != REGISTER_MAP_MAGIC || m_Header.m_Version != REGISTER_MAP_VERSION) {
+        m_StatusMessage << "Not a register map, magic: 0x" << std::hex << m_Header.m_Magic << ", version: 0x" << m_Header.m_Version;
+        userStatus = Failure;
+        goto Exit;
+    }
+
+    if (m_Header.m_Size > (UINT64)FileSize.QuadPart ||
+        m_Header.m_BucketCount != CPerfectHash::GetBucketCount(m_Header.m_DeviceCount) ||
+        m_Header.m_BucketOffset + (UINT64)m_Header.m_BucketCount * sizeof(UINT32) > m_Header.m_DeviceOffset ||
+        m_Header.m_DeviceOffset + (UINT64)m_Header.m_DeviceCount * sizeof(RegisterMapDevice) > m_Header.m_TableOffset ||
+        m_Header.m_TableOffset + (UINT64)m_Header.m_TableCount * sizeof(RegisterMapTable) > m_Header.m_RegisterOffset ||
+        m_Header.m_RegisterOffset + (UINT64)m_Header.m_RegisterCount * sizeof(RegisterMapRegister) > m_Header.m_FieldOffset ||
+        m_Header.m_FieldOffset + (UINT64)m_Header.m_FieldCount * sizeof(RegisterMapField) > m_Header.m_StringOffset ||
+        m_Header.m_StringOffset + m_Header.m_StringSize > m_Header.m_Size ||
+        m_Header.m_StringSize == 0 || m_View[m_Header.m_StringOffset + m_Header.m_StringSize - 1] != '\0') {
+        m_StatusMessage << "Register map " << FileName << " is truncated";
+        userStatus = IndexOutOfRange;
+        goto Exit;
+    }
+
+    m_Buckets = (const UINT32*)(m_View + m_Header.m_BucketOffset);
+    m_Devices = (const RegisterMapDevice*)(m_View + m_Header.m_DeviceOffset);
+    m_Tables = (const RegisterMapTable*)(m_View + m_Header.m_TableOffset);
+    m_Registers = (const RegisterMapRegister*)(m_View + m_Header.m_RegisterOffset);
+    m_Fields = (const RegisterMapField*)(m_View + m_Header.m_FieldOffset);
+    m_Strings = (const char*)(m_View + m_Header.m_StringOffset);
+
+Exit:
+    if (userStatus != Success) {
+        Close();
+    }
+    return userStatus;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMap::FindDevice
+
+  Summary:  Returns the device with the given ids, one hash slot is read.
+
+  Args:     UINT16 VendorId, UINT16 DeviceId
+              Ids of the device.
+
+  Modifies: None.
+
+  Returns:  const RegisterMapDevice*
+              Returns NULL if the device is not described.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+const RegisterMapDevice* CRegisterMap::FindDevice(UINT16 VendorId, UINT16 DeviceId)
+{
+    const RegisterMapDevice* device;
+
+    if (m_View == NULL || m_Header.m_DeviceCount == 0) {
+        return NULL;
+    }
+
+    device = &m_Devices[CPerfectHash::Lookup(REGISTER_MAP_KEY(VendorId, DeviceId), m_Buckets, m_Header.m_BucketCount, m_Header.m_DeviceCount)];
+    if (device->m_VendorId != VendorId || device->m_DeviceId != DeviceId || device->m_Table >= m_Header.m_TableCount) {
+        return NULL;
+    }
+    return device;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMap::FindRegister
+
+  Summary:  Binary searches the register table of a device.
+
+  Args:     const RegisterMapDevice* Device
+              Device returned by FindDevice.
+            UINT32 Offset
+              Register offset in the BAR.
+
+  Modifies: None.
+
+  Returns:  const RegisterMapRegister*
+              Returns NULL if no register starts at Offset or its width is
+              not 1, 2, 4 or 8 bytes.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+const RegisterMapRegister* CRegisterMap::FindRegister(const RegisterMapDevice* Device, UINT32 Offset)
+{
+    const RegisterMapTable& table = m_Tables[Device->m_Table];
+    const RegisterMapRegister* first;
+    const RegisterMapRegister* last;
+
+    if ((UINT64)table.m_FirstRegister + table.m_RegisterCount > m_Header.m_RegisterCount) {
+        return NULL;
+    }
+
+    first = m_Registers + table.m_FirstRegister;
+    last = first + table.m_RegisterCount;
+    first = std::lower_bound(first, last, Offset, [](const RegisterMapRegister& Register, UINT32 Value) {
+        return Register.m_Offset < Value;
+    });
+    return (first != last && first->m_Offset == Offset && REGISTER_MAP_VALID_WIDTH(first->m_Width)) ? first : NULL;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CRegisterMap::Decode
+
+  Summary:  Finds the first register inside the dump by binary search and
+            then walks the sorted table, copying every register that lies
+            entirely inside the dump. Registers that are not 1, 2, 4 or 8
+            bytes wide are skipped.
+
+  Args:     const RegisterMapDevice* Device
+              Device returned by FindDevice.
+            UINT32 BaseOffset
+              BAR offset of the first byte of Data.
+            const UINT8* Data, UINT32 Size
+              Dump to decode.
+            std::vector<DecodedRegister>& Registers
+              Receives the registers in offset order.
+
+  Modifies: [Registers].
+
+  Returns:  UINT32
+              Returns the number of registers decoded.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UINT32 CRegisterMap::Decode(const RegisterMapDevice* Device, UINT32 BaseOffset, const UINT8* Data, UINT32 Size, std::vector<DecodedRegister>& Registers)
+{
+    const RegisterMapTable& table = m_Tables[Device->m_Table];
+    const RegisterMapRegister* first;
+    const RegisterMapRegister* last;
+    UINT64 end = (UINT64)BaseOffset + Size;
+
+    Registers.clear();
+    if ((UINT64)table.m_FirstRegister + table.m_RegisterCount > m_Header.m_RegisterCount) {
+        return 0;
+    }
+
+    first = m_Registers + table.m_FirstRegister;
+    last = first + table.m_RegisterCount;
+    first = std::lower_bound(first, last, BaseOffset, [](const RegisterMapRegister& Register, UINT32 Value) {
+        return Register.m_Offset < Value;
+    });
+
+    for (; first != last && first->m_Offset < end; first++)
+    {
+        DecodedRegister decoded;
+
+        if (first->m_Offset + (UINT64)first->m_Width > end) {
+            break;
+        }
+
+        //
+        // The value is copied into a UINT64, a corrupt width is skipped.
+        //
+        if (!REGISTER_MAP_VALID_WIDTH(first->m_Width)) {
+            continue;
+        }
+        decoded.m_Register = first;
+        decoded.m_Value = 0;
+        memcpy(&decoded.m_Value, Data + (first->m_Offset - BaseOffset), first->m_Width);
+        Registers.push_back(decoded);
+    }
+
+    return (UINT32)Registers.size();
+}
+
+const RegisterMapField* CRegisterMap::GetFields(const RegisterMapRegister* Register)
+{
+    if ((UINT64)Register->m_FirstField + Register->m_FieldCount > m_Header.m_FieldCount) {
+        return NULL;
+    }
+    return m_Fields + Register->m_FirstField;
+}
+
+const char* CRegisterMap::GetString(UINT32 String)
+{
+    return (String < m_Header.m_StringSize) ? m_Strings + String : "";
+}
+
+const RegisterMapHeader& CRegisterMap::GetHeader()
+{
+    return m_Header;
+}
+
+void CRegisterMap::Close()
+{
+    if (m_View != NULL) {
+        UnmapViewOfFile(m_View);
+        m_View = NULL;
+    }
+    if (m_Mapping != NULL) {
+        CloseHandle(m_Mapping);
+        m_Mapping = NULL;
+    }
+    if (m_File != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_File);
+        m_File = INVALID_HANDLE_VALUE;
+    }
+    m_Buckets = NULL;
+    m_Devices = NULL;
+    m_Tables = NULL;
+    m_Registers = NULL;
+    m_Fields = NULL;
+    m_Strings = NULL;
+}
+
+std::string CRegisterMap::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
@@ -0,0 +1,221 @@
+#pragma once
+/*+===================================================================
+  File:      RegisterMap.h
+
+  Summary:   Compiles vendor register descriptions into a memory mapped
+             database and decodes MMIO dumps with it.
+
+  Classes:   CRegisterMapCompiler, CRegisterMap.
+
+  Functions: AddFile, Write, Open, FindDevice, FindRegister, Decode.
+
+  Origin:
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "PerfectHash.h"
+
+#define REGISTER_MAP_MAGIC          0x4D525748      // 'HWRM'
+#define REGISTER_MAP_VERSION        1
+#define REGISTER_MAP_KEY(v, d)      (((UINT64)(v) << 16) | (d))
+#define REGISTER_MAP_VALID_WIDTH(w) ((w) == 1 || (w) == 2 || (w) == 4 || (w) == 8)
+
+//
+// A description file is line based, '#' starts a comment and text with
+// blanks is quoted:
+//
+//   device <VendorId> <DeviceId> ["Name"]
+//   register <Offset> <Bits> <ro|rw|rw1c> <Name> ["Description"]
+//   field <Lsb> <Bits> <ro|rw|rw1c> <Name> ["Description"]
+//
+// Consecutive device lines share the registers that follow them, fields
+// belong to the register above. Registers are 8, 16, 32 or 64 bits wide,
+// naturally aligned and must not overlap, neither may fields.
+//
+// A database is a RegisterMapHeader, the perfect hash displacements, one
+// RegisterMapDevice per slot, the register tables, the registers sorted by
+// offset per table, the fields sorted by lsb per register and a pool of
+// NUL terminated strings, string 0 is empty.
+//
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    UINT32 m_Magic;
+    UINT32 m_Version;
+    UINT32 m_DeviceCount;
+    UINT32 m_BucketCount;
+    UINT32 m_TableCount;
+    UINT32 m_RegisterCount;
+    UINT32 m_FieldCount;
+    UINT32 m_StringSize;
+    UINT64 m_BucketOffset;
+    UINT64 m_DeviceOffset;
+    UINT64 m_TableOffset;
+    UINT64 m_RegisterOffset;
+    UINT64 m_FieldOffset;
+    UINT64 m_StringOffset;
+    UINT64 m_Size;
+}RegisterMapHeader;
+
+typedef struct
+{
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT32 m_Table;
+    UINT32 m_Name;
+}RegisterMapDevice;
+
+typedef struct
+{
+    UINT32 m_FirstRegister;
+    UINT32 m_RegisterCount;
+}RegisterMapTable;
+
+typedef struct
+{
+    UINT32 m_Offset;
+    UINT8 m_Width;
+    UINT8 m_Access;
+    UINT16 m_FieldCount;
+    UINT32 m_FirstField;
+    UINT32 m_Name;
+    UINT32 m_Description;
+}RegisterMapRegister;
+
+typedef struct
+{
+    UINT8 m_Lsb;
+    UINT8 m_Bits;
+    UINT8 m_Access;
+    UINT8 m_Reserved;
+    UINT32 m_Name;
+    UINT32 m_Description;
+}RegisterMapField;
+#pragma pack(pop)
+
+//
+// A register of a decoded dump, m_Register points into the database.
+//
+typedef struct
+{
+    const RegisterMapRegister* m_Register;
+    UINT64 m_Value;
+}DecodedRegister;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CRegisterMapCompiler
+
+  Summary:  Parses and checks description files and writes the database.
+
+  Methods:  UserStatus AddFile(const std::string& FileName)
+              Parses a description file.
+            UserStatus AddText(const std::string& Text, const std::string& Source)
+              Parses a description held in memory, Source names it in errors.
+            UserStatus Write(const std::string& FileName)
+              Builds the perfect hash and writes the database.
+            UINT32 GetDeviceCount(), GetRegisterCount()
+              Return the devices and registers parsed so far.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CRegisterMapCompiler
+{
+public:
+    CRegisterMapCompiler();
+    UserStatus AddFile(const std::string& FileName);
+    UserStatus AddText(const std::string& Text, const std::string& Source);
+    UserStatus Write(const std::string& FileName);
+    UINT32 GetDeviceCount();
+    UINT32 GetRegisterCount();
+    std::string GetStatusMessage();
+
+private:
+    struct CompiledRegister
+    {
+        RegisterMapRegister m_Register;
+        std::vector<RegisterMapField> m_Fields;
+    };
+
+    UINT32 AddString(const std::string& Text);
+    UserStatus CloseTable(const std::string& Source);
+
+    std::vector<RegisterMapDevice> m_Devices;
+    std::unordered_map<UINT64, UINT32> m_DeviceIndex;
+    std::vector<std::vector<CompiledRegister>> m_Tables;
+    std::vector<CHAR> m_Strings;
+    std::unordered_map<std::string, UINT32> m_StringIndex;
+    UINT32 m_RegisterCount;
+    std::stringstream m_StatusMessage;
+};
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CRegisterMap
+
+  Summary:  Looks up devices and registers in a memory mapped database.
+            Opening checks the header only, lookups touch just the pages
+            they read.
+
+  Methods:  UserStatus Open(const std::string& FileName)
+              Maps a database.
+            const RegisterMapDevice* FindDevice(UINT16 VendorId, UINT16 DeviceId)
+              Returns the device or NULL.
+            const RegisterMapRegister* FindRegister(const RegisterMapDevice* Device, UINT32 Offset)
+              Returns the register at Offset or NULL.
+            UINT32 Decode(const RegisterMapDevice* Device, UINT32 BaseOffset, const UINT8* Data, UINT32 Size, std::vector<DecodedRegister>& Registers)
+              Decodes the registers inside a dump of Size bytes taken at
+              BaseOffset, returns their count.
+            const RegisterMapField* GetFields(const RegisterMapRegister* Register)
+              Returns the m_FieldCount fields of a register.
+            static UINT64 GetFieldValue(const RegisterMapField* Field, UINT64 RegisterValue)
+              Extracts a field.
+            const char* GetString(UINT32 String)
+              Returns a string of the pool.
+            const RegisterMapHeader& GetHeader()
+              Returns the database header.
+            void Close()
+              Unmaps the database.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CRegisterMap
+{
+public:
+    CRegisterMap();
+    ~CRegisterMap();
+    UserStatus Open(const std::string& FileName);
+    const RegisterMapDevice* FindDevice(UINT16 VendorId, UINT16 DeviceId);
+    const RegisterMapRegister* FindRegister(const RegisterMapDevice* Device, UINT32 Offset);
+    UINT32 Decode(const RegisterMapDevice* Device, UINT32 BaseOffset, const UINT8* Data, UINT32 Size, std::vector<DecodedRegister>& Registers);
+    const RegisterMapField* GetFields(const RegisterMapRegister* Register);
+    const char* GetString(UINT32 String);
+    const RegisterMapHeader& GetHeader();
+    void Close();
+    std::string GetStatusMessage();
+
+    static inline UINT64 GetFieldValue(const RegisterMapField* Field, UINT64 RegisterValue)
+    {
+        UINT64 mask = (Field->m_Bits >= 64) ? ~0ULL : ((1ULL << Field->m_Bits) - 1);
+        return (RegisterValue >> Field->m_Lsb) & mask;
+    }
+
+private:
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const UINT8* m_View;
+    RegisterMapHeader m_Header;
+    const UINT32* m_Buckets;
+    const RegisterMapDevice* m_Devices;
+    const RegisterMapTable* m_Tables;
+    const RegisterMapRegister* m_Registers;
+    const RegisterMapField* m_Fields;
+    const char* m_Strings;
+    std::stringstream m_StatusMessage;
+};
@@ -0,0 +1,184 @@
+#include "SriovEnumerator.h"
+
+CSriovEnumerator::CSriovEnumerator(CHardwareInterfaceLib& CHWLib)
+    : m_Walker(CHWLib)
+{
+    m_Read = CCapabilityWalker::LibRead;
+    m_Context = &CHWLib;
+    m_CaptureSize = 0;
+}
+
+CSriovEnumerator::CSriovEnumerator(PFN_CFG_READ Read, PVOID Context)
+    : m_Walker(Read, Context)
+{
+    m_Read = Read;
+    m_Context = Context;
+    m_CaptureSize = 0;
+}
+
+UserStatus CSriovEnumerator::GetSriovInfo(UINT8 Bus, UINT8 Device, UINT8 Function, SriovInfo& Info)
+{
+    UserStatus userStatus = Success;
+    SriovVfEnable::ValueType vfEnable = 0;
+    m_StatusMessage.str("");
+
+    memset(&Info, 0, sizeof(Info));
+
+    userStatus = m_Walker.ReadRegister<SriovTotalVFs>(Bus, Device, Function, Info.m_TotalVFs);
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<SriovNumVFs>(Bus, Device, Function, Info.m_NumVFs);
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<SriovFirstVfOffset>(Bus, Device, Function, Info.m_FirstVfOffset);
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<SriovVfStride>(Bus, Device, Function, Info.m_VfStride);
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadRegister<SriovVfDeviceId>(Bus, Device, Function, Info.m_VfDeviceId);
+    }
+    if (userStatus == Success) {
+        userStatus = m_Walker.ReadField<SriovVfEnable>(Bus, Device, Function, vfEnable);
+    }
+    if (userStatus != Success) {
+        m_StatusMessage << m_Walker.GetStatusMessage();
+        return userStatus;
+    }
+
+    Info.m_VfEnable = (vfEnable != 0);
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CSriovEnumerator::GetVirtualFunctions
+
+  Summary:  Computes the routing ids of the VFs of a PF from First VF
+            Offset and VF Stride. Only NumVFs VFs exist, and only while
+            VF Enable is set, NumVFs is limited to TotalVFs.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Physical function.
+            std::vector<UINT16>& RoutingIds
+              Receives one routing id per VF, in VF order.
+
+  Modifies: [RoutingIds].
+
+  Returns:  UserStatus
+              Returns IndexOutOfRange if the PF has no SR-IOV capability
+              or a VF would be past bus 255.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CSriovEnumerator::GetVirtualFunctions(UINT8 Bus, UINT8 Device, UINT8 Function, std::vector<UINT16>& RoutingIds)
+{
+    UserStatus userStatus = Success;
+    SriovInfo info;
+    UINT32 vfCount = 0;
+    UINT32 routingId = 0;
+
+    RoutingIds.clear();
+
+    userStatus = GetSriovInfo(Bus, Device, Function, info);
+    if (userStatus != Success || !info.m_VfEnable) {
+        return userStatus;
+    }
+
+    vfCount = (info.m_NumVFs < info.m_TotalVFs) ? info.m_NumVFs : info.m_TotalVFs;
+    if (vfCount > 1 && info.m_VfStride == 0) {
+        m_StatusMessage << "VF Stride is 0 with " << std::dec << vfCount << " VFs";
+        return Failure;
+    }
+
+    RoutingIds.reserve(vfCount);
+    routingId = SRIOV_ROUTING_ID(Bus, Device, Function) + (UINT32)info.m_FirstVfOffset;
+    for (UINT32 vf = 0; vf < vfCount; vf++)
+    {
+        if (routingId > 0xFFFF) {
+            m_StatusMessage << "VF " << std::dec << vf + 1 << " of " << vfCount << " is past bus 255";
+            RoutingIds.clear();
+            return IndexOutOfRange;
+        }
+        RoutingIds.push_back((UINT16)routingId);
+        routingId += info.m_VfStride;
+    }
+
+    return Success;
+}
+
+/*M+M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M+++M
+  Method:   CSriovEnumerator::Capture
+
+  Summary:  Reads Size bytes of configuration space of every enabled VF
+            of a PF. Each read is hashed, a capture already seen is not
+            stored again, the VF only records its index.
+
+  Args:     UINT8 Bus, UINT8 Device, UINT8 Function
+              Physical function.
+            UINT32 Size
+              Bytes per VF from offset 0, a multiple of 4 up to
+              PCIe_CFG_SIZE.
+
+  Modifies: [m_RoutingIds, m_CaptureIndex, m_Captures, m_Hashes, m_Index].
+
+  Returns:  UserStatus
+              Returns error code, the capture is empty on failure.
+M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M---M-M*/
+UserStatus CSriovEnumerator::Capture(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Size)
+{
+    UserStatus userStatus = Success;
+    std::vector<UINT8> data;
+
+    m_RoutingIds.clear();
+    m_CaptureIndex.clear();
+    m_Captures.clear();
+    m_Hashes.clear();
+    m_Index.clear();
+    m_CaptureSize = Size;
+
+    if (Size == 0 || Size > PCIe_CFG_SIZE || (Size % sizeof(UINT32)) != 0) {
+        m_StatusMessage.str("");
+        m_StatusMessage << "Invalid capture size 0x" << std::hex << Size;
+        return IndexOutOfRange;
+    }
+
+    userStatus = GetVirtualFunctions(Bus, Device, Function, m_RoutingIds);
+    if (userStatus != Success) {
+        return userStatus;
+    }
+
+    data.resize(Size);
+    m_CaptureIndex.reserve(m_RoutingIds.size());
+    for (UINT32 vf = 0; vf < m_RoutingIds.size(); vf++)
+    {
+        UINT16 routingId = m_RoutingIds[vf];
+        Hash128 hash;
+
+        userStatus = m_Read(m_Context, SRIOV_ROUTING_ID_BUS(routingId), SRIOV_ROUTING_ID_DEVICE(routingId),
+            SRIOV_ROUTING_ID_FUNCTION(routingId), 0, data.data(), Size);
+        if (userStatus != Success) {
+            m_StatusMessage << "Configuration read failed for VF " << std::dec << vf + 1 << ", Bus: 0x" << std::hex
+                << +SRIOV_ROUTING_ID_BUS(routingId) << ", Device: 0x" << +SRIOV_ROUTING_ID_DEVICE(routingId)
+                << ", Function: 0x" << +SRIOV_ROUTING_ID_FUNCTION(routingId);
+            m_RoutingIds.clear();
+            m_CaptureIndex.clear();
+            m_Captures.clear();
+            m_Hashes.clear();
+            m_Index.clear();
+            return userStatus;
+        }
+
+        hash = CHash128::Compute(data.data(), Size, Size);
+        auto found = m_Index.find(hash);
+        if (found == m_Index.end()) {
+            found = m_Index.emplace(hash, (UINT32)m_Hashes.size()).first;
+            m_Hashes.push_back(hash);
+            m_Captures.insert(m_Captures.end(), data.begin(), data.end());
+        }
+        m_CaptureIndex.push_back(found->second);
+    }
+
+    return Success;
+}
+
+std::string CSriovEnumerator::GetStatusMessage()
+{
+    return m_StatusMessage.str();
+}
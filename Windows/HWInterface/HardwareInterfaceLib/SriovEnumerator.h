@@ -0,0 +1,121 @@
+#pragma once
+/*+===================================================================
+  File:      SriovEnumerator.h
+
+  Summary:   Finds the virtual functions of an SR-IOV physical function
+             and captures their configuration spaces, storing identical
+             captures once.
+
+  Classes:   CSriovEnumerator.
+
+  Functions: GetSriovInfo, GetVirtualFunctions, Capture.
+
+  Origin:    PCI Express Base Specification, Single Root I/O
+             Virtualization and Sharing.
+
+##
+
+  Copyright and Legal notices.
+===================================================================+*/
+
+#include <unordered_map>
+#include <vector>
+#include "HardwareInterfaceLib.h"
+#include "CapabilityWalker.h"
+#include "Hash128.h"
+
+#define SRIOV_ROUTING_ID(b, d, f)       (UINT16)(((b) << 8) | (((d) & 0x1F) << 3) | ((f) & 0x07))
+#define SRIOV_ROUTING_ID_BUS(r)         (UINT8)((r) >> 8)
+#define SRIOV_ROUTING_ID_DEVICE(r)      (UINT8)(((r) >> 3) & 0x1F)
+#define SRIOV_ROUTING_ID_FUNCTION(r)    (UINT8)((r) & 0x07)
+
+typedef struct
+{
+    UINT16 m_TotalVFs;
+    UINT16 m_NumVFs;
+    UINT16 m_FirstVfOffset;
+    UINT16 m_VfStride;
+    UINT16 m_VfDeviceId;
+    bool m_VfEnable;
+}SriovInfo;
+
+/*C+C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C+++C
+  Class:    CSriovEnumerator
+
+  Summary:  VFs are usually not all exposed as devnodes, so their routing
+            ids are computed from the SR-IOV capability of the PF: VF n,
+            counting from 1, is at PF + First VF Offset + (n - 1) * VF
+            Stride. A capture reads every VF once and keys it by its
+            128-bit hash, VFs of one PF normally differ in few places if
+            at all, so the captures kept are the distinct ones and every
+            VF holds the index of its capture.
+
+  Methods:  CSriovEnumerator(CHardwareInterfaceLib& CHWLib)
+              Reads through the driver.
+            CSriovEnumerator(PFN_CFG_READ Read, PVOID Context)
+              Reads through any other backend.
+            UserStatus GetSriovInfo(UINT8 Bus, UINT8 Device, UINT8 Function, SriovInfo& Info)
+              Reads the SR-IOV capability of a PF.
+            UserStatus GetVirtualFunctions(UINT8 Bus, UINT8 Device, UINT8 Function, std::vector<UINT16>& RoutingIds)
+              Returns the routing ids of the enabled VFs of a PF.
+            UserStatus Capture(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Size)
+              Captures Size bytes of every enabled VF of a PF.
+            UINT32 GetVfCount(), UINT16 GetRoutingId(UINT32 Vf), UINT32 GetCaptureIndex(UINT32 Vf)
+              Return the VFs of the last capture and the capture of each.
+            UINT32 GetCaptureCount(), const UINT8* GetCapture(UINT32 Index), UINT32 GetCaptureSize()
+              Return the distinct captures.
+            std::string GetStatusMessage()
+              Returns the error status message.
+C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C---C-C*/
+class CSriovEnumerator
+{
+public:
+    CSriovEnumerator(CHardwareInterfaceLib& CHWLib);
+    CSriovEnumerator(PFN_CFG_READ Read, PVOID Context);
+    UserStatus GetSriovInfo(UINT8 Bus, UINT8 Device, UINT8 Function, SriovInfo& Info);
+    UserStatus GetVirtualFunctions(UINT8 Bus, UINT8 Device, UINT8 Function, std::vector<UINT16>& RoutingIds);
+    UserStatus Capture(UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Size);
+    std::string GetStatusMessage();
+
+    UINT32 GetVfCount()
+    {
+        return (UINT32)m_RoutingIds.size();
+    }
+
+    UINT16 GetRoutingId(UINT32 Vf)
+    {
+        return m_RoutingIds[Vf];
+    }
+
+    UINT32 GetCaptureIndex(UINT32 Vf)
+    {
+        return m_CaptureIndex[Vf];
+    }
+
+    UINT32 GetCaptureCount()
+    {
+        return (UINT32)m_Hashes.size();
+    }
+
+    const UINT8* GetCapture(UINT32 Index)
+    {
+        return m_Captures.data() + (SIZE_T)Index * m_CaptureSize;
+    }
+
+    UINT32 GetCaptureSize()
+    {
+        return m_CaptureSize;
+    }
+
+private:
+    CCapabilityWalker m_Walker;
+    PFN_CFG_READ m_Read;
+    PVOID m_Context;
+    std::vector<UINT16> m_RoutingIds;
+    std::vector<UINT32> m_CaptureIndex;
+    std::vector<UINT8> m_Captures;
+    std::vector<Hash128> m_Hashes;
+    std::unordered_map<Hash128, UINT32, Hash128Hasher> m_Index;
+    UINT32 m_CaptureSize;
+    std::stringstream m_StatusMessage;
+};
@@ -1,13 +1,43 @@
 #include <Windows.h>
 #include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include "..\sys\public.h"
 
-int main()
+#define BENCH_DEFAULT_ITERATIONS    1000
+#define BENCH_WARMUP_ITERATIONS     16
+
+//
+// IN_DIRECT sends the payload in the output buffer and gets only its length
+// back, the other methods echo it.
+//
+typedef struct
+{
+    const char* m_Name;
+    ULONG m_IoControlCode;
+    bool m_Echoes;
+}EchoMethod;
+
+static const EchoMethod EchoMethods[] =
+{
+    { "BUFFERED", (ULONG)IOCTL_NONPNP_ECHO_BUFFERED, true },
+    { "IN_DIRECT", (ULONG)IOCTL_NONPNP_ECHO_IN_DIRECT, false },
+    { "OUT_DIRECT", (ULONG)IOCTL_NONPNP_ECHO_OUT_DIRECT, true },
+    { "NEITHER", (ULONG)IOCTL_NONPNP_ECHO_NEITHER, true },
+};
+
+static const ULONG DefaultSizes[] = { 0, 64, 512, 4096, 65536, NON_PNP_ECHO_MAX_SIZE };
+
+int MessageCommand(HANDLE handle);
+int BenchCommand(HANDLE handle, int argc, char* argv[]);
+bool Echo(HANDLE handle, const EchoMethod& Method, PUCHAR Payload, PUCHAR Echoed, ULONG Size);
+
+int main(int argc, char* argv[])
 {
     HANDLE handle = INVALID_HANDLE_VALUE;
-    CHAR InputBuffer[500] = { 0 };
-    CHAR OutputBuffer[500] = { 0 };
-    ULONG BytesReturned = 0;
+    int result = 0;
 
     handle = CreateFileA(
         NON_PNP_DRIVER_FILE_NAME,
@@ -23,6 +53,26 @@ int main()
         return 1;
     }
 
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        result = BenchCommand(handle, argc, argv);
+    }
+    else {
+        result = MessageCommand(handle);
+    }
+
+    //
+    // Close the handle to the device before unloading the driver.
+    //
+    CloseHandle(handle);
+    return result;
+}
+
+int MessageCommand(HANDLE handle)
+{
+    CHAR InputBuffer[500] = { 0 };
+    CHAR OutputBuffer[500] = { 0 };
+    ULONG BytesReturned = 0;
+
     std::cout << "Enter your name: ";
     std::cin >> InputBuffer;
 
@@ -42,9 +92,127 @@ int main()
     }
 
     std::cout << "Message from driver: " << OutputBuffer << std::endl;
+    return 0;
+}
 
-    //
-    // Close the handle to the device before unloading the driver.
-    //
-    CloseHandle(handle);
+bool Echo(HANDLE handle, const EchoMethod& Method, PUCHAR Payload, PUCHAR Echoed, ULONG Size)
+{
+    ULONG BytesReturned = 0;
+    bool result;
+
+    if (Method.m_Echoes) {
+        result = DeviceIoControl(handle, Method.m_IoControlCode, Payload, Size, Echoed, Size, &BytesReturned, NULL);
+    }
+    else {
+        result = DeviceIoControl(handle, Method.m_IoControlCode, NULL, 0, Payload, Size, &BytesReturned, NULL);
+    }
+    return result && BytesReturned == Size;
+}
+
+//
+// Runs Iterations round trips per method and payload size, each timed on
+// its own, and prints the rate, the throughput and the latency
+// percentiles. The echoed payload of the last round trip is checked.
+//
+int BenchCommand(HANDLE handle, int argc, char* argv[])
+{
+    std::vector<ULONG> Sizes;
+    std::vector<LONGLONG> Latencies;
+    ULONG Iterations = BENCH_DEFAULT_ITERATIONS;
+    LARGE_INTEGER Frequency, Start, End;
+    PUCHAR Payload = NULL, Echoed = NULL;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string Option = argv[i];
+        if (Option == "-iterations" && i + 1 < argc) {
+            Iterations = std::stoul(argv[++i], nullptr, 0);
+        }
+        else if (Option == "-size" && i + 1 < argc) {
+            Sizes.push_back(std::stoul(argv[++i], nullptr, 0));
+        }
+        else {
+            std::cout << "Usage: NonPnPApp.exe bench [-iterations <Count>] [-size <Bytes>]..." << std::endl;
+            return 1;
+        }
+    }
+    if (Sizes.empty()) {
+        Sizes.assign(DefaultSizes, DefaultSizes + sizeof(DefaultSizes) / sizeof(DefaultSizes[0]));
+    }
+    for (auto Size : Sizes)
+    {
+        if (Size > NON_PNP_ECHO_MAX_SIZE) {
+            std::cout << "Payload size " << Size << " is above the maximum of " << NON_PNP_ECHO_MAX_SIZE << " bytes" << std::endl;
+            return 1;
+        }
+    }
+    if (Iterations == 0) {
+        Iterations = 1;
+    }
+
+    Payload = (PUCHAR)VirtualAlloc(NULL, NON_PNP_ECHO_MAX_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    Echoed = (PUCHAR)VirtualAlloc(NULL, NON_PNP_ECHO_MAX_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (Payload == NULL || Echoed == NULL) {
+        std::cout << "Buffer allocation failed " << GetLastError() << std::endl;
+        return 1;
+    }
+    for (ULONG i = 0; i < NON_PNP_ECHO_MAX_SIZE; i++)
+    {
+        Payload[i] = (UCHAR)(i * 7 + 1);
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    Latencies.resize(Iterations);
+
+    std::cout << std::left << std::setw(12) << "Method" << std::right << std::setw(10) << "Bytes" << std::setw(12) << "Trips/s"
+        << std::setw(10) << "MB/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+        << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << std::endl;
+
+    for (auto& Method : EchoMethods)
+    {
+        for (auto Size : Sizes)
+        {
+            LONGLONG Total = 0;
+            bool Failed = false;
+
+            for (ULONG i = 0; i < BENCH_WARMUP_ITERATIONS && !Failed; i++)
+            {
+                Failed = !Echo(handle, Method, Payload, Echoed, Size);
+            }
+
+            memset(Echoed, 0, Size);
+            for (ULONG i = 0; i < Iterations && !Failed; i++)
+            {
+                QueryPerformanceCounter(&Start);
+                Failed = !Echo(handle, Method, Payload, Echoed, Size);
+                QueryPerformanceCounter(&End);
+                Latencies[i] = End.QuadPart - Start.QuadPart;
+                Total += Latencies[i];
+            }
+            if (!Failed && Method.m_Echoes) {
+                Failed = (memcmp(Payload, Echoed, Size) != 0);
+            }
+            if (Failed) {
+                std::cout << std::left << std::setw(12) << Method.m_Name << std::right << std::setw(10) << Size
+                    << "  round trip failed " << GetLastError() << std::endl;
+                continue;
+            }
+
+            std::sort(Latencies.begin(), Latencies.end());
+            auto Percentile = [&](double Percent) {
+                return (double)Latencies[(size_t)((Iterations - 1) * Percent / 100.0)] * 1000000.0 / Frequency.QuadPart;
+            };
+            double Seconds = (double)(Total ? Total : 1) / Frequency.QuadPart;
+
+            std::cout << std::left << std::setw(12) << Method.m_Name << std::right << std::setw(10) << Size << std::fixed
+                << std::setprecision(0) << std::setw(12) << Iterations / Seconds << std::setprecision(1)
+                << std::setw(10) << (double)Size * Iterations / Seconds / (1024 * 1024)
+                << std::setw(10) << Percentile(50) << std::setw(10) << Percentile(90) << std::setw(10) << Percentile(99)
+                << std::setw(10) << Percentile(99.9) << std::setw(10) << Percentile(100) << std::endl;
+        }
+    }
+
+    VirtualFree(Payload, 0, MEM_RELEASE);
+    VirtualFree(Echoed, 0, MEM_RELEASE);
+    return 0;
 }
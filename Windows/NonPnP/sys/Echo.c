@@ -0,0 +1,143 @@
+/*++
+
+Module Name:
+
+	Echo.c
+
+Abstract:
+
+	This file contains the payload echo of the benchmark IOCTLs. The caller
+	passes the buffers it retrieved for the transfer method, so the cost
+	measured here is the copy alone.
+
+Environment:
+
+	user and kernel
+
+--*/
+
+#include "Echo.h"
+#include "public.h"
+
+UINT32
+EchoCopy(
+	_In_reads_bytes_opt_(InputLength) const VOID* Input,
+	_In_ SIZE_T InputLength,
+	_Out_writes_bytes_opt_(OutputLength) PVOID Output,
+	_In_ SIZE_T OutputLength,
+	_Out_ PSIZE_T BytesEchoed
+	)
+/*++
+
+Routine Description:
+
+	Copies the input payload to the output buffer.
+
+Arguments:
+
+	Input - payload, may be NULL when InputLength is 0.
+
+	InputLength - payload length in bytes, at most NON_PNP_ECHO_MAX_SIZE.
+
+	Output - receives the payload, at least InputLength bytes.
+
+	OutputLength - length of the output buffer in bytes.
+
+	BytesEchoed - receives the number of bytes copied.
+
+Return Value:
+
+	ECHO_STATUS_SUCCESS or ECHO_STATUS_* error code.
+
+--*/
+{
+	*BytesEchoed = 0;
+
+	if (InputLength > NON_PNP_ECHO_MAX_SIZE) {
+		return ECHO_STATUS_TOO_LARGE;
+	}
+	if (InputLength == 0) {
+		return ECHO_STATUS_SUCCESS;
+	}
+	if (Input == NULL || Output == NULL) {
+		return ECHO_STATUS_INVALID_PARAMETER;
+	}
+	if (OutputLength < InputLength) {
+		return ECHO_STATUS_BUFFER_TOO_SMALL;
+	}
+
+	//
+	// With METHOD_BUFFERED input and output share the system buffer.
+	//
+	if (Output != Input) {
+		RtlMoveMemory(Output, Input, InputLength);
+	}
+
+	*BytesEchoed = InputLength;
+	return ECHO_STATUS_SUCCESS;
+}
+
+UINT32
+EchoConsume(
+	_In_reads_bytes_opt_(InputLength) const VOID* Input,
+	_In_ SIZE_T InputLength,
+	_Out_ PSIZE_T BytesConsumed,
+	_Out_ PUINT32 Checksum
+	)
+/*++
+
+Routine Description:
+
+	Reads the whole payload without returning it, for transfer methods
+	that carry data to the driver only.
+
+Arguments:
+
+	Input - payload, may be NULL when InputLength is 0.
+
+	InputLength - payload length in bytes, at most NON_PNP_ECHO_MAX_SIZE.
+
+	BytesConsumed - receives the number of bytes read.
+
+	Checksum - receives the folded sum of the payload qwords, so that
+		the reads cannot be dropped.
+
+Return Value:
+
+	ECHO_STATUS_SUCCESS or ECHO_STATUS_* error code.
+
+--*/
+{
+	const UINT8* Data = (const UINT8*)Input;
+	UINT64 Word = 0;
+	UINT64 Sum = 0;
+	SIZE_T i = 0;
+
+	*BytesConsumed = 0;
+	*Checksum = 0;
+
+	if (InputLength > NON_PNP_ECHO_MAX_SIZE) {
+		return ECHO_STATUS_TOO_LARGE;
+	}
+	if (InputLength != 0 && Input == NULL) {
+		return ECHO_STATUS_INVALID_PARAMETER;
+	}
+
+	//
+	// Summed a qword at a time so that reading the payload costs about as
+	// much as copying it, the tail is summed byte by byte.
+	//
+	for (i = 0; i + sizeof(UINT64) <= InputLength; i += sizeof(UINT64))
+	{
+		RtlCopyMemory(&Word, Data + i, sizeof(UINT64));
+		Sum += Word;
+	}
+	for (; i < InputLength; i++)
+	{
+		Sum += Data[i];
+	}
+
+	*BytesConsumed = InputLength;
+	*Checksum = (UINT32)(Sum ^ (Sum >> 32));
+	return ECHO_STATUS_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/*++
+
+Module Name:
+
+	Echo.h
+
+Abstract:
+
+	Payload echo used by the benchmark IOCTLs. It does not depend on WDF,
+	so the same code runs in the driver and in user mode.
+
+Environment:
+
+	user and kernel
+
+--*/
+
+#pragma once
+
+#ifdef _KERNEL_MODE
+#include <ntddk.h>
+#else
+#include <Windows.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ECHO_STATUS_SUCCESS				0
+#define ECHO_STATUS_INVALID_PARAMETER	1
+#define ECHO_STATUS_BUFFER_TOO_SMALL	2
+#define ECHO_STATUS_TOO_LARGE			3
+
+UINT32
+EchoCopy(
+	_In_reads_bytes_opt_(InputLength) const VOID* Input,
+	_In_ SIZE_T InputLength,
+	_Out_writes_bytes_opt_(OutputLength) PVOID Output,
+	_In_ SIZE_T OutputLength,
+	_Out_ PSIZE_T BytesEchoed
+	);
+
+UINT32
+EchoConsume(
+	_In_reads_bytes_opt_(InputLength) const VOID* Input,
+	_In_ SIZE_T InputLength,
+	_Out_ PSIZE_T BytesConsumed,
+	_Out_ PUINT32 Checksum
+	);
+
+#ifdef __cplusplus
+}
+#endif
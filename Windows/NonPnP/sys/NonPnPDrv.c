@@ -1,10 +1,14 @@
 #include "NonPnPDrv.h"
 #include "NonPnPDrv.tmh"
 
+static NTSTATUS EchoRequest(WDFREQUEST Request, ULONG IoControlCode, size_t OutputBufferLength, size_t InputBufferLength, size_t* BytesEchoed);
+
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(INIT, DriverEntry)
 #pragma alloc_text(PAGE, EvtWdfDriverUnload)
 #pragma alloc_text(PAGE, EvtWdfIoDeviceControl)
+#pragma alloc_text(PAGE, EvtWdfIoInCallerContext)
+#pragma alloc_text(PAGE, EchoRequest)
 #endif
 
 NTSTATUS
@@ -70,6 +74,13 @@ DriverEntry(
 	//
 	WdfDeviceInitSetExclusive(pDeviceInit, TRUE);
 	WdfDeviceInitSetIoType(pDeviceInit, WdfDeviceIoBuffered);
+
+	//
+	// METHOD_NEITHER buffers are user addresses, they are probed and locked
+	// while the request is still in the caller's context.
+	//
+	WdfDeviceInitSetIoInCallerContextCallback(pDeviceInit, EvtWdfIoInCallerContext);
+
 	Status = WdfDeviceInitAssignName(pDeviceInit, &NTDeviceName);
 	if (!NT_SUCCESS(Status))
 	{
@@ -165,7 +176,10 @@ void EvtWdfIoDeviceControl(
 
 	PAGED_CODE();
 
-	if (!OutputBufferLength || !InputBufferLength)
+	//
+	// Echo payloads may be empty, the message request needs both buffers.
+	//
+	if (IoControlCode == IOCTL_NONPNP_GET_MESSAGE && (!OutputBufferLength || !InputBufferLength))
 	{
 		Status = STATUS_INVALID_PARAMETER;
 		WdfRequestComplete(Request, Status);
@@ -220,6 +234,21 @@ void EvtWdfIoDeviceControl(
 			break;
 		}
 
+		case IOCTL_NONPNP_ECHO_BUFFERED:
+		case IOCTL_NONPNP_ECHO_IN_DIRECT:
+		case IOCTL_NONPNP_ECHO_OUT_DIRECT:
+		case IOCTL_NONPNP_ECHO_NEITHER:
+		{
+			size_t BytesEchoed = 0;
+
+			Status = EchoRequest(Request, IoControlCode, OutputBufferLength, InputBufferLength, &BytesEchoed);
+			if (NT_SUCCESS(Status)) {
+				WdfRequestSetInformation(Request, BytesEchoed);
+			}
+
+			break;
+		}
+
 		default:
 		{
 			//
@@ -236,6 +265,172 @@ void EvtWdfIoDeviceControl(
 	TraceEvents(TRACE_LEVEL_VERBOSE, NON_PNP, "%!FUNC!: Exiting with status 0x%x", Status);
 }
 
+//
+// Retrieves the buffers of an echo request for its transfer method and
+// runs the WDF independent echo on them.
+//
+static NTSTATUS EchoRequest(
+	WDFREQUEST Request,
+	ULONG IoControlCode,
+	size_t OutputBufferLength,
+	size_t InputBufferLength,
+	size_t* BytesEchoed
+)
+{
+	NTSTATUS			Status = STATUS_SUCCESS;
+	PVOID				InBuf = NULL, OutBuf = NULL;
+	PREQUEST_CONTEXT	Context = NULL;
+	UINT32				EchoStatus = ECHO_STATUS_SUCCESS;
+	UINT32				Checksum = 0;
+
+	PAGED_CODE();
+
+	switch (IoControlCode)
+	{
+		case IOCTL_NONPNP_ECHO_NEITHER:
+		{
+			Context = RequestGetContext(Request);
+			if (Context == NULL) {
+				return STATUS_INVALID_DEVICE_REQUEST;
+			}
+			if (Context->InputMemory != NULL) {
+				InBuf = WdfMemoryGetBuffer(Context->InputMemory, NULL);
+			}
+			if (Context->OutputMemory != NULL) {
+				OutBuf = WdfMemoryGetBuffer(Context->OutputMemory, NULL);
+			}
+			EchoStatus = EchoCopy(InBuf, InputBufferLength, OutBuf, OutputBufferLength, BytesEchoed);
+			break;
+		}
+
+		case IOCTL_NONPNP_ECHO_IN_DIRECT:
+		{
+			//
+			// The payload travels in the output buffer, which METHOD_IN_DIRECT
+			// maps for reading.
+			//
+			if (OutputBufferLength != 0) {
+				Status = WdfRequestRetrieveOutputBuffer(Request, OutputBufferLength, &InBuf, NULL);
+				if (!NT_SUCCESS(Status)) {
+					TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", Status);
+					return Status;
+				}
+			}
+			EchoStatus = EchoConsume(InBuf, OutputBufferLength, BytesEchoed, &Checksum);
+			break;
+		}
+
+		default:
+		{
+			if (InputBufferLength != 0) {
+				Status = WdfRequestRetrieveInputBuffer(Request, InputBufferLength, &InBuf, NULL);
+				if (!NT_SUCCESS(Status)) {
+					TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "WdfRequestRetrieveInputBuffer failed with status 0x%x\n", Status);
+					return Status;
+				}
+			}
+			if (OutputBufferLength != 0) {
+				Status = WdfRequestRetrieveOutputBuffer(Request, OutputBufferLength, &OutBuf, NULL);
+				if (!NT_SUCCESS(Status)) {
+					TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "WdfRequestRetrieveOutputBuffer failed with status 0x%x\n", Status);
+					return Status;
+				}
+			}
+			EchoStatus = EchoCopy(InBuf, InputBufferLength, OutBuf, OutputBufferLength, BytesEchoed);
+			break;
+		}
+	}
+
+	switch (EchoStatus)
+	{
+		case ECHO_STATUS_SUCCESS:
+			return STATUS_SUCCESS;
+		case ECHO_STATUS_BUFFER_TOO_SMALL:
+			return STATUS_BUFFER_TOO_SMALL;
+		case ECHO_STATUS_TOO_LARGE:
+			return STATUS_INVALID_BUFFER_SIZE;
+		default:
+			return STATUS_INVALID_PARAMETER;
+	}
+}
+
+void EvtWdfIoInCallerContext(
+	WDFDEVICE Device,
+	WDFREQUEST Request
+)
+{
+	NTSTATUS				Status = STATUS_SUCCESS;
+	WDF_REQUEST_PARAMETERS	Params;
+	WDF_OBJECT_ATTRIBUTES	Attributes;
+	PREQUEST_CONTEXT		Context = NULL;
+	PVOID					InBuf = NULL, OutBuf = NULL;
+	size_t					InputBufferLength = 0, OutputBufferLength = 0;
+
+	PAGED_CODE();
+
+	WDF_REQUEST_PARAMETERS_INIT(&Params);
+	WdfRequestGetParameters(Request, &Params);
+
+	//
+	// Only METHOD_NEITHER requests need the caller's context, all others go
+	// to the queue as they are.
+	//
+	if (Params.Type != WdfRequestTypeDeviceControl ||
+		Params.Parameters.DeviceIoControl.IoControlCode != IOCTL_NONPNP_ECHO_NEITHER) {
+		goto Enqueue;
+	}
+
+	InputBufferLength = Params.Parameters.DeviceIoControl.InputBufferLength;
+	OutputBufferLength = Params.Parameters.DeviceIoControl.OutputBufferLength;
+	if (InputBufferLength > NON_PNP_ECHO_MAX_SIZE || OutputBufferLength > NON_PNP_ECHO_MAX_SIZE) {
+		Status = STATUS_INVALID_BUFFER_SIZE;
+		goto Complete;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&Attributes, REQUEST_CONTEXT);
+	Status = WdfObjectAllocateContext(Request, &Attributes, &Context);
+	if (!NT_SUCCESS(Status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "%!FUNC!: WdfObjectAllocateContext failed with status 0x%x\n", Status);
+		goto Complete;
+	}
+
+	//
+	// The memory objects are children of the request and are released with
+	// it, the pages stay locked until then.
+	//
+	if (InputBufferLength != 0) {
+		Status = WdfRequestRetrieveUnsafeUserInputBuffer(Request, InputBufferLength, &InBuf, NULL);
+		if (NT_SUCCESS(Status)) {
+			Status = WdfRequestProbeAndLockUserBufferForRead(Request, InBuf, InputBufferLength, &Context->InputMemory);
+		}
+		if (!NT_SUCCESS(Status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "%!FUNC!: Input buffer probe failed with status 0x%x\n", Status);
+			goto Complete;
+		}
+	}
+
+	if (OutputBufferLength != 0) {
+		Status = WdfRequestRetrieveUnsafeUserOutputBuffer(Request, OutputBufferLength, &OutBuf, NULL);
+		if (NT_SUCCESS(Status)) {
+			Status = WdfRequestProbeAndLockUserBufferForWrite(Request, OutBuf, OutputBufferLength, &Context->OutputMemory);
+		}
+		if (!NT_SUCCESS(Status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "%!FUNC!: Output buffer probe failed with status 0x%x\n", Status);
+			goto Complete;
+		}
+	}
+
+Enqueue:
+	Status = WdfDeviceEnqueueRequest(Device, Request);
+	if (NT_SUCCESS(Status)) {
+		return;
+	}
+	TraceEvents(TRACE_LEVEL_ERROR, NON_PNP, "%!FUNC!: WdfDeviceEnqueueRequest failed with status 0x%x\n", Status);
+
+Complete:
+	WdfRequestComplete(Request, Status);
+}
+
 void EvtWdfDriverUnload(
 	WDFDRIVER Driver
 )
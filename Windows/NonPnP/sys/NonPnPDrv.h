@@ -3,6 +3,7 @@
 #include <wdf.h>
 #include <Ntstrsafe.h>
 #include "public.h"
+#include "Echo.h"
 #include "Trace.h"
 
 #define NT_DEVICE_NAME		        L"\\Device\\NonPnP"
@@ -17,6 +18,20 @@ typedef struct _CONTROL_DEVICE_EXTENSION {
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(CONTROL_DEVICE_EXTENSION, ControlGetData)
 
+//
+// User buffers of a METHOD_NEITHER request, probed and locked in the
+// caller's context.
+//
+typedef struct _REQUEST_CONTEXT {
+
+	WDFMEMORY   InputMemory;
+	WDFMEMORY   OutputMemory;
+
+} REQUEST_CONTEXT, * PREQUEST_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(REQUEST_CONTEXT, RequestGetContext)
+
 DRIVER_INITIALIZE DriverEntry;
 EVT_WDF_DRIVER_UNLOAD EvtWdfDriverUnload;
-EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL EvtWdfIoDeviceControl;
\ No newline at end of file
+EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL EvtWdfIoDeviceControl;
+EVT_WDF_IO_IN_CALLER_CONTEXT EvtWdfIoInCallerContext;
\ No newline at end of file
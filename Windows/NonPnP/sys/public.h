@@ -10,4 +10,24 @@
 #define IOCTL_NONPNP_GET_MESSAGE \
     CTL_CODE( NON_PNP_TYPE, 0x900, METHOD_BUFFERED, FILE_ANY_ACCESS  )
 
+//
+// Benchmark IOCTLs, each echoes its payload with a different transfer
+// method. BUFFERED, OUT_DIRECT and NEITHER copy the input buffer to the
+// output buffer. IN_DIRECT reads the payload from the output buffer (the
+// direct one) and only returns its length.
+//
+#define IOCTL_NONPNP_ECHO_BUFFERED \
+    CTL_CODE( NON_PNP_TYPE, 0x901, METHOD_BUFFERED, FILE_ANY_ACCESS  )
+
+#define IOCTL_NONPNP_ECHO_IN_DIRECT \
+    CTL_CODE( NON_PNP_TYPE, 0x902, METHOD_IN_DIRECT, FILE_ANY_ACCESS  )
+
+#define IOCTL_NONPNP_ECHO_OUT_DIRECT \
+    CTL_CODE( NON_PNP_TYPE, 0x903, METHOD_OUT_DIRECT, FILE_ANY_ACCESS  )
+
+#define IOCTL_NONPNP_ECHO_NEITHER \
+    CTL_CODE( NON_PNP_TYPE, 0x904, METHOD_NEITHER, FILE_ANY_ACCESS  )
+
+#define NON_PNP_ECHO_MAX_SIZE       (1024 * 1024)
+
 #define NON_PNP_DRIVER_FILE_NAME    "\\\\.\\NonPnp"
\ No newline at end of file
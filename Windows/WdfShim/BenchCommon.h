@@ -0,0 +1,74 @@
+/*++
+
+Module Name:
+
+    BenchCommon.h
+
+Abstract:
+
+    Fixture shared by the HW benches of the Linux harness. Benches that
+    load the HWInterface driver run it on the WDF shim and the simulated
+    PCI fabric, and the user mode library opens it through the Win32 shim.
+    Those that read extended configuration space add the host bridge
+    below, which points the library at an ECAM window.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <string.h>
+#include <chrono>
+#include "SimFabric.h"
+
+#define BENCH_ECAM_BASE             0xE0000000ULL
+#define BENCH_PCIEXBAR              0x60
+#define BENCH_VENDOR_ID             0x8086
+#define BENCH_DEVICE_ID             0x1234
+
+//
+// Seconds on the steady clock.
+//
+static inline double BenchNow(VOID)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Endpoint Index sits at device Index % 32 of bus 1 + Index / 32, bus 0
+// is left to the host bridge and any ports.
+//
+static inline VOID BenchLocate(ULONG Index, PUINT8 Bus, PUINT8 Device)
+{
+    *Bus = (UINT8)(1 + Index / 32);
+    *Device = (UINT8)(Index % 32);
+}
+
+//
+// Function Index of a dense host sits at the Index-th BDF from 00:00.0 on.
+//
+static inline VOID BenchLocateFunction(ULONG Index, PUINT8 Bus, PUINT8 Device, PUINT8 Function)
+{
+    *Bus = (UINT8)(Index >> 8);
+    *Device = (UINT8)((Index >> 3) & 0x1F);
+    *Function = (UINT8)(Index & 0x07);
+}
+
+//
+// Adds the host bridge at 00:00.0 with PCIEXBAR pointing at the ECAM
+// window and opens the window, the library finds it on initialise.
+//
+static inline NTSTATUS BenchAddHostBridge(VOID)
+{
+    UINT64 PciExBar = BENCH_ECAM_BASE | 1;
+    NTSTATUS Status = SimFabricAddFunction(0, 0, 0, BENCH_VENDOR_ID, 0x0001, 0x060000);
+
+    if (NT_SUCCESS(Status)) {
+        memcpy(SimFabricGetConfig(0, 0, 0) + BENCH_PCIEXBAR, &PciExBar, sizeof(PciExBar));
+        SimFabricSetEcam(BENCH_ECAM_BASE);
+    }
+    return Status;
+}
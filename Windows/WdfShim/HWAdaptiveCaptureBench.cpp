@@ -0,0 +1,322 @@
+/*++
+
+Module Name:
+
+    HWAdaptiveCaptureBench.cpp
+
+Abstract:
+
+    Times the adaptive 4 KB capture of the App dump against reading the
+    whole extended configuration space of every function.
+
+    The functions come in five layouts: conventional PCI, PCI Express
+    without extended capabilities, AER and a serial number, a vendor
+    specific capability sized by its length field, and a capability of
+    unknown size that ends at the next one. The full mode reads 4 KB per
+    function. The adaptive mode reads the 256 byte header, sizes the
+    function with CCapabilityWalker::GetExtent on top of the header, as
+    the App does, reads up to the extent and zeroes the rest of the slot.
+    The bench prints the time, the bytes and the ECAM reads of both. Both
+    captures must be identical and every layout must end where it was
+    built to.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "CapabilityWalker.h"
+#include "CaptureArena.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     400
+#define BENCH_DEFAULT_PASSES        5
+#define BENCH_DEFAULT_CONFIG_NS     2000
+#define BENCH_DEFAULT_MMIO_NS       50
+#define BENCH_LAYOUTS               5
+
+//
+// Header of the function being captured, as ReadCapturedHeader of the App.
+//
+typedef struct
+{
+    CHardwareInterfaceLib* m_CHWLib;
+    PUINT8 m_Header;
+    UINT64 m_BytesRead;
+}BenchHeader;
+
+//
+// Where each layout ends.
+//
+static const UINT32 LayoutExtents[BENCH_LAYOUTS] = { PCI_CFG_SIZE, PCI_CFG_SIZE, 0x154, 0x240, 0x308 };
+
+static NTSTATUS AddLayout(UINT8 Bus, UINT8 Device, ULONG Layout)
+{
+    NTSTATUS Status = SimFabricAddFunction(Bus, Device, 0, BENCH_VENDOR_ID, (USHORT)(BENCH_DEVICE_ID + Layout), 0x020000);
+
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PM, 0x40);
+    }
+    if (NT_SUCCESS(Status) && Layout >= 1) {
+        Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PCIe, 0x50);
+    }
+    if (NT_SUCCESS(Status) && Layout >= 2) {
+        Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_AER, 0x100);
+    }
+    if (NT_SUCCESS(Status) && Layout == 2) {
+        Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_DSN, 0x148);
+    }
+    if (NT_SUCCESS(Status) && Layout == 3) {
+        UINT32 Header = (0x40 << 20) | (1 << 16) | 0x0001;
+
+        Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_VENDOR, 0x200);
+        if (NT_SUCCESS(Status)) {
+            memcpy(SimFabricGetConfig(Bus, Device, 0) + 0x200 + VendorSpecificHeader::Offset, &Header, sizeof(Header));
+            memset(SimFabricGetConfig(Bus, Device, 0) + 0x208, 0xA5, 0x38);
+        }
+    }
+    if (NT_SUCCESS(Status) && Layout == 4) {
+        Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_ACS, 0x160);
+        if (NT_SUCCESS(Status)) {
+            memset(SimFabricGetConfig(Bus, Device, 0) + 0x164, 0x5A, 0x300 - 0x164);
+            Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_ARI, 0x300);
+        }
+    }
+    return Status;
+}
+
+//
+// The host bridge and Functions endpoints, the layouts in turn.
+//
+static NTSTATUS BuildFabric(ULONG Functions)
+{
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (ULONG i = 0; i < Functions && NT_SUCCESS(Status); i++)
+    {
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        Status = AddLayout(Bus, Device, i % BENCH_LAYOUTS);
+    }
+    return Status;
+}
+
+//
+// Serves the walker from the captured header below 0x100, else reads the
+// extended space.
+//
+static UserStatus ReadHeader(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    BenchHeader* Header = (BenchHeader*)Context;
+    PCI_PCIeCfgData cfgData;
+
+    if (Offset + Size <= PCI_CFG_SIZE) {
+        memcpy(Data, Header->m_Header + Offset, Size);
+        return Success;
+    }
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = Function;
+    cfgData.m_Offset = Offset;
+    cfgData.OutputData.m_Size = Size;
+    cfgData.OutputData.DataPointer = Data;
+    Header->m_BytesRead += Size;
+    return Header->m_CHWLib->PCIeExCfgRead(&cfgData);
+}
+
+static UserStatus CaptureFull(CHardwareInterfaceLib& CHWLib, UINT8 Bus, UINT8 Device, PUINT8 Slot, BenchHeader& Header)
+{
+    PCI_PCIeCfgData cfgData;
+
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = 0;
+    cfgData.m_Offset = 0;
+    cfgData.OutputData.m_Size = PCIe_CFG_SIZE;
+    cfgData.OutputData.DataPointer = Slot;
+    Header.m_BytesRead += PCIe_CFG_SIZE;
+    return CHWLib.PCIeExCfgRead(&cfgData);
+}
+
+static UserStatus CaptureAdaptive(CHardwareInterfaceLib& CHWLib, CCapabilityWalker& Walker, UINT8 Bus, UINT8 Device, PUINT8 Slot,
+                                  BenchHeader& Header, PUINT32 pExtent)
+{
+    PCI_PCIeCfgData cfgData;
+    UserStatus userStatus;
+
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = 0;
+    cfgData.m_Offset = 0;
+    cfgData.OutputData.m_Size = PCI_CFG_SIZE;
+    cfgData.OutputData.DataPointer = Slot;
+    Header.m_BytesRead += PCI_CFG_SIZE;
+    userStatus = CHWLib.PCIStdCfgRead(&cfgData);
+    if (userStatus != Success) {
+        return userStatus;
+    }
+
+    //
+    // The walker keeps the offsets it found, a new capture walks again.
+    //
+    Header.m_Header = Slot;
+    Walker.Invalidate(Bus, Device, 0);
+    userStatus = Walker.GetExtent(Bus, Device, 0, pExtent);
+    if (userStatus != Success) {
+        return userStatus;
+    }
+    if (*pExtent > PCI_CFG_SIZE) {
+        cfgData.m_Offset = PCI_CFG_SIZE;
+        cfgData.OutputData.m_Size = *pExtent - PCI_CFG_SIZE;
+        cfgData.OutputData.DataPointer = Slot + PCI_CFG_SIZE;
+        Header.m_BytesRead += cfgData.OutputData.m_Size;
+        userStatus = CHWLib.PCIeExCfgRead(&cfgData);
+    }
+    memset(Slot + *pExtent, 0, PCIe_CFG_SIZE - *pExtent);
+    return userStatus;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWAdaptiveCaptureBench [-functions <Count>] [-passes <Count>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "full 4 KB", "adaptive" };
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    SIM_FABRIC_LATENCY Latency = { BENCH_DEFAULT_CONFIG_NS, BENCH_DEFAULT_MMIO_NS, 0 };
+    SIM_FABRIC_COUNTERS Counters[2];
+    CHardwareInterfaceLib CHWLib;
+    CCaptureArena Arenas[2];
+    BenchHeader Header = { &CHWLib, NULL, 0 };
+    CCapabilityWalker Walker(ReadHeader, &Header);
+    UINT64 BytesRead[2] = { 0 };
+    ULONG Failures[2] = { 0 };
+    ULONG WrongExtents = 0;
+    double Times[2] = { 0 };
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 32 * 255 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BuildFabric(Functions);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        double Begin;
+
+        if (Arenas[Mode].Reserve(Functions, PCIe_CFG_SIZE) != Success) {
+            printf("%s\n", Arenas[Mode].GetStatusMessage().c_str());
+            return 1;
+        }
+        Header.m_BytesRead = 0;
+        SimFabricResetCounters();
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            for (ULONG i = 0; i < Functions; i++)
+            {
+                UINT32 Extent = PCIe_CFG_SIZE;
+                UserStatus userStatus;
+                UINT8 Bus, Device;
+
+                BenchLocate(i, &Bus, &Device);
+                if (Mode == 0) {
+                    userStatus = CaptureFull(CHWLib, Bus, Device, Arenas[Mode].GetSlot(i), Header);
+                }
+                else {
+                    userStatus = CaptureAdaptive(CHWLib, Walker, Bus, Device, Arenas[Mode].GetSlot(i), Header, &Extent);
+                    WrongExtents += (userStatus == Success && Extent != LayoutExtents[i % BENCH_LAYOUTS]);
+                }
+                Failures[Mode] += (userStatus != Success);
+            }
+        }
+        Times[Mode] = BenchNow() - Begin;
+        BytesRead[Mode] = Header.m_BytesRead;
+        SimFabricGetCounters(&Counters[Mode]);
+    }
+
+    printf("%u functions of %u layouts, %u passes, latency config %u ns, MMIO %u ns\n", Functions, BENCH_LAYOUTS, Passes,
+           Latency.ConfigNs, Latency.MmioNs);
+    printf("%-12s%12s%14s%10s%12s%10s\n", "Capture", "ms", "Bytes", "HAL", "ECAM", "Failed");
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        printf("%-12s%12.3f%14llu%10llu%12llu%10u\n", ModeNames[Mode], Times[Mode] * 1e3, (unsigned long long)BytesRead[Mode],
+               (unsigned long long)Counters[Mode].ConfigReads, (unsigned long long)Counters[Mode].MmioReads, Failures[Mode]);
+    }
+    printf("Speedup %.2fx, %.1f%% of the bytes\n", (Times[1] > 0) ? Times[0] / Times[1] : 0.0,
+           (BytesRead[0] > 0) ? 100.0 * BytesRead[1] / BytesRead[0] : 0.0);
+
+    if (Failures[0] != 0 || Failures[1] != 0 || WrongExtents != 0) {
+        printf("%u full and %u adaptive captures failed, %u extents wrong\n", Failures[0], Failures[1], WrongExtents);
+        Passed = FALSE;
+    }
+    if (memcmp(Arenas[0].GetData(), Arenas[1].GetData(), Arenas[0].GetSize()) != 0) {
+        printf("Full and adaptive captures differ\n");
+        Passed = FALSE;
+    }
+    if (Functions >= BENCH_LAYOUTS && BytesRead[1] >= BytesRead[0]) {
+        printf("The adaptive capture read as much as the full one\n");
+        Passed = FALSE;
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
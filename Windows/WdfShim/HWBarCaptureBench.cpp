@@ -0,0 +1,391 @@
+/*++
+
+Module Name:
+
+    HWBarCaptureBench.cpp
+
+Abstract:
+
+    Runs CaptureBarToFile and ExpandBarCapture of the App against a BAR of
+    the simulated PCI fabric and times the captures.
+
+    The BAR holds blocks of zeroes, of the fabric pattern, of random bytes
+    and of repeated records. It is captured whole and from an offset to a
+    length that are not dword aligned, to a plain and to a compressed file.
+    A plain file must hold the BAR bytes. In a compressed one the header
+    must describe the capture and every frame must have the raw size and
+    hash of its part of the BAR, ExpandBarCapture must write the BAR bytes
+    back, and a capture with a bad hash, a damaged frame, a missing last
+    byte or a byte past the last frame must be refused.
+
+    The times of the compressed captures include the check of the file
+    that CaptureBarToFile runs when asked to verify.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <compressapi.h>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "BarCapture.h"
+
+#define BENCH_DEFAULT_SIZE          0x800000
+#define BENCH_DEFAULT_BUFFERS       4
+#define BENCH_BAR_BASE              0x400000000ULL
+#define BENCH_BLOCK_SIZE            0x10000
+#define BENCH_RECORD_SIZE           16
+#define BENCH_SLICE_OFFSET          0x1003
+#define BENCH_SLICE_TAIL            0x2FD
+#define BENCH_CAPTURE_FILE          "HWBarCaptureBench.capture.bin"
+#define BENCH_EXPANDED_FILE         "HWBarCaptureBench.expanded.bin"
+#define BENCH_DAMAGED_FILE          "HWBarCaptureBench.damaged.bin"
+#define BENCH_DAMAGES               4
+
+typedef struct
+{
+    const char* m_Name;
+    bool m_Compress;
+    UINT64 m_Offset;
+    UINT64 m_Length;
+}BenchCapture;
+
+static UINT64 Random(UINT64* State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *State >> 17;
+}
+
+static BOOLEAN ReadWholeFile(const char* FileName, std::vector<UINT8>& Data)
+{
+    FILE* File = fopen(FileName, "rb");
+
+    if (File == NULL) {
+        return FALSE;
+    }
+    fseek(File, 0, SEEK_END);
+    Data.resize((SIZE_T)ftell(File));
+    fseek(File, 0, SEEK_SET);
+    if (fread(Data.data(), 1, Data.size(), File) != Data.size()) {
+        fclose(File);
+        return FALSE;
+    }
+    fclose(File);
+    return TRUE;
+}
+
+static BOOLEAN WriteWholeFile(const char* FileName, const UINT8* Data, SIZE_T Size)
+{
+    FILE* File = fopen(FileName, "wb");
+    BOOLEAN Written;
+
+    if (File == NULL) {
+        return FALSE;
+    }
+    Written = (fwrite(Data, 1, Size, File) == Size);
+    return (fclose(File) == 0) && Written;
+}
+
+//
+// Every fourth block keeps the pattern SimFabricAddBar wrote.
+//
+static VOID FillBar(PUINT8 Bar, ULONG Size)
+{
+    UINT64 State = 1;
+
+    for (ULONG Block = 0; Block < Size / BENCH_BLOCK_SIZE; Block++)
+    {
+        PUINT8 Data = Bar + (SIZE_T)Block * BENCH_BLOCK_SIZE;
+
+        switch (Block % 4)
+        {
+        case 0:
+            memset(Data, 0, BENCH_BLOCK_SIZE);
+            break;
+        case 2:
+            for (ULONG i = 0; i < BENCH_BLOCK_SIZE; i++)
+            {
+                Data[i] = (UINT8)Random(&State);
+            }
+            break;
+        case 3:
+            for (ULONG i = 0; i < BENCH_BLOCK_SIZE; i += BENCH_RECORD_SIZE)
+            {
+                UINT32 Record[BENCH_RECORD_SIZE / sizeof(UINT32)] = { 0x80000000 | Block, i / BENCH_RECORD_SIZE, 0xFFFF0000, 0 };
+
+                memcpy(Data + i, Record, BENCH_RECORD_SIZE);
+            }
+            break;
+        }
+    }
+}
+
+//
+// Returns FALSE if the header does not describe Capture or a frame does
+// not hold the size and hash of its part of the BAR, as read from memory.
+//
+static BOOLEAN CheckFrames(const std::vector<UINT8>& File, const UINT8* Bar, const BenchCapture& Capture, PULONG Frames)
+{
+    BAR_CAPTURE_HEADER Header;
+    SIZE_T Position = sizeof(Header);
+    UINT64 Done = 0;
+
+    *Frames = 0;
+    if (File.size() < sizeof(Header)) {
+        printf("%s: %zu bytes, no header\n", Capture.m_Name, File.size());
+        return FALSE;
+    }
+    memcpy(&Header, File.data(), sizeof(Header));
+    if (Header.m_Magic != BAR_CAPTURE_MAGIC || Header.m_Version != BAR_CAPTURE_VERSION || Header.m_Algorithm != COMPRESS_ALGORITHM_XPRESS ||
+        Header.m_ChunkSize != BAR_CAPTURE_BUFFER_SIZE || Header.m_BarBase != BENCH_BAR_BASE ||
+        Header.m_Offset != Capture.m_Offset || Header.m_Length != Capture.m_Length) {
+        printf("%s: header 0x%x version %u algorithm %u chunk 0x%x BAR 0x%llx offset 0x%llx length 0x%llx\n", Capture.m_Name,
+               Header.m_Magic, Header.m_Version, Header.m_Algorithm, Header.m_ChunkSize, (unsigned long long)Header.m_BarBase,
+               (unsigned long long)Header.m_Offset, (unsigned long long)Header.m_Length);
+        return FALSE;
+    }
+
+    while (Done < Capture.m_Length)
+    {
+        BAR_CAPTURE_FRAME Frame;
+        UINT64 Chunk = (Capture.m_Length - Done > BAR_CAPTURE_BUFFER_SIZE) ? BAR_CAPTURE_BUFFER_SIZE : Capture.m_Length - Done;
+
+        if (File.size() - Position < sizeof(Frame)) {
+            printf("%s: frame %u is missing\n", Capture.m_Name, *Frames);
+            return FALSE;
+        }
+        memcpy(&Frame, File.data() + Position, sizeof(Frame));
+        if (Frame.m_RawSize != Chunk || File.size() - Position - sizeof(Frame) < Frame.m_CompressedSize ||
+            Frame.m_Hash != CHash128::Compute(Bar + Capture.m_Offset + Done, Chunk).m_Low) {
+            printf("%s: frame %u holds 0x%x bytes of 0x%llx, %u compressed, hash %s\n", Capture.m_Name, *Frames, Frame.m_RawSize,
+                   (unsigned long long)Chunk, Frame.m_CompressedSize,
+                   Frame.m_Hash == CHash128::Compute(Bar + Capture.m_Offset + Done, Chunk).m_Low ? "matches" : "DIFFERS");
+            return FALSE;
+        }
+        Position += sizeof(Frame) + Frame.m_CompressedSize;
+        Done += Chunk;
+        (*Frames)++;
+    }
+
+    if (Position != File.size()) {
+        printf("%s: %zu bytes after the last frame\n", Capture.m_Name, File.size() - Position);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+// Writes damaged copies of a compressed capture and returns how many of
+// them ExpandBarCapture refuses.
+//
+static ULONG CheckDamage(const std::vector<UINT8>& File)
+{
+    BAR_CAPTURE_FRAME Frame;
+    SIZE_T Position = sizeof(BAR_CAPTURE_HEADER);
+    SIZE_T LastFrame = Position;
+    ULONG Refused = 0;
+
+    while (Position < File.size())
+    {
+        LastFrame = Position;
+        memcpy(&Frame, File.data() + Position, sizeof(Frame));
+        Position += sizeof(Frame) + Frame.m_CompressedSize;
+    }
+
+    for (ULONG Damage = 0; Damage < BENCH_DAMAGES; Damage++)
+    {
+        std::vector<UINT8> Damaged(File);
+
+        switch (Damage)
+        {
+        case 0:
+            Damaged[sizeof(BAR_CAPTURE_HEADER) + offsetof(BAR_CAPTURE_FRAME, m_Hash)] ^= 1;
+            break;
+        case 1:
+            //
+            // The top flag of a frame is its first item, which can only
+            // be a literal, turned into a match with nothing before it.
+            //
+            Damaged[LastFrame + sizeof(BAR_CAPTURE_FRAME) + 3] ^= 0x80;
+            break;
+        case 2:
+            Damaged.pop_back();
+            break;
+        case 3:
+            Damaged.push_back(0);
+            break;
+        }
+
+        if (!WriteWholeFile(BENCH_DAMAGED_FILE, Damaged.data(), Damaged.size())) {
+            printf("Unable to write %s\n", BENCH_DAMAGED_FILE);
+            continue;
+        }
+        Refused += (ExpandBarCapture(BENCH_DAMAGED_FILE, BENCH_EXPANDED_FILE) != Success);
+    }
+    remove(BENCH_DAMAGED_FILE);
+    return Refused;
+}
+
+//
+// Returns FALSE if a capture fails or does not hold the BAR.
+//
+static BOOLEAN RunCaptures(CHardwareInterfaceLib& CHWLib, const UINT8* Bar, ULONG Size, ULONG Buffers)
+{
+    const BenchCapture Captures[] = {
+        { "plain", false, 0, Size },
+        { "plain slice", false, BENCH_SLICE_OFFSET, Size - BENCH_SLICE_OFFSET - BENCH_SLICE_TAIL },
+        { "xpress", true, 0, Size },
+        { "xpress slice", true, BENCH_SLICE_OFFSET, Size - BENCH_SLICE_OFFSET - BENCH_SLICE_TAIL },
+    };
+    std::vector<UINT8> Results[sizeof(Captures) / sizeof(Captures[0])];
+    double Times[sizeof(Captures) / sizeof(Captures[0])];
+    std::vector<UINT8> Expanded;
+    BOOLEAN Passed = TRUE;
+    ULONG Refused = 0;
+
+    for (ULONG c = 0; c < sizeof(Captures) / sizeof(Captures[0]); c++)
+    {
+        const BenchCapture& Capture = Captures[c];
+        BAR_CAPTURE_CONFIG Config;
+        ULONG Frames = 0;
+        double Begin;
+
+        Config.BarBase = BENCH_BAR_BASE;
+        Config.Offset = Capture.m_Offset;
+        Config.Length = Capture.m_Length;
+        Config.FileName = BENCH_CAPTURE_FILE;
+        Config.Compress = Capture.m_Compress;
+        Config.Verify = Capture.m_Compress;
+        Config.BufferCount = Buffers;
+
+        Begin = BenchNow();
+        if (CaptureBarToFile(CHWLib, Config) != Success) {
+            printf("%s: CaptureBarToFile failed\n", Capture.m_Name);
+            Passed = FALSE;
+            continue;
+        }
+        Times[c] = BenchNow() - Begin;
+
+        if (!ReadWholeFile(BENCH_CAPTURE_FILE, Results[c])) {
+            printf("%s: unable to read %s\n", Capture.m_Name, BENCH_CAPTURE_FILE);
+            Passed = FALSE;
+            continue;
+        }
+
+        if (!Capture.m_Compress) {
+            if (Results[c].size() != Capture.m_Length || memcmp(Results[c].data(), Bar + Capture.m_Offset, Capture.m_Length) != 0) {
+                printf("%s: %zu bytes captured, %s the BAR\n", Capture.m_Name, Results[c].size(),
+                       Results[c].size() == Capture.m_Length ? "different from" : "not the length of");
+                Passed = FALSE;
+            }
+            continue;
+        }
+
+        if (!CheckFrames(Results[c], Bar, Capture, &Frames)) {
+            Passed = FALSE;
+            continue;
+        }
+        if (ExpandBarCapture(BENCH_CAPTURE_FILE, BENCH_EXPANDED_FILE) != Success || !ReadWholeFile(BENCH_EXPANDED_FILE, Expanded) ||
+            Expanded.size() != Capture.m_Length || memcmp(Expanded.data(), Bar + Capture.m_Offset, Capture.m_Length) != 0) {
+            printf("%s: the %u frames do not expand to the BAR\n", Capture.m_Name, Frames);
+            Passed = FALSE;
+            continue;
+        }
+
+        Refused = CheckDamage(Results[c]);
+        if (Refused != BENCH_DAMAGES) {
+            printf("%s: %u of %u damaged captures expanded\n", Capture.m_Name, BENCH_DAMAGES - Refused, BENCH_DAMAGES);
+            Passed = FALSE;
+        }
+    }
+    remove(BENCH_CAPTURE_FILE);
+    remove(BENCH_EXPANDED_FILE);
+
+    printf("\n%-14s%14s%12s%10s%14s%8s\n", "Capture", "Offset", "Length", "Time ms", "File bytes", "MB/s");
+    for (ULONG c = 0; c < sizeof(Captures) / sizeof(Captures[0]); c++)
+    {
+        if (Results[c].empty()) {
+            continue;
+        }
+        printf("%-14s%14llu%12llu%10.3f%14zu%8.1f\n", Captures[c].m_Name, (unsigned long long)Captures[c].m_Offset,
+               (unsigned long long)Captures[c].m_Length, Times[c] * 1e3, Results[c].size(), Captures[c].m_Length / 1048576.0 / Times[c]);
+    }
+    return Passed;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWBarCaptureBench [-size <Bytes>] [-buffers <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Size = BENCH_DEFAULT_SIZE;
+    ULONG Buffers = BENCH_DEFAULT_BUFFERS;
+    CHardwareInterfaceLib CHWLib;
+    BOOLEAN Passed = TRUE;
+    PUINT8 Bar;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-size") == 0 && Arg + 1 < argc) {
+            Size = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-buffers") == 0 && Arg + 1 < argc) {
+            Buffers = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Size < BENCH_BLOCK_SIZE || Size > SIM_FABRIC_MAX_BAR_SIZE || (Size & (Size - 1)) != 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BenchAddHostBridge();
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddFunction(1, 0, 0, BENCH_VENDOR_ID, BENCH_DEVICE_ID, 0x058000);
+    }
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddBar(1, 0, 0, 0, BENCH_BAR_BASE, Size);
+    }
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Bar = SimFabricGetBarMemory(BENCH_BAR_BASE, Size);
+    FillBar(Bar, Size);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    printf("BAR of 0x%x bytes at 0x%llx, %u capture buffers\n", Size, (unsigned long long)BENCH_BAR_BASE, Buffers);
+    Passed = RunCaptures(CHWLib, Bar, Size, Buffers);
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,302 @@
+/*++
+
+Module Name:
+
+    HWBarIndexBench.cpp
+
+Abstract:
+
+    Measures CBarIndex lookups over a map of many BARs and checks BAR
+    sizing on the simulated PCI fabric.
+
+    The lookup part adds Bars windows of 4 KB to 1 MB in shuffled order,
+    with gaps between them, and times Find over random addresses, every
+    result checked against a linear scan of the windows.
+
+    In the sizing part SizeBars must find the 32-bit and the 64-bit BAR of
+    an endpoint and leave its header as it was, refuse a bridge without
+    writing to it, and restore the BARs and the command register when a
+    write of the sizing script fails. AddResource must place an assigned
+    window under the BAR decoding it and skip one no BAR decodes.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "BarIndex.h"
+
+#define BENCH_DEFAULT_BARS          10000
+#define BENCH_DEFAULT_LOOKUPS       1000000
+#define BENCH_CHECKED_LOOKUPS       20000
+#define BENCH_MAP_BASE              0x100000000ULL
+#define BENCH_BAR0_BASE             0xF0000000ULL
+#define BENCH_BAR0_SIZE             0x10000
+#define BENCH_BAR2_BASE             0x400000000ULL
+#define BENCH_BAR2_SIZE             0x100000
+#define BENCH_COMMAND               0x0006
+#define BENCH_HEADER_SIZE           0x28
+
+typedef struct
+{
+    UINT64 m_Base;
+    UINT64 m_Size;
+}BenchWindow;
+
+static UINT64 Random(UINT64* State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *State >> 17;
+}
+
+static UINT32 LinearFind(const std::vector<BenchWindow>& Windows, UINT64 Address)
+{
+    for (UINT32 i = 0; i < Windows.size(); i++)
+    {
+        if (Address >= Windows[i].m_Base && Address - Windows[i].m_Base < Windows[i].m_Size) {
+            return i;
+        }
+    }
+    return BAR_INDEX_INVALID;
+}
+
+//
+// Returns FALSE if an add, a lookup or the overlap check fails.
+//
+static BOOLEAN RunLookups(ULONG Bars, ULONG Lookups)
+{
+    CBarIndex Index;
+    std::vector<BenchWindow> Windows;
+    std::vector<UINT32> Order;
+    std::vector<UINT64> Addresses;
+    UINT64 State = 1;
+    UINT64 Next = BENCH_MAP_BASE;
+    UINT64 Found = 0;
+    ULONG Mismatches = 0;
+    double Begin, AddTime, FindTime;
+
+    for (ULONG i = 0; i < Bars; i++)
+    {
+        BenchWindow Window;
+
+        Window.m_Size = 0x1000ULL << (Random(&State) % 9);
+        Window.m_Base = (Next + Window.m_Size - 1) & ~(Window.m_Size - 1);
+        Next = Window.m_Base + Window.m_Size + (Random(&State) % 4) * 0x1000;
+        Windows.push_back(Window);
+        Order.push_back(i);
+    }
+    for (ULONG i = Bars; i > 1; i--)
+    {
+        std::swap(Order[i - 1], Order[Random(&State) % i]);
+    }
+    for (ULONG i = 0; i < Lookups; i++)
+    {
+        Addresses.push_back(BENCH_MAP_BASE - 0x1000 + Random(&State) % (Next - BENCH_MAP_BASE + 0x2000));
+    }
+
+    Begin = BenchNow();
+    for (auto i : Order)
+    {
+        if (Index.Add(Windows[i].m_Base, Windows[i].m_Size, (UINT8)(i >> 8), (UINT8)((i >> 3) & 0x1F), (UINT8)(i & 0x07), 0, 0) != Success) {
+            printf("Add: %s\n", Index.GetStatusMessage().c_str());
+            return FALSE;
+        }
+    }
+    AddTime = BenchNow() - Begin;
+
+    Begin = BenchNow();
+    for (auto Address : Addresses)
+    {
+        Found += (Index.Find(Address, 1) != BAR_INDEX_INVALID);
+    }
+    FindTime = BenchNow() - Begin;
+
+    //
+    // Windows are added in address order, so the index of a window found
+    // by the scan is its position in the index.
+    //
+    for (ULONG i = 0; i < Lookups && i < BENCH_CHECKED_LOOKUPS; i++)
+    {
+        Mismatches += (Index.Find(Addresses[i], 1) != LinearFind(Windows, Addresses[i]));
+    }
+
+    printf("%u BARs added in %.3f ms, %u lookups (%llu found) in %.3f ms, %.1f ns per lookup, %u of %u checked lookups wrong\n",
+           Bars, AddTime * 1e3, Lookups, (unsigned long long)Found, FindTime * 1e3, FindTime * 1e9 / (Lookups ? Lookups : 1),
+           Mismatches, (Lookups < BENCH_CHECKED_LOOKUPS) ? Lookups : BENCH_CHECKED_LOOKUPS);
+    if (Mismatches != 0 || Index.GetCount() != Bars) {
+        return FALSE;
+    }
+    if (Bars != 0 && Index.Add(Windows[0].m_Base + Windows[0].m_Size - 1, 0x1000, 0, 0, 0, 0, 0) == Success) {
+        printf("Add: window overlapping BAR 0 accepted\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+// The host bridge, an endpoint at 1:0.0 with a 32-bit BAR 0 and
+// a 64-bit BAR 2 and decode on, and a PCI bridge at 0:1.0.
+//
+static NTSTATUS BuildFabric(VOID)
+{
+    USHORT Command = BENCH_COMMAND;
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Status = SimFabricAddFunction(1, 0, 0, BENCH_VENDOR_ID, 0x0002, 0x020000);
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddBar(1, 0, 0, 0, BENCH_BAR0_BASE, BENCH_BAR0_SIZE);
+    }
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddBar(1, 0, 0, 2, BENCH_BAR2_BASE, BENCH_BAR2_SIZE);
+    }
+    if (NT_SUCCESS(Status)) {
+        memcpy(SimFabricGetConfig(1, 0, 0) + 0x04, &Command, sizeof(Command));
+        Status = SimFabricAddFunction(0, 1, 0, BENCH_VENDOR_ID, 0x0003, 0x060400);
+    }
+    if (NT_SUCCESS(Status)) {
+        SimFabricGetConfig(0, 1, 0)[0x0E] = 1;
+    }
+    return Status;
+}
+
+//
+// Returns FALSE if a sizing, refusal, restore or resource check fails.
+//
+static BOOLEAN RunSizing(CHardwareInterfaceLib& CHWLib)
+{
+    CBarIndex Index;
+    SIM_FABRIC_COUNTERS Counters;
+    UINT8 Header[BENCH_HEADER_SIZE];
+    UserStatus SizeStatus;
+    BOOLEAN Passed = TRUE;
+
+    memcpy(Header, SimFabricGetConfig(1, 0, 0), sizeof(Header));
+
+    SizeStatus = Index.SizeBars(CHWLib, 1, 0, 0);
+    if (SizeStatus != Success || Index.GetCount() != 2 ||
+        Index.GetBase(0) != BENCH_BAR0_BASE || Index.GetSize(0) != BENCH_BAR0_SIZE || Index.GetBar(0) != 0 || Index.GetFlags(0) != 0 ||
+        Index.GetBase(1) != BENCH_BAR2_BASE || Index.GetSize(1) != BENCH_BAR2_SIZE || Index.GetBar(1) != 2 || Index.GetFlags(1) != BAR_INDEX_64BIT) {
+        printf("SizeBars 1:0.0: status 0x%x, %u BARs %s\n", SizeStatus, Index.GetCount(), Index.GetStatusMessage().c_str());
+        Passed = FALSE;
+    }
+    if (memcmp(Header, SimFabricGetConfig(1, 0, 0), sizeof(Header)) != 0) {
+        printf("SizeBars 1:0.0: header changed\n");
+        Passed = FALSE;
+    }
+
+    //
+    // The bridge is refused before anything is written.
+    //
+    Index.Clear();
+    SimFabricResetCounters();
+    SizeStatus = Index.SizeBars(CHWLib, 0, 1, 0);
+    SimFabricGetCounters(&Counters);
+    if (SizeStatus == Success || Counters.ConfigWrites != 0 || Index.GetCount() != 0) {
+        printf("SizeBars 0:1.0: status 0x%x, %llu writes to the bridge\n", SizeStatus, (unsigned long long)Counters.ConfigWrites);
+        Passed = FALSE;
+    }
+
+    //
+    // The third write, restoring BAR 0, fails with decode off and all ones
+    // in BAR 0.
+    //
+    SimFabricFailConfigWrite(2);
+    SizeStatus = Index.SizeBars(CHWLib, 1, 0, 0);
+    if (SizeStatus == Success || Index.GetCount() != 0 || memcmp(Header, SimFabricGetConfig(1, 0, 0), sizeof(Header)) != 0) {
+        printf("SizeBars 1:0.0 with a failed write: status 0x%x, %u BARs, header %s\n", SizeStatus, Index.GetCount(),
+               memcmp(Header, SimFabricGetConfig(1, 0, 0), sizeof(Header)) == 0 ? "restored" : "NOT RESTORED");
+        Passed = FALSE;
+    }
+
+    Index.Clear();
+    SimFabricResetCounters();
+    if (Index.AddResource(CHWLib, 1, 0, 0, BENCH_BAR2_BASE, BENCH_BAR2_SIZE) != Success ||
+        Index.AddResource(CHWLib, 1, 0, 0, BENCH_BAR0_BASE + BENCH_BAR0_SIZE, 0x1000) != Success ||
+        Index.GetCount() != 1 || Index.GetBar(0) != 2 || Index.GetFlags(0) != BAR_INDEX_64BIT) {
+        printf("AddResource 1:0.0: %u BARs %s\n", Index.GetCount(), Index.GetStatusMessage().c_str());
+        Passed = FALSE;
+    }
+    SimFabricGetCounters(&Counters);
+    if (Counters.ConfigWrites != 0) {
+        printf("AddResource 1:0.0: %llu configuration writes\n", (unsigned long long)Counters.ConfigWrites);
+        Passed = FALSE;
+    }
+
+    printf("SizeBars and AddResource on the simulated fabric: %s\n", Passed ? "correct" : "WRONG");
+    return Passed;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWBarIndexBench [-bars <Count>] [-lookups <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Bars = BENCH_DEFAULT_BARS;
+    ULONG Lookups = BENCH_DEFAULT_LOOKUPS;
+    CHardwareInterfaceLib CHWLib;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-bars") == 0 && Arg + 1 < argc) {
+            Bars = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-lookups") == 0 && Arg + 1 < argc) {
+            Lookups = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Bars == 0 || Bars > 0x10000) {
+        PrintUsage();
+        return 1;
+    }
+
+    Passed = RunLookups(Bars, Lookups);
+
+    Status = BuildFabric();
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    if (!RunSizing(CHWLib)) {
+        Passed = FALSE;
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/*++
+
+Module Name:
+
+    HWBrokerBench.cpp
+
+Abstract:
+
+    Load test of CHardwareBroker with many concurrent local clients.
+
+    The library opens the driver as it opens \\.\HWInterface on Windows,
+    and a second open must fail since the device is exclusive. Every
+    client thread then issues the same mix of reads: registers of the
+    function headers that all clients read, registers only that client
+    reads and MMIO dwords, queued in groups like the scanners do. Each
+    read is checked against the fabric.
+
+    The mix runs once with all clients sharing the one library instance
+    under a lock, each read its own IOCTL, which is what the tools would
+    do if they took turns on the handle, then through the broker without
+    a cache and with one. It prints the read rate, the time per read, the
+    IOCTLs and configuration accesses per read, and for the broker the
+    backend rounds, merged reads and cache hits.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "HardwareBroker.h"
+
+#define BENCH_DEFAULT_CLIENTS       16
+#define BENCH_DEFAULT_REQUESTS      2000
+#define BENCH_GROUP                 4
+#define BENCH_FUNCTIONS             4
+#define BENCH_HOT_REGISTERS         4
+#define BENCH_BAR_BASE              0x80000000ULL
+#define BENCH_BAR_SIZE              0x10000
+#define BENCH_PIPE_NAME             "\\\\.\\pipe\\HWBrokerBench"
+
+typedef enum _BENCH_PATH {
+    BenchDirect,
+    BenchBroker,
+} BENCH_PATH;
+
+typedef struct _BENCH_READ {
+    BOOLEAN Mmio;
+    UINT8 Device;
+    UINT32 Offset;
+    UINT32 Size;
+    UINT8 Data[8];
+} BENCH_READ;
+
+//
+// Read Index of a client. Half of the reads hit the shared header
+// registers, a quarter the device specific registers of the client and
+// a quarter MMIO dwords spread over the BAR.
+//
+static VOID MakeRead(ULONG Client, ULONG Index, BENCH_READ* Read)
+{
+    ULONG Kind = Index % 4;
+    ULONG Mixed = (Index * 2654435761u) ^ (Client * 40503u);
+
+    memset(Read, 0, sizeof(*Read));
+    Read->Device = (UINT8)(Mixed % BENCH_FUNCTIONS);
+    Read->Size = sizeof(UINT32);
+    if (Kind < 2) {
+        Read->Offset = (Mixed >> 8) % BENCH_HOT_REGISTERS * sizeof(UINT32);
+    }
+    else if (Kind == 2) {
+        Read->Offset = 0x40 + (Client * 4 + (Mixed >> 8) % 4) % 48 * sizeof(UINT32);
+    }
+    else {
+        Read->Mmio = TRUE;
+        Read->Offset = (Mixed >> 8) % (PCIe_CFG_SIZE / sizeof(UINT32)) * sizeof(UINT32);
+    }
+}
+
+static BOOLEAN CheckRead(const BENCH_READ* Read)
+{
+    UINT32 Expected = 0;
+
+    if (Read->Mmio) {
+        Expected = Read->Offset / sizeof(UINT32);
+    }
+    else {
+        memcpy(&Expected, SimFabricGetConfig(0, Read->Device, 0) + Read->Offset, sizeof(Expected));
+    }
+    return memcmp(Read->Data, &Expected, Read->Size) == 0;
+}
+
+static UINT64 BarOf(UINT8 Device)
+{
+    return BENCH_BAR_BASE + (UINT64)Device * BENCH_BAR_SIZE;
+}
+
+//
+// Takes the lock for every read, the library serves one caller at a time.
+//
+static VOID RunDirectClient(CHardwareInterfaceLib* CHWLib, std::mutex* Lock, ULONG Client, ULONG Requests, std::atomic<ULONG>* Failures)
+{
+    BENCH_READ Read;
+    UserStatus Status;
+
+    for (ULONG i = 0; i < Requests; i++)
+    {
+        MakeRead(Client, i, &Read);
+        std::lock_guard<std::mutex> Guard(*Lock);
+        if (Read.Mmio) {
+            PCIeMMIOData MmioData;
+
+            MmioData.m_BaseAddressRegister = BarOf(Read.Device);
+            MmioData.m_Offset = Read.Offset;
+            MmioData.OutputData.DataPointer = Read.Data;
+            MmioData.OutputData.m_Size = Read.Size;
+            Status = CHWLib->PCIeMMIORead(&MmioData);
+        }
+        else {
+            PCI_PCIeCfgData CfgData;
+
+            CfgData.m_Bus = 0;
+            CfgData.m_Device = Read.Device;
+            CfgData.m_Function = 0;
+            CfgData.m_Offset = Read.Offset;
+            CfgData.OutputData.DataPointer = Read.Data;
+            CfgData.OutputData.m_Size = Read.Size;
+            Status = CHWLib->PCIStdCfgRead(&CfgData);
+        }
+        if (Status != Success || !CheckRead(&Read)) {
+            (*Failures)++;
+        }
+    }
+}
+
+static VOID RunBrokerClient(ULONG Client, ULONG Requests, std::atomic<ULONG>* Failures)
+{
+    CHardwareBrokerClient BrokerClient;
+    BENCH_READ Reads[BENCH_GROUP];
+
+    if (BrokerClient.Connect(BENCH_PIPE_NAME) != Success) {
+        printf("Client %u: %s\n", Client, BrokerClient.GetStatusMessage().c_str());
+        (*Failures) += Requests;
+        return;
+    }
+
+    for (ULONG i = 0; i < Requests; i += BENCH_GROUP)
+    {
+        ULONG Count = (Requests - i < BENCH_GROUP) ? Requests - i : BENCH_GROUP;
+
+        for (ULONG r = 0; r < Count; r++)
+        {
+            MakeRead(Client, i + r, &Reads[r]);
+            if (Reads[r].Mmio) {
+                BrokerClient.QueueMMIORead(BarOf(Reads[r].Device), Reads[r].Offset, Reads[r].Data, Reads[r].Size);
+            }
+            else {
+                BrokerClient.QueueCfgRead(0, Reads[r].Device, 0, Reads[r].Offset, Reads[r].Data, Reads[r].Size);
+            }
+        }
+        if (BrokerClient.Flush() != Success) {
+            (*Failures) += Count;
+            continue;
+        }
+        for (ULONG r = 0; r < Count; r++)
+        {
+            if (!CheckRead(&Reads[r])) {
+                (*Failures)++;
+            }
+        }
+    }
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWBrokerBench [-clients <Count>] [-requests <Count>] [-ttl <ms>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Clients = BENCH_DEFAULT_CLIENTS;
+    ULONG Requests = BENCH_DEFAULT_REQUESTS;
+    UINT32 TtlMs = CONFIG_CACHE_DEFAULT_TTL;
+    SIM_FABRIC_LATENCY Latency = { 0, 0, 0 };
+    CHardwareInterfaceLib CHWLib;
+    CHardwareInterfaceLib Second;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-clients") == 0 && Arg + 1 < argc) {
+            Clients = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-requests") == 0 && Arg + 1 < argc) {
+            Requests = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-ttl") == 0 && Arg + 1 < argc) {
+            TtlMs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Clients == 0 || Requests == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = STATUS_SUCCESS;
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS && NT_SUCCESS(Status); Device++)
+    {
+        Status = SimFabricAddFunction(0, Device, 0, BENCH_VENDOR_ID, (USHORT)(BENCH_DEVICE_ID + Device), 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddBar(0, Device, 0, 0, BarOf(Device), BENCH_BAR_SIZE);
+        }
+    }
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+
+    //
+    // Registers the clients read on their own, distinct per function.
+    //
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS; Device++)
+    {
+        PUCHAR Config = SimFabricGetConfig(0, Device, 0);
+
+        for (ULONG Offset = 0x40; Offset < PCI_CFG_SIZE; Offset++)
+        {
+            Config[Offset] = (UCHAR)(Offset ^ (Device << 4));
+        }
+    }
+    SimFabricSetLatency(&Latency);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+    if (Second.CHardwareInterfaceLibInitialise() == Success) {
+        printf("Second open of the exclusive device succeeded\n");
+        Passed = FALSE;
+    }
+    else {
+        printf("Second open of the exclusive device: refused\n");
+    }
+
+    printf("%u clients, %u reads each in groups of %u, latency config %u ns, MMIO %u ns\n",
+           Clients, Requests, BENCH_GROUP, Latency.ConfigNs, Latency.MmioNs);
+    printf("%-16s%12s%10s%11s%10s%9s%9s%9s\n", "Path", "Reads/s", "us/read", "IOCTL/read", "cfg/read", "Rounds", "Merged", "Hits");
+
+    for (ULONG Case = 0; Case < 3; Case++)
+    {
+        BENCH_PATH Path = (Case == 0) ? BenchDirect : BenchBroker;
+        UINT32 CaseTtl = (Case == 1) ? 0 : TtlMs;
+        CHardwareBroker Broker(CHWLib);
+        HardwareBrokerStatistics BrokerStatistics;
+        std::vector<std::thread> Threads;
+        std::atomic<ULONG> Failures(0);
+        std::mutex Lock;
+        SIM_FABRIC_COUNTERS Counters;
+        SHIM_STATISTICS Statistics;
+        char Name[32];
+        double Begin;
+        double Seconds;
+        double Total = (double)Clients * Requests;
+
+        memset(&BrokerStatistics, 0, sizeof(BrokerStatistics));
+        if (Path == BenchBroker) {
+            CHardwareBroker Rival(CHWLib);
+
+            snprintf(Name, sizeof(Name), "BROKER ttl %u", CaseTtl);
+            if (Broker.Start(BENCH_PIPE_NAME, CaseTtl) != Success) {
+                printf("%s\n", Broker.GetStatusMessage().c_str());
+                return 1;
+            }
+            if (Rival.Start(BENCH_PIPE_NAME, CaseTtl) == Success) {
+                printf("Second broker on the same pipe started\n");
+                Passed = FALSE;
+            }
+        }
+        else {
+            snprintf(Name, sizeof(Name), "DIRECT locked");
+        }
+
+        SimFabricResetCounters();
+        ShimResetStatistics();
+        Begin = BenchNow();
+        for (ULONG Client = 0; Client < Clients; Client++)
+        {
+            if (Path == BenchDirect) {
+                Threads.emplace_back(RunDirectClient, &CHWLib, &Lock, Client, Requests, &Failures);
+            }
+            else {
+                Threads.emplace_back(RunBrokerClient, Client, Requests, &Failures);
+            }
+        }
+        for (auto& Thread : Threads)
+        {
+            Thread.join();
+        }
+        Seconds = BenchNow() - Begin;
+        SimFabricGetCounters(&Counters);
+        ShimGetStatistics(&Statistics);
+
+        if (Path == BenchBroker) {
+            Broker.Stop();
+            BrokerStatistics = Broker.GetStatistics();
+            if (BrokerStatistics.m_Requests != Total || BrokerStatistics.m_Connections != Clients) {
+                printf("%-16s broker counted %llu reads of %llu connections\n", Name,
+                       (unsigned long long)BrokerStatistics.m_Requests, (unsigned long long)BrokerStatistics.m_Connections);
+                Passed = FALSE;
+            }
+        }
+
+        if (Failures != 0) {
+            printf("%-16s  %u reads failed\n", Name, Failures.load());
+            Passed = FALSE;
+            continue;
+        }
+        printf("%-16s%12.0f%10.2f%11.3f%10.3f%9llu%9llu%9llu\n", Name, Total / Seconds, Seconds * 1e6 / Total,
+               (double)Statistics.Requests / Total, (double)Counters.ConfigReads / Total,
+               (unsigned long long)BrokerStatistics.m_Batches, (unsigned long long)BrokerStatistics.m_Merged,
+               (unsigned long long)BrokerStatistics.m_CacheHits);
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+/*++
+
+Module Name:
+
+    HWCapabilityBench.cpp
+
+Abstract:
+
+    Measures the configuration space bytes and the time CCapabilityWalker
+    spends per capability lookup.
+
+    The walker reads through a PFN_CFG_READ served from in-memory images
+    of Functions functions, each with five standard capabilities and four
+    extended capabilities. The same lookups, present and missing ids at
+    the head and the tail of both chains, are made by walking both chains
+    in full for every lookup, by the lazy walk on a cold walker, by the
+    walker once its offsets are cached, and as cached field reads. Every
+    offset found is checked against the images, a cached lookup must not
+    read, and walks of looped chains and of an absent function must end.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "BenchCommon.h"
+#include "CapabilityWalker.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     1000
+#define BENCH_DEFAULT_PASSES        10
+#define BENCH_MISSING_ID            0x12
+#define BENCH_MISSING_EXT_ID        PCIe_EXT_CAP_ID_SRIOV
+#define BENCH_LINK_STATUS           0x12
+
+typedef struct
+{
+    bool m_Extended;
+    UINT16 m_Id;
+    UINT16 m_Offset;
+}BenchLookup;
+
+//
+// Chains of every function, in list order. An offset of 0 is a missing id.
+//
+static const BenchLookup Layout[] =
+{
+    { false, PCI_CAP_ID_PM, 0x40 },
+    { false, PCI_CAP_ID_VENDOR, 0x48 },
+    { false, PCI_CAP_ID_MSI, 0x50 },
+    { false, PCI_CAP_ID_MSIX, 0x68 },
+    { false, PCI_CAP_ID_PCIe, 0x80 },
+    { true, PCIe_EXT_CAP_ID_AER, 0x100 },
+    { true, PCIe_EXT_CAP_ID_ARI, 0x148 },
+    { true, PCIe_EXT_CAP_ID_DSN, 0x150 },
+    { true, PCIe_EXT_CAP_ID_LTR, 0x160 },
+};
+
+static const BenchLookup Lookups[] =
+{
+    { false, PCI_CAP_ID_PM, 0x40 },
+    { false, PCI_CAP_ID_PCIe, 0x80 },
+    { false, BENCH_MISSING_ID, 0 },
+    { true, PCIe_EXT_CAP_ID_AER, 0x100 },
+    { true, PCIe_EXT_CAP_ID_LTR, 0x160 },
+    { true, BENCH_MISSING_EXT_ID, 0 },
+};
+
+//
+// Configuration space images, function Index at bus 1 + Index / 32. A
+// function past the images reads all ones.
+//
+typedef struct
+{
+    std::vector<UINT8> m_Images;
+    ULONG m_Functions;
+    UINT64 m_Reads;
+}BenchFabric;
+
+static UserStatus FabricRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    BenchFabric* Fabric = (BenchFabric*)Context;
+    ULONG Index = (ULONG)(Bus - 1) * 32 + Device;
+
+    if (Offset > PCIe_CFG_SIZE || Size > PCIe_CFG_SIZE - Offset) {
+        return IndexOutOfRange;
+    }
+    Fabric->m_Reads++;
+    if (Bus == 0 || Function != 0 || Index >= Fabric->m_Functions) {
+        memset(Data, 0xFF, Size);
+        return Success;
+    }
+    memcpy(Data, &Fabric->m_Images[(size_t)Index * PCIe_CFG_SIZE + Offset], Size);
+    return Success;
+}
+
+static VOID LinkCapabilities(PUINT8 Config)
+{
+    UINT16 Status = 0x0010;
+    ULONG Count = sizeof(Layout) / sizeof(Layout[0]);
+
+    memcpy(Config + 0x06, &Status, sizeof(Status));
+    Config[0x34] = (UINT8)Layout[0].m_Offset;
+    for (ULONG i = 0; i < Count; i++)
+    {
+        UINT16 Next = (i + 1 < Count && Layout[i + 1].m_Extended == Layout[i].m_Extended) ? Layout[i + 1].m_Offset : 0;
+
+        if (!Layout[i].m_Extended) {
+            Config[Layout[i].m_Offset] = (UINT8)Layout[i].m_Id;
+            Config[Layout[i].m_Offset + 1] = (UINT8)Next;
+        }
+        else {
+            UINT32 Header = Layout[i].m_Id | (1 << 16) | ((UINT32)Next << 20);
+            memcpy(Config + Layout[i].m_Offset, &Header, sizeof(Header));
+        }
+    }
+}
+
+static BOOLEAN Check(const BenchLookup& Lookup, UserStatus LookupStatus, UINT32 Offset)
+{
+    if (Lookup.m_Offset == 0) {
+        return LookupStatus == IndexOutOfRange;
+    }
+    return LookupStatus == Success && Offset == Lookup.m_Offset;
+}
+
+//
+// Walks both chains in full and scans them, as a walker without lazy
+// stepping or caching would for every lookup.
+//
+static UserStatus EagerFind(CCapabilityWalker& Walker, UINT8 Bus, UINT8 Device, const BenchLookup& Lookup, PUINT32 pOffset)
+{
+    std::vector<CapabilityEntry> Standard, Extended;
+    UserStatus LookupStatus;
+
+    Walker.Invalidate(Bus, Device, 0);
+    LookupStatus = Walker.GetCapabilities(Bus, Device, 0, false, Standard);
+    if (LookupStatus == Success) {
+        LookupStatus = Walker.GetCapabilities(Bus, Device, 0, true, Extended);
+    }
+    if (LookupStatus != Success) {
+        return LookupStatus;
+    }
+    for (auto& Entry : (Lookup.m_Extended ? Extended : Standard))
+    {
+        if (Entry.m_Id == Lookup.m_Id) {
+            *pOffset = Entry.m_Offset;
+            return Success;
+        }
+    }
+    return IndexOutOfRange;
+}
+
+//
+// Returns FALSE if a looped chain or an absent function is not bounded.
+//
+static BOOLEAN CheckTermination(BenchFabric& Fabric)
+{
+    CCapabilityWalker Walker(FabricRead, &Fabric);
+    std::vector<CapabilityEntry> Standard, Extended;
+    PUINT8 Config = &Fabric.m_Images[0];
+    UINT32 Header = PCIe_EXT_CAP_ID_AER | (1 << 16) | (0x100 << 20);
+    UINT32 Offset = 0;
+    UINT32 Extent = 0;
+    UINT64 Reads;
+    BOOLEAN Passed = TRUE;
+    UINT8 Bus, Device;
+
+    //
+    // Function 0 gets a standard list and an extended chain that point
+    // back at themselves.
+    //
+    Config[0x41] = 0x40;
+    memcpy(Config + 0x100, &Header, sizeof(Header));
+    BenchLocate(0, &Bus, &Device);
+
+    Reads = Fabric.m_Reads;
+    if (Walker.GetCapabilities(Bus, Device, 0, false, Standard) != Success || Standard.size() != 48 ||
+        Walker.GetCapabilities(Bus, Device, 0, true, Extended) != Success || Extended.size() != (PCIe_CFG_SIZE - 0x100) / 4 ||
+        Walker.FindCapability(Bus, Device, 0, BENCH_MISSING_ID, &Offset) != IndexOutOfRange ||
+        Walker.FindExtendedCapability(Bus, Device, 0, BENCH_MISSING_EXT_ID, &Offset) != IndexOutOfRange) {
+        printf("Looped chains: %zu standard, %zu extended entries\n", Standard.size(), Extended.size());
+        Passed = FALSE;
+    }
+    printf("Looped chains end after %zu standard and %zu extended headers, %llu reads\n", Standard.size(), Extended.size(),
+           (unsigned long long)(Fabric.m_Reads - Reads));
+
+    Reads = Fabric.m_Reads;
+    if (Walker.FindCapability(0, 0, 0, PCI_CAP_ID_PCIe, &Offset) != IndexOutOfRange ||
+        Walker.FindExtendedCapability(0, 0, 0, PCIe_EXT_CAP_ID_AER, &Offset) != IndexOutOfRange ||
+        Walker.GetExtent(0, 0, 0, &Extent) != Success || Extent != PCI_CFG_SIZE || Fabric.m_Reads - Reads > 3) {
+        printf("Absent function: extent 0x%x, %llu reads\n", Extent, (unsigned long long)(Fabric.m_Reads - Reads));
+        Passed = FALSE;
+    }
+
+    return Passed;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWCapabilityBench [-functions <Count>] [-passes <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "eager walk", "lazy, cold", "lazy, cached", "field, cached" };
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    ULONG LookupCount = sizeof(Lookups) / sizeof(Lookups[0]);
+    BenchFabric Fabric;
+    CCapabilityWalker Cached(FabricRead, &Fabric);
+    BOOLEAN Passed = TRUE;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 32 * 255 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Fabric.m_Images.assign((size_t)Functions * PCIe_CFG_SIZE, 0);
+    Fabric.m_Functions = Functions;
+    Fabric.m_Reads = 0;
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        LinkCapabilities(&Fabric.m_Images[(size_t)i * PCIe_CFG_SIZE]);
+    }
+
+    //
+    // The cached rows start from a walker that already holds every chain.
+    //
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        UINT8 Bus, Device;
+        UINT32 Offset = 0;
+
+        BenchLocate(i, &Bus, &Device);
+        Cached.FindCapability(Bus, Device, 0, BENCH_MISSING_ID, &Offset);
+        Cached.FindExtendedCapability(Bus, Device, 0, BENCH_MISSING_EXT_ID, &Offset);
+    }
+
+    printf("%u functions, %u passes of %u lookups per function\n", Functions, Passes, LookupCount);
+    printf("%-16s%10s%10s%14s%14s%10s\n", "Lookup", "Lookups", "ms", "Bytes/lookup", "Reads/lookup", "Wrong");
+
+    for (ULONG Mode = 0; Mode < sizeof(ModeNames) / sizeof(ModeNames[0]); Mode++)
+    {
+        UINT64 Bytes = 0;
+        UINT64 Reads = Fabric.m_Reads;
+        UINT64 Count = 0;
+        ULONG Wrong = 0;
+        double Begin = BenchNow();
+
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            CCapabilityWalker Cold(FabricRead, &Fabric);
+            CCapabilityWalker& Walker = (Mode >= 2) ? Cached : Cold;
+            UINT64 BytesBefore = Walker.GetBytesRead();
+
+            for (ULONG i = 0; i < Functions; i++)
+            {
+                UINT8 Bus, Device;
+
+                BenchLocate(i, &Bus, &Device);
+                for (ULONG l = 0; l < LookupCount; l++)
+                {
+                    const BenchLookup& Lookup = Lookups[l];
+                    UINT32 Offset = 0;
+                    UserStatus LookupStatus;
+
+                    if (Mode == 0) {
+                        LookupStatus = EagerFind(Walker, Bus, Device, Lookup, &Offset);
+                    }
+                    else if (Mode == 3) {
+                        UINT16 LinkStatus = 0;
+
+                        if (Lookup.m_Extended || Lookup.m_Offset == 0) {
+                            continue;
+                        }
+                        LookupStatus = Walker.ReadCapability(Bus, Device, 0, (UINT8)Lookup.m_Id, BENCH_LINK_STATUS, (PUINT8)&LinkStatus, sizeof(LinkStatus));
+                        Offset = (LookupStatus == Success && LinkStatus == *(PUINT16)&Fabric.m_Images[(size_t)i * PCIe_CFG_SIZE + Lookup.m_Offset + BENCH_LINK_STATUS])
+                            ? Lookup.m_Offset : 0;
+                    }
+                    else if (Lookup.m_Extended) {
+                        LookupStatus = Walker.FindExtendedCapability(Bus, Device, 0, Lookup.m_Id, &Offset);
+                    }
+                    else {
+                        LookupStatus = Walker.FindCapability(Bus, Device, 0, (UINT8)Lookup.m_Id, &Offset);
+                    }
+                    Wrong += !Check(Lookup, LookupStatus, Offset);
+                    Count++;
+                }
+            }
+            Bytes += Walker.GetBytesRead() - BytesBefore;
+        }
+
+        printf("%-16s%10llu%10.3f%14.2f%14.2f%10u\n", ModeNames[Mode], (unsigned long long)Count, (BenchNow() - Begin) * 1e3,
+               (double)Bytes / Count, (double)(Fabric.m_Reads - Reads) / Count, Wrong);
+        if (Wrong != 0 || (Mode == 2 && Bytes != 0) || (Mode == 3 && Bytes != Count * sizeof(UINT16))) {
+            Passed = FALSE;
+        }
+    }
+
+    if (!CheckTermination(Fabric)) {
+        Passed = FALSE;
+    }
+
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*++
+
+Module Name:
+
+    HWCaptureArenaBench.cpp
+
+Abstract:
+
+    Times configuration space captures into CCaptureArena against one heap
+    buffer per function, as the dumps allocated before the arena.
+
+    Every pass captures the 256 byte header of all functions and then
+    their 4 KB space, the order of the App dump. The heap mode callocs and
+    frees a buffer per function and capture, the arena mode reserves its
+    slots before each capture. The bench prints the time and the
+    allocations of both. The arena must hold the bytes of the fabric,
+    allocate nothing after the first pass, keep its slots contiguous and
+    keep its slab when a reserve fails.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "CaptureArena.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     500
+#define BENCH_DEFAULT_PASSES        20
+
+//
+// The host bridge and Functions endpoints with a PCI Express capability
+// and AER, so the extended space is populated.
+//
+static NTSTATUS BuildFabric(ULONG Functions)
+{
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (ULONG i = 0; i < Functions && NT_SUCCESS(Status); i++)
+    {
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        Status = SimFabricAddFunction(Bus, Device, 0, BENCH_VENDOR_ID, (USHORT)(BENCH_DEVICE_ID + i % 4), 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PCIe, 0x50);
+        }
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_AER, 0x100);
+        }
+    }
+    return Status;
+}
+
+static UserStatus Capture(CHardwareInterfaceLib& CHWLib, ULONG Index, PUINT8 Data, UINT32 Size)
+{
+    PCI_PCIeCfgData cfgData;
+    UINT8 Bus, Device;
+
+    BenchLocate(Index, &Bus, &Device);
+    cfgData.m_Bus = Bus;
+    cfgData.m_Device = Device;
+    cfgData.m_Function = 0;
+    cfgData.m_Offset = 0;
+    cfgData.OutputData.m_Size = Size;
+    cfgData.OutputData.DataPointer = Data;
+    return (Size == PCI_CFG_SIZE) ? CHWLib.PCIStdCfgRead(&cfgData) : CHWLib.PCIeExCfgRead(&cfgData);
+}
+
+//
+// Stands in for printing a capture, which reads every byte of it.
+//
+static UINT64 Consume(const UINT8* Data, UINT32 Size)
+{
+    UINT64 Sum = 0;
+
+    for (UINT32 i = 0; i < Size; i += sizeof(UINT32))
+    {
+        UINT32 Value;
+
+        memcpy(&Value, Data + i, sizeof(Value));
+        Sum += Value;
+    }
+    return Sum;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWCaptureArenaBench [-functions <Count>] [-passes <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "heap per function", "arena" };
+    static const UINT32 SlotSizes[] = { PCI_CFG_SIZE, PCIe_CFG_SIZE };
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    CHardwareInterfaceLib CHWLib;
+    CCaptureArena Arena;
+    UINT64 Sums[2] = { 0 };
+    UINT64 Allocations[2] = { 0 };
+    ULONG Failures[2] = { 0 };
+    double Times[2] = { 0 };
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 32 * 255 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BuildFabric(Functions);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        double Begin = BenchNow();
+
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            for (ULONG s = 0; s < sizeof(SlotSizes) / sizeof(SlotSizes[0]); s++)
+            {
+                if (Mode == 1 && Arena.Reserve(Functions, SlotSizes[s]) != Success) {
+                    printf("%s\n", Arena.GetStatusMessage().c_str());
+                    Failures[Mode]++;
+                    continue;
+                }
+                for (ULONG i = 0; i < Functions; i++)
+                {
+                    PUINT8 Data;
+
+                    if (Mode == 0) {
+                        Data = (PUINT8)calloc(1, SlotSizes[s]);
+                        Allocations[Mode]++;
+                        if (Data == NULL) {
+                            Failures[Mode]++;
+                            continue;
+                        }
+                    }
+                    else {
+                        Data = Arena.GetSlot(i);
+                    }
+                    if (Capture(CHWLib, i, Data, SlotSizes[s]) == Success) {
+                        Sums[Mode] += Consume(Data, SlotSizes[s]);
+                    }
+                    else {
+                        Failures[Mode]++;
+                    }
+                    if (Mode == 0) {
+                        free(Data);
+                    }
+                }
+            }
+        }
+        Times[Mode] = BenchNow() - Begin;
+    }
+    Allocations[1] = Arena.GetAllocationCount();
+
+    printf("%u functions, %u passes of a 256 byte and a 4 KB capture\n", Functions, Passes);
+    printf("%-20s%12s%14s%10s\n", "Buffers", "ms", "Allocations", "Failed");
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        printf("%-20s%12.3f%14llu%10u\n", ModeNames[Mode], Times[Mode] * 1e3, (unsigned long long)Allocations[Mode], Failures[Mode]);
+    }
+    printf("Speedup %.2fx, arena slab %zu bytes\n", (Times[1] > 0) ? Times[0] / Times[1] : 0.0, Arena.GetSize());
+
+    if (Failures[0] != 0 || Failures[1] != 0 || Sums[0] != Sums[1]) {
+        printf("Heap and arena captures disagree\n");
+        Passed = FALSE;
+    }
+
+    //
+    // The first pass allocates for its 256 byte capture and grows the slab
+    // for the 4 KB one unless it already fits, later passes allocate nothing.
+    //
+    if (Allocations[1] != ((SIZE_T)Functions * PCIe_CFG_SIZE > (((SIZE_T)Functions * PCI_CFG_SIZE + CAPTURE_ARENA_GRANULARITY - 1) &
+                                                                ~(SIZE_T)(CAPTURE_ARENA_GRANULARITY - 1)) ? 2 : 1)) {
+        printf("The arena allocated %llu times\n", (unsigned long long)Allocations[1]);
+        Passed = FALSE;
+    }
+
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        if (Arena.GetSlot(i) != Arena.GetData() + (SIZE_T)i * PCIe_CFG_SIZE ||
+            memcmp(Arena.GetSlot(i), SimFabricGetConfig(Bus, Device, 0), PCIe_CFG_SIZE) != 0) {
+            printf("Slot %u does not hold %02x:%02x.0\n", i, Bus, Device);
+            Passed = FALSE;
+            break;
+        }
+    }
+
+    {
+        PUINT8 Slab = Arena.GetData();
+
+        if (Arena.Reserve(Functions, 6) != IndexOutOfRange || Arena.GetData() != Slab || Arena.GetSlotSize() != PCIe_CFG_SIZE ||
+            Arena.GetSlotCount() != Functions) {
+            printf("A slot size of 6 bytes was accepted or replaced the slab\n");
+            Passed = FALSE;
+        }
+        Arena.Release();
+        if (Arena.GetData() != NULL || Arena.GetSize() != 0) {
+            printf("Release left %zu bytes\n", Arena.GetSize());
+            Passed = FALSE;
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,414 @@
+/*++
+
+Module Name:
+
+    HWConfigArchiveBench.cpp
+
+Abstract:
+
+    Times CConfigArchiveBuilder::Ingest of a synthetic fleet at 1, 2, 4 and
+    up to one thread per logical processor and checks the archive through
+    CConfigArchiveReader.
+
+    Every host is a snapshot file of the same number of functions, made
+    from a few device templates with a BAR, Max Payload Size, AER
+    correctable status and serial number drawn from small sets, so most
+    captures repeat across functions and hosts. The bench prints the ingest
+    time and functions per second of each thread count and the speedup
+    over one thread. Every thread count must give the same archive, the
+    manifest of every host must hold the bytes of its snapshot, every
+    distinct capture must be found by its hash and the blob count must be
+    the number of distinct captures made.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "ConfigArchive.h"
+
+#define BENCH_DEFAULT_HOSTS         1000
+#define BENCH_DEFAULT_FUNCTIONS     1000
+#define BENCH_DEFAULT_ARCHIVE       "HWConfigArchiveBench.hwa"
+#define BENCH_SNAPSHOT_FORMAT       "HWConfigArchiveBench.%04u.hws"
+#define BENCH_TEMPLATES             6
+#define BENCH_BAR_SLOTS             4
+#define BENCH_MPS_VALUES            3
+#define BENCH_BATCHES               8
+
+//
+// Offsets of the synthetic layout, the PCI Express capability at 0x80,
+// AER at 0x100 and a serial number at 0x148.
+//
+#define BENCH_PCIE_CAP              0x80
+#define BENCH_DEVICE_CONTROL        0x88
+#define BENCH_AER_CAP               0x100
+#define BENCH_AER_CORRECTABLE       0x110
+#define BENCH_DSN_CAP               0x148
+
+//
+// A capture is made from its key: the template, BAR slot, Max Payload Size,
+// AER correctable bit plus one or 0 and the batch that picks the serial
+// number. Conventional captures have no AER or serial number, so their
+// keys leave both 0 and different keys always give different bytes.
+//
+#define BENCH_KEY(Template, Bar, Mps, Correctable, Batch) \
+    ((Template) | ((Bar) << 3) | ((Mps) << 5) | ((Correctable) << 7) | ((Batch) << 12))
+
+typedef struct
+{
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT32 m_ClassCode;
+    BOOLEAN m_Extended;
+}BenchTemplate;
+
+static const BenchTemplate Templates[BENCH_TEMPLATES] =
+{
+    { 0x8086, 0x7A38, 0x060400, TRUE },     // root port
+    { 0x8086, 0x1572, 0x020000, TRUE },     // Ethernet
+    { 0x144D, 0xA808, 0x010802, TRUE },     // NVMe
+    { 0x10DE, 0x2204, 0x030000, TRUE },     // VGA
+    { 0x8086, 0x7A24, 0x0C0330, FALSE },    // USB, 256 byte capture
+    { 0x8086, 0x7A04, 0x060100, FALSE },    // ISA bridge, 256 byte capture
+};
+
+static UINT32 Random(PUINT64 State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (UINT32)(*State >> 33);
+}
+
+static UINT32 MakeCapture(UINT32 Key, PUINT8 Capture)
+{
+    const BenchTemplate& Template = Templates[Key & 0x07];
+    UINT32 Size = Template.m_Extended ? PCIe_CFG_SIZE : PCI_CFG_SIZE;
+    UINT32 Id = Template.m_VendorId | ((UINT32)Template.m_DeviceId << 16);
+    UINT32 Class = Template.m_ClassCode << 8;
+    UINT32 Bar0 = 0xF0000000 + ((Key >> 3) & 0x03) * 0x200000;
+    UINT32 PcieHeader = PCI_CAP_ID_PCIe | (0x0002 << 16);
+    UINT32 DeviceControl = (((Key >> 5) & 0x03) << 5) | 0x0F;
+    UINT32 AerHeader = PCIe_EXT_CAP_ID_AER | (1 << 16) | (BENCH_DSN_CAP << 20);
+    UINT32 CorrectableBit = (Key >> 7) & 0x1F;
+    UINT32 Correctable = (CorrectableBit != 0) ? (1 << (CorrectableBit - 1)) : 0;
+    UINT32 DsnHeader = PCIe_EXT_CAP_ID_DSN | (1 << 16);
+    UINT32 Serial[2] = { 0x5E000000 | (Key >> 12), Template.m_DeviceId };
+
+    memset(Capture, 0, PCIe_CFG_SIZE);
+    memcpy(Capture + 0x00, &Id, sizeof(Id));
+    memcpy(Capture + 0x08, &Class, sizeof(Class));
+    memcpy(Capture + 0x10, &Bar0, sizeof(Bar0));
+    Capture[0x34] = BENCH_PCIE_CAP;
+    memcpy(Capture + BENCH_PCIE_CAP, &PcieHeader, sizeof(PcieHeader));
+    memcpy(Capture + BENCH_DEVICE_CONTROL, &DeviceControl, sizeof(DeviceControl));
+    if (Template.m_Extended) {
+        memcpy(Capture + BENCH_AER_CAP, &AerHeader, sizeof(AerHeader));
+        memcpy(Capture + BENCH_AER_CORRECTABLE, &Correctable, sizeof(Correctable));
+        memcpy(Capture + BENCH_DSN_CAP, &DsnHeader, sizeof(DsnHeader));
+        memcpy(Capture + BENCH_DSN_CAP + 4, Serial, sizeof(Serial));
+    }
+    return Size;
+}
+
+//
+// Function i of host h: the template follows the function, the BAR slot
+// its position, the Max Payload Size and the batch follow the host and one
+// function in 16 has a correctable error bit set.
+//
+static UINT32 KeyOf(ULONG Host, ULONG Index, PUINT64 State)
+{
+    UINT32 Template = Index % BENCH_TEMPLATES;
+    UINT32 Bar = (Index / BENCH_TEMPLATES) % BENCH_BAR_SLOTS;
+    UINT32 Mps = Host % BENCH_MPS_VALUES;
+    UINT32 Correctable = ((Random(State) % 16) == 0) ? 1 + Random(State) % 16 : 0;
+    UINT32 Batch = Host % BENCH_BATCHES;
+
+    if (!Templates[Template].m_Extended) {
+        Correctable = 0;
+        Batch = 0;
+    }
+    return BENCH_KEY(Template, Bar, Mps, Correctable, Batch);
+}
+
+static std::string SnapshotName(ULONG Host)
+{
+    char Name[64];
+
+    snprintf(Name, sizeof(Name), BENCH_SNAPSHOT_FORMAT, Host);
+    return Name;
+}
+
+static std::string HostName(ULONG Host)
+{
+    char Name[32];
+
+    snprintf(Name, sizeof(Name), "host%04u", Host);
+    return Name;
+}
+
+//
+// Hashes the archive file, so the archives of two thread counts compare
+// without keeping both.
+//
+static BOOLEAN HashFile(const char* FileName, Hash128* pHash)
+{
+    std::vector<UINT8> Data;
+    FILE* File = fopen(FileName, "rb");
+
+    if (File == NULL) {
+        return FALSE;
+    }
+    fseek(File, 0, SEEK_END);
+    Data.resize((SIZE_T)ftell(File));
+    fseek(File, 0, SEEK_SET);
+    if (fread(Data.data(), 1, Data.size(), File) != Data.size()) {
+        fclose(File);
+        return FALSE;
+    }
+    fclose(File);
+    *pHash = CHash128::Compute(Data.data(), Data.size());
+    return TRUE;
+}
+
+//
+// Returns the number of hosts whose manifest does not hold the records of
+// their snapshot.
+//
+static ULONG CheckManifests(CConfigArchiveReader& Reader, ULONG Hosts)
+{
+    std::vector<UINT8> Data;
+    ConfigSnapshotRecord Record;
+    ULONG Mismatches = 0;
+
+    for (ULONG h = 0; h < Hosts; h++)
+    {
+        CConfigSnapshotReader Snapshot;
+        const ConfigArchiveHost* Host = NULL;
+        const ConfigArchiveEntry* Entries = NULL;
+        UINT32 Count = 0;
+        BOOLEAN Matches = TRUE;
+
+        if (Reader.GetHost(h, &Host) != Success || HostName(h) != Host->m_HostName ||
+            Reader.GetEntries(h, &Entries, &Count) != Success ||
+            Snapshot.Open(SnapshotName(h)) != Success || Snapshot.GetHeader().m_RecordCount != Count) {
+            Mismatches++;
+            continue;
+        }
+        for (UINT32 i = 0; i < Count && Matches; i++)
+        {
+            const UINT8* Blob = NULL;
+            UINT32 Size = 0;
+
+            Matches = Snapshot.ReadRecord(Record, Data) == Success && Reader.GetBlob(Entries[i].m_BlobId, &Blob, &Size) == Success &&
+                      Entries[i].m_Bus == Record.m_Bus && Entries[i].m_Device == Record.m_Device && Entries[i].m_Function == Record.m_Function &&
+                      Size == Data.size() && memcmp(Blob, Data.data(), Size) == 0;
+        }
+        Mismatches += !Matches;
+    }
+    return Mismatches;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWConfigArchiveBench [-hosts <Count>] [-functions <Count>] [-threads <Count>] [-archive <File>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Hosts = BENCH_DEFAULT_HOSTS;
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG MaxThreads = std::thread::hardware_concurrency();
+    const char* ArchiveFile = BENCH_DEFAULT_ARCHIVE;
+    std::vector<std::string> SnapshotFiles;
+    std::vector<ULONG> ThreadCounts;
+    std::set<UINT32> Keys;
+    std::vector<UINT8> Capture(PCIe_CFG_SIZE);
+    UINT64 State = 0x9E3779B97F4A7C15ULL;
+    UINT64 RawBytes = 0;
+    UINT64 FunctionCount = 0;
+    Hash128 FirstHash = { 0, 0 };
+    double SingleTime = 0;
+    double Begin;
+    ULONG Differing = 0;
+    ULONG Miscounted = 0;
+    ULONG Missing = 0;
+    ULONG Mismatches = 0;
+    UINT32 Absent = 0;
+    BOOLEAN Passed = TRUE;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-hosts") == 0 && Arg + 1 < argc) {
+            Hosts = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-threads") == 0 && Arg + 1 < argc) {
+            MaxThreads = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-archive") == 0 && Arg + 1 < argc) {
+            ArchiveFile = argv[++Arg];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Hosts == 0 || Hosts > 10000 || Functions == 0 || Functions > 0x10000) {
+        PrintUsage();
+        return 1;
+    }
+    if (MaxThreads == 0) {
+        MaxThreads = 1;
+    }
+    for (ULONG Threads = 1; Threads < MaxThreads; Threads *= 2)
+    {
+        ThreadCounts.push_back(Threads);
+    }
+    ThreadCounts.push_back(MaxThreads);
+
+    Begin = BenchNow();
+    for (ULONG h = 0; h < Hosts; h++)
+    {
+        CConfigSnapshotWriter Writer;
+
+        SnapshotFiles.push_back(SnapshotName(h));
+        if (Writer.Create(SnapshotFiles[h], HostName(h)) != Success) {
+            printf("%s\n", Writer.GetStatusMessage().c_str());
+            return 1;
+        }
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            UINT32 Key = KeyOf(h, i, &State);
+            UINT32 Size = MakeCapture(Key, Capture.data());
+            UINT8 Bus, Device, Function;
+
+            Keys.insert(Key);
+            BenchLocateFunction(i, &Bus, &Device, &Function);
+            if (Writer.Append(Bus, Device, Function, Capture.data(), Size) != Success) {
+                printf("%s\n", Writer.GetStatusMessage().c_str());
+                return 1;
+            }
+            RawBytes += Size;
+        }
+        if (Writer.Close() != Success) {
+            printf("%s\n", Writer.GetStatusMessage().c_str());
+            return 1;
+        }
+    }
+    FunctionCount = (UINT64)Hosts * Functions;
+    printf("%u hosts of %u functions, %zu distinct captures, %llu raw bytes, snapshots written in %.3f s\n",
+           Hosts, Functions, Keys.size(), (unsigned long long)RawBytes, BenchNow() - Begin);
+
+    printf("%-10s%12s%16s%10s\n", "Threads", "ms", "Functions/s", "Speedup");
+    for (ULONG Threads : ThreadCounts)
+    {
+        CConfigArchiveBuilder Builder;
+        Hash128 Hash;
+        double Time;
+
+        Begin = BenchNow();
+        if (Builder.Ingest(SnapshotFiles, Threads) != Success) {
+            printf("%s\n", Builder.GetStatusMessage().c_str());
+            return 1;
+        }
+        Time = BenchNow() - Begin;
+        if (SingleTime == 0) {
+            SingleTime = Time;
+        }
+        printf("%-10u%12.3f%16.0f%10.2f\n", Threads, Time * 1e3, FunctionCount / Time, SingleTime / Time);
+
+        if (Builder.Write(ArchiveFile) != Success) {
+            printf("%s\n", Builder.GetStatusMessage().c_str());
+            return 1;
+        }
+        if (Builder.GetFunctionCount() != FunctionCount || Builder.GetBlobCount() != Keys.size()) {
+            Miscounted++;
+        }
+        if (!HashFile(ArchiveFile, &Hash)) {
+            printf("Unable to read archive %s\n", ArchiveFile);
+            return 1;
+        }
+        if (Threads == ThreadCounts[0]) {
+            FirstHash = Hash;
+        }
+        Differing += !(Hash == FirstHash);
+    }
+
+    //
+    // The archive of the last thread count is read back.
+    //
+    {
+        CConfigArchiveReader Reader;
+
+        if (Reader.Open(ArchiveFile) != Success) {
+            printf("%s\n", Reader.GetStatusMessage().c_str());
+            return 1;
+        }
+
+        Begin = BenchNow();
+        Mismatches = CheckManifests(Reader, Hosts);
+        printf("Manifests checked against the snapshots in %.3f s\n", BenchNow() - Begin);
+
+        for (UINT32 Key : Keys)
+        {
+            UINT32 Size = MakeCapture(Key, Capture.data());
+            UINT32 BlobId = 0;
+            const UINT8* Blob = NULL;
+            UINT32 BlobSize = 0;
+
+            if (Reader.FindBlob(CHash128::Compute(Capture.data(), Size, Size), &BlobId) != Success ||
+                Reader.GetBlob(BlobId, &Blob, &BlobSize) != Success || BlobSize != Size || memcmp(Blob, Capture.data(), Size) != 0) {
+                Missing++;
+            }
+        }
+
+        if (Reader.GetHeader().m_BlobCount != Keys.size() || Reader.GetHeader().m_HostCount != Hosts ||
+            Reader.GetHeader().m_EntryCount != FunctionCount) {
+            printf("The archive holds %u blobs of %zu, %u hosts of %u and %llu functions of %llu\n",
+                   Reader.GetHeader().m_BlobCount, Keys.size(), Reader.GetHeader().m_HostCount, Hosts,
+                   (unsigned long long)Reader.GetHeader().m_EntryCount, (unsigned long long)FunctionCount);
+            Passed = FALSE;
+        }
+
+        //
+        // A Max Payload Size no host uses makes a capture that is not
+        // archived.
+        //
+        MakeCapture(BENCH_KEY(0, 0, BENCH_MPS_VALUES, 0, 0), Capture.data());
+        if (Reader.FindBlob(CHash128::Compute(Capture.data(), PCIe_CFG_SIZE, PCIe_CFG_SIZE), &Absent) == Success) {
+            printf("A capture that was never ingested was found\n");
+            Passed = FALSE;
+        }
+        Reader.Close();
+    }
+
+    if (Differing != 0 || Miscounted != 0) {
+        printf("%u thread counts wrote a different archive, %u counted other functions or blobs\n", Differing, Miscounted);
+        Passed = FALSE;
+    }
+    if (Mismatches != 0 || Missing != 0) {
+        printf("%u manifests do not hold their snapshot, %u distinct captures were not found\n", Mismatches, Missing);
+        Passed = FALSE;
+    }
+
+    for (const auto& SnapshotFile : SnapshotFiles)
+    {
+        remove(SnapshotFile.c_str());
+    }
+
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,376 @@
+/*++
+
+Module Name:
+
+    HWConfigCacheBench.cpp
+
+Abstract:
+
+    Replays a recorded trace of configuration reads through CConfigCache.
+
+    A workload of id reads, capability walks and health passes over every
+    function runs once with CAccessTraceRecorder attached. The
+    configuration reads of the trace are then replayed through the driver
+    without a cache, through the cache with the default TTL, with a TTL of
+    0, and with a TTL of 0 and reads queued in groups. Every replay must
+    return the bytes of the uncached one, and no transfer may cross the
+    256 byte boundary.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "AccessTrace.h"
+#include "ConfigCache.h"
+#include "HealthScanner.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     200
+#define BENCH_DEFAULT_PASSES        5
+#define BENCH_DEFAULT_QUEUE         32
+#define BENCH_DEFAULT_TRACE         "HWConfigCacheBench.hwt"
+
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    UINT8 m_Function;
+    UINT32 m_Offset;
+    UINT32 m_Size;
+}BenchRead;
+
+//
+// Backend of the cache, counts the transfers it is asked for.
+//
+typedef struct
+{
+    CHardwareInterfaceLib* m_CHWLib;
+    UINT64 m_Transfers;
+    UINT64 m_Bytes;
+    UINT64 m_Crossing;
+}BenchBackend;
+
+static UserStatus BackendRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    BenchBackend* Backend = (BenchBackend*)Context;
+
+    Backend->m_Transfers++;
+    Backend->m_Bytes += Size;
+    if (Offset < PCI_CFG_SIZE && Offset + Size > PCI_CFG_SIZE) {
+        Backend->m_Crossing++;
+    }
+    return CCapabilityWalker::LibRead(Backend->m_CHWLib, Bus, Device, Function, Offset, Data, Size);
+}
+
+//
+// The host bridge and Functions endpoints with power management, PCI
+// Express and MSI capabilities, AER and a serial number.
+//
+static NTSTATUS BuildFabric(ULONG Functions)
+{
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (ULONG i = 0; i < Functions && NT_SUCCESS(Status); i++)
+    {
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        Status = SimFabricAddFunction(Bus, Device, 0, BENCH_VENDOR_ID, (USHORT)(BENCH_DEVICE_ID + i % 4), 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PM, 0x40);
+        }
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PCIe, 0x50);
+        }
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_MSI, 0x90);
+        }
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_AER, 0x100);
+        }
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_DSN, 0x148);
+        }
+    }
+    return Status;
+}
+
+//
+// Returns the number of calls that failed.
+//
+static ULONG RunWorkload(CHardwareInterfaceLib& CHWLib, ULONG Functions, ULONG Passes)
+{
+    CCapabilityWalker Walker(CHWLib);
+    CHealthScanner Scanner(CHWLib);
+    std::vector<CapabilityEntry> Capabilities;
+    std::vector<HealthChange> Changes;
+    ULONG Failures = 0;
+
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        UINT8 Bus, Device;
+        UINT32 Id = 0;
+
+        BenchLocate(i, &Bus, &Device);
+        Failures += (CCapabilityWalker::LibRead(&CHWLib, Bus, Device, 0, 0, (PUINT8)&Id, sizeof(Id)) != Success);
+        Failures += (Walker.GetCapabilities(Bus, Device, 0, false, Capabilities) != Success || Capabilities.size() != 3);
+        Failures += (Walker.GetCapabilities(Bus, Device, 0, true, Capabilities) != Success || Capabilities.size() != 2);
+        Failures += (Scanner.AddDevice(Bus, Device, 0) != Success);
+    }
+    for (ULONG Pass = 0; Pass < Passes; Pass++)
+    {
+        Failures += (Scanner.Scan(Changes) != Success);
+    }
+    return Failures;
+}
+
+//
+// Configuration reads of a trace in call order.
+//
+static BOOLEAN LoadReads(const char* TraceFile, std::vector<BenchRead>& Reads)
+{
+    std::vector<UINT8> Trace;
+    AccessTraceHeader Header;
+    LARGE_INTEGER Size;
+    DWORD BytesRead = 0;
+    size_t Position = sizeof(Header);
+    HANDLE File = CreateFileA(TraceFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (File == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+    if (!GetFileSizeEx(File, &Size) || (UINT64)Size.QuadPart < sizeof(Header)) {
+        CloseHandle(File);
+        return FALSE;
+    }
+    Trace.resize((size_t)Size.QuadPart);
+    if (!ReadFile(File, Trace.data(), (DWORD)Trace.size(), &BytesRead, NULL) || BytesRead != Trace.size()) {
+        CloseHandle(File);
+        return FALSE;
+    }
+    CloseHandle(File);
+
+    memcpy(&Header, Trace.data(), sizeof(Header));
+    if (Header.m_Magic != ACCESS_TRACE_MAGIC || Header.m_Version != ACCESS_TRACE_VERSION) {
+        return FALSE;
+    }
+    for (UINT64 r = 0; r < Header.m_RecordCount; r++)
+    {
+        AccessTraceRecord Record;
+        BenchRead Read;
+
+        if (Position + sizeof(Record) > Trace.size()) {
+            return FALSE;
+        }
+        memcpy(&Record, Trace.data() + Position, sizeof(Record));
+        Position += sizeof(Record) + Record.m_PayloadSize;
+        if ((Record.m_Operation != AccessTraceStdCfgRead && Record.m_Operation != AccessTraceExCfgRead) || Record.m_Status != Success) {
+            continue;
+        }
+        Read.m_Bus = ACCESS_TRACE_BUS(Record.m_Address);
+        Read.m_Device = ACCESS_TRACE_DEVICE(Record.m_Address);
+        Read.m_Function = ACCESS_TRACE_FUNCTION(Record.m_Address);
+        Read.m_Offset = Record.m_Offset;
+        Read.m_Size = Record.m_Size;
+        Reads.push_back(Read);
+    }
+    return TRUE;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWConfigCacheBench [-functions <Count>] [-passes <Count>] [-queue <Count>] [-trace <File>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "uncached", "TTL 100 ms", "TTL 0", "TTL 0 queued" };
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    ULONG QueueDepth = BENCH_DEFAULT_QUEUE;
+    const char* TraceFile = BENCH_DEFAULT_TRACE;
+    SIM_FABRIC_LATENCY Latency = { 0, 0, 0 };
+    SIM_FABRIC_COUNTERS Counters;
+    CHardwareInterfaceLib CHWLib;
+    CAccessTraceRecorder Recorder;
+    std::vector<BenchRead> Reads;
+    std::vector<UINT8> Reference;
+    std::vector<UINT8> Data;
+    UINT64 ReadBytes = 0;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-queue") == 0 && Arg + 1 < argc) {
+            QueueDepth = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-trace") == 0 && Arg + 1 < argc) {
+            TraceFile = argv[++Arg];
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 32 * 255 || QueueDepth == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BuildFabric(Functions);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    if (Recorder.Start(TraceFile) != Success) {
+        printf("%s\n", Recorder.GetStatusMessage().c_str());
+        return 1;
+    }
+    CHWLib.SetTraceRecorder(&Recorder);
+    if (RunWorkload(CHWLib, Functions, Passes) != 0) {
+        printf("Workload: calls failed\n");
+        Passed = FALSE;
+    }
+    CHWLib.SetTraceRecorder(NULL);
+    if (Recorder.Stop() != Success) {
+        printf("%s\n", Recorder.GetStatusMessage().c_str());
+        return 1;
+    }
+    if (!LoadReads(TraceFile, Reads) || Reads.empty()) {
+        printf("Unable to read the configuration reads of %s\n", TraceFile);
+        return 1;
+    }
+    for (auto& Read : Reads)
+    {
+        ReadBytes += Read.m_Size;
+    }
+    Reference.resize((size_t)ReadBytes);
+    Data.resize((size_t)ReadBytes);
+
+    printf("%u functions, %u health passes, %zu configuration reads of %llu bytes, latency config %u ns, MMIO %u ns\n",
+           Functions, Passes, Reads.size(), (unsigned long long)ReadBytes, Latency.ConfigNs, Latency.MmioNs);
+    printf("%-16s%10s%11s%12s%10s%10s%10s%10s\n", "Replay", "ms", "Transfers", "Bytes", "Hits", "HAL", "ECAM", "Data");
+
+    for (ULONG Mode = 0; Mode < sizeof(ModeNames) / sizeof(ModeNames[0]); Mode++)
+    {
+        BenchBackend Backend = { &CHWLib, 0, 0, 0 };
+        CConfigCache Cache(BackendRead, &Backend);
+        UserStatus ReplayStatus = Success;
+        size_t Position = 0;
+        size_t Queued = 0;
+        double Begin;
+        double Elapsed;
+        BOOLEAN Same;
+
+        if (Mode >= 2) {
+            Cache.SetTtl(0);
+        }
+        SimFabricResetCounters();
+        Begin = BenchNow();
+        for (auto& Read : Reads)
+        {
+            PUINT8 Target = (Mode == 0 ? Reference.data() : Data.data()) + Position;
+            UserStatus ReadStatus;
+
+            if (Mode == 0) {
+                ReadStatus = BackendRead(&Backend, Read.m_Bus, Read.m_Device, Read.m_Function, Read.m_Offset, Target, Read.m_Size);
+            }
+            else if (Mode == 3) {
+                ReadStatus = Cache.Queue(Read.m_Bus, Read.m_Device, Read.m_Function, Read.m_Offset, Target, Read.m_Size);
+                if (ReadStatus == Success && ++Queued == QueueDepth) {
+                    ReadStatus = Cache.Flush();
+                    Queued = 0;
+                }
+            }
+            else {
+                ReadStatus = Cache.Read(Read.m_Bus, Read.m_Device, Read.m_Function, Read.m_Offset, Target, Read.m_Size);
+            }
+            if (ReadStatus != Success && ReplayStatus == Success) {
+                ReplayStatus = ReadStatus;
+            }
+            Position += Read.m_Size;
+        }
+        if (Mode == 3 && Cache.Flush() != Success && ReplayStatus == Success) {
+            ReplayStatus = Failure;
+        }
+        Elapsed = BenchNow() - Begin;
+        SimFabricGetCounters(&Counters);
+
+        Same = (Mode == 0) || memcmp(Reference.data(), Data.data(), Data.size()) == 0;
+        printf("%-16s%10.3f%11llu%12llu%10llu%10llu%10llu%10s\n", ModeNames[Mode], Elapsed * 1e3, (unsigned long long)Backend.m_Transfers,
+               (unsigned long long)Backend.m_Bytes, (unsigned long long)((Mode == 0) ? 0 : Cache.GetStatistics().m_Hits),
+               (unsigned long long)Counters.ConfigReads, (unsigned long long)Counters.MmioReads, Same ? "same" : "DIFFERENT");
+        if (ReplayStatus != Success || !Same || Backend.m_Crossing != 0) {
+            printf("  status 0x%x, %llu transfers across 0x100\n", ReplayStatus, (unsigned long long)Backend.m_Crossing);
+            Passed = FALSE;
+        }
+        if (Mode != 0) {
+            memset(Data.data(), 0, Data.size());
+        }
+    }
+
+    //
+    // A read across 0x100 is fetched as one standard and one extended line.
+    //
+    {
+        BenchBackend Backend = { &CHWLib, 0, 0, 0 };
+        CConfigCache Cache(BackendRead, &Backend);
+        UINT8 Boundary[0x20];
+        UINT8 Bus, Device;
+
+        BenchLocate(0, &Bus, &Device);
+        if (Cache.Read(Bus, Device, 0, 0xF0, Boundary, sizeof(Boundary)) != Success || Backend.m_Transfers != 2 ||
+            Backend.m_Bytes != 2 * CONFIG_CACHE_LINE || Backend.m_Crossing != 0 ||
+            memcmp(Boundary, SimFabricGetConfig(Bus, Device, 0) + 0xF0, sizeof(Boundary)) != 0) {
+            printf("Read of 0x20 bytes at 0xF0: %llu transfers of %llu bytes, %llu across 0x100\n", (unsigned long long)Backend.m_Transfers,
+                   (unsigned long long)Backend.m_Bytes, (unsigned long long)Backend.m_Crossing);
+            Passed = FALSE;
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+/*++
+
+Module Name:
+
+    HWDeviceRegistryBench.cpp
+
+Abstract:
+
+    Times CDeviceRegistry against one record per function with its own
+    name string, as the App kept its functions before the registry.
+
+    Both hold the same functions, whose names come from a few dozen device
+    models. The bench fills both, counts the bridges by class code, finds
+    every function by BDF and hands the functions to a dump the way the
+    App does: the records by value, as the dump functions took them, and
+    the registry by const reference. It prints the time of each and the
+    memory both hold. The registry must keep the index of a function that
+    is added again, not find absent BDFs, share the name of a model and
+    keep its contents when moved.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "DeviceRegistry.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     4096
+#define BENCH_DEFAULT_PASSES        50
+#define BENCH_MODELS                32
+#define BENCH_CLASS_BRIDGE          0x06
+
+typedef struct
+{
+    std::string DeviceName;
+    UINT8 Bus;
+    UINT8 Device;
+    UINT8 Function;
+    UINT16 VendorId;
+    UINT16 DeviceId;
+    UINT32 ClassCode;
+}BenchRecord;
+
+static UINT32 ClassOf(ULONG Model)
+{
+    static const UINT32 Classes[] = { 0x060400, 0x020000, 0x010802, 0x030000, 0x0C0330, 0x060000, 0x088000, 0x040300 };
+
+    return Classes[Model % (sizeof(Classes) / sizeof(Classes[0]))];
+}
+
+static std::string NameOf(ULONG Model)
+{
+    char Name[96];
+
+    snprintf(Name, sizeof(Name), "Vendor %u Corporation Controller Family %u [Model %04x]", Model % 5, Model / 5, 0x1000 + Model);
+    return Name;
+}
+
+//
+// Stands in for the dump functions, which only read the location of each
+// function.
+//
+static UINT64 DumpRecords(std::vector<BenchRecord> Records)
+{
+    UINT64 Sum = 0;
+
+    for (auto& Record : Records)
+    {
+        Sum += Record.Bus + Record.Device + Record.Function;
+    }
+    return Sum;
+}
+
+static UINT64 DumpRegistry(const CDeviceRegistry& Registry)
+{
+    UINT64 Sum = 0;
+
+    for (UINT32 i = 0; i < Registry.GetCount(); i++)
+    {
+        Sum += Registry.GetBus(i) + Registry.GetDevice(i) + Registry.GetFunction(i);
+    }
+    return Sum;
+}
+
+static SIZE_T RecordMemory(const std::vector<BenchRecord>& Records)
+{
+    SIZE_T Usage = Records.capacity() * sizeof(BenchRecord);
+
+    for (auto& Record : Records)
+    {
+        if (Record.DeviceName.capacity() > std::string().capacity()) {
+            Usage += Record.DeviceName.capacity() + 1;
+        }
+    }
+    return Usage;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWDeviceRegistryBench [-functions <Count>] [-passes <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* StepNames[] = { "fill", "bridges by class", "find by BDF", "pass to dump" };
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    std::vector<std::string> Names;
+    std::vector<BenchRecord> Records;
+    CDeviceRegistry Registry;
+    UINT64 Results[2][4] = { { 0 } };
+    double Times[2][4] = { { 0 } };
+    BOOLEAN Passed = TRUE;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > DEVICE_REGISTRY_BDF_COUNT || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    for (ULONG m = 0; m < BENCH_MODELS; m++)
+    {
+        Names.push_back(NameOf(m));
+    }
+
+    //
+    // Mode 0 runs on the records, mode 1 on the registry. Every pass
+    // starts from empty storage, as enumeration does.
+    //
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            double Begin = BenchNow();
+
+            if (Mode == 0) {
+                Records.clear();
+                Records.shrink_to_fit();
+            }
+            else {
+                Registry = CDeviceRegistry();
+            }
+            for (ULONG i = 0; i < Functions; i++)
+            {
+                ULONG Model = (i * 7) % BENCH_MODELS;
+                UINT8 Bus, Device, Function;
+
+                BenchLocateFunction(i, &Bus, &Device, &Function);
+                if (Mode == 0) {
+                    Records.push_back({ Names[Model], Bus, Device, Function, (UINT16)(0x8000 + Model % 5), (UINT16)(0x1000 + Model), ClassOf(Model) });
+                }
+                else {
+                    Registry.Add(Bus, Device, Function, (UINT16)(0x8000 + Model % 5), (UINT16)(0x1000 + Model), ClassOf(Model), Names[Model]);
+                }
+            }
+            Times[Mode][0] += BenchNow() - Begin;
+            Results[Mode][0] = (Mode == 0) ? Records.size() : Registry.GetCount();
+
+            Begin = BenchNow();
+            Results[Mode][1] = 0;
+            if (Mode == 0) {
+                for (auto& Record : Records)
+                {
+                    Results[Mode][1] += ((Record.ClassCode >> 16) == BENCH_CLASS_BRIDGE);
+                }
+            }
+            else {
+                for (UINT32 i = 0; i < Registry.GetCount(); i++)
+                {
+                    Results[Mode][1] += ((Registry.GetClassCode(i) >> 16) == BENCH_CLASS_BRIDGE);
+                }
+            }
+            Times[Mode][1] += BenchNow() - Begin;
+
+            //
+            // The records have no lookup, they are searched.
+            //
+            Begin = BenchNow();
+            Results[Mode][2] = 0;
+            for (ULONG i = 0; i < Functions; i++)
+            {
+                UINT8 Bus, Device, Function;
+                UINT32 Index;
+
+                BenchLocateFunction(i, &Bus, &Device, &Function);
+                if (Mode == 0) {
+                    auto Found = std::find_if(Records.begin(), Records.end(), [&](const BenchRecord& Record) {
+                        return Record.Bus == Bus && Record.Device == Device && Record.Function == Function;
+                    });
+                    Index = (Found != Records.end()) ? (UINT32)(Found - Records.begin()) : DEVICE_REGISTRY_INVALID_INDEX;
+                }
+                else {
+                    Index = Registry.Find(Bus, Device, Function);
+                }
+                Results[Mode][2] += (Index == i);
+            }
+            Times[Mode][2] += BenchNow() - Begin;
+
+            Begin = BenchNow();
+            Results[Mode][3] = (Mode == 0) ? DumpRecords(Records) : DumpRegistry(Registry);
+            Times[Mode][3] += BenchNow() - Begin;
+        }
+    }
+
+    printf("%u functions of %u models, %u passes\n", Functions, BENCH_MODELS, Passes);
+    printf("%-18s%14s%14s%10s\n", "Step", "Records ms", "Registry ms", "Speedup");
+    for (ULONG Step = 0; Step < sizeof(StepNames) / sizeof(StepNames[0]); Step++)
+    {
+        printf("%-18s%14.3f%14.3f%9.1fx\n", StepNames[Step], Times[0][Step] * 1e3, Times[1][Step] * 1e3,
+               (Times[1][Step] > 0) ? Times[0][Step] / Times[1][Step] : 0.0);
+    }
+    printf("Memory: records %zu bytes, registry %zu bytes\n", RecordMemory(Records), Registry.GetMemoryUsage());
+
+    if (Results[0][0] != Functions || Results[1][0] != Functions || Results[0][1] != Results[1][1] ||
+        Results[0][2] != Functions || Results[1][2] != Functions || Results[0][3] != Results[1][3]) {
+        printf("Records and registry disagree\n");
+        Passed = FALSE;
+    }
+
+    {
+        UINT32 Index = Registry.Add(0, 0, 1, 0x1234, 0x5678, 0x0C0500, Names[0]);
+        CDeviceRegistry Moved(std::move(Registry));
+
+        if (Functions > 1 && (Index != 1 || Moved.GetCount() != Functions || Moved.GetVendorId(1) != 0x1234 ||
+                              Moved.GetClassCode(1) != 0x0C0500 || strcmp(Moved.GetName(1), Names[0].c_str()) != 0)) {
+            printf("Adding 00:00.1 again moved it to index %u\n", Index);
+            Passed = FALSE;
+        }
+        if (Functions < DEVICE_REGISTRY_BDF_COUNT && Moved.Find(0xFF, 0x1F, 7) != DEVICE_REGISTRY_INVALID_INDEX) {
+            printf("ff:1f.7 was found\n");
+            Passed = FALSE;
+        }
+        if (Functions > BENCH_MODELS && Moved.GetName(2) != Moved.GetName(2 + BENCH_MODELS)) {
+            printf("Functions of one model do not share their name\n");
+            Passed = FALSE;
+        }
+        Moved.Clear();
+        if (Moved.GetCount() != 0 || Moved.Find(0, 0, 0) != DEVICE_REGISTRY_INVALID_INDEX) {
+            printf("Clear left %u functions\n", Moved.GetCount());
+            Passed = FALSE;
+        }
+    }
+
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,332 @@
+/*++
+
+Module Name:
+
+    HWHealthScannerBench.cpp
+
+Abstract:
+
+    Times CHealthScanner passes against reading the 4 KB configuration
+    space of every function on each pass.
+
+    The endpoints have a PCI Express capability, three of four also AER,
+    and a few start with a degraded link or AER status set. Before every
+    pass after the first one function changes, an AER correctable status
+    bit where there is AER, else the link speed. Each pass reads every
+    function whole and compares the link and AER values with the previous
+    pass, then runs a scanner pass. The bench prints the setup time, the
+    time and the bytes of the passes. The first scanner pass must report
+    every degraded link and set status, every later pass exactly the
+    change made and the full reads the same number, and an unreachable
+    function must be reported when it goes and when it comes back.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "HealthScanner.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     500
+#define BENCH_DEFAULT_PASSES        20
+#define BENCH_DEFAULT_CONFIG_NS     2000
+#define BENCH_DEFAULT_MMIO_NS       50
+#define BENCH_PCIE_OFFSET           0x50
+#define BENCH_AER_OFFSET            0x100
+#define BENCH_MAX_SPEED             4
+#define BENCH_MAX_WIDTH             16
+
+//
+// Link and AER values of a function as a full read sees them.
+//
+typedef struct
+{
+    UINT16 m_LinkStatus;
+    UINT32 m_Uncorrectable;
+    UINT32 m_Correctable;
+}BenchHealth;
+
+static BOOLEAN HasAer(ULONG Index)
+{
+    return (Index % 4) != 3;
+}
+
+static PUINT8 ConfigOf(ULONG Index)
+{
+    UINT8 Bus, Device;
+
+    BenchLocate(Index, &Bus, &Device);
+    return SimFabricGetConfig(Bus, Device, 0);
+}
+
+static VOID SetLink(ULONG Index, UINT16 LinkStatus)
+{
+    memcpy(ConfigOf(Index) + BENCH_PCIE_OFFSET + PcieLinkStatus::Offset, &LinkStatus, sizeof(LinkStatus));
+}
+
+static UINT16 GetLink(ULONG Index)
+{
+    UINT16 LinkStatus;
+
+    memcpy(&LinkStatus, ConfigOf(Index) + BENCH_PCIE_OFFSET + PcieLinkStatus::Offset, sizeof(LinkStatus));
+    return LinkStatus;
+}
+
+//
+// The host bridge and Functions endpoints at the maximum link, except
+// every 50th at half width, and with the first correctable status bit set
+// on every 40th.
+//
+static NTSTATUS BuildFabric(ULONG Functions)
+{
+    UINT32 LinkCapabilities = BENCH_MAX_SPEED | (BENCH_MAX_WIDTH << 4);
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (ULONG i = 0; i < Functions && NT_SUCCESS(Status); i++)
+    {
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        Status = SimFabricAddFunction(Bus, Device, 0, BENCH_VENDOR_ID, BENCH_DEVICE_ID, 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCI_CAP_ID_PCIe, BENCH_PCIE_OFFSET);
+        }
+        if (NT_SUCCESS(Status) && HasAer(i)) {
+            Status = SimFabricAddCapability(Bus, Device, 0, PCIe_EXT_CAP_ID_AER, BENCH_AER_OFFSET);
+        }
+        if (!NT_SUCCESS(Status)) {
+            break;
+        }
+        memcpy(ConfigOf(i) + BENCH_PCIE_OFFSET + PcieLinkCapabilities::Offset, &LinkCapabilities, sizeof(LinkCapabilities));
+        SetLink(i, (UINT16)(BENCH_MAX_SPEED | (((i % 50) == 1 ? BENCH_MAX_WIDTH / 2 : BENCH_MAX_WIDTH) << 4)));
+        if ((i % 40) == 2) {
+            UINT32 Correctable = 1;
+
+            memcpy(ConfigOf(i) + BENCH_AER_OFFSET + AerCorrectableStatus::Offset, &Correctable, sizeof(Correctable));
+        }
+    }
+    return Status;
+}
+
+//
+// Reads every function whole and returns the number of link and AER
+// values that differ from the previous read.
+//
+static ULONG FullPass(CHardwareInterfaceLib& CHWLib, ULONG Functions, std::vector<UINT8>& Data, std::vector<BenchHealth>& Health, PULONG Failures)
+{
+    ULONG Changes = 0;
+
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        PCI_PCIeCfgData cfgData;
+        BenchHealth Current = { 0, 0, 0 };
+        UINT8 Bus, Device;
+
+        BenchLocate(i, &Bus, &Device);
+        cfgData.m_Bus = Bus;
+        cfgData.m_Device = Device;
+        cfgData.m_Function = 0;
+        cfgData.m_Offset = 0;
+        cfgData.OutputData.m_Size = PCIe_CFG_SIZE;
+        cfgData.OutputData.DataPointer = Data.data();
+        if (CHWLib.PCIeExCfgRead(&cfgData) != Success) {
+            (*Failures)++;
+            continue;
+        }
+        memcpy(&Current.m_LinkStatus, Data.data() + BENCH_PCIE_OFFSET + PcieLinkStatus::Offset, sizeof(Current.m_LinkStatus));
+        if (HasAer(i)) {
+            memcpy(&Current.m_Uncorrectable, Data.data() + BENCH_AER_OFFSET + AerUncorrectableStatus::Offset, sizeof(Current.m_Uncorrectable));
+            memcpy(&Current.m_Correctable, Data.data() + BENCH_AER_OFFSET + AerCorrectableStatus::Offset, sizeof(Current.m_Correctable));
+        }
+        Changes += (PcieCurrentLinkSpeed::Get(Current.m_LinkStatus) != PcieCurrentLinkSpeed::Get(Health[i].m_LinkStatus));
+        Changes += (PcieNegotiatedLinkWidth::Get(Current.m_LinkStatus) != PcieNegotiatedLinkWidth::Get(Health[i].m_LinkStatus));
+        Changes += (Current.m_Uncorrectable != Health[i].m_Uncorrectable);
+        Changes += (Current.m_Correctable != Health[i].m_Correctable);
+        Health[i] = Current;
+    }
+    return Changes;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWHealthScannerBench [-functions <Count>] [-passes <Count>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    SIM_FABRIC_LATENCY Latency = { BENCH_DEFAULT_CONFIG_NS, BENCH_DEFAULT_MMIO_NS, 0 };
+    CHardwareInterfaceLib CHWLib;
+    std::vector<HealthChange> Changes;
+    std::vector<UINT8> Data(PCIe_CFG_SIZE);
+    std::vector<BenchHealth> Health;
+    ULONG Expected = 0;
+    ULONG FullFailures = 0;
+    ULONG WrongPasses = 0;
+    UINT64 FullBytes = 0;
+    double SetupTime = 0;
+    double FullTime = 0;
+    double ScanTime = 0;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 32 * 255 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BuildFabric(Functions);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    {
+        CHealthScanner Scanner(CHWLib);
+        double Begin;
+
+        Begin = BenchNow();
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            UINT8 Bus, Device;
+
+            BenchLocate(i, &Bus, &Device);
+            if (Scanner.AddDevice(Bus, Device, 0) != Success) {
+                printf("%s\n", Scanner.GetStatusMessage().c_str());
+                Passed = FALSE;
+            }
+        }
+        SetupTime = BenchNow() - Begin;
+
+        //
+        // The full reads start from the maximum link and clear status, as
+        // the first scanner pass compares with them.
+        //
+        Health.assign(Functions, { (UINT16)(BENCH_MAX_SPEED | (BENCH_MAX_WIDTH << 4)), 0, 0 });
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            Expected += ((i % 50) == 1) + ((i % 40) == 2);
+        }
+
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            ULONG FullChanges;
+
+            //
+            // One function changes before every pass after the first.
+            //
+            if (Pass > 0) {
+                ULONG Target = (Pass * 37) % Functions;
+
+                if (HasAer(Target)) {
+                    ConfigOf(Target)[BENCH_AER_OFFSET + AerCorrectableStatus::Offset + 1] ^= 0x01;
+                }
+                else {
+                    SetLink(Target, (UINT16)((GetLink(Target) & ~0x0F) | ((PcieCurrentLinkSpeed::Get(GetLink(Target)) == BENCH_MAX_SPEED) ? 3 : BENCH_MAX_SPEED)));
+                }
+                Expected = 1;
+            }
+
+            Begin = BenchNow();
+            FullChanges = FullPass(CHWLib, Functions, Data, Health, &FullFailures);
+            FullTime += BenchNow() - Begin;
+            FullBytes += (UINT64)Functions * PCIe_CFG_SIZE;
+
+            Begin = BenchNow();
+            if (Scanner.Scan(Changes) != Success) {
+                printf("%s\n", Scanner.GetStatusMessage().c_str());
+                Passed = FALSE;
+            }
+            ScanTime += BenchNow() - Begin;
+
+            if (Changes.size() != Expected || FullChanges != Expected) {
+                if (WrongPasses++ == 0) {
+                    printf("Pass %u: %zu scanner and %u full read changes, %u expected\n", Pass, Changes.size(), FullChanges, Expected);
+                }
+            }
+        }
+
+        printf("%u functions, %u passes, latency config %u ns, MMIO %u ns\n", Functions, Passes, Latency.ConfigNs, Latency.MmioNs);
+        printf("Scanner setup: %.3f ms\n", SetupTime * 1e3);
+        printf("%-12s%12s%14s%14s\n", "Pass", "ms", "Bytes", "ms per pass");
+        printf("%-12s%12.3f%14llu%14.3f\n", "full 4 KB", FullTime * 1e3, (unsigned long long)FullBytes, FullTime * 1e3 / Passes);
+        printf("%-12s%12.3f%14llu%14.3f\n", "scanner", ScanTime * 1e3, (unsigned long long)Scanner.GetBytesRead(), ScanTime * 1e3 / Passes);
+        printf("Speedup %.1fx\n", (ScanTime > 0) ? FullTime / ScanTime : 0.0);
+
+        if (FullFailures != 0 || WrongPasses != 0) {
+            printf("%u full reads failed, %u passes reported the wrong changes\n", FullFailures, WrongPasses);
+            Passed = FALSE;
+        }
+
+        //
+        // A function reading all ones is reported when it goes and when it
+        // comes back, and not again after that.
+        //
+        {
+            UINT16 LinkStatus = GetLink(0);
+            BOOLEAN Gone, Back, Quiet;
+
+            SetLink(0, 0xFFFF);
+            Gone = Scanner.Scan(Changes) == Success && Changes.size() == 1 && Changes[0].m_Kind == HealthUnreachable && Changes[0].m_Current == 0xFFFF;
+            SetLink(0, LinkStatus);
+            Back = Scanner.Scan(Changes) == Success && Changes.size() == 1 && Changes[0].m_Kind == HealthUnreachable && Changes[0].m_Previous == 0xFFFF;
+            Quiet = Scanner.Scan(Changes) == Success && Changes.empty();
+            if (!Gone || !Back || !Quiet) {
+                printf("Unreachable function: gone %u, back %u, quiet %u\n", Gone, Back, Quiet);
+                Passed = FALSE;
+            }
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
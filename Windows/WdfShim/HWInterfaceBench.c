@@ -0,0 +1,528 @@
+/*++
+
+Module Name:
+
+    HWInterfaceBench.c
+
+Abstract:
+
+    Benchmark of HardwareInterfaceDrvEvtIoDeviceControl on the WDF shim and
+    the simulated PCI fabric. Loads the driver through its DriverEntry,
+    builds a fabric of functions with one 1 MB BAR each and sends every
+    IOCTL of the driver from several threads, each thread to its own
+    function. Prints the request rate, the time per request and the
+    configuration, register and mapping accesses per request, which stay
+    the same whatever latency the fabric is given, and the bytes the I/O
+    manager copies between the caller and system buffers per request.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "WdfShim.h"
+#include "SimFabric.h"
+#include "Public.h"
+
+#define BENCH_DEFAULT_THREADS       4
+#define BENCH_DEFAULT_ITERATIONS    2000
+#define BENCH_WARMUP_ITERATIONS     4
+#define BENCH_MAX_THREADS           64
+#define BENCH_BUSES                 4
+#define BENCH_DEVICES               8
+#define BENCH_BAR_BASE              0x80000000ULL
+#define BENCH_BAR_SIZE              PCIe_BAR_WINDOW_SIZE
+#define BENCH_VENDOR_ID             0x8086
+#define BENCH_SCRIPT_READS          16
+
+DRIVER_INITIALIZE DriverEntry;
+
+//
+// One request of a case, built per thread so every thread reads its own
+// function.
+//
+typedef struct _BENCH_REQUEST {
+    ULONG IoControlCode;
+    UCHAR Input[sizeof(RegScriptHeader) + 2 * BENCH_SCRIPT_READS * sizeof(RegScriptOp)];
+    ULONG InputLength;
+    PUCHAR Output;
+    ULONG OutputLength;
+    PUCHAR Data;
+} BENCH_REQUEST;
+
+typedef enum _BENCH_KIND {
+    BenchStdCfgRead,
+    BenchMmioRead,
+    BenchStdCfgReadDirect,
+    BenchMmioReadDirect,
+    BenchRegScript,
+    BenchBarRead,
+} BENCH_KIND;
+
+typedef struct _BENCH_CASE {
+    PCSTR Name;
+    BENCH_KIND Kind;
+    ULONG Size;
+} BENCH_CASE;
+
+static const BENCH_CASE BenchCases[] = {
+    { "STD_CFG_READ", BenchStdCfgRead, 4 },
+    { "STD_CFG_READ", BenchStdCfgRead, PCI_CFG_SIZE },
+    { "MMIO_READ", BenchMmioRead, PCIe_CFG_SIZE },
+    { "STD_CFG_READ_DIRECT", BenchStdCfgReadDirect, 4 },
+    { "STD_CFG_READ_DIRECT", BenchStdCfgReadDirect, PCI_CFG_SIZE },
+    { "MMIO_READ_DIRECT", BenchMmioReadDirect, PCIe_CFG_SIZE },
+    { "REG_SCRIPT", BenchRegScript, 2 * BENCH_SCRIPT_READS },
+    { "BAR_READ", BenchBarRead, PCIe_CFG_SIZE },
+    { "BAR_READ", BenchBarRead, BENCH_BAR_SIZE },
+};
+
+typedef struct _BENCH_THREAD {
+    pthread_t Thread;
+    pthread_barrier_t* Ready;
+    pthread_barrier_t* Start;
+    WDFDEVICE Device;
+    const BENCH_CASE* Case;
+    BENCH_REQUEST Request;
+    UINT8 Bus;
+    UINT8 DeviceNumber;
+    ULONG64 BarBase;
+    ULONG Iterations;
+    ULONG Failures;
+    double Begin;
+    double End;
+} BENCH_THREAD;
+
+static double Now(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+//
+// Builds the input of a case. The two buffered reads carry the user address
+// of the data in the request itself, the driver writes through it. Their
+// direct forms and BAR_READ receive the data in the output buffer.
+//
+static VOID BuildRequest(BENCH_THREAD* Thread)
+{
+    BENCH_REQUEST* Request = &Thread->Request;
+    ULONG i;
+
+    memset(Request->Input, 0, sizeof(Request->Input));
+    switch (Thread->Case->Kind)
+    {
+    case BenchStdCfgRead:
+    {
+        PPCI_PCIeCfgData CfgData = (PPCI_PCIeCfgData)Request->Input;
+
+        Request->IoControlCode = IOCTL_PLATFORM_PCI_STD_CFG_READ;
+        CfgData->m_Bus = Thread->Bus;
+        CfgData->m_Device = Thread->DeviceNumber;
+        CfgData->m_Function = 0;
+        CfgData->m_Offset = 0;
+        CfgData->OutputData.m_Size = Thread->Case->Size;
+        CfgData->OutputData.DataPointer = Request->Data;
+        Request->InputLength = sizeof(PCI_PCIeCfgData);
+        Request->OutputLength = sizeof(PCI_PCIeCfgData);
+        break;
+    }
+    case BenchMmioRead:
+    {
+        PPCIeMMIOData MmioData = (PPCIeMMIOData)Request->Input;
+
+        Request->IoControlCode = IOCTL_PLATFORM_PCIe_MMIO_READ;
+        MmioData->m_BaseAddressRegister = Thread->BarBase;
+        MmioData->m_Offset = 0;
+        MmioData->OutputData.m_Size = Thread->Case->Size;
+        MmioData->OutputData.DataPointer = Request->Data;
+        Request->InputLength = sizeof(PCIeMMIOData);
+        Request->OutputLength = sizeof(PCIeMMIOData);
+        break;
+    }
+    case BenchStdCfgReadDirect:
+    {
+        PPCIeCfgReadRequest CfgRequest = (PPCIeCfgReadRequest)Request->Input;
+
+        Request->IoControlCode = IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT;
+        CfgRequest->m_Bus = Thread->Bus;
+        CfgRequest->m_Device = Thread->DeviceNumber;
+        CfgRequest->m_Function = 0;
+        CfgRequest->m_Offset = 0;
+        CfgRequest->m_Length = Thread->Case->Size;
+        Request->InputLength = sizeof(PCIeCfgReadRequest);
+        Request->OutputLength = Thread->Case->Size;
+        break;
+    }
+    case BenchMmioReadDirect:
+    {
+        PPCIeMMIOReadRequest MmioRequest = (PPCIeMMIOReadRequest)Request->Input;
+
+        Request->IoControlCode = IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT;
+        MmioRequest->m_BaseAddressRegister = Thread->BarBase;
+        MmioRequest->m_Offset = 0;
+        MmioRequest->m_Length = Thread->Case->Size;
+        Request->InputLength = sizeof(PCIeMMIOReadRequest);
+        Request->OutputLength = Thread->Case->Size;
+        break;
+    }
+    case BenchRegScript:
+    {
+        PRegScriptHeader Header = (PRegScriptHeader)Request->Input;
+        PRegScriptOp Ops = (PRegScriptOp)(Header + 1);
+
+        Request->IoControlCode = IOCTL_PLATFORM_REG_SCRIPT_EXECUTE;
+        Header->m_Bus = Thread->Bus;
+        Header->m_Device = Thread->DeviceNumber;
+        Header->m_Function = 0;
+        Header->m_MmioBase = Thread->BarBase;
+        Header->m_OpCount = Thread->Case->Size;
+        for (i = 0; i < Thread->Case->Size; i++)
+        {
+            Ops[i].m_OpCode = REG_SCRIPT_OP_READ;
+            Ops[i].m_Space = (i < BENCH_SCRIPT_READS) ? REG_SCRIPT_SPACE_PCI_CFG : REG_SCRIPT_SPACE_MMIO;
+            Ops[i].m_Width = sizeof(UINT32);
+            Ops[i].m_Offset = (i % BENCH_SCRIPT_READS) * sizeof(UINT32);
+        }
+        Request->InputLength = sizeof(RegScriptHeader) + Thread->Case->Size * sizeof(RegScriptOp);
+        Request->OutputLength = sizeof(RegScriptResult) + Thread->Case->Size * sizeof(UINT32);
+        break;
+    }
+    default:
+    {
+        PPCIeBarReadRequest BarRequest = (PPCIeBarReadRequest)Request->Input;
+
+        Request->IoControlCode = IOCTL_PLATFORM_PCIe_BAR_READ;
+        BarRequest->m_BaseAddressRegister = Thread->BarBase;
+        BarRequest->m_Offset = 0;
+        BarRequest->m_Length = Thread->Case->Size;
+        Request->InputLength = sizeof(PCIeBarReadRequest);
+        Request->OutputLength = Thread->Case->Size;
+        break;
+    }
+    }
+}
+
+//
+// Sends the request and checks what came back against the fabric: the
+// vendor id of a configuration read, the BAR pattern of an MMIO read.
+//
+static BOOLEAN SendRequest(BENCH_THREAD* Thread)
+{
+    BENCH_REQUEST* Request = &Thread->Request;
+    BOOLEAN Buffered = (Thread->Case->Kind == BenchStdCfgRead || Thread->Case->Kind == BenchMmioRead);
+    PUCHAR Data = Buffered ? Request->Data : Request->Output;
+    ULONG BytesReturned = 0;
+    NTSTATUS Status;
+    ULONG Dword = 0;
+
+    //
+    // Buffered requests get a system buffer copy of the input, so the data
+    // pointer the driver advances on MMIO_READ never reaches Input.
+    //
+    Status = ShimDeviceIoControl(Thread->Device, Request->IoControlCode, Request->Input, Request->InputLength,
+                                 Request->Output, Request->OutputLength, &BytesReturned);
+    if (!NT_SUCCESS(Status) || BytesReturned != Request->OutputLength) {
+        return FALSE;
+    }
+
+    switch (Thread->Case->Kind)
+    {
+    case BenchStdCfgRead:
+        return ((PPCI_PCIeCfgData)Request->Output)->OutputData.m_Size == Thread->Case->Size &&
+               Data[0] == (UCHAR)BENCH_VENDOR_ID && Data[1] == (UCHAR)(BENCH_VENDOR_ID >> 8);
+    case BenchStdCfgReadDirect:
+        return Data[0] == (UCHAR)BENCH_VENDOR_ID && Data[1] == (UCHAR)(BENCH_VENDOR_ID >> 8);
+    case BenchRegScript:
+        return ((PRegScriptResult)Request->Output)->m_Status == REG_SCRIPT_STATUS_SUCCESS &&
+               ((PULONG)(Request->Output + sizeof(RegScriptResult)))[0] == (BENCH_VENDOR_ID | (0x1234 << 16));
+    default:
+        memcpy(&Dword, Data + Thread->Case->Size - sizeof(ULONG), sizeof(Dword));
+        return Dword == (Thread->Case->Size / sizeof(ULONG) - 1);
+    }
+}
+
+static PVOID BenchThread(PVOID Parameter)
+{
+    BENCH_THREAD* Thread = (BENCH_THREAD*)Parameter;
+    ULONG i;
+
+    BuildRequest(Thread);
+    for (i = 0; i < BENCH_WARMUP_ITERATIONS; i++)
+    {
+        Thread->Failures += !SendRequest(Thread);
+    }
+
+    pthread_barrier_wait(Thread->Ready);
+    pthread_barrier_wait(Thread->Start);
+    Thread->Begin = Now();
+    for (i = 0; i < Thread->Iterations; i++)
+    {
+        Thread->Failures += !SendRequest(Thread);
+    }
+    Thread->End = Now();
+    return NULL;
+}
+
+static double RunCase(BENCH_THREAD* Threads, ULONG ThreadCount, const BENCH_CASE* Case)
+{
+    pthread_barrier_t Ready, Start;
+    double Begin = 0, End = 0;
+    ULONG Failures = 0;
+    ULONG i;
+
+    pthread_barrier_init(&Ready, NULL, ThreadCount + 1);
+    pthread_barrier_init(&Start, NULL, ThreadCount + 1);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[i].Ready = &Ready;
+        Threads[i].Start = &Start;
+        Threads[i].Case = Case;
+        Threads[i].Failures = 0;
+        pthread_create(&Threads[i].Thread, NULL, BenchThread, &Threads[i]);
+    }
+
+    pthread_barrier_wait(&Ready);
+    SimFabricResetCounters();
+    ShimResetStatistics();
+    pthread_barrier_wait(&Start);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        pthread_join(Threads[i].Thread, NULL);
+        Failures += Threads[i].Failures;
+        if (i == 0 || Threads[i].Begin < Begin) {
+            Begin = Threads[i].Begin;
+        }
+        if (i == 0 || Threads[i].End > End) {
+            End = Threads[i].End;
+        }
+    }
+    pthread_barrier_destroy(&Ready);
+    pthread_barrier_destroy(&Start);
+
+    return Failures ? -1.0 : End - Begin;
+}
+
+static NTSTATUS BuildFabric(VOID)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG Bus, Device;
+
+    for (Bus = 0; Bus < BENCH_BUSES && NT_SUCCESS(Status); Bus++)
+    {
+        for (Device = 0; Device < BENCH_DEVICES && NT_SUCCESS(Status); Device++)
+        {
+            Status = SimFabricAddFunction((UINT8)Bus, (UINT8)Device, 0, BENCH_VENDOR_ID, 0x1234, 0x020000);
+            if (NT_SUCCESS(Status)) {
+                Status = SimFabricAddBar((UINT8)Bus, (UINT8)Device, 0, 0,
+                                         BENCH_BAR_BASE + (Bus * BENCH_DEVICES + Device) * (ULONG64)BENCH_BAR_SIZE, BENCH_BAR_SIZE);
+            }
+        }
+    }
+    return Status;
+}
+
+//
+// Scripts that write must be refused on IOCTL_PLATFORM_REG_SCRIPT_EXECUTE
+// and run on IOCTL_PLATFORM_REG_SCRIPT_WRITE.
+//
+static BOOLEAN CheckScriptAccess(WDFDEVICE Device)
+{
+    UCHAR Input[sizeof(RegScriptHeader) + sizeof(RegScriptOp)];
+    UCHAR Output[sizeof(RegScriptResult)];
+    PRegScriptHeader Header = (PRegScriptHeader)Input;
+    PRegScriptOp Op = (PRegScriptOp)(Header + 1);
+    ULONG BytesReturned = 0;
+    NTSTATUS ExecuteStatus;
+    NTSTATUS WriteStatus;
+
+    memset(Input, 0, sizeof(Input));
+    Header->m_OpCount = 1;
+    Op->m_OpCode = REG_SCRIPT_OP_WRITE;
+    Op->m_Space = REG_SCRIPT_SPACE_PCI_CFG;
+    Op->m_Width = sizeof(UINT8);
+    Op->m_Offset = 0x3C;
+    Op->m_Value = 0x0B;
+
+    ExecuteStatus = ShimDeviceIoControl(Device, IOCTL_PLATFORM_REG_SCRIPT_EXECUTE, Input, sizeof(Input), Output, sizeof(Output), &BytesReturned);
+    WriteStatus = ShimDeviceIoControl(Device, IOCTL_PLATFORM_REG_SCRIPT_WRITE, Input, sizeof(Input), Output, sizeof(Output), &BytesReturned);
+    if (ExecuteStatus != STATUS_ACCESS_DENIED || !NT_SUCCESS(WriteStatus) || SimFabricGetConfig(0, 0, 0)[0x3C] != 0x0B) {
+        printf("Writing register script: REG_SCRIPT_EXECUTE status 0x%x, REG_SCRIPT_WRITE status 0x%x\n",
+               (unsigned)ExecuteStatus, (unsigned)WriteStatus);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+// BAR windows that wrap around the physical address space must be refused.
+//
+static BOOLEAN CheckBarReadWrap(WDFDEVICE Device)
+{
+    PCIeBarReadRequest Request;
+    UCHAR Output[PCIe_CFG_SIZE];
+    ULONG BytesReturned = 0;
+    NTSTATUS OffsetStatus;
+    NTSTATUS LengthStatus;
+
+    Request.m_BaseAddressRegister = BENCH_BAR_BASE;
+    Request.m_Offset = ~0ULL - BENCH_BAR_BASE + PCIe_CFG_SIZE;
+    Request.m_Length = sizeof(Output);
+    OffsetStatus = ShimDeviceIoControl(Device, IOCTL_PLATFORM_PCIe_BAR_READ, &Request, sizeof(Request), Output, sizeof(Output), &BytesReturned);
+
+    Request.m_BaseAddressRegister = ~0ULL - PCIe_CFG_SIZE / 2;
+    Request.m_Offset = 0;
+    LengthStatus = ShimDeviceIoControl(Device, IOCTL_PLATFORM_PCIe_BAR_READ, &Request, sizeof(Request), Output, sizeof(Output), &BytesReturned);
+
+    if (OffsetStatus != STATUS_INVALID_PARAMETER || LengthStatus != STATUS_INVALID_PARAMETER) {
+        printf("Wrapping BAR_READ: offset status 0x%x, length status 0x%x\n", (unsigned)OffsetStatus, (unsigned)LengthStatus);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWInterfaceBench [-threads <Count>] [-iterations <Count>] [-config-latency <ns>] [-mmio-latency <ns>] [-map-latency <ns>] [-dispatch <sequential|parallel>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    BENCH_THREAD* Threads = NULL;
+    ULONG ThreadCount = BENCH_DEFAULT_THREADS;
+    ULONG Iterations = BENCH_DEFAULT_ITERATIONS;
+    SIM_FABRIC_LATENCY Latency = { 0, 0, 0 };
+    WDF_IO_QUEUE_DISPATCH_TYPE Dispatch = WdfIoQueueDispatchInvalid;
+    WDFDEVICE Device = NULL;
+    NTSTATUS Status;
+    ULONG c, i;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-threads") == 0 && Arg + 1 < argc) {
+            ThreadCount = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-iterations") == 0 && Arg + 1 < argc) {
+            Iterations = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-map-latency") == 0 && Arg + 1 < argc) {
+            Latency.MapNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-dispatch") == 0 && Arg + 1 < argc) {
+            Arg++;
+            if (strcmp(argv[Arg], "sequential") == 0) {
+                Dispatch = WdfIoQueueDispatchSequential;
+            }
+            else if (strcmp(argv[Arg], "parallel") == 0) {
+                Dispatch = WdfIoQueueDispatchParallel;
+            }
+            else {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (ThreadCount == 0 || ThreadCount > BENCH_MAX_THREADS) {
+        printf("Thread count must be 1 to %u\n", BENCH_MAX_THREADS);
+        return 1;
+    }
+    if (Iterations == 0) {
+        Iterations = 1;
+    }
+
+    Status = BuildFabric();
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    ShimOverrideDispatchType(Dispatch);
+    Status = ShimDriverLoad(DriverEntry, &Device);
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+
+    if (!CheckScriptAccess(Device) || !CheckBarReadWrap(Device)) {
+        return 1;
+    }
+
+    Threads = (BENCH_THREAD*)calloc(ThreadCount, sizeof(BENCH_THREAD));
+    if (Threads == NULL) {
+        printf("Thread allocation failed\n");
+        return 1;
+    }
+    for (i = 0; i < ThreadCount; i++)
+    {
+        ULONG Slot = i % (BENCH_BUSES * BENCH_DEVICES);
+
+        Threads[i].Device = Device;
+        Threads[i].Iterations = Iterations;
+        Threads[i].Bus = (UINT8)(Slot / BENCH_DEVICES);
+        Threads[i].DeviceNumber = (UINT8)(Slot % BENCH_DEVICES);
+        Threads[i].BarBase = BENCH_BAR_BASE + Slot * (ULONG64)BENCH_BAR_SIZE;
+        Threads[i].Request.Output = (PUCHAR)malloc(BENCH_BAR_SIZE);
+        Threads[i].Request.Data = (PUCHAR)malloc(BENCH_BAR_SIZE);
+        if (Threads[i].Request.Output == NULL || Threads[i].Request.Data == NULL) {
+            printf("Buffer allocation failed\n");
+            return 1;
+        }
+    }
+
+    printf("%s queue, %u threads, %u requests per thread, latency config %u ns, MMIO %u ns, map %u ns\n",
+           (Dispatch == WdfIoQueueDispatchParallel) ? "Parallel" : "Sequential", ThreadCount, Iterations,
+           Latency.ConfigNs, Latency.MmioNs, Latency.MapNs);
+    printf("%-21s%9s%12s%10s%10s%10s%10s%10s%10s%10s%11s\n", "IOCTL", "Bytes", "Requests/s", "us/req", "cfg/req", "cfg B/req",
+           "mmio/req", "maps/req", "unmap/req", "leaked", "copy B/req");
+
+    for (c = 0; c < sizeof(BenchCases) / sizeof(BenchCases[0]); c++)
+    {
+        SIM_FABRIC_COUNTERS Counters;
+        SHIM_STATISTICS Statistics;
+        ULONG LiveMappings = SimFabricGetLiveMappings();
+        double Requests = (double)ThreadCount * Iterations;
+        double Seconds = RunCase(Threads, ThreadCount, &BenchCases[c]);
+
+        SimFabricGetCounters(&Counters);
+        ShimGetStatistics(&Statistics);
+        if (Seconds < 0) {
+            printf("%-21s%9u  request failed\n", BenchCases[c].Name, BenchCases[c].Size);
+            continue;
+        }
+        printf("%-21s%9u%12.0f%10.2f%10.1f%10.1f%10.1f%10.2f%10.2f%10u%11.0f\n", BenchCases[c].Name, BenchCases[c].Size,
+               Requests / Seconds, Seconds * 1e6 / Requests, Counters.ConfigReads / Requests, Counters.ConfigReadBytes / Requests,
+               Counters.MmioReads / Requests, Counters.Maps / Requests, Counters.Unmaps / Requests,
+               SimFabricGetLiveMappings() - LiveMappings,
+               (Statistics.BytesCopiedIn + Statistics.BytesCopiedOut) / Requests);
+    }
+
+    ShimDriverUnload();
+    SimFabricReset();
+    for (i = 0; i < ThreadCount; i++)
+    {
+        free(Threads[i].Request.Output);
+        free(Threads[i].Request.Data);
+    }
+    free(Threads);
+    return 0;
+}
@@ -0,0 +1,354 @@
+/*++
+
+Module Name:
+
+    HWPciIdsBench.cpp
+
+Abstract:
+
+    Compiles a pci.ids file into a CPciIds image and times name lookups on
+    the memory mapped image.
+
+    Without -ids a synthetic pci.ids of the size of the published one is
+    written first: vendors with devices and subsystems, comments and a
+    class section the compiler must skip. Subsystem names repeat, so the
+    string pool must hold fewer names than there are entries. Vendor,
+    device and subsystem lookups and GetDeviceName run for every id and an
+    absent one, and the same lookups in a std::unordered_map of the ids
+    written are timed for comparison. With -ids a given pci.ids is
+    compiled and looked up with the ids it holds, without the name checks.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "PciIds.h"
+
+#define BENCH_DEFAULT_VENDORS       2500
+#define BENCH_DEFAULT_PASSES        10
+#define BENCH_DEFAULT_IDS           "HWPciIdsBench.ids"
+#define BENCH_DEFAULT_IMAGE         "HWPciIdsBench.bin"
+#define BENCH_SUBSYSTEM_NAMES       64
+
+typedef struct
+{
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT16 m_SubVendorId;
+    UINT16 m_SubDeviceId;
+}BenchId;
+
+//
+// A lookup with its expected name, and whether device 0xFFFE of the
+// vendor is named.
+//
+typedef struct
+{
+    PciIdsTableKind m_Table;
+    UINT64 m_Key;
+    const char* m_Expected;
+    BOOLEAN m_AbsentNamed;
+}BenchLookup;
+
+typedef struct
+{
+    std::vector<BenchId> m_Ids;
+    std::unordered_map<UINT64, std::string> m_Names[PciIdsTableCount];
+}BenchIds;
+
+static UINT32 Random(PUINT64 State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (UINT32)(*State >> 33);
+}
+
+//
+// Vendor v has an even id, so odd ids are absent. Every vendor has up to
+// 31 devices, every fourth device up to 3 subsystems.
+//
+static BOOLEAN WriteIds(const char* FileName, ULONG Vendors, BenchIds& Ids)
+{
+    FILE* File = fopen(FileName, "w");
+    UINT64 Seed = 1;
+
+    if (File == NULL) {
+        return FALSE;
+    }
+    fprintf(File, "#\n#\tList of PCI ID's, generated by HWPciIdsBench\n#\n\n");
+    fprintf(File, "# Syntax:\n# vendor  vendor_name\n#\tdevice  device_name\n#\t\tsubvendor subdevice  subsystem_name\n\n");
+
+    for (ULONG v = 0; v < Vendors; v++)
+    {
+        UINT16 VendorId = (UINT16)(2 * v + 2);
+        ULONG Devices = Random(&Seed) % 32;
+        char Name[64];
+
+        snprintf(Name, sizeof(Name), "Vendor %u Corporation", v);
+        fprintf(File, "%04x  %s\n", VendorId, Name);
+        Ids.m_Names[PciIdsVendor][VendorId] = Name;
+        Ids.m_Ids.push_back({ VendorId, 0xFFFF, 0xFFFF, 0xFFFF });
+
+        for (ULONG d = 0; d < Devices; d++)
+        {
+            UINT16 DeviceId = (UINT16)(0x1000 + d * 0x11);
+
+            snprintf(Name, sizeof(Name), "Controller %04x [Family %u]", DeviceId, d % 7);
+            fprintf(File, "\t%04x  %s\n", DeviceId, Name);
+            Ids.m_Names[PciIdsDevice][PCI_IDS_DEVICE_KEY(VendorId, DeviceId)] = Name;
+            Ids.m_Ids.push_back({ VendorId, DeviceId, 0xFFFF, 0xFFFF });
+
+            for (ULONG s = 0; d % 4 == 0 && s < 1 + Random(&Seed) % 3; s++)
+            {
+                UINT16 SubVendorId = (UINT16)(2 + 2 * (Random(&Seed) % Vendors));
+                UINT16 SubDeviceId = (UINT16)(Random(&Seed) & 0xFFFF);
+                UINT64 Key = PCI_IDS_SUBSYSTEM_KEY(VendorId, DeviceId, SubVendorId, SubDeviceId);
+
+                if (Ids.m_Names[PciIdsSubsystem].count(Key) != 0) {
+                    continue;
+                }
+                snprintf(Name, sizeof(Name), "Adapter %u", (unsigned)(Random(&Seed) % BENCH_SUBSYSTEM_NAMES));
+                fprintf(File, "\t\t%04x %04x  %s\n", SubVendorId, SubDeviceId, Name);
+                Ids.m_Names[PciIdsSubsystem][Key] = Name;
+                Ids.m_Ids.push_back({ VendorId, DeviceId, SubVendorId, SubDeviceId });
+            }
+        }
+    }
+
+    //
+    // Class lines would parse as vendor 0 and device lines below them if
+    // the compiler did not skip the section.
+    //
+    fprintf(File, "\n# List of known device classes, subclasses and programming interfaces\n\n");
+    fprintf(File, "C 00  Unclassified device\n\t00  Non-VGA unclassified device\n\t01  VGA compatible unclassified device\n");
+    fprintf(File, "C 02  Network controller\n\t00  Ethernet controller\n\t80  Network controller\n");
+    fprintf(File, "C 0c  Serial bus controller\n\t03  USB controller\n\t\t30  XHCI\n");
+    return fclose(File) == 0;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWPciIdsBench [-vendors <Count>] [-passes <Count>] [-ids <pci.ids>] [-image <File>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "CPciIds", "unordered_map" };
+    ULONG Vendors = BENCH_DEFAULT_VENDORS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    const char* IdsName = NULL;
+    const char* ImageName = BENCH_DEFAULT_IMAGE;
+    CPciIdsCompiler Compiler;
+    CPciIds PciIds;
+    BenchIds Ids;
+    std::vector<BenchLookup> Lookups;
+    std::string Name;
+    UINT64 NameBytes = 0;
+    BOOLEAN Passed = TRUE;
+    double Begin;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-vendors") == 0 && Arg + 1 < argc) {
+            Vendors = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-ids") == 0 && Arg + 1 < argc) {
+            IdsName = argv[++Arg];
+        }
+        else if (strcmp(argv[Arg], "-image") == 0 && Arg + 1 < argc) {
+            ImageName = argv[++Arg];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Vendors == 0 || Vendors > 0x7FFF || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (IdsName == NULL) {
+        IdsName = BENCH_DEFAULT_IDS;
+        if (!WriteIds(IdsName, Vendors, Ids)) {
+            printf("Unable to write %s\n", IdsName);
+            return 1;
+        }
+    }
+
+    Begin = BenchNow();
+    if (Compiler.AddFile(IdsName) != Success || Compiler.Write(ImageName) != Success) {
+        printf("Compile: %s\n", Compiler.GetStatusMessage().c_str());
+        return 1;
+    }
+    printf("%u vendors, %u devices, %u subsystems compiled in %.1f ms\n", Compiler.GetCount(PciIdsVendor), Compiler.GetCount(PciIdsDevice),
+           Compiler.GetCount(PciIdsSubsystem), (BenchNow() - Begin) * 1e3);
+
+    Begin = BenchNow();
+    if (PciIds.Open(ImageName) != Success) {
+        printf("Open: %s\n", PciIds.GetStatusMessage().c_str());
+        return 1;
+    }
+    printf("Opened in %.3f ms, image %llu bytes, names %u bytes\n", (BenchNow() - Begin) * 1e3, (unsigned long long)PciIds.GetHeader().m_Size,
+           PciIds.GetHeader().m_StringSize);
+
+    //
+    // A given pci.ids is looked up with its own ids, taken back from the
+    // image.
+    //
+    if (Ids.m_Ids.empty()) {
+        const UINT8* View = NULL;
+        FILE* File = fopen(ImageName, "rb");
+        std::vector<UINT8> Image((size_t)PciIds.GetHeader().m_Size);
+
+        if (File == NULL) {
+            printf("Unable to open %s\n", ImageName);
+            return 1;
+        }
+        if (fread(Image.data(), 1, Image.size(), File) != Image.size()) {
+            printf("Unable to read %s\n", ImageName);
+            fclose(File);
+            return 1;
+        }
+        fclose(File);
+        View = Image.data();
+        for (ULONG t = 0; t < PciIdsTableCount; t++)
+        {
+            const PciIdsTable& Table = PciIds.GetHeader().m_Tables[t];
+            const PciIdsEntry* Entries = (const PciIdsEntry*)(View + Table.m_EntryOffset);
+
+            for (UINT32 e = 0; e < Table.m_Count; e++)
+            {
+                UINT64 Key = Entries[e].m_Key;
+                BenchId Id = { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF };
+
+                if (t == PciIdsVendor) {
+                    Id.m_VendorId = (UINT16)Key;
+                }
+                else if (t == PciIdsDevice) {
+                    Id.m_VendorId = (UINT16)(Key >> 16);
+                    Id.m_DeviceId = (UINT16)Key;
+                }
+                else {
+                    Id = { (UINT16)(Key >> 48), (UINT16)(Key >> 32), (UINT16)(Key >> 16), (UINT16)Key };
+                }
+                Ids.m_Ids.push_back(Id);
+                Ids.m_Names[t][(t == PciIdsVendor) ? Key & 0xFFFF : Key] = (const char*)View + PciIds.GetHeader().m_StringOffset + Entries[e].m_Name;
+            }
+        }
+    }
+    else {
+        if (Compiler.GetCount(PciIdsVendor) != Ids.m_Names[PciIdsVendor].size() ||
+            Compiler.GetCount(PciIdsDevice) != Ids.m_Names[PciIdsDevice].size() ||
+            Compiler.GetCount(PciIdsSubsystem) != Ids.m_Names[PciIdsSubsystem].size()) {
+            printf("The compiler parsed ids of the class section\n");
+            Passed = FALSE;
+        }
+        for (ULONG t = 0; t < PciIdsTableCount; t++)
+        {
+            for (auto& Each : Ids.m_Names[t])
+            {
+                NameBytes += Each.second.size() + 1;
+            }
+        }
+        if (PciIds.GetHeader().m_StringSize >= NameBytes) {
+            printf("Names take %u bytes, %llu bytes without sharing\n", PciIds.GetHeader().m_StringSize, (unsigned long long)NameBytes);
+            Passed = FALSE;
+        }
+    }
+
+    for (auto& Id : Ids.m_Ids)
+    {
+        BenchLookup Lookup;
+
+        Lookup.m_Table = (Id.m_DeviceId == 0xFFFF) ? PciIdsVendor : (Id.m_SubVendorId == 0xFFFF) ? PciIdsDevice : PciIdsSubsystem;
+        Lookup.m_Key = (Lookup.m_Table == PciIdsVendor) ? Id.m_VendorId : (Lookup.m_Table == PciIdsDevice) ? PCI_IDS_DEVICE_KEY(Id.m_VendorId, Id.m_DeviceId)
+            : PCI_IDS_SUBSYSTEM_KEY(Id.m_VendorId, Id.m_DeviceId, Id.m_SubVendorId, Id.m_SubDeviceId);
+        Lookup.m_Expected = Ids.m_Names[Lookup.m_Table][Lookup.m_Key].c_str();
+        Lookup.m_AbsentNamed = Ids.m_Names[PciIdsDevice].count(PCI_IDS_DEVICE_KEY(Id.m_VendorId, 0xFFFE)) != 0;
+        Lookups.push_back(Lookup);
+    }
+
+    printf("%-16s%12s%10s%12s%10s\n", "Lookup", "Lookups", "ms", "ns/lookup", "Wrong");
+
+    for (ULONG Mode = 0; Mode < sizeof(ModeNames) / sizeof(ModeNames[0]); Mode++)
+    {
+        UINT64 Count = 0;
+        ULONG Wrong = 0;
+        double Elapsed;
+
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            for (size_t i = 0; i < Lookups.size(); i++)
+            {
+                const BenchId& Id = Ids.m_Ids[i];
+                const BenchLookup& Lookup = Lookups[i];
+                const char* Found = NULL;
+                const char* Absent = NULL;
+
+                if (Mode == 0) {
+                    Found = (Lookup.m_Table == PciIdsVendor) ? PciIds.FindVendor(Id.m_VendorId) :
+                            (Lookup.m_Table == PciIdsDevice) ? PciIds.FindDevice(Id.m_VendorId, Id.m_DeviceId) :
+                            PciIds.FindSubsystem(Id.m_VendorId, Id.m_DeviceId, Id.m_SubVendorId, Id.m_SubDeviceId);
+                    Absent = PciIds.FindDevice(Id.m_VendorId, 0xFFFE);
+                }
+                else {
+                    auto Each = Ids.m_Names[Lookup.m_Table].find(Lookup.m_Key);
+                    auto None = Ids.m_Names[PciIdsDevice].find(PCI_IDS_DEVICE_KEY(Id.m_VendorId, 0xFFFE));
+
+                    Found = (Each != Ids.m_Names[Lookup.m_Table].end()) ? Each->second.c_str() : NULL;
+                    Absent = (None != Ids.m_Names[PciIdsDevice].end()) ? None->second.c_str() : NULL;
+                }
+                Wrong += (Found == NULL || strcmp(Found, Lookup.m_Expected) != 0 || (Absent != NULL) != (Lookup.m_AbsentNamed != FALSE));
+                Count += 2;
+            }
+        }
+        Elapsed = BenchNow() - Begin;
+        printf("%-16s%12llu%10.3f%12.1f%10u\n", ModeNames[Mode], (unsigned long long)Count, Elapsed * 1e3, Elapsed * 1e9 / Count, Wrong);
+        Passed = Passed && (Wrong == 0);
+    }
+
+    //
+    // A name is built from the parts found, and a vendor that is not in
+    // the image leaves it unchanged.
+    //
+    for (auto& Id : Ids.m_Ids)
+    {
+        std::string Expected;
+
+        if (Id.m_SubVendorId == 0xFFFF || Ids.m_Names[PciIdsVendor].count(Id.m_VendorId) == 0 ||
+            Ids.m_Names[PciIdsDevice].count(PCI_IDS_DEVICE_KEY(Id.m_VendorId, Id.m_DeviceId)) == 0) {
+            continue;
+        }
+        Expected = Ids.m_Names[PciIdsVendor][Id.m_VendorId] + " " + Ids.m_Names[PciIdsDevice][PCI_IDS_DEVICE_KEY(Id.m_VendorId, Id.m_DeviceId)] +
+            " (" + Ids.m_Names[PciIdsSubsystem][PCI_IDS_SUBSYSTEM_KEY(Id.m_VendorId, Id.m_DeviceId, Id.m_SubVendorId, Id.m_SubDeviceId)] + ")";
+        if (!PciIds.GetDeviceName(Id.m_VendorId, Id.m_DeviceId, Id.m_SubVendorId, Id.m_SubDeviceId, Name) || Name != Expected) {
+            printf("GetDeviceName: \"%s\", expected \"%s\"\n", Name.c_str(), Expected.c_str());
+            Passed = FALSE;
+        }
+        break;
+    }
+    Name = "unchanged";
+    if (Ids.m_Names[PciIdsVendor].count(0xFFFF) == 0 && (PciIds.GetDeviceName(0xFFFF, 0, 0, 0, Name) || Name != "unchanged")) {
+        printf("GetDeviceName named vendor 0xffff \"%s\"\n", Name.c_str());
+        Passed = FALSE;
+    }
+
+    PciIds.Close();
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
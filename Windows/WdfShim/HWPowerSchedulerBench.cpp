@@ -0,0 +1,342 @@
+/*++
+
+Module Name:
+
+    HWPowerSchedulerBench.cpp
+
+Abstract:
+
+    Times a 4 KB capture of a fabric with functions in D3 without
+    CPowerScheduler and with it skipping or deferring them.
+
+    Downstream ports on bus 0 each lead to a bus of endpoints. The link of
+    the last port is down, its endpoints are in D3Cold, and every fifth
+    endpoint elsewhere is in D3Hot. Reads go through a backend that models
+    the cost of D3: a function below the down link reads all ones, and an
+    extended read of a function in D3 fails after a completion timeout.
+    The capture runs in the order of the App dump: every function, or the
+    schedule of the policy with deferred functions classified again at
+    the end, by which time one of them has returned to D0. The bench
+    prints the time of classifying and capturing and the outcomes. The
+    states must be classified as built, functions below the down link
+    must not be read to classify them, and only the capture without a
+    scheduler may fail.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "PowerScheduler.h"
+
+#define BENCH_DEFAULT_PORTS         8
+#define BENCH_DEFAULT_ENDPOINTS     8
+#define BENCH_DEFAULT_TIMEOUT_US    200
+#define BENCH_PM_OFFSET             0x40
+#define BENCH_PCIE_OFFSET           0x50
+#define BENCH_PORT_DEVICE_ID        0x2030
+
+typedef struct
+{
+    UINT8 m_Bus;
+    UINT8 m_Device;
+    DevicePowerState m_State;
+}BenchFunction;
+
+//
+// Backend of the scheduler and the capture, counts the reads that reach a
+// function below the down link and the completion timeouts.
+//
+typedef struct
+{
+    CHardwareInterfaceLib* m_CHWLib;
+    UINT8 m_DownBus;
+    ULONG m_TimeoutUs;
+    UINT64 m_DownReads;
+    UINT64 m_Timeouts;
+}BenchBackend;
+
+static VOID Spin(ULONG Microseconds)
+{
+    double End = BenchNow() + Microseconds * 1e-6;
+
+    while (BenchNow() < End)
+    {
+    }
+}
+
+static UserStatus BackendRead(PVOID Context, UINT8 Bus, UINT8 Device, UINT8 Function, UINT32 Offset, PUINT8 Data, UINT32 Size)
+{
+    BenchBackend* Backend = (BenchBackend*)Context;
+    PmControlStatus::ValueType ControlStatus = 0;
+    BOOLEAN Extended = (Offset + Size > PCI_CFG_SIZE);
+
+    if (Bus == Backend->m_DownBus) {
+        Backend->m_DownReads++;
+        if (Extended) {
+            Backend->m_Timeouts++;
+            Spin(Backend->m_TimeoutUs);
+            return Failure;
+        }
+        memset(Data, 0xFF, Size);
+        return Success;
+    }
+    if (Bus != 0 && Extended) {
+        memcpy(&ControlStatus, SimFabricGetConfig(Bus, Device, Function) + BENCH_PM_OFFSET + PmControlStatus::Offset, sizeof(ControlStatus));
+        if (PmPowerState::Get(ControlStatus) == PowerD3Hot) {
+            Backend->m_Timeouts++;
+            Spin(Backend->m_TimeoutUs);
+            return Failure;
+        }
+    }
+    return CCapabilityWalker::LibRead(Backend->m_CHWLib, Bus, Device, Function, Offset, Data, Size);
+}
+
+static VOID SetPowerState(const BenchFunction& Function, UINT16 State)
+{
+    memcpy(SimFabricGetConfig(Function.m_Bus, Function.m_Device, 0) + BENCH_PM_OFFSET + PmControlStatus::Offset, &State, sizeof(State));
+}
+
+//
+// The host bridge and Ports downstream ports at 00:01.0 on, port p
+// leading to bus p with Endpoints endpoints. Ports report Data Link Layer
+// Link Active, the last one has its link down.
+//
+static NTSTATUS BuildFabric(ULONG Ports, ULONG Endpoints, std::vector<BenchFunction>& Functions)
+{
+    UINT32 LinkCapabilities = 1 << 20;
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    for (ULONG p = 1; p <= Ports && NT_SUCCESS(Status); p++)
+    {
+        UINT16 LinkStatus = (p == Ports) ? 0 : (1 << 13);
+        PUINT8 Config;
+
+        Status = SimFabricAddFunction(0, (UINT8)p, 0, BENCH_VENDOR_ID, BENCH_PORT_DEVICE_ID, 0x060400);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(0, (UINT8)p, 0, PCI_CAP_ID_PCIe, BENCH_PCIE_OFFSET);
+        }
+        if (!NT_SUCCESS(Status)) {
+            break;
+        }
+        Config = SimFabricGetConfig(0, (UINT8)p, 0);
+        Config[PciHeaderType::Offset] = 0x01;
+        Config[BridgeSecondaryBus::Offset] = (UINT8)p;
+        Config[BridgeSubordinateBus::Offset] = (UINT8)p;
+        memcpy(Config + BENCH_PCIE_OFFSET + PcieLinkCapabilities::Offset, &LinkCapabilities, sizeof(LinkCapabilities));
+        memcpy(Config + BENCH_PCIE_OFFSET + PcieLinkStatus::Offset, &LinkStatus, sizeof(LinkStatus));
+        Functions.push_back({ 0, (UINT8)p, PowerUnknown });
+
+        for (ULONG e = 0; e < Endpoints && NT_SUCCESS(Status); e++)
+        {
+            BenchFunction Function = { (UINT8)p, (UINT8)e, PowerD0 };
+
+            Status = SimFabricAddFunction(Function.m_Bus, Function.m_Device, 0, BENCH_VENDOR_ID, BENCH_DEVICE_ID, 0x020000);
+            if (NT_SUCCESS(Status)) {
+                Status = SimFabricAddCapability(Function.m_Bus, Function.m_Device, 0, PCI_CAP_ID_PM, BENCH_PM_OFFSET);
+            }
+            if (NT_SUCCESS(Status)) {
+                Status = SimFabricAddCapability(Function.m_Bus, Function.m_Device, 0, PCI_CAP_ID_PCIe, BENCH_PCIE_OFFSET);
+            }
+            if (p == Ports) {
+                Function.m_State = PowerD3Cold;
+            }
+            else if ((Functions.size() % 5) == 0) {
+                Function.m_State = PowerD3Hot;
+            }
+            if (NT_SUCCESS(Status)) {
+                SetPowerState(Function, (Function.m_State == PowerD3Hot) ? PowerD3Hot : PowerD0);
+            }
+            Functions.push_back(Function);
+        }
+    }
+    return Status;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWPowerSchedulerBench [-ports <Count>] [-endpoints <Count>] [-timeout <us>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* ModeNames[] = { "no scheduler", "skip", "defer" };
+    static const PowerPolicy Policies[] = { PowerCaptureAll, PowerSkipLowPower, PowerDeferLowPower };
+    ULONG Ports = BENCH_DEFAULT_PORTS;
+    ULONG Endpoints = BENCH_DEFAULT_ENDPOINTS;
+    std::vector<BenchFunction> Functions;
+    std::vector<UINT8> Data(PCIe_CFG_SIZE);
+    CHardwareInterfaceLib CHWLib;
+    BenchBackend Backend = { &CHWLib, 0, BENCH_DEFAULT_TIMEOUT_US, 0, 0 };
+    ULONG LowPower = 0;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-ports") == 0 && Arg + 1 < argc) {
+            Ports = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-endpoints") == 0 && Arg + 1 < argc) {
+            Endpoints = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-timeout") == 0 && Arg + 1 < argc) {
+            Backend.m_TimeoutUs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Ports < 2 || Ports > 31 || Endpoints == 0 || Endpoints > 32) {
+        PrintUsage();
+        return 1;
+    }
+    Backend.m_DownBus = (UINT8)Ports;
+
+    Status = BuildFabric(Ports, Endpoints, Functions);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    for (auto& Function : Functions)
+    {
+        LowPower += (Function.m_State == PowerD3Hot || Function.m_State == PowerD3Cold);
+    }
+
+    printf("%zu functions behind %u ports, %u in D3, completion timeout %u us\n", Functions.size(), Ports, LowPower, Backend.m_TimeoutUs);
+    printf("%-14s%12s%12s%10s%10s%10s%10s%10s\n", "Capture", "Classify ms", "Capture ms", "Timeouts", "Captured", "Failed", "Skipped", "Deferred");
+
+    for (ULONG Mode = 0; Mode < sizeof(Policies) / sizeof(Policies[0]); Mode++)
+    {
+        CPowerScheduler Scheduler(BackendRead, &Backend);
+        std::vector<UINT32> Order, Deferred;
+        UINT32 Outcomes[CaptureDeferred + 1] = { 0 };
+        UINT32 FirstDeferred;
+        UINT32 Woken = (UINT32)Functions.size();
+        double ClassifyTime = 0;
+        double Begin;
+
+        for (auto& Function : Functions)
+        {
+            Scheduler.AddDevice(Function.m_Bus, Function.m_Device, 0);
+        }
+        Backend.m_DownReads = 0;
+        Backend.m_Timeouts = 0;
+
+        Begin = BenchNow();
+        if (Mode != 0) {
+            if (Scheduler.Classify() != Success) {
+                printf("%s\n", Scheduler.GetStatusMessage().c_str());
+                Passed = FALSE;
+            }
+            ClassifyTime = BenchNow() - Begin;
+            Scheduler.Schedule(Policies[Mode], Order, Deferred);
+
+            for (UINT32 i = 0; i < Functions.size(); i++)
+            {
+                if (Scheduler.GetPowerState(i) != Functions[i].m_State) {
+                    printf("%02x:%02x.0 classified as %u, built as %u\n", Functions[i].m_Bus, Functions[i].m_Device,
+                           Scheduler.GetPowerState(i), Functions[i].m_State);
+                    Passed = FALSE;
+                }
+            }
+            if (Backend.m_DownReads != 0) {
+                printf("Classify read functions below the down link %llu times\n", (unsigned long long)Backend.m_DownReads);
+                Passed = FALSE;
+            }
+        }
+        else {
+            Scheduler.Schedule(PowerCaptureAll, Order, Deferred);
+        }
+        FirstDeferred = (UINT32)Order.size();
+        Order.insert(Order.end(), Deferred.begin(), Deferred.end());
+
+        Begin = BenchNow();
+        for (UINT32 Position = 0; Position < Order.size(); Position++)
+        {
+            UINT32 Index = Order[Position];
+
+            //
+            // The first deferred function in D3Hot has returned to D0 by
+            // the end of the capture.
+            //
+            if (Position == FirstDeferred) {
+                for (auto Later : Deferred)
+                {
+                    if (Functions[Later].m_State == PowerD3Hot) {
+                        SetPowerState(Functions[Later], PowerD0);
+                        Woken = Later;
+                        break;
+                    }
+                }
+            }
+            if (Position >= FirstDeferred && Scheduler.Reclassify(Index) == Success && Scheduler.IsLowPower(Index)) {
+                Scheduler.SetOutcome(Index, CaptureSkipped);
+                continue;
+            }
+            if (BackendRead(&Backend, Functions[Index].m_Bus, Functions[Index].m_Device, 0, 0, Data.data(), PCIe_CFG_SIZE) != Success) {
+                Scheduler.SetOutcome(Index, CaptureFailed);
+                continue;
+            }
+            if (memcmp(Data.data(), SimFabricGetConfig(Functions[Index].m_Bus, Functions[Index].m_Device, 0), PCIe_CFG_SIZE) != 0) {
+                printf("Capture of %02x:%02x.0 differs from the fabric\n", Functions[Index].m_Bus, Functions[Index].m_Device);
+                Passed = FALSE;
+            }
+            Scheduler.SetOutcome(Index, CaptureDone);
+        }
+        for (UINT32 i = 0; i < Scheduler.GetCount(); i++)
+        {
+            Outcomes[Scheduler.GetOutcome(i)]++;
+        }
+        printf("%-14s%12.3f%12.3f%10llu%10u%10u%10u%10zu\n", ModeNames[Mode], ClassifyTime * 1e3, (BenchNow() - Begin) * 1e3,
+               (unsigned long long)Backend.m_Timeouts, Outcomes[CaptureDone], Outcomes[CaptureFailed], Outcomes[CaptureSkipped], Deferred.size());
+
+        //
+        // Without a scheduler every function in D3 fails, with one none
+        // does, and the function that returned to D0 is captured last.
+        //
+        if ((Mode == 0 && (Outcomes[CaptureFailed] != LowPower || Outcomes[CaptureDone] != Functions.size() - LowPower)) ||
+            (Mode == 1 && (Outcomes[CaptureFailed] != 0 || Outcomes[CaptureSkipped] != LowPower || Backend.m_Timeouts != 0)) ||
+            (Mode == 2 && (Outcomes[CaptureFailed] != 0 || Deferred.size() != LowPower || Backend.m_Timeouts != 0 ||
+                           Outcomes[CaptureSkipped] != LowPower - (Woken < Functions.size()) ||
+                           (Woken < Functions.size() && Scheduler.GetOutcome(Woken) != CaptureDone)))) {
+            printf("  outcomes do not match the %u functions in D3\n", LowPower);
+            Passed = FALSE;
+        }
+        if (Woken < Functions.size()) {
+            SetPowerState(Functions[Woken], PowerD3Hot);
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
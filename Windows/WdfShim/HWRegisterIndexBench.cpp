@@ -0,0 +1,322 @@
+/*++
+
+Module Name:
+
+    HWRegisterIndexBench.cpp
+
+Abstract:
+
+    Builds a CRegisterIndex over a synthetic fleet of captures and times
+    predicate queries on the memory mapped index against a scan of the
+    captures.
+
+    Every host holds the same number of functions, each a 256 byte or
+    4 KB capture made from a few device templates with a varying Max
+    Payload Size, AER correctable status and BAR. The queries are parsed
+    by CRegisterIndex::ParsePredicate, and every query must return the
+    rows of the scan. A row is then read back through GetRow and GetValue,
+    and an offset outside configuration space must fail.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "RegisterIndex.h"
+
+#define BENCH_DEFAULT_HOSTS         1000
+#define BENCH_DEFAULT_FUNCTIONS     1000
+#define BENCH_DEFAULT_INDEX         "HWRegisterIndexBench.hri"
+#define BENCH_MAX_PREDICATES        3
+#define BENCH_TEMPLATES             6
+#define BENCH_BAR_SLOTS             64
+
+//
+// Offsets of the synthetic layout: the PCI Express capability at 0x80,
+// whose Device Control holds Max Payload Size in bits 7:5, and AER at
+// 0x100 with the correctable error status at 0x110.
+//
+#define BENCH_PCIE_CAP              0x80
+#define BENCH_DEVICE_CONTROL        0x88
+#define BENCH_AER_CAP               0x100
+#define BENCH_AER_CORRECTABLE       0x110
+
+typedef struct
+{
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT32 m_ClassCode;
+    BOOLEAN m_Extended;
+}BenchTemplate;
+
+typedef struct
+{
+    const char* m_Name;
+    const char* m_Predicates[BENCH_MAX_PREDICATES];
+}BenchQuery;
+
+static const BenchTemplate Templates[BENCH_TEMPLATES] =
+{
+    { 0x8086, 0x7A38, 0x060400, TRUE },     // root port
+    { 0x8086, 0x1572, 0x020000, TRUE },     // Ethernet
+    { 0x144D, 0xA808, 0x010802, TRUE },     // NVMe
+    { 0x10DE, 0x2204, 0x030000, TRUE },     // VGA
+    { 0x8086, 0x7A24, 0x0C0330, FALSE },    // USB, 256 byte capture
+    { 0x8086, 0x7A04, 0x060100, FALSE },    // ISA bridge, 256 byte capture
+};
+
+static const BenchQuery Queries[] =
+{
+    { "Intel functions", { "vendor=0x8086" } },
+    { "MPS 128 root port", { "class=0x060400", "0x88&0xE0=0" } },
+    { "AER correctable", { "0x110!=0", "0x110!=0xFFFFFFFF" } },
+    { "NVMe MPS > 256", { "class=0x010802", "0x88&0xE0>0x20" } },
+    { "BAR0 >= 0xF4000000", { "0x10>=0xF4000000", "vendor!=0x10DE" } },
+    { "no such device", { "device=0xFFFE" } },
+};
+
+static UINT32 Random(PUINT64 State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (UINT32)(*State >> 33);
+}
+
+//
+// Fills a capture from a template, Mps is the Max Payload Size encoding,
+// Correctable the AER correctable status and Bar the slot of BAR0.
+//
+static UINT32 MakeCapture(std::vector<UINT8>& Capture, const BenchTemplate& Template, UINT32 Mps, UINT32 Correctable, UINT32 Bar)
+{
+    UINT32 Size = Template.m_Extended ? PCIe_CFG_SIZE : PCI_CFG_SIZE;
+    UINT32 Id = Template.m_VendorId | ((UINT32)Template.m_DeviceId << 16);
+    UINT32 Class = Template.m_ClassCode << 8;
+    UINT32 Bar0 = 0xF0000000 + Bar * 0x200000;
+    UINT32 PcieHeader = PCI_CAP_ID_PCIe | (0x0002 << 16);
+    UINT32 DeviceControl = (Mps << 5) | 0x0F;
+    UINT32 AerHeader = PCIe_EXT_CAP_ID_AER | (1 << 16);
+
+    Capture.assign(PCIe_CFG_SIZE, 0);
+    memcpy(&Capture[0x00], &Id, sizeof(Id));
+    memcpy(&Capture[0x08], &Class, sizeof(Class));
+    memcpy(&Capture[0x10], &Bar0, sizeof(Bar0));
+    Capture[0x34] = BENCH_PCIE_CAP;
+    memcpy(&Capture[BENCH_PCIE_CAP], &PcieHeader, sizeof(PcieHeader));
+    memcpy(&Capture[BENCH_DEVICE_CONTROL], &DeviceControl, sizeof(DeviceControl));
+    if (Template.m_Extended) {
+        memcpy(&Capture[BENCH_AER_CAP], &AerHeader, sizeof(AerHeader));
+        memcpy(&Capture[BENCH_AER_CORRECTABLE], &Correctable, sizeof(Correctable));
+    }
+    return Size;
+}
+
+static UINT32 CaptureDword(const std::vector<UINT8>& Capture, UINT32 Size, UINT32 Offset)
+{
+    UINT32 Value = 0xFFFFFFFF;
+
+    if (Offset + sizeof(Value) <= Size) {
+        memcpy(&Value, &Capture[Offset], sizeof(Value));
+    }
+    return Value;
+}
+
+static bool Compare(UINT32 Left, RegisterCompare Operator, UINT32 Right)
+{
+    switch (Operator)
+    {
+        case CompareEqual:          return Left == Right;
+        case CompareNotEqual:       return Left != Right;
+        case CompareGreater:        return Left > Right;
+        case CompareGreaterEqual:   return Left >= Right;
+        case CompareLess:           return Left < Right;
+        case CompareLessEqual:      return Left <= Right;
+    }
+    return false;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWRegisterIndexBench [-hosts <Count>] [-functions <Count>] [-index <File>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Hosts = BENCH_DEFAULT_HOSTS;
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    const char* IndexName = BENCH_DEFAULT_INDEX;
+    std::vector<std::vector<UINT8>> Captures;
+    std::vector<UINT32> CaptureSizes;
+    std::vector<UINT32> RowCapture;
+    std::vector<UINT32> CaptureIndex(BENCH_TEMPLATES * 4 * 4 * BENCH_BAR_SLOTS, MAXDWORD);
+    CRegisterIndexBuilder Builder;
+    CRegisterIndex Index;
+    RegisterPredicate Predicate;
+    UINT64 Seed = 1;
+    BOOLEAN Passed = TRUE;
+    double Begin;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-hosts") == 0 && Arg + 1 < argc) {
+            Hosts = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-index") == 0 && Arg + 1 < argc) {
+            IndexName = argv[++Arg];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Hosts == 0 || Functions == 0 || Functions > 0x10000) {
+        PrintUsage();
+        return 1;
+    }
+
+    //
+    // Most functions run the default Max Payload Size of 128 or 256 bytes
+    // and have no correctable errors logged.
+    //
+    Begin = BenchNow();
+    for (ULONG h = 0; h < Hosts; h++)
+    {
+        char HostName[CONFIG_SNAPSHOT_HOST_LENGTH];
+
+        snprintf(HostName, sizeof(HostName), "host%05u", h);
+        Builder.AddHost(HostName);
+        for (ULONG f = 0; f < Functions; f++)
+        {
+            UINT32 Template = Random(&Seed) % BENCH_TEMPLATES;
+            UINT32 Mps = (Random(&Seed) % 16 == 0) ? 2 + Random(&Seed) % 2 : Random(&Seed) % 2;
+            UINT32 Correctable = (Random(&Seed) % 64 == 0 && Templates[Template].m_Extended) ? 1 + Random(&Seed) % 3 : 0;
+            UINT32 Bar = Random(&Seed) % BENCH_BAR_SLOTS;
+            UINT32 Key = ((Template * 4 + Mps) * 4 + Correctable) * BENCH_BAR_SLOTS + Bar;
+            std::vector<UINT8> Capture;
+
+            if (CaptureIndex[Key] == MAXDWORD) {
+                UINT32 Size = MakeCapture(Capture, Templates[Template], Mps, Correctable, Bar);
+
+                CaptureIndex[Key] = (UINT32)Captures.size();
+                Captures.push_back(Capture);
+                CaptureSizes.push_back(Size);
+            }
+            RowCapture.push_back(CaptureIndex[Key]);
+
+            const std::vector<UINT8>& Stored = Captures[CaptureIndex[Key]];
+            if (Builder.Add((UINT8)(f >> 8), (UINT8)((f >> 3) & 0x1F), (UINT8)(f & 0x07), Stored.data(), CaptureSizes[CaptureIndex[Key]]) != Success) {
+                printf("Add: %s\n", Builder.GetStatusMessage().c_str());
+                return 1;
+            }
+        }
+    }
+    if (Builder.Write(IndexName) != Success) {
+        printf("Write: %s\n", Builder.GetStatusMessage().c_str());
+        return 1;
+    }
+    printf("%u hosts, %u functions, %zu unique captures, index built in %.1f ms\n", Hosts, Hosts * Functions, Captures.size(),
+           (BenchNow() - Begin) * 1e3);
+
+    if (Index.Open(IndexName) != Success) {
+        printf("Open: %s\n", Index.GetStatusMessage().c_str());
+        return 1;
+    }
+    if (Index.GetHeader().m_RowCount != RowCapture.size() || Index.GetHeader().m_BlobCount != Captures.size()) {
+        printf("Index holds %u rows of %u blobs\n", Index.GetHeader().m_RowCount, Index.GetHeader().m_BlobCount);
+        Passed = FALSE;
+    }
+
+    printf("%-22s%10s%12s%12s%10s\n", "Query", "Rows", "Index ms", "Scan ms", "Wrong");
+
+    for (auto& Query : Queries)
+    {
+        std::vector<RegisterPredicate> Predicates;
+        std::vector<UINT32> Rows;
+        std::vector<UINT32> Expected;
+        double IndexTime, ScanTime;
+
+        for (ULONG p = 0; p < BENCH_MAX_PREDICATES && Query.m_Predicates[p] != NULL; p++)
+        {
+            if (CRegisterIndex::ParsePredicate(Query.m_Predicates[p], Predicate) != Success) {
+                printf("%s does not parse\n", Query.m_Predicates[p]);
+                return 1;
+            }
+            Predicates.push_back(Predicate);
+        }
+
+        Begin = BenchNow();
+        if (Index.Query(Predicates, Rows) != Success) {
+            printf("Query: %s\n", Index.GetStatusMessage().c_str());
+            Passed = FALSE;
+        }
+        IndexTime = BenchNow() - Begin;
+
+        Begin = BenchNow();
+        for (UINT32 r = 0; r < (UINT32)RowCapture.size(); r++)
+        {
+            const std::vector<UINT8>& Capture = Captures[RowCapture[r]];
+            bool Match = true;
+
+            for (auto& Each : Predicates)
+            {
+                Match = Match && Compare(CaptureDword(Capture, CaptureSizes[RowCapture[r]], Each.m_Offset) & Each.m_Mask, Each.m_Compare, Each.m_Value);
+            }
+            if (Match) {
+                Expected.push_back(r);
+            }
+        }
+        ScanTime = BenchNow() - Begin;
+
+        printf("%-22s%10zu%12.3f%12.3f%10s\n", Query.m_Name, Rows.size(), IndexTime * 1e3, ScanTime * 1e3, (Rows == Expected) ? "0" : "yes");
+        if (Rows != Expected) {
+            Passed = FALSE;
+        }
+    }
+
+    //
+    // The last function of the last host, read back through the index.
+    //
+    {
+        UINT32 Row = (UINT32)RowCapture.size() - 1;
+        std::string HostName;
+        UINT8 Bus = 0, Device = 0, Function = 0;
+        UINT32 Value = 0;
+        char Expected[CONFIG_SNAPSHOT_HOST_LENGTH];
+
+        snprintf(Expected, sizeof(Expected), "host%05u", Hosts - 1);
+        if (Index.GetRow(Row, HostName, &Bus, &Device, &Function) != Success || HostName != Expected ||
+            (((UINT32)Bus << 8) | ((UINT32)Device << 3) | Function) != Functions - 1 ||
+            Index.GetValue(Row, BENCH_DEVICE_CONTROL, &Value) != Success ||
+            Value != CaptureDword(Captures[RowCapture[Row]], CaptureSizes[RowCapture[Row]], BENCH_DEVICE_CONTROL)) {
+            printf("Row %u reads back as %s %02x:%02x.%x, 0x%08x\n", Row, HostName.c_str(), Bus, Device, Function, Value);
+            Passed = FALSE;
+        }
+    }
+
+    {
+        std::vector<RegisterPredicate> Predicates(1);
+        std::vector<UINT32> Rows;
+
+        Predicates[0].m_Offset = PCIe_CFG_SIZE;
+        Predicates[0].m_Mask = 0xFFFFFFFF;
+        Predicates[0].m_Value = 0;
+        Predicates[0].m_Compare = CompareEqual;
+        if (Index.Query(Predicates, Rows) != IndexOutOfRange || !Rows.empty()) {
+            printf("Offset 0x%x was queried\n", PCIe_CFG_SIZE);
+            Passed = FALSE;
+        }
+    }
+
+    Index.Close();
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
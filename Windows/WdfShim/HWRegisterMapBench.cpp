@@ -0,0 +1,345 @@
+/*++
+
+Module Name:
+
+    HWRegisterMapBench.cpp
+
+Abstract:
+
+    Compiles a synthetic register description into a CRegisterMap database
+    and times device and register lookups and decodes on the memory mapped
+    database.
+
+    Devices are described in groups that share one register table, every
+    table holds registers of all four widths with two fields each. Device
+    lookups through the minimal perfect hash of the database run for every
+    described device and as many absent ones, and are compared with a
+    std::unordered_map over the same keys. Every register offset of a table
+    and the offsets between them are looked up, and dumps of a table are
+    decoded from offset 0 and from a misaligned offset. The database is
+    then rewritten with a register of a width of 3 bytes, which FindRegister
+    and Decode must skip.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "RegisterMap.h"
+
+#define BENCH_DEFAULT_DEVICES       10000
+#define BENCH_DEFAULT_REGISTERS     256
+#define BENCH_DEFAULT_PASSES        20
+#define BENCH_DEFAULT_DATABASE      "HWRegisterMapBench.hrm"
+#define BENCH_DEVICES_PER_TABLE     16
+#define BENCH_REGISTER_STRIDE       8
+#define BENCH_BAD_WIDTH             3
+
+static UINT16 VendorOf(ULONG Index)
+{
+    return (UINT16)(0x1000 + (Index >> 12));
+}
+
+static UINT16 DeviceOf(ULONG Index)
+{
+    return (UINT16)((Index * 0x9E5) & 0xFFF);
+}
+
+//
+// Register r of every table sits at r * BENCH_REGISTER_STRIDE and is 8,
+// 16, 32 or 64 bits wide in turn.
+//
+static UINT32 WidthOf(ULONG Register)
+{
+    return 1U << (Register % 4);
+}
+
+static std::string Describe(ULONG Devices, ULONG Registers)
+{
+    static const char* Access[] = { "ro", "rw", "rw1c" };
+    std::string Text;
+    char Line[128];
+
+    for (ULONG i = 0; i < Devices; i++)
+    {
+        snprintf(Line, sizeof(Line), "device 0x%04x 0x%04x \"Device %u\"\n", VendorOf(i), DeviceOf(i), i);
+        Text += Line;
+        if ((i + 1) % BENCH_DEVICES_PER_TABLE != 0 && i + 1 != Devices) {
+            continue;
+        }
+        for (ULONG r = 0; r < Registers; r++)
+        {
+            snprintf(Line, sizeof(Line), "register 0x%x %u %s REG%u \"Register %u\"\n", r * BENCH_REGISTER_STRIDE, WidthOf(r) * 8,
+                     Access[r % 3], r, r);
+            Text += Line;
+            snprintf(Line, sizeof(Line), "field 0 1 rw EN%u\nfield 1 %u ro STATUS%u\n", r, WidthOf(r) * 8 - 1, r);
+            Text += Line;
+        }
+    }
+    return Text;
+}
+
+//
+// Rewrites the width of the first register of the database.
+//
+static BOOLEAN CorruptWidth(const char* FileName)
+{
+    std::vector<UINT8> Image;
+    RegisterMapHeader Header;
+    FILE* File = fopen(FileName, "rb");
+    long Size;
+
+    if (File == NULL) {
+        return FALSE;
+    }
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    Image.resize((size_t)Size);
+    if (fread(Image.data(), 1, Image.size(), File) != Image.size() || Image.size() < sizeof(Header)) {
+        fclose(File);
+        return FALSE;
+    }
+    fclose(File);
+
+    memcpy(&Header, Image.data(), sizeof(Header));
+    if (Header.m_RegisterCount == 0 || Header.m_RegisterOffset + sizeof(RegisterMapRegister) > Image.size()) {
+        return FALSE;
+    }
+    ((RegisterMapRegister*)(Image.data() + Header.m_RegisterOffset))->m_Width = BENCH_BAD_WIDTH;
+
+    File = fopen(FileName, "wb");
+    if (File == NULL) {
+        return FALSE;
+    }
+    if (fwrite(Image.data(), 1, Image.size(), File) != Image.size()) {
+        fclose(File);
+        return FALSE;
+    }
+    return fclose(File) == 0;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWRegisterMapBench [-devices <Count>] [-registers <Count>] [-passes <Count>] [-database <File>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Devices = BENCH_DEFAULT_DEVICES;
+    ULONG Registers = BENCH_DEFAULT_REGISTERS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    const char* DatabaseName = BENCH_DEFAULT_DATABASE;
+    CRegisterMapCompiler Compiler;
+    CRegisterMap Map;
+    std::unordered_map<UINT64, ULONG> Baseline;
+    std::vector<UINT64> Keys;
+    std::vector<UINT32> Displacements, Slots;
+    std::vector<UINT8> Dump;
+    std::vector<DecodedRegister> Decoded;
+    std::string Text;
+    BOOLEAN Passed = TRUE;
+    double Begin;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-devices") == 0 && Arg + 1 < argc) {
+            Devices = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-registers") == 0 && Arg + 1 < argc) {
+            Registers = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-database") == 0 && Arg + 1 < argc) {
+            DatabaseName = argv[++Arg];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Devices == 0 || Devices > 0x10000 || Registers < 2 || Registers > 0x10000 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Text = Describe(Devices, Registers);
+    Begin = BenchNow();
+    if (Compiler.AddText(Text, "bench") != Success || Compiler.Write(DatabaseName) != Success) {
+        printf("Compile: %s\n", Compiler.GetStatusMessage().c_str());
+        return 1;
+    }
+    printf("%u devices, %u registers compiled in %.1f ms\n", Compiler.GetDeviceCount(), Compiler.GetRegisterCount(), (BenchNow() - Begin) * 1e3);
+
+    //
+    // The hash must place every key in its own slot.
+    //
+    for (ULONG i = 0; i < Devices; i++)
+    {
+        Keys.push_back(REGISTER_MAP_KEY(VendorOf(i), DeviceOf(i)));
+        Baseline[Keys.back()] = i;
+    }
+    if (CPerfectHash::Build(Keys, Displacements, Slots) != Success || Slots.size() != Keys.size()) {
+        printf("CPerfectHash::Build failed for %u keys\n", Devices);
+        Passed = FALSE;
+    }
+    else {
+        for (ULONG i = 0; i < Devices; i++)
+        {
+            UINT32 Slot = CPerfectHash::Lookup(Keys[i], Displacements.data(), (UINT32)Displacements.size(), (UINT32)Slots.size());
+            if (Slot >= Slots.size() || Slots[Slot] != i) {
+                printf("Key 0x%llx is not in its slot\n", (unsigned long long)Keys[i]);
+                Passed = FALSE;
+                break;
+            }
+        }
+    }
+
+    Begin = BenchNow();
+    if (Map.Open(DatabaseName) != Success) {
+        printf("Open: %s\n", Map.GetStatusMessage().c_str());
+        return 1;
+    }
+    printf("Opened in %.3f ms, %u buckets for %u devices\n", (BenchNow() - Begin) * 1e3, Map.GetHeader().m_BucketCount, Map.GetHeader().m_DeviceCount);
+
+    printf("%-22s%12s%10s%12s%10s\n", "Lookup", "Lookups", "ms", "ns/lookup", "Wrong");
+
+    //
+    // Absent devices take the ids of a described one with the vendor id
+    // of no described device.
+    //
+    for (ULONG Mode = 0; Mode < 2; Mode++)
+    {
+        UINT64 Count = 0;
+        ULONG Wrong = 0;
+        double Elapsed;
+
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            for (ULONG i = 0; i < Devices; i++)
+            {
+                UINT16 Absent = (UINT16)(0xF000 | VendorOf(i));
+
+                if (Mode == 0) {
+                    const RegisterMapDevice* Device = Map.FindDevice(VendorOf(i), DeviceOf(i));
+                    Wrong += (Device == NULL || Device->m_Table != i / BENCH_DEVICES_PER_TABLE);
+                    Wrong += (Map.FindDevice(Absent, DeviceOf(i)) != NULL);
+                }
+                else {
+                    auto Found = Baseline.find(REGISTER_MAP_KEY(VendorOf(i), DeviceOf(i)));
+                    Wrong += (Found == Baseline.end() || Found->second != i);
+                    Wrong += (Baseline.find(REGISTER_MAP_KEY(Absent, DeviceOf(i))) != Baseline.end());
+                }
+                Count += 2;
+            }
+        }
+        Elapsed = BenchNow() - Begin;
+        printf("%-22s%12llu%10.3f%12.1f%10u\n", (Mode == 0) ? "FindDevice" : "unordered_map", (unsigned long long)Count, Elapsed * 1e3,
+               Elapsed * 1e9 / Count, Wrong);
+        Passed = Passed && (Wrong == 0);
+    }
+
+    {
+        const RegisterMapDevice* Device = Map.FindDevice(VendorOf(Devices - 1), DeviceOf(Devices - 1));
+        UINT32 Extent = Registers * BENCH_REGISTER_STRIDE;
+        UINT64 Count = 0;
+        ULONG Wrong = 0;
+        double Elapsed;
+
+        if (Device == NULL) {
+            printf("Device %u is not found\n", Devices - 1);
+            return 1;
+        }
+
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            for (UINT32 Offset = 0; Offset < Extent; Offset += 4)
+            {
+                const RegisterMapRegister* Register = Map.FindRegister(Device, Offset);
+                ULONG r = Offset / BENCH_REGISTER_STRIDE;
+
+                if (Offset % BENCH_REGISTER_STRIDE != 0) {
+                    Wrong += (Register != NULL);
+                }
+                else {
+                    Wrong += (Register == NULL || Register->m_Width != WidthOf(r) || Register->m_FieldCount != 2);
+                }
+                Count++;
+            }
+        }
+        Elapsed = BenchNow() - Begin;
+        printf("%-22s%12llu%10.3f%12.1f%10u\n", "FindRegister", (unsigned long long)Count, Elapsed * 1e3, Elapsed * 1e9 / Count, Wrong);
+        Passed = Passed && (Wrong == 0);
+
+        //
+        // A dump of the whole table decodes every register, a dump that
+        // starts inside register 0 and ends inside the last one decodes
+        // the others.
+        //
+        Dump.resize(Extent);
+        for (UINT32 b = 0; b < Extent; b++)
+        {
+            Dump[b] = (UINT8)(b * 7 + 3);
+        }
+        Count = 0;
+        Wrong = 0;
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            Wrong += (Map.Decode(Device, 0, Dump.data(), Extent, Decoded) != Registers);
+            for (auto& Each : Decoded)
+            {
+                UINT64 Value = 0;
+
+                memcpy(&Value, Dump.data() + Each.m_Register->m_Offset, Each.m_Register->m_Width);
+                Wrong += (Value != Each.m_Value);
+            }
+            Wrong += (Map.Decode(Device, 4, Dump.data() + 4, Extent - 8, Decoded) != Registers - 2 ||
+                      Decoded.front().m_Register->m_Offset != BENCH_REGISTER_STRIDE);
+            Count += 2;
+        }
+        Elapsed = BenchNow() - Begin;
+        printf("%-22s%12llu%10.3f%12.1f%10u\n", "Decode", (unsigned long long)Count, Elapsed * 1e3, Elapsed * 1e9 / Count, Wrong);
+        Passed = Passed && (Wrong == 0);
+    }
+
+    //
+    // Register 0 of the first table gets a width Decode could not copy
+    // into a UINT64.
+    //
+    Map.Close();
+    if (!CorruptWidth(DatabaseName) || Map.Open(DatabaseName) != Success) {
+        printf("Unable to rewrite %s\n", DatabaseName);
+        return 1;
+    }
+    {
+        const RegisterMapDevice* Device = Map.FindDevice(VendorOf(0), DeviceOf(0));
+
+        if (Device == NULL || Map.FindRegister(Device, 0) != NULL || Map.FindRegister(Device, BENCH_REGISTER_STRIDE) == NULL ||
+            Map.Decode(Device, 0, Dump.data(), (UINT32)Dump.size(), Decoded) != Registers - 1) {
+            printf("A register %u bytes wide was decoded\n", BENCH_BAD_WIDTH);
+            Passed = FALSE;
+        }
+        else {
+            printf("A register %u bytes wide is skipped\n", BENCH_BAD_WIDTH);
+        }
+    }
+    Map.Close();
+
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
@@ -0,0 +1,608 @@
+/*++
+
+Module Name:
+
+    HWRingBench.c
+
+Abstract:
+
+    Stress test and benchmark of the register access rings in HwRing.c.
+
+    The stress test runs the ring routines between two user mode threads.
+    The consumer serves the ring the way the driver's ring thread does,
+    polling, then announcing its sleep with HW_RING_FLAG_NEED_WAKEUP and
+    waiting on an event the producer sets as its doorbell. The producer
+    submits numbered descriptors, every seventh of them invalid, in bursts
+    separated by pauses long enough for the consumer to fall asleep, and
+    checks that every completion comes back once, in order, with the
+    status and data of its descriptor. A run that makes no progress for
+    BENCH_HANG_SECONDS is reported as a lost wakeup. It ends with a ring
+    whose submission tail is overwritten, which must be flagged corrupt.
+
+    The benchmark loads the driver on the WDF shim and the simulated PCI
+    fabric, registers a ring with IOCTL_PLATFORM_RING_SETUP and reads
+    configuration space and MMIO through it in batches, next to the same
+    reads sent as one direct IOCTL each. It prints the read rate, the time
+    per read, the IOCTLs per read, which for the ring are its doorbells,
+    and the configuration and mapping accesses per read.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include "WdfShim.h"
+#include "SimFabric.h"
+#include "HwRing.h"
+
+#define BENCH_DEFAULT_ITERATIONS    200000
+#define BENCH_DEFAULT_STRESS        200000
+#define BENCH_DEFAULT_ENTRIES       256
+#define BENCH_DEFAULT_IDLE_US       50
+#define BENCH_STRESS_IDLE_US        5
+#define BENCH_STRESS_SLOT           16
+#define BENCH_STRESS_INVALID        7
+#define BENCH_HANG_SECONDS          5
+#define BENCH_BAR_BASE              0x80000000ULL
+#define BENCH_BAR_SIZE              0x10000
+#define BENCH_VENDOR_ID             0x8086
+#define BENCH_DEVICE_ID             0x1234
+
+DRIVER_INITIALIZE DriverEntry;
+
+static double Now(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+static PVOID AllocateRing(UINT32 Entries, UINT32 DataLength, SIZE_T* Length)
+{
+    PVOID Memory = NULL;
+
+    *Length = HwRingLayoutSize(Entries, DataLength);
+    if (*Length == 0 || posix_memalign(&Memory, 4096, *Length) != 0) {
+        return NULL;
+    }
+    memset(Memory, 0, *Length);
+    return Memory;
+}
+
+//
+// Stress test.
+//
+typedef struct _STRESS_CONTEXT {
+    HwRing Driver;
+    HwRing Application;
+    KEVENT Doorbell;
+    volatile LONG Stop;
+    ULONG64 Sleeps;
+    ULONG64 Doorbells;
+} STRESS_CONTEXT;
+
+//
+// Fills the data of a descriptor with its sequence number, as a read of
+// the device would.
+//
+static VOID StressExecute(STRESS_CONTEXT* Context, const HwRingSqe* Sqe, PHwRingCqe Cqe)
+{
+    Cqe->m_UserData = Sqe->m_UserData;
+    Cqe->m_Length = 0;
+    Cqe->m_Status = HwRingValidateSqe(&Context->Driver, Sqe);
+    if (Cqe->m_Status == HW_RING_STATUS_SUCCESS) {
+        memcpy(Context->Driver.m_Data + Sqe->m_DataOffset, &Sqe->m_UserData, sizeof(Sqe->m_UserData));
+        Cqe->m_Length = Sqe->m_Length;
+    }
+}
+
+//
+// Same loop as HardwareInterfaceDrvRingThread.
+//
+static PVOID StressConsumer(PVOID Parameter)
+{
+    STRESS_CONTEXT* Context = (STRESS_CONTEXT*)Parameter;
+    double IdleStart = Now();
+    HwRingSqe Sqe;
+    HwRingCqe Cqe;
+    ULONG Executed;
+
+    while (!Context->Stop) {
+        Executed = 0;
+        while (HwRingFetch(&Context->Driver, &Sqe)) {
+            StressExecute(Context, &Sqe, &Cqe);
+            HwRingPost(&Context->Driver, &Cqe);
+            Executed++;
+        }
+        if (Executed != 0) {
+            IdleStart = Now();
+            continue;
+        }
+        if ((Now() - IdleStart) * 1e6 < BENCH_STRESS_IDLE_US) {
+            YieldProcessor();
+            continue;
+        }
+
+        HwRingSetNeedWakeup(&Context->Driver, TRUE);
+        if (!HwRingHasWork(&Context->Driver) && !Context->Stop) {
+            Context->Sleeps++;
+            KeWaitForSingleObject(&Context->Doorbell, Executive, KernelMode, FALSE, NULL);
+        }
+        HwRingSetNeedWakeup(&Context->Driver, FALSE);
+        IdleStart = Now();
+    }
+    return NULL;
+}
+
+static VOID StressDoorbell(STRESS_CONTEXT* Context)
+{
+    if (HwRingNeedsWakeup(&Context->Application)) {
+        Context->Doorbells++;
+        KeSetEvent(&Context->Doorbell, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+//
+// Checks one completion against the descriptor the producer numbered
+// Expected. Returns FALSE and prints why if it does not match.
+//
+static BOOLEAN StressCheck(STRESS_CONTEXT* Context, const HwRingCqe* Cqe, ULONG64 Expected)
+{
+    ULONG64 Data = 0;
+    UINT32 Slots = 2 * Context->Application.m_Entries;
+
+    if (Cqe->m_UserData != Expected) {
+        printf("Completion %llu came back as %llu\n", (unsigned long long)Expected, (unsigned long long)Cqe->m_UserData);
+        return FALSE;
+    }
+    if (Expected % BENCH_STRESS_INVALID == 0) {
+        if (Cqe->m_Status != HW_RING_STATUS_INVALID_OP || Cqe->m_Length != 0) {
+            printf("Invalid descriptor %llu completed with status %u\n", (unsigned long long)Expected, Cqe->m_Status);
+            return FALSE;
+        }
+        return TRUE;
+    }
+    memcpy(&Data, Context->Application.m_Data + (Expected % Slots) * BENCH_STRESS_SLOT, sizeof(Data));
+    if (Cqe->m_Status != HW_RING_STATUS_SUCCESS || Cqe->m_Length != BENCH_STRESS_SLOT || Data != Expected) {
+        printf("Descriptor %llu completed with status %u, length %u, data %llu\n", (unsigned long long)Expected,
+               Cqe->m_Status, Cqe->m_Length, (unsigned long long)Data);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+// Two descriptors per entry can be outstanding, one in each queue, so the
+// data area has a slot for each.
+//
+static BOOLEAN RunStress(ULONG64 Count, UINT32 Entries)
+{
+    STRESS_CONTEXT Context;
+    pthread_t Consumer;
+    SIZE_T Length = 0;
+    UINT32 DataLength = 2 * Entries * BENCH_STRESS_SLOT;
+    PVOID Memory = AllocateRing(Entries, DataLength, &Length);
+    ULONG64 Submitted = 0, Completed = 0;
+    ULONG Burst = 0;
+    ULONG64 Progress = 0;
+    double Begin, LastProgress;
+    BOOLEAN Passed = TRUE;
+    HwRingSqe Sqe;
+    HwRingCqe Cqe;
+
+    if (Memory == NULL) {
+        printf("Ring allocation failed\n");
+        return FALSE;
+    }
+    memset(&Context, 0, sizeof(Context));
+    KeInitializeEvent(&Context.Doorbell, SynchronizationEvent, FALSE);
+    if (HwRingAttach(Memory, Length, &Context.Application) != HW_RING_STATUS_NOT_READY ||
+        HwRingInitialize(Memory, Length, Entries, DataLength, &Context.Driver) != HW_RING_STATUS_SUCCESS ||
+        HwRingAttach(Memory, Length, &Context.Application) != HW_RING_STATUS_SUCCESS) {
+        printf("Ring layout failed\n");
+        free(Memory);
+        return FALSE;
+    }
+    pthread_create(&Consumer, NULL, StressConsumer, &Context);
+
+    Begin = LastProgress = Now();
+    srand(1);
+    while (Completed < Count && Passed) {
+        //
+        // Bursts of up to a queue and a half, then a pause of up to 200 us
+        // every so often so the consumer goes to sleep in between.
+        //
+        if (Burst == 0) {
+            Burst = 1 + rand() % (Entries + Entries / 2);
+            if (rand() % 4 == 0) {
+                usleep(rand() % 200);
+            }
+        }
+        while (Burst != 0 && Submitted < Count) {
+            memset(&Sqe, 0, sizeof(Sqe));
+            Sqe.m_OpCode = (Submitted % BENCH_STRESS_INVALID == 0) ? 0x7F : HW_RING_OP_CFG_READ;
+            Sqe.m_Length = BENCH_STRESS_SLOT;
+            Sqe.m_DataOffset = (UINT32)((Submitted % (2 * Entries)) * BENCH_STRESS_SLOT);
+            Sqe.m_UserData = Submitted;
+            if (!HwRingSubmit(&Context.Application, &Sqe)) {
+                break;
+            }
+            Submitted++;
+            Burst--;
+        }
+        StressDoorbell(&Context);
+
+        while (HwRingReap(&Context.Application, &Cqe)) {
+            if (!StressCheck(&Context, &Cqe, Completed)) {
+                Passed = FALSE;
+                break;
+            }
+            Completed++;
+            LastProgress = Now();
+        }
+
+        //
+        // A consumer that slept on a full completion queue needs the
+        // doorbell once the producer made room.
+        //
+        StressDoorbell(&Context);
+        if (Submitted + Completed == Progress) {
+            sched_yield();
+        }
+        Progress = Submitted + Completed;
+        if (Now() - LastProgress > BENCH_HANG_SECONDS) {
+            printf("No completion for %u s after %llu of %llu, flags 0x%x: lost wakeup\n", BENCH_HANG_SECONDS,
+                   (unsigned long long)Completed, (unsigned long long)Submitted, Context.Application.m_Header->m_Flags.m_Value);
+            Passed = FALSE;
+        }
+    }
+
+    InterlockedExchange(&Context.Stop, TRUE);
+    KeSetEvent(&Context.Doorbell, IO_NO_INCREMENT, FALSE);
+    pthread_join(Consumer, NULL);
+
+    printf("Stress: %llu descriptors, %u entries, %.2f us/descriptor, %llu sleeps, %llu doorbells: %s\n",
+           (unsigned long long)Completed, Entries, (Now() - Begin) * 1e6 / (Completed ? Completed : 1),
+           (unsigned long long)Context.Sleeps, (unsigned long long)Context.Doorbells, Passed ? "passed" : "FAILED");
+
+    //
+    // A submission tail more than a queue ahead of the head must stop the
+    // consumer instead of letting it read stale entries.
+    //
+    if (Passed) {
+        Context.Application.m_Header->m_SqTail.m_Value = Context.Driver.m_SqIndex + Entries + 1;
+        if (HwRingFetch(&Context.Driver, &Sqe) || !(Context.Application.m_Header->m_Flags.m_Value & HW_RING_FLAG_CORRUPT)) {
+            printf("Corrupt submission tail was not detected\n");
+            Passed = FALSE;
+        }
+        else {
+            printf("Corrupt submission tail: detected\n");
+        }
+    }
+
+    free(Memory);
+    return Passed;
+}
+
+//
+// Driver benchmark.
+//
+typedef enum _BENCH_KIND {
+    BenchRingCfgRead,
+    BenchRingMmioRead,
+    BenchDirectCfgRead,
+    BenchDirectMmioRead,
+} BENCH_KIND;
+
+typedef struct _BENCH_CASE {
+    PCSTR Name;
+    BENCH_KIND Kind;
+    ULONG Size;
+    ULONG Batch;
+} BENCH_CASE;
+
+static const BENCH_CASE BenchCases[] = {
+    { "STD_CFG_READ_DIRECT", BenchDirectCfgRead, 4, 1 },
+    { "RING CFG_READ", BenchRingCfgRead, 4, 1 },
+    { "RING CFG_READ", BenchRingCfgRead, 4, 32 },
+    { "STD_CFG_READ_DIRECT", BenchDirectCfgRead, PCI_CFG_SIZE, 1 },
+    { "RING CFG_READ", BenchRingCfgRead, PCI_CFG_SIZE, 1 },
+    { "RING CFG_READ", BenchRingCfgRead, PCI_CFG_SIZE, 32 },
+    { "MMIO_READ_DIRECT", BenchDirectMmioRead, PCIe_CFG_SIZE, 1 },
+    { "RING MMIO_READ", BenchRingMmioRead, PCIe_CFG_SIZE, 1 },
+    { "RING MMIO_READ", BenchRingMmioRead, PCIe_CFG_SIZE, 32 },
+};
+
+typedef struct _BENCH_CONTEXT {
+    WDFDEVICE Device;
+    HwRing Ring;
+    PUCHAR Output;
+    ULONG Failures;
+} BENCH_CONTEXT;
+
+static BOOLEAN CheckData(BENCH_KIND Kind, PUCHAR Data, ULONG Size)
+{
+    ULONG Dword = 0;
+
+    if (Kind == BenchRingCfgRead || Kind == BenchDirectCfgRead) {
+        return Data[0] == (UCHAR)BENCH_VENDOR_ID && Data[1] == (UCHAR)(BENCH_VENDOR_ID >> 8);
+    }
+    memcpy(&Dword, Data + Size - sizeof(ULONG), sizeof(Dword));
+    return Dword == (Size / sizeof(ULONG) - 1);
+}
+
+static VOID RunDirect(BENCH_CONTEXT* Context, const BENCH_CASE* Case, ULONG Iterations)
+{
+    PCIeCfgReadRequest CfgRequest;
+    PCIeMMIOReadRequest MmioRequest;
+    ULONG BytesReturned = 0;
+    NTSTATUS Status;
+    ULONG i;
+
+    memset(&CfgRequest, 0, sizeof(CfgRequest));
+    CfgRequest.m_Length = Case->Size;
+    memset(&MmioRequest, 0, sizeof(MmioRequest));
+    MmioRequest.m_BaseAddressRegister = BENCH_BAR_BASE;
+    MmioRequest.m_Length = Case->Size;
+
+    for (i = 0; i < Iterations; i++)
+    {
+        if (Case->Kind == BenchDirectCfgRead) {
+            Status = ShimDeviceIoControl(Context->Device, IOCTL_PLATFORM_PCI_STD_CFG_READ_DIRECT, &CfgRequest, sizeof(CfgRequest),
+                                         Context->Output, Case->Size, &BytesReturned);
+        }
+        else {
+            Status = ShimDeviceIoControl(Context->Device, IOCTL_PLATFORM_PCIe_MMIO_READ_DIRECT, &MmioRequest, sizeof(MmioRequest),
+                                         Context->Output, Case->Size, &BytesReturned);
+        }
+        if (!NT_SUCCESS(Status) || BytesReturned != Case->Size || !CheckData(Case->Kind, Context->Output, Case->Size)) {
+            Context->Failures++;
+        }
+    }
+}
+
+//
+// Submits a batch, rings the doorbell if the ring thread sleeps and reaps
+// the batch. Each descriptor of a batch has its own slot of the data area.
+//
+static VOID RunRing(BENCH_CONTEXT* Context, const BENCH_CASE* Case, ULONG Iterations)
+{
+    ULONG BytesReturned = 0;
+    ULONG Done = 0, Batch, i;
+    HwRingSqe Sqe;
+    HwRingCqe Cqe;
+
+    memset(&Sqe, 0, sizeof(Sqe));
+    Sqe.m_OpCode = (Case->Kind == BenchRingCfgRead) ? HW_RING_OP_CFG_READ : HW_RING_OP_MMIO_READ;
+    Sqe.m_Address = BENCH_BAR_BASE;
+    Sqe.m_Length = Case->Size;
+
+    while (Done < Iterations) {
+        Batch = (Iterations - Done < Case->Batch) ? Iterations - Done : Case->Batch;
+        for (i = 0; i < Batch; i++)
+        {
+            Sqe.m_DataOffset = i * PCIe_CFG_SIZE;
+            Sqe.m_UserData = i;
+            if (!HwRingSubmit(&Context->Ring, &Sqe)) {
+                Context->Failures++;
+                return;
+            }
+        }
+        if (HwRingNeedsWakeup(&Context->Ring)) {
+            ShimDeviceIoControl(Context->Device, IOCTL_PLATFORM_RING_DOORBELL, NULL, 0, NULL, 0, &BytesReturned);
+        }
+
+        i = 0;
+        while (i < Batch) {
+            if (!HwRingReap(&Context->Ring, &Cqe)) {
+                sched_yield();
+                continue;
+            }
+            if (Cqe.m_Status != HW_RING_STATUS_SUCCESS || Cqe.m_Length != Case->Size || Cqe.m_UserData != i ||
+                !CheckData(Case->Kind, Context->Ring.m_Data + Cqe.m_UserData * PCIe_CFG_SIZE, Case->Size)) {
+                Context->Failures++;
+            }
+            i++;
+        }
+        Done += Batch;
+    }
+}
+
+static NTSTATUS SetupRing(BENCH_CONTEXT* Context, PHwRingSetup Setup, PVOID Memory, SIZE_T Length, WDFREQUEST* Request)
+{
+    NTSTATUS Status;
+    double Begin = Now();
+
+    Status = ShimBeginDeviceIoControl(Context->Device, IOCTL_PLATFORM_RING_SETUP, Setup, sizeof(*Setup), Memory, (ULONG)Length, Request);
+    if (*Request == NULL) {
+        return Status;
+    }
+    while (HwRingAttach(Memory, Length, &Context->Ring) == HW_RING_STATUS_NOT_READY) {
+        sched_yield();
+        if (Now() - Begin > BENCH_HANG_SECONDS) {
+            return STATUS_TIMEOUT;
+        }
+    }
+    return STATUS_PENDING;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWRingBench [-iterations <Count>] [-stress <Count>] [-entries <Count>] [-idle-us <us>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Iterations = BENCH_DEFAULT_ITERATIONS;
+    ULONG64 StressCount = BENCH_DEFAULT_STRESS;
+    HwRingSetup Setup = { BENCH_DEFAULT_ENTRIES, 32 * PCIe_CFG_SIZE, BENCH_DEFAULT_IDLE_US };
+    SIM_FABRIC_LATENCY Latency = { 0, 0, 0 };
+    BENCH_CONTEXT Context;
+    WDFREQUEST Request = NULL, Second = NULL;
+    PVOID Memory = NULL, SecondMemory = NULL;
+    SIZE_T Length = 0;
+    ULONG BytesReturned = 0;
+    NTSTATUS Status;
+    BOOLEAN Passed = TRUE;
+    ULONG c;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-iterations") == 0 && Arg + 1 < argc) {
+            Iterations = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-stress") == 0 && Arg + 1 < argc) {
+            StressCount = strtoull(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-entries") == 0 && Arg + 1 < argc) {
+            Setup.m_Entries = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-idle-us") == 0 && Arg + 1 < argc) {
+            Setup.m_IdleUs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (HwRingLayoutSize(Setup.m_Entries, Setup.m_DataLength) == 0 || Setup.m_Entries < 32) {
+        printf("Entries must be a power of two from 32 to %u\n", HW_RING_MAX_ENTRIES);
+        return 1;
+    }
+    if (Iterations == 0) {
+        Iterations = 1;
+    }
+
+    if (StressCount != 0) {
+        Passed = RunStress(StressCount, 4) && RunStress(StressCount, Setup.m_Entries);
+    }
+
+    Status = SimFabricAddFunction(0, 0, 0, BENCH_VENDOR_ID, BENCH_DEVICE_ID, 0x020000);
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddBar(0, 0, 0, 0, BENCH_BAR_BASE, BENCH_BAR_SIZE);
+    }
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    memset(&Context, 0, sizeof(Context));
+    Status = ShimDriverLoad(DriverEntry, &Context.Device);
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Context.Output = (PUCHAR)malloc(PCIe_CFG_SIZE);
+    Memory = AllocateRing(Setup.m_Entries, Setup.m_DataLength, &Length);
+    SecondMemory = AllocateRing(Setup.m_Entries, Setup.m_DataLength, &Length);
+    if (Context.Output == NULL || Memory == NULL || SecondMemory == NULL) {
+        printf("Buffer allocation failed\n");
+        return 1;
+    }
+
+    Status = SetupRing(&Context, &Setup, Memory, Length, &Request);
+    if (Status != STATUS_PENDING) {
+        printf("IOCTL_PLATFORM_RING_SETUP failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+
+    //
+    // Only one ring is served at a time.
+    //
+    Status = ShimBeginDeviceIoControl(Context.Device, IOCTL_PLATFORM_RING_SETUP, &Setup, sizeof(Setup), SecondMemory, (ULONG)Length, &Second);
+    if (Second != NULL) {
+        Status = ShimEndDeviceIoControl(Second, &BytesReturned);
+    }
+    if (Status != STATUS_DEVICE_BUSY) {
+        printf("Second ring setup returned 0x%x instead of STATUS_DEVICE_BUSY\n", (unsigned)Status);
+        Passed = FALSE;
+    }
+
+    printf("Ring of %u entries, %u us idle, %u reads per case, latency config %u ns, MMIO %u ns\n",
+           Setup.m_Entries, Setup.m_IdleUs, Iterations, Latency.ConfigNs, Latency.MmioNs);
+    printf("%-21s%9s%7s%12s%10s%11s%10s%10s\n", "Path", "Bytes", "Batch", "Reads/s", "us/read", "IOCTL/read", "cfg/read", "maps/read");
+
+    for (c = 0; c < sizeof(BenchCases) / sizeof(BenchCases[0]); c++)
+    {
+        const BENCH_CASE* Case = &BenchCases[c];
+        SIM_FABRIC_COUNTERS Counters;
+        SHIM_STATISTICS Statistics;
+        double Begin;
+        double Seconds;
+
+        Context.Failures = 0;
+        SimFabricResetCounters();
+        ShimResetStatistics();
+        Begin = Now();
+        if (Case->Kind == BenchDirectCfgRead || Case->Kind == BenchDirectMmioRead) {
+            RunDirect(&Context, Case, Iterations);
+        }
+        else {
+            RunRing(&Context, Case, Iterations);
+        }
+        Seconds = Now() - Begin;
+        SimFabricGetCounters(&Counters);
+        ShimGetStatistics(&Statistics);
+
+        if (Context.Failures != 0) {
+            printf("%-21s%9u%7u  %u reads failed\n", Case->Name, Case->Size, Case->Batch, Context.Failures);
+            Passed = FALSE;
+            continue;
+        }
+        printf("%-21s%9u%7u%12.0f%10.2f%11.3f%10.1f%10.3f\n", Case->Name, Case->Size, Case->Batch,
+               Iterations / Seconds, Seconds * 1e6 / Iterations, (double)Statistics.Requests / Iterations,
+               (double)Counters.ConfigReads / Iterations, (double)Counters.Maps / Iterations);
+    }
+
+    //
+    // Canceling the setup request stops the ring thread, after which the
+    // buffer belongs to the application again and a new ring can start.
+    //
+    ShimCancelIo(Request);
+    Status = ShimEndDeviceIoControl(Request, &BytesReturned);
+    if (Status != STATUS_CANCELLED) {
+        printf("Canceled ring setup returned 0x%x instead of STATUS_CANCELLED\n", (unsigned)Status);
+        Passed = FALSE;
+    }
+    Status = SetupRing(&Context, &Setup, SecondMemory, Length, &Request);
+    if (Status != STATUS_PENDING) {
+        printf("Ring setup after cancel failed with status 0x%x\n", (unsigned)Status);
+        Passed = FALSE;
+    }
+
+    //
+    // Unloading with a ring still registered must not hang.
+    //
+    ShimDriverUnload();
+    if (Request != NULL) {
+        Status = ShimEndDeviceIoControl(Request, &BytesReturned);
+    }
+    printf("Cancel, restart and unload: %s\n", Passed ? "passed" : "FAILED");
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+
+    SimFabricReset();
+    free(Context.Output);
+    free(Memory);
+    free(SecondMemory);
+    return Passed ? 0 : 1;
+}
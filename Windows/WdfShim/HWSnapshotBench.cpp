@@ -0,0 +1,318 @@
+/*++
+
+Module Name:
+
+    HWSnapshotBench.cpp
+
+Abstract:
+
+    Times CConfigSnapshotWriter and CConfigSnapshotReader on a synthetic
+    host and CCfgSpaceCodec on its captures in memory.
+
+    The captures are made from a few device templates with a varying BAR,
+    Max Payload Size and AER correctable status, a random serial number,
+    an all ones region and a repeated dword pattern, so every token kind
+    of the codec is used. The bench writes them to a snapshot, reads it
+    back through the file mapping, and encodes and decodes them in memory
+    against the previous capture of the same device. It prints the time
+    and throughput of each and the raw and encoded sizes. Every record
+    must read back as written, later captures of a device must be encoded
+    against an earlier one, random data must fit MaxEncodedSize and
+    truncated input and captures larger than the extended configuration
+    space must be refused.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "CfgSpaceCodec.h"
+#include "ConfigSnapshot.h"
+
+#define BENCH_DEFAULT_FUNCTIONS     4096
+#define BENCH_DEFAULT_PASSES        5
+#define BENCH_DEFAULT_SNAPSHOT      "HWSnapshotBench.hws"
+#define BENCH_TEMPLATES             6
+
+//
+// Offsets of the synthetic layout: the PCI Express capability at 0x80,
+// AER at 0x100, a serial number at 0x148, then an all ones region and a
+// repeated pattern in the vendor specific part of extended captures.
+//
+#define BENCH_PCIE_CAP              0x80
+#define BENCH_DEVICE_CONTROL        0x88
+#define BENCH_AER_CAP               0x100
+#define BENCH_AER_CORRECTABLE       0x110
+#define BENCH_DSN_CAP               0x148
+#define BENCH_ONES                  0x200
+#define BENCH_ONES_SIZE             0x80
+#define BENCH_PATTERN               0x300
+#define BENCH_PATTERN_SIZE          0x40
+
+typedef struct
+{
+    UINT16 m_VendorId;
+    UINT16 m_DeviceId;
+    UINT32 m_ClassCode;
+    BOOLEAN m_Extended;
+}BenchTemplate;
+
+static const BenchTemplate Templates[BENCH_TEMPLATES] =
+{
+    { 0x8086, 0x7A38, 0x060400, TRUE },     // root port
+    { 0x8086, 0x1572, 0x020000, TRUE },     // Ethernet
+    { 0x144D, 0xA808, 0x010802, TRUE },     // NVMe
+    { 0x10DE, 0x2204, 0x030000, TRUE },     // VGA
+    { 0x8086, 0x7A24, 0x0C0330, FALSE },    // USB, 256 byte capture
+    { 0x8086, 0x7A04, 0x060100, FALSE },    // ISA bridge, 256 byte capture
+};
+
+static UINT32 Random(PUINT64 State)
+{
+    *State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (UINT32)(*State >> 33);
+}
+
+static UINT32 MakeCapture(PUINT8 Capture, const BenchTemplate& Template, PUINT64 State)
+{
+    UINT32 Size = Template.m_Extended ? PCIe_CFG_SIZE : PCI_CFG_SIZE;
+    UINT32 Id = Template.m_VendorId | ((UINT32)Template.m_DeviceId << 16);
+    UINT32 Class = Template.m_ClassCode << 8;
+    UINT32 Bar0 = 0xF0000000 + (Random(State) % 64) * 0x200000;
+    UINT32 PcieHeader = PCI_CAP_ID_PCIe | (0x0002 << 16);
+    UINT32 DeviceControl = ((Random(State) % 3) << 5) | 0x0F;
+    UINT32 AerHeader = PCIe_EXT_CAP_ID_AER | (1 << 16) | (BENCH_DSN_CAP << 20);
+    UINT32 Correctable = ((Random(State) % 8) == 0) ? (1 << (Random(State) % 16)) : 0;
+    UINT32 DsnHeader = PCIe_EXT_CAP_ID_DSN | (1 << 16);
+    UINT32 Pattern = 0x5A5A0000 | Template.m_DeviceId;
+
+    memset(Capture, 0, PCIe_CFG_SIZE);
+    memcpy(Capture + 0x00, &Id, sizeof(Id));
+    memcpy(Capture + 0x08, &Class, sizeof(Class));
+    memcpy(Capture + 0x10, &Bar0, sizeof(Bar0));
+    Capture[0x34] = BENCH_PCIE_CAP;
+    memcpy(Capture + BENCH_PCIE_CAP, &PcieHeader, sizeof(PcieHeader));
+    memcpy(Capture + BENCH_DEVICE_CONTROL, &DeviceControl, sizeof(DeviceControl));
+    if (Template.m_Extended) {
+        UINT32 Serial[2] = { Random(State), Random(State) };
+
+        memcpy(Capture + BENCH_AER_CAP, &AerHeader, sizeof(AerHeader));
+        memcpy(Capture + BENCH_AER_CORRECTABLE, &Correctable, sizeof(Correctable));
+        memcpy(Capture + BENCH_DSN_CAP, &DsnHeader, sizeof(DsnHeader));
+        memcpy(Capture + BENCH_DSN_CAP + 4, Serial, sizeof(Serial));
+        memset(Capture + BENCH_ONES, 0xFF, BENCH_ONES_SIZE);
+        for (UINT32 Offset = BENCH_PATTERN; Offset < BENCH_PATTERN + BENCH_PATTERN_SIZE; Offset += sizeof(Pattern))
+        {
+            memcpy(Capture + Offset, &Pattern, sizeof(Pattern));
+        }
+    }
+    return Size;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWSnapshotBench [-functions <Count>] [-passes <Count>] [-snapshot <File>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ULONG Functions = BENCH_DEFAULT_FUNCTIONS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    const char* SnapshotFile = BENCH_DEFAULT_SNAPSHOT;
+    std::vector<UINT8> Captures;
+    std::vector<UINT32> Sizes;
+    std::vector<UINT8> Encoded;
+    std::vector<UINT32> EncodedSizes;
+    std::vector<UINT8> Decoded(PCIe_CFG_SIZE);
+    std::vector<UINT8> Data;
+    ConfigSnapshotRecord Record;
+    UINT64 RawBytes = 0;
+    UINT64 FileBytes = 0;
+    UINT64 CodecBytes = 0;
+    UINT64 State = 0x9E3779B97F4A7C15ULL;
+    double Times[4] = { 0 };
+    ULONG Mismatches = 0;
+    ULONG Unreferenced = 0;
+    BOOLEAN Passed = TRUE;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-functions") == 0 && Arg + 1 < argc) {
+            Functions = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-snapshot") == 0 && Arg + 1 < argc) {
+            SnapshotFile = argv[++Arg];
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Functions == 0 || Functions > 0x10000 || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Captures.resize((SIZE_T)Functions * PCIe_CFG_SIZE);
+    for (ULONG i = 0; i < Functions; i++)
+    {
+        Sizes.push_back(MakeCapture(Captures.data() + (SIZE_T)i * PCIe_CFG_SIZE, Templates[i % BENCH_TEMPLATES], &State));
+        RawBytes += Sizes[i];
+    }
+
+    //
+    // The last pass leaves the snapshot that is checked below.
+    //
+    for (ULONG Pass = 0; Pass < Passes; Pass++)
+    {
+        CConfigSnapshotWriter Writer;
+        CConfigSnapshotReader Reader;
+        double Begin = BenchNow();
+
+        if (Writer.Create(SnapshotFile, "HWSnapshotBench") != Success) {
+            printf("%s\n", Writer.GetStatusMessage().c_str());
+            return 1;
+        }
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            UINT8 Bus, Device, Function;
+
+            BenchLocateFunction(i, &Bus, &Device, &Function);
+            if (Writer.Append(Bus, Device, Function, Captures.data() + (SIZE_T)i * PCIe_CFG_SIZE, Sizes[i]) != Success) {
+                printf("%s\n", Writer.GetStatusMessage().c_str());
+                return 1;
+            }
+        }
+        if (Writer.Close() != Success) {
+            printf("%s\n", Writer.GetStatusMessage().c_str());
+            return 1;
+        }
+        Times[0] += BenchNow() - Begin;
+        FileBytes = Writer.GetEncodedBytes();
+
+        Begin = BenchNow();
+        if (Reader.Open(SnapshotFile) != Success) {
+            printf("%s\n", Reader.GetStatusMessage().c_str());
+            return 1;
+        }
+        Mismatches = 0;
+        Unreferenced = 0;
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            UINT8 Bus, Device, Function;
+
+            BenchLocateFunction(i, &Bus, &Device, &Function);
+            if (Reader.ReadRecord(Record, Data) != Success || Record.m_Bus != Bus || Record.m_Device != Device || Record.m_Function != Function ||
+                Record.m_VendorId != Templates[i % BENCH_TEMPLATES].m_VendorId || Record.m_RawSize != Sizes[i] || Data.size() != Sizes[i] ||
+                memcmp(Data.data(), Captures.data() + (SIZE_T)i * PCIe_CFG_SIZE, Sizes[i]) != 0) {
+                Mismatches++;
+            }
+            Unreferenced += (i >= BENCH_TEMPLATES && Record.m_ReferenceIndex == CONFIG_SNAPSHOT_NO_REFERENCE);
+        }
+        if (Reader.GetHeader().m_RecordCount != Functions || Reader.ReadRecord(Record, Data) == Success) {
+            Mismatches++;
+        }
+        Reader.Close();
+        Times[1] += BenchNow() - Begin;
+    }
+
+    //
+    // The codec alone, each capture against the previous one of its
+    // template as the writer does.
+    //
+    Encoded.resize((SIZE_T)Functions * CCfgSpaceCodec::MaxEncodedSize(PCIe_CFG_SIZE));
+    EncodedSizes.resize(Functions);
+    for (ULONG Pass = 0; Pass < Passes; Pass++)
+    {
+        double Begin = BenchNow();
+
+        CodecBytes = 0;
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            const UINT8* Reference = (i >= BENCH_TEMPLATES) ? Captures.data() + (SIZE_T)(i - BENCH_TEMPLATES) * PCIe_CFG_SIZE : NULL;
+
+            EncodedSizes[i] = CCfgSpaceCodec::Encode(Captures.data() + (SIZE_T)i * PCIe_CFG_SIZE, Sizes[i], Reference,
+                                                     Encoded.data() + (SIZE_T)i * CCfgSpaceCodec::MaxEncodedSize(PCIe_CFG_SIZE));
+            CodecBytes += EncodedSizes[i];
+        }
+        Times[2] += BenchNow() - Begin;
+
+        Begin = BenchNow();
+        for (ULONG i = 0; i < Functions; i++)
+        {
+            const UINT8* Reference = (i >= BENCH_TEMPLATES) ? Captures.data() + (SIZE_T)(i - BENCH_TEMPLATES) * PCIe_CFG_SIZE : NULL;
+
+            if (CCfgSpaceCodec::Decode(Encoded.data() + (SIZE_T)i * CCfgSpaceCodec::MaxEncodedSize(PCIe_CFG_SIZE), EncodedSizes[i], Reference,
+                                       Decoded.data(), Sizes[i]) != Success ||
+                memcmp(Decoded.data(), Captures.data() + (SIZE_T)i * PCIe_CFG_SIZE, Sizes[i]) != 0) {
+                Mismatches++;
+            }
+        }
+        Times[3] += BenchNow() - Begin;
+    }
+
+    printf("%u functions of %u templates, %u passes, %llu raw bytes\n", Functions, BENCH_TEMPLATES, Passes, (unsigned long long)RawBytes);
+    printf("%-16s%12s%12s%14s\n", "Step", "ms", "MB/s", "Bytes");
+    printf("%-16s%12.3f%12.1f%14llu\n", "snapshot write", Times[0] * 1e3, RawBytes * Passes / 1e6 / Times[0], (unsigned long long)FileBytes);
+    printf("%-16s%12.3f%12.1f%14llu\n", "snapshot read", Times[1] * 1e3, RawBytes * Passes / 1e6 / Times[1], (unsigned long long)FileBytes);
+    printf("%-16s%12.3f%12.1f%14llu\n", "encode", Times[2] * 1e3, RawBytes * Passes / 1e6 / Times[2], (unsigned long long)CodecBytes);
+    printf("%-16s%12.3f%12.1f%14llu\n", "decode", Times[3] * 1e3, RawBytes * Passes / 1e6 / Times[3], (unsigned long long)CodecBytes);
+    printf("Snapshot is %.1f%% of the raw captures\n", 100.0 * FileBytes / RawBytes);
+
+    if (Mismatches != 0 || Unreferenced != 0) {
+        printf("%u records did not read back, %u were encoded without a reference\n", Mismatches, Unreferenced);
+        Passed = FALSE;
+    }
+    if (FileBytes >= RawBytes / 2) {
+        printf("The snapshot holds %llu of %llu raw bytes\n", (unsigned long long)FileBytes, (unsigned long long)RawBytes);
+        Passed = FALSE;
+    }
+
+    //
+    // Random data is the worst case for the codec, and cutting its last
+    // byte must fail to decode.
+    //
+    {
+        std::vector<UINT8> Noise(PCIe_CFG_SIZE);
+        std::vector<UINT8> Output(CCfgSpaceCodec::MaxEncodedSize(PCIe_CFG_SIZE));
+        UINT32 Size;
+
+        for (auto& Byte : Noise)
+        {
+            Byte = (UINT8)(Random(&State) | 0x01);
+        }
+        Size = CCfgSpaceCodec::Encode(Noise.data(), PCIe_CFG_SIZE, NULL, Output.data());
+        if (Size == 0 || Size > Output.size() ||
+            CCfgSpaceCodec::Decode(Output.data(), Size, NULL, Decoded.data(), PCIe_CFG_SIZE) != Success ||
+            memcmp(Decoded.data(), Noise.data(), PCIe_CFG_SIZE) != 0 ||
+            CCfgSpaceCodec::Decode(Output.data(), Size - 1, NULL, Decoded.data(), PCIe_CFG_SIZE) == Success) {
+            printf("Random capture of 0x%x bytes encoded to %u bytes, at most %zu\n", PCIe_CFG_SIZE, Size, Output.size());
+            Passed = FALSE;
+        }
+    }
+
+    {
+        CConfigSnapshotWriter Writer;
+
+        if (Writer.Create(SnapshotFile, "HWSnapshotBench") != Success ||
+            Writer.Append(0, 0, 0, Captures.data(), PCIe_CFG_SIZE + sizeof(UINT32)) != IndexOutOfRange ||
+            Writer.Append(0, 0, 0, Captures.data(), 6) != IndexOutOfRange || Writer.Close() != Success) {
+            printf("A capture larger than 0x%x bytes or of 6 bytes was accepted\n", PCIe_CFG_SIZE);
+            Passed = FALSE;
+        }
+    }
+
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
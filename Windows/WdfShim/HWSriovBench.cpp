@@ -0,0 +1,283 @@
+/*++
+
+Module Name:
+
+    HWSriovBench.cpp
+
+Abstract:
+
+    Times CSriovEnumerator on a physical function with many virtual
+    functions against reading and keeping every VF capture.
+
+    The PF has an SR-IOV capability at 0x100 and its VFs sit where First
+    VF Offset and VF Stride put them, differing only in their subsystem
+    id, so their captures come in a few templates. The bench computes the
+    VF routing ids and captures 256 bytes and 4 KB of every VF, once kept
+    whole per VF and once through the enumerator, which keeps each
+    distinct capture once. It prints the time and the bytes kept of both.
+    Every VF must map to a capture holding its bytes, and NumVFs, VF
+    Enable, VF Stride, First VF Offset and the capture size must be
+    checked as documented.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "SriovEnumerator.h"
+
+#define BENCH_DEFAULT_VFS           2048
+#define BENCH_DEFAULT_PASSES        5
+#define BENCH_TEMPLATES             5
+#define BENCH_PF_BUS                1
+#define BENCH_FIRST_VF_OFFSET       0x100
+#define BENCH_VF_STRIDE             1
+#define BENCH_SRIOV_OFFSET          0x100
+#define BENCH_PF_DEVICE_ID          0x1572
+#define BENCH_VF_DEVICE_ID          0x154C
+
+static UINT16 VfRoutingId(ULONG Vf)
+{
+    return (UINT16)(SRIOV_ROUTING_ID(BENCH_PF_BUS, 0, 0) + BENCH_FIRST_VF_OFFSET + Vf * BENCH_VF_STRIDE);
+}
+
+static VOID SetSriov(UINT16 TotalVFs, UINT16 NumVFs, UINT16 FirstVfOffset, UINT16 VfStride, BOOLEAN VfEnable)
+{
+    PUINT8 Capability = SimFabricGetConfig(BENCH_PF_BUS, 0, 0) + BENCH_SRIOV_OFFSET;
+    UINT16 Control = VfEnable ? 1 : 0;
+    UINT16 VfDeviceId = BENCH_VF_DEVICE_ID;
+
+    memcpy(Capability + SriovControl::Offset, &Control, sizeof(Control));
+    memcpy(Capability + SriovTotalVFs::Offset, &TotalVFs, sizeof(TotalVFs));
+    memcpy(Capability + SriovNumVFs::Offset, &NumVFs, sizeof(NumVFs));
+    memcpy(Capability + SriovFirstVfOffset::Offset, &FirstVfOffset, sizeof(FirstVfOffset));
+    memcpy(Capability + SriovVfStride::Offset, &VfStride, sizeof(VfStride));
+    memcpy(Capability + SriovVfDeviceId::Offset, &VfDeviceId, sizeof(VfDeviceId));
+}
+
+//
+// The host bridge, the PF and its VFs, whose subsystem id is the
+// template they belong to.
+//
+static NTSTATUS BuildFabric(ULONG Vfs)
+{
+    NTSTATUS Status = BenchAddHostBridge();
+
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Status = SimFabricAddFunction(BENCH_PF_BUS, 0, 0, BENCH_VENDOR_ID, BENCH_PF_DEVICE_ID, 0x020000);
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddCapability(BENCH_PF_BUS, 0, 0, PCI_CAP_ID_PCIe, 0x50);
+    }
+    if (NT_SUCCESS(Status)) {
+        Status = SimFabricAddCapability(BENCH_PF_BUS, 0, 0, PCIe_EXT_CAP_ID_SRIOV, BENCH_SRIOV_OFFSET);
+    }
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+    SetSriov((UINT16)Vfs, (UINT16)Vfs, BENCH_FIRST_VF_OFFSET, BENCH_VF_STRIDE, TRUE);
+
+    for (ULONG Vf = 0; Vf < Vfs && NT_SUCCESS(Status); Vf++)
+    {
+        UINT16 RoutingId = VfRoutingId(Vf);
+        UINT16 SubsystemId = (UINT16)(Vf % BENCH_TEMPLATES);
+
+        Status = SimFabricAddFunction(SRIOV_ROUTING_ID_BUS(RoutingId), SRIOV_ROUTING_ID_DEVICE(RoutingId), SRIOV_ROUTING_ID_FUNCTION(RoutingId),
+                                      BENCH_VENDOR_ID, BENCH_VF_DEVICE_ID, 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddCapability(SRIOV_ROUTING_ID_BUS(RoutingId), SRIOV_ROUTING_ID_DEVICE(RoutingId),
+                                            SRIOV_ROUTING_ID_FUNCTION(RoutingId), PCI_CAP_ID_PCIe, 0x50);
+        }
+        if (NT_SUCCESS(Status)) {
+            memcpy(SimFabricGetConfig(SRIOV_ROUTING_ID_BUS(RoutingId), SRIOV_ROUTING_ID_DEVICE(RoutingId), SRIOV_ROUTING_ID_FUNCTION(RoutingId)) + 0x2E,
+                   &SubsystemId, sizeof(SubsystemId));
+        }
+    }
+    return Status;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWSriovBench [-vfs <Count>] [-passes <Count>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const UINT32 Sizes[] = { PCI_CFG_SIZE, PCIe_CFG_SIZE };
+    ULONG Vfs = BENCH_DEFAULT_VFS;
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    CHardwareInterfaceLib CHWLib;
+    std::vector<UINT16> RoutingIds;
+    std::vector<UINT8> Captures;
+    double RoutingTime = 0;
+    double Times[2][2] = { { 0 } };
+    SIZE_T Kept[2][2] = { { 0 } };
+    ULONG Failures = 0;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-vfs") == 0 && Arg + 1 < argc) {
+            Vfs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Vfs < 2 || SRIOV_ROUTING_ID(BENCH_PF_BUS, 0, 0) + BENCH_FIRST_VF_OFFSET + (Vfs - 1) * BENCH_VF_STRIDE > 0xFFFF || Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = BuildFabric(Vfs);
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    {
+        CSriovEnumerator Enumerator(CHWLib);
+        double Begin;
+
+        Begin = BenchNow();
+        for (ULONG Pass = 0; Pass < Passes; Pass++)
+        {
+            Failures += (Enumerator.GetVirtualFunctions(BENCH_PF_BUS, 0, 0, RoutingIds) != Success);
+        }
+        RoutingTime = BenchNow() - Begin;
+
+        Failures += (RoutingIds.size() != Vfs);
+        for (ULONG Vf = 0; Vf < RoutingIds.size(); Vf++)
+        {
+            Failures += (RoutingIds[Vf] != VfRoutingId(Vf));
+        }
+
+        //
+        // Mode 0 keeps the capture of every VF, mode 1 the distinct ones.
+        //
+        for (ULONG s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++)
+        {
+            Begin = BenchNow();
+            for (ULONG Pass = 0; Pass < Passes; Pass++)
+            {
+                Captures.clear();
+                Captures.resize((SIZE_T)RoutingIds.size() * Sizes[s]);
+                for (ULONG Vf = 0; Vf < RoutingIds.size(); Vf++)
+                {
+                    Failures += (CCapabilityWalker::LibRead(&CHWLib, SRIOV_ROUTING_ID_BUS(RoutingIds[Vf]), SRIOV_ROUTING_ID_DEVICE(RoutingIds[Vf]),
+                                                            SRIOV_ROUTING_ID_FUNCTION(RoutingIds[Vf]), 0, Captures.data() + (SIZE_T)Vf * Sizes[s],
+                                                            Sizes[s]) != Success);
+                }
+            }
+            Times[0][s] = BenchNow() - Begin;
+            Kept[0][s] = Captures.size();
+
+            Begin = BenchNow();
+            for (ULONG Pass = 0; Pass < Passes; Pass++)
+            {
+                if (Enumerator.Capture(BENCH_PF_BUS, 0, 0, Sizes[s]) != Success) {
+                    printf("%s\n", Enumerator.GetStatusMessage().c_str());
+                    Failures++;
+                }
+            }
+            Times[1][s] = BenchNow() - Begin;
+            Kept[1][s] = (SIZE_T)Enumerator.GetCaptureCount() * Enumerator.GetCaptureSize();
+
+            if (Enumerator.GetVfCount() != Vfs || Enumerator.GetCaptureCount() != ((Vfs < BENCH_TEMPLATES) ? Vfs : BENCH_TEMPLATES) ||
+                Enumerator.GetCaptureSize() != Sizes[s]) {
+                printf("%u VFs captured into %u captures of 0x%x bytes\n", Enumerator.GetVfCount(), Enumerator.GetCaptureCount(),
+                       Enumerator.GetCaptureSize());
+                Passed = FALSE;
+            }
+            for (ULONG Vf = 0; Vf < Enumerator.GetVfCount(); Vf++)
+            {
+                UINT16 RoutingId = Enumerator.GetRoutingId(Vf);
+
+                if (Enumerator.GetCaptureIndex(Vf) >= Enumerator.GetCaptureCount() ||
+                    memcmp(Enumerator.GetCapture(Enumerator.GetCaptureIndex(Vf)), Captures.data() + (SIZE_T)Vf * Sizes[s], Sizes[s]) != 0 ||
+                    memcmp(Captures.data() + (SIZE_T)Vf * Sizes[s], SimFabricGetConfig(SRIOV_ROUTING_ID_BUS(RoutingId),
+                           SRIOV_ROUTING_ID_DEVICE(RoutingId), SRIOV_ROUTING_ID_FUNCTION(RoutingId)), Sizes[s]) != 0) {
+                    printf("VF %u does not map to its capture of 0x%x bytes\n", Vf + 1, Sizes[s]);
+                    Passed = FALSE;
+                    break;
+                }
+            }
+        }
+
+        printf("1 PF with %u VFs in %u templates, %u passes\n", Vfs, BENCH_TEMPLATES, Passes);
+        printf("Routing ids: %.3f ms\n", RoutingTime * 1e3);
+        printf("%-14s%14s%14s%16s%16s\n", "Capture", "Every VF ms", "Distinct ms", "Every VF bytes", "Distinct bytes");
+        for (ULONG s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++)
+        {
+            printf("%-14u%14.3f%14.3f%16zu%16zu\n", Sizes[s], Times[0][s] * 1e3, Times[1][s] * 1e3, Kept[0][s], Kept[1][s]);
+        }
+        if (Failures != 0) {
+            printf("%u reads or routing ids failed\n", Failures);
+            Passed = FALSE;
+        }
+
+        //
+        // NumVFs is limited to TotalVFs, no VFs exist without VF Enable,
+        // a stride of 0 and VFs past bus 255 are refused, as is a capture
+        // size that is not a multiple of 4.
+        //
+        SetSriov((UINT16)(Vfs / 2), (UINT16)Vfs, BENCH_FIRST_VF_OFFSET, BENCH_VF_STRIDE, TRUE);
+        if (Enumerator.GetVirtualFunctions(BENCH_PF_BUS, 0, 0, RoutingIds) != Success || RoutingIds.size() != Vfs / 2) {
+            printf("NumVFs above TotalVFs gave %zu VFs\n", RoutingIds.size());
+            Passed = FALSE;
+        }
+        SetSriov((UINT16)Vfs, (UINT16)Vfs, BENCH_FIRST_VF_OFFSET, BENCH_VF_STRIDE, FALSE);
+        if (Enumerator.GetVirtualFunctions(BENCH_PF_BUS, 0, 0, RoutingIds) != Success || !RoutingIds.empty()) {
+            printf("VF Enable clear gave %zu VFs\n", RoutingIds.size());
+            Passed = FALSE;
+        }
+        SetSriov((UINT16)Vfs, (UINT16)Vfs, BENCH_FIRST_VF_OFFSET, 0, TRUE);
+        if (Enumerator.GetVirtualFunctions(BENCH_PF_BUS, 0, 0, RoutingIds) != Failure) {
+            printf("A VF Stride of 0 was accepted\n");
+            Passed = FALSE;
+        }
+        SetSriov((UINT16)Vfs, (UINT16)Vfs, 0xFFFF, BENCH_VF_STRIDE, TRUE);
+        if (Enumerator.GetVirtualFunctions(BENCH_PF_BUS, 0, 0, RoutingIds) != IndexOutOfRange || !RoutingIds.empty()) {
+            printf("VFs past bus 255 were accepted\n");
+            Passed = FALSE;
+        }
+        SetSriov((UINT16)Vfs, (UINT16)Vfs, BENCH_FIRST_VF_OFFSET, BENCH_VF_STRIDE, TRUE);
+        if (Enumerator.Capture(BENCH_PF_BUS, 0, 0, 6) != IndexOutOfRange || Enumerator.GetVfCount() != 0 || Enumerator.GetCaptureCount() != 0) {
+            printf("A capture of 6 bytes was accepted\n");
+            Passed = FALSE;
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
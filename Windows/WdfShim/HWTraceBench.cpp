@@ -0,0 +1,324 @@
+/*++
+
+Module Name:
+
+    HWTraceBench.cpp
+
+Abstract:
+
+    Records the register accesses of a tool workload with
+    CAccessTraceRecorder and replays them with CAccessTraceReplayer.
+
+    The workload enumerates the functions, enables memory decoding, dumps
+    each BAR, runs a register script per function and then polls status
+    registers in rounds with a millisecond between them, the way the dump,
+    capture and health commands use the library.
+
+    The workload first runs alternately with and without the recorder to
+    measure what recording costs per access. A recorded run with the
+    polling gaps is then replayed at maximum speed several times, which
+    is the regression benchmark, and once at original speed. Every replay
+    must return the recorded status for every access and make exactly the
+    configuration, MMIO and mapping accesses on the fabric that the
+    recorded run made.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "Win32Shim.h"
+#include "BenchCommon.h"
+#include "AccessTrace.h"
+#include "RegScriptBuilder.h"
+
+#define BENCH_FUNCTIONS             8
+#define BENCH_BAR_BASE              0x80000000ULL
+#define BENCH_BAR_SIZE              0x10000
+#define BENCH_POLL_ROUNDS           20
+#define BENCH_POLL_REGISTERS        4
+#define BENCH_OVERHEAD_RUNS         101
+#define BENCH_DEFAULT_PASSES        5
+#define BENCH_DEFAULT_TRACE         "HWTraceBench.hwt"
+
+static UINT64 BarOf(UINT8 Device)
+{
+    return BENCH_BAR_BASE + (UINT64)Device * BENCH_BAR_SIZE;
+}
+
+//
+// Runs the workload once, Gaps sleeps a millisecond between poll rounds.
+// Returns the number of calls that failed.
+//
+static ULONG RunWorkload(CHardwareInterfaceLib& CHWLib, BOOLEAN Gaps, std::vector<UINT8>& Buffer)
+{
+    ULONG Failures = 0;
+
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS; Device++)
+    {
+        PCI_PCIeCfgData CfgData;
+        UINT32 ClassCode = 0;
+        UINT32 Bar0 = 0;
+
+        CfgData.m_Bus = 0;
+        CfgData.m_Device = Device;
+        CfgData.m_Function = 0;
+        CfgData.m_Offset = 0;
+        CfgData.OutputData.DataPointer = Buffer.data();
+        CfgData.OutputData.m_Size = PCI_CFG_SIZE;
+        Failures += (CHWLib.PCIStdCfgRead(&CfgData) != Success);
+        Failures += (CHWLib.ReadField<PciClassCode>(0, Device, 0, ClassCode) != Success || ClassCode != 0x020000);
+        Failures += (CHWLib.ReadRegister<PciBar0>(0, Device, 0, Bar0) != Success);
+        Failures += (CHWLib.WriteField<PciCommandMemorySpace>(0, Device, 0, 1) != Success);
+    }
+
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS; Device++)
+    {
+        Failures += (CHWLib.PCIeBarRead(BarOf(Device), 0, Buffer.data(), BENCH_BAR_SIZE) != Success);
+    }
+
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS; Device++)
+    {
+        CRegScriptBuilder Script(0, Device, 0, BarOf(Device));
+
+        Script.Read(REG_SCRIPT_SPACE_PCI_CFG, 0x00, sizeof(UINT32));
+        for (UINT32 Register = 0; Register < BENCH_POLL_REGISTERS; Register++)
+        {
+            Script.Read(REG_SCRIPT_SPACE_MMIO, Register * sizeof(UINT32), sizeof(UINT32));
+        }
+        Failures += (Script.Execute(CHWLib) != Success);
+    }
+
+    for (ULONG Round = 0; Round < BENCH_POLL_ROUNDS; Round++)
+    {
+        for (UINT8 Device = 0; Device < BENCH_FUNCTIONS; Device++)
+        {
+            UINT16 Status = 0;
+
+            Failures += (CHWLib.ReadRegister<PciStatus>(0, Device, 0, Status) != Success);
+            for (UINT32 Register = 0; Register < BENCH_POLL_REGISTERS; Register++)
+            {
+                PCIeMMIOData MmioData;
+                UINT32 Value = 0;
+
+                MmioData.m_BaseAddressRegister = BarOf(Device);
+                MmioData.m_Offset = Register * sizeof(UINT32);
+                MmioData.OutputData.DataPointer = (PUINT8)&Value;
+                MmioData.OutputData.m_Size = sizeof(Value);
+                Failures += (CHWLib.PCIeMMIORead(&MmioData) != Success || Value != Register);
+            }
+        }
+        if (Gaps) {
+            Sleep(1);
+        }
+    }
+
+    return Failures;
+}
+
+static BOOLEAN SameAccesses(const SIM_FABRIC_COUNTERS* Recorded, const SIM_FABRIC_COUNTERS* Replayed)
+{
+    return Recorded->ConfigReads == Replayed->ConfigReads && Recorded->ConfigReadBytes == Replayed->ConfigReadBytes &&
+           Recorded->ConfigWrites == Replayed->ConfigWrites && Recorded->MmioReads == Replayed->MmioReads &&
+           Recorded->MmioReadBytes == Replayed->MmioReadBytes && Recorded->Maps == Replayed->Maps &&
+           Recorded->MappedBytes == Replayed->MappedBytes;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: HWTraceBench [-passes <Count>] [-trace <File>] [-config-latency <ns>] [-mmio-latency <ns>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static const char* OperationNames[AccessTraceOperationCount] = { "", "StdCfgRead", "ExCfgRead", "MMIORead", "BarRead", "RegScript" };
+    ULONG Passes = BENCH_DEFAULT_PASSES;
+    const char* TraceFile = BENCH_DEFAULT_TRACE;
+    SIM_FABRIC_LATENCY Latency = { 0, 0, 0 };
+    SIM_FABRIC_COUNTERS Recorded;
+    SIM_FABRIC_COUNTERS Replayed;
+    CHardwareInterfaceLib CHWLib;
+    CAccessTraceRecorder Recorder;
+    CAccessTraceReplayer Replayer;
+    AccessTraceReplayStatistics Statistics;
+    std::vector<UINT8> Buffer(BENCH_BAR_SIZE);
+    std::vector<double> PlainRuns;
+    std::vector<double> TracedRuns;
+    std::vector<double> Elapsed;
+    UINT64 Accesses = 0;
+    LARGE_INTEGER TraceSize;
+    HANDLE File;
+    BOOLEAN Passed = TRUE;
+    NTSTATUS Status;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc) {
+            Passes = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-trace") == 0 && Arg + 1 < argc) {
+            TraceFile = argv[++Arg];
+        }
+        else if (strcmp(argv[Arg], "-config-latency") == 0 && Arg + 1 < argc) {
+            Latency.ConfigNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-mmio-latency") == 0 && Arg + 1 < argc) {
+            Latency.MmioNs = strtoul(argv[++Arg], NULL, 0);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (Passes == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    Status = STATUS_SUCCESS;
+    for (UINT8 Device = 0; Device < BENCH_FUNCTIONS && NT_SUCCESS(Status); Device++)
+    {
+        Status = SimFabricAddFunction(0, Device, 0, BENCH_VENDOR_ID, (USHORT)(BENCH_DEVICE_ID + Device), 0x020000);
+        if (NT_SUCCESS(Status)) {
+            Status = SimFabricAddBar(0, Device, 0, 0, BarOf(Device), BENCH_BAR_SIZE);
+        }
+    }
+    if (!NT_SUCCESS(Status)) {
+        printf("Building the simulated fabric failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    SimFabricSetLatency(&Latency);
+
+    Status = Win32ShimLoadDriver();
+    if (!NT_SUCCESS(Status)) {
+        printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    if (CHWLib.CHardwareInterfaceLibInitialise() != Success) {
+        printf("%s\n", CHWLib.GetStatusMessage().c_str());
+        return 1;
+    }
+
+    //
+    // Recording cost. The recorder is attached to every other run of the
+    // workload without gaps, so drift of the host affects both alike, and
+    // the medians are compared. The traced runs fill more than one buffer.
+    //
+    if (Recorder.Start(TraceFile) != Success) {
+        printf("%s\n", Recorder.GetStatusMessage().c_str());
+        return 1;
+    }
+    for (ULONG Run = 0; Run < 2 * BENCH_OVERHEAD_RUNS; Run++)
+    {
+        BOOLEAN Traced = (Run % 2 == 1);
+        ULONG Failures;
+        double Begin;
+
+        CHWLib.SetTraceRecorder(Traced ? &Recorder : NULL);
+        Begin = BenchNow();
+        Failures = RunWorkload(CHWLib, FALSE, Buffer);
+        (Traced ? TracedRuns : PlainRuns).push_back(BenchNow() - Begin);
+        if (Failures != 0) {
+            printf("Workload: %u calls failed\n", Failures);
+            Passed = FALSE;
+        }
+    }
+    CHWLib.SetTraceRecorder(NULL);
+    if (Recorder.Stop() != Success) {
+        printf("%s\n", Recorder.GetStatusMessage().c_str());
+        Passed = FALSE;
+    }
+    Accesses = Recorder.GetRecordCount() / BENCH_OVERHEAD_RUNS;
+
+    std::sort(PlainRuns.begin(), PlainRuns.end());
+    std::sort(TracedRuns.begin(), TracedRuns.end());
+    printf("%u functions, %llu accesses per run, latency config %u ns, MMIO %u ns\n", BENCH_FUNCTIONS,
+           (unsigned long long)Accesses, Latency.ConfigNs, Latency.MmioNs);
+    printf("Recording: %.1f us per run untraced, %.1f us traced, %.0f ns per access\n", PlainRuns[BENCH_OVERHEAD_RUNS / 2] * 1e6,
+           TracedRuns[BENCH_OVERHEAD_RUNS / 2] * 1e6, (TracedRuns[BENCH_OVERHEAD_RUNS / 2] - PlainRuns[BENCH_OVERHEAD_RUNS / 2]) * 1e9 / Accesses);
+
+    //
+    // The trace that is replayed, with the gaps of the poll rounds.
+    //
+    if (Recorder.Start(TraceFile) != Success) {
+        printf("%s\n", Recorder.GetStatusMessage().c_str());
+        return 1;
+    }
+    CHWLib.SetTraceRecorder(&Recorder);
+    SimFabricResetCounters();
+    if (RunWorkload(CHWLib, TRUE, Buffer) != 0) {
+        Passed = FALSE;
+    }
+    SimFabricGetCounters(&Recorded);
+    CHWLib.SetTraceRecorder(NULL);
+    if (Recorder.Stop() != Success || Replayer.Open(TraceFile) != Success) {
+        printf("%s%s\n", Recorder.GetStatusMessage().c_str(), Replayer.GetStatusMessage().c_str());
+        return 1;
+    }
+    TraceSize.QuadPart = 0;
+    File = CreateFileA(TraceFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (File != INVALID_HANDLE_VALUE) {
+        GetFileSizeEx(File, &TraceSize);
+        CloseHandle(File);
+    }
+    printf("Trace: %llu records, %llu bytes, %.3f ms\n", (unsigned long long)Replayer.GetHeader().m_RecordCount,
+           (unsigned long long)TraceSize.QuadPart, (double)Replayer.GetHeader().m_Duration * 1e3 / Replayer.GetHeader().m_Frequency);
+
+    printf("%-14s%12s%12s%11s%9s\n", "Replay", "ms", "Accesses", "Mismatch", "Fabric");
+    for (ULONG Pass = 0; Pass <= Passes; Pass++)
+    {
+        BOOLEAN OriginalSpeed = (Pass == Passes);
+        char Name[32];
+
+        SimFabricResetCounters();
+        if (Replayer.Replay(CHWLib, OriginalSpeed, true, Statistics) != Success) {
+            printf("%s\n", Replayer.GetStatusMessage().c_str());
+            return 1;
+        }
+        SimFabricGetCounters(&Replayed);
+        if (!OriginalSpeed) {
+            Elapsed.push_back((double)Statistics.m_ElapsedNs / 1e6);
+        }
+
+        if (OriginalSpeed) {
+            snprintf(Name, sizeof(Name), "original");
+        }
+        else {
+            snprintf(Name, sizeof(Name), "max %u", Pass);
+        }
+        printf("%-14s%12.3f%12llu%11llu%9s\n", Name, (double)Statistics.m_ElapsedNs / 1e6, (unsigned long long)Statistics.m_Replayed,
+               (unsigned long long)Statistics.m_Mismatches, SameAccesses(&Recorded, &Replayed) ? "same" : "DIFFERENT");
+        if (Statistics.m_Replayed != Replayer.GetHeader().m_RecordCount || Statistics.m_Mismatches != 0 || !SameAccesses(&Recorded, &Replayed)) {
+            Passed = FALSE;
+        }
+    }
+
+    std::sort(Elapsed.begin(), Elapsed.end());
+    printf("Max speed: median %.3f ms, spread %.1f%%, recorded %.3f ms\n", Elapsed[Elapsed.size() / 2],
+           (Elapsed.back() - Elapsed.front()) * 100 / Elapsed[Elapsed.size() / 2], (double)Statistics.m_RecordedNs / 1e6);
+    for (UINT32 Operation = 1; Operation < AccessTraceOperationCount; Operation++)
+    {
+        const AccessTraceOperationStatistics& Counters = Statistics.m_Operations[Operation];
+
+        if (Counters.m_Count != 0) {
+            printf("  %-12s%8llu accesses %8.2f us replayed %8.2f us recorded\n", OperationNames[Operation], (unsigned long long)Counters.m_Count,
+                   (double)Counters.m_ReplayedNs / Counters.m_Count / 1000, (double)Counters.m_RecordedNs / Counters.m_Count / 1000);
+        }
+    }
+
+    CHWLib.CHardwareInterfaceLibUninitialise();
+    Win32ShimUnloadDriver();
+    if (SimFabricGetLiveMappings() != 0) {
+        printf("%u mappings leaked\n", SimFabricGetLiveMappings());
+        Passed = FALSE;
+    }
+    printf("%s\n", Passed ? "PASSED" : "FAILED");
+    return Passed ? 0 : 1;
+}
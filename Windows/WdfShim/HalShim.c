@@ -0,0 +1,697 @@
+/*++
+
+Module Name:
+
+    HalShim.c
+
+Abstract:
+
+    User mode stand-ins for the HAL configuration space routines, the
+    memory manager MMIO mapping routines, the register access routines,
+    pool and delays, all served by a simulated PCI fabric.
+
+    Configuration space follows a type 0 header: only the command register,
+    cache line size, latency timer, interrupt line and implemented BARs are
+    writable, BARs read back their size mask after all ones are written.
+    The decoded window of a BAR stays where SimFabricAddBar put it.
+    MmMapIoSpace returns the backing memory of the BAR holding the range,
+    or a buffer of all ones for a range no BAR claims, as a master abort
+    would read.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "SimFabric.h"
+
+#define SIM_BDF(Bus, Device, Function)      ((((ULONG)(Bus) & 0xFF) << 8) | (((ULONG)(Device) & 0x1F) << 3) | ((ULONG)(Function) & 0x07))
+#define SIM_CFG_SIZE                        0x1000
+#define SIM_STD_CFG_SIZE                    0x100
+#define SIM_BAR_COUNT                       6
+#define SIM_BAR_OFFSET                      0x10
+#define SIM_BAR_64BIT                       0x04
+#define SIM_ECAM_SIZE                       0x10000000ULL
+#define SIM_STATUS_CAPABILITIES             0x10
+#define SIM_CAPABILITIES_POINTER            0x34
+
+typedef struct _SIM_FUNCTION {
+    UCHAR Config[SIM_CFG_SIZE];
+    ULONG64 BarSize[SIM_BAR_COUNT];
+    BOOLEAN BarUpper[SIM_BAR_COUNT];
+} SIM_FUNCTION, *PSIM_FUNCTION;
+
+//
+// BAR windows sorted by base.
+//
+typedef struct _SIM_REGION {
+    ULONG64 Base;
+    ULONG64 Size;
+    PUCHAR Backing;
+} SIM_REGION, *PSIM_REGION;
+
+typedef struct _SIM_MAPPING {
+    struct _SIM_MAPPING* Next;
+    struct _SIM_MAPPING* Previous;
+    PVOID Address;
+    SIZE_T Size;
+    PUCHAR Allocated;
+} SIM_MAPPING, *PSIM_MAPPING;
+
+static PSIM_FUNCTION SimFunctions[0x10000];
+static PSIM_REGION SimRegions = NULL;
+static ULONG SimRegionCount = 0;
+static PSIM_MAPPING SimMappings = NULL;
+static ULONG SimMappingCount = 0;
+static pthread_mutex_t SimMappingLock = PTHREAD_MUTEX_INITIALIZER;
+static ULONG64 SimEcamBase = 0;
+static LONG SimFailConfigWrite = -1;
+static SIM_FABRIC_LATENCY SimLatency;
+static SIM_FABRIC_COUNTERS SimCounters;
+
+#define SIM_COUNT(Counter, Value)           __atomic_fetch_add(&SimCounters.Counter, (Value), __ATOMIC_RELAXED)
+
+static ULONG64 SimNow(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (ULONG64)Time.tv_sec * 1000000000ULL + (ULONG64)Time.tv_nsec;
+}
+
+static VOID SimSpin(ULONG64 Nanoseconds)
+{
+    ULONG64 End;
+
+    if (Nanoseconds == 0) {
+        return;
+    }
+    End = SimNow() + Nanoseconds;
+    while (SimNow() < End) {
+    }
+}
+
+static PSIM_FUNCTION SimFindFunction(ULONG Bus, ULONG SlotNumber)
+{
+    PCI_SLOT_NUMBER Slot;
+
+    if (Bus > 0xFF) {
+        return NULL;
+    }
+    Slot.u.AsULONG = SlotNumber;
+    return SimFunctions[SIM_BDF(Bus, Slot.u.bits.DeviceNumber, Slot.u.bits.FunctionNumber)];
+}
+
+static PSIM_REGION SimFindRegion(ULONG64 Address, ULONG64 Length)
+{
+    ULONG Low = 0, High = SimRegionCount;
+
+    while (Low < High) {
+        ULONG Middle = (Low + High) / 2;
+
+        if (SimRegions[Middle].Base <= Address) {
+            Low = Middle + 1;
+        }
+        else {
+            High = Middle;
+        }
+    }
+    if (Low == 0) {
+        return NULL;
+    }
+    Low--;
+    if (Address - SimRegions[Low].Base >= SimRegions[Low].Size || Length > SimRegions[Low].Size - (Address - SimRegions[Low].Base)) {
+        return NULL;
+    }
+    return &SimRegions[Low];
+}
+
+//
+// Function whose configuration space holds the ECAM range, NULL if the
+// range is outside the window, crosses a function or the slot is empty.
+//
+static PSIM_FUNCTION SimFindEcamFunction(ULONG64 Address, ULONG64 Length)
+{
+    if (SimEcamBase == 0 || Address < SimEcamBase || Address - SimEcamBase >= SIM_ECAM_SIZE ||
+        Length > SIM_CFG_SIZE - (Address & (SIM_CFG_SIZE - 1))) {
+        return NULL;
+    }
+    return SimFunctions[(Address - SimEcamBase) / SIM_CFG_SIZE];
+}
+
+//
+// Writes one byte with the header's write rules. A BAR dword is rebuilt
+// from its bytes and masked to its size, so writing all ones reads back
+// the size mask.
+//
+static VOID SimWriteConfigByte(PSIM_FUNCTION Function, ULONG Offset, UCHAR Value)
+{
+    if (Offset >= SIM_BAR_OFFSET && Offset < SIM_BAR_OFFSET + SIM_BAR_COUNT * sizeof(ULONG)) {
+        ULONG Bar = (Offset - SIM_BAR_OFFSET) / sizeof(ULONG);
+        ULONG DwordOffset = SIM_BAR_OFFSET + Bar * sizeof(ULONG);
+        ULONG Original, Dword;
+
+        memcpy(&Original, &Function->Config[DwordOffset], sizeof(Original));
+        Dword = Original;
+        ((PUCHAR)&Dword)[Offset - DwordOffset] = Value;
+        if (Function->BarUpper[Bar]) {
+            Dword &= (ULONG)(~(Function->BarSize[Bar - 1] - 1) >> 32);
+        }
+        else if (Function->BarSize[Bar] != 0) {
+            Dword = (Dword & (ULONG)~(Function->BarSize[Bar] - 1) & ~0x0FU) | (Original & 0x0F);
+        }
+        else {
+            return;
+        }
+        memcpy(&Function->Config[DwordOffset], &Dword, sizeof(Dword));
+        return;
+    }
+
+    switch (Offset)
+    {
+    case 0x04:
+    case 0x05:
+    case 0x0C:
+    case 0x0D:
+    case 0x3C:
+        Function->Config[Offset] = Value;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// Pool and delays.
+//
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    return malloc(NumberOfBytes);
+}
+
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    free(P);
+}
+
+VOID KeStallExecutionProcessor(ULONG MicroSeconds)
+{
+    SimSpin((ULONG64)MicroSeconds * 1000);
+}
+
+NTSTATUS KeDelayExecutionThread(KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Interval)
+{
+    LONGLONG Hundreds = (Interval->QuadPart < 0) ? -Interval->QuadPart : Interval->QuadPart;
+    struct timespec Time;
+
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    Time.tv_sec = (time_t)(Hundreds / 10000000);
+    Time.tv_nsec = (long)(Hundreds % 10000000) * 100;
+    nanosleep(&Time, NULL);
+    return STATUS_SUCCESS;
+}
+
+//
+// Configuration space. An empty slot reads as PCI_INVALID_VENDORID, the
+// HAL returns 2 for it.
+//
+ULONG HalGetBusDataByOffset(BUS_DATA_TYPE BusDataType, ULONG BusNumber, ULONG SlotNumber, PVOID Buffer, ULONG Offset, ULONG Length)
+{
+    PSIM_FUNCTION Function = NULL;
+
+    if (BusDataType != PCIConfiguration) {
+        return 0;
+    }
+    SIM_COUNT(ConfigReads, 1);
+    SimSpin(SimLatency.ConfigNs);
+
+    Function = SimFindFunction(BusNumber, SlotNumber);
+    if (Function == NULL) {
+        if (Length < sizeof(USHORT)) {
+            return 0;
+        }
+        memset(Buffer, 0xFF, sizeof(USHORT));
+        SIM_COUNT(ConfigReadBytes, sizeof(USHORT));
+        return sizeof(USHORT);
+    }
+    if (Offset >= SIM_STD_CFG_SIZE) {
+        return 0;
+    }
+    if (Length > SIM_STD_CFG_SIZE - Offset) {
+        Length = SIM_STD_CFG_SIZE - Offset;
+    }
+    memcpy(Buffer, &Function->Config[Offset], Length);
+    SIM_COUNT(ConfigReadBytes, Length);
+    return Length;
+}
+
+ULONG HalSetBusDataByOffset(BUS_DATA_TYPE BusDataType, ULONG BusNumber, ULONG SlotNumber, PVOID Buffer, ULONG Offset, ULONG Length)
+{
+    PSIM_FUNCTION Function = NULL;
+    ULONG i;
+
+    if (BusDataType != PCIConfiguration) {
+        return 0;
+    }
+    SIM_COUNT(ConfigWrites, 1);
+    SimSpin(SimLatency.ConfigNs);
+
+    if (SimFailConfigWrite >= 0 && SimFailConfigWrite-- == 0) {
+        return 0;
+    }
+
+    Function = SimFindFunction(BusNumber, SlotNumber);
+    if (Function == NULL || Offset >= SIM_STD_CFG_SIZE) {
+        return 0;
+    }
+    if (Length > SIM_STD_CFG_SIZE - Offset) {
+        Length = SIM_STD_CFG_SIZE - Offset;
+    }
+    for (i = 0; i < Length; i++)
+    {
+        SimWriteConfigByte(Function, Offset + i, ((PUCHAR)Buffer)[i]);
+    }
+    SIM_COUNT(ConfigWriteBytes, Length);
+    return Length;
+}
+
+//
+// MMIO mappings.
+//
+PVOID MmMapIoSpace(PHYSICAL_ADDRESS PhysicalAddress, SIZE_T NumberOfBytes, MEMORY_CACHING_TYPE CacheType)
+{
+    PSIM_FUNCTION Function = NULL;
+    PSIM_REGION Region = NULL;
+    PSIM_MAPPING Mapping = NULL;
+
+    UNREFERENCED_PARAMETER(CacheType);
+
+    if (NumberOfBytes == 0) {
+        return NULL;
+    }
+    SIM_COUNT(Maps, 1);
+    SIM_COUNT(MappedBytes, NumberOfBytes);
+    SimSpin(SimLatency.MapNs);
+
+    Mapping = (PSIM_MAPPING)calloc(1, sizeof(SIM_MAPPING));
+    if (Mapping == NULL) {
+        return NULL;
+    }
+    Function = SimFindEcamFunction((ULONG64)PhysicalAddress.QuadPart, NumberOfBytes);
+    Region = (Function == NULL) ? SimFindRegion((ULONG64)PhysicalAddress.QuadPart, NumberOfBytes) : NULL;
+    if (Function != NULL) {
+        Mapping->Address = &Function->Config[(ULONG64)PhysicalAddress.QuadPart & (SIM_CFG_SIZE - 1)];
+    }
+    else if (Region != NULL) {
+        Mapping->Address = Region->Backing + ((ULONG64)PhysicalAddress.QuadPart - Region->Base);
+    }
+    else {
+        if (NumberOfBytes > SIM_FABRIC_MAX_BAR_SIZE) {
+            free(Mapping);
+            return NULL;
+        }
+        Mapping->Allocated = (PUCHAR)malloc(NumberOfBytes);
+        if (Mapping->Allocated == NULL) {
+            free(Mapping);
+            return NULL;
+        }
+        memset(Mapping->Allocated, 0xFF, NumberOfBytes);
+        Mapping->Address = Mapping->Allocated;
+    }
+    Mapping->Size = NumberOfBytes;
+
+    //
+    // New mappings go to the head, a request unmaps what it mapped last.
+    //
+    pthread_mutex_lock(&SimMappingLock);
+    Mapping->Next = SimMappings;
+    if (SimMappings != NULL) {
+        SimMappings->Previous = Mapping;
+    }
+    SimMappings = Mapping;
+    SimMappingCount++;
+    pthread_mutex_unlock(&SimMappingLock);
+
+    return Mapping->Address;
+}
+
+VOID MmUnmapIoSpace(PVOID BaseAddress, SIZE_T NumberOfBytes)
+{
+    PSIM_MAPPING Mapping = NULL;
+
+    SIM_COUNT(Unmaps, 1);
+    SimSpin(SimLatency.MapNs);
+
+    pthread_mutex_lock(&SimMappingLock);
+    for (Mapping = SimMappings; Mapping != NULL; Mapping = Mapping->Next)
+    {
+        if (Mapping->Address == BaseAddress && Mapping->Size == NumberOfBytes) {
+            break;
+        }
+    }
+    ASSERT(Mapping != NULL);
+    if (Mapping != NULL) {
+        if (Mapping->Previous != NULL) {
+            Mapping->Previous->Next = Mapping->Next;
+        }
+        else {
+            SimMappings = Mapping->Next;
+        }
+        if (Mapping->Next != NULL) {
+            Mapping->Next->Previous = Mapping->Previous;
+        }
+        SimMappingCount--;
+    }
+    pthread_mutex_unlock(&SimMappingLock);
+
+    if (Mapping != NULL) {
+        free(Mapping->Allocated);
+        free(Mapping);
+    }
+}
+
+//
+// Register access.
+//
+UCHAR READ_REGISTER_UCHAR(volatile UCHAR* Register)
+{
+    SIM_COUNT(MmioReads, 1);
+    SIM_COUNT(MmioReadBytes, sizeof(UCHAR));
+    SimSpin(SimLatency.MmioNs);
+    return *Register;
+}
+
+USHORT READ_REGISTER_USHORT(volatile USHORT* Register)
+{
+    SIM_COUNT(MmioReads, 1);
+    SIM_COUNT(MmioReadBytes, sizeof(USHORT));
+    SimSpin(SimLatency.MmioNs);
+    return *Register;
+}
+
+ULONG READ_REGISTER_ULONG(volatile ULONG* Register)
+{
+    SIM_COUNT(MmioReads, 1);
+    SIM_COUNT(MmioReadBytes, sizeof(ULONG));
+    SimSpin(SimLatency.MmioNs);
+    return *Register;
+}
+
+ULONG64 READ_REGISTER_ULONG64(volatile ULONG64* Register)
+{
+    SIM_COUNT(MmioReads, 1);
+    SIM_COUNT(MmioReadBytes, sizeof(ULONG64));
+    SimSpin(SimLatency.MmioNs);
+    return *Register;
+}
+
+VOID READ_REGISTER_BUFFER_UCHAR(volatile UCHAR* Register, PUCHAR Buffer, ULONG Count)
+{
+    SIM_COUNT(MmioReads, Count);
+    SIM_COUNT(MmioReadBytes, Count);
+    SimSpin((ULONG64)SimLatency.MmioNs * Count);
+    memcpy(Buffer, (const void*)Register, Count);
+}
+
+VOID READ_REGISTER_BUFFER_ULONG(volatile ULONG* Register, PULONG Buffer, ULONG Count)
+{
+    SIM_COUNT(MmioReads, Count);
+    SIM_COUNT(MmioReadBytes, (ULONG64)Count * sizeof(ULONG));
+    SimSpin((ULONG64)SimLatency.MmioNs * Count);
+    memcpy(Buffer, (const void*)Register, (SIZE_T)Count * sizeof(ULONG));
+}
+
+VOID READ_REGISTER_BUFFER_ULONG64(volatile ULONG64* Register, ULONG64* Buffer, ULONG Count)
+{
+    SIM_COUNT(MmioReads, Count);
+    SIM_COUNT(MmioReadBytes, (ULONG64)Count * sizeof(ULONG64));
+    SimSpin((ULONG64)SimLatency.MmioNs * Count);
+    memcpy(Buffer, (const void*)Register, (SIZE_T)Count * sizeof(ULONG64));
+}
+
+VOID WRITE_REGISTER_UCHAR(volatile UCHAR* Register, UCHAR Value)
+{
+    SIM_COUNT(MmioWrites, 1);
+    *Register = Value;
+}
+
+VOID WRITE_REGISTER_USHORT(volatile USHORT* Register, USHORT Value)
+{
+    SIM_COUNT(MmioWrites, 1);
+    *Register = Value;
+}
+
+//
+// Writes are posted, they cost no latency.
+//
+VOID WRITE_REGISTER_ULONG(volatile ULONG* Register, ULONG Value)
+{
+    SIM_COUNT(MmioWrites, 1);
+    *Register = Value;
+}
+
+//
+// Fabric.
+//
+NTSTATUS SimFabricAddFunction(UINT8 Bus, UINT8 Device, UINT8 Function, USHORT VendorId, USHORT DeviceId, ULONG ClassCode)
+{
+    PSIM_FUNCTION Entry = NULL;
+    ULONG ClassRevision = ClassCode << 8;
+
+    if (Device > 0x1F || Function > 0x07) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (SimFunctions[SIM_BDF(Bus, Device, Function)] != NULL) {
+        return STATUS_OBJECT_NAME_EXISTS;
+    }
+    Entry = (PSIM_FUNCTION)calloc(1, sizeof(SIM_FUNCTION));
+    if (Entry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    memcpy(&Entry->Config[0x00], &VendorId, sizeof(VendorId));
+    memcpy(&Entry->Config[0x02], &DeviceId, sizeof(DeviceId));
+    memcpy(&Entry->Config[0x08], &ClassRevision, sizeof(ClassRevision));
+    SimFunctions[SIM_BDF(Bus, Device, Function)] = Entry;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS SimFabricAddBar(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar, ULONG64 Base, ULONG64 Size)
+{
+    PSIM_FUNCTION Entry = SimFunctions[SIM_BDF(Bus, Device, Function)];
+    BOOLEAN Is64Bit = (Base + Size - 1 > 0xFFFFFFFF);
+    PSIM_REGION Regions = NULL;
+    PUCHAR Backing = NULL;
+    ULONG Position = 0;
+    ULONG Dword;
+    ULONG64 i;
+
+    if (Entry == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+    if (Size < 0x10 || Size > SIM_FABRIC_MAX_BAR_SIZE || (Size & (Size - 1)) != 0 || (Base & (Size - 1)) != 0 ||
+        Bar + (Is64Bit ? 1 : 0) >= SIM_BAR_COUNT || Entry->BarSize[Bar] != 0 || Entry->BarUpper[Bar] ||
+        (Is64Bit && (Entry->BarSize[Bar + 1] != 0 || Entry->BarUpper[Bar + 1]))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (SimFindRegion(Base, 1) != NULL || SimFindRegion(Base + Size - 1, 1) != NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Backing = (PUCHAR)malloc(Size);
+    Regions = (PSIM_REGION)realloc(SimRegions, (SimRegionCount + 1) * sizeof(SIM_REGION));
+    if (Backing == NULL || Regions == NULL) {
+        free(Backing);
+        if (Regions != NULL) {
+            SimRegions = Regions;
+        }
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    SimRegions = Regions;
+    for (i = 0; i < Size; i += sizeof(ULONG))
+    {
+        Dword = ((ULONG)Bar << 28) | (ULONG)((i / sizeof(ULONG)) & 0x0FFFFFFF);
+        memcpy(Backing + i, &Dword, sizeof(Dword));
+    }
+
+    while (Position < SimRegionCount && SimRegions[Position].Base < Base) {
+        Position++;
+    }
+    memmove(&SimRegions[Position + 1], &SimRegions[Position], (SimRegionCount - Position) * sizeof(SIM_REGION));
+    SimRegions[Position].Base = Base;
+    SimRegions[Position].Size = Size;
+    SimRegions[Position].Backing = Backing;
+    SimRegionCount++;
+
+    Entry->BarSize[Bar] = Size;
+    Dword = (ULONG)Base | (Is64Bit ? SIM_BAR_64BIT : 0);
+    memcpy(&Entry->Config[SIM_BAR_OFFSET + Bar * sizeof(ULONG)], &Dword, sizeof(Dword));
+    if (Is64Bit) {
+        Entry->BarUpper[Bar + 1] = TRUE;
+        Dword = (ULONG)(Base >> 32);
+        memcpy(&Entry->Config[SIM_BAR_OFFSET + (Bar + 1) * sizeof(ULONG)], &Dword, sizeof(Dword));
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS SimFabricAddCapability(UINT8 Bus, UINT8 Device, UINT8 Function, USHORT Id, ULONG Offset)
+{
+    PSIM_FUNCTION Entry = SimFunctions[SIM_BDF(Bus, Device, Function)];
+    ULONG Header;
+    ULONG Last;
+    ULONG Steps;
+
+    if (Entry == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+    if (Offset % sizeof(ULONG) || Offset < 0x40 || Offset > SIM_CFG_SIZE - sizeof(ULONG) ||
+        (Offset < SIM_STD_CFG_SIZE && Id > 0xFF)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Offset < SIM_STD_CFG_SIZE) {
+        Entry->Config[Offset] = (UCHAR)Id;
+        Entry->Config[Offset + 1] = 0;
+        if (!(Entry->Config[0x06] & SIM_STATUS_CAPABILITIES)) {
+            Entry->Config[0x06] |= SIM_STATUS_CAPABILITIES;
+            Entry->Config[SIM_CAPABILITIES_POINTER] = (UCHAR)Offset;
+            return STATUS_SUCCESS;
+        }
+        for (Last = Entry->Config[SIM_CAPABILITIES_POINTER], Steps = 0; Entry->Config[Last + 1] != 0 && Steps < 48; Steps++)
+        {
+            Last = Entry->Config[Last + 1];
+        }
+        Entry->Config[Last + 1] = (UCHAR)Offset;
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Extended capabilities start at 0x100, the first one added goes there.
+    //
+    Header = (ULONG)Id | (1UL << 16);
+    if (Offset != SIM_STD_CFG_SIZE) {
+        ULONG First;
+
+        memcpy(&First, &Entry->Config[SIM_STD_CFG_SIZE], sizeof(First));
+        if (First == 0) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        for (Last = SIM_STD_CFG_SIZE, Steps = 0; Steps < 1024; Steps++)
+        {
+            memcpy(&First, &Entry->Config[Last], sizeof(First));
+            if ((First >> 20) == 0) {
+                break;
+            }
+            Last = First >> 20;
+        }
+        First |= Offset << 20;
+        memcpy(&Entry->Config[Last], &First, sizeof(First));
+    }
+    memcpy(&Entry->Config[Offset], &Header, sizeof(Header));
+    return STATUS_SUCCESS;
+}
+
+VOID SimFabricSetEcam(ULONG64 Base)
+{
+    SimEcamBase = Base;
+}
+
+PUCHAR SimFabricGetConfig(UINT8 Bus, UINT8 Device, UINT8 Function)
+{
+    PSIM_FUNCTION Entry = SimFunctions[SIM_BDF(Bus, Device, Function)];
+
+    return (Entry != NULL) ? Entry->Config : NULL;
+}
+
+PUCHAR SimFabricGetBarMemory(ULONG64 Address, ULONG64 Length)
+{
+    PSIM_REGION Region = SimFindRegion(Address, Length);
+
+    return (Region != NULL) ? Region->Backing + (Address - Region->Base) : NULL;
+}
+
+VOID SimFabricFailConfigWrite(ULONG After)
+{
+    SimFailConfigWrite = (LONG)After;
+}
+
+VOID SimFabricSetLatency(const SIM_FABRIC_LATENCY* Latency)
+{
+    SimLatency = *Latency;
+}
+
+VOID SimFabricGetCounters(PSIM_FABRIC_COUNTERS Counters)
+{
+    Counters->ConfigReads = __atomic_load_n(&SimCounters.ConfigReads, __ATOMIC_RELAXED);
+    Counters->ConfigReadBytes = __atomic_load_n(&SimCounters.ConfigReadBytes, __ATOMIC_RELAXED);
+    Counters->ConfigWrites = __atomic_load_n(&SimCounters.ConfigWrites, __ATOMIC_RELAXED);
+    Counters->ConfigWriteBytes = __atomic_load_n(&SimCounters.ConfigWriteBytes, __ATOMIC_RELAXED);
+    Counters->MmioReads = __atomic_load_n(&SimCounters.MmioReads, __ATOMIC_RELAXED);
+    Counters->MmioReadBytes = __atomic_load_n(&SimCounters.MmioReadBytes, __ATOMIC_RELAXED);
+    Counters->MmioWrites = __atomic_load_n(&SimCounters.MmioWrites, __ATOMIC_RELAXED);
+    Counters->Maps = __atomic_load_n(&SimCounters.Maps, __ATOMIC_RELAXED);
+    Counters->MappedBytes = __atomic_load_n(&SimCounters.MappedBytes, __ATOMIC_RELAXED);
+    Counters->Unmaps = __atomic_load_n(&SimCounters.Unmaps, __ATOMIC_RELAXED);
+}
+
+VOID SimFabricResetCounters(VOID)
+{
+    SIM_FABRIC_COUNTERS Zero;
+
+    memset(&Zero, 0, sizeof(Zero));
+    pthread_mutex_lock(&SimMappingLock);
+    SimCounters = Zero;
+    pthread_mutex_unlock(&SimMappingLock);
+}
+
+ULONG SimFabricGetLiveMappings(VOID)
+{
+    ULONG Count;
+
+    pthread_mutex_lock(&SimMappingLock);
+    Count = SimMappingCount;
+    pthread_mutex_unlock(&SimMappingLock);
+    return Count;
+}
+
+VOID SimFabricReset(VOID)
+{
+    ULONG i;
+
+    pthread_mutex_lock(&SimMappingLock);
+    while (SimMappings != NULL) {
+        PSIM_MAPPING Next = SimMappings->Next;
+
+        free(SimMappings->Allocated);
+        free(SimMappings);
+        SimMappings = Next;
+    }
+    SimMappingCount = 0;
+    pthread_mutex_unlock(&SimMappingLock);
+
+    for (i = 0; i < SimRegionCount; i++)
+    {
+        free(SimRegions[i].Backing);
+    }
+    free(SimRegions);
+    SimRegions = NULL;
+    SimRegionCount = 0;
+
+    for (i = 0; i < sizeof(SimFunctions) / sizeof(SimFunctions[0]); i++)
+    {
+        free(SimFunctions[i]);
+        SimFunctions[i] = NULL;
+    }
+    SimEcamBase = 0;
+    SimFailConfigWrite = -1;
+}
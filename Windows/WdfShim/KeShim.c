@@ -0,0 +1,247 @@
+/*++
+
+Module Name:
+
+    KeShim.c
+
+Abstract:
+
+    User mode stand-ins for the kernel events, system threads and object
+    references declared in ntddk.h. A system thread is a pthread with a
+    dispatcher header that is signaled when it exits and a reference count
+    shared by its handle, its referenced pointers and the running thread.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include "ntddk.h"
+
+typedef struct _SHIM_THREAD {
+    DISPATCHER_HEADER Header;
+    LONG References;
+    pthread_t Thread;
+    PKSTART_ROUTINE StartRoutine;
+    PVOID StartContext;
+} SHIM_THREAD, *PSHIM_THREAD;
+
+static POBJECT_TYPE ShimThreadType = (POBJECT_TYPE)&ShimThreadType;
+POBJECT_TYPE* PsThreadType = &ShimThreadType;
+
+static __thread PSHIM_THREAD ShimCurrentThread = NULL;
+
+static VOID ShimHeaderInitialize(DISPATCHER_HEADER* Header, EVENT_TYPE Type, LONG SignalState)
+{
+    Header->Type = Type;
+    Header->SignalState = SignalState;
+    pthread_mutex_init(&Header->Lock, NULL);
+    pthread_cond_init(&Header->Signaled, NULL);
+}
+
+static LONG ShimHeaderSignal(DISPATCHER_HEADER* Header)
+{
+    LONG Previous = 0;
+
+    pthread_mutex_lock(&Header->Lock);
+    Previous = Header->SignalState;
+    Header->SignalState = 1;
+    if (Header->Type == SynchronizationEvent) {
+        pthread_cond_signal(&Header->Signaled);
+    }
+    else {
+        pthread_cond_broadcast(&Header->Signaled);
+    }
+    pthread_mutex_unlock(&Header->Lock);
+    return Previous;
+}
+
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency)
+{
+    struct timespec Time;
+    LARGE_INTEGER Counter;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    Counter.QuadPart = (LONGLONG)Time.tv_sec * 10000000 + Time.tv_nsec / 100;
+    if (PerformanceFrequency != NULL) {
+        PerformanceFrequency->QuadPart = 10000000;
+    }
+    return Counter;
+}
+
+//
+// A pause would keep a polling thread on a core the sender may need, the
+// shim usually runs both on few cores.
+//
+VOID YieldProcessor(VOID)
+{
+    sched_yield();
+}
+
+//
+// Events.
+//
+VOID KeInitializeEvent(PRKEVENT Event, EVENT_TYPE Type, BOOLEAN State)
+{
+    ShimHeaderInitialize(&Event->Header, Type, State ? 1 : 0);
+}
+
+LONG KeSetEvent(PRKEVENT Event, KPRIORITY Increment, BOOLEAN Wait)
+{
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+
+    return ShimHeaderSignal(&Event->Header);
+}
+
+VOID KeClearEvent(PRKEVENT Event)
+{
+    pthread_mutex_lock(&Event->Header.Lock);
+    Event->Header.SignalState = 0;
+    pthread_mutex_unlock(&Event->Header.Lock);
+}
+
+//
+// Waits on an event or a thread. Only relative timeouts are supported, a
+// satisfied wait resets a synchronization event.
+//
+NTSTATUS KeWaitForSingleObject(PVOID Object, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Timeout)
+{
+    DISPATCHER_HEADER* Header = (DISPATCHER_HEADER*)Object;
+    struct timespec Deadline;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    UNREFERENCED_PARAMETER(WaitReason);
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    if (Timeout != NULL) {
+        LONGLONG Hundreds = (Timeout->QuadPart < 0) ? -Timeout->QuadPart : Timeout->QuadPart;
+
+        clock_gettime(CLOCK_REALTIME, &Deadline);
+        Deadline.tv_sec += (time_t)(Hundreds / 10000000);
+        Deadline.tv_nsec += (long)(Hundreds % 10000000) * 100;
+        if (Deadline.tv_nsec >= 1000000000) {
+            Deadline.tv_sec++;
+            Deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&Header->Lock);
+    while (Header->SignalState == 0) {
+        if (Timeout == NULL) {
+            pthread_cond_wait(&Header->Signaled, &Header->Lock);
+        }
+        else if (Timeout->QuadPart == 0 || pthread_cond_timedwait(&Header->Signaled, &Header->Lock, &Deadline) == ETIMEDOUT) {
+            Status = STATUS_TIMEOUT;
+            break;
+        }
+    }
+    if (Status == STATUS_SUCCESS && Header->Type == SynchronizationEvent) {
+        Header->SignalState = 0;
+    }
+    pthread_mutex_unlock(&Header->Lock);
+    return Status;
+}
+
+//
+// System threads.
+//
+static VOID ShimThreadRelease(PSHIM_THREAD Thread)
+{
+    if (InterlockedDecrement(&Thread->References) == 0) {
+        pthread_mutex_destroy(&Thread->Header.Lock);
+        pthread_cond_destroy(&Thread->Header.Signaled);
+        free(Thread);
+    }
+}
+
+static VOID ShimThreadExit(PSHIM_THREAD Thread)
+{
+    ShimHeaderSignal(&Thread->Header);
+    ShimThreadRelease(Thread);
+}
+
+static void* ShimThreadStart(void* Argument)
+{
+    PSHIM_THREAD Thread = (PSHIM_THREAD)Argument;
+
+    ShimCurrentThread = Thread;
+    Thread->StartRoutine(Thread->StartContext);
+    ShimThreadExit(Thread);
+    return NULL;
+}
+
+NTSTATUS PsCreateSystemThread(HANDLE* ThreadHandle, ULONG DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes, HANDLE ProcessHandle,
+                              PCLIENT_ID ClientId, PKSTART_ROUTINE StartRoutine, PVOID StartContext)
+{
+    PSHIM_THREAD Thread = NULL;
+
+    UNREFERENCED_PARAMETER(DesiredAccess);
+    UNREFERENCED_PARAMETER(ObjectAttributes);
+    UNREFERENCED_PARAMETER(ProcessHandle);
+    UNREFERENCED_PARAMETER(ClientId);
+
+    Thread = (PSHIM_THREAD)calloc(1, sizeof(SHIM_THREAD));
+    if (Thread == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    ShimHeaderInitialize(&Thread->Header, NotificationEvent, 0);
+    Thread->References = 2;
+    Thread->StartRoutine = StartRoutine;
+    Thread->StartContext = StartContext;
+    if (pthread_create(&Thread->Thread, NULL, ShimThreadStart, Thread) != 0) {
+        free(Thread);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    pthread_detach(Thread->Thread);
+    *ThreadHandle = Thread;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS PsTerminateSystemThread(NTSTATUS ExitStatus)
+{
+    UNREFERENCED_PARAMETER(ExitStatus);
+
+    if (ShimCurrentThread == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    ShimThreadExit(ShimCurrentThread);
+    pthread_exit(NULL);
+}
+
+//
+// Handles are the thread objects themselves, a handle holds one reference.
+//
+NTSTATUS ObReferenceObjectByHandle(HANDLE Handle, ACCESS_MASK DesiredAccess, POBJECT_TYPE ObjectType, KPROCESSOR_MODE AccessMode,
+                                   PVOID* Object, PVOID HandleInformation)
+{
+    PSHIM_THREAD Thread = (PSHIM_THREAD)Handle;
+
+    UNREFERENCED_PARAMETER(DesiredAccess);
+    UNREFERENCED_PARAMETER(AccessMode);
+    UNREFERENCED_PARAMETER(HandleInformation);
+
+    if (Thread == NULL || ObjectType != ShimThreadType) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    InterlockedIncrement(&Thread->References);
+    *Object = Thread;
+    return STATUS_SUCCESS;
+}
+
+VOID ObDereferenceObject(PVOID Object)
+{
+    ShimThreadRelease((PSHIM_THREAD)Object);
+}
+
+NTSTATUS ZwClose(HANDLE Handle)
+{
+    ShimThreadRelease((PSHIM_THREAD)Handle);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/*++
+
+Module Name:
+
+    NonPnPBench.c
+
+Abstract:
+
+    Load generator for the NonPnP request path on the WDF shim. Loads the
+    driver through its DriverEntry, checks IOCTL_NONPNP_GET_MESSAGE and
+    then sends the echo IOCTLs from several threads at once, per transfer
+    method and payload size. Prints the dispatch rate, the time per
+    request and the share of it spent on the buffer copies of the I/O
+    manager, measured as the time per request above the 0 byte run of the
+    same method.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "WdfShim.h"
+#include "public.h"
+
+#define BENCH_DEFAULT_THREADS       4
+#define BENCH_DEFAULT_ITERATIONS    20000
+#define BENCH_WARMUP_ITERATIONS     16
+#define BENCH_MAX_THREADS           64
+
+DRIVER_INITIALIZE DriverEntry;
+
+typedef struct _ECHO_METHOD {
+    PCSTR Name;
+    ULONG IoControlCode;
+    BOOLEAN Echoes;
+} ECHO_METHOD;
+
+static const ECHO_METHOD EchoMethods[] = {
+    { "BUFFERED", IOCTL_NONPNP_ECHO_BUFFERED, TRUE },
+    { "IN_DIRECT", IOCTL_NONPNP_ECHO_IN_DIRECT, FALSE },
+    { "OUT_DIRECT", IOCTL_NONPNP_ECHO_OUT_DIRECT, TRUE },
+    { "NEITHER", IOCTL_NONPNP_ECHO_NEITHER, TRUE },
+};
+
+static const ULONG DefaultSizes[] = { 0, 64, 512, 4096, 65536, NON_PNP_ECHO_MAX_SIZE };
+
+typedef struct _BENCH_THREAD {
+    pthread_t Thread;
+    pthread_barrier_t* Ready;
+    pthread_barrier_t* Start;
+    WDFDEVICE Device;
+    const ECHO_METHOD* Method;
+    ULONG Size;
+    ULONG Iterations;
+    PUCHAR Payload;
+    PUCHAR Echoed;
+    ULONG Failures;
+    double Begin;
+    double End;
+} BENCH_THREAD;
+
+static double Now(VOID)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec / 1e9;
+}
+
+static BOOLEAN Echo(BENCH_THREAD* Thread)
+{
+    ULONG BytesReturned = 0;
+    NTSTATUS Status;
+
+    if (Thread->Method->Echoes) {
+        Status = ShimDeviceIoControl(Thread->Device, Thread->Method->IoControlCode, Thread->Payload, Thread->Size,
+                                     Thread->Echoed, Thread->Size, &BytesReturned);
+    }
+    else {
+        Status = ShimDeviceIoControl(Thread->Device, Thread->Method->IoControlCode, NULL, 0,
+                                     Thread->Payload, Thread->Size, &BytesReturned);
+    }
+    return NT_SUCCESS(Status) && BytesReturned == Thread->Size;
+}
+
+static PVOID BenchThread(PVOID Parameter)
+{
+    BENCH_THREAD* Thread = (BENCH_THREAD*)Parameter;
+    ULONG i;
+
+    for (i = 0; i < BENCH_WARMUP_ITERATIONS; i++)
+    {
+        Thread->Failures += !Echo(Thread);
+    }
+    memset(Thread->Echoed, 0, Thread->Size);
+
+    pthread_barrier_wait(Thread->Ready);
+    pthread_barrier_wait(Thread->Start);
+    Thread->Begin = Now();
+    for (i = 0; i < Thread->Iterations; i++)
+    {
+        Thread->Failures += !Echo(Thread);
+    }
+    Thread->End = Now();
+    if (Thread->Method->Echoes && memcmp(Thread->Payload, Thread->Echoed, Thread->Size) != 0) {
+        Thread->Failures++;
+    }
+    return NULL;
+}
+
+//
+// Runs one method and size on all threads and returns the time from the
+// first thread starting its timed part to the last one finishing it, or a
+// negative value if a round trip failed.
+//
+static double RunCase(BENCH_THREAD* Threads, ULONG ThreadCount, const ECHO_METHOD* Method, ULONG Size)
+{
+    pthread_barrier_t Ready, Start;
+    double Begin = 0, End = 0;
+    ULONG Failures = 0;
+    ULONG i;
+
+    pthread_barrier_init(&Ready, NULL, ThreadCount + 1);
+    pthread_barrier_init(&Start, NULL, ThreadCount + 1);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[i].Ready = &Ready;
+        Threads[i].Start = &Start;
+        Threads[i].Method = Method;
+        Threads[i].Size = Size;
+        Threads[i].Failures = 0;
+        pthread_create(&Threads[i].Thread, NULL, BenchThread, &Threads[i]);
+    }
+
+    //
+    // The statistics are reset between the warm up and the timed part.
+    //
+    pthread_barrier_wait(&Ready);
+    ShimResetStatistics();
+    pthread_barrier_wait(&Start);
+    for (i = 0; i < ThreadCount; i++)
+    {
+        pthread_join(Threads[i].Thread, NULL);
+        Failures += Threads[i].Failures;
+        if (i == 0 || Threads[i].Begin < Begin) {
+            Begin = Threads[i].Begin;
+        }
+        if (i == 0 || Threads[i].End > End) {
+            End = Threads[i].End;
+        }
+    }
+    pthread_barrier_destroy(&Ready);
+    pthread_barrier_destroy(&Start);
+
+    return Failures ? -1.0 : End - Begin;
+}
+
+static int MessageCheck(WDFDEVICE Device)
+{
+    CHAR InputBuffer[500] = "Bench";
+    CHAR OutputBuffer[500] = { 0 };
+    ULONG BytesReturned = 0;
+    NTSTATUS Status;
+
+    Status = ShimDeviceIoControl(Device, IOCTL_NONPNP_GET_MESSAGE, InputBuffer, sizeof(InputBuffer),
+                                 OutputBuffer, sizeof(OutputBuffer), &BytesReturned);
+    if (!NT_SUCCESS(Status)) {
+        printf("IOCTL_NONPNP_GET_MESSAGE failed with status 0x%x\n", (unsigned)Status);
+        return 1;
+    }
+    printf("Message from driver: %.*s\n", (int)BytesReturned, OutputBuffer);
+    return 0;
+}
+
+static VOID PrintUsage(VOID)
+{
+    printf("Usage: NonPnPBench [-threads <Count>] [-iterations <Count>] [-size <Bytes>]... [-dispatch <sequential|parallel|both>]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    BENCH_THREAD Threads[BENCH_MAX_THREADS];
+    ULONG Sizes[sizeof(DefaultSizes) / sizeof(DefaultSizes[0]) + 16];
+    ULONG SizeCount = 0;
+    ULONG ThreadCount = BENCH_DEFAULT_THREADS;
+    ULONG Iterations = BENCH_DEFAULT_ITERATIONS;
+    WDF_IO_QUEUE_DISPATCH_TYPE Dispatch[2] = { WdfIoQueueDispatchSequential, WdfIoQueueDispatchParallel };
+    ULONG DispatchCount = 2;
+    ULONG d, m, s, i;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "-threads") == 0 && Arg + 1 < argc) {
+            ThreadCount = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-iterations") == 0 && Arg + 1 < argc) {
+            Iterations = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-size") == 0 && Arg + 1 < argc && SizeCount < sizeof(Sizes) / sizeof(Sizes[0])) {
+            Sizes[SizeCount++] = strtoul(argv[++Arg], NULL, 0);
+        }
+        else if (strcmp(argv[Arg], "-dispatch") == 0 && Arg + 1 < argc) {
+            Arg++;
+            if (strcmp(argv[Arg], "sequential") == 0) {
+                DispatchCount = 1;
+            }
+            else if (strcmp(argv[Arg], "parallel") == 0) {
+                Dispatch[0] = WdfIoQueueDispatchParallel;
+                DispatchCount = 1;
+            }
+            else if (strcmp(argv[Arg], "both") != 0) {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (SizeCount == 0) {
+        SizeCount = sizeof(DefaultSizes) / sizeof(DefaultSizes[0]);
+        memcpy(Sizes, DefaultSizes, sizeof(DefaultSizes));
+    }
+    for (s = 0; s < SizeCount; s++)
+    {
+        if (Sizes[s] > NON_PNP_ECHO_MAX_SIZE) {
+            printf("Payload size %u is above the maximum of %u bytes\n", Sizes[s], NON_PNP_ECHO_MAX_SIZE);
+            return 1;
+        }
+    }
+    if (ThreadCount == 0 || ThreadCount > BENCH_MAX_THREADS) {
+        printf("Thread count must be 1 to %u\n", BENCH_MAX_THREADS);
+        return 1;
+    }
+    if (Iterations == 0) {
+        Iterations = 1;
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        ULONG b;
+
+        memset(&Threads[i], 0, sizeof(Threads[i]));
+        Threads[i].Iterations = Iterations;
+        Threads[i].Payload = (PUCHAR)malloc(NON_PNP_ECHO_MAX_SIZE);
+        Threads[i].Echoed = (PUCHAR)malloc(NON_PNP_ECHO_MAX_SIZE);
+        if (Threads[i].Payload == NULL || Threads[i].Echoed == NULL) {
+            printf("Buffer allocation failed\n");
+            return 1;
+        }
+        for (b = 0; b < NON_PNP_ECHO_MAX_SIZE; b++)
+        {
+            Threads[i].Payload[b] = (UCHAR)(b * 7 + i + 1);
+        }
+    }
+
+    for (d = 0; d < DispatchCount; d++)
+    {
+        WDFDEVICE Device = NULL;
+        NTSTATUS Status;
+
+        ShimOverrideDispatchType(Dispatch[d]);
+        Status = ShimDriverLoad(DriverEntry, &Device);
+        if (!NT_SUCCESS(Status)) {
+            printf("DriverEntry failed with status 0x%x\n", (unsigned)Status);
+            return 1;
+        }
+        if (d == 0 && MessageCheck(Device) != 0) {
+            return 1;
+        }
+
+        printf("\n%s queue, %u threads, %u requests per thread\n",
+               (Dispatch[d] == WdfIoQueueDispatchSequential) ? "Sequential" : "Parallel", ThreadCount, Iterations);
+        printf("%-12s%10s%14s%10s%10s%10s%14s\n", "Method", "Bytes", "Requests/s", "ns/req", "MB/s", "copy ns", "copied B/req");
+
+        for (m = 0; m < sizeof(EchoMethods) / sizeof(EchoMethods[0]); m++)
+        {
+            double BaseNs = -1.0;
+
+            for (s = 0; s < SizeCount; s++)
+            {
+                SHIM_STATISTICS Statistics;
+                double Seconds, Ns;
+                ULONG64 Requests = (ULONG64)ThreadCount * Iterations;
+
+                for (i = 0; i < ThreadCount; i++)
+                {
+                    Threads[i].Device = Device;
+                }
+                Seconds = RunCase(Threads, ThreadCount, &EchoMethods[m], Sizes[s]);
+                ShimGetStatistics(&Statistics);
+                if (Seconds < 0) {
+                    printf("%-12s%10u  round trip failed\n", EchoMethods[m].Name, Sizes[s]);
+                    continue;
+                }
+
+                //
+                // Wall time per request, with several threads on a parallel
+                // queue it is below the latency of one request.
+                //
+                Ns = Seconds * 1e9 / (double)Requests;
+                if (Sizes[s] == 0) {
+                    BaseNs = Ns;
+                }
+                printf("%-12s%10u%14.0f%10.0f%10.1f", EchoMethods[m].Name, Sizes[s], (double)Requests / Seconds, Ns,
+                       (double)Sizes[s] * (double)Requests / Seconds / (1024 * 1024));
+                if (BaseNs >= 0) {
+                    printf("%10.0f", Ns - BaseNs);
+                }
+                else {
+                    printf("%10s", "-");
+                }
+                printf("%14.0f\n", (double)(Statistics.BytesCopiedIn + Statistics.BytesCopiedOut) / (double)(Statistics.Requests ? Statistics.Requests : 1));
+            }
+        }
+
+        ShimDriverUnload();
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        free(Threads[i].Payload);
+        free(Threads[i].Echoed);
+    }
+    return 0;
+}
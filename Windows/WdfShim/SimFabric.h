@@ -0,0 +1,132 @@
+/*++
+
+Module Name:
+
+    SimFabric.h
+
+Abstract:
+
+    Simulated PCI fabric behind the HAL, memory manager and register access
+    stand-ins of the shim. Functions have a 4 KB configuration space, read
+    through the HAL or an ECAM window, and up to six memory BARs backed by
+    host memory. Every configuration access,
+    register access and mapping is counted and can be given a latency, so
+    a driver request shows how many accesses it makes and what they cost.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#ifdef _KERNEL_MODE
+#include "ntddk.h"
+#else
+#include <Windows.h>
+
+typedef LONG NTSTATUS;
+
+#define NT_SUCCESS(Status)          (((NTSTATUS)(Status)) >= 0)
+#define STATUS_SUCCESS              ((NTSTATUS)0x00000000L)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_FABRIC_MAX_BAR_SIZE     0x1000000
+
+//
+// Latencies are busy waits on the calling thread. ConfigNs applies to each
+// HAL call, MmioNs to each register access, a buffer read of Count
+// elements costs Count accesses, MapNs to each map and unmap.
+//
+typedef struct _SIM_FABRIC_LATENCY {
+    ULONG ConfigNs;
+    ULONG MmioNs;
+    ULONG MapNs;
+} SIM_FABRIC_LATENCY, *PSIM_FABRIC_LATENCY;
+
+//
+// Plain loads and stores through a mapping are not seen, only the
+// READ_REGISTER and WRITE_REGISTER routines are counted.
+//
+typedef struct _SIM_FABRIC_COUNTERS {
+    ULONG64 ConfigReads;
+    ULONG64 ConfigReadBytes;
+    ULONG64 ConfigWrites;
+    ULONG64 ConfigWriteBytes;
+    ULONG64 MmioReads;
+    ULONG64 MmioReadBytes;
+    ULONG64 MmioWrites;
+    ULONG64 Maps;
+    ULONG64 MappedBytes;
+    ULONG64 Unmaps;
+} SIM_FABRIC_COUNTERS, *PSIM_FABRIC_COUNTERS;
+
+//
+// Adds a type 0 function with its ids, a class code and a capability
+// free header. Returns STATUS_OBJECT_NAME_EXISTS if it is already there.
+//
+NTSTATUS SimFabricAddFunction(UINT8 Bus, UINT8 Device, UINT8 Function, USHORT VendorId, USHORT DeviceId, ULONG ClassCode);
+
+//
+// Adds a memory BAR, 64-bit if Base is above 4 GB. Size is a power of two
+// up to SIM_FABRIC_MAX_BAR_SIZE and Base a multiple of it. The backing
+// memory holds a pattern of the BAR number and the dword offset.
+//
+NTSTATUS SimFabricAddBar(UINT8 Bus, UINT8 Device, UINT8 Function, UINT8 Bar, ULONG64 Base, ULONG64 Size);
+
+//
+// Links a capability at Offset to the end of the capability list, or of
+// the extended capability list for an Offset of 0x100 and above, where the
+// first one added must be at 0x100. Only the header is written, the body
+// is set up through SimFabricGetConfig.
+//
+NTSTATUS SimFabricAddCapability(UINT8 Bus, UINT8 Device, UINT8 Function, USHORT Id, ULONG Offset);
+
+//
+// Serves the ECAM window of 256 buses at Base from the configuration space
+// of the functions, a mapping of an empty slot reads all ones. Writes
+// through the window bypass the header's write rules.
+//
+VOID SimFabricSetEcam(ULONG64 Base);
+
+//
+// Configuration space of a function to set up registers the builder does
+// not know about, NULL if the function does not exist.
+//
+PUCHAR SimFabricGetConfig(UINT8 Bus, UINT8 Device, UINT8 Function);
+
+//
+// Memory behind a BAR window at Address, to set up or check what a BAR
+// read returns, NULL if no window holds Length bytes from Address.
+//
+PUCHAR SimFabricGetBarMemory(ULONG64 Address, ULONG64 Length);
+
+//
+// Fails the configuration write that follows After successful ones, once,
+// as a function that stops responding would.
+//
+VOID SimFabricFailConfigWrite(ULONG After);
+
+VOID SimFabricSetLatency(const SIM_FABRIC_LATENCY* Latency);
+VOID SimFabricGetCounters(PSIM_FABRIC_COUNTERS Counters);
+VOID SimFabricResetCounters(VOID);
+
+//
+// Mappings made by MmMapIoSpace and not yet released.
+//
+ULONG SimFabricGetLiveMappings(VOID);
+
+//
+// Removes every function, BAR, the ECAM window and a pending write failure
+// and releases the mappings left behind.
+//
+VOID SimFabricReset(VOID);
+
+#ifdef __cplusplus
+}
+#endif
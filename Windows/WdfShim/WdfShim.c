@@ -0,0 +1,992 @@
+/*++
+
+Module Name:
+
+    WdfShim.c
+
+Abstract:
+
+    User mode implementation of the KMDF subset declared in wdf.h. Every
+    object is one heap block with its contexts and child memory objects.
+    A request carries the buffers the I/O manager would have built for
+    the transfer method of its IOCTL:
+
+        METHOD_BUFFERED     one system buffer of the larger length, filled
+                            from the input and copied back on completion
+        METHOD_IN_DIRECT,   a system buffer for the input, the output is
+        METHOD_OUT_DIRECT   the caller's buffer as a locked MDL would map it
+        METHOD_NEITHER      the caller's addresses, reachable only through
+                            the unsafe user buffer routines
+
+    Requests run on the sending thread. A sequential queue lets one request
+    in at a time and takes the next when the driver completes the current
+    one, a parallel queue lets every sender in. A manual queue only holds
+    the requests the driver forwards to it until they are canceled.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+#include "WdfShim.h"
+
+typedef enum _SHIM_OBJECT_TYPE {
+    ShimObjectDriver,
+    ShimObjectDevice,
+    ShimObjectQueue,
+    ShimObjectRequest,
+    ShimObjectMemory,
+} SHIM_OBJECT_TYPE;
+
+typedef struct _SHIM_CONTEXT {
+    struct _SHIM_CONTEXT* Next;
+    const WDF_OBJECT_CONTEXT_TYPE_INFO* TypeInfo;
+    ULONG64 Data[1];
+} SHIM_CONTEXT, *PSHIM_CONTEXT;
+
+struct _SHIM_DEVICE_INIT {
+    WDF_DEVICE_IO_TYPE IoType;
+    BOOLEAN Exclusive;
+    PFN_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext;
+};
+
+typedef struct _SHIM_OBJECT {
+    SHIM_OBJECT_TYPE Type;
+    PSHIM_CONTEXT Contexts;
+    struct _SHIM_OBJECT* Children;
+    struct _SHIM_OBJECT* Sibling;
+
+    union {
+        struct {
+            WDF_DRIVER_CONFIG Config;
+            DRIVER_OBJECT DriverObject;
+        } Driver;
+
+        struct {
+            struct _SHIM_DEVICE_INIT Init;
+            struct _SHIM_OBJECT* DefaultQueue;
+            PFN_WDF_OBJECT_CONTEXT_CLEANUP EvtCleanupCallback;
+            WCHAR SymbolicLink[64];
+            ULONG OpenHandles;
+            BOOLEAN Initialized;
+        } Device;
+
+        struct {
+            WDF_IO_QUEUE_CONFIG Config;
+            struct _SHIM_OBJECT* Device;
+            pthread_mutex_t Lock;
+            pthread_cond_t Idle;
+            BOOLEAN Busy;
+            struct _SHIM_OBJECT* Requests;
+        } Queue;
+
+        struct {
+            WDF_REQUEST_PARAMETERS Parameters;
+            struct _SHIM_OBJECT* Device;
+            struct _SHIM_OBJECT* Queue;
+            struct _SHIM_OBJECT* Next;
+            PVOID UserInputBuffer;
+            PVOID UserOutputBuffer;
+            PVOID SystemBuffer;
+            PVOID InputBuffer;
+            PVOID OutputBuffer;
+            ULONG_PTR Information;
+            NTSTATUS Status;
+            PSHIM_COMPLETION_ROUTINE CompletionRoutine;
+            PVOID CompletionContext;
+            BOOLEAN InCallerContext;
+            BOOLEAN Canceled;
+            BOOLEAN Completing;
+            volatile BOOLEAN Completed;
+        } Request;
+
+        struct {
+            PVOID Buffer;
+            size_t Size;
+        } Memory;
+    } u;
+} SHIM_OBJECT, *PSHIM_OBJECT;
+
+const UNICODE_STRING SDDL_DEVOBJ_SYS_ALL_ADM_RWX_WORLD_RW_RES_R = { 0, 0, L"D:P(A;;GA;;;SY)(A;;GRGWGX;;;BA)(A;;GRGW;;;WD)(A;;GR;;;RC)" };
+const UNICODE_STRING SDDL_DEVOBJ_SYS_ALL_ADM_RWX_WORLD_R_RES_R = { 0, 0, L"D:P(A;;GA;;;SY)(A;;GRGWGX;;;BA)(A;;GR;;;WD)(A;;GR;;;RC)" };
+
+ULONG ShimTraceLevel = TRACE_LEVEL_NONE;
+
+static WDF_IO_QUEUE_DISPATCH_TYPE ShimDispatchOverride = WdfIoQueueDispatchInvalid;
+static PSHIM_OBJECT ShimDriver = NULL;
+static PSHIM_OBJECT ShimDevices = NULL;
+static SHIM_STATISTICS ShimStatistics;
+
+//
+// Guards the request lists of manual queues, the cancel flags and the
+// completion routines, a request changes queues while it is forwarded.
+//
+static pthread_mutex_t ShimCancelLock = PTHREAD_MUTEX_INITIALIZER;
+
+static VOID ShimQueuePurge(PSHIM_OBJECT Queue);
+
+static PSHIM_OBJECT ShimObjectCreate(SHIM_OBJECT_TYPE Type, PSHIM_OBJECT Parent)
+{
+    PSHIM_OBJECT Object = (PSHIM_OBJECT)calloc(1, sizeof(SHIM_OBJECT));
+
+    if (Object == NULL) {
+        return NULL;
+    }
+    Object->Type = Type;
+    if (Parent != NULL) {
+        Object->Sibling = Parent->Children;
+        Parent->Children = Object;
+    }
+    return Object;
+}
+
+//
+// Frees an object with its contexts and children, the parent link is left
+// to the caller.
+//
+static VOID ShimObjectDelete(PSHIM_OBJECT Object)
+{
+    PSHIM_CONTEXT Context = Object->Contexts;
+    PSHIM_OBJECT Child = Object->Children;
+
+    //
+    // The framework purges the queues of a device before its cleanup
+    // callback, so requests parked in manual queues are canceled first.
+    //
+    if (Object->Type == ShimObjectDevice) {
+        for (; Child != NULL; Child = Child->Sibling)
+        {
+            if (Child->Type == ShimObjectQueue) {
+                ShimQueuePurge(Child);
+            }
+        }
+        Child = Object->Children;
+        if (Object->u.Device.EvtCleanupCallback != NULL) {
+            Object->u.Device.EvtCleanupCallback(Object);
+        }
+    }
+    while (Child != NULL) {
+        PSHIM_OBJECT Next = Child->Sibling;
+        ShimObjectDelete(Child);
+        Child = Next;
+    }
+    while (Context != NULL) {
+        PSHIM_CONTEXT Next = Context->Next;
+        free(Context);
+        Context = Next;
+    }
+    if (Object->Type == ShimObjectQueue) {
+        pthread_mutex_destroy(&Object->u.Queue.Lock);
+        pthread_cond_destroy(&Object->u.Queue.Idle);
+    }
+    free(Object);
+}
+
+static NTSTATUS ShimObjectAddContext(PSHIM_OBJECT Object, const WDF_OBJECT_CONTEXT_TYPE_INFO* TypeInfo, PVOID* Context)
+{
+    PSHIM_CONTEXT Entry = NULL;
+
+    if (ShimObjectGetContext(Object, TypeInfo) != NULL) {
+        return STATUS_OBJECT_NAME_EXISTS;
+    }
+    Entry = (PSHIM_CONTEXT)calloc(1, offsetof(SHIM_CONTEXT, Data) + TypeInfo->ContextSize);
+    if (Entry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    Entry->TypeInfo = TypeInfo;
+    Entry->Next = Object->Contexts;
+    Object->Contexts = Entry;
+    if (Context != NULL) {
+        *Context = Entry->Data;
+    }
+    return STATUS_SUCCESS;
+}
+
+PVOID ShimObjectGetContext(WDFOBJECT Object, const WDF_OBJECT_CONTEXT_TYPE_INFO* TypeInfo)
+{
+    PSHIM_CONTEXT Context = NULL;
+
+    if (Object == NULL) {
+        return NULL;
+    }
+
+    //
+    // Every translation unit has its own type info, so the names decide.
+    //
+    for (Context = Object->Contexts; Context != NULL; Context = Context->Next)
+    {
+        if (Context->TypeInfo == TypeInfo || strcmp(Context->TypeInfo->ContextName, TypeInfo->ContextName) == 0) {
+            return Context->Data;
+        }
+    }
+    return NULL;
+}
+
+VOID ShimTrace(ULONG Level, PCSTR Function, PCSTR Message, ...)
+{
+    if (Level > ShimTraceLevel) {
+        return;
+    }
+    fprintf(stderr, "[%u] %s: %s", Level, Function, Message);
+    if (Message[0] == '\0' || Message[strlen(Message) - 1] != '\n') {
+        fputc('\n', stderr);
+    }
+}
+
+//
+// Driver.
+//
+NTSTATUS WdfDriverCreate(PDRIVER_OBJECT DriverObject, PCUNICODE_STRING RegistryPath, PWDF_OBJECT_ATTRIBUTES DriverAttributes,
+                         PWDF_DRIVER_CONFIG DriverConfig, WDFDRIVER* Driver)
+{
+    PSHIM_OBJECT Object = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    if (ShimDriver != NULL || DriverConfig == NULL) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    Object = ShimObjectCreate(ShimObjectDriver, NULL);
+    if (Object == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    Object->u.Driver.Config = *DriverConfig;
+    Object->u.Driver.DriverObject = *DriverObject;
+    if (DriverAttributes != NULL && DriverAttributes->ContextTypeInfo != NULL) {
+        Status = ShimObjectAddContext(Object, DriverAttributes->ContextTypeInfo, NULL);
+        if (!NT_SUCCESS(Status)) {
+            ShimObjectDelete(Object);
+            return Status;
+        }
+    }
+
+    ShimDriver = Object;
+    if (Driver != NULL) {
+        *Driver = Object;
+    }
+    return STATUS_SUCCESS;
+}
+
+PDRIVER_OBJECT WdfDriverWdmGetDriverObject(WDFDRIVER Driver)
+{
+    return &Driver->u.Driver.DriverObject;
+}
+
+//
+// Device.
+//
+PWDFDEVICE_INIT WdfControlDeviceInitAllocate(WDFDRIVER Driver, PCUNICODE_STRING SDDLString)
+{
+    PWDFDEVICE_INIT DeviceInit = NULL;
+
+    UNREFERENCED_PARAMETER(SDDLString);
+
+    if (Driver == NULL) {
+        return NULL;
+    }
+    DeviceInit = (PWDFDEVICE_INIT)calloc(1, sizeof(WDFDEVICE_INIT));
+    if (DeviceInit != NULL) {
+        DeviceInit->IoType = WdfDeviceIoBuffered;
+    }
+    return DeviceInit;
+}
+
+VOID WdfDeviceInitFree(PWDFDEVICE_INIT DeviceInit)
+{
+    free(DeviceInit);
+}
+
+//
+// Exclusive lets ShimOpenDevice hand out one handle at a time.
+//
+VOID WdfDeviceInitSetExclusive(PWDFDEVICE_INIT DeviceInit, BOOLEAN IsExclusive)
+{
+    DeviceInit->Exclusive = IsExclusive;
+}
+
+//
+// The I/O type applies to read and write requests, IOCTLs always follow
+// the transfer method of their code.
+//
+VOID WdfDeviceInitSetIoType(PWDFDEVICE_INIT DeviceInit, WDF_DEVICE_IO_TYPE IoType)
+{
+    DeviceInit->IoType = IoType;
+}
+
+VOID WdfDeviceInitSetIoInCallerContextCallback(PWDFDEVICE_INIT DeviceInit, PFN_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext)
+{
+    DeviceInit->EvtIoInCallerContext = EvtIoInCallerContext;
+}
+
+NTSTATUS WdfDeviceInitAssignName(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING DeviceName)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+
+    return (DeviceName != NULL && DeviceName->Buffer != NULL) ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+}
+
+NTSTATUS WdfDeviceCreate(PWDFDEVICE_INIT* DeviceInit, PWDF_OBJECT_ATTRIBUTES DeviceAttributes, WDFDEVICE* Device)
+{
+    PSHIM_OBJECT Object = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (DeviceInit == NULL || *DeviceInit == NULL || ShimDriver == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    Object = ShimObjectCreate(ShimObjectDevice, ShimDriver);
+    if (Object == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    if (DeviceAttributes != NULL && DeviceAttributes->ContextTypeInfo != NULL) {
+        Status = ShimObjectAddContext(Object, DeviceAttributes->ContextTypeInfo, NULL);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+    }
+    if (DeviceAttributes != NULL) {
+        Object->u.Device.EvtCleanupCallback = DeviceAttributes->EvtCleanupCallback;
+    }
+
+    //
+    // The framework owns the init structure once the device exists.
+    //
+    Object->u.Device.Init = **DeviceInit;
+    free(*DeviceInit);
+    *DeviceInit = NULL;
+
+    ShimDevices = Object;
+    *Device = Object;
+    return STATUS_SUCCESS;
+}
+
+//
+// Keeps the last component of the link, \DosDevices\Name is opened by
+// ShimOpenDevice as Name.
+//
+NTSTATUS WdfDeviceCreateSymbolicLink(WDFDEVICE Device, PCUNICODE_STRING SymbolicLinkName)
+{
+    PCWSTR Name = NULL;
+    size_t Length = 0;
+
+    if (SymbolicLinkName == NULL || SymbolicLinkName->Buffer == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    Name = wcsrchr(SymbolicLinkName->Buffer, L'\\');
+    Name = (Name != NULL) ? Name + 1 : SymbolicLinkName->Buffer;
+    Length = wcslen(Name);
+    if (Length == 0 || Length >= sizeof(Device->u.Device.SymbolicLink) / sizeof(WCHAR)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    wcscpy(Device->u.Device.SymbolicLink, Name);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfControlFinishInitializing(WDFDEVICE Device)
+{
+    Device->u.Device.Initialized = TRUE;
+}
+
+//
+// Queue.
+//
+NTSTATUS WdfIoQueueCreate(WDFDEVICE Device, PWDF_IO_QUEUE_CONFIG Config, PWDF_OBJECT_ATTRIBUTES QueueAttributes, WDFQUEUE* Queue)
+{
+    PSHIM_OBJECT Object = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Device == NULL || Config == NULL || (Config->DefaultQueue && Device->u.Device.DefaultQueue != NULL)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (Config->DefaultQueue ?
+        (Config->DispatchType != WdfIoQueueDispatchSequential && Config->DispatchType != WdfIoQueueDispatchParallel) :
+        (Config->DispatchType != WdfIoQueueDispatchManual)) {
+        return STATUS_NOT_IMPLEMENTED;
+    }
+    Object = ShimObjectCreate(ShimObjectQueue, Device);
+    if (Object == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    pthread_mutex_init(&Object->u.Queue.Lock, NULL);
+    pthread_cond_init(&Object->u.Queue.Idle, NULL);
+    Object->u.Queue.Config = *Config;
+    Object->u.Queue.Device = Device;
+    if (Config->DefaultQueue && ShimDispatchOverride != WdfIoQueueDispatchInvalid) {
+        Object->u.Queue.Config.DispatchType = ShimDispatchOverride;
+    }
+    if (QueueAttributes != NULL && QueueAttributes->ContextTypeInfo != NULL) {
+        Status = ShimObjectAddContext(Object, QueueAttributes->ContextTypeInfo, NULL);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    if (Config->DefaultQueue) {
+        Device->u.Device.DefaultQueue = Object;
+    }
+    if (Queue != NULL) {
+        *Queue = Object;
+    }
+    return STATUS_SUCCESS;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+    return Queue->u.Queue.Device;
+}
+
+//
+// Lets the next request into a sequential queue.
+//
+static VOID ShimQueueRelease(PSHIM_OBJECT Queue)
+{
+    if (Queue != NULL && Queue->u.Queue.Config.DispatchType == WdfIoQueueDispatchSequential) {
+        pthread_mutex_lock(&Queue->u.Queue.Lock);
+        Queue->u.Queue.Busy = FALSE;
+        pthread_cond_signal(&Queue->u.Queue.Idle);
+        pthread_mutex_unlock(&Queue->u.Queue.Lock);
+    }
+}
+
+//
+// Takes a request off the list of a manual queue, FALSE if it is not on
+// it. The caller holds ShimCancelLock.
+//
+static BOOLEAN ShimQueueRemove(PSHIM_OBJECT Queue, PSHIM_OBJECT Request)
+{
+    PSHIM_OBJECT* Link = NULL;
+
+    for (Link = &Queue->u.Queue.Requests; *Link != NULL; Link = &(*Link)->u.Request.Next)
+    {
+        if (*Link == Request) {
+            *Link = Request->u.Request.Next;
+            Request->u.Request.Next = NULL;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//
+// Hands a canceled request to the queue's callback, or completes it.
+//
+static VOID ShimQueueCancel(PSHIM_OBJECT Queue, PSHIM_OBJECT Request)
+{
+    if (Queue->u.Queue.Config.EvtIoCanceledOnQueue != NULL) {
+        Queue->u.Queue.Config.EvtIoCanceledOnQueue(Queue, Request);
+    }
+    else {
+        WdfRequestComplete(Request, STATUS_CANCELLED);
+    }
+}
+
+//
+// Hands a request to the driver. A sequential queue waits until the
+// request it dispatched before has been completed.
+//
+static VOID ShimQueueDispatch(PSHIM_OBJECT Queue, PSHIM_OBJECT Request)
+{
+    WDF_REQUEST_PARAMETERS* Parameters = &Request->u.Request.Parameters;
+
+    if (Queue->u.Queue.Config.DispatchType == WdfIoQueueDispatchSequential) {
+        pthread_mutex_lock(&Queue->u.Queue.Lock);
+        while (Queue->u.Queue.Busy) {
+            pthread_cond_wait(&Queue->u.Queue.Idle, &Queue->u.Queue.Lock);
+        }
+        Queue->u.Queue.Busy = TRUE;
+        pthread_mutex_unlock(&Queue->u.Queue.Lock);
+    }
+
+    Request->u.Request.Queue = Queue;
+    if (Queue->u.Queue.Config.EvtIoDeviceControl == NULL) {
+        WdfRequestComplete(Request, STATUS_INVALID_DEVICE_REQUEST);
+        return;
+    }
+    Queue->u.Queue.Config.EvtIoDeviceControl(Queue, Request, Parameters->Parameters.DeviceIoControl.OutputBufferLength,
+                                             Parameters->Parameters.DeviceIoControl.InputBufferLength,
+                                             Parameters->Parameters.DeviceIoControl.IoControlCode);
+}
+
+//
+// Cancels every request a manual queue holds.
+//
+static VOID ShimQueuePurge(PSHIM_OBJECT Queue)
+{
+    PSHIM_OBJECT Request = NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&ShimCancelLock);
+        Request = Queue->u.Queue.Requests;
+        if (Request != NULL) {
+            Queue->u.Queue.Requests = Request->u.Request.Next;
+            Request->u.Request.Next = NULL;
+            Request->u.Request.Canceled = TRUE;
+        }
+        pthread_mutex_unlock(&ShimCancelLock);
+        if (Request == NULL) {
+            return;
+        }
+        ShimQueueCancel(Queue, Request);
+    }
+}
+
+NTSTATUS WdfDeviceEnqueueRequest(WDFDEVICE Device, WDFREQUEST Request)
+{
+    if (Device == NULL || Device->u.Device.DefaultQueue == NULL || !Request->u.Request.InCallerContext) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    Request->u.Request.InCallerContext = FALSE;
+    ShimQueueDispatch(Device->u.Device.DefaultQueue, Request);
+    return STATUS_SUCCESS;
+}
+
+//
+// Request.
+//
+VOID WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters)
+{
+    *Parameters = Request->u.Request.Parameters;
+}
+
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredLength, PVOID* Buffer, size_t* Length)
+{
+    size_t InputBufferLength = Request->u.Request.Parameters.Parameters.DeviceIoControl.InputBufferLength;
+
+    if (METHOD_FROM_CTL_CODE(Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode) == METHOD_NEITHER) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (InputBufferLength == 0 || InputBufferLength < MinimumRequiredLength) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+    *Buffer = Request->u.Request.InputBuffer;
+    if (Length != NULL) {
+        *Length = InputBufferLength;
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize, PVOID* Buffer, size_t* Length)
+{
+    size_t OutputBufferLength = Request->u.Request.Parameters.Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (METHOD_FROM_CTL_CODE(Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode) == METHOD_NEITHER) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (OutputBufferLength == 0 || OutputBufferLength < MinimumRequiredSize) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+    *Buffer = Request->u.Request.OutputBuffer;
+    if (Length != NULL) {
+        *Length = OutputBufferLength;
+    }
+    return STATUS_SUCCESS;
+}
+
+//
+// The unsafe routines are only valid for METHOD_NEITHER in the caller's
+// context, where the user addresses still mean something.
+//
+NTSTATUS WdfRequestRetrieveUnsafeUserInputBuffer(WDFREQUEST Request, size_t MinimumRequiredLength, PVOID* InputBuffer, size_t* Length)
+{
+    size_t InputBufferLength = Request->u.Request.Parameters.Parameters.DeviceIoControl.InputBufferLength;
+
+    if (!Request->u.Request.InCallerContext ||
+        METHOD_FROM_CTL_CODE(Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode) != METHOD_NEITHER) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (InputBufferLength == 0 || InputBufferLength < MinimumRequiredLength) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+    *InputBuffer = Request->u.Request.UserInputBuffer;
+    if (Length != NULL) {
+        *Length = InputBufferLength;
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestRetrieveUnsafeUserOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredLength, PVOID* OutputBuffer, size_t* Length)
+{
+    size_t OutputBufferLength = Request->u.Request.Parameters.Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (!Request->u.Request.InCallerContext ||
+        METHOD_FROM_CTL_CODE(Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode) != METHOD_NEITHER) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (OutputBufferLength == 0 || OutputBufferLength < MinimumRequiredLength) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+    *OutputBuffer = Request->u.Request.UserOutputBuffer;
+    if (Length != NULL) {
+        *Length = OutputBufferLength;
+    }
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS ShimRequestLockUserBuffer(WDFREQUEST Request, PVOID Buffer, size_t Length, WDFMEMORY* MemoryObject)
+{
+    PSHIM_OBJECT Memory = NULL;
+
+    if (!Request->u.Request.InCallerContext) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if (Buffer == NULL || Length == 0) {
+        return STATUS_ACCESS_VIOLATION;
+    }
+    Memory = ShimObjectCreate(ShimObjectMemory, Request);
+    if (Memory == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    Memory->u.Memory.Buffer = Buffer;
+    Memory->u.Memory.Size = Length;
+    *MemoryObject = Memory;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestProbeAndLockUserBufferForRead(WDFREQUEST Request, PVOID Buffer, size_t Length, WDFMEMORY* MemoryObject)
+{
+    return ShimRequestLockUserBuffer(Request, Buffer, Length, MemoryObject);
+}
+
+NTSTATUS WdfRequestProbeAndLockUserBufferForWrite(WDFREQUEST Request, PVOID Buffer, size_t Length, WDFMEMORY* MemoryObject)
+{
+    return ShimRequestLockUserBuffer(Request, Buffer, Length, MemoryObject);
+}
+
+//
+// Only manual queues take forwarded requests. A request that was canceled
+// before it got there is canceled on the queue right away.
+//
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue)
+{
+    PSHIM_OBJECT Source = Request->u.Request.Queue;
+    BOOLEAN Canceled = FALSE;
+
+    if (DestinationQueue == NULL || DestinationQueue == Source ||
+        DestinationQueue->u.Queue.Config.DispatchType != WdfIoQueueDispatchManual) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    pthread_mutex_lock(&ShimCancelLock);
+    Request->u.Request.Queue = DestinationQueue;
+    Canceled = Request->u.Request.Canceled;
+    if (!Canceled) {
+        Request->u.Request.Next = DestinationQueue->u.Queue.Requests;
+        DestinationQueue->u.Queue.Requests = Request;
+    }
+    pthread_mutex_unlock(&ShimCancelLock);
+
+    ShimQueueRelease(Source);
+    if (Canceled) {
+        ShimQueueCancel(DestinationQueue, Request);
+    }
+    return STATUS_SUCCESS;
+}
+
+VOID WdfRequestSetInformation(WDFREQUEST Request, ULONG_PTR Information)
+{
+    Request->u.Request.Information = Information;
+}
+
+//
+// Copies a BUFFERED result back, lets the next request into a sequential
+// queue and wakes the sender.
+//
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+    PSHIM_OBJECT Queue = Request->u.Request.Queue;
+    PSHIM_COMPLETION_ROUTINE CompletionRoutine = NULL;
+    PVOID CompletionContext = NULL;
+    size_t OutputBufferLength = Request->u.Request.Parameters.Parameters.DeviceIoControl.OutputBufferLength;
+    ULONG Method = METHOD_FROM_CTL_CODE(Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode);
+
+    ASSERT(!Request->u.Request.Completed);
+
+    if (Request->u.Request.Information > OutputBufferLength) {
+        Request->u.Request.Information = OutputBufferLength;
+    }
+    if (Method == METHOD_BUFFERED && NT_SUCCESS(Status) && Request->u.Request.Information != 0) {
+        RtlCopyMemory(Request->u.Request.UserOutputBuffer, Request->u.Request.SystemBuffer, Request->u.Request.Information);
+        __atomic_fetch_add(&ShimStatistics.BytesCopiedOut, Request->u.Request.Information, __ATOMIC_RELAXED);
+    }
+    if (!NT_SUCCESS(Status)) {
+        Request->u.Request.Information = 0;
+    }
+    Request->u.Request.Status = Status;
+
+    ShimQueueRelease(Queue);
+
+    //
+    // The sender may free the request as soon as it sees it completed, so
+    // the completion routine runs first.
+    //
+    pthread_mutex_lock(&ShimCancelLock);
+    Request->u.Request.Completing = TRUE;
+    CompletionRoutine = Request->u.Request.CompletionRoutine;
+    CompletionContext = Request->u.Request.CompletionContext;
+    pthread_mutex_unlock(&ShimCancelLock);
+
+    if (CompletionRoutine != NULL) {
+        CompletionRoutine(CompletionContext, Status, Request->u.Request.Information);
+    }
+    __atomic_store_n(&Request->u.Request.Completed, TRUE, __ATOMIC_RELEASE);
+}
+
+VOID WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information)
+{
+    WdfRequestSetInformation(Request, Information);
+    WdfRequestComplete(Request, Status);
+}
+
+//
+// Memory and objects.
+//
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t* BufferSize)
+{
+    if (BufferSize != NULL) {
+        *BufferSize = Memory->u.Memory.Size;
+    }
+    return Memory->u.Memory.Buffer;
+}
+
+NTSTATUS WdfObjectAllocateContext(WDFOBJECT Handle, PWDF_OBJECT_ATTRIBUTES ContextAttributes, PVOID* Context)
+{
+    if (Handle == NULL || ContextAttributes == NULL || ContextAttributes->ContextTypeInfo == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return ShimObjectAddContext(Handle, ContextAttributes->ContextTypeInfo, Context);
+}
+
+//
+// Test side.
+//
+VOID ShimOverrideDispatchType(WDF_IO_QUEUE_DISPATCH_TYPE DispatchType)
+{
+    ShimDispatchOverride = DispatchType;
+}
+
+NTSTATUS ShimDriverLoad(PDRIVER_INITIALIZE DriverEntry, WDFDEVICE* ControlDevice)
+{
+    static DRIVER_OBJECT DriverObject = { "ShimDriver" };
+    DECLARE_CONST_UNICODE_STRING(RegistryPath, L"\\Registry\\Machine\\System\\CurrentControlSet\\Services\\ShimDriver");
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (ShimDriver != NULL) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    Status = DriverEntry(&DriverObject, (PUNICODE_STRING)&RegistryPath);
+    if (!NT_SUCCESS(Status)) {
+        ShimDriverUnload();
+        return Status;
+    }
+    if (ShimDevices == NULL || !ShimDevices->u.Device.Initialized) {
+        ShimDriverUnload();
+        return STATUS_NOT_FOUND;
+    }
+    *ControlDevice = ShimDevices;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS ShimOpenDevice(PCSTR Name, WDFDEVICE* Device)
+{
+    PSHIM_OBJECT Object = ShimDevices;
+    size_t Length = strlen(Name);
+    size_t i = 0;
+
+    *Device = NULL;
+    if (Object == NULL || !Object->u.Device.Initialized || Length != wcslen(Object->u.Device.SymbolicLink)) {
+        return STATUS_NOT_FOUND;
+    }
+    for (i = 0; i < Length; i++)
+    {
+        if ((WCHAR)(UCHAR)Name[i] != Object->u.Device.SymbolicLink[i]) {
+            return STATUS_NOT_FOUND;
+        }
+    }
+    if (__atomic_fetch_add(&Object->u.Device.OpenHandles, 1, __ATOMIC_ACQUIRE) != 0 && Object->u.Device.Init.Exclusive) {
+        __atomic_fetch_sub(&Object->u.Device.OpenHandles, 1, __ATOMIC_RELEASE);
+        return STATUS_DEVICE_BUSY;
+    }
+    *Device = Object;
+    return STATUS_SUCCESS;
+}
+
+VOID ShimCloseDevice(WDFDEVICE Device)
+{
+    __atomic_fetch_sub(&Device->u.Device.OpenHandles, 1, __ATOMIC_RELEASE);
+}
+
+VOID ShimDriverUnload(VOID)
+{
+    if (ShimDriver == NULL) {
+        return;
+    }
+    if (ShimDriver->u.Driver.Config.EvtDriverUnload != NULL) {
+        ShimDriver->u.Driver.Config.EvtDriverUnload(ShimDriver);
+    }
+    ShimObjectDelete(ShimDriver);
+    ShimDriver = NULL;
+    ShimDevices = NULL;
+}
+
+NTSTATUS ShimBeginDeviceIoControl(WDFDEVICE Device, ULONG IoControlCode, PVOID InputBuffer, ULONG InputBufferLength,
+                                  PVOID OutputBuffer, ULONG OutputBufferLength, WDFREQUEST* RequestHandle)
+{
+    PSHIM_OBJECT Request = NULL;
+    ULONG Method = METHOD_FROM_CTL_CODE(IoControlCode);
+    size_t SystemBufferLength = 0;
+
+    *RequestHandle = NULL;
+    if (Device == NULL || Device->u.Device.DefaultQueue == NULL) {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+    if ((InputBuffer == NULL && InputBufferLength != 0) || (OutputBuffer == NULL && OutputBufferLength != 0)) {
+        return STATUS_ACCESS_VIOLATION;
+    }
+
+    Request = ShimObjectCreate(ShimObjectRequest, NULL);
+    if (Request == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    WDF_REQUEST_PARAMETERS_INIT(&Request->u.Request.Parameters);
+    Request->u.Request.Parameters.Type = WdfRequestTypeDeviceControl;
+    Request->u.Request.Parameters.Parameters.DeviceIoControl.IoControlCode = IoControlCode;
+    Request->u.Request.Parameters.Parameters.DeviceIoControl.InputBufferLength = InputBufferLength;
+    Request->u.Request.Parameters.Parameters.DeviceIoControl.OutputBufferLength = OutputBufferLength;
+    Request->u.Request.Device = Device;
+    Request->u.Request.UserInputBuffer = InputBuffer;
+    Request->u.Request.UserOutputBuffer = OutputBuffer;
+
+    //
+    // Build what the I/O manager would pass down for the transfer method.
+    //
+    switch (Method)
+    {
+    case METHOD_BUFFERED:
+        SystemBufferLength = (InputBufferLength > OutputBufferLength) ? InputBufferLength : OutputBufferLength;
+        break;
+    case METHOD_IN_DIRECT:
+    case METHOD_OUT_DIRECT:
+        SystemBufferLength = InputBufferLength;
+        Request->u.Request.OutputBuffer = (OutputBufferLength != 0) ? OutputBuffer : NULL;
+        break;
+    default:
+        Request->u.Request.Parameters.Parameters.DeviceIoControl.Type3InputBuffer = InputBuffer;
+        break;
+    }
+    if (SystemBufferLength != 0) {
+        Request->u.Request.SystemBuffer = malloc(SystemBufferLength);
+        if (Request->u.Request.SystemBuffer == NULL) {
+            ShimObjectDelete(Request);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        if (InputBufferLength != 0) {
+            RtlCopyMemory(Request->u.Request.SystemBuffer, InputBuffer, InputBufferLength);
+            __atomic_fetch_add(&ShimStatistics.BytesCopiedIn, InputBufferLength, __ATOMIC_RELAXED);
+        }
+        Request->u.Request.InputBuffer = Request->u.Request.SystemBuffer;
+        if (Method == METHOD_BUFFERED) {
+            Request->u.Request.OutputBuffer = Request->u.Request.SystemBuffer;
+        }
+    }
+    __atomic_fetch_add(&ShimStatistics.Requests, 1, __ATOMIC_RELAXED);
+
+    if (Device->u.Device.Init.EvtIoInCallerContext != NULL) {
+        Request->u.Request.InCallerContext = TRUE;
+        Device->u.Device.Init.EvtIoInCallerContext(Device, Request);
+    }
+    else {
+        ShimQueueDispatch(Device->u.Device.DefaultQueue, Request);
+    }
+
+    *RequestHandle = Request;
+    return STATUS_PENDING;
+}
+
+BOOLEAN ShimSetCompletionRoutine(WDFREQUEST Request, PSHIM_COMPLETION_ROUTINE CompletionRoutine, PVOID CompletionContext)
+{
+    BOOLEAN Set = FALSE;
+
+    pthread_mutex_lock(&ShimCancelLock);
+    if (!Request->u.Request.Completing) {
+        Request->u.Request.CompletionRoutine = CompletionRoutine;
+        Request->u.Request.CompletionContext = CompletionContext;
+        Set = TRUE;
+    }
+    pthread_mutex_unlock(&ShimCancelLock);
+    return Set;
+}
+
+//
+// A request waiting on a manual queue is canceled there, one the driver
+// still owns is only marked.
+//
+VOID ShimCancelIo(WDFREQUEST Request)
+{
+    PSHIM_OBJECT Queue = NULL;
+    BOOLEAN Removed = FALSE;
+
+    pthread_mutex_lock(&ShimCancelLock);
+    Request->u.Request.Canceled = TRUE;
+    Queue = Request->u.Request.Queue;
+    if (Queue != NULL && Queue->u.Queue.Config.DispatchType == WdfIoQueueDispatchManual) {
+        Removed = ShimQueueRemove(Queue, Request);
+    }
+    pthread_mutex_unlock(&ShimCancelLock);
+
+    if (Removed) {
+        ShimQueueCancel(Queue, Request);
+    }
+}
+
+NTSTATUS ShimEndDeviceIoControl(WDFREQUEST Request, PULONG BytesReturned)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    //
+    // A driver may complete the request later from another thread.
+    //
+    while (!__atomic_load_n(&Request->u.Request.Completed, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    Status = Request->u.Request.Status;
+    *BytesReturned = (ULONG)Request->u.Request.Information;
+    free(Request->u.Request.SystemBuffer);
+    ShimObjectDelete(Request);
+    return Status;
+}
+
+NTSTATUS ShimDeviceIoControl(WDFDEVICE Device, ULONG IoControlCode, PVOID InputBuffer, ULONG InputBufferLength,
+                             PVOID OutputBuffer, ULONG OutputBufferLength, PULONG BytesReturned)
+{
+    WDFREQUEST Request = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *BytesReturned = 0;
+    Status = ShimBeginDeviceIoControl(Device, IoControlCode, InputBuffer, InputBufferLength,
+                                      OutputBuffer, OutputBufferLength, &Request);
+    if (Request == NULL) {
+        return Status;
+    }
+    return ShimEndDeviceIoControl(Request, BytesReturned);
+}
+
+VOID ShimGetStatistics(PSHIM_STATISTICS Statistics)
+{
+    Statistics->Requests = __atomic_load_n(&ShimStatistics.Requests, __ATOMIC_RELAXED);
+    Statistics->BytesCopiedIn = __atomic_load_n(&ShimStatistics.BytesCopiedIn, __ATOMIC_RELAXED);
+    Statistics->BytesCopiedOut = __atomic_load_n(&ShimStatistics.BytesCopiedOut, __ATOMIC_RELAXED);
+}
+
+VOID ShimResetStatistics(VOID)
+{
+    __atomic_store_n(&ShimStatistics.Requests, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ShimStatistics.BytesCopiedIn, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ShimStatistics.BytesCopiedOut, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,89 @@
+/*++
+
+Module Name:
+
+    WdfShim.h
+
+Abstract:
+
+    Test side of the user mode WDF shim. A driver is loaded by calling its
+    DriverEntry, requests are sent to its control device the way
+    DeviceIoControl sends them and the shim counts the bytes it copies on
+    behalf of the I/O manager.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include "wdf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Bytes the I/O manager would copy: the system buffer fill of BUFFERED and
+// DIRECT requests and the copy back of BUFFERED ones.
+//
+typedef struct _SHIM_STATISTICS {
+    ULONG64 Requests;
+    ULONG64 BytesCopiedIn;
+    ULONG64 BytesCopiedOut;
+} SHIM_STATISTICS, *PSHIM_STATISTICS;
+
+//
+// WdfIoQueueDispatchInvalid keeps the dispatch type the driver asks for,
+// any other value replaces it for the queues created by the next load.
+//
+VOID ShimOverrideDispatchType(WDF_IO_QUEUE_DISPATCH_TYPE DispatchType);
+
+NTSTATUS ShimDriverLoad(PDRIVER_INITIALIZE DriverEntry, WDFDEVICE* ControlDevice);
+VOID ShimDriverUnload(VOID);
+
+//
+// Opens the control device of the loaded driver by the last component of
+// its symbolic link the way CreateFile opens \\.\Name. An exclusive
+// device returns STATUS_DEVICE_BUSY while another handle is open.
+//
+NTSTATUS ShimOpenDevice(PCSTR Name, WDFDEVICE* Device);
+VOID ShimCloseDevice(WDFDEVICE Device);
+
+//
+// Sends an IOCTL and returns once the driver completed it. Any number of
+// threads may call it at the same time, the queue decides how many
+// requests the driver sees at once.
+//
+NTSTATUS ShimDeviceIoControl(WDFDEVICE Device, ULONG IoControlCode, PVOID InputBuffer, ULONG InputBufferLength,
+                             PVOID OutputBuffer, ULONG OutputBufferLength, PULONG BytesReturned);
+
+//
+// Overlapped form of ShimDeviceIoControl. Begin returns once the driver
+// has dispatched the request, which may still be pending. End waits for
+// the completion and frees the request, CancelIo cancels it the way
+// CancelIoEx does.
+//
+NTSTATUS ShimBeginDeviceIoControl(WDFDEVICE Device, ULONG IoControlCode, PVOID InputBuffer, ULONG InputBufferLength,
+                                  PVOID OutputBuffer, ULONG OutputBufferLength, WDFREQUEST* Request);
+VOID ShimCancelIo(WDFREQUEST Request);
+NTSTATUS ShimEndDeviceIoControl(WDFREQUEST Request, PULONG BytesReturned);
+
+//
+// Has WdfRequestComplete call CompletionRoutine on the completing thread,
+// after which End no longer waits. Returns FALSE without setting it if
+// the request is already complete.
+//
+typedef VOID SHIM_COMPLETION_ROUTINE(PVOID Context, NTSTATUS Status, ULONG_PTR Information);
+typedef SHIM_COMPLETION_ROUTINE* PSHIM_COMPLETION_ROUTINE;
+
+BOOLEAN ShimSetCompletionRoutine(WDFREQUEST Request, PSHIM_COMPLETION_ROUTINE CompletionRoutine, PVOID CompletionContext);
+
+VOID ShimGetStatistics(PSHIM_STATISTICS Statistics);
+VOID ShimResetStatistics(VOID);
+
+#ifdef __cplusplus
+}
+#endif
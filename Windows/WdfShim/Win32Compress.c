@@ -0,0 +1,391 @@
+/*++
+
+Module Name:
+
+    Win32Compress.c
+
+Abstract:
+
+    Compression routines declared by win32/compressapi.h. Unlike
+    Win32Shim.c this file is compiled against win32/Windows.h.
+
+    XPRESS data is Plain LZ77 as in [MS-XCA]: a 32-bit flag word ahead of
+    every 32 items, a clear flag for a literal byte and a set one for a
+    match. A match is 2 bytes of the distance minus one above the length
+    minus three, lengths from 10 on continue in a half byte shared by two
+    matches, then a byte, then 2 or 6 more bytes. Trailing flags are set,
+    a set flag at the end of the input ends the data. The compressor is
+    greedy and takes the last position whose first 3 bytes hash alike,
+    if it is at most 8 KB back.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <compressapi.h>
+
+#define XPRESS_MAX_DISTANCE                 0x2000
+#define XPRESS_MIN_MATCH                    3
+#define XPRESS_HASH_BITS                    15
+
+//
+// Hash holds the position plus one of the last occurrence of every hash,
+// a decompressor has none.
+//
+struct _COMPRESSOR_HANDLE {
+    DWORD Algorithm;
+    BOOLEAN Compressor;
+    UINT32 Hash[];
+};
+
+static VOID XpressStore(PUINT8 Out, UINT32 Value, ULONG Bytes)
+{
+    for (ULONG i = 0; i < Bytes; i++)
+    {
+        Out[i] = (UINT8)(Value >> (8 * i));
+    }
+}
+
+static UINT32 XpressLoad(const UINT8* In, ULONG Bytes)
+{
+    UINT32 Value = 0;
+
+    for (ULONG i = 0; i < Bytes; i++)
+    {
+        Value |= (UINT32)In[i] << (8 * i);
+    }
+    return Value;
+}
+
+static UINT32 XpressHash(const UINT8* In)
+{
+    return ((In[0] | ((UINT32)In[1] << 8) | ((UINT32)In[2] << 16)) * 2654435761U) >> (32 - XPRESS_HASH_BITS);
+}
+
+static BOOL XpressCreate(DWORD Algorithm, BOOLEAN Compressor, PCOMPRESSOR_HANDLE Handle)
+{
+    COMPRESSOR_HANDLE New;
+
+    if (Handle == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if (Algorithm != COMPRESS_ALGORITHM_XPRESS) {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+
+    New = (COMPRESSOR_HANDLE)calloc(1, sizeof(*New) + (Compressor ? sizeof(UINT32) << XPRESS_HASH_BITS : 0));
+    if (New == NULL) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    New->Algorithm = Algorithm;
+    New->Compressor = Compressor;
+    *Handle = New;
+    return TRUE;
+}
+
+BOOL CreateCompressor(DWORD Algorithm, PCOMPRESS_ALLOCATION_ROUTINES AllocationRoutines, PCOMPRESSOR_HANDLE CompressorHandle)
+{
+    (VOID)AllocationRoutines;
+    return XpressCreate(Algorithm, TRUE, CompressorHandle);
+}
+
+BOOL CreateDecompressor(DWORD Algorithm, PCOMPRESS_ALLOCATION_ROUTINES AllocationRoutines, PDECOMPRESSOR_HANDLE DecompressorHandle)
+{
+    (VOID)AllocationRoutines;
+    return XpressCreate(Algorithm, FALSE, DecompressorHandle);
+}
+
+BOOL CloseCompressor(COMPRESSOR_HANDLE CompressorHandle)
+{
+    if (CompressorHandle == NULL || !CompressorHandle->Compressor) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    free(CompressorHandle);
+    return TRUE;
+}
+
+BOOL CloseDecompressor(DECOMPRESSOR_HANDLE DecompressorHandle)
+{
+    if (DecompressorHandle == NULL || DecompressorHandle->Compressor) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    free(DecompressorHandle);
+    return TRUE;
+}
+
+//
+// Fails with ERROR_INSUFFICIENT_BUFFER as soon as the next item would not
+// fit, nothing is reported about the size it would have needed.
+//
+BOOL Compress(COMPRESSOR_HANDLE CompressorHandle, LPCVOID UncompressedData, SIZE_T UncompressedDataSize, PVOID CompressedBuffer,
+              SIZE_T CompressedBufferSize, PSIZE_T CompressedDataSize)
+{
+    const UINT8* In = (const UINT8*)UncompressedData;
+    PUINT8 Out = (PUINT8)CompressedBuffer;
+    SIZE_T InPos = 0;
+    SIZE_T OutPos = 4;
+    SIZE_T FlagPos = 0;
+    SIZE_T HalfByte = 0;
+    UINT32 Flags = 0;
+    UINT32 FlagCount = 0;
+
+    if (CompressorHandle == NULL || !CompressorHandle->Compressor) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if ((In == NULL && UncompressedDataSize != 0) || UncompressedDataSize >= 0xFFFFFFFF || CompressedDataSize == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    if (Out == NULL || CompressedBufferSize < 4) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+
+    memset(CompressorHandle->Hash, 0, sizeof(UINT32) << XPRESS_HASH_BITS);
+
+    while (InPos < UncompressedDataSize)
+    {
+        SIZE_T Length = 0;
+        SIZE_T Distance = 0;
+        SIZE_T Need = 1;
+
+        if (UncompressedDataSize - InPos >= XPRESS_MIN_MATCH) {
+            PUINT32 Slot = &CompressorHandle->Hash[XpressHash(In + InPos)];
+
+            if (*Slot != 0 && InPos - (*Slot - 1) <= XPRESS_MAX_DISTANCE) {
+                SIZE_T Candidate = *Slot - 1;
+
+                while (InPos + Length < UncompressedDataSize && In[Candidate + Length] == In[InPos + Length])
+                {
+                    Length++;
+                }
+                Distance = InPos - Candidate;
+            }
+            *Slot = (UINT32)(InPos + 1);
+        }
+
+        //
+        // Extra is the length minus three, 7 and 15 in the shorter fields
+        // say it continues in the next one.
+        //
+        if (Length >= XPRESS_MIN_MATCH) {
+            SIZE_T Extra = Length - XPRESS_MIN_MATCH;
+
+            Need = 2;
+            if (Extra >= 7) {
+                Need += (HalfByte == 0);
+                if (Extra - 7 >= 15) {
+                    Need += (Extra - 7 - 15 < 255) ? 1 : ((Extra < 0x10000) ? 3 : 7);
+                }
+            }
+        }
+        if (CompressedBufferSize - OutPos < Need + ((FlagCount == 31) ? 4 : 0)) {
+            SetLastError(ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+
+        if (Length >= XPRESS_MIN_MATCH) {
+            SIZE_T Extra = Length - XPRESS_MIN_MATCH;
+
+            XpressStore(Out + OutPos, (UINT32)(((Distance - 1) << 3) | ((Extra < 7) ? Extra : 7)), 2);
+            OutPos += 2;
+            if (Extra >= 7) {
+                UINT8 Nibble = (UINT8)((Extra - 7 < 15) ? Extra - 7 : 15);
+
+                if (HalfByte == 0) {
+                    HalfByte = OutPos;
+                    Out[OutPos++] = Nibble;
+                }
+                else {
+                    Out[HalfByte] |= (UINT8)(Nibble << 4);
+                    HalfByte = 0;
+                }
+
+                if (Nibble == 15) {
+                    if (Extra - 7 - 15 < 255) {
+                        Out[OutPos++] = (UINT8)(Extra - 7 - 15);
+                    }
+                    else {
+                        Out[OutPos++] = 255;
+                        if (Extra < 0x10000) {
+                            XpressStore(Out + OutPos, (UINT32)Extra, 2);
+                            OutPos += 2;
+                        }
+                        else {
+                            XpressStore(Out + OutPos, 0, 2);
+                            XpressStore(Out + OutPos + 2, (UINT32)Extra, 4);
+                            OutPos += 6;
+                        }
+                    }
+                }
+            }
+            Flags = (Flags << 1) | 1;
+            InPos += Length;
+        }
+        else {
+            Out[OutPos++] = In[InPos++];
+            Flags <<= 1;
+        }
+
+        if (++FlagCount == 32) {
+            XpressStore(Out + FlagPos, Flags, 4);
+            Flags = 0;
+            FlagCount = 0;
+            FlagPos = OutPos;
+            OutPos += 4;
+        }
+    }
+
+    Flags = (FlagCount == 0) ? 0xFFFFFFFF : (Flags << (32 - FlagCount)) | ((1U << (32 - FlagCount)) - 1);
+    XpressStore(Out + FlagPos, Flags, 4);
+    *CompressedDataSize = OutPos;
+    return TRUE;
+}
+
+//
+// Every field is checked against the end of the input and every match
+// against the output written so far, corrupt data fails with
+// ERROR_BAD_COMPRESSION_BUFFER and data that expands past the buffer with
+// ERROR_INSUFFICIENT_BUFFER.
+//
+BOOL Decompress(DECOMPRESSOR_HANDLE DecompressorHandle, LPCVOID CompressedData, SIZE_T CompressedDataSize, PVOID UncompressedBuffer,
+                SIZE_T UncompressedBufferSize, PSIZE_T UncompressedDataSize)
+{
+    const UINT8* In = (const UINT8*)CompressedData;
+    PUINT8 Out = (PUINT8)UncompressedBuffer;
+    SIZE_T InPos = 0;
+    SIZE_T OutPos = 0;
+    SIZE_T HalfByte = 0;
+    UINT32 Flags = 0;
+    UINT32 FlagCount = 0;
+
+    if (DecompressorHandle == NULL || DecompressorHandle->Compressor) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (In == NULL || UncompressedDataSize == NULL || (Out == NULL && UncompressedBufferSize != 0)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    for (;;)
+    {
+        SIZE_T Length, Distance;
+        UINT32 Match;
+
+        if (FlagCount == 0) {
+            if (CompressedDataSize - InPos < 4) {
+                goto Corrupt;
+            }
+            Flags = XpressLoad(In + InPos, 4);
+            InPos += 4;
+            FlagCount = 32;
+        }
+        FlagCount--;
+
+        if ((Flags & (1U << FlagCount)) == 0) {
+            if (InPos == CompressedDataSize) {
+                goto Corrupt;
+            }
+            if (OutPos == UncompressedBufferSize) {
+                SetLastError(ERROR_INSUFFICIENT_BUFFER);
+                return FALSE;
+            }
+            Out[OutPos++] = In[InPos++];
+            continue;
+        }
+
+        if (InPos == CompressedDataSize) {
+            break;
+        }
+        if (CompressedDataSize - InPos < 2) {
+            goto Corrupt;
+        }
+        Match = XpressLoad(In + InPos, 2);
+        InPos += 2;
+        Length = Match & 7;
+        Distance = (Match >> 3) + 1;
+
+        if (Length == 7) {
+            if (HalfByte == 0) {
+                if (InPos == CompressedDataSize) {
+                    goto Corrupt;
+                }
+                Length = In[InPos] & 15;
+                HalfByte = InPos++;
+            }
+            else {
+                Length = In[HalfByte] >> 4;
+                HalfByte = 0;
+            }
+
+            if (Length == 15) {
+                if (InPos == CompressedDataSize) {
+                    goto Corrupt;
+                }
+                Length = In[InPos++];
+                if (Length == 255) {
+                    if (CompressedDataSize - InPos < 2) {
+                        goto Corrupt;
+                    }
+                    Length = XpressLoad(In + InPos, 2);
+                    InPos += 2;
+                    if (Length == 0) {
+                        if (CompressedDataSize - InPos < 4) {
+                            goto Corrupt;
+                        }
+                        Length = XpressLoad(In + InPos, 4);
+                        InPos += 4;
+                    }
+                    if (Length < 15 + 7) {
+                        goto Corrupt;
+                    }
+                    Length -= 15 + 7;
+                }
+                Length += 15;
+            }
+            Length += 7;
+        }
+        Length += XPRESS_MIN_MATCH;
+
+        if (Distance > OutPos) {
+            goto Corrupt;
+        }
+        if (UncompressedBufferSize - OutPos < Length) {
+            SetLastError(ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+
+        //
+        // A match may overlap the bytes it produces, a distance of one
+        // repeats the last byte.
+        //
+        if (Distance >= Length) {
+            memcpy(Out + OutPos, Out + OutPos - Distance, Length);
+        }
+        else {
+            for (SIZE_T i = 0; i < Length; i++)
+            {
+                Out[OutPos + i] = Out[OutPos + i - Distance];
+            }
+        }
+        OutPos += Length;
+    }
+
+    *UncompressedDataSize = OutPos;
+    return TRUE;
+
+Corrupt:
+    SetLastError(ERROR_BAD_COMPRESSION_BUFFER);
+    return FALSE;
+}
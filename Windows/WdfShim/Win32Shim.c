@@ -0,0 +1,1629 @@
+/*++
+
+Module Name:
+
+    Win32Shim.c
+
+Abstract:
+
+    Win32 routines declared by win32/Windows.h for user mode code running
+    on Linux next to a driver loaded through the WDF shim. The file is
+    compiled against the kernel headers of the shim, the Win32 types it
+    needs are laid out as in win32/Windows.h.
+
+    \\.\Name opens the control device of the loaded driver, its IOCTLs are
+    sent with ShimBeginDeviceIoControl and overlapped ones complete through
+    a completion routine. Named pipes are SOCK_SEQPACKET Unix domain
+    sockets in the abstract namespace, which keep message boundaries, and
+    their overlapped operations are finished by one I/O thread polling the
+    sockets. Any other name is a file, which can be mapped read-only.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "WdfShim.h"
+
+typedef INT32 BOOL;
+typedef const void* LPCVOID;
+typedef DWORD* LPDWORD;
+
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    union {
+        struct {
+            DWORD Offset;
+            DWORD OffsetHigh;
+        };
+        PVOID Pointer;
+    };
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+#define INVALID_HANDLE_VALUE                ((HANDLE)(intptr_t)-1)
+#define INFINITE                            0xFFFFFFFF
+
+#define ERROR_INVALID_FUNCTION              1
+#define ERROR_FILE_NOT_FOUND                2
+#define ERROR_ACCESS_DENIED                 5
+#define ERROR_INVALID_HANDLE                6
+#define ERROR_NOT_ENOUGH_MEMORY             8
+#define ERROR_NOT_READY                     21
+#define ERROR_GEN_FAILURE                   31
+#define ERROR_NOT_SUPPORTED                 50
+#define ERROR_FILE_EXISTS                   80
+#define ERROR_INVALID_PARAMETER             87
+#define ERROR_BROKEN_PIPE                   109
+#define ERROR_INSUFFICIENT_BUFFER           122
+#define ERROR_BUSY                          170
+#define ERROR_PIPE_BUSY                     231
+#define ERROR_PIPE_NOT_CONNECTED            233
+#define ERROR_MORE_DATA                     234
+#define ERROR_PIPE_CONNECTED                535
+#define ERROR_OPERATION_ABORTED             995
+#define ERROR_IO_INCOMPLETE                 996
+#define ERROR_IO_PENDING                    997
+#define ERROR_NOACCESS                      998
+#define ERROR_NOT_FOUND                     1168
+#define ERROR_NO_SYSTEM_RESOURCES           1450
+#define ERROR_TIMEOUT                       1460
+
+#define GENERIC_READ                        0x80000000
+#define GENERIC_WRITE                       0x40000000
+#define CREATE_NEW                          1
+#define CREATE_ALWAYS                       2
+#define OPEN_EXISTING                       3
+#define OPEN_ALWAYS                         4
+#define TRUNCATE_EXISTING                   5
+#define FILE_FLAG_FIRST_PIPE_INSTANCE       0x00080000
+#define FILE_BEGIN                          0
+#define FILE_CURRENT                        1
+#define FILE_END                            2
+#define WAIT_OBJECT_0                       0x00000000
+#define WAIT_TIMEOUT                        0x00000102
+#define WAIT_FAILED                         0xFFFFFFFF
+#define MEM_RELEASE                         0x00008000
+#define PAGE_READONLY                       0x02
+#define FILE_MAP_READ                       0x0004
+
+#define STATUS_PIPE_DISCONNECTED            ((NTSTATUS)0xC00000B0L)
+#define STATUS_PIPE_BROKEN                  ((NTSTATUS)0xC000014BL)
+
+#define WIN32_DEVICE_PREFIX                 "\\\\.\\"
+#define WIN32_PIPE_PREFIX                   "\\\\.\\pipe\\"
+#define WIN32_COUNTER_FREQUENCY             10000000
+
+typedef enum _WIN32_HANDLE_TYPE {
+    Win32HandleEvent,
+    Win32HandleDevice,
+    Win32HandleFile,
+    Win32HandlePipe,
+    Win32HandleMapping,
+} WIN32_HANDLE_TYPE;
+
+//
+// Every server instance of a pipe name accepts from the same listening
+// socket.
+//
+typedef struct _WIN32_PIPE_NAME {
+    struct _WIN32_PIPE_NAME* Next;
+    char Name[sizeof(((struct sockaddr_un*)0)->sun_path) - 1];
+    int Listener;
+    ULONG Instances;
+} WIN32_PIPE_NAME, *PWIN32_PIPE_NAME;
+
+typedef struct _WIN32_HANDLE {
+    WIN32_HANDLE_TYPE Type;
+    union {
+        struct {
+            BOOLEAN ManualReset;
+            BOOLEAN Signaled;
+        } Event;
+
+        struct {
+            WDFDEVICE Device;
+            DWORD Access;
+        } Device;
+
+        struct {
+            int Fd;
+        } File;
+
+        //
+        // Name is set for server instances, Fd is -1 while an instance is
+        // not connected.
+        //
+        struct {
+            PWIN32_PIPE_NAME Name;
+            int Fd;
+        } Pipe;
+
+        //
+        // Fd is a duplicate of the file descriptor, the mapping outlives
+        // the file handle as on Windows.
+        //
+        struct {
+            int Fd;
+            ULONG64 Size;
+        } Mapping;
+    } u;
+} WIN32_HANDLE, *PWIN32_HANDLE;
+
+typedef enum _WIN32_IO_TYPE {
+    Win32IoDevice,
+    Win32IoConnect,
+    Win32IoRead,
+    Win32IoWrite,
+} WIN32_IO_TYPE;
+
+//
+// An overlapped operation in flight. A device operation stays listed
+// until GetOverlappedResult or CloseHandle ends its request, a pipe
+// operation until the I/O thread or CancelIoEx finishes it.
+//
+typedef struct _WIN32_IO {
+    struct _WIN32_IO* Next;
+    WIN32_IO_TYPE Type;
+    PWIN32_HANDLE Handle;
+    LPOVERLAPPED Overlapped;
+    WDFREQUEST Request;
+    PVOID Buffer;
+    ULONG Length;
+    BOOLEAN CancelRequested;
+    BOOLEAN Canceling;
+} WIN32_IO, *PWIN32_IO;
+
+//
+// Win32Lock guards events, the operation list and the pipe names, and
+// Win32Changed is broadcast whenever an event is set or an operation
+// finishes.
+//
+static pthread_mutex_t Win32Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Win32Changed = PTHREAD_COND_INITIALIZER;
+static PWIN32_IO Win32Ios = NULL;
+static PWIN32_PIPE_NAME Win32PipeNames = NULL;
+static pthread_once_t Win32IoThreadOnce = PTHREAD_ONCE_INIT;
+static int Win32IoWake = -1;
+static ULONG64 Win32IoPolls = 0;
+static WDFDEVICE Win32LoadedDevice = NULL;
+static __thread DWORD Win32LastError = 0;
+
+extern DRIVER_INITIALIZE DriverEntry;
+
+DWORD GetLastError(VOID)
+{
+    return Win32LastError;
+}
+
+VOID SetLastError(DWORD dwErrCode)
+{
+    Win32LastError = dwErrCode;
+}
+
+static DWORD Win32ErrorFromStatus(NTSTATUS Status)
+{
+    switch (Status)
+    {
+    case STATUS_BUFFER_OVERFLOW:
+        return ERROR_MORE_DATA;
+    case STATUS_CANCELLED:
+        return ERROR_OPERATION_ABORTED;
+    case STATUS_PIPE_BROKEN:
+        return ERROR_BROKEN_PIPE;
+    case STATUS_PIPE_DISCONNECTED:
+        return ERROR_PIPE_NOT_CONNECTED;
+    case STATUS_INVALID_PARAMETER:
+        return ERROR_INVALID_PARAMETER;
+    case STATUS_INVALID_DEVICE_REQUEST:
+    case STATUS_NOT_IMPLEMENTED:
+        return ERROR_INVALID_FUNCTION;
+    case STATUS_BUFFER_TOO_SMALL:
+    case STATUS_INVALID_BUFFER_SIZE:
+        return ERROR_INSUFFICIENT_BUFFER;
+    case STATUS_ACCESS_VIOLATION:
+        return ERROR_NOACCESS;
+    case STATUS_ACCESS_DENIED:
+        return ERROR_ACCESS_DENIED;
+    case STATUS_NO_MEMORY:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    case STATUS_INSUFFICIENT_RESOURCES:
+        return ERROR_NO_SYSTEM_RESOURCES;
+    case STATUS_DEVICE_BUSY:
+        return ERROR_BUSY;
+    case STATUS_NOT_FOUND:
+        return ERROR_NOT_FOUND;
+    case STATUS_TIMEOUT:
+        return ERROR_TIMEOUT;
+    case STATUS_POWER_STATE_INVALID:
+        return ERROR_NOT_READY;
+    default:
+        return ERROR_GEN_FAILURE;
+    }
+}
+
+static DWORD Win32ErrorFromErrno(int Error)
+{
+    switch (Error)
+    {
+    case ENOENT:
+    case ECONNREFUSED:
+        return ERROR_FILE_NOT_FOUND;
+    case EACCES:
+    case EPERM:
+    case EADDRINUSE:
+        return ERROR_ACCESS_DENIED;
+    case EEXIST:
+        return ERROR_FILE_EXISTS;
+    case ENOMEM:
+        return ERROR_NOT_ENOUGH_MEMORY;
+    case EPIPE:
+    case ECONNRESET:
+        return ERROR_BROKEN_PIPE;
+    case ENOTCONN:
+        return ERROR_PIPE_NOT_CONNECTED;
+    case EAGAIN:
+        return ERROR_PIPE_BUSY;
+    case EINVAL:
+    case ENAMETOOLONG:
+        return ERROR_INVALID_PARAMETER;
+    default:
+        return ERROR_GEN_FAILURE;
+    }
+}
+
+//
+// Sets the result of an I/O and returns it the way the Win32 routines do.
+//
+static BOOL Win32Result(NTSTATUS Status, ULONG_PTR Information, LPDWORD Transferred)
+{
+    if (Transferred != NULL) {
+        *Transferred = (DWORD)Information;
+    }
+    if (!NT_SUCCESS(Status)) {
+        SetLastError(Win32ErrorFromStatus(Status));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static PWIN32_HANDLE Win32HandleCreate(WIN32_HANDLE_TYPE Type)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)calloc(1, sizeof(WIN32_HANDLE));
+
+    if (Handle == NULL) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    Handle->Type = Type;
+    return Handle;
+}
+
+static PWIN32_HANDLE Win32HandleGet(HANDLE Object, WIN32_HANDLE_TYPE Type)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)Object;
+
+    if (Handle == NULL || Object == INVALID_HANDLE_VALUE || Handle->Type != Type) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    return Handle;
+}
+
+//
+// Events. Called with Win32Lock held.
+//
+static VOID Win32EventSet(HANDLE Event)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)Event;
+
+    if (Handle != NULL && Handle->Type == Win32HandleEvent) {
+        Handle->u.Event.Signaled = TRUE;
+        pthread_cond_broadcast(&Win32Changed);
+    }
+}
+
+//
+// Finishes an overlapped operation. Called with Win32Lock held.
+//
+static VOID Win32IoSetResult(LPOVERLAPPED Overlapped, NTSTATUS Status, ULONG_PTR Information)
+{
+    Overlapped->InternalHigh = NT_SUCCESS(Status) || Status == STATUS_BUFFER_OVERFLOW ? Information : 0;
+    Overlapped->Internal = (ULONG_PTR)(ULONG)Status;
+    Win32EventSet(Overlapped->hEvent);
+    pthread_cond_broadcast(&Win32Changed);
+}
+
+static VOID Win32IoUnlink(PWIN32_IO Io)
+{
+    PWIN32_IO* Link = &Win32Ios;
+
+    while (*Link != NULL && *Link != Io) {
+        Link = &(*Link)->Next;
+    }
+    if (*Link != NULL) {
+        *Link = Io->Next;
+    }
+}
+
+HANDLE CreateEventA(PVOID lpEventAttributes, BOOL bManualReset, BOOL bInitialState, PCSTR lpName)
+{
+    PWIN32_HANDLE Handle = NULL;
+
+    UNREFERENCED_PARAMETER(lpEventAttributes);
+
+    if (lpName != NULL) {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+    Handle = Win32HandleCreate(Win32HandleEvent);
+    if (Handle != NULL) {
+        Handle->u.Event.ManualReset = (bManualReset != FALSE);
+        Handle->u.Event.Signaled = (bInitialState != FALSE);
+    }
+    return Handle;
+}
+
+BOOL SetEvent(HANDLE hEvent)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hEvent, Win32HandleEvent);
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    pthread_mutex_lock(&Win32Lock);
+    Win32EventSet(Handle);
+    pthread_mutex_unlock(&Win32Lock);
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE hEvent)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hEvent, Win32HandleEvent);
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    pthread_mutex_lock(&Win32Lock);
+    Handle->u.Event.Signaled = FALSE;
+    pthread_mutex_unlock(&Win32Lock);
+    return TRUE;
+}
+
+//
+// Only events can be waited on. Waits on all objects take them together,
+// as Windows does.
+//
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds)
+{
+    struct timespec Deadline;
+    DWORD Result = WAIT_TIMEOUT;
+    DWORD i = 0;
+
+    if (nCount == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return WAIT_FAILED;
+    }
+    for (i = 0; i < nCount; i++)
+    {
+        if (Win32HandleGet(lpHandles[i], Win32HandleEvent) == NULL) {
+            return WAIT_FAILED;
+        }
+    }
+    if (dwMilliseconds != INFINITE) {
+        clock_gettime(CLOCK_REALTIME, &Deadline);
+        Deadline.tv_sec += dwMilliseconds / 1000;
+        Deadline.tv_nsec += (long)(dwMilliseconds % 1000) * 1000000;
+        if (Deadline.tv_nsec >= 1000000000) {
+            Deadline.tv_sec++;
+            Deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&Win32Lock);
+    for (;;)
+    {
+        DWORD Signaled = 0;
+        DWORD First = nCount;
+
+        for (i = 0; i < nCount; i++)
+        {
+            if (((PWIN32_HANDLE)lpHandles[i])->u.Event.Signaled) {
+                Signaled++;
+                First = (First == nCount) ? i : First;
+            }
+        }
+        if (bWaitAll ? (Signaled == nCount) : (Signaled != 0)) {
+            for (i = bWaitAll ? 0 : First; i < (bWaitAll ? nCount : First + 1); i++)
+            {
+                PWIN32_HANDLE Handle = (PWIN32_HANDLE)lpHandles[i];
+
+                if (!Handle->u.Event.ManualReset) {
+                    Handle->u.Event.Signaled = FALSE;
+                }
+            }
+            Result = WAIT_OBJECT_0 + (bWaitAll ? 0 : First);
+            break;
+        }
+        if (dwMilliseconds == 0) {
+            break;
+        }
+        if (dwMilliseconds == INFINITE) {
+            pthread_cond_wait(&Win32Changed, &Win32Lock);
+        }
+        else if (pthread_cond_timedwait(&Win32Changed, &Win32Lock, &Deadline) == ETIMEDOUT) {
+            dwMilliseconds = 0;
+        }
+    }
+    pthread_mutex_unlock(&Win32Lock);
+    return Result;
+}
+
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+    return WaitForMultipleObjects(1, &hHandle, FALSE, dwMilliseconds);
+}
+
+//
+// Device I/O.
+//
+static VOID Win32DeviceIoComplete(PVOID Context, NTSTATUS Status, ULONG_PTR Information)
+{
+    PWIN32_IO Io = (PWIN32_IO)Context;
+
+    pthread_mutex_lock(&Win32Lock);
+    Win32IoSetResult(Io->Overlapped, Status, Information);
+    pthread_mutex_unlock(&Win32Lock);
+}
+
+BOOL DeviceIoControl(HANDLE hDevice, DWORD dwIoControlCode, PVOID lpInBuffer, DWORD nInBufferSize, PVOID lpOutBuffer,
+                     DWORD nOutBufferSize, LPDWORD lpBytesReturned, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hDevice, Win32HandleDevice);
+    PWIN32_IO Io = NULL;
+    WDFREQUEST Request = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG BytesReturned = 0;
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+
+    //
+    // The I/O manager checks the access bits of the control code against
+    // the access the handle was opened with.
+    //
+    if ((((dwIoControlCode >> 14) & FILE_READ_ACCESS) && !(Handle->u.Device.Access & GENERIC_READ)) ||
+        (((dwIoControlCode >> 14) & FILE_WRITE_ACCESS) && !(Handle->u.Device.Access & GENERIC_WRITE))) {
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    }
+    if (lpOverlapped == NULL) {
+        Status = ShimDeviceIoControl(Handle->u.Device.Device, dwIoControlCode, lpInBuffer, nInBufferSize,
+                                     lpOutBuffer, nOutBufferSize, &BytesReturned);
+        return Win32Result(Status, BytesReturned, lpBytesReturned);
+    }
+
+    Io = (PWIN32_IO)calloc(1, sizeof(WIN32_IO));
+    if (Io == NULL) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    Io->Type = Win32IoDevice;
+    Io->Handle = Handle;
+    Io->Overlapped = lpOverlapped;
+    lpOverlapped->Internal = (ULONG_PTR)STATUS_PENDING;
+    lpOverlapped->InternalHigh = 0;
+
+    Status = ShimBeginDeviceIoControl(Handle->u.Device.Device, dwIoControlCode, lpInBuffer, nInBufferSize,
+                                      lpOutBuffer, nOutBufferSize, &Request);
+    if (Request == NULL) {
+        free(Io);
+        pthread_mutex_lock(&Win32Lock);
+        Win32IoSetResult(lpOverlapped, Status, 0);
+        pthread_mutex_unlock(&Win32Lock);
+        return Win32Result(Status, 0, lpBytesReturned);
+    }
+    Io->Request = Request;
+
+    pthread_mutex_lock(&Win32Lock);
+    Io->Next = Win32Ios;
+    Win32Ios = Io;
+    pthread_mutex_unlock(&Win32Lock);
+
+    //
+    // A request the driver completed while it was sent completes here, a
+    // pending one when the driver completes it.
+    //
+    if (ShimSetCompletionRoutine(Request, Win32DeviceIoComplete, Io)) {
+        SetLastError(ERROR_IO_PENDING);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&Win32Lock);
+    Win32IoUnlink(Io);
+    pthread_mutex_unlock(&Win32Lock);
+    free(Io);
+
+    Status = ShimEndDeviceIoControl(Request, &BytesReturned);
+    pthread_mutex_lock(&Win32Lock);
+    Win32IoSetResult(lpOverlapped, Status, BytesReturned);
+    pthread_mutex_unlock(&Win32Lock);
+    return Win32Result(Status, BytesReturned, lpBytesReturned);
+}
+
+//
+// Pipes. The I/O thread polls the sockets of all pending pipe operations
+// and an eventfd that is written whenever an operation is added, and
+// retries every pending operation without blocking when one is ready.
+// Called with Win32Lock held.
+//
+static BOOLEAN Win32PipeTry(PWIN32_IO Io, int Flags, NTSTATUS* Status, ULONG* Transferred)
+{
+    PWIN32_HANDLE Handle = Io->Handle;
+    ssize_t Result = 0;
+
+    *Status = STATUS_SUCCESS;
+    *Transferred = 0;
+
+    if (Io->Type == Win32IoConnect) {
+        int Fd = accept4(Handle->u.Pipe.Name->Listener, NULL, NULL, SOCK_CLOEXEC);
+
+        if (Fd < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? FALSE : (*Status = STATUS_UNSUCCESSFUL, TRUE);
+        }
+        Handle->u.Pipe.Fd = Fd;
+        return TRUE;
+    }
+
+    if (Handle->u.Pipe.Fd < 0) {
+        *Status = STATUS_PIPE_DISCONNECTED;
+        return TRUE;
+    }
+
+    if (Io->Type == Win32IoRead) {
+        struct iovec Vector = { Io->Buffer, Io->Length };
+        struct msghdr Message;
+
+        memset(&Message, 0, sizeof(Message));
+        Message.msg_iov = &Vector;
+        Message.msg_iovlen = 1;
+        Result = recvmsg(Handle->u.Pipe.Fd, &Message, Flags);
+        if (Result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return FALSE;
+        }
+
+        //
+        // The protocols on top never send an empty message, so 0 is the
+        // other end closing its handle.
+        //
+        if (Result <= 0) {
+            *Status = STATUS_PIPE_BROKEN;
+            return TRUE;
+        }
+        *Transferred = (ULONG)Result;
+        *Status = (Message.msg_flags & MSG_TRUNC) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+        return TRUE;
+    }
+
+    Result = send(Handle->u.Pipe.Fd, Io->Buffer, Io->Length, Flags | MSG_NOSIGNAL);
+    if (Result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return FALSE;
+    }
+    if (Result < 0) {
+        *Status = (errno == EMSGSIZE) ? STATUS_INVALID_PARAMETER : STATUS_PIPE_BROKEN;
+        return TRUE;
+    }
+    *Transferred = (ULONG)Result;
+    return TRUE;
+}
+
+static void* Win32IoThread(void* Context)
+{
+    struct pollfd* Fds = NULL;
+    size_t Capacity = 0;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (;;)
+    {
+        size_t Count = 1;
+        PWIN32_IO Io = NULL;
+        PWIN32_IO* Link = NULL;
+        uint64_t Value = 0;
+
+        pthread_mutex_lock(&Win32Lock);
+        for (Io = Win32Ios; Io != NULL; Io = Io->Next)
+        {
+            Count++;
+        }
+        if (Count > Capacity) {
+            struct pollfd* Grown = (struct pollfd*)realloc(Fds, Count * 2 * sizeof(*Fds));
+
+            if (Grown != NULL) {
+                Fds = Grown;
+                Capacity = Count * 2;
+            }
+        }
+        Win32IoPolls++;
+        pthread_cond_broadcast(&Win32Changed);
+        Fds[0].fd = Win32IoWake;
+        Fds[0].events = POLLIN;
+        Count = 1;
+        for (Io = Win32Ios; Io != NULL && Count < Capacity; Io = Io->Next)
+        {
+            if (Io->Type == Win32IoDevice) {
+                continue;
+            }
+            Fds[Count].fd = (Io->Type == Win32IoConnect) ? Io->Handle->u.Pipe.Name->Listener : Io->Handle->u.Pipe.Fd;
+            Fds[Count].events = (Io->Type == Win32IoWrite) ? POLLOUT : POLLIN;
+            Count++;
+        }
+        pthread_mutex_unlock(&Win32Lock);
+
+        poll(Fds, Count, -1);
+        if (Fds[0].revents & POLLIN) {
+            ssize_t Drained = read(Win32IoWake, &Value, sizeof(Value));
+            UNREFERENCED_PARAMETER(Drained);
+        }
+
+        pthread_mutex_lock(&Win32Lock);
+        Link = &Win32Ios;
+        while (*Link != NULL) {
+            NTSTATUS Status = STATUS_SUCCESS;
+            ULONG Transferred = 0;
+
+            Io = *Link;
+            if (Io->Type == Win32IoDevice || !Win32PipeTry(Io, MSG_DONTWAIT, &Status, &Transferred)) {
+                Link = &Io->Next;
+                continue;
+            }
+            *Link = Io->Next;
+            Win32IoSetResult(Io->Overlapped, Status, Transferred);
+            free(Io);
+        }
+        pthread_mutex_unlock(&Win32Lock);
+    }
+    return NULL;
+}
+
+static VOID Win32IoThreadStart(VOID)
+{
+    pthread_t Thread;
+
+    Win32IoWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (Win32IoWake < 0 || pthread_create(&Thread, NULL, Win32IoThread, NULL) != 0) {
+        fprintf(stderr, "Win32Shim: cannot start the I/O thread\n");
+        abort();
+    }
+    pthread_detach(Thread);
+}
+
+static VOID Win32IoThreadWake(VOID)
+{
+    uint64_t Value = 1;
+    ssize_t Written = write(Win32IoWake, &Value, sizeof(Value));
+
+    UNREFERENCED_PARAMETER(Written);
+}
+
+//
+// A socket the I/O thread polls stays open until the poll returns, which
+// would keep a listener bound and hide a closed connection from the
+// other end, so closing waits until the thread polls without it. Called
+// with Win32Lock held.
+//
+static VOID Win32PipeClose(int Fd)
+{
+    ULONG64 Polls = Win32IoPolls;
+
+    close(Fd);
+    if (Win32IoWake < 0) {
+        return;
+    }
+    Win32IoThreadWake();
+    while (Win32IoPolls == Polls) {
+        pthread_cond_wait(&Win32Changed, &Win32Lock);
+    }
+}
+
+//
+// Runs a pipe operation, without an OVERLAPPED it blocks until done. An
+// overlapped operation is tried once and left to the I/O thread if it
+// cannot finish.
+//
+static BOOL Win32PipeIo(PWIN32_HANDLE Handle, WIN32_IO_TYPE Type, PVOID Buffer, ULONG Length, LPDWORD Transferred,
+                        LPOVERLAPPED Overlapped)
+{
+    WIN32_IO Attempt;
+    PWIN32_IO Io = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG Done = 0;
+
+    memset(&Attempt, 0, sizeof(Attempt));
+    Attempt.Type = Type;
+    Attempt.Handle = Handle;
+    Attempt.Buffer = Buffer;
+    Attempt.Length = Length;
+
+    if (Overlapped == NULL) {
+        if (Type == Win32IoConnect) {
+            struct pollfd Listener = { Handle->u.Pipe.Name->Listener, POLLIN, 0 };
+
+            while (!Win32PipeTry(&Attempt, 0, &Status, &Done)) {
+                poll(&Listener, 1, -1);
+            }
+        }
+        else {
+            while (!Win32PipeTry(&Attempt, 0, &Status, &Done)) {
+                sched_yield();
+            }
+        }
+        return Win32Result(Status, Done, Transferred);
+    }
+
+    pthread_once(&Win32IoThreadOnce, Win32IoThreadStart);
+    pthread_mutex_lock(&Win32Lock);
+    if (Win32PipeTry(&Attempt, MSG_DONTWAIT, &Status, &Done)) {
+        Win32IoSetResult(Overlapped, Status, Done);
+        pthread_mutex_unlock(&Win32Lock);
+        return Win32Result(Status, Done, Transferred);
+    }
+
+    Io = (PWIN32_IO)malloc(sizeof(WIN32_IO));
+    if (Io == NULL) {
+        pthread_mutex_unlock(&Win32Lock);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    *Io = Attempt;
+    Io->Overlapped = Overlapped;
+    Overlapped->Internal = (ULONG_PTR)STATUS_PENDING;
+    Overlapped->InternalHigh = 0;
+    Io->Next = Win32Ios;
+    Win32Ios = Io;
+    pthread_mutex_unlock(&Win32Lock);
+
+    Win32IoThreadWake();
+    SetLastError(ERROR_IO_PENDING);
+    return FALSE;
+}
+
+static int Win32PipeAddress(PCSTR Name, struct sockaddr_un* Address, socklen_t* Length)
+{
+    size_t NameLength = strlen(Name);
+
+    memset(Address, 0, sizeof(*Address));
+    Address->sun_family = AF_UNIX;
+    if (NameLength == 0 || NameLength >= sizeof(Address->sun_path) - 1) {
+        return -1;
+    }
+
+    //
+    // A leading zero puts the socket in the abstract namespace, it goes
+    // away with its last descriptor.
+    //
+    memcpy(Address->sun_path + 1, Name, NameLength);
+    *Length = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + NameLength);
+    return 0;
+}
+
+HANDLE CreateNamedPipeA(PCSTR lpName, DWORD dwOpenMode, DWORD dwPipeMode, DWORD nMaxInstances, DWORD nOutBufferSize,
+                        DWORD nInBufferSize, DWORD nDefaultTimeOut, PVOID lpSecurityAttributes)
+{
+    PWIN32_PIPE_NAME Name = NULL;
+    PWIN32_HANDLE Handle = NULL;
+    struct sockaddr_un Address;
+    socklen_t AddressLength = 0;
+    PCSTR PipeName = lpName + strlen(WIN32_PIPE_PREFIX);
+
+    UNREFERENCED_PARAMETER(dwPipeMode);
+    UNREFERENCED_PARAMETER(nOutBufferSize);
+    UNREFERENCED_PARAMETER(nInBufferSize);
+    UNREFERENCED_PARAMETER(nDefaultTimeOut);
+    UNREFERENCED_PARAMETER(lpSecurityAttributes);
+
+    if (lpName == NULL || strncmp(lpName, WIN32_PIPE_PREFIX, strlen(WIN32_PIPE_PREFIX)) != 0 ||
+        Win32PipeAddress(PipeName, &Address, &AddressLength) != 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+    Handle = Win32HandleCreate(Win32HandlePipe);
+    if (Handle == NULL) {
+        return INVALID_HANDLE_VALUE;
+    }
+    Handle->u.Pipe.Fd = -1;
+
+    pthread_mutex_lock(&Win32Lock);
+    for (Name = Win32PipeNames; Name != NULL && strcmp(Name->Name, PipeName) != 0; Name = Name->Next);
+    if (Name != NULL && ((dwOpenMode & FILE_FLAG_FIRST_PIPE_INSTANCE) || (nMaxInstances != 255 && Name->Instances >= nMaxInstances))) {
+        pthread_mutex_unlock(&Win32Lock);
+        free(Handle);
+        SetLastError((dwOpenMode & FILE_FLAG_FIRST_PIPE_INSTANCE) ? ERROR_ACCESS_DENIED : ERROR_PIPE_BUSY);
+        return INVALID_HANDLE_VALUE;
+    }
+    if (Name == NULL) {
+        Name = (PWIN32_PIPE_NAME)calloc(1, sizeof(WIN32_PIPE_NAME));
+        if (Name == NULL) {
+            pthread_mutex_unlock(&Win32Lock);
+            free(Handle);
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return INVALID_HANDLE_VALUE;
+        }
+        strcpy(Name->Name, PipeName);
+        Name->Listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (Name->Listener < 0 || bind(Name->Listener, (struct sockaddr*)&Address, AddressLength) != 0 ||
+            listen(Name->Listener, SOMAXCONN) != 0) {
+            DWORD Error = Win32ErrorFromErrno(errno);
+
+            if (Name->Listener >= 0) {
+                close(Name->Listener);
+            }
+            pthread_mutex_unlock(&Win32Lock);
+            free(Name);
+            free(Handle);
+            SetLastError(Error);
+            return INVALID_HANDLE_VALUE;
+        }
+        Name->Next = Win32PipeNames;
+        Win32PipeNames = Name;
+    }
+    Name->Instances++;
+    Handle->u.Pipe.Name = Name;
+    pthread_mutex_unlock(&Win32Lock);
+    return Handle;
+}
+
+//
+// A client that connected before the call is taken at once, which Windows
+// reports as ERROR_PIPE_CONNECTED.
+//
+BOOL ConnectNamedPipe(HANDLE hNamedPipe, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hNamedPipe, Win32HandlePipe);
+    BOOL Connected = FALSE;
+
+    if (Handle == NULL || Handle->u.Pipe.Name == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    if (Handle->u.Pipe.Fd >= 0) {
+        SetLastError(ERROR_PIPE_CONNECTED);
+        return FALSE;
+    }
+    Connected = Win32PipeIo(Handle, Win32IoConnect, NULL, 0, NULL, lpOverlapped);
+    if (Connected && lpOverlapped != NULL) {
+        SetLastError(ERROR_PIPE_CONNECTED);
+        return FALSE;
+    }
+    return Connected;
+}
+
+static VOID Win32IoCancel(PWIN32_HANDLE Handle, LPOVERLAPPED Overlapped, BOOLEAN* Found);
+
+BOOL DisconnectNamedPipe(HANDLE hNamedPipe)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hNamedPipe, Win32HandlePipe);
+    BOOLEAN Found = FALSE;
+
+    if (Handle == NULL || Handle->u.Pipe.Name == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    Win32IoCancel(Handle, NULL, &Found);
+    pthread_mutex_lock(&Win32Lock);
+    if (Handle->u.Pipe.Fd >= 0) {
+        Win32PipeClose(Handle->u.Pipe.Fd);
+        Handle->u.Pipe.Fd = -1;
+    }
+    pthread_mutex_unlock(&Win32Lock);
+    return TRUE;
+}
+
+//
+// Listening sockets take clients into their backlog before an instance
+// waits for them, so a server that exists is always available.
+//
+BOOL WaitNamedPipeA(PCSTR lpNamedPipeName, DWORD nTimeOut)
+{
+    UNREFERENCED_PARAMETER(lpNamedPipeName);
+    UNREFERENCED_PARAMETER(nTimeOut);
+
+    return TRUE;
+}
+
+BOOL SetNamedPipeHandleState(HANDLE hNamedPipe, LPDWORD lpMode, LPDWORD lpMaxCollectionCount, LPDWORD lpCollectDataTimeout)
+{
+    UNREFERENCED_PARAMETER(lpMode);
+    UNREFERENCED_PARAMETER(lpMaxCollectionCount);
+    UNREFERENCED_PARAMETER(lpCollectDataTimeout);
+
+    return Win32HandleGet(hNamedPipe, Win32HandlePipe) != NULL;
+}
+
+//
+// Only the blocking form is served.
+//
+BOOL TransactNamedPipe(HANDLE hNamedPipe, PVOID lpInBuffer, DWORD nInBufferSize, PVOID lpOutBuffer, DWORD nOutBufferSize,
+                       LPDWORD lpBytesRead, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hNamedPipe, Win32HandlePipe);
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    if (lpOverlapped != NULL) {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return FALSE;
+    }
+    if (!Win32PipeIo(Handle, Win32IoWrite, lpInBuffer, nInBufferSize, NULL, NULL)) {
+        return FALSE;
+    }
+    return Win32PipeIo(Handle, Win32IoRead, lpOutBuffer, nOutBufferSize, lpBytesRead, NULL);
+}
+
+//
+// Files, devices and pipe clients.
+//
+HANDLE CreateFileA(PCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, PVOID lpSecurityAttributes,
+                   DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+{
+    PWIN32_HANDLE Handle = NULL;
+    int Flags = O_CLOEXEC;
+
+    UNREFERENCED_PARAMETER(dwShareMode);
+    UNREFERENCED_PARAMETER(lpSecurityAttributes);
+    UNREFERENCED_PARAMETER(dwFlagsAndAttributes);
+    UNREFERENCED_PARAMETER(hTemplateFile);
+
+    if (lpFileName == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    if (strncmp(lpFileName, WIN32_PIPE_PREFIX, strlen(WIN32_PIPE_PREFIX)) == 0) {
+        struct sockaddr_un Address;
+        socklen_t AddressLength = 0;
+
+        if (Win32PipeAddress(lpFileName + strlen(WIN32_PIPE_PREFIX), &Address, &AddressLength) != 0) {
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return INVALID_HANDLE_VALUE;
+        }
+        Handle = Win32HandleCreate(Win32HandlePipe);
+        if (Handle == NULL) {
+            return INVALID_HANDLE_VALUE;
+        }
+        Handle->u.Pipe.Fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (Handle->u.Pipe.Fd < 0 || connect(Handle->u.Pipe.Fd, (struct sockaddr*)&Address, AddressLength) != 0) {
+            DWORD Error = Win32ErrorFromErrno(errno);
+
+            if (Handle->u.Pipe.Fd >= 0) {
+                close(Handle->u.Pipe.Fd);
+            }
+            free(Handle);
+            SetLastError(Error);
+            return INVALID_HANDLE_VALUE;
+        }
+        return Handle;
+    }
+
+    if (strncmp(lpFileName, WIN32_DEVICE_PREFIX, strlen(WIN32_DEVICE_PREFIX)) == 0) {
+        WDFDEVICE Device = NULL;
+        NTSTATUS Status = ShimOpenDevice(lpFileName + strlen(WIN32_DEVICE_PREFIX), &Device);
+
+        if (!NT_SUCCESS(Status)) {
+            SetLastError((Status == STATUS_DEVICE_BUSY) ? ERROR_ACCESS_DENIED : ERROR_FILE_NOT_FOUND);
+            return INVALID_HANDLE_VALUE;
+        }
+        Handle = Win32HandleCreate(Win32HandleDevice);
+        if (Handle == NULL) {
+            ShimCloseDevice(Device);
+            return INVALID_HANDLE_VALUE;
+        }
+        Handle->u.Device.Device = Device;
+        Handle->u.Device.Access = dwDesiredAccess;
+        return Handle;
+    }
+
+    switch (dwDesiredAccess & (GENERIC_READ | GENERIC_WRITE))
+    {
+    case GENERIC_READ | GENERIC_WRITE:
+        Flags |= O_RDWR;
+        break;
+    case GENERIC_WRITE:
+        Flags |= O_WRONLY;
+        break;
+    default:
+        Flags |= O_RDONLY;
+        break;
+    }
+    switch (dwCreationDisposition)
+    {
+    case CREATE_NEW:
+        Flags |= O_CREAT | O_EXCL;
+        break;
+    case CREATE_ALWAYS:
+        Flags |= O_CREAT | O_TRUNC;
+        break;
+    case OPEN_ALWAYS:
+        Flags |= O_CREAT;
+        break;
+    case TRUNCATE_EXISTING:
+        Flags |= O_TRUNC;
+        break;
+    default:
+        break;
+    }
+    Handle = Win32HandleCreate(Win32HandleFile);
+    if (Handle == NULL) {
+        return INVALID_HANDLE_VALUE;
+    }
+    Handle->u.File.Fd = open(lpFileName, Flags, 0644);
+    if (Handle->u.File.Fd < 0) {
+        DWORD Error = Win32ErrorFromErrno(errno);
+
+        free(Handle);
+        SetLastError(Error);
+        return INVALID_HANDLE_VALUE;
+    }
+    return Handle;
+}
+
+//
+// File I/O completes before the call returns, an OVERLAPPED only gives
+// the file position.
+//
+static BOOL Win32FileIo(PWIN32_HANDLE Handle, BOOLEAN Write, PVOID Buffer, DWORD Length, LPDWORD Transferred,
+                        LPOVERLAPPED Overlapped)
+{
+    ssize_t Result = 0;
+    size_t Done = 0;
+    off_t Position = 0;
+
+    while (Done < Length) {
+        if (Overlapped != NULL) {
+            Position = (off_t)(((ULONG64)Overlapped->OffsetHigh << 32) | Overlapped->Offset) + (off_t)Done;
+            Result = Write ? pwrite(Handle->u.File.Fd, (PUCHAR)Buffer + Done, Length - Done, Position) :
+                             pread(Handle->u.File.Fd, (PUCHAR)Buffer + Done, Length - Done, Position);
+        }
+        else {
+            Result = Write ? write(Handle->u.File.Fd, (PUCHAR)Buffer + Done, Length - Done) :
+                             read(Handle->u.File.Fd, (PUCHAR)Buffer + Done, Length - Done);
+        }
+        if (Result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (Result <= 0) {
+            break;
+        }
+        Done += (size_t)Result;
+    }
+
+    if (Transferred != NULL) {
+        *Transferred = (DWORD)Done;
+    }
+    if (Overlapped != NULL) {
+        pthread_mutex_lock(&Win32Lock);
+        Win32IoSetResult(Overlapped, (Result < 0) ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS, Done);
+        pthread_mutex_unlock(&Win32Lock);
+    }
+    if (Result < 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL ReadFile(HANDLE hFile, PVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hFile;
+
+    if (Handle != NULL && hFile != INVALID_HANDLE_VALUE && Handle->Type == Win32HandlePipe) {
+        return Win32PipeIo(Handle, Win32IoRead, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+    }
+    Handle = Win32HandleGet(hFile, Win32HandleFile);
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    return Win32FileIo(Handle, FALSE, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+}
+
+BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hFile;
+
+    if (Handle != NULL && hFile != INVALID_HANDLE_VALUE && Handle->Type == Win32HandlePipe) {
+        return Win32PipeIo(Handle, Win32IoWrite, (PVOID)lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
+    }
+    Handle = Win32HandleGet(hFile, Win32HandleFile);
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    return Win32FileIo(Handle, TRUE, (PVOID)lpBuffer, nNumberOfBytesToWrite, lpNumberOfBytesWritten, lpOverlapped);
+}
+
+BOOL FlushFileBuffers(HANDLE hFile)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hFile;
+
+    if (Handle != NULL && hFile != INVALID_HANDLE_VALUE && Handle->Type == Win32HandlePipe) {
+        return TRUE;
+    }
+    Handle = Win32HandleGet(hFile, Win32HandleFile);
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    if (fsync(Handle->u.File.Fd) != 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hFile, Win32HandleFile);
+    struct stat Status;
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    if (fstat(Handle->u.File.Fd, &Status) != 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    lpFileSize->QuadPart = (LONGLONG)Status.st_size;
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hFile, Win32HandleFile);
+    off_t Position = 0;
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    Position = lseek(Handle->u.File.Fd, (off_t)liDistanceToMove.QuadPart,
+                     (dwMoveMethod == FILE_END) ? SEEK_END : (dwMoveMethod == FILE_CURRENT) ? SEEK_CUR : SEEK_SET);
+    if (Position < 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    if (lpNewFilePointer != NULL) {
+        lpNewFilePointer->QuadPart = (LONGLONG)Position;
+    }
+    return TRUE;
+}
+
+//
+// Cuts or extends the file at the file pointer.
+//
+BOOL SetEndOfFile(HANDLE hFile)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hFile, Win32HandleFile);
+    off_t Position = 0;
+
+    if (Handle == NULL) {
+        return FALSE;
+    }
+    Position = lseek(Handle->u.File.Fd, 0, SEEK_CUR);
+    if (Position < 0 || ftruncate(Handle->u.File.Fd, Position) != 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+// Overlapped results and cancellation.
+//
+static PWIN32_IO Win32IoFind(PWIN32_HANDLE Handle, LPOVERLAPPED Overlapped)
+{
+    PWIN32_IO Io = NULL;
+
+    for (Io = Win32Ios; Io != NULL; Io = Io->Next)
+    {
+        if (Io->Handle == Handle && (Overlapped == NULL || Io->Overlapped == Overlapped)) {
+            break;
+        }
+    }
+    return Io;
+}
+
+//
+// Pipe operations are finished as canceled at once. Device requests are
+// canceled through the shim without Win32Lock, their completion routine
+// takes it, and Canceling keeps GetOverlappedResult from ending them in
+// the meantime.
+//
+static VOID Win32IoCancel(PWIN32_HANDLE Handle, LPOVERLAPPED Overlapped, BOOLEAN* Found)
+{
+    PWIN32_IO Io = NULL;
+    PWIN32_IO* Link = NULL;
+
+    *Found = FALSE;
+    pthread_mutex_lock(&Win32Lock);
+    Link = &Win32Ios;
+    while (*Link != NULL) {
+        Io = *Link;
+        if (Io->Handle != Handle || (Overlapped != NULL && Io->Overlapped != Overlapped)) {
+            Link = &Io->Next;
+            continue;
+        }
+        *Found = TRUE;
+        if (Io->Type != Win32IoDevice) {
+            *Link = Io->Next;
+            Win32IoSetResult(Io->Overlapped, STATUS_CANCELLED, 0);
+            free(Io);
+            continue;
+        }
+        if (!Io->CancelRequested && Io->Overlapped->Internal == (ULONG_PTR)STATUS_PENDING) {
+            Io->CancelRequested = TRUE;
+            Io->Canceling = TRUE;
+            pthread_mutex_unlock(&Win32Lock);
+            ShimCancelIo(Io->Request);
+            pthread_mutex_lock(&Win32Lock);
+            Io->Canceling = FALSE;
+            pthread_cond_broadcast(&Win32Changed);
+            Link = &Win32Ios;
+            continue;
+        }
+        Link = &Io->Next;
+    }
+    pthread_mutex_unlock(&Win32Lock);
+}
+
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED lpOverlapped)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hFile;
+    BOOLEAN Found = FALSE;
+
+    if (Handle == NULL || hFile == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    Win32IoCancel(Handle, lpOverlapped, &Found);
+    if (!Found) {
+        SetLastError(ERROR_NOT_FOUND);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED lpOverlapped, LPDWORD lpNumberOfBytesTransferred, BOOL bWait)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hFile;
+    PWIN32_IO Io = NULL;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG_PTR Information = 0;
+    ULONG BytesReturned = 0;
+
+    if (Handle == NULL || hFile == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&Win32Lock);
+    while (lpOverlapped->Internal == (ULONG_PTR)STATUS_PENDING) {
+        if (!bWait) {
+            pthread_mutex_unlock(&Win32Lock);
+            SetLastError(ERROR_IO_INCOMPLETE);
+            return FALSE;
+        }
+        pthread_cond_wait(&Win32Changed, &Win32Lock);
+    }
+    Status = (NTSTATUS)(ULONG)lpOverlapped->Internal;
+    Information = lpOverlapped->InternalHigh;
+
+    Io = Win32IoFind(Handle, lpOverlapped);
+    while (Io != NULL && Io->Canceling) {
+        pthread_cond_wait(&Win32Changed, &Win32Lock);
+        Io = Win32IoFind(Handle, lpOverlapped);
+    }
+    if (Io != NULL) {
+        Win32IoUnlink(Io);
+    }
+    pthread_mutex_unlock(&Win32Lock);
+
+    if (Io != NULL) {
+        ShimEndDeviceIoControl(Io->Request, &BytesReturned);
+        free(Io);
+    }
+    return Win32Result(Status, Information, lpNumberOfBytesTransferred);
+}
+
+//
+// Closing a device handle cancels and ends its requests still in flight,
+// as the cleanup of the file object does.
+//
+BOOL CloseHandle(HANDLE hObject)
+{
+    PWIN32_HANDLE Handle = (PWIN32_HANDLE)hObject;
+    PWIN32_IO Io = NULL;
+    BOOLEAN Found = FALSE;
+    ULONG BytesReturned = 0;
+
+    if (Handle == NULL || hObject == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    switch (Handle->Type)
+    {
+    case Win32HandleDevice:
+        Win32IoCancel(Handle, NULL, &Found);
+        for (;;)
+        {
+            pthread_mutex_lock(&Win32Lock);
+            Io = Win32IoFind(Handle, NULL);
+            while (Io != NULL && Io->Canceling) {
+                pthread_cond_wait(&Win32Changed, &Win32Lock);
+                Io = Win32IoFind(Handle, NULL);
+            }
+            if (Io != NULL) {
+                Win32IoUnlink(Io);
+            }
+            pthread_mutex_unlock(&Win32Lock);
+            if (Io == NULL) {
+                break;
+            }
+            ShimEndDeviceIoControl(Io->Request, &BytesReturned);
+            free(Io);
+        }
+        ShimCloseDevice(Handle->u.Device.Device);
+        break;
+
+    case Win32HandleFile:
+        close(Handle->u.File.Fd);
+        break;
+
+    case Win32HandleMapping:
+        close(Handle->u.Mapping.Fd);
+        break;
+
+    case Win32HandlePipe:
+        Win32IoCancel(Handle, NULL, &Found);
+        pthread_mutex_lock(&Win32Lock);
+        if (Handle->u.Pipe.Fd >= 0) {
+            Win32PipeClose(Handle->u.Pipe.Fd);
+        }
+        if (Handle->u.Pipe.Name != NULL && --Handle->u.Pipe.Name->Instances == 0) {
+            PWIN32_PIPE_NAME* Link = &Win32PipeNames;
+
+            while (*Link != Handle->u.Pipe.Name) {
+                Link = &(*Link)->Next;
+            }
+            *Link = Handle->u.Pipe.Name->Next;
+            Win32PipeClose(Handle->u.Pipe.Name->Listener);
+            free(Handle->u.Pipe.Name);
+        }
+        pthread_mutex_unlock(&Win32Lock);
+        break;
+
+    default:
+        break;
+    }
+
+    free(Handle);
+    return TRUE;
+}
+
+//
+// File mappings. A view is mapped behind a page holding its length, as
+// VirtualAlloc does, so UnmapViewOfFile can release it.
+//
+HANDLE CreateFileMappingA(HANDLE hFile, PVOID lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh,
+                          DWORD dwMaximumSizeLow, PCSTR lpName)
+{
+    PWIN32_HANDLE File = Win32HandleGet(hFile, Win32HandleFile);
+    PWIN32_HANDLE Handle = NULL;
+    ULONG64 Size = ((ULONG64)dwMaximumSizeHigh << 32) | dwMaximumSizeLow;
+    struct stat Status;
+
+    UNREFERENCED_PARAMETER(lpFileMappingAttributes);
+
+    if (File == NULL) {
+        return NULL;
+    }
+    if (flProtect != PAGE_READONLY || lpName != NULL) {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+    if (fstat(File->u.File.Fd, &Status) != 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return NULL;
+    }
+    if (Size == 0) {
+        Size = (ULONG64)Status.st_size;
+    }
+    if (Size == 0 || Size > (ULONG64)Status.st_size) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    Handle = Win32HandleCreate(Win32HandleMapping);
+    if (Handle == NULL) {
+        return NULL;
+    }
+    Handle->u.Mapping.Fd = fcntl(File->u.File.Fd, F_DUPFD_CLOEXEC, 0);
+    if (Handle->u.Mapping.Fd < 0) {
+        DWORD Error = Win32ErrorFromErrno(errno);
+
+        free(Handle);
+        SetLastError(Error);
+        return NULL;
+    }
+    Handle->u.Mapping.Size = Size;
+    return Handle;
+}
+
+PVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow,
+                    SIZE_T dwNumberOfBytesToMap)
+{
+    PWIN32_HANDLE Handle = Win32HandleGet(hFileMappingObject, Win32HandleMapping);
+    size_t Page = (size_t)sysconf(_SC_PAGESIZE);
+    ULONG64 Offset = ((ULONG64)dwFileOffsetHigh << 32) | dwFileOffsetLow;
+    size_t Length = 0;
+    PUCHAR Region = NULL;
+
+    if (Handle == NULL) {
+        return NULL;
+    }
+    if (dwDesiredAccess != FILE_MAP_READ || Offset % Page != 0 || Offset >= Handle->u.Mapping.Size ||
+        dwNumberOfBytesToMap > Handle->u.Mapping.Size - Offset) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    Length = (dwNumberOfBytesToMap != 0) ? dwNumberOfBytesToMap : (size_t)(Handle->u.Mapping.Size - Offset);
+    Region = (PUCHAR)mmap(NULL, Page + Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Region == MAP_FAILED) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    if (mmap(Region + Page, Length, PROT_READ, MAP_SHARED | MAP_FIXED, Handle->u.Mapping.Fd, (off_t)Offset) == MAP_FAILED) {
+        DWORD Error = Win32ErrorFromErrno(errno);
+
+        munmap(Region, Page + Length);
+        SetLastError(Error);
+        return NULL;
+    }
+    *(size_t*)Region = Page + Length;
+    return Region + Page;
+}
+
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress)
+{
+    PUCHAR Region = (PUCHAR)lpBaseAddress - sysconf(_SC_PAGESIZE);
+
+    if (lpBaseAddress == NULL) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    munmap(Region, *(size_t*)Region);
+    return TRUE;
+}
+
+//
+// Memory, time and threads. VirtualAlloc keeps the size of a region in a
+// page in front of it.
+//
+PVOID VirtualAlloc(PVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect)
+{
+    size_t Page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t Length = 0;
+    PUCHAR Region = NULL;
+
+    UNREFERENCED_PARAMETER(flAllocationType);
+    UNREFERENCED_PARAMETER(flProtect);
+
+    if (lpAddress != NULL || dwSize == 0) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    Length = Page + ((dwSize + Page - 1) & ~(Page - 1));
+    Region = (PUCHAR)mmap(NULL, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Region == MAP_FAILED) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    *(size_t*)Region = Length;
+    return Region + Page;
+}
+
+BOOL VirtualFree(PVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType)
+{
+    PUCHAR Region = (PUCHAR)lpAddress - sysconf(_SC_PAGESIZE);
+
+    if (lpAddress == NULL || dwSize != 0 || dwFreeType != MEM_RELEASE) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    munmap(Region, *(size_t*)Region);
+    return TRUE;
+}
+
+BOOL QueryPerformanceCounter(PLARGE_INTEGER lpPerformanceCount)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    lpPerformanceCount->QuadPart = (LONGLONG)Now.tv_sec * WIN32_COUNTER_FREQUENCY + Now.tv_nsec / (1000000000 / WIN32_COUNTER_FREQUENCY);
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(PLARGE_INTEGER lpFrequency)
+{
+    lpFrequency->QuadPart = WIN32_COUNTER_FREQUENCY;
+    return TRUE;
+}
+
+ULONGLONG GetTickCount64(VOID)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (ULONGLONG)Now.tv_sec * 1000 + (ULONGLONG)Now.tv_nsec / 1000000;
+}
+
+VOID Sleep(DWORD dwMilliseconds)
+{
+    struct timespec Interval = { (time_t)(dwMilliseconds / 1000), (long)(dwMilliseconds % 1000) * 1000000 };
+
+    while (nanosleep(&Interval, &Interval) != 0 && errno == EINTR);
+}
+
+BOOL SwitchToThread(VOID)
+{
+    sched_yield();
+    return TRUE;
+}
+
+BOOL GetComputerNameA(PCHAR lpBuffer, LPDWORD nSize)
+{
+    char HostName[256] = { 0 };
+    size_t Length = 0;
+
+    if (gethostname(HostName, sizeof(HostName) - 1) != 0) {
+        SetLastError(Win32ErrorFromErrno(errno));
+        return FALSE;
+    }
+    Length = strlen(HostName);
+    if (Length + 1 > *nSize) {
+        *nSize = (DWORD)(Length + 1);
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+    memcpy(lpBuffer, HostName, Length + 1);
+    *nSize = (DWORD)Length;
+    return TRUE;
+}
+
+//
+// Test side.
+//
+LONG Win32ShimLoadDriver(VOID)
+{
+    return ShimDriverLoad(DriverEntry, &Win32LoadedDevice);
+}
+
+VOID Win32ShimUnloadDriver(VOID)
+{
+    ShimDriverUnload();
+    Win32LoadedDevice = NULL;
+}
@@ -0,0 +1,47 @@
+/*++
+
+Module Name:
+
+    Win32Shim.h
+
+Abstract:
+
+    Test side of the Win32 routines in Win32Shim.c, for user mode code built
+    against win32/Windows.h. Loading the driver linked into the program
+    makes its control device available to CreateFile as \\.\Name.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <Windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Returns the NTSTATUS of DriverEntry.
+//
+LONG Win32ShimLoadDriver(VOID);
+VOID Win32ShimUnloadDriver(VOID);
+
+//
+// Statistics of WdfShim.h, whose kernel types do not mix with these.
+//
+typedef struct _SHIM_STATISTICS {
+    ULONG64 Requests;
+    ULONG64 BytesCopiedIn;
+    ULONG64 BytesCopiedOut;
+} SHIM_STATISTICS, *PSHIM_STATISTICS;
+
+VOID ShimGetStatistics(PSHIM_STATISTICS Statistics);
+VOID ShimResetStatistics(VOID);
+
+#ifdef __cplusplus
+}
+#endif
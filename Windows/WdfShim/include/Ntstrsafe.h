@@ -0,0 +1,49 @@
+/*++
+
+Module Name:
+
+    Ntstrsafe.h
+
+Abstract:
+
+    User mode stand-in for the counted string routines used by the drivers.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "ntddk.h"
+
+static inline NTSTATUS RtlStringCchPrintfA(PCHAR Destination, SIZE_T Count, PCSTR Format, ...)
+{
+    va_list Args;
+    int Length;
+
+    if (Count == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    va_start(Args, Format);
+    Length = vsnprintf(Destination, Count, Format, Args);
+    va_end(Args);
+
+    return (Length < 0 || (SIZE_T)Length >= Count) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+}
+
+static inline NTSTATUS RtlStringCchLengthA(PCSTR String, SIZE_T MaxCount, PSIZE_T Length)
+{
+    SIZE_T Count = strnlen(String, MaxCount);
+
+    if (Count == MaxCount) {
+        *Length = 0;
+        return STATUS_INVALID_PARAMETER;
+    }
+    *Length = Count;
+    return STATUS_SUCCESS;
+}
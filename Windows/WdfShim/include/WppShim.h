@@ -0,0 +1,50 @@
+/*++
+
+Module Name:
+
+    WppShim.h
+
+Abstract:
+
+    Stand-in for the WPP tracing a driver gets from its generated .tmh
+    file. The .tmh files of the shim are empty, trace calls at or below
+    ShimTraceLevel print the function and the raw format string to stderr.
+    WPP format specifiers are not printf ones, so the arguments are never
+    formatted. The default level is TRACE_LEVEL_NONE.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include "ntddk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_LEVEL_NONE            0
+#define TRACE_LEVEL_CRITICAL        1
+#define TRACE_LEVEL_FATAL           1
+#define TRACE_LEVEL_ERROR           2
+#define TRACE_LEVEL_WARNING         3
+#define TRACE_LEVEL_INFORMATION     4
+#define TRACE_LEVEL_VERBOSE         5
+
+extern ULONG ShimTraceLevel;
+VOID ShimTrace(ULONG Level, PCSTR Function, PCSTR Message, ...);
+
+//
+// Flags are WPP control bit names, not C identifiers, so they are dropped.
+//
+#define TraceEvents(Level, Flags, ...)      ShimTrace((Level), __func__, __VA_ARGS__)
+#define Trace(Level, ...)                   ShimTrace((Level), __func__, __VA_ARGS__)
+#define WPP_INIT_TRACING(DriverObject, RegistryPath)    ((void)(DriverObject), (void)(RegistryPath))
+#define WPP_CLEANUP(DriverObject)                       ((void)(DriverObject))
+
+#ifdef __cplusplus
+}
+#endif
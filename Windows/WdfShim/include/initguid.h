@@ -0,0 +1,5 @@
+#pragma once
+
+//
+// GUIDs are not used by the shim build.
+//
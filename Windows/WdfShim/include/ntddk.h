@@ -0,0 +1,317 @@
+/*++
+
+Module Name:
+
+    ntddk.h
+
+Abstract:
+
+    User mode stand-in for the kernel types, status codes and run time
+    routines used by the drivers in this repository, so that their request
+    path can be compiled and run on Linux against the WDF shim. The HAL,
+    memory manager and register access routines are served by the
+    simulated PCI fabric in HalShim.c.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <assert.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IN
+#define OUT
+#define VOID void
+#define CONST const
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_opt_
+#define _Out_opt_
+#define _In_reads_(x)
+#define _In_reads_bytes_(x)
+#define _In_reads_bytes_opt_(x)
+#define _Out_writes_(x)
+#define _Out_writes_bytes_(x)
+#define _Out_writes_bytes_opt_(x)
+#define _Use_decl_annotations_
+#define __analysis_assume(x)
+
+typedef uint8_t UINT8, *PUINT8, UCHAR, *PUCHAR, BYTE, BOOLEAN, *PBOOLEAN;
+typedef uint16_t UINT16, *PUINT16, USHORT, *PUSHORT;
+typedef uint32_t UINT32, *PUINT32, ULONG, *PULONG, DWORD;
+typedef int32_t INT32, LONG, *PLONG, NTSTATUS;
+typedef uint64_t UINT64, *PUINT64, ULONG64, *PULONG64, ULONGLONG;
+typedef int64_t INT64, LONGLONG;
+typedef size_t SIZE_T, *PSIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef char CHAR, *PCHAR;
+typedef const char* PCSTR;
+typedef wchar_t WCHAR, *PWCHAR, *PWSTR;
+typedef const wchar_t* PCWSTR;
+typedef void* PVOID;
+typedef void* HANDLE;
+
+#define TRUE    1
+#define FALSE   0
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER, PHYSICAL_ADDRESS, *PLARGE_INTEGER, *PPHYSICAL_ADDRESS;
+
+typedef struct _UNICODE_STRING {
+    USHORT Length;
+    USHORT MaximumLength;
+    PCWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING* PCUNICODE_STRING;
+
+#define DECLARE_CONST_UNICODE_STRING(_var, _string) \
+    const UNICODE_STRING _var = { sizeof(_string) - sizeof(WCHAR), sizeof(_string), _string }
+
+//
+// The shim has no WDM objects, a driver object only carries its name.
+//
+typedef struct _DRIVER_OBJECT {
+    PCSTR DriverName;
+} DRIVER_OBJECT, *PDRIVER_OBJECT;
+
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+typedef DRIVER_INITIALIZE* PDRIVER_INITIALIZE;
+
+#define NT_SUCCESS(Status)                  (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS                      ((NTSTATUS)0x00000000L)
+#define STATUS_PENDING                      ((NTSTATUS)0x00000103L)
+#define STATUS_BUFFER_OVERFLOW              ((NTSTATUS)0x80000005L)
+#define STATUS_UNSUCCESSFUL                 ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED              ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER            ((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST       ((NTSTATUS)0xC0000010L)
+#define STATUS_ACCESS_VIOLATION             ((NTSTATUS)0xC0000005L)
+#define STATUS_ACCESS_DENIED                ((NTSTATUS)0xC0000022L)
+#define STATUS_NO_MEMORY                    ((NTSTATUS)0xC0000017L)
+#define STATUS_BUFFER_TOO_SMALL             ((NTSTATUS)0xC0000023L)
+#define STATUS_INSUFFICIENT_RESOURCES       ((NTSTATUS)0xC000009AL)
+#define STATUS_CANCELLED                    ((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_BUFFER_SIZE          ((NTSTATUS)0xC0000206L)
+#define STATUS_NOT_FOUND                    ((NTSTATUS)0xC0000225L)
+#define STATUS_POWER_STATE_INVALID          ((NTSTATUS)0xC00002D3L)
+#define STATUS_DEVICE_BUSY                  ((NTSTATUS)0x80000011L)
+#define STATUS_TIMEOUT                      ((NTSTATUS)0x00000102L)
+#define STATUS_OBJECT_NAME_EXISTS           ((NTSTATUS)0x40000000L)
+
+#define METHOD_BUFFERED                     0
+#define METHOD_IN_DIRECT                    1
+#define METHOD_OUT_DIRECT                   2
+#define METHOD_NEITHER                      3
+#define FILE_ANY_ACCESS                     0
+#define FILE_READ_ACCESS                    1
+#define FILE_WRITE_ACCESS                   2
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+    ((ULONG)(((ULONG)(DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method)))
+#define METHOD_FROM_CTL_CODE(ctrlCode)      ((ULONG)((ctrlCode) & 3))
+
+#define UNREFERENCED_PARAMETER(P)           ((void)(P))
+#define PAGED_CODE()
+#define ASSERT(e)                           assert(e)
+
+#define RtlCopyMemory(Destination, Source, Length)  memcpy((Destination), (Source), (Length))
+#define RtlMoveMemory(Destination, Source, Length)  memmove((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length)          memset((Destination), 0, (Length))
+#define RtlSecureZeroMemory(Destination, Length)    memset((Destination), 0, (Length))
+
+#define EXTERN_C_START
+#define EXTERN_C_END
+
+//
+// Pool.
+//
+typedef enum _POOL_TYPE {
+    NonPagedPool,
+    PagedPool,
+    NonPagedPoolNx = 512,
+} POOL_TYPE;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+
+//
+// Delays.
+//
+typedef enum _MODE {
+    KernelMode,
+    UserMode,
+} KPROCESSOR_MODE;
+
+VOID KeStallExecutionProcessor(ULONG MicroSeconds);
+NTSTATUS KeDelayExecutionThread(KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Interval);
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency);
+VOID YieldProcessor(VOID);
+
+//
+// Interlocked operations.
+//
+static inline LONG InterlockedExchange(volatile LONG* Target, LONG Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline PVOID InterlockedExchangePointer(PVOID volatile* Target, PVOID Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedIncrement(volatile LONG* Addend)
+{
+    return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG* Addend)
+{
+    return __atomic_sub_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+#define KeMemoryBarrier()                           __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+//
+// Dispatcher objects and system threads, implemented in KeShim.c. Events
+// and threads share a header, so KeWaitForSingleObject takes either.
+//
+typedef enum _EVENT_TYPE {
+    NotificationEvent,
+    SynchronizationEvent,
+} EVENT_TYPE;
+
+typedef enum _KWAIT_REASON {
+    Executive,
+} KWAIT_REASON;
+
+typedef struct _DISPATCHER_HEADER {
+    EVENT_TYPE Type;
+    LONG SignalState;
+    pthread_mutex_t Lock;
+    pthread_cond_t Signaled;
+} DISPATCHER_HEADER;
+
+typedef struct _KEVENT {
+    DISPATCHER_HEADER Header;
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+typedef LONG KPRIORITY;
+typedef ULONG ACCESS_MASK;
+typedef struct _OBJECT_TYPE* POBJECT_TYPE;
+typedef struct _CLIENT_ID* PCLIENT_ID;
+
+typedef struct _OBJECT_ATTRIBUTES {
+    ULONG Length;
+    HANDLE RootDirectory;
+    PUNICODE_STRING ObjectName;
+    ULONG Attributes;
+    PVOID SecurityDescriptor;
+    PVOID SecurityQualityOfService;
+} OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+
+#define OBJ_KERNEL_HANDLE                   0x00000200L
+#define THREAD_ALL_ACCESS                   0x001FFFFFL
+#define IO_NO_INCREMENT                     0
+
+#define InitializeObjectAttributes(p, n, a, r, s) \
+    do { \
+        (p)->Length = sizeof(OBJECT_ATTRIBUTES); \
+        (p)->RootDirectory = (r); \
+        (p)->Attributes = (a); \
+        (p)->ObjectName = (n); \
+        (p)->SecurityDescriptor = (s); \
+        (p)->SecurityQualityOfService = NULL; \
+    } while (0)
+
+typedef VOID KSTART_ROUTINE(PVOID StartContext);
+typedef KSTART_ROUTINE* PKSTART_ROUTINE;
+
+extern POBJECT_TYPE* PsThreadType;
+
+VOID KeInitializeEvent(PRKEVENT Event, EVENT_TYPE Type, BOOLEAN State);
+LONG KeSetEvent(PRKEVENT Event, KPRIORITY Increment, BOOLEAN Wait);
+VOID KeClearEvent(PRKEVENT Event);
+NTSTATUS KeWaitForSingleObject(PVOID Object, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Timeout);
+
+NTSTATUS PsCreateSystemThread(HANDLE* ThreadHandle, ULONG DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes, HANDLE ProcessHandle,
+                              PCLIENT_ID ClientId, PKSTART_ROUTINE StartRoutine, PVOID StartContext);
+NTSTATUS PsTerminateSystemThread(NTSTATUS ExitStatus);
+NTSTATUS ObReferenceObjectByHandle(HANDLE Handle, ACCESS_MASK DesiredAccess, POBJECT_TYPE ObjectType, KPROCESSOR_MODE AccessMode,
+                                   PVOID* Object, PVOID HandleInformation);
+VOID ObDereferenceObject(PVOID Object);
+NTSTATUS ZwClose(HANDLE Handle);
+
+//
+// Configuration space through the HAL.
+//
+typedef enum _BUS_DATA_TYPE {
+    Cmos,
+    EisaSlotInformation,
+    Cmos1,
+    Pos,
+    CbusConfiguration,
+    PCIConfiguration,
+} BUS_DATA_TYPE;
+
+typedef struct _PCI_SLOT_NUMBER {
+    union {
+        struct {
+            ULONG DeviceNumber:5;
+            ULONG FunctionNumber:3;
+            ULONG Reserved:24;
+        } bits;
+        ULONG AsULONG;
+    } u;
+} PCI_SLOT_NUMBER, *PPCI_SLOT_NUMBER;
+
+ULONG HalGetBusDataByOffset(BUS_DATA_TYPE BusDataType, ULONG BusNumber, ULONG SlotNumber, PVOID Buffer, ULONG Offset, ULONG Length);
+ULONG HalSetBusDataByOffset(BUS_DATA_TYPE BusDataType, ULONG BusNumber, ULONG SlotNumber, PVOID Buffer, ULONG Offset, ULONG Length);
+
+//
+// MMIO.
+//
+typedef enum _MEMORY_CACHING_TYPE {
+    MmNonCached,
+    MmCached,
+    MmWriteCombined,
+} MEMORY_CACHING_TYPE;
+
+PVOID MmMapIoSpace(PHYSICAL_ADDRESS PhysicalAddress, SIZE_T NumberOfBytes, MEMORY_CACHING_TYPE CacheType);
+VOID MmUnmapIoSpace(PVOID BaseAddress, SIZE_T NumberOfBytes);
+
+UCHAR READ_REGISTER_UCHAR(volatile UCHAR* Register);
+USHORT READ_REGISTER_USHORT(volatile USHORT* Register);
+ULONG READ_REGISTER_ULONG(volatile ULONG* Register);
+ULONG64 READ_REGISTER_ULONG64(volatile ULONG64* Register);
+VOID READ_REGISTER_BUFFER_UCHAR(volatile UCHAR* Register, PUCHAR Buffer, ULONG Count);
+VOID READ_REGISTER_BUFFER_ULONG(volatile ULONG* Register, PULONG Buffer, ULONG Count);
+VOID READ_REGISTER_BUFFER_ULONG64(volatile ULONG64* Register, ULONG64* Buffer, ULONG Count);
+VOID WRITE_REGISTER_UCHAR(volatile UCHAR* Register, UCHAR Value);
+VOID WRITE_REGISTER_USHORT(volatile USHORT* Register, USHORT Value);
+VOID WRITE_REGISTER_ULONG(volatile ULONG* Register, ULONG Value);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,269 @@
+/*++
+
+Module Name:
+
+    Windows.h
+
+Abstract:
+
+    User mode stand-in for the Win32 types and routines used by the user
+    mode libraries in this repository, so that they can be compiled with
+    g++ and run on Linux. Win32Shim.c serves the routines: CreateFile opens
+    the control device of the driver loaded through the WDF shim, files,
+    events and named pipes, which are carried over Unix domain sockets.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINAPI
+#define CALLBACK
+#define VOID void
+#define CONST const
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_opt_
+#define _Out_opt_
+#define _In_reads_(x)
+#define _In_reads_bytes_(x)
+#define _Out_writes_(x)
+#define _Out_writes_bytes_(x)
+#define _Out_writes_bytes_opt_(x)
+
+//
+// Same sizes as the kernel types of ..\include\ntddk.h, Win32Shim.c is
+// compiled against those.
+//
+typedef uint8_t UINT8, *PUINT8, UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN, *PBOOLEAN;
+typedef uint16_t UINT16, *PUINT16, USHORT, *PUSHORT, WORD;
+typedef uint32_t UINT32, *PUINT32, ULONG, *PULONG, DWORD, *PDWORD, *LPDWORD, UINT;
+typedef int32_t INT32, LONG, *PLONG, BOOL, INT;
+typedef uint64_t UINT64, *PUINT64, ULONG64, *PULONG64, ULONGLONG, DWORD64;
+typedef int64_t INT64, LONGLONG, LONG64;
+typedef size_t SIZE_T, *PSIZE_T;
+typedef uintptr_t ULONG_PTR, DWORD_PTR;
+typedef char CHAR, *PCHAR, *LPSTR;
+typedef const char *PCSTR, *LPCSTR;
+typedef wchar_t WCHAR, *PWSTR, *LPWSTR;
+typedef const wchar_t *PCWSTR, *LPCWSTR;
+typedef void *PVOID, *LPVOID, *HANDLE;
+typedef const void* LPCVOID;
+
+#define TRUE    1
+#define FALSE   0
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    union {
+        struct {
+            DWORD Offset;
+            DWORD OffsetHigh;
+        };
+        PVOID Pointer;
+    };
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _SECURITY_ATTRIBUTES {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+#define INVALID_HANDLE_VALUE                ((HANDLE)(intptr_t)-1)
+#define INFINITE                            0xFFFFFFFF
+#define MAXDWORD                            0xFFFFFFFF
+#define MAX_PATH                            260
+
+#define ERROR_SUCCESS                       0
+#define ERROR_INVALID_FUNCTION              1
+#define ERROR_FILE_NOT_FOUND                2
+#define ERROR_ACCESS_DENIED                 5
+#define ERROR_INVALID_HANDLE                6
+#define ERROR_NOT_ENOUGH_MEMORY             8
+#define ERROR_GEN_FAILURE                   31
+#define ERROR_HANDLE_EOF                    38
+#define ERROR_NOT_SUPPORTED                 50
+#define ERROR_FILE_EXISTS                   80
+#define ERROR_INVALID_PARAMETER             87
+#define ERROR_BROKEN_PIPE                   109
+#define ERROR_INSUFFICIENT_BUFFER           122
+#define ERROR_BUSY                          170
+#define ERROR_ALREADY_EXISTS                183
+#define ERROR_PIPE_BUSY                     231
+#define ERROR_NO_DATA                       232
+#define ERROR_PIPE_NOT_CONNECTED            233
+#define ERROR_MORE_DATA                     234
+#define ERROR_PIPE_CONNECTED                535
+#define ERROR_BAD_COMPRESSION_BUFFER        605
+#define ERROR_OPERATION_ABORTED             995
+#define ERROR_IO_INCOMPLETE                 996
+#define ERROR_IO_PENDING                    997
+#define ERROR_NOACCESS                      998
+#define ERROR_NOT_FOUND                     1168
+#define ERROR_NO_SYSTEM_RESOURCES           1450
+#define ERROR_TIMEOUT                       1460
+
+#define GENERIC_READ                        0x80000000
+#define GENERIC_WRITE                       0x40000000
+#define FILE_SHARE_READ                     0x00000001
+#define FILE_SHARE_WRITE                    0x00000002
+#define CREATE_NEW                          1
+#define CREATE_ALWAYS                       2
+#define OPEN_EXISTING                       3
+#define OPEN_ALWAYS                         4
+#define TRUNCATE_EXISTING                   5
+#define FILE_ATTRIBUTE_NORMAL               0x00000080
+#define FILE_FLAG_FIRST_PIPE_INSTANCE       0x00080000
+#define FILE_FLAG_SEQUENTIAL_SCAN           0x08000000
+#define FILE_FLAG_NO_BUFFERING              0x20000000
+#define FILE_FLAG_OVERLAPPED                0x40000000
+#define FILE_BEGIN                          0
+#define FILE_CURRENT                        1
+#define FILE_END                            2
+
+#define PIPE_ACCESS_INBOUND                 0x00000001
+#define PIPE_ACCESS_OUTBOUND                0x00000002
+#define PIPE_ACCESS_DUPLEX                  0x00000003
+#define PIPE_WAIT                           0x00000000
+#define PIPE_READMODE_MESSAGE               0x00000002
+#define PIPE_TYPE_MESSAGE                   0x00000004
+#define PIPE_REJECT_REMOTE_CLIENTS          0x00000008
+#define PIPE_UNLIMITED_INSTANCES            255
+#define NMPWAIT_USE_DEFAULT_WAIT            0x00000000
+#define NMPWAIT_WAIT_FOREVER                0xFFFFFFFF
+
+#define WAIT_OBJECT_0                       0x00000000
+#define WAIT_TIMEOUT                        0x00000102
+#define WAIT_FAILED                         0xFFFFFFFF
+#define MAXIMUM_WAIT_OBJECTS                64
+
+#define MEM_COMMIT                          0x00001000
+#define MEM_RESERVE                         0x00002000
+#define MEM_RELEASE                         0x00008000
+#define PAGE_READONLY                       0x02
+#define PAGE_READWRITE                      0x04
+#define FILE_MAP_READ                       0x0004
+#define MAX_COMPUTERNAME_LENGTH             15
+
+#define METHOD_BUFFERED                     0
+#define METHOD_IN_DIRECT                    1
+#define METHOD_OUT_DIRECT                   2
+#define METHOD_NEITHER                      3
+#define FILE_ANY_ACCESS                     0
+#define FILE_READ_ACCESS                    1
+#define FILE_WRITE_ACCESS                   2
+
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+    (((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+#define UNREFERENCED_PARAMETER(P)           ((void)(P))
+#define ZeroMemory(Destination, Length)     memset((Destination), 0, (Length))
+#define CopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length)  memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlMoveMemory(Destination, Source, Length) memmove((Destination), (Source), (Length))
+#define MemoryBarrier()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define YieldProcessor()                    __asm__ __volatile__("" ::: "memory")
+
+//
+// STATUS_PENDING, the I/O is still in flight.
+//
+#define HasOverlappedIoCompleted(lpOverlapped) (((DWORD)(lpOverlapped)->Internal) != 0x00000103)
+
+//
+// Errors.
+//
+DWORD GetLastError(VOID);
+VOID SetLastError(DWORD dwErrCode);
+
+//
+// Handles, files and devices. A name of the form \\.\Name opens the
+// control device whose symbolic link ends in Name, \\.\pipe\Name a named
+// pipe and any other name a file.
+//
+HANDLE CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+                   DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+BOOL CloseHandle(HANDLE hObject);
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped);
+BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped);
+BOOL FlushFileBuffers(HANDLE hFile);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod);
+BOOL SetEndOfFile(HANDLE hFile);
+BOOL DeviceIoControl(HANDLE hDevice, DWORD dwIoControlCode, LPVOID lpInBuffer, DWORD nInBufferSize, LPVOID lpOutBuffer,
+                     DWORD nOutBufferSize, LPDWORD lpBytesReturned, LPOVERLAPPED lpOverlapped);
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED lpOverlapped, LPDWORD lpNumberOfBytesTransferred, BOOL bWait);
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED lpOverlapped);
+
+//
+// Named pipes. Only message pipes are served, a message longer than the
+// buffer of a read fails with ERROR_MORE_DATA and its rest is dropped.
+//
+HANDLE CreateNamedPipeA(LPCSTR lpName, DWORD dwOpenMode, DWORD dwPipeMode, DWORD nMaxInstances, DWORD nOutBufferSize,
+                        DWORD nInBufferSize, DWORD nDefaultTimeOut, LPSECURITY_ATTRIBUTES lpSecurityAttributes);
+BOOL ConnectNamedPipe(HANDLE hNamedPipe, LPOVERLAPPED lpOverlapped);
+BOOL DisconnectNamedPipe(HANDLE hNamedPipe);
+BOOL WaitNamedPipeA(LPCSTR lpNamedPipeName, DWORD nTimeOut);
+BOOL SetNamedPipeHandleState(HANDLE hNamedPipe, LPDWORD lpMode, LPDWORD lpMaxCollectionCount, LPDWORD lpCollectDataTimeout);
+BOOL TransactNamedPipe(HANDLE hNamedPipe, LPVOID lpInBuffer, DWORD nInBufferSize, LPVOID lpOutBuffer, DWORD nOutBufferSize,
+                       LPDWORD lpBytesRead, LPOVERLAPPED lpOverlapped);
+
+//
+// Events and waits.
+//
+HANDLE CreateEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName);
+BOOL SetEvent(HANDLE hEvent);
+BOOL ResetEvent(HANDLE hEvent);
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE* lpHandles, BOOL bWaitAll, DWORD dwMilliseconds);
+
+//
+// File mappings. Only whole files are mapped, read-only.
+//
+HANDLE CreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh,
+                          DWORD dwMaximumSizeLow, LPCSTR lpName);
+LPVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow,
+                     SIZE_T dwNumberOfBytesToMap);
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress);
+
+//
+// Memory, time and threads.
+//
+LPVOID VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
+BOOL VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
+BOOL QueryPerformanceCounter(PLARGE_INTEGER lpPerformanceCount);
+BOOL QueryPerformanceFrequency(PLARGE_INTEGER lpFrequency);
+ULONGLONG GetTickCount64(VOID);
+VOID Sleep(DWORD dwMilliseconds);
+BOOL SwitchToThread(VOID);
+BOOL GetComputerNameA(LPSTR lpBuffer, LPDWORD nSize);
+
+#ifdef __cplusplus
+}
+#endif
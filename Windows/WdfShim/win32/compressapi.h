@@ -0,0 +1,60 @@
+/*++
+
+Module Name:
+
+    compressapi.h
+
+Abstract:
+
+    User mode stand-in for the buffer mode routines of the Windows
+    Compression API, served by Win32Compress.c. Only XPRESS is offered,
+    as the Plain LZ77 format of [MS-XCA] without the header Windows puts
+    in front of buffer mode output, so data compressed here round trips
+    through this file and is not meant to be expanded on Windows.
+
+Environment:
+
+    user mode (Linux)
+
+--*/
+
+#pragma once
+
+#include <Windows.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COMPRESS_ALGORITHM_XPRESS           3
+
+typedef struct _COMPRESSOR_HANDLE* COMPRESSOR_HANDLE;
+typedef COMPRESSOR_HANDLE* PCOMPRESSOR_HANDLE;
+typedef COMPRESSOR_HANDLE DECOMPRESSOR_HANDLE;
+typedef COMPRESSOR_HANDLE* PDECOMPRESSOR_HANDLE;
+
+//
+// Accepted for the signatures, the handles always use malloc.
+//
+typedef PVOID (*PFN_COMPRESS_ALLOCATE)(PVOID UserContext, SIZE_T Size);
+typedef VOID (*PFN_COMPRESS_FREE)(PVOID UserContext, PVOID Memory);
+
+typedef struct _COMPRESS_ALLOCATION_ROUTINES {
+    PFN_COMPRESS_ALLOCATE Allocate;
+    PFN_COMPRESS_FREE Free;
+    PVOID UserContext;
+} COMPRESS_ALLOCATION_ROUTINES, *PCOMPRESS_ALLOCATION_ROUTINES;
+
+BOOL CreateCompressor(DWORD Algorithm, PCOMPRESS_ALLOCATION_ROUTINES AllocationRoutines, PCOMPRESSOR_HANDLE CompressorHandle);
+BOOL CloseCompressor(COMPRESSOR_HANDLE CompressorHandle);
+BOOL Compress(COMPRESSOR_HANDLE CompressorHandle, LPCVOID UncompressedData, SIZE_T UncompressedDataSize, PVOID CompressedBuffer,
+              SIZE_T CompressedBufferSize, PSIZE_T CompressedDataSize);
+
+BOOL CreateDecompressor(DWORD Algorithm, PCOMPRESS_ALLOCATION_ROUTINES AllocationRoutines, PDECOMPRESSOR_HANDLE DecompressorHandle);
+BOOL CloseDecompressor(DECOMPRESSOR_HANDLE DecompressorHandle);
+BOOL Decompress(DECOMPRESSOR_HANDLE DecompressorHandle, LPCVOID CompressedData, SIZE_T CompressedDataSize, PVOID UncompressedBuffer,
+                SIZE_T UncompressedBufferSize, PSIZE_T UncompressedDataSize);
+
+#ifdef __cplusplus
+}
+#endif